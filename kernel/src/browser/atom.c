@@ -0,0 +1,231 @@
+#include "atom.h"
+#include "html/arena.h"
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <pthread.h>
+
+#define ATOM_PAGE_SHIFT 10
+#define ATOM_PAGE_SIZE (1u << ATOM_PAGE_SHIFT)
+#define ATOM_MAX_PAGES 4096
+#define ATOM_INITIAL_BUCKETS 1024
+
+typedef struct {
+    const char* str;
+    uint32_t length;
+    uint32_t hash;
+    uint32_t flags;
+} atom_entry_t;
+
+// Entries live in fixed pages that never move, so readers can map an atom
+// to its string without locking while other threads intern.
+static struct {
+    atom_entry_t* pages[ATOM_MAX_PAGES];
+    uint32_t count;
+    atom_t* buckets;
+    uint32_t bucket_mask;
+    dom_arena_t* strings;
+    pthread_mutex_t lock;
+} atom_table = {
+    .lock = PTHREAD_MUTEX_INITIALIZER
+};
+
+static pthread_once_t atom_table_once = PTHREAD_ONCE_INIT;
+
+static uint32_t atom_hash_string(const char* str, uint32_t length) {
+    uint32_t hash = 2166136261u;
+    for (uint32_t i = 0; i < length; i++) {
+        hash ^= (uint8_t)str[i];
+        hash *= 16777619u;
+    }
+    return hash ? hash : 1;
+}
+
+static atom_entry_t* atom_entry(atom_t atom) {
+    atom_entry_t* page = atom_table.pages[atom >> ATOM_PAGE_SHIFT];
+    return page ? &page[atom & (ATOM_PAGE_SIZE - 1)] : NULL;
+}
+
+static bool atom_grow_buckets(void) {
+    uint32_t new_size = (atom_table.bucket_mask + 1) * 2;
+    atom_t* new_buckets = calloc(new_size, sizeof(atom_t));
+    if (!new_buckets) return false;
+    
+    for (atom_t atom = 1; atom < atom_table.count; atom++) {
+        uint32_t index = atom_entry(atom)->hash & (new_size - 1);
+        while (new_buckets[index]) {
+            index = (index + 1) & (new_size - 1);
+        }
+        new_buckets[index] = atom;
+    }
+    
+    free(atom_table.buckets);
+    atom_table.buckets = new_buckets;
+    atom_table.bucket_mask = new_size - 1;
+    return true;
+}
+
+// Caller holds the lock
+static atom_t atom_find_locked(const char* str, uint32_t length, uint32_t hash) {
+    uint32_t index = hash & atom_table.bucket_mask;
+    while (atom_table.buckets[index]) {
+        atom_t atom = atom_table.buckets[index];
+        atom_entry_t* entry = atom_entry(atom);
+        if (entry->hash == hash && entry->length == length && memcmp(entry->str, str, length) == 0) {
+            return atom;
+        }
+        index = (index + 1) & atom_table.bucket_mask;
+    }
+    return ATOM_NULL;
+}
+
+// Caller holds the lock
+static atom_t atom_insert_locked(const char* str, uint32_t length, uint32_t hash, uint32_t flags) {
+    atom_t atom = atom_table.count;
+    uint32_t page_index = atom >> ATOM_PAGE_SHIFT;
+    if (page_index >= ATOM_MAX_PAGES) return ATOM_NULL;
+    
+    if (!atom_table.pages[page_index]) {
+        atom_table.pages[page_index] = calloc(ATOM_PAGE_SIZE, sizeof(atom_entry_t));
+        if (!atom_table.pages[page_index]) return ATOM_NULL;
+    }
+    
+    // Keep load factor under one half
+    if ((atom_table.count + 1) * 2 > atom_table.bucket_mask + 1 && !atom_grow_buckets()) {
+        return ATOM_NULL;
+    }
+    
+    char* copy = dom_arena_strndup(atom_table.strings, str, length);
+    if (!copy) return ATOM_NULL;
+    
+    atom_entry_t* entry = atom_entry(atom);
+    entry->str = copy;
+    entry->length = length;
+    entry->hash = hash;
+    entry->flags = flags;
+    
+    uint32_t index = hash & atom_table.bucket_mask;
+    while (atom_table.buckets[index]) {
+        index = (index + 1) & atom_table.bucket_mask;
+    }
+    atom_table.buckets[index] = atom;
+    
+    // Publish the entry before the atom can be handed out
+    __atomic_store_n(&atom_table.count, atom + 1, __ATOMIC_RELEASE);
+    return atom;
+}
+
+static void atom_table_init(void) {
+    atom_table.strings = dom_arena_create();
+    atom_table.buckets = calloc(ATOM_INITIAL_BUCKETS, sizeof(atom_t));
+    atom_table.bucket_mask = ATOM_INITIAL_BUCKETS - 1;
+    if (!atom_table.strings || !atom_table.buckets) return;
+    
+    // Atom 0 is ATOM_NULL
+    atom_table.pages[0] = calloc(ATOM_PAGE_SIZE, sizeof(atom_entry_t));
+    if (!atom_table.pages[0]) return;
+    atom_table.count = 1;
+    
+    // Static atoms are inserted in enum order so their ids match
+#define BROWSER_ATOM_INSERT(id, str, flags) \
+    atom_insert_locked(str, sizeof(str) - 1, atom_hash_string(str, sizeof(str) - 1), flags);
+    BROWSER_STATIC_ATOMS(BROWSER_ATOM_INSERT)
+#undef BROWSER_ATOM_INSERT
+}
+
+atom_t atom_intern_len(const char* str, uint32_t length) {
+    if (!str) return ATOM_NULL;
+    pthread_once(&atom_table_once, atom_table_init);
+    if (!atom_table.buckets) return ATOM_NULL;
+    
+    uint32_t hash = atom_hash_string(str, length);
+    
+    pthread_mutex_lock(&atom_table.lock);
+    atom_t atom = atom_find_locked(str, length, hash);
+    if (!atom) {
+        atom = atom_insert_locked(str, length, hash, 0);
+    }
+    pthread_mutex_unlock(&atom_table.lock);
+    
+    return atom;
+}
+
+atom_t atom_intern(const char* str) {
+    if (!str) return ATOM_NULL;
+    return atom_intern_len(str, (uint32_t)strlen(str));
+}
+
+// Run fn on the ASCII-lowercased form, as HTML tag and attribute names require
+static atom_t atom_with_lower(const char* str, uint32_t length, atom_t (*fn)(const char*, uint32_t)) {
+    if (!str) return ATOM_NULL;
+    
+    char small[64];
+    char* lower = length < sizeof(small) ? small : malloc(length);
+    if (!lower) return ATOM_NULL;
+    
+    for (uint32_t i = 0; i < length; i++) {
+        lower[i] = (char)tolower((unsigned char)str[i]);
+    }
+    
+    atom_t atom = fn(lower, length);
+    if (lower != small) free(lower);
+    return atom;
+}
+
+atom_t atom_intern_lower(const char* str, uint32_t length) {
+    return atom_with_lower(str, length, atom_intern_len);
+}
+
+// Find an existing atom without creating one
+atom_t atom_lookup_len(const char* str, uint32_t length) {
+    if (!str) return ATOM_NULL;
+    pthread_once(&atom_table_once, atom_table_init);
+    if (!atom_table.buckets) return ATOM_NULL;
+    
+    uint32_t hash = atom_hash_string(str, length);
+    
+    pthread_mutex_lock(&atom_table.lock);
+    atom_t atom = atom_find_locked(str, length, hash);
+    pthread_mutex_unlock(&atom_table.lock);
+    
+    return atom;
+}
+
+atom_t atom_lookup_lower(const char* str, uint32_t length) {
+    return atom_with_lower(str, length, atom_lookup_len);
+}
+
+atom_t atom_lookup(const char* str) {
+    if (!str) return ATOM_NULL;
+    return atom_lookup_len(str, (uint32_t)strlen(str));
+}
+
+const char* atom_string(atom_t atom) {
+    if (atom == ATOM_NULL || atom >= __atomic_load_n(&atom_table.count, __ATOMIC_ACQUIRE)) return NULL;
+    return atom_entry(atom)->str;
+}
+
+uint32_t atom_length(atom_t atom) {
+    if (atom == ATOM_NULL || atom >= __atomic_load_n(&atom_table.count, __ATOMIC_ACQUIRE)) return 0;
+    return atom_entry(atom)->length;
+}
+
+uint32_t atom_hash(atom_t atom) {
+    if (atom == ATOM_NULL || atom >= __atomic_load_n(&atom_table.count, __ATOMIC_ACQUIRE)) return 0;
+    return atom_entry(atom)->hash;
+}
+
+uint32_t atom_flags(atom_t atom) {
+    // Only static atoms carry flags
+    if (atom == ATOM_NULL || atom >= ATOM_STATIC_COUNT) return 0;
+    pthread_once(&atom_table_once, atom_table_init);
+    return atom_entry(atom)->flags;
+}
+
+bool atom_has_flag(atom_t atom, uint32_t flag) {
+    return (atom_flags(atom) & flag) != 0;
+}
+
+uint32_t atom_count(void) {
+    return __atomic_load_n(&atom_table.count, __ATOMIC_ACQUIRE);
+}
\ No newline at end of file
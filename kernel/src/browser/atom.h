@@ -0,0 +1,307 @@
+#ifndef BROWSER_ATOM_H
+#define BROWSER_ATOM_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Interned string identifier. Equal strings always map to the same atom,
+// so tag names, attribute names, ids, classes and CSS identifiers compare
+// with a single integer compare and are stored once per process.
+typedef uint32_t atom_t;
+
+// Atom classification flags
+#define ATOM_FLAG_TAG           0x01
+#define ATOM_FLAG_VOID          0x02    // Void HTML element
+#define ATOM_FLAG_SPECIAL       0x04    // HTML "special" category
+#define ATOM_FLAG_FORMATTING    0x08    // HTML formatting element
+#define ATOM_FLAG_ATTRIBUTE     0x10
+#define ATOM_FLAG_PROPERTY      0x20    // CSS property
+#define ATOM_FLAG_INHERITED     0x40    // Inherited CSS property
+#define ATOM_FLAG_PAINT_ONLY    0x80    // Changing it never affects layout
+
+// Atoms known at compile time: X(identifier, string, flags)
+#define BROWSER_STATIC_ATOMS(X) \
+    X(address, "address", ATOM_FLAG_TAG | ATOM_FLAG_SPECIAL) \
+    X(applet, "applet", ATOM_FLAG_TAG | ATOM_FLAG_SPECIAL) \
+    X(area, "area", ATOM_FLAG_TAG | ATOM_FLAG_VOID | ATOM_FLAG_SPECIAL) \
+    X(article, "article", ATOM_FLAG_TAG | ATOM_FLAG_SPECIAL) \
+    X(aside, "aside", ATOM_FLAG_TAG | ATOM_FLAG_SPECIAL) \
+    X(base, "base", ATOM_FLAG_TAG | ATOM_FLAG_VOID | ATOM_FLAG_SPECIAL) \
+    X(basefont, "basefont", ATOM_FLAG_TAG | ATOM_FLAG_SPECIAL) \
+    X(bgsound, "bgsound", ATOM_FLAG_TAG | ATOM_FLAG_SPECIAL) \
+    X(blockquote, "blockquote", ATOM_FLAG_TAG | ATOM_FLAG_SPECIAL) \
+    X(body, "body", ATOM_FLAG_TAG | ATOM_FLAG_SPECIAL) \
+    X(br, "br", ATOM_FLAG_TAG | ATOM_FLAG_VOID | ATOM_FLAG_SPECIAL) \
+    X(button, "button", ATOM_FLAG_TAG | ATOM_FLAG_SPECIAL) \
+    X(caption, "caption", ATOM_FLAG_TAG | ATOM_FLAG_SPECIAL) \
+    X(center, "center", ATOM_FLAG_TAG | ATOM_FLAG_SPECIAL) \
+    X(col, "col", ATOM_FLAG_TAG | ATOM_FLAG_VOID | ATOM_FLAG_SPECIAL) \
+    X(colgroup, "colgroup", ATOM_FLAG_TAG | ATOM_FLAG_SPECIAL) \
+    X(dd, "dd", ATOM_FLAG_TAG | ATOM_FLAG_SPECIAL) \
+    X(details, "details", ATOM_FLAG_TAG | ATOM_FLAG_SPECIAL) \
+    X(dir, "dir", ATOM_FLAG_TAG | ATOM_FLAG_SPECIAL | ATOM_FLAG_ATTRIBUTE) \
+    X(div, "div", ATOM_FLAG_TAG | ATOM_FLAG_SPECIAL) \
+    X(dl, "dl", ATOM_FLAG_TAG | ATOM_FLAG_SPECIAL) \
+    X(dt, "dt", ATOM_FLAG_TAG | ATOM_FLAG_SPECIAL) \
+    X(embed, "embed", ATOM_FLAG_TAG | ATOM_FLAG_VOID | ATOM_FLAG_SPECIAL) \
+    X(fieldset, "fieldset", ATOM_FLAG_TAG | ATOM_FLAG_SPECIAL) \
+    X(figcaption, "figcaption", ATOM_FLAG_TAG | ATOM_FLAG_SPECIAL) \
+    X(figure, "figure", ATOM_FLAG_TAG | ATOM_FLAG_SPECIAL) \
+    X(footer, "footer", ATOM_FLAG_TAG | ATOM_FLAG_SPECIAL) \
+    X(form, "form", ATOM_FLAG_TAG | ATOM_FLAG_SPECIAL) \
+    X(frame, "frame", ATOM_FLAG_TAG | ATOM_FLAG_SPECIAL) \
+    X(frameset, "frameset", ATOM_FLAG_TAG | ATOM_FLAG_SPECIAL) \
+    X(h1, "h1", ATOM_FLAG_TAG | ATOM_FLAG_SPECIAL) \
+    X(h2, "h2", ATOM_FLAG_TAG | ATOM_FLAG_SPECIAL) \
+    X(h3, "h3", ATOM_FLAG_TAG | ATOM_FLAG_SPECIAL) \
+    X(h4, "h4", ATOM_FLAG_TAG | ATOM_FLAG_SPECIAL) \
+    X(h5, "h5", ATOM_FLAG_TAG | ATOM_FLAG_SPECIAL) \
+    X(h6, "h6", ATOM_FLAG_TAG | ATOM_FLAG_SPECIAL) \
+    X(head, "head", ATOM_FLAG_TAG | ATOM_FLAG_SPECIAL) \
+    X(header, "header", ATOM_FLAG_TAG | ATOM_FLAG_SPECIAL) \
+    X(hgroup, "hgroup", ATOM_FLAG_TAG | ATOM_FLAG_SPECIAL) \
+    X(hr, "hr", ATOM_FLAG_TAG | ATOM_FLAG_VOID | ATOM_FLAG_SPECIAL) \
+    X(html, "html", ATOM_FLAG_TAG | ATOM_FLAG_SPECIAL) \
+    X(iframe, "iframe", ATOM_FLAG_TAG | ATOM_FLAG_SPECIAL) \
+    X(img, "img", ATOM_FLAG_TAG | ATOM_FLAG_VOID | ATOM_FLAG_SPECIAL) \
+    X(input, "input", ATOM_FLAG_TAG | ATOM_FLAG_VOID | ATOM_FLAG_SPECIAL) \
+    X(keygen, "keygen", ATOM_FLAG_TAG | ATOM_FLAG_SPECIAL) \
+    X(li, "li", ATOM_FLAG_TAG | ATOM_FLAG_SPECIAL) \
+    X(link, "link", ATOM_FLAG_TAG | ATOM_FLAG_VOID | ATOM_FLAG_SPECIAL) \
+    X(listing, "listing", ATOM_FLAG_TAG | ATOM_FLAG_SPECIAL) \
+    X(main, "main", ATOM_FLAG_TAG | ATOM_FLAG_SPECIAL) \
+    X(marquee, "marquee", ATOM_FLAG_TAG | ATOM_FLAG_SPECIAL) \
+    X(menu, "menu", ATOM_FLAG_TAG | ATOM_FLAG_SPECIAL) \
+    X(meta, "meta", ATOM_FLAG_TAG | ATOM_FLAG_VOID | ATOM_FLAG_SPECIAL) \
+    X(nav, "nav", ATOM_FLAG_TAG | ATOM_FLAG_SPECIAL) \
+    X(noembed, "noembed", ATOM_FLAG_TAG | ATOM_FLAG_SPECIAL) \
+    X(noframes, "noframes", ATOM_FLAG_TAG | ATOM_FLAG_SPECIAL) \
+    X(noscript, "noscript", ATOM_FLAG_TAG | ATOM_FLAG_SPECIAL) \
+    X(object, "object", ATOM_FLAG_TAG | ATOM_FLAG_SPECIAL) \
+    X(ol, "ol", ATOM_FLAG_TAG | ATOM_FLAG_SPECIAL) \
+    X(p, "p", ATOM_FLAG_TAG | ATOM_FLAG_SPECIAL) \
+    X(param, "param", ATOM_FLAG_TAG | ATOM_FLAG_VOID | ATOM_FLAG_SPECIAL) \
+    X(plaintext, "plaintext", ATOM_FLAG_TAG | ATOM_FLAG_SPECIAL) \
+    X(pre, "pre", ATOM_FLAG_TAG | ATOM_FLAG_SPECIAL) \
+    X(script, "script", ATOM_FLAG_TAG | ATOM_FLAG_SPECIAL) \
+    X(section, "section", ATOM_FLAG_TAG | ATOM_FLAG_SPECIAL) \
+    X(select, "select", ATOM_FLAG_TAG | ATOM_FLAG_SPECIAL) \
+    X(source, "source", ATOM_FLAG_TAG | ATOM_FLAG_VOID | ATOM_FLAG_SPECIAL) \
+    X(style, "style", ATOM_FLAG_TAG | ATOM_FLAG_SPECIAL | ATOM_FLAG_ATTRIBUTE) \
+    X(summary, "summary", ATOM_FLAG_TAG | ATOM_FLAG_SPECIAL) \
+    X(table, "table", ATOM_FLAG_TAG | ATOM_FLAG_SPECIAL) \
+    X(tbody, "tbody", ATOM_FLAG_TAG | ATOM_FLAG_SPECIAL) \
+    X(td, "td", ATOM_FLAG_TAG | ATOM_FLAG_SPECIAL) \
+    X(template, "template", ATOM_FLAG_TAG | ATOM_FLAG_SPECIAL) \
+    X(textarea, "textarea", ATOM_FLAG_TAG | ATOM_FLAG_SPECIAL) \
+    X(tfoot, "tfoot", ATOM_FLAG_TAG | ATOM_FLAG_SPECIAL) \
+    X(th, "th", ATOM_FLAG_TAG | ATOM_FLAG_SPECIAL) \
+    X(thead, "thead", ATOM_FLAG_TAG | ATOM_FLAG_SPECIAL) \
+    X(title, "title", ATOM_FLAG_TAG | ATOM_FLAG_SPECIAL | ATOM_FLAG_ATTRIBUTE) \
+    X(tr, "tr", ATOM_FLAG_TAG | ATOM_FLAG_SPECIAL) \
+    X(track, "track", ATOM_FLAG_TAG | ATOM_FLAG_VOID | ATOM_FLAG_SPECIAL) \
+    X(ul, "ul", ATOM_FLAG_TAG | ATOM_FLAG_SPECIAL) \
+    X(wbr, "wbr", ATOM_FLAG_TAG | ATOM_FLAG_VOID | ATOM_FLAG_SPECIAL) \
+    X(xmp, "xmp", ATOM_FLAG_TAG | ATOM_FLAG_SPECIAL) \
+    X(a, "a", ATOM_FLAG_TAG | ATOM_FLAG_FORMATTING) \
+    X(b, "b", ATOM_FLAG_TAG | ATOM_FLAG_FORMATTING) \
+    X(big, "big", ATOM_FLAG_TAG | ATOM_FLAG_FORMATTING) \
+    X(code, "code", ATOM_FLAG_TAG | ATOM_FLAG_FORMATTING) \
+    X(em, "em", ATOM_FLAG_TAG | ATOM_FLAG_FORMATTING) \
+    X(font, "font", ATOM_FLAG_TAG | ATOM_FLAG_FORMATTING | ATOM_FLAG_PROPERTY | ATOM_FLAG_INHERITED) \
+    X(i, "i", ATOM_FLAG_TAG | ATOM_FLAG_FORMATTING) \
+    X(nobr, "nobr", ATOM_FLAG_TAG | ATOM_FLAG_FORMATTING) \
+    X(s, "s", ATOM_FLAG_TAG | ATOM_FLAG_FORMATTING) \
+    X(small, "small", ATOM_FLAG_TAG | ATOM_FLAG_FORMATTING) \
+    X(strike, "strike", ATOM_FLAG_TAG | ATOM_FLAG_FORMATTING) \
+    X(strong, "strong", ATOM_FLAG_TAG | ATOM_FLAG_FORMATTING) \
+    X(tt, "tt", ATOM_FLAG_TAG | ATOM_FLAG_FORMATTING) \
+    X(u, "u", ATOM_FLAG_TAG | ATOM_FLAG_FORMATTING) \
+    X(span, "span", ATOM_FLAG_TAG) \
+    X(label, "label", ATOM_FLAG_TAG) \
+    X(option, "option", ATOM_FLAG_TAG) \
+    X(optgroup, "optgroup", ATOM_FLAG_TAG) \
+    X(canvas, "canvas", ATOM_FLAG_TAG) \
+    X(svg, "svg", ATOM_FLAG_TAG) \
+    X(video, "video", ATOM_FLAG_TAG) \
+    X(audio, "audio", ATOM_FLAG_TAG) \
+    X(picture, "picture", ATOM_FLAG_TAG) \
+    X(abbr, "abbr", ATOM_FLAG_TAG) \
+    X(cite, "cite", ATOM_FLAG_TAG) \
+    X(q, "q", ATOM_FLAG_TAG) \
+    X(sub, "sub", ATOM_FLAG_TAG) \
+    X(sup, "sup", ATOM_FLAG_TAG) \
+    X(mark, "mark", ATOM_FLAG_TAG) \
+    X(time, "time", ATOM_FLAG_TAG) \
+    X(var, "var", ATOM_FLAG_TAG) \
+    X(kbd, "kbd", ATOM_FLAG_TAG) \
+    X(samp, "samp", ATOM_FLAG_TAG) \
+    X(ins, "ins", ATOM_FLAG_TAG) \
+    X(del, "del", ATOM_FLAG_TAG) \
+    X(id, "id", ATOM_FLAG_ATTRIBUTE) \
+    X(class, "class", ATOM_FLAG_ATTRIBUTE) \
+    X(src, "src", ATOM_FLAG_ATTRIBUTE) \
+    X(href, "href", ATOM_FLAG_ATTRIBUTE) \
+    X(rel, "rel", ATOM_FLAG_ATTRIBUTE) \
+    X(type, "type", ATOM_FLAG_ATTRIBUTE) \
+    X(name, "name", ATOM_FLAG_ATTRIBUTE) \
+    X(value, "value", ATOM_FLAG_ATTRIBUTE) \
+    X(alt, "alt", ATOM_FLAG_ATTRIBUTE) \
+    X(width, "width", ATOM_FLAG_ATTRIBUTE | ATOM_FLAG_PROPERTY) \
+    X(height, "height", ATOM_FLAG_ATTRIBUTE | ATOM_FLAG_PROPERTY) \
+    X(lang, "lang", ATOM_FLAG_ATTRIBUTE) \
+    X(as, "as", ATOM_FLAG_ATTRIBUTE) \
+    X(media, "media", ATOM_FLAG_ATTRIBUTE) \
+    X(charset, "charset", ATOM_FLAG_ATTRIBUTE) \
+    X(content, "content", ATOM_FLAG_ATTRIBUTE) \
+    X(async, "async", ATOM_FLAG_ATTRIBUTE) \
+    X(defer, "defer", ATOM_FLAG_ATTRIBUTE) \
+    X(disabled, "disabled", ATOM_FLAG_ATTRIBUTE) \
+    X(checked, "checked", ATOM_FLAG_ATTRIBUTE) \
+    X(selected, "selected", ATOM_FLAG_ATTRIBUTE) \
+    X(hidden, "hidden", ATOM_FLAG_ATTRIBUTE) \
+    X(tabindex, "tabindex", ATOM_FLAG_ATTRIBUTE) \
+    X(role, "role", ATOM_FLAG_ATTRIBUTE) \
+    X(for, "for", ATOM_FLAG_ATTRIBUTE) \
+    X(action, "action", ATOM_FLAG_ATTRIBUTE) \
+    X(method, "method", ATOM_FLAG_ATTRIBUTE) \
+    X(colspan, "colspan", ATOM_FLAG_ATTRIBUTE) \
+    X(rowspan, "rowspan", ATOM_FLAG_ATTRIBUTE) \
+    X(color, "color", ATOM_FLAG_ATTRIBUTE | ATOM_FLAG_PROPERTY | ATOM_FLAG_INHERITED | ATOM_FLAG_PAINT_ONLY) \
+    X(font_family, "font-family", ATOM_FLAG_PROPERTY | ATOM_FLAG_INHERITED) \
+    X(font_size, "font-size", ATOM_FLAG_PROPERTY | ATOM_FLAG_INHERITED) \
+    X(font_style, "font-style", ATOM_FLAG_PROPERTY | ATOM_FLAG_INHERITED) \
+    X(font_weight, "font-weight", ATOM_FLAG_PROPERTY | ATOM_FLAG_INHERITED) \
+    X(font_variant, "font-variant", ATOM_FLAG_PROPERTY | ATOM_FLAG_INHERITED) \
+    X(line_height, "line-height", ATOM_FLAG_PROPERTY | ATOM_FLAG_INHERITED) \
+    X(letter_spacing, "letter-spacing", ATOM_FLAG_PROPERTY | ATOM_FLAG_INHERITED) \
+    X(word_spacing, "word-spacing", ATOM_FLAG_PROPERTY | ATOM_FLAG_INHERITED) \
+    X(text_align, "text-align", ATOM_FLAG_PROPERTY | ATOM_FLAG_INHERITED) \
+    X(text_indent, "text-indent", ATOM_FLAG_PROPERTY | ATOM_FLAG_INHERITED) \
+    X(text_transform, "text-transform", ATOM_FLAG_PROPERTY | ATOM_FLAG_INHERITED) \
+    X(white_space, "white-space", ATOM_FLAG_PROPERTY | ATOM_FLAG_INHERITED) \
+    X(visibility, "visibility", ATOM_FLAG_PROPERTY | ATOM_FLAG_INHERITED | ATOM_FLAG_PAINT_ONLY) \
+    X(cursor, "cursor", ATOM_FLAG_PROPERTY | ATOM_FLAG_INHERITED | ATOM_FLAG_PAINT_ONLY) \
+    X(direction, "direction", ATOM_FLAG_PROPERTY | ATOM_FLAG_INHERITED) \
+    X(list_style, "list-style", ATOM_FLAG_PROPERTY | ATOM_FLAG_INHERITED) \
+    X(list_style_type, "list-style-type", ATOM_FLAG_PROPERTY | ATOM_FLAG_INHERITED) \
+    X(list_style_position, "list-style-position", ATOM_FLAG_PROPERTY | ATOM_FLAG_INHERITED) \
+    X(quotes, "quotes", ATOM_FLAG_PROPERTY | ATOM_FLAG_INHERITED) \
+    X(pointer_events, "pointer-events", ATOM_FLAG_PROPERTY | ATOM_FLAG_INHERITED | ATOM_FLAG_PAINT_ONLY) \
+    X(display, "display", ATOM_FLAG_PROPERTY) \
+    X(position, "position", ATOM_FLAG_PROPERTY) \
+    X(float, "float", ATOM_FLAG_PROPERTY) \
+    X(clear, "clear", ATOM_FLAG_PROPERTY) \
+    X(margin, "margin", ATOM_FLAG_PROPERTY) \
+    X(margin_top, "margin-top", ATOM_FLAG_PROPERTY) \
+    X(margin_right, "margin-right", ATOM_FLAG_PROPERTY) \
+    X(margin_bottom, "margin-bottom", ATOM_FLAG_PROPERTY) \
+    X(margin_left, "margin-left", ATOM_FLAG_PROPERTY) \
+    X(padding, "padding", ATOM_FLAG_PROPERTY) \
+    X(padding_top, "padding-top", ATOM_FLAG_PROPERTY) \
+    X(padding_right, "padding-right", ATOM_FLAG_PROPERTY) \
+    X(padding_bottom, "padding-bottom", ATOM_FLAG_PROPERTY) \
+    X(padding_left, "padding-left", ATOM_FLAG_PROPERTY) \
+    X(border, "border", ATOM_FLAG_PROPERTY) \
+    X(border_width, "border-width", ATOM_FLAG_PROPERTY) \
+    X(border_style, "border-style", ATOM_FLAG_PROPERTY) \
+    X(border_color, "border-color", ATOM_FLAG_PROPERTY | ATOM_FLAG_PAINT_ONLY) \
+    X(border_radius, "border-radius", ATOM_FLAG_PROPERTY | ATOM_FLAG_PAINT_ONLY) \
+    X(border_top, "border-top", ATOM_FLAG_PROPERTY) \
+    X(border_right, "border-right", ATOM_FLAG_PROPERTY) \
+    X(border_bottom, "border-bottom", ATOM_FLAG_PROPERTY) \
+    X(border_left, "border-left", ATOM_FLAG_PROPERTY) \
+    X(min_width, "min-width", ATOM_FLAG_PROPERTY) \
+    X(min_height, "min-height", ATOM_FLAG_PROPERTY) \
+    X(max_width, "max-width", ATOM_FLAG_PROPERTY) \
+    X(max_height, "max-height", ATOM_FLAG_PROPERTY) \
+    X(top, "top", ATOM_FLAG_PROPERTY) \
+    X(right, "right", ATOM_FLAG_PROPERTY) \
+    X(bottom, "bottom", ATOM_FLAG_PROPERTY) \
+    X(left, "left", ATOM_FLAG_PROPERTY) \
+    X(box_sizing, "box-sizing", ATOM_FLAG_PROPERTY) \
+    X(text_decoration, "text-decoration", ATOM_FLAG_PROPERTY | ATOM_FLAG_PAINT_ONLY) \
+    X(background, "background", ATOM_FLAG_PROPERTY | ATOM_FLAG_PAINT_ONLY) \
+    X(background_color, "background-color", ATOM_FLAG_PROPERTY | ATOM_FLAG_PAINT_ONLY) \
+    X(background_image, "background-image", ATOM_FLAG_PROPERTY | ATOM_FLAG_PAINT_ONLY) \
+    X(background_repeat, "background-repeat", ATOM_FLAG_PROPERTY | ATOM_FLAG_PAINT_ONLY) \
+    X(background_attachment, "background-attachment", ATOM_FLAG_PROPERTY | ATOM_FLAG_PAINT_ONLY) \
+    X(background_position, "background-position", ATOM_FLAG_PROPERTY | ATOM_FLAG_PAINT_ONLY) \
+    X(background_size, "background-size", ATOM_FLAG_PROPERTY) \
+    X(flex, "flex", ATOM_FLAG_PROPERTY) \
+    X(flex_direction, "flex-direction", ATOM_FLAG_PROPERTY) \
+    X(flex_wrap, "flex-wrap", ATOM_FLAG_PROPERTY) \
+    X(flex_grow, "flex-grow", ATOM_FLAG_PROPERTY) \
+    X(flex_shrink, "flex-shrink", ATOM_FLAG_PROPERTY) \
+    X(flex_basis, "flex-basis", ATOM_FLAG_PROPERTY) \
+    X(justify_content, "justify-content", ATOM_FLAG_PROPERTY) \
+    X(align_items, "align-items", ATOM_FLAG_PROPERTY) \
+    X(align_self, "align-self", ATOM_FLAG_PROPERTY) \
+    X(order, "order", ATOM_FLAG_PROPERTY) \
+    X(gap, "gap", ATOM_FLAG_PROPERTY) \
+    X(grid, "grid", ATOM_FLAG_PROPERTY) \
+    X(grid_template_columns, "grid-template-columns", ATOM_FLAG_PROPERTY) \
+    X(grid_template_rows, "grid-template-rows", ATOM_FLAG_PROPERTY) \
+    X(grid_template_areas, "grid-template-areas", ATOM_FLAG_PROPERTY) \
+    X(grid_gap, "grid-gap", ATOM_FLAG_PROPERTY) \
+    X(grid_column, "grid-column", ATOM_FLAG_PROPERTY) \
+    X(grid_row, "grid-row", ATOM_FLAG_PROPERTY) \
+    X(overflow, "overflow", ATOM_FLAG_PROPERTY) \
+    X(overflow_x, "overflow-x", ATOM_FLAG_PROPERTY) \
+    X(overflow_y, "overflow-y", ATOM_FLAG_PROPERTY) \
+    X(opacity, "opacity", ATOM_FLAG_PROPERTY | ATOM_FLAG_PAINT_ONLY) \
+    X(transform, "transform", ATOM_FLAG_PROPERTY | ATOM_FLAG_PAINT_ONLY) \
+    X(transform_origin, "transform-origin", ATOM_FLAG_PROPERTY | ATOM_FLAG_PAINT_ONLY) \
+    X(transform_style, "transform-style", ATOM_FLAG_PROPERTY) \
+    X(perspective, "perspective", ATOM_FLAG_PROPERTY | ATOM_FLAG_PAINT_ONLY) \
+    X(transition, "transition", ATOM_FLAG_PROPERTY) \
+    X(animation, "animation", ATOM_FLAG_PROPERTY) \
+    X(z_index, "z-index", ATOM_FLAG_PROPERTY | ATOM_FLAG_PAINT_ONLY) \
+    X(user_select, "user-select", ATOM_FLAG_PROPERTY | ATOM_FLAG_PAINT_ONLY) \
+    X(vertical_align, "vertical-align", ATOM_FLAG_PROPERTY) \
+    X(border_top_width, "border-top-width", ATOM_FLAG_PROPERTY) \
+    X(border_right_width, "border-right-width", ATOM_FLAG_PROPERTY) \
+    X(border_bottom_width, "border-bottom-width", ATOM_FLAG_PROPERTY) \
+    X(border_left_width, "border-left-width", ATOM_FLAG_PROPERTY) \
+    X(border_top_color, "border-top-color", ATOM_FLAG_PROPERTY | ATOM_FLAG_PAINT_ONLY) \
+    X(border_right_color, "border-right-color", ATOM_FLAG_PROPERTY | ATOM_FLAG_PAINT_ONLY) \
+    X(border_bottom_color, "border-bottom-color", ATOM_FLAG_PROPERTY | ATOM_FLAG_PAINT_ONLY) \
+    X(border_left_color, "border-left-color", ATOM_FLAG_PROPERTY | ATOM_FLAG_PAINT_ONLY) \
+    X(border_top_left_radius, "border-top-left-radius", ATOM_FLAG_PROPERTY | ATOM_FLAG_PAINT_ONLY) \
+    X(border_top_right_radius, "border-top-right-radius", ATOM_FLAG_PROPERTY | ATOM_FLAG_PAINT_ONLY) \
+    X(border_bottom_right_radius, "border-bottom-right-radius", ATOM_FLAG_PROPERTY | ATOM_FLAG_PAINT_ONLY) \
+    X(border_bottom_left_radius, "border-bottom-left-radius", ATOM_FLAG_PROPERTY | ATOM_FLAG_PAINT_ONLY) \
+    X(background_position_x, "background-position-x", ATOM_FLAG_PROPERTY | ATOM_FLAG_PAINT_ONLY) \
+    X(background_position_y, "background-position-y", ATOM_FLAG_PROPERTY | ATOM_FLAG_PAINT_ONLY) \
+    X(auto, "auto", 0) \
+    X(none, "none", 0) \
+    X(normal, "normal", 0) \
+    X(inherit, "inherit", 0) \
+    X(initial, "initial", 0) \
+    X(length, "length", 0) \
+    X(prototype, "prototype", 0)
+
+typedef enum {
+    ATOM_NULL = 0,
+#define BROWSER_ATOM_ENUM(id, str, flags) ATOM_##id,
+    BROWSER_STATIC_ATOMS(BROWSER_ATOM_ENUM)
+#undef BROWSER_ATOM_ENUM
+    ATOM_STATIC_COUNT
+} atom_static_t;
+
+// Atom table API. Interning is thread safe; atom_string() and atom_flags()
+// never take a lock.
+atom_t atom_intern(const char* str);
+atom_t atom_intern_len(const char* str, uint32_t length);
+atom_t atom_intern_lower(const char* str, uint32_t length);
+atom_t atom_lookup(const char* str);
+atom_t atom_lookup_len(const char* str, uint32_t length);
+atom_t atom_lookup_lower(const char* str, uint32_t length);
+const char* atom_string(atom_t atom);
+uint32_t atom_length(atom_t atom);
+uint32_t atom_hash(atom_t atom);
+uint32_t atom_flags(atom_t atom);
+bool atom_has_flag(atom_t atom, uint32_t flag);
+uint32_t atom_count(void);
+
+#endif
\ No newline at end of file
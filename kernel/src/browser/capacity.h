@@ -0,0 +1,25 @@
+#ifndef BROWSER_CAPACITY_H
+#define BROWSER_CAPACITY_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Growth for arrays counted in uint32_t. Capacities double in 64-bit
+// arithmetic and come back as 0 when the result would not fit a uint32_t
+// count or its byte size would not fit a size_t, so a caller treats 0 like
+// a failed allocation instead of wrapping to a smaller buffer.
+
+// Smallest doubling of capacity (initial when it is 0) holding needed
+static inline uint32_t capacity_reserve(uint32_t capacity, uint64_t needed, uint32_t initial, size_t element_size) {
+    uint64_t grown = capacity ? capacity : initial;
+    while (grown < needed) grown *= 2;
+    if (grown > UINT32_MAX || grown > SIZE_MAX / element_size) return 0;
+    return (uint32_t)grown;
+}
+
+// Room for one more element
+static inline uint32_t capacity_grow(uint32_t capacity, uint32_t initial, size_t element_size) {
+    return capacity_reserve(capacity, (uint64_t)capacity + 1, initial, element_size);
+}
+
+#endif
@@ -0,0 +1,778 @@
+#include "invalidation.h"
+#include "../render/engine.h"
+#include "../capacity.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define INVALIDATION_MAP_INITIAL_SIZE 64
+
+// Feature kinds, combined with the atom as in the style sharing cache
+enum {
+    INVALIDATION_KEY_TAG = 1u << 28,
+    INVALIDATION_KEY_CLASS = 2u << 28,
+    INVALIDATION_KEY_ID = 3u << 28,
+    INVALIDATION_KEY_ATTRIBUTE = 4u << 28
+};
+
+// What a change to one feature restyles
+enum {
+    INVALIDATE_SELF = 1,
+    INVALIDATE_SUBTREE = 2,
+    INVALIDATE_DESCENDANTS = 4,         // Descendants carrying one of descendants[]
+    INVALIDATE_SIBLINGS = 8,            // Following siblings
+    INVALIDATE_SIBLING_SUBTREES = 16    // Following siblings and their subtrees
+};
+
+typedef struct {
+    uint32_t key;                       // INVALIDATION_KEY_* | atom, 0 when empty
+    uint32_t flags;
+    uint32_t* descendants;              // Sorted keys
+    uint32_t descendant_count;
+    uint32_t descendant_capacity;
+} invalidation_set_t;
+
+struct css_invalidation_map {
+    invalidation_set_t* sets;
+    uint32_t mask;
+    uint32_t used;
+    bool structural;                    // Structural pseudo-classes or sibling combinators
+    bool structural_subtree;            // ... followed by a descendant combinator
+    bool invalidate_all;                // Analysis ran out of memory
+};
+
+// Map storage
+
+static uint32_t set_hash(uint32_t key) {
+    uint32_t hash = key * 2654435761u;
+    return hash ^ (hash >> 16);
+}
+
+static invalidation_set_t* map_find(const css_invalidation_map_t* map, uint32_t key) {
+    uint32_t index = set_hash(key) & map->mask;
+    while (map->sets[index].key) {
+        if (map->sets[index].key == key) return &map->sets[index];
+        index = (index + 1) & map->mask;
+    }
+    return NULL;
+}
+
+static bool map_grow(css_invalidation_map_t* map) {
+    uint32_t new_size = (map->mask + 1) * 2;
+    invalidation_set_t* new_sets = calloc(new_size, sizeof(invalidation_set_t));
+    if (!new_sets) return false;
+    
+    for (uint32_t i = 0; i <= map->mask; i++) {
+        if (!map->sets[i].key) continue;
+        uint32_t index = set_hash(map->sets[i].key) & (new_size - 1);
+        while (new_sets[index].key) index = (index + 1) & (new_size - 1);
+        new_sets[index] = map->sets[i];
+    }
+    
+    free(map->sets);
+    map->sets = new_sets;
+    map->mask = new_size - 1;
+    return true;
+}
+
+static invalidation_set_t* map_insert(css_invalidation_map_t* map, uint32_t key) {
+    invalidation_set_t* set = map_find(map, key);
+    if (set) return set;
+    
+    if ((map->used + 1) * 2 > map->mask + 1 && !map_grow(map)) return NULL;
+    
+    uint32_t index = set_hash(key) & map->mask;
+    while (map->sets[index].key) index = (index + 1) & map->mask;
+    map->sets[index].key = key;
+    map->used++;
+    return &map->sets[index];
+}
+
+static bool sorted_insert(uint32_t** array, uint32_t* count, uint32_t* capacity, uint32_t value) {
+    uint32_t low = 0, high = *count;
+    while (low < high) {
+        uint32_t mid = (low + high) / 2;
+        if ((*array)[mid] < value) low = mid + 1;
+        else high = mid;
+    }
+    if (low < *count && (*array)[low] == value) return true;
+    
+    if (*count >= *capacity) {
+        uint32_t new_capacity = capacity_grow(*capacity, 4, sizeof(uint32_t));
+        uint32_t* new_array = new_capacity ? realloc(*array, new_capacity * sizeof(uint32_t)) : NULL;
+        if (!new_array) return false;
+        *array = new_array;
+        *capacity = new_capacity;
+    }
+    
+    memmove(&(*array)[low + 1], &(*array)[low], (*count - low) * sizeof(uint32_t));
+    (*array)[low] = value;
+    (*count)++;
+    return true;
+}
+
+static bool sorted_contains(const uint32_t* array, uint32_t count, uint32_t value) {
+    uint32_t low = 0, high = count;
+    while (low < high) {
+        uint32_t mid = (low + high) / 2;
+        if (array[mid] == value) return true;
+        if (array[mid] < value) low = mid + 1;
+        else high = mid;
+    }
+    return false;
+}
+
+// Selector analysis
+
+static bool is_combinator(const css_selector_t* node) {
+    return node->type == SELECTOR_DESCENDANT || node->type == SELECTOR_CHILD ||
+           node->type == SELECTOR_ADJACENT_SIBLING || node->type == SELECTOR_GENERAL_SIBLING;
+}
+
+static bool is_structural_pseudo(const char* name) {
+    static const char* const structural[] = {
+        "first-child", "last-child", "only-child", "nth-child", "nth-last-child",
+        "first-of-type", "last-of-type", "only-of-type", "nth-of-type",
+        "nth-last-of-type", "empty", NULL
+    };
+    if (!name) return false;
+    for (uint32_t i = 0; structural[i]; i++) {
+        if (strcmp(name, structural[i]) == 0) return true;
+    }
+    return false;
+}
+
+static uint32_t feature_key(css_selector_t* node) {
+    switch (node->type) {
+        case SELECTOR_CLASS:
+            return node->value ? INVALIDATION_KEY_CLASS | atom_intern(node->value) : 0;
+        case SELECTOR_ID:
+            return node->value ? INVALIDATION_KEY_ID | atom_intern(node->value) : 0;
+        case SELECTOR_ATTRIBUTE:
+            if (node->attribute.name_atom == ATOM_NULL && node->attribute.name) {
+                node->attribute.name_atom = atom_intern_lower(node->attribute.name, (uint32_t)strlen(node->attribute.name));
+            }
+            return node->attribute.name_atom ? INVALIDATION_KEY_ATTRIBUTE | node->attribute.name_atom : 0;
+        default:
+            return 0;
+    }
+}
+
+static void add_feature(css_invalidation_map_t* map, uint32_t key, uint32_t flags, uint32_t descendant_key) {
+    if (!key) return;
+    
+    invalidation_set_t* set = map_insert(map, key);
+    if (!set) {
+        map->invalidate_all = true;
+        return;
+    }
+    
+    set->flags |= flags;
+    if ((flags & INVALIDATE_DESCENDANTS) &&
+        !sorted_insert(&set->descendants, &set->descendant_count, &set->descendant_capacity, descendant_key)) {
+        set->flags |= INVALIDATE_SUBTREE;
+    }
+}
+
+// Features inside :not() and friends count as part of the enclosing compound
+static void add_nested_features(css_invalidation_map_t* map, css_selector_t* list, uint32_t flags, uint32_t descendant_key) {
+    for (css_selector_t* node = list; node; node = node->next) {
+        add_feature(map, feature_key(node), flags, descendant_key);
+        if (node->child) add_nested_features(map, node->child, flags, descendant_key);
+    }
+}
+
+static void analyse_selector(css_invalidation_map_t* map, css_selector_t* selector) {
+    uint32_t count = 0;
+    for (css_selector_t* node = selector; node; node = node->next) count++;
+    if (count == 0) return;
+    
+    // Combinators are scanned right to left, so collect the list first
+    css_selector_t** nodes = malloc(count * sizeof(css_selector_t*));
+    if (!nodes) {
+        map->invalidate_all = true;
+        return;
+    }
+    count = 0;
+    for (css_selector_t* node = selector; node; node = node->next) nodes[count++] = node;
+    
+    // Key of the rightmost compound: id, then class, then tag
+    uint32_t start = count;
+    while (start > 0 && !is_combinator(nodes[start - 1])) start--;
+    
+    uint32_t id = 0, class_name = 0, tag = 0;
+    for (uint32_t i = start; i < count; i++) {
+        css_selector_t* node = nodes[i];
+        if (!node->value) continue;
+        if (node->type == SELECTOR_ID && !id) id = INVALIDATION_KEY_ID | atom_intern(node->value);
+        if (node->type == SELECTOR_CLASS && !class_name) class_name = INVALIDATION_KEY_CLASS | atom_intern(node->value);
+        if (node->type == SELECTOR_TYPE && !tag) {
+            tag = INVALIDATION_KEY_TAG | atom_intern_lower(node->value, (uint32_t)strlen(node->value));
+        }
+    }
+    uint32_t rightmost = id ? id : class_name ? class_name : tag;
+    
+    // nearest is the combinator just right of the current compound; it
+    // decides whether the rightmost element is a descendant or a sibling
+    css_selector_type_t nearest = SELECTOR_DESCENDANT;
+    bool seen_descendant = false, seen_sibling = false;
+    for (uint32_t i = count; i-- > 0;) {
+        css_selector_t* node = nodes[i];
+        
+        if (is_combinator(node)) {
+            nearest = node->type;
+            if (node->type == SELECTOR_ADJACENT_SIBLING || node->type == SELECTOR_GENERAL_SIBLING) {
+                seen_sibling = true;
+                map->structural = true;
+                if (seen_descendant) map->structural_subtree = true;
+            } else {
+                seen_descendant = true;
+            }
+            continue;
+        }
+        
+        uint32_t flags;
+        if (i >= start) {
+            flags = INVALIDATE_SELF;
+        } else if (nearest == SELECTOR_ADJACENT_SIBLING || nearest == SELECTOR_GENERAL_SIBLING) {
+            flags = seen_descendant ? INVALIDATE_SIBLING_SUBTREES : INVALIDATE_SIBLINGS;
+        } else {
+            flags = !seen_sibling && rightmost ? INVALIDATE_DESCENDANTS : INVALIDATE_SUBTREE;
+        }
+        
+        if (node->type == SELECTOR_PSEUDO_CLASS && is_structural_pseudo(node->pseudo.name)) {
+            map->structural = true;
+            if (i < start) map->structural_subtree = true;
+        }
+        
+        add_feature(map, feature_key(node), flags, rightmost);
+        if (node->child) add_nested_features(map, node->child, flags, rightmost);
+    }
+    
+    free(nodes);
+}
+
+static void analyse_rules(css_invalidation_map_t* map, css_rule_t** rules, uint32_t rule_count) {
+    for (uint32_t i = 0; i < rule_count; i++) {
+        css_rule_t* rule = rules[i];
+        if (!rule) continue;
+        
+        if (rule->type == RULE_STYLE) {
+            for (uint32_t j = 0; j < rule->selector_count; j++) {
+                analyse_selector(map, rule->selectors[j]);
+            }
+        } else if (rule->type == RULE_MEDIA || rule->type == RULE_SUPPORTS) {
+            analyse_rules(map, rule->media.rules, rule->media.rule_count);
+        }
+    }
+}
+
+css_invalidation_map_t* css_invalidation_map_create(css_stylesheet_t** stylesheets, uint32_t stylesheet_count) {
+    css_invalidation_map_t* map = calloc(1, sizeof(css_invalidation_map_t));
+    if (!map) return NULL;
+    
+    map->sets = calloc(INVALIDATION_MAP_INITIAL_SIZE, sizeof(invalidation_set_t));
+    if (!map->sets) {
+        free(map);
+        return NULL;
+    }
+    map->mask = INVALIDATION_MAP_INITIAL_SIZE - 1;
+    
+    for (uint32_t i = 0; i < stylesheet_count; i++) {
+        if (stylesheets[i] && !stylesheets[i]->disabled) {
+            analyse_rules(map, stylesheets[i]->rules, stylesheets[i]->rule_count);
+        }
+    }
+    
+    return map;
+}
+
+void css_invalidation_map_destroy(css_invalidation_map_t* map) {
+    if (!map) return;
+    
+    for (uint32_t i = 0; i <= map->mask; i++) {
+        free(map->sets[i].descendants);
+    }
+    free(map->sets);
+    free(map);
+}
+
+// Dirty bits
+
+void css_mark_style_dirty(dom_element_t* element, uint8_t bits) {
+    if (!element) return;
+    element->style_dirty |= bits;
+    
+    dom_node_t* parent = element->base.parent_node;
+    while (parent && parent->type == NODE_ELEMENT) {
+        dom_element_t* ancestor = (dom_element_t*)parent;
+        if (ancestor->style_dirty & DOM_STYLE_DIRTY_DESCENDANTS) break;
+        ancestor->style_dirty |= DOM_STYLE_DIRTY_DESCENDANTS;
+        parent = parent->parent_node;
+    }
+}
+
+static void mark(dom_element_t* element, uint8_t bits, uint32_t* marked) {
+    if (!(element->style_dirty & (DOM_STYLE_DIRTY_SELF | DOM_STYLE_DIRTY_SUBTREE))) (*marked)++;
+    css_mark_style_dirty(element, bits);
+}
+
+// Scheduling
+
+static bool element_has_key(dom_element_t* element, const uint32_t* keys, uint32_t count) {
+    if (element->tag_atom && sorted_contains(keys, count, INVALIDATION_KEY_TAG | element->tag_atom)) return true;
+    if (element->id_atom && sorted_contains(keys, count, INVALIDATION_KEY_ID | element->id_atom)) return true;
+    if (element->class_atoms) {
+        for (uint32_t i = 0; i < element->class_count; i++) {
+            if (sorted_contains(keys, count, INVALIDATION_KEY_CLASS | element->class_atoms[i])) return true;
+        }
+    }
+    return false;
+}
+
+static void mark_matching_descendants(dom_element_t* element, const invalidation_set_t* set, uint32_t* marked) {
+    for (dom_node_t* child = element->base.first_child; child; child = child->next_sibling) {
+        if (child->type != NODE_ELEMENT) continue;
+        dom_element_t* child_element = (dom_element_t*)child;
+        if (element_has_key(child_element, set->descendants, set->descendant_count)) {
+            mark(child_element, DOM_STYLE_DIRTY_SELF, marked);
+        }
+        mark_matching_descendants(child_element, set, marked);
+    }
+}
+
+static void apply_set(const invalidation_set_t* set, dom_element_t* element, uint32_t* marked) {
+    if (set->flags & INVALIDATE_SUBTREE) {
+        mark(element, DOM_STYLE_DIRTY_SUBTREE, marked);
+    } else {
+        if (set->flags & INVALIDATE_SELF) mark(element, DOM_STYLE_DIRTY_SELF, marked);
+        if (set->flags & INVALIDATE_DESCENDANTS) mark_matching_descendants(element, set, marked);
+    }
+    
+    if (set->flags & (INVALIDATE_SIBLINGS | INVALIDATE_SIBLING_SUBTREES)) {
+        uint8_t bits = (set->flags & INVALIDATE_SIBLING_SUBTREES) ? DOM_STYLE_DIRTY_SUBTREE : DOM_STYLE_DIRTY_SELF;
+        for (dom_node_t* sibling = element->base.next_sibling; sibling; sibling = sibling->next_sibling) {
+            if (sibling->type == NODE_ELEMENT) mark((dom_element_t*)sibling, bits, marked);
+        }
+    }
+}
+
+static void invalidate_feature(const css_invalidation_map_t* map, uint32_t key, dom_element_t* element, uint32_t* marked) {
+    const invalidation_set_t* set = map_find(map, key);
+    if (set) apply_set(set, element, marked);
+}
+
+static atom_t current_class_atom(dom_element_t* element, uint32_t index) {
+    return element->class_atoms ? element->class_atoms[index] : atom_lookup(element->class_list[index]);
+}
+
+static bool old_classes_contain(const char* old_value, atom_t class_name) {
+    const char* name = atom_string(class_name);
+    uint32_t length = atom_length(class_name);
+    
+    for (const char* p = old_value; p && *p;) {
+        while (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\f' || *p == '\r') p++;
+        const char* token = p;
+        while (*p && *p != ' ' && *p != '\t' && *p != '\n' && *p != '\f' && *p != '\r') p++;
+        if ((uint32_t)(p - token) == length && memcmp(token, name, length) == 0) return true;
+    }
+    return false;
+}
+
+// Classes added or removed by a class attribute change
+static void schedule_class_change(const css_invalidation_map_t* map, dom_element_t* element, const char* old_value, uint32_t* marked) {
+    for (uint32_t i = 0; i < element->class_count; i++) {
+        atom_t class_name = current_class_atom(element, i);
+        if (class_name && !old_classes_contain(old_value, class_name)) {
+            invalidate_feature(map, INVALIDATION_KEY_CLASS | class_name, element, marked);
+        }
+    }
+    
+    for (const char* p = old_value; p && *p;) {
+        while (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\f' || *p == '\r') p++;
+        const char* token = p;
+        while (*p && *p != ' ' && *p != '\t' && *p != '\n' && *p != '\f' && *p != '\r') p++;
+        if (p == token) break;
+        
+        // A class nobody interned cannot appear in any selector
+        atom_t class_name = atom_lookup_len(token, (uint32_t)(p - token));
+        if (class_name == ATOM_NULL) continue;
+        
+        bool present = false;
+        for (uint32_t i = 0; i < element->class_count && !present; i++) {
+            present = current_class_atom(element, i) == class_name;
+        }
+        if (!present) invalidate_feature(map, INVALIDATION_KEY_CLASS | class_name, element, marked);
+    }
+}
+
+static void schedule_attribute(const css_invalidation_map_t* map, dom_element_t* element, const dom_mutation_record_t* record, uint32_t* marked) {
+    if (!record->attribute_name) return;
+    atom_t name = atom_lookup_lower(record->attribute_name, (uint32_t)strlen(record->attribute_name));
+    if (name == ATOM_NULL) return;
+    
+    if (name == ATOM_style) {
+        mark(element, DOM_STYLE_DIRTY_SELF, marked);
+    } else if (name == ATOM_class) {
+        schedule_class_change(map, element, record->old_value, marked);
+    } else if (name == ATOM_id) {
+        atom_t old_id = record->old_value ? atom_lookup(record->old_value) : ATOM_NULL;
+        atom_t new_id = element->id_atom ? element->id_atom : element->id ? atom_lookup(element->id) : ATOM_NULL;
+        if (old_id != new_id) {
+            if (old_id) invalidate_feature(map, INVALIDATION_KEY_ID | old_id, element, marked);
+            if (new_id) invalidate_feature(map, INVALIDATION_KEY_ID | new_id, element, marked);
+        }
+    }
+    
+    invalidate_feature(map, INVALIDATION_KEY_ATTRIBUTE | name, element, marked);
+}
+
+// Structural selectors can change for every child when the list changes
+static void schedule_structural(const css_invalidation_map_t* map, dom_element_t* parent, uint32_t* marked) {
+    if (!map->structural) return;
+    
+    mark(parent, DOM_STYLE_DIRTY_SELF, marked);
+    uint8_t bits = map->structural_subtree ? DOM_STYLE_DIRTY_SUBTREE : DOM_STYLE_DIRTY_SELF;
+    for (dom_node_t* child = parent->base.first_child; child; child = child->next_sibling) {
+        if (child->type == NODE_ELEMENT) mark((dom_element_t*)child, bits, marked);
+    }
+}
+
+uint32_t css_invalidation_schedule(css_invalidation_map_t* map, dom_mutation_record_t** records, uint32_t count, css_invalidation_t* invalidation) {
+    if (!records) return 0;
+    
+    uint32_t marked = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        dom_mutation_record_t* record = records[i];
+        if (!record || !record->target) continue;
+        
+        dom_node_t* target = record->target;
+        dom_element_t* element = target->type == NODE_ELEMENT ? (dom_element_t*)target : NULL;
+        
+        if (map && map->invalidate_all) {
+            dom_document_t* document = target->owner_document;
+            if (document && document->document_element) {
+                mark(document->document_element, DOM_STYLE_DIRTY_SUBTREE, &marked);
+            }
+        }
+        
+        switch (record->type) {
+            case MUTATION_ATTRIBUTES:
+                if (element && map) schedule_attribute(map, element, record, &marked);
+                break;
+            
+            case MUTATION_CHILD_LIST:
+                // New nodes have no style yet; removed ones take theirs along
+                for (uint32_t j = 0; j < record->added_count; j++) {
+                    dom_node_t* added = record->added_nodes[j];
+                    if (added && added->type == NODE_ELEMENT) {
+                        mark((dom_element_t*)added, DOM_STYLE_DIRTY_SUBTREE, &marked);
+                    }
+                }
+                if (element) {
+                    if (map) schedule_structural(map, element, &marked);
+                    css_invalidation_add(invalidation, element, CSS_STYLE_CHANGE_LAYOUT);
+                }
+                break;
+            
+            case MUTATION_CHARACTER_DATA: {
+                // Text never restyles, but :empty aside it moves the line boxes
+                dom_node_t* parent = target->parent_node;
+                if (parent && parent->type == NODE_ELEMENT) {
+                    if (map && map->structural) mark((dom_element_t*)parent, DOM_STYLE_DIRTY_SELF, &marked);
+                    css_invalidation_add(invalidation, (dom_element_t*)parent, CSS_STYLE_CHANGE_LAYOUT);
+                }
+                break;
+            }
+            
+            default:
+                break;
+        }
+    }
+    
+    return marked;
+}
+
+// Style comparison
+
+static bool css_value_equal(const css_value_t* a, const css_value_t* b) {
+    if (a == b) return true;
+    if (!a || !b || a->type != b->type) return false;
+    
+    switch (a->type) {
+        case VALUE_LENGTH:
+            return a->value.length.value == b->value.length.value && a->value.length.unit == b->value.length.unit;
+        case VALUE_PERCENTAGE:
+            return a->value.percentage == b->value.percentage;
+        case VALUE_NUMBER:
+            return a->value.number == b->value.number;
+        case VALUE_COLOR:
+            return memcmp(&a->value.color, &b->value.color, sizeof(a->value.color)) == 0;
+        case VALUE_STRING:
+        case VALUE_URL:
+        case VALUE_KEYWORD:
+            // string, url and keyword share the union slot
+            if (!a->value.string || !b->value.string) return a->value.string == b->value.string;
+            return strcmp(a->value.string, b->value.string) == 0;
+        case VALUE_FUNCTION:
+            if (a->value.function.argument_count != b->value.function.argument_count) return false;
+            if (!a->value.function.name || !b->value.function.name ||
+                strcmp(a->value.function.name, b->value.function.name) != 0) {
+                return a->value.function.name == b->value.function.name;
+            }
+            for (uint32_t i = 0; i < a->value.function.argument_count; i++) {
+                if (!css_value_equal(a->value.function.arguments[i], b->value.function.arguments[i])) return false;
+            }
+            return true;
+        case VALUE_LIST:
+            if (a->value.list.item_count != b->value.list.item_count) return false;
+            for (uint32_t i = 0; i < a->value.list.item_count; i++) {
+                if (!css_value_equal(a->value.list.items[i], b->value.list.items[i])) return false;
+            }
+            return true;
+    }
+    return false;
+}
+
+static bool packed_equal(css_packed_value_t a, const css_value_table_t* a_table, css_packed_value_t b, const css_value_table_t* b_table) {
+    if (a.type != b.type) return false;
+    if (a.type == CSS_PACKED_UNSET) return true;
+    if (a.type == CSS_PACKED_COMPLEX) {
+        return css_value_equal(css_packed_complex(a_table, a), css_packed_complex(b_table, b));
+    }
+    return a.unit == b.unit && a.data.index == b.data.index;
+}
+
+static bool strings_equal(char** a, uint32_t a_count, char** b, uint32_t b_count) {
+    if (a_count != b_count) return false;
+    for (uint32_t i = 0; i < a_count; i++) {
+        if (!a[i] || !b[i]) {
+            if (a[i] != b[i]) return false;
+        } else if (strcmp(a[i], b[i]) != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static const atom_t style_slot_atoms[CSS_PROP_COUNT] = {
+#define CSS_STYLE_SLOT_ATOM(id, atom) [CSS_PROP_##id] = ATOM_##atom,
+    CSS_STYLE_PROPERTIES(CSS_STYLE_SLOT_ATOM)
+#undef CSS_STYLE_SLOT_ATOM
+};
+
+static const atom_t inherited_slot_atoms[CSS_INHERITED_COUNT] = {
+#define CSS_INHERITED_SLOT_ATOM(id, atom) [CSS_INHERITED_##id] = ATOM_##atom,
+    CSS_INHERITED_PROPERTIES(CSS_INHERITED_SLOT_ATOM)
+#undef CSS_INHERITED_SLOT_ATOM
+};
+
+static css_style_change_t compare_inherited(const css_inherited_style_t* a, const css_inherited_style_t* b) {
+    if (a == b) return CSS_STYLE_CHANGE_NONE;
+    if (!a || !b) return CSS_STYLE_CHANGE_LAYOUT;
+    
+    if (a->font_weight != b->font_weight || a->font_style != b->font_style ||
+        a->text_align != b->text_align || a->text_transform != b->text_transform ||
+        !strings_equal(a->font_family, a->font_family_count, b->font_family, b->font_family_count)) {
+        return CSS_STYLE_CHANGE_LAYOUT;
+    }
+    
+    bool paint = a->visibility != b->visibility;
+    for (uint32_t i = 0; i < CSS_INHERITED_COUNT; i++) {
+        if (packed_equal(a->values[i], &a->complex_values, b->values[i], &b->complex_values)) continue;
+        if (!atom_has_flag(inherited_slot_atoms[i], ATOM_FLAG_PAINT_ONLY)) return CSS_STYLE_CHANGE_LAYOUT;
+        paint = true;
+    }
+    
+    // cursor and pointer-events only matter to hit testing
+    return paint ? CSS_STYLE_CHANGE_PAINT : CSS_STYLE_CHANGE_NONE;
+}
+
+css_style_change_t css_compare_styles(const css_computed_style_t* old_style, const css_computed_style_t* new_style) {
+    if (old_style == new_style) return CSS_STYLE_CHANGE_NONE;
+    if (!old_style || !new_style) return CSS_STYLE_CHANGE_LAYOUT;
+    
+    const css_computed_style_t* a = old_style;
+    const css_computed_style_t* b = new_style;
+    
+    // Box generation and geometry
+    if (a->display != b->display || a->position != b->position ||
+        a->float_type != b->float_type || a->clear != b->clear ||
+        a->box_sizing != b->box_sizing ||
+        memcmp(a->border_style, b->border_style, sizeof(a->border_style)) != 0 ||
+        a->flex_direction != b->flex_direction || a->flex_wrap != b->flex_wrap ||
+        a->justify_content != b->justify_content || a->align_items != b->align_items ||
+        a->align_self != b->align_self ||
+        a->overflow_x != b->overflow_x || a->overflow_y != b->overflow_y ||
+        memcmp(&a->grid_column, &b->grid_column, sizeof(a->grid_column)) != 0 ||
+        memcmp(&a->grid_row, &b->grid_row, sizeof(a->grid_row)) != 0 ||
+        !strings_equal(a->grid_template_columns, a->grid_column_count, b->grid_template_columns, b->grid_column_count) ||
+        !strings_equal(a->grid_template_rows, a->grid_row_count, b->grid_template_rows, b->grid_row_count) ||
+        !strings_equal(a->grid_template_areas, a->grid_area_count, b->grid_template_areas, b->grid_area_count)) {
+        return CSS_STYLE_CHANGE_LAYOUT;
+    }
+    
+    bool paint = false;
+    for (uint32_t i = 0; i < CSS_PROP_COUNT; i++) {
+        if (packed_equal(a->values[i], &a->complex_values, b->values[i], &b->complex_values)) continue;
+        
+        // transform-origin has no atom of its own and never moves boxes
+        bool paint_only = i >= CSS_PROP_TRANSFORM_ORIGIN_X || atom_has_flag(style_slot_atoms[i], ATOM_FLAG_PAINT_ONLY);
+        if (!paint_only) return CSS_STYLE_CHANGE_LAYOUT;
+        paint = true;
+    }
+    
+    css_style_change_t inherited = compare_inherited(a->inherited, b->inherited);
+    if (inherited == CSS_STYLE_CHANGE_LAYOUT) return CSS_STYLE_CHANGE_LAYOUT;
+    if (inherited == CSS_STYLE_CHANGE_PAINT) paint = true;
+    
+    // Decoration and transforms; transitions and animations only drive
+    // later frames
+    if (a->text_decoration != b->text_decoration ||
+        a->background_repeat != b->background_repeat ||
+        a->background_attachment != b->background_attachment ||
+        a->background_size != b->background_size ||
+        a->transform_style != b->transform_style ||
+        !strings_equal(a->background_image, a->background_image_count, b->background_image, b->background_image_count) ||
+        !strings_equal(a->transform, a->transform_count, b->transform, b->transform_count)) {
+        paint = true;
+    }
+    
+    return paint ? CSS_STYLE_CHANGE_PAINT : CSS_STYLE_CHANGE_NONE;
+}
+
+// Recalc
+
+typedef struct {
+    css_style_cache_t* cache;
+    css_stylesheet_t** stylesheets;
+    uint32_t stylesheet_count;
+    css_invalidation_t* invalidation;
+    uint32_t restyled;
+} recalc_context_t;
+
+static void recalc_element(recalc_context_t* context, dom_element_t* element, bool force) {
+    uint8_t dirty = element->style_dirty;
+    element->style_dirty = 0;
+    bool force_children = force || (dirty & DOM_STYLE_DIRTY_SUBTREE);
+    
+    if (force || (dirty & (DOM_STYLE_DIRTY_SELF | DOM_STYLE_DIRTY_SUBTREE))) {
+        css_computed_style_t* old_style = element->computed_style;
+        css_computed_style_t* new_style = css_style_cache_get(context->cache, element);
+        if (!new_style) {
+            new_style = css_compute_style(element, context->stylesheets, context->stylesheet_count);
+            if (new_style) css_style_cache_put(context->cache, element, new_style);
+        }
+        
+        if (new_style) {
+            context->restyled++;
+            
+            css_style_change_t change = css_compare_styles(old_style, new_style);
+            if (change != CSS_STYLE_CHANGE_NONE) css_invalidation_add(context->invalidation, element, change);
+            
+            // Children inherit from the new style
+            if (!old_style || compare_inherited(old_style->inherited, new_style->inherited) != CSS_STYLE_CHANGE_NONE) {
+                force_children = true;
+            }
+            
+            element->computed_style = new_style;
+            css_computed_style_release(old_style);
+        }
+    }
+    
+    if (!force_children && !(dirty & DOM_STYLE_DIRTY_DESCENDANTS)) return;
+    
+    for (dom_node_t* child = element->base.first_child; child; child = child->next_sibling) {
+        if (child->type == NODE_ELEMENT) recalc_element(context, (dom_element_t*)child, force_children);
+    }
+}
+
+uint32_t css_recalc_styles(css_style_cache_t* cache, dom_element_t* root, css_stylesheet_t** stylesheets, uint32_t stylesheet_count, css_invalidation_t* invalidation) {
+    if (!root || !root->style_dirty) return 0;
+    
+    recalc_context_t context = {
+        .cache = cache,
+        .stylesheets = stylesheets,
+        .stylesheet_count = stylesheet_count,
+        .invalidation = invalidation
+    };
+    recalc_element(&context, root, false);
+    return context.restyled;
+}
+
+// Invalidation lists
+
+css_invalidation_t* css_invalidation_create(void) {
+    return calloc(1, sizeof(css_invalidation_t));
+}
+
+void css_invalidation_add(css_invalidation_t* invalidation, dom_element_t* element, css_style_change_t change) {
+    if (!invalidation || !element || change == CSS_STYLE_CHANGE_NONE) return;
+    
+    if (invalidation->element_count >= invalidation->element_capacity) {
+        uint32_t capacity = capacity_grow(invalidation->element_capacity, 16, sizeof(dom_element_t*));
+        dom_element_t** elements = capacity ? realloc(invalidation->elements, capacity * sizeof(dom_element_t*)) : NULL;
+        if (!elements) return;
+        invalidation->elements = elements;
+        
+        css_style_change_t* changes = realloc(invalidation->changes, capacity * sizeof(css_style_change_t));
+        if (!changes) return;
+        invalidation->changes = changes;
+        invalidation->element_capacity = capacity;
+    }
+    
+    invalidation->elements[invalidation->element_count] = element;
+    invalidation->changes[invalidation->element_count] = change;
+    invalidation->element_count++;
+    
+    invalidation->needs_paint = true;
+    if (change == CSS_STYLE_CHANGE_LAYOUT) invalidation->needs_layout = true;
+}
+
+void css_invalidation_destroy(css_invalidation_t* invalidation) {
+    if (!invalidation) return;
+    free(invalidation->elements);
+    free(invalidation->changes);
+    free(invalidation);
+}
+
+// An inline style change on one element
+css_invalidation_t* css_invalidate_style(dom_element_t* element, const char* property) {
+    if (!element) return NULL;
+    
+    css_invalidation_t* invalidation = css_invalidation_create();
+    if (!invalidation) return NULL;
+    
+    css_mark_style_dirty(element, DOM_STYLE_DIRTY_SELF);
+    
+    atom_t name = property ? atom_lookup_lower(property, (uint32_t)strlen(property)) : ATOM_NULL;
+    bool paint_only = name != ATOM_NULL && atom_has_flag(name, ATOM_FLAG_PAINT_ONLY);
+    css_invalidation_add(invalidation, element, paint_only ? CSS_STYLE_CHANGE_PAINT : CSS_STYLE_CHANGE_LAYOUT);
+    return invalidation;
+}
+
+void css_invalidation_apply(const css_invalidation_t* invalidation, render_tree_t* tree) {
+    if (!invalidation || !tree) return;
+    
+    for (uint32_t i = 0; i < invalidation->element_count; i++) {
+        dom_element_t* element = invalidation->elements[i];
+        layout_box_t* box = element->layout_box;
+        if (!box) {
+            // The box tree changes, and with it the layers
+            tree->needs_layout = true;
+            tree->needs_layer_update = true;
+            continue;
+        }
+        
+        struct css_computed_style* style = (struct css_computed_style*)element->computed_style;
+        if (paint_style_changes_layers(box->style, style)) tree->needs_layer_update = true;
+        box->style = style;
+        if (invalidation->changes[i] == CSS_STYLE_CHANGE_LAYOUT) {
+            invalidate_layout(tree, box);
+        } else {
+            invalidate_paint(tree, box, NULL);
+        }
+    }
+    
+    if (invalidation->needs_layout) tree->needs_layout = true;
+    if (invalidation->needs_paint) tree->needs_paint = true;
+}
@@ -0,0 +1,50 @@
+#ifndef CSS_INVALIDATION_H
+#define CSS_INVALIDATION_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "style.h"
+#include "../html/dom.h"
+
+// Forward declarations
+struct render_tree;
+
+// Invalidation sets. For every class, id and attribute a selector tests,
+// the map records which elements a change to it can restyle: the element
+// itself (feature in the rightmost compound), descendants carrying the
+// rightmost compound's id, class or tag (feature left of a descendant or
+// child combinator), the whole subtree when that compound has no key, and
+// following siblings (feature left of a sibling combinator). Rebuild the
+// map whenever the stylesheet set changes.
+typedef struct css_invalidation_map css_invalidation_map_t;
+
+css_invalidation_map_t* css_invalidation_map_create(css_stylesheet_t** stylesheets, uint32_t stylesheet_count);
+void css_invalidation_map_destroy(css_invalidation_map_t* map);
+
+// Sets DOM_STYLE_DIRTY_* bits for the elements a batch of mutation records
+// can restyle. Attribute records need old_value. Text and child list
+// changes that affect layout without restyling are added to invalidation.
+// Returns the number of elements marked.
+uint32_t css_invalidation_schedule(css_invalidation_map_t* map, dom_mutation_record_t** records, uint32_t count, css_invalidation_t* invalidation);
+
+// Marks the element and sets DOM_STYLE_DIRTY_DESCENDANTS up to the root
+void css_mark_style_dirty(struct dom_element* element, uint8_t bits);
+
+// Restyles the dirty elements under root, skipping clean subtrees, and
+// appends every element whose style changed. Children are restyled when
+// an element's inherited properties change. Returns the number restyled.
+uint32_t css_recalc_styles(css_style_cache_t* cache, struct dom_element* root, css_stylesheet_t** stylesheets, uint32_t stylesheet_count, css_invalidation_t* invalidation);
+
+// How far a style change reaches down the pipeline
+css_style_change_t css_compare_styles(const css_computed_style_t* old_style, const css_computed_style_t* new_style);
+
+// Invalidation lists
+css_invalidation_t* css_invalidation_create(void);
+void css_invalidation_add(css_invalidation_t* invalidation, struct dom_element* element, css_style_change_t change);
+
+// Feeds the changes into the render tree through invalidate_layout and
+// invalidate_paint. Elements without a box (e.g. leaving display: none)
+// flag the tree for layout so their boxes get built.
+void css_invalidation_apply(const css_invalidation_t* invalidation, struct render_tree* tree);
+
+#endif
@@ -3,6 +3,11 @@
 
 #include <stdint.h>
 #include <stdbool.h>
+#include "../atom.h"
+
+// Forward declarations
+struct dom_node;
+struct dom_element;
 
 // CSS token types
 typedef enum {
@@ -74,6 +79,7 @@ typedef enum {
 typedef struct css_selector {
     css_selector_type_t type;
     char* value;
+    atom_t value_atom;              // Tag, class or id name
     struct css_selector* next;
     struct css_selector* child;
     
@@ -81,6 +87,7 @@ typedef struct css_selector {
     struct {
         char* name;
         char* value;
+        atom_t name_atom;
         enum {
             ATTR_EQUALS,
             ATTR_INCLUDES,
@@ -105,6 +112,7 @@ typedef struct css_selector {
 typedef struct {
     char* name;
     char* value;
+    atom_t name_atom;
     bool important;
     uint32_t source_line;
 } css_property_t;
@@ -158,7 +166,7 @@ typedef struct css_rule {
 } css_rule_t;
 
 // CSS stylesheet
-typedef struct {
+typedef struct css_stylesheet {
     css_rule_t** rules;
     uint32_t rule_count;
     char* href;
@@ -167,6 +175,10 @@ typedef struct {
     bool disabled;
     struct dom_node* owner_node;
     struct css_stylesheet* parent;
+    
+    // Selector index for style resolution, see rule_index.h. Released by
+    // css_stylesheet_destroy.
+    struct css_rule_index* rule_index;
 } css_stylesheet_t;
 
 // Parser API
@@ -0,0 +1,80 @@
+#include "style.h"
+#include <string.h>
+
+bool css_is_inherited_atom(atom_t property) {
+    return atom_has_flag(property, ATOM_FLAG_INHERITED);
+}
+
+bool css_is_inherited_property(const char* property) {
+    if (!property) return false;
+    return css_is_inherited_atom(atom_lookup(property));
+}
+
+// Custom properties keep their names as strings
+static css_value_t* css_find_custom_property(css_computed_style_t* style, const char* name) {
+    for (uint32_t i = 0; i < style->custom_property_count; i++) {
+        if (strcmp(style->custom_properties[i].name, name) == 0) {
+            return style->custom_properties[i].value;
+        }
+    }
+    return NULL;
+}
+
+// Map a property atom to its slot in values[], or -1
+static int css_style_slot(atom_t property) {
+    switch (property) {
+#define CSS_STYLE_SLOT_CASE(id, atom) case ATOM_##atom: return CSS_PROP_##id;
+        CSS_STYLE_PROPERTIES(CSS_STYLE_SLOT_CASE)
+#undef CSS_STYLE_SLOT_CASE
+        default:
+            return -1;
+    }
+}
+
+static int css_inherited_slot(atom_t property) {
+    switch (property) {
+#define CSS_INHERITED_SLOT_CASE(id, atom) case ATOM_##atom: return CSS_INHERITED_##id;
+        CSS_INHERITED_PROPERTIES(CSS_INHERITED_SLOT_CASE)
+#undef CSS_INHERITED_SLOT_CASE
+        default:
+            return -1;
+    }
+}
+
+css_packed_value_t css_get_packed_value(css_computed_style_t* style, atom_t property) {
+    css_packed_value_t unset = { .type = CSS_PACKED_UNSET };
+    if (!style) return unset;
+    
+    // Inherited properties live in the shared sub-struct
+    int slot = css_inherited_slot(property);
+    if (slot >= 0) return style->inherited ? style->inherited->values[slot] : unset;
+    
+    slot = css_style_slot(property);
+    return slot >= 0 ? style->values[slot] : unset;
+}
+
+css_value_t* css_get_computed_value_atom(css_computed_style_t* style, atom_t property) {
+    if (!style) return NULL;
+    
+    int slot = css_inherited_slot(property);
+    if (slot >= 0) {
+        if (!style->inherited) return NULL;
+        return css_unpack_value(&style->inherited->complex_values, style->inherited->values[slot]);
+    }
+    
+    slot = css_style_slot(property);
+    if (slot >= 0) return css_unpack_value(&style->complex_values, style->values[slot]);
+    
+    const char* name = atom_string(property);
+    return name ? css_value_clone(css_find_custom_property(style, name)) : NULL;
+}
+
+css_value_t* css_get_computed_value(css_computed_style_t* style, const char* property) {
+    if (!style || !property) return NULL;
+    
+    // A name nobody interned can only be a custom property
+    atom_t atom = atom_lookup(property);
+    if (atom == ATOM_NULL) return css_value_clone(css_find_custom_property(style, property));
+    
+    return css_get_computed_value_atom(style, atom);
+}
@@ -0,0 +1,470 @@
+#include "rule_index.h"
+#include "../html/dom.h"
+#include "../capacity.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define RULE_TABLE_INITIAL_SIZE 64
+#define RULE_MAX_SELECTOR_NODES 64
+
+// Bloom key kinds, so that tag "x", class "x" and id "x" hash apart
+enum {
+    BLOOM_KIND_TAG = 1,
+    BLOOM_KIND_CLASS = 2,
+    BLOOM_KIND_ID = 3
+};
+
+// Rules filed under one key
+typedef struct {
+    atom_t key;
+    css_rule_entry_t* entries;
+    uint32_t count;
+    uint32_t capacity;
+} rule_bucket_t;
+
+typedef struct {
+    rule_bucket_t* buckets;
+    uint32_t mask;
+    uint32_t used;
+} rule_table_t;
+
+// An @media block's query and the condition enclosing it
+typedef struct {
+    css_media_query_t* query;       // NULL when it failed to parse
+    bool always;                    // No query text: matches everything
+    uint32_t parent;                // 1-based, or 0
+} rule_condition_t;
+
+struct css_rule_index {
+    rule_table_t ids;
+    rule_table_t classes;
+    rule_table_t tags;
+    rule_bucket_t universal;
+    uint32_t rule_count;            // Style rules, nested ones included
+    
+    rule_condition_t* conditions;
+    uint32_t condition_count;
+    uint32_t condition_capacity;
+};
+
+static uint32_t bloom_hash(uint32_t kind, atom_t atom) {
+    uint32_t hash = atom * 0x9E3779B1u ^ kind * 0x85EBCA77u;
+    hash ^= hash >> 16;
+    hash *= 0x7FEB352Du;
+    hash ^= hash >> 15;
+    return hash ? hash : 1;
+}
+
+// Bloom filter
+
+void css_bloom_clear(css_bloom_filter_t* filter) {
+    if (filter) memset(filter->counters, 0, sizeof(filter->counters));
+}
+
+static void bloom_add(css_bloom_filter_t* filter, uint32_t hash) {
+    uint8_t* first = &filter->counters[hash & CSS_BLOOM_MASK];
+    uint8_t* second = &filter->counters[(hash >> CSS_BLOOM_BITS) & CSS_BLOOM_MASK];
+    if (*first < UINT8_MAX) (*first)++;
+    if (*second < UINT8_MAX) (*second)++;
+}
+
+// Saturated counters stay put; they can only cause false positives
+static void bloom_remove(css_bloom_filter_t* filter, uint32_t hash) {
+    uint8_t* first = &filter->counters[hash & CSS_BLOOM_MASK];
+    uint8_t* second = &filter->counters[(hash >> CSS_BLOOM_BITS) & CSS_BLOOM_MASK];
+    if (*first > 0 && *first < UINT8_MAX) (*first)--;
+    if (*second > 0 && *second < UINT8_MAX) (*second)--;
+}
+
+bool css_bloom_might_contain(const css_bloom_filter_t* filter, uint32_t hash) {
+    return filter->counters[hash & CSS_BLOOM_MASK] &&
+           filter->counters[(hash >> CSS_BLOOM_BITS) & CSS_BLOOM_MASK];
+}
+
+static void bloom_update(css_bloom_filter_t* filter, struct dom_element* element, void (*op)(css_bloom_filter_t*, uint32_t)) {
+    if (!filter || !element) return;
+    
+    if (element->tag_atom) op(filter, bloom_hash(BLOOM_KIND_TAG, element->tag_atom));
+    if (element->id_atom) op(filter, bloom_hash(BLOOM_KIND_ID, element->id_atom));
+    if (element->class_atoms) {
+        for (uint32_t i = 0; i < element->class_count; i++) {
+            op(filter, bloom_hash(BLOOM_KIND_CLASS, element->class_atoms[i]));
+        }
+    }
+}
+
+void css_bloom_push_element(css_bloom_filter_t* filter, struct dom_element* element) {
+    bloom_update(filter, element, bloom_add);
+}
+
+void css_bloom_pop_element(css_bloom_filter_t* filter, struct dom_element* element) {
+    bloom_update(filter, element, bloom_remove);
+}
+
+// Rule tables
+
+static bool bucket_push(rule_bucket_t* bucket, const css_rule_entry_t* entry) {
+    if (bucket->count >= bucket->capacity) {
+        uint32_t new_capacity = capacity_grow(bucket->capacity, 4, sizeof(css_rule_entry_t));
+        css_rule_entry_t* new_entries = new_capacity ? realloc(bucket->entries, new_capacity * sizeof(css_rule_entry_t)) : NULL;
+        if (!new_entries) return false;
+        bucket->entries = new_entries;
+        bucket->capacity = new_capacity;
+    }
+    bucket->entries[bucket->count++] = *entry;
+    return true;
+}
+
+static bool table_init(rule_table_t* table) {
+    table->buckets = calloc(RULE_TABLE_INITIAL_SIZE, sizeof(rule_bucket_t));
+    table->mask = RULE_TABLE_INITIAL_SIZE - 1;
+    table->used = 0;
+    return table->buckets != NULL;
+}
+
+static void table_free(rule_table_t* table) {
+    if (!table->buckets) return;
+    for (uint32_t i = 0; i <= table->mask; i++) {
+        free(table->buckets[i].entries);
+    }
+    free(table->buckets);
+}
+
+static rule_bucket_t* table_find(const rule_table_t* table, atom_t key) {
+    if (key == ATOM_NULL || !table->buckets) return NULL;
+    
+    uint32_t index = key & table->mask;
+    while (table->buckets[index].key != ATOM_NULL) {
+        if (table->buckets[index].key == key) return &table->buckets[index];
+        index = (index + 1) & table->mask;
+    }
+    return NULL;
+}
+
+static bool table_grow(rule_table_t* table) {
+    uint32_t new_size = (table->mask + 1) * 2;
+    rule_bucket_t* new_buckets = calloc(new_size, sizeof(rule_bucket_t));
+    if (!new_buckets) return false;
+    
+    for (uint32_t i = 0; i <= table->mask; i++) {
+        if (table->buckets[i].key == ATOM_NULL) continue;
+        
+        uint32_t index = table->buckets[i].key & (new_size - 1);
+        while (new_buckets[index].key != ATOM_NULL) {
+            index = (index + 1) & (new_size - 1);
+        }
+        new_buckets[index] = table->buckets[i];
+    }
+    
+    free(table->buckets);
+    table->buckets = new_buckets;
+    table->mask = new_size - 1;
+    return true;
+}
+
+static bool table_add(rule_table_t* table, atom_t key, const css_rule_entry_t* entry) {
+    rule_bucket_t* bucket = table_find(table, key);
+    if (!bucket) {
+        if ((table->used + 1) * 2 > table->mask + 1 && !table_grow(table)) return false;
+        
+        uint32_t index = key & table->mask;
+        while (table->buckets[index].key != ATOM_NULL) {
+            index = (index + 1) & table->mask;
+        }
+        bucket = &table->buckets[index];
+        bucket->key = key;
+        table->used++;
+    }
+    return bucket_push(bucket, entry);
+}
+
+// Selector analysis
+
+static bool is_combinator(css_selector_type_t type) {
+    return type == SELECTOR_DESCENDANT || type == SELECTOR_CHILD ||
+           type == SELECTOR_ADJACENT_SIBLING || type == SELECTOR_GENERAL_SIBLING;
+}
+
+// Intern the selector's name on first use; type selectors are case-insensitive
+static atom_t selector_atom(css_selector_t* selector) {
+    if (selector->value_atom == ATOM_NULL && selector->value) {
+        selector->value_atom = selector->type == SELECTOR_TYPE
+            ? atom_intern_lower(selector->value, (uint32_t)strlen(selector->value))
+            : atom_intern(selector->value);
+    }
+    return selector->value_atom;
+}
+
+static uint32_t selector_bloom_kind(css_selector_type_t type) {
+    switch (type) {
+        case SELECTOR_TYPE: return BLOOM_KIND_TAG;
+        case SELECTOR_CLASS: return BLOOM_KIND_CLASS;
+        case SELECTOR_ID: return BLOOM_KIND_ID;
+        default: return 0;
+    }
+}
+
+static void index_selector(css_rule_index_t* index, css_rule_t* rule, css_selector_t* selector, uint32_t order, uint32_t condition) {
+    css_rule_entry_t entry = {
+        .rule = rule,
+        .selector = selector,
+        .specificity = selector->specificity ? selector->specificity : css_calculate_specificity(selector),
+        .order = order,
+        .condition = condition
+    };
+    
+    css_selector_t* nodes[RULE_MAX_SELECTOR_NODES];
+    uint32_t node_count = 0;
+    for (css_selector_t* node = selector; node; node = node->next) {
+        if (node_count == RULE_MAX_SELECTOR_NODES) {
+            // Too long to analyse; always try it
+            bucket_push(&index->universal, &entry);
+            return;
+        }
+        nodes[node_count++] = node;
+    }
+    
+    // Rightmost compound: everything after the last combinator
+    uint32_t start = node_count;
+    while (start > 0 && !is_combinator(nodes[start - 1]->type)) {
+        start--;
+    }
+    
+    atom_t id = ATOM_NULL, class_name = ATOM_NULL, tag = ATOM_NULL;
+    for (uint32_t i = start; i < node_count; i++) {
+        atom_t atom = selector_atom(nodes[i]);
+        if (nodes[i]->type == SELECTOR_ID && !id) id = atom;
+        else if (nodes[i]->type == SELECTOR_CLASS && !class_name) class_name = atom;
+        else if (nodes[i]->type == SELECTOR_TYPE && !tag) tag = atom;
+    }
+    
+    // Compounds left of a descendant or child combinator must match an
+    // ancestor. One left of a sibling combinator matches a sibling of the
+    // element or of an ancestor, which need not be an ancestor itself.
+    uint32_t hash_count = 0;
+    bool ancestor = false;
+    for (uint32_t i = start; i > 0 && hash_count < CSS_RULE_ANCESTOR_HASHES; i--) {
+        css_selector_t* node = nodes[i - 1];
+        if (is_combinator(node->type)) {
+            ancestor = node->type == SELECTOR_DESCENDANT || node->type == SELECTOR_CHILD;
+            continue;
+        }
+        
+        uint32_t kind = selector_bloom_kind(node->type);
+        atom_t atom = selector_atom(node);
+        if (ancestor && kind && atom) {
+            entry.ancestor_hashes[hash_count++] = bloom_hash(kind, atom);
+        }
+    }
+    
+    if (id) table_add(&index->ids, id, &entry);
+    else if (class_name) table_add(&index->classes, class_name, &entry);
+    else if (tag) table_add(&index->tags, tag, &entry);
+    else bucket_push(&index->universal, &entry);
+}
+
+// A condition for an @media block inside parent; 0 when out of memory,
+// which leaves the block unconditional rather than dropping it
+static uint32_t add_condition(css_rule_index_t* index, const char* media_query, uint32_t parent) {
+    if (index->condition_count >= index->condition_capacity) {
+        uint32_t new_capacity = capacity_grow(index->condition_capacity, 8, sizeof(rule_condition_t));
+        rule_condition_t* new_conditions = new_capacity ? realloc(index->conditions, new_capacity * sizeof(rule_condition_t)) : NULL;
+        if (!new_conditions) return parent;
+        index->conditions = new_conditions;
+        index->condition_capacity = new_capacity;
+    }
+    
+    rule_condition_t* condition = &index->conditions[index->condition_count++];
+    condition->always = !media_query || !*media_query;
+    condition->query = condition->always ? NULL : css_parse_media_query(media_query);
+    condition->parent = parent;
+    return index->condition_count;
+}
+
+// Invalid queries match nothing, as "not all"
+static bool condition_matches(const css_rule_index_t* index, uint32_t condition) {
+    while (condition) {
+        const rule_condition_t* entry = &index->conditions[condition - 1];
+        if (!entry->always && (!entry->query || !css_media_query_matches(entry->query, NULL))) return false;
+        condition = entry->parent;
+    }
+    return true;
+}
+
+// Files rules depth first, so order follows the source across nesting.
+// @supports groups apply as written; their conditions are not evaluated.
+static void index_rules(css_rule_index_t* index, css_rule_t** rules, uint32_t rule_count, uint32_t condition) {
+    for (uint32_t i = 0; i < rule_count; i++) {
+        css_rule_t* rule = rules[i];
+        if (!rule) continue;
+        
+        if (rule->type == RULE_STYLE) {
+            uint32_t order = index->rule_count++;
+            for (uint32_t j = 0; j < rule->selector_count; j++) {
+                if (rule->selectors[j]) {
+                    index_selector(index, rule, rule->selectors[j], order, condition);
+                }
+            }
+        } else if (rule->type == RULE_MEDIA) {
+            uint32_t nested = add_condition(index, rule->media.media_query, condition);
+            index_rules(index, rule->media.rules, rule->media.rule_count, nested);
+        } else if (rule->type == RULE_SUPPORTS) {
+            index_rules(index, rule->media.rules, rule->media.rule_count, condition);
+        }
+    }
+}
+
+css_rule_index_t* css_rule_index_create(css_stylesheet_t* stylesheet) {
+    if (!stylesheet) return NULL;
+    
+    css_rule_index_t* index = calloc(1, sizeof(css_rule_index_t));
+    if (!index) return NULL;
+    
+    if (!table_init(&index->ids) || !table_init(&index->classes) || !table_init(&index->tags)) {
+        css_rule_index_destroy(index);
+        return NULL;
+    }
+    
+    index_rules(index, stylesheet->rules, stylesheet->rule_count, 0);
+    return index;
+}
+
+void css_rule_index_destroy(css_rule_index_t* index) {
+    if (!index) return;
+    
+    table_free(&index->ids);
+    table_free(&index->classes);
+    table_free(&index->tags);
+    free(index->universal.entries);
+    for (uint32_t i = 0; i < index->condition_count; i++) {
+        css_media_query_destroy(index->conditions[i].query);
+    }
+    free(index->conditions);
+    free(index);
+}
+
+css_rule_index_t* css_stylesheet_get_rule_index(css_stylesheet_t* stylesheet) {
+    if (!stylesheet) return NULL;
+    if (!stylesheet->rule_index) {
+        stylesheet->rule_index = css_rule_index_create(stylesheet);
+    }
+    return stylesheet->rule_index;
+}
+
+// Call whenever rules are inserted, removed or edited
+void css_stylesheet_invalidate_rules(css_stylesheet_t* stylesheet) {
+    if (!stylesheet) return;
+    css_rule_index_destroy(stylesheet->rule_index);
+    stylesheet->rule_index = NULL;
+}
+
+// Declaration collection
+
+typedef struct {
+    css_cascade_entry_t* entries;
+    uint32_t count;
+    uint32_t capacity;
+} collect_buffer_t;
+
+static void collect_bucket(collect_buffer_t* buffer, const css_rule_index_t* index, const rule_bucket_t* bucket, struct dom_element* element, const css_bloom_filter_t* ancestors, uint32_t order_base) {
+    if (!bucket) return;
+    
+    for (uint32_t i = 0; i < bucket->count; i++) {
+        const css_rule_entry_t* entry = &bucket->entries[i];
+        
+        if (ancestors) {
+            bool rejected = false;
+            for (uint32_t h = 0; h < CSS_RULE_ANCESTOR_HASHES && entry->ancestor_hashes[h]; h++) {
+                if (!css_bloom_might_contain(ancestors, entry->ancestor_hashes[h])) {
+                    rejected = true;
+                    break;
+                }
+            }
+            if (rejected) continue;
+        }
+        
+        if (!css_selector_matches(entry->selector, element)) continue;
+        if (entry->condition && !condition_matches(index, entry->condition)) continue;
+        
+        css_declaration_t* declarations = entry->rule->declarations;
+        if (!declarations) continue;
+        
+        for (uint32_t p = 0; p < declarations->property_count; p++) {
+            if (buffer->count >= buffer->capacity) {
+                uint32_t new_capacity = capacity_grow(buffer->capacity, 64, sizeof(css_cascade_entry_t));
+                css_cascade_entry_t* new_entries = new_capacity ? realloc(buffer->entries, new_capacity * sizeof(css_cascade_entry_t)) : NULL;
+                if (!new_entries) return;
+                buffer->entries = new_entries;
+                buffer->capacity = new_capacity;
+            }
+            
+            css_cascade_entry_t* out = &buffer->entries[buffer->count++];
+            out->rule = entry->rule;
+            out->selector = entry->selector;
+            out->property = declarations->properties[p];
+            out->specificity = entry->specificity;
+            out->order = order_base + entry->order;
+            out->origin = ORIGIN_AUTHOR;
+        }
+    }
+}
+
+css_cascade_entry_t** css_collect_declarations_filtered(struct dom_element* element, css_stylesheet_t** stylesheets, uint32_t stylesheet_count, const css_bloom_filter_t* ancestors, uint32_t* count) {
+    if (count) *count = 0;
+    if (!element || !stylesheets) return NULL;
+    
+    collect_buffer_t buffer = {0};
+    uint32_t order_base = 0;
+    
+    for (uint32_t s = 0; s < stylesheet_count; s++) {
+        css_stylesheet_t* stylesheet = stylesheets[s];
+        if (!stylesheet || stylesheet->disabled) continue;
+        
+        css_rule_index_t* index = css_stylesheet_get_rule_index(stylesheet);
+        if (!index) continue;
+        
+        collect_bucket(&buffer, index, table_find(&index->ids, element->id_atom), element, ancestors, order_base);
+        if (element->class_atoms) {
+            for (uint32_t i = 0; i < element->class_count; i++) {
+                // class="a a" names one bucket
+                bool repeated = false;
+                for (uint32_t j = 0; j < i && !repeated; j++) {
+                    repeated = element->class_atoms[j] == element->class_atoms[i];
+                }
+                if (!repeated) {
+                    collect_bucket(&buffer, index, table_find(&index->classes, element->class_atoms[i]), element, ancestors, order_base);
+                }
+            }
+        }
+        collect_bucket(&buffer, index, table_find(&index->tags, element->tag_atom), element, ancestors, order_base);
+        collect_bucket(&buffer, index, &index->universal, element, ancestors, order_base);
+        
+        order_base += index->rule_count;
+    }
+    
+    if (buffer.count == 0) {
+        free(buffer.entries);
+        return NULL;
+    }
+    
+    // Pointer array followed by the entries, freed as one block
+    css_cascade_entry_t** result = malloc(buffer.count * (sizeof(css_cascade_entry_t*) + sizeof(css_cascade_entry_t)));
+    if (!result) {
+        free(buffer.entries);
+        return NULL;
+    }
+    
+    css_cascade_entry_t* entries = (css_cascade_entry_t*)(result + buffer.count);
+    memcpy(entries, buffer.entries, buffer.count * sizeof(css_cascade_entry_t));
+    for (uint32_t i = 0; i < buffer.count; i++) {
+        result[i] = &entries[i];
+    }
+    free(buffer.entries);
+    
+    if (count) *count = buffer.count;
+    return result;
+}
+
+css_cascade_entry_t** css_collect_declarations(struct dom_element* element, css_stylesheet_t** stylesheets, uint32_t stylesheet_count, uint32_t* count) {
+    return css_collect_declarations_filtered(element, stylesheets, stylesheet_count, NULL, count);
+}
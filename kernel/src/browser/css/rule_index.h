@@ -0,0 +1,62 @@
+#ifndef CSS_RULE_INDEX_H
+#define CSS_RULE_INDEX_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "style.h"
+
+// Counting Bloom filter over the ids, classes and tags of the ancestors of
+// the element being styled. The style walk pushes an element before
+// descending into its children and pops it afterwards.
+#define CSS_BLOOM_BITS 12
+#define CSS_BLOOM_SIZE (1 << CSS_BLOOM_BITS)
+#define CSS_BLOOM_MASK (CSS_BLOOM_SIZE - 1)
+
+typedef struct {
+    uint8_t counters[CSS_BLOOM_SIZE];
+} css_bloom_filter_t;
+
+void css_bloom_clear(css_bloom_filter_t* filter);
+void css_bloom_push_element(css_bloom_filter_t* filter, struct dom_element* element);
+void css_bloom_pop_element(css_bloom_filter_t* filter, struct dom_element* element);
+bool css_bloom_might_contain(const css_bloom_filter_t* filter, uint32_t hash);
+
+// Rule index for one stylesheet. Each selector is filed under the most
+// selective key of its rightmost compound: id, then class, then tag, else
+// the universal list. Up to CSS_RULE_ANCESTOR_HASHES keys that must be on
+// an ancestor are stored with it so css_bloom_might_contain can reject it
+// before css_selector_matches runs.
+//
+// Selectors are read as a list linked through next in source order, with
+// combinators appearing as their own SELECTOR_DESCENDANT/CHILD/..._SIBLING
+// nodes between compounds.
+//
+// Style rules nested in @media and @supports are indexed too, numbered in
+// source order with the rest. A rule inside @media records its innermost
+// media condition; it only applies while that condition and the ones
+// enclosing it match.
+#define CSS_RULE_ANCESTOR_HASHES 4
+
+typedef struct {
+    css_rule_t* rule;
+    css_selector_t* selector;
+    uint32_t specificity;
+    uint32_t order;
+    uint32_t condition;             // 1-based media condition, or 0
+    uint32_t ancestor_hashes[CSS_RULE_ANCESTOR_HASHES];
+} css_rule_entry_t;
+
+typedef struct css_rule_index css_rule_index_t;
+
+css_rule_index_t* css_rule_index_create(css_stylesheet_t* stylesheet);
+void css_rule_index_destroy(css_rule_index_t* index);
+
+// Built on first use and kept on the stylesheet until its rules change
+css_rule_index_t* css_stylesheet_get_rule_index(css_stylesheet_t* stylesheet);
+void css_stylesheet_invalidate_rules(css_stylesheet_t* stylesheet);
+
+// css_collect_declarations with ancestor filtering. ancestors may be NULL.
+// The returned array and its entries are a single allocation; free() it.
+css_cascade_entry_t** css_collect_declarations_filtered(struct dom_element* element, css_stylesheet_t** stylesheets, uint32_t stylesheet_count, const css_bloom_filter_t* ancestors, uint32_t* count);
+
+#endif
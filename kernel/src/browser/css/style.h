@@ -4,12 +4,66 @@
 #include <stdint.h>
 #include <stdbool.h>
 #include "parser.h"
+#include "value.h"
 
 // Forward declarations
 struct dom_element;
 
-// CSS computed style
-typedef struct {
+// Inherited computed properties. One instance is shared by an element and
+// every descendant that does not override an inherited property; it is
+// copy-on-write through css_style_mutable_inherited and owns its values.
+typedef struct css_inherited_style {
+    uint32_t ref_count;
+    
+    // Font size, line height, spacing, indent and color, indexed by
+    // css_inherited_property_t; complex values live in complex_values
+    css_packed_value_t values[CSS_INHERITED_COUNT];
+    css_value_table_t complex_values;
+    
+    // Typography
+    char** font_family;
+    uint32_t font_family_count;
+    enum {
+        FONT_WEIGHT_NORMAL = 400, FONT_WEIGHT_BOLD = 700
+    } font_weight;
+    enum {
+        FONT_STYLE_NORMAL, FONT_STYLE_ITALIC, FONT_STYLE_OBLIQUE
+    } font_style;
+    enum {
+        TEXT_ALIGN_LEFT, TEXT_ALIGN_RIGHT, TEXT_ALIGN_CENTER,
+        TEXT_ALIGN_JUSTIFY, TEXT_ALIGN_START, TEXT_ALIGN_END
+    } text_align;
+    enum {
+        TEXT_TRANSFORM_NONE, TEXT_TRANSFORM_CAPITALIZE,
+        TEXT_TRANSFORM_UPPERCASE, TEXT_TRANSFORM_LOWERCASE
+    } text_transform;
+    
+    // Visibility and interaction
+    enum {
+        VISIBILITY_VISIBLE, VISIBILITY_HIDDEN, VISIBILITY_COLLAPSE
+    } visibility;
+    enum {
+        CURSOR_AUTO, CURSOR_DEFAULT, CURSOR_POINTER, CURSOR_MOVE,
+        CURSOR_TEXT, CURSOR_WAIT, CURSOR_HELP, CURSOR_CROSSHAIR,
+        CURSOR_NOT_ALLOWED, CURSOR_PROGRESS
+    } cursor;
+    enum {
+        POINTER_EVENTS_AUTO, POINTER_EVENTS_NONE
+    } pointer_events;
+} css_inherited_style_t;
+
+// CSS computed style. Styles are refcounted and may be shared by several
+// elements (see css_style_cache_t), so they are never modified once
+// published; css_computed_style_destroy is only reached through the last
+// css_computed_style_release and releases inherited.
+typedef struct css_computed_style {
+    uint32_t ref_count;
+    
+    // Lengths, colors and numbers (margins, padding, borders, sizes,
+    // offsets, flex, opacity, ...) indexed by css_style_property_t
+    css_packed_value_t values[CSS_PROP_COUNT];
+    css_value_table_t complex_values;
+    
     // Display and positioning
     enum {
         DISPLAY_NONE, DISPLAY_BLOCK, DISPLAY_INLINE, DISPLAY_INLINE_BLOCK,
@@ -31,60 +85,19 @@ typedef struct {
     } clear;
     
     // Box model
-    struct {
-        css_value_t* top;
-        css_value_t* right;
-        css_value_t* bottom;
-        css_value_t* left;
-    } margin, padding, border_width;
-    
-    css_value_t* width;
-    css_value_t* height;
-    css_value_t* min_width;
-    css_value_t* min_height;
-    css_value_t* max_width;
-    css_value_t* max_height;
-    
     enum {
         BOX_SIZING_CONTENT_BOX, BOX_SIZING_BORDER_BOX
     } box_sizing;
     
-    // Position offsets
-    css_value_t* top;
-    css_value_t* right;
-    css_value_t* bottom;
-    css_value_t* left;
+    // Inherited properties, shared with the parent until overridden
+    css_inherited_style_t* inherited;
     
-    // Typography
-    char** font_family;
-    uint32_t font_family_count;
-    css_value_t* font_size;
-    enum {
-        FONT_WEIGHT_NORMAL = 400, FONT_WEIGHT_BOLD = 700
-    } font_weight;
-    enum {
-        FONT_STYLE_NORMAL, FONT_STYLE_ITALIC, FONT_STYLE_OBLIQUE
-    } font_style;
-    css_value_t* line_height;
-    enum {
-        TEXT_ALIGN_LEFT, TEXT_ALIGN_RIGHT, TEXT_ALIGN_CENTER,
-        TEXT_ALIGN_JUSTIFY, TEXT_ALIGN_START, TEXT_ALIGN_END
-    } text_align;
     enum {
         TEXT_DECORATION_NONE, TEXT_DECORATION_UNDERLINE,
         TEXT_DECORATION_OVERLINE, TEXT_DECORATION_LINE_THROUGH
     } text_decoration;
-    enum {
-        TEXT_TRANSFORM_NONE, TEXT_TRANSFORM_CAPITALIZE,
-        TEXT_TRANSFORM_UPPERCASE, TEXT_TRANSFORM_LOWERCASE
-    } text_transform;
-    css_value_t* letter_spacing;
-    css_value_t* word_spacing;
-    css_value_t* text_indent;
     
-    // Colors and backgrounds
-    css_value_t* color;
-    css_value_t* background_color;
+    // Backgrounds
     char** background_image;
     uint32_t background_image_count;
     enum {
@@ -94,10 +107,6 @@ typedef struct {
     enum {
         BG_ATTACHMENT_SCROLL, BG_ATTACHMENT_FIXED, BG_ATTACHMENT_LOCAL
     } background_attachment;
-    struct {
-        css_value_t* x;
-        css_value_t* y;
-    } background_position;
     enum {
         BG_SIZE_AUTO, BG_SIZE_COVER, BG_SIZE_CONTAIN
     } background_size;
@@ -108,8 +117,6 @@ typedef struct {
         BORDER_STYLE_DOTTED, BORDER_STYLE_DOUBLE, BORDER_STYLE_GROOVE,
         BORDER_STYLE_RIDGE, BORDER_STYLE_INSET, BORDER_STYLE_OUTSET
     } border_style[4];
-    css_value_t* border_color[4];
-    css_value_t* border_radius[4];
     
     // Flexbox
     enum {
@@ -127,11 +134,6 @@ typedef struct {
         ALIGN_FLEX_START, ALIGN_FLEX_END, ALIGN_CENTER,
         ALIGN_BASELINE, ALIGN_STRETCH
     } align_items, align_self;
-    css_value_t* flex_grow;
-    css_value_t* flex_shrink;
-    css_value_t* flex_basis;
-    css_value_t* order;
-    css_value_t* gap;
     
     // Grid
     char** grid_template_columns;
@@ -140,34 +142,23 @@ typedef struct {
     uint32_t grid_row_count;
     char** grid_template_areas;
     uint32_t grid_area_count;
-    css_value_t* grid_gap;
     struct {
         uint32_t start;
         uint32_t end;
     } grid_column, grid_row;
     
-    // Visibility and overflow
-    enum {
-        VISIBILITY_VISIBLE, VISIBILITY_HIDDEN, VISIBILITY_COLLAPSE
-    } visibility;
+    // Overflow
     enum {
         OVERFLOW_VISIBLE, OVERFLOW_HIDDEN, OVERFLOW_SCROLL,
         OVERFLOW_AUTO, OVERFLOW_CLIP
     } overflow_x, overflow_y;
-    css_value_t* opacity;
     
     // Transforms
     char** transform;
     uint32_t transform_count;
-    struct {
-        css_value_t* x;
-        css_value_t* y;
-        css_value_t* z;
-    } transform_origin;
     enum {
         TRANSFORM_STYLE_FLAT, TRANSFORM_STYLE_PRESERVE_3D
     } transform_style;
-    css_value_t* perspective;
     
     // Transitions and animations
     struct {
@@ -199,15 +190,6 @@ typedef struct {
     uint32_t animation_count;
     
     // Miscellaneous
-    css_value_t* z_index;
-    enum {
-        CURSOR_AUTO, CURSOR_DEFAULT, CURSOR_POINTER, CURSOR_MOVE,
-        CURSOR_TEXT, CURSOR_WAIT, CURSOR_HELP, CURSOR_CROSSHAIR,
-        CURSOR_NOT_ALLOWED, CURSOR_PROGRESS
-    } cursor;
-    enum {
-        POINTER_EVENTS_AUTO, POINTER_EVENTS_NONE
-    } pointer_events;
     enum {
         USER_SELECT_AUTO, USER_SELECT_NONE, USER_SELECT_TEXT, USER_SELECT_ALL
     } user_select;
@@ -223,7 +205,30 @@ typedef struct {
 // Style computation
 css_computed_style_t* css_compute_style(struct dom_element* element, css_stylesheet_t** stylesheets, uint32_t stylesheet_count);
 void css_computed_style_destroy(css_computed_style_t* style);
+css_computed_style_t* css_computed_style_retain(css_computed_style_t* style);
+void css_computed_style_release(css_computed_style_t* style);
+
+// Inherited style sharing
+css_inherited_style_t* css_inherited_style_create(void);
+css_inherited_style_t* css_inherited_style_retain(css_inherited_style_t* inherited);
+void css_inherited_style_release(css_inherited_style_t* inherited);
+css_inherited_style_t* css_style_mutable_inherited(css_computed_style_t* style);
+css_value_t* css_value_clone(const css_value_t* value);
+
+// Computed value lookup. The packed form is read in place; the css_value_t
+// form is unpacked into a new value the caller destroys.
+css_packed_value_t css_get_packed_value(css_computed_style_t* style, atom_t property);
 css_value_t* css_get_computed_value(css_computed_style_t* style, const char* property);
+css_value_t* css_get_computed_value_atom(css_computed_style_t* style, atom_t property);
+
+static inline css_packed_value_t css_style_get(const css_computed_style_t* style, css_style_property_t property) {
+    return style->values[property];
+}
+
+static inline css_packed_value_t css_style_get_inherited(const css_computed_style_t* style, css_inherited_property_t property) {
+    css_packed_value_t unset = { .type = CSS_PACKED_UNSET };
+    return style->inherited ? style->inherited->values[property] : unset;
+}
 void css_set_inline_style(struct dom_element* element, const char* property, const char* value);
 
 // Cascade and inheritance
@@ -247,6 +252,7 @@ void css_sort_declarations(css_cascade_entry_t** entries, uint32_t count);
 css_value_t* css_cascade_property(const char* property, css_cascade_entry_t** entries, uint32_t count);
 css_value_t* css_inherit_property(const char* property, css_computed_style_t* parent_style);
 bool css_is_inherited_property(const char* property);
+bool css_is_inherited_atom(atom_t property);
 
 // CSS animations
 typedef struct {
@@ -262,10 +268,20 @@ css_animation_t* css_find_animation(const char* name, css_stylesheet_t** stylesh
 css_computed_style_t* css_interpolate_animation(css_animation_t* animation, double progress, css_computed_style_t* base_style);
 void css_animation_destroy(css_animation_t* animation);
 
-// Style invalidation
-typedef struct {
+// Style invalidation. elements lists the elements whose computed style
+// changed, with how much of the pipeline each change reaches in changes;
+// see css/invalidation.h for the mutation-driven path that fills it.
+typedef enum {
+    CSS_STYLE_CHANGE_NONE,
+    CSS_STYLE_CHANGE_PAINT,         // Same geometry, repaint only
+    CSS_STYLE_CHANGE_LAYOUT
+} css_style_change_t;
+
+typedef struct css_invalidation {
     struct dom_element** elements;
+    css_style_change_t* changes;
     uint32_t element_count;
+    uint32_t element_capacity;
     bool needs_layout;
     bool needs_paint;
 } css_invalidation_t;
@@ -273,10 +289,15 @@ typedef struct {
 css_invalidation_t* css_invalidate_style(struct dom_element* element, const char* property);
 void css_invalidation_destroy(css_invalidation_t* invalidation);
 
-// Style matching cache
+// Style sharing cache. Elements whose styles are guaranteed equal share a
+// single computed style: same parent style, tag, id, classes, inline style
+// and values of every attribute some selector tests. Elements that a
+// selector with pseudo-classes or sibling combinators could single out are
+// never shared. css_style_cache_set_stylesheets must be called whenever
+// the stylesheet set changes; it clears the cache.
 typedef struct {
-    void* selector_cache;
-    void* computed_style_cache;
+    void* selector_cache;           // What the stylesheets make style-relevant
+    void* computed_style_cache;     // Sharing key -> style
     uint64_t hit_count;
     uint64_t miss_count;
 } css_style_cache_t;
@@ -284,6 +305,9 @@ typedef struct {
 css_style_cache_t* css_style_cache_create(void);
 void css_style_cache_destroy(css_style_cache_t* cache);
 void css_style_cache_clear(css_style_cache_t* cache);
+void css_style_cache_set_stylesheets(css_style_cache_t* cache, css_stylesheet_t** stylesheets, uint32_t stylesheet_count);
+
+// get returns a new reference or NULL; put retains the style
 css_computed_style_t* css_style_cache_get(css_style_cache_t* cache, struct dom_element* element);
 void css_style_cache_put(css_style_cache_t* cache, struct dom_element* element, css_computed_style_t* style);
 
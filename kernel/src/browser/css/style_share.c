@@ -0,0 +1,537 @@
+#include "style.h"
+#include "../html/dom.h"
+#include "../capacity.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define STYLE_CACHE_INITIAL_SIZE 256
+#define STYLE_CACHE_MAX_ENTRIES 8192
+
+// Key kinds for elements a dynamic selector could single out
+enum {
+    SHARE_KEY_TAG = 1u << 28,
+    SHARE_KEY_CLASS = 2u << 28,
+    SHARE_KEY_ID = 3u << 28
+};
+
+// What the current stylesheets make style-relevant
+typedef struct {
+    atom_t* attributes;             // Sorted attribute names tested by selectors
+    uint32_t attribute_count;
+    uint32_t attribute_capacity;
+    uint32_t* unshareable;          // Sorted SHARE_KEY_* | atom
+    uint32_t unshareable_count;
+    uint32_t unshareable_capacity;
+    bool sharing_disabled;          // A dynamic selector with no key
+} style_selector_info_t;
+
+typedef struct {
+    uint32_t hash;
+    uint8_t* key;
+    uint32_t key_length;
+    css_computed_style_t* parent;   // Retained so its address stays unique
+    css_computed_style_t* style;
+} style_cache_entry_t;
+
+typedef struct {
+    style_cache_entry_t* entries;
+    uint32_t mask;
+    uint32_t used;
+    
+    // Scratch buffer for building keys
+    uint8_t* buffer;
+    uint32_t length;
+    uint32_t capacity;
+} style_share_table_t;
+
+// Reference counting
+
+css_computed_style_t* css_computed_style_retain(css_computed_style_t* style) {
+    if (style) __atomic_add_fetch(&style->ref_count, 1, __ATOMIC_ACQ_REL);
+    return style;
+}
+
+void css_computed_style_release(css_computed_style_t* style) {
+    if (!style) return;
+    if (__atomic_sub_fetch(&style->ref_count, 1, __ATOMIC_ACQ_REL) == 0) {
+        css_computed_style_destroy(style);
+    }
+}
+
+css_inherited_style_t* css_inherited_style_create(void) {
+    css_inherited_style_t* inherited = calloc(1, sizeof(css_inherited_style_t));
+    if (!inherited) return NULL;
+    
+    inherited->ref_count = 1;
+    inherited->font_weight = FONT_WEIGHT_NORMAL;
+    inherited->font_style = FONT_STYLE_NORMAL;
+    inherited->text_align = TEXT_ALIGN_START;
+    inherited->visibility = VISIBILITY_VISIBLE;
+    inherited->cursor = CURSOR_AUTO;
+    inherited->pointer_events = POINTER_EVENTS_AUTO;
+    
+    return inherited;
+}
+
+css_inherited_style_t* css_inherited_style_retain(css_inherited_style_t* inherited) {
+    if (inherited) __atomic_add_fetch(&inherited->ref_count, 1, __ATOMIC_ACQ_REL);
+    return inherited;
+}
+
+void css_inherited_style_release(css_inherited_style_t* inherited) {
+    if (!inherited) return;
+    if (__atomic_sub_fetch(&inherited->ref_count, 1, __ATOMIC_ACQ_REL) != 0) return;
+    
+    for (uint32_t i = 0; i < inherited->font_family_count; i++) {
+        free(inherited->font_family[i]);
+    }
+    free(inherited->font_family);
+    
+    css_value_table_clear(&inherited->complex_values);
+    free(inherited);
+}
+
+css_value_t* css_value_clone(const css_value_t* value) {
+    if (!value) return NULL;
+    
+    css_value_t* copy = malloc(sizeof(css_value_t));
+    if (!copy) return NULL;
+    *copy = *value;
+    
+    switch (value->type) {
+        case VALUE_STRING:
+            copy->value.string = value->value.string ? strdup(value->value.string) : NULL;
+            break;
+        case VALUE_URL:
+            copy->value.url = value->value.url ? strdup(value->value.url) : NULL;
+            break;
+        case VALUE_KEYWORD:
+            copy->value.keyword = value->value.keyword ? strdup(value->value.keyword) : NULL;
+            break;
+        case VALUE_FUNCTION:
+            copy->value.function.name = value->value.function.name ? strdup(value->value.function.name) : NULL;
+            copy->value.function.arguments = NULL;
+            if (value->value.function.argument_count) {
+                copy->value.function.arguments = calloc(value->value.function.argument_count, sizeof(css_value_t*));
+                if (!copy->value.function.arguments) {
+                    copy->value.function.argument_count = 0;
+                    break;
+                }
+                for (uint32_t i = 0; i < value->value.function.argument_count; i++) {
+                    copy->value.function.arguments[i] = css_value_clone(value->value.function.arguments[i]);
+                }
+            }
+            break;
+        case VALUE_LIST:
+            copy->value.list.items = NULL;
+            if (value->value.list.item_count) {
+                copy->value.list.items = calloc(value->value.list.item_count, sizeof(css_value_t*));
+                if (!copy->value.list.items) {
+                    copy->value.list.item_count = 0;
+                    break;
+                }
+                for (uint32_t i = 0; i < value->value.list.item_count; i++) {
+                    copy->value.list.items[i] = css_value_clone(value->value.list.items[i]);
+                }
+            }
+            break;
+        default:
+            break;
+    }
+    
+    return copy;
+}
+
+// Give the style its own inherited struct before writing to it
+css_inherited_style_t* css_style_mutable_inherited(css_computed_style_t* style) {
+    if (!style) return NULL;
+    
+    css_inherited_style_t* inherited = style->inherited;
+    if (!inherited) {
+        style->inherited = css_inherited_style_create();
+        return style->inherited;
+    }
+    if (__atomic_load_n(&inherited->ref_count, __ATOMIC_ACQUIRE) == 1) return inherited;
+    
+    css_inherited_style_t* copy = malloc(sizeof(css_inherited_style_t));
+    if (!copy) return NULL;
+    *copy = *inherited;
+    copy->ref_count = 1;
+    
+    copy->font_family = NULL;
+    copy->font_family_count = 0;
+    if (inherited->font_family_count) {
+        copy->font_family = calloc(inherited->font_family_count, sizeof(char*));
+        if (copy->font_family) {
+            for (uint32_t i = 0; i < inherited->font_family_count; i++) {
+                copy->font_family[i] = strdup(inherited->font_family[i]);
+            }
+            copy->font_family_count = inherited->font_family_count;
+        }
+    }
+    
+    // Inline values came across with the struct copy; complex slot
+    // indices stay valid because the table is cloned in order
+    css_value_table_clone(&copy->complex_values, &inherited->complex_values);
+    
+    style->inherited = copy;
+    css_inherited_style_release(inherited);
+    return copy;
+}
+
+// Selector analysis
+
+static bool sorted_insert(uint32_t** array, uint32_t* count, uint32_t* capacity, uint32_t value) {
+    uint32_t low = 0, high = *count;
+    while (low < high) {
+        uint32_t mid = (low + high) / 2;
+        if ((*array)[mid] < value) low = mid + 1;
+        else high = mid;
+    }
+    if (low < *count && (*array)[low] == value) return true;
+    
+    if (*count >= *capacity) {
+        uint32_t new_capacity = capacity_grow(*capacity, 16, sizeof(uint32_t));
+        uint32_t* new_array = new_capacity ? realloc(*array, new_capacity * sizeof(uint32_t)) : NULL;
+        if (!new_array) return false;
+        *array = new_array;
+        *capacity = new_capacity;
+    }
+    
+    memmove(&(*array)[low + 1], &(*array)[low], (*count - low) * sizeof(uint32_t));
+    (*array)[low] = value;
+    (*count)++;
+    return true;
+}
+
+static bool sorted_contains(const uint32_t* array, uint32_t count, uint32_t value) {
+    uint32_t low = 0, high = count;
+    while (low < high) {
+        uint32_t mid = (low + high) / 2;
+        if (array[mid] == value) return true;
+        if (array[mid] < value) low = mid + 1;
+        else high = mid;
+    }
+    return false;
+}
+
+static void analyse_selector(style_selector_info_t* info, css_selector_t* selector) {
+    bool dynamic = false;
+    atom_t id = ATOM_NULL, class_name = ATOM_NULL, tag = ATOM_NULL;
+    
+    for (css_selector_t* node = selector; node; node = node->next) {
+        switch (node->type) {
+            case SELECTOR_ATTRIBUTE:
+                if (node->attribute.name_atom == ATOM_NULL && node->attribute.name) {
+                    node->attribute.name_atom = atom_intern_lower(node->attribute.name, (uint32_t)strlen(node->attribute.name));
+                }
+                if (node->attribute.name_atom &&
+                    !sorted_insert(&info->attributes, &info->attribute_count, &info->attribute_capacity, node->attribute.name_atom)) {
+                    info->sharing_disabled = true;
+                }
+                break;
+            case SELECTOR_PSEUDO_CLASS:
+                dynamic = true;
+                break;
+            case SELECTOR_ADJACENT_SIBLING:
+            case SELECTOR_GENERAL_SIBLING:
+                dynamic = true;
+                id = class_name = tag = ATOM_NULL;
+                break;
+            case SELECTOR_DESCENDANT:
+            case SELECTOR_CHILD:
+                // Only the rightmost compound supplies the key
+                id = class_name = tag = ATOM_NULL;
+                break;
+            case SELECTOR_ID:
+                if (!id && node->value) id = atom_intern(node->value);
+                break;
+            case SELECTOR_CLASS:
+                if (!class_name && node->value) class_name = atom_intern(node->value);
+                break;
+            case SELECTOR_TYPE:
+                if (!tag && node->value) tag = atom_intern_lower(node->value, (uint32_t)strlen(node->value));
+                break;
+            default:
+                break;
+        }
+    }
+    
+    if (!dynamic) return;
+    
+    uint32_t key = id ? SHARE_KEY_ID | id : class_name ? SHARE_KEY_CLASS | class_name : tag ? SHARE_KEY_TAG | tag : 0;
+    if (!key || !sorted_insert(&info->unshareable, &info->unshareable_count, &info->unshareable_capacity, key)) {
+        info->sharing_disabled = true;
+    }
+}
+
+static void analyse_rules(style_selector_info_t* info, css_rule_t** rules, uint32_t rule_count) {
+    for (uint32_t i = 0; i < rule_count; i++) {
+        css_rule_t* rule = rules[i];
+        if (!rule) continue;
+        
+        if (rule->type == RULE_STYLE) {
+            for (uint32_t j = 0; j < rule->selector_count; j++) {
+                analyse_selector(info, rule->selectors[j]);
+            }
+        } else if (rule->type == RULE_MEDIA || rule->type == RULE_SUPPORTS) {
+            analyse_rules(info, rule->media.rules, rule->media.rule_count);
+        }
+    }
+}
+
+static void selector_info_reset(style_selector_info_t* info) {
+    free(info->attributes);
+    free(info->unshareable);
+    memset(info, 0, sizeof(*info));
+}
+
+static bool element_is_shareable(const style_selector_info_t* info, dom_element_t* element) {
+    if (info->sharing_disabled) return false;
+    if (element->class_count && !element->class_atoms) return false;
+    if (info->unshareable_count == 0) return true;
+    
+    if (sorted_contains(info->unshareable, info->unshareable_count, SHARE_KEY_TAG | element->tag_atom)) return false;
+    if (element->id_atom && sorted_contains(info->unshareable, info->unshareable_count, SHARE_KEY_ID | element->id_atom)) return false;
+    for (uint32_t i = 0; i < element->class_count; i++) {
+        if (sorted_contains(info->unshareable, info->unshareable_count, SHARE_KEY_CLASS | element->class_atoms[i])) return false;
+    }
+    return true;
+}
+
+// Sharing keys
+
+static bool key_append(style_share_table_t* table, const void* data, uint32_t length) {
+    if ((uint64_t)table->length + length > table->capacity) {
+        uint32_t new_capacity = capacity_reserve(table->capacity, (uint64_t)table->length + length, 256, 1);
+        uint8_t* new_buffer = new_capacity ? realloc(table->buffer, new_capacity) : NULL;
+        if (!new_buffer) return false;
+        table->buffer = new_buffer;
+        table->capacity = new_capacity;
+    }
+    memcpy(table->buffer + table->length, data, length);
+    table->length += length;
+    return true;
+}
+
+static bool key_append_string(style_share_table_t* table, const char* str) {
+    uint32_t length = str ? (uint32_t)strlen(str) : UINT32_MAX;
+    if (!key_append(table, &length, sizeof(length))) return false;
+    return !str || key_append(table, str, length);
+}
+
+static int compare_atoms(const void* a, const void* b) {
+    atom_t x = *(const atom_t*)a, y = *(const atom_t*)b;
+    return x < y ? -1 : x > y;
+}
+
+// Everything that can make two elements' styles differ
+static bool build_key(style_share_table_t* table, const style_selector_info_t* info, dom_element_t* element, css_computed_style_t* parent) {
+    table->length = 0;
+    
+    if (!key_append(table, &parent, sizeof(parent))) return false;
+    if (!key_append(table, &element->tag_atom, sizeof(atom_t))) return false;
+    if (!key_append(table, &element->id_atom, sizeof(atom_t))) return false;
+    
+    atom_t classes[32];
+    uint32_t class_count = element->class_count;
+    if (class_count > 32) return false;
+    memcpy(classes, element->class_atoms, class_count * sizeof(atom_t));
+    qsort(classes, class_count, sizeof(atom_t), compare_atoms);
+    if (!key_append(table, &class_count, sizeof(class_count))) return false;
+    if (!key_append(table, classes, class_count * sizeof(atom_t))) return false;
+    
+    if (!key_append_string(table, dom_element_get_attribute_atom(element, ATOM_style))) return false;
+    for (uint32_t i = 0; i < info->attribute_count; i++) {
+        if (!key_append_string(table, dom_element_get_attribute_atom(element, info->attributes[i]))) return false;
+    }
+    
+    return true;
+}
+
+static uint32_t key_hash(const uint8_t* key, uint32_t length) {
+    uint32_t hash = 2166136261u;
+    for (uint32_t i = 0; i < length; i++) {
+        hash ^= key[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+static css_computed_style_t* parent_style(dom_element_t* element) {
+    dom_node_t* parent = element->base.parent_node;
+    if (!parent || parent->type != NODE_ELEMENT) return NULL;
+    return ((dom_element_t*)parent)->computed_style;
+}
+
+// Sharing table
+
+static void table_clear(style_share_table_t* table) {
+    for (uint32_t i = 0; table->entries && i <= table->mask; i++) {
+        style_cache_entry_t* entry = &table->entries[i];
+        if (!entry->key) continue;
+        
+        free(entry->key);
+        css_computed_style_release(entry->style);
+        css_computed_style_release(entry->parent);
+        memset(entry, 0, sizeof(*entry));
+    }
+    table->used = 0;
+}
+
+static style_cache_entry_t* table_slot(style_share_table_t* table, uint32_t hash) {
+    uint32_t index = hash & table->mask;
+    while (table->entries[index].key) {
+        style_cache_entry_t* entry = &table->entries[index];
+        if (entry->hash == hash && entry->key_length == table->length &&
+            memcmp(entry->key, table->buffer, table->length) == 0) {
+            return entry;
+        }
+        index = (index + 1) & table->mask;
+    }
+    return &table->entries[index];
+}
+
+static bool table_grow(style_share_table_t* table) {
+    uint32_t new_size = (table->mask + 1) * 2;
+    style_cache_entry_t* new_entries = calloc(new_size, sizeof(style_cache_entry_t));
+    if (!new_entries) return false;
+    
+    for (uint32_t i = 0; i <= table->mask; i++) {
+        if (!table->entries[i].key) continue;
+        
+        uint32_t index = table->entries[i].hash & (new_size - 1);
+        while (new_entries[index].key) {
+            index = (index + 1) & (new_size - 1);
+        }
+        new_entries[index] = table->entries[i];
+    }
+    
+    free(table->entries);
+    table->entries = new_entries;
+    table->mask = new_size - 1;
+    return true;
+}
+
+// Cache API
+
+typedef struct {
+    style_selector_info_t info;
+} style_selector_cache_t;
+
+css_style_cache_t* css_style_cache_create(void) {
+    css_style_cache_t* cache = calloc(1, sizeof(css_style_cache_t));
+    if (!cache) return NULL;
+    
+    style_selector_cache_t* selectors = calloc(1, sizeof(style_selector_cache_t));
+    style_share_table_t* table = calloc(1, sizeof(style_share_table_t));
+    if (table) {
+        table->entries = calloc(STYLE_CACHE_INITIAL_SIZE, sizeof(style_cache_entry_t));
+        table->mask = STYLE_CACHE_INITIAL_SIZE - 1;
+    }
+    
+    if (!selectors || !table || !table->entries) {
+        if (table) free(table->entries);
+        free(table);
+        free(selectors);
+        free(cache);
+        return NULL;
+    }
+    
+    cache->selector_cache = selectors;
+    cache->computed_style_cache = table;
+    return cache;
+}
+
+void css_style_cache_destroy(css_style_cache_t* cache) {
+    if (!cache) return;
+    
+    style_share_table_t* table = cache->computed_style_cache;
+    table_clear(table);
+    free(table->entries);
+    free(table->buffer);
+    free(table);
+    
+    style_selector_cache_t* selectors = cache->selector_cache;
+    selector_info_reset(&selectors->info);
+    free(selectors);
+    free(cache);
+}
+
+void css_style_cache_clear(css_style_cache_t* cache) {
+    if (!cache) return;
+    table_clear(cache->computed_style_cache);
+}
+
+void css_style_cache_set_stylesheets(css_style_cache_t* cache, css_stylesheet_t** stylesheets, uint32_t stylesheet_count) {
+    if (!cache) return;
+    
+    style_selector_cache_t* selectors = cache->selector_cache;
+    selector_info_reset(&selectors->info);
+    for (uint32_t i = 0; i < stylesheet_count; i++) {
+        if (stylesheets[i] && !stylesheets[i]->disabled) {
+            analyse_rules(&selectors->info, stylesheets[i]->rules, stylesheets[i]->rule_count);
+        }
+    }
+    
+    table_clear(cache->computed_style_cache);
+}
+
+css_computed_style_t* css_style_cache_get(css_style_cache_t* cache, struct dom_element* element) {
+    if (!cache || !element) return NULL;
+    
+    style_selector_cache_t* selectors = cache->selector_cache;
+    style_share_table_t* table = cache->computed_style_cache;
+    
+    if (!element_is_shareable(&selectors->info, element) ||
+        !build_key(table, &selectors->info, element, parent_style(element))) {
+        cache->miss_count++;
+        return NULL;
+    }
+    
+    style_cache_entry_t* entry = table_slot(table, key_hash(table->buffer, table->length));
+    if (!entry->key) {
+        cache->miss_count++;
+        return NULL;
+    }
+    
+    cache->hit_count++;
+    return css_computed_style_retain(entry->style);
+}
+
+void css_style_cache_put(css_style_cache_t* cache, struct dom_element* element, css_computed_style_t* style) {
+    if (!cache || !element || !style) return;
+    
+    style_selector_cache_t* selectors = cache->selector_cache;
+    style_share_table_t* table = cache->computed_style_cache;
+    
+    css_computed_style_t* parent = parent_style(element);
+    if (!element_is_shareable(&selectors->info, element) ||
+        !build_key(table, &selectors->info, element, parent)) {
+        return;
+    }
+    
+    // Bound memory held by the cache
+    if (table->used >= STYLE_CACHE_MAX_ENTRIES) {
+        table_clear(table);
+    }
+    if ((table->used + 1) * 2 > table->mask + 1 && !table_grow(table)) return;
+    
+    uint32_t hash = key_hash(table->buffer, table->length);
+    style_cache_entry_t* entry = table_slot(table, hash);
+    if (entry->key) {
+        css_computed_style_release(entry->style);
+        entry->style = css_computed_style_retain(style);
+        return;
+    }
+    
+    entry->key = malloc(table->length);
+    if (!entry->key) return;
+    
+    memcpy(entry->key, table->buffer, table->length);
+    entry->key_length = table->length;
+    entry->hash = hash;
+    entry->parent = css_computed_style_retain(parent);
+    entry->style = css_computed_style_retain(style);
+    table->used++;
+}
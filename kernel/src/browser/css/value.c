@@ -0,0 +1,178 @@
+#include "value.h"
+#include "style.h"
+#include "../capacity.h"
+#include <stdlib.h>
+#include <string.h>
+
+// Side table
+
+static uint32_t table_append(css_value_table_t* table, css_value_t* value) {
+    if (table->count >= table->capacity) {
+        uint32_t capacity = capacity_grow(table->capacity, 4, sizeof(css_value_t*));
+        css_value_t** values = capacity ? realloc(table->values, capacity * sizeof(css_value_t*)) : NULL;
+        if (!values) return UINT32_MAX;
+        table->values = values;
+        table->capacity = capacity;
+    }
+    table->values[table->count] = value;
+    return table->count++;
+}
+
+void css_value_table_clear(css_value_table_t* table) {
+    if (!table) return;
+    for (uint32_t i = 0; i < table->count; i++) {
+        css_value_destroy(table->values[i]);
+    }
+    free(table->values);
+    table->values = NULL;
+    table->count = 0;
+    table->capacity = 0;
+}
+
+void css_value_table_clone(css_value_table_t* dest, const css_value_table_t* src) {
+    dest->values = NULL;
+    dest->count = 0;
+    dest->capacity = 0;
+    if (!src || src->count == 0) return;
+    
+    dest->values = calloc(src->count, sizeof(css_value_t*));
+    if (!dest->values) return;
+    dest->capacity = src->count;
+    for (uint32_t i = 0; i < src->count; i++) {
+        dest->values[i] = css_value_clone(src->values[i]);
+    }
+    dest->count = src->count;
+}
+
+// Packing
+
+css_packed_value_t css_pack_value(css_value_table_t* table, const css_value_t* value) {
+    css_packed_value_t packed = { .type = CSS_PACKED_UNSET };
+    if (!value) return packed;
+    
+    switch (value->type) {
+        case VALUE_LENGTH:
+            return css_packed_length((float)value->value.length.value, (uint8_t)value->value.length.unit);
+        case VALUE_PERCENTAGE:
+            return css_packed_percentage((float)value->value.percentage);
+        case VALUE_NUMBER:
+            return css_packed_number((float)value->value.number);
+        case VALUE_COLOR:
+            return css_packed_color(value->value.color.r, value->value.color.g,
+                                    value->value.color.b, value->value.color.a);
+        case VALUE_KEYWORD:
+            // Keywords come from a small fixed vocabulary, so interning
+            // them does not grow the atom table without bound
+            if (value->value.keyword) {
+                return css_packed_keyword(atom_intern_lower(value->value.keyword, (uint32_t)strlen(value->value.keyword)));
+            }
+            return packed;
+        default:
+            break;
+    }
+    
+    if (!table) return packed;
+    css_value_t* copy = css_value_clone(value);
+    if (!copy) return packed;
+    uint32_t index = table_append(table, copy);
+    if (index == UINT32_MAX) {
+        css_value_destroy(copy);
+        return packed;
+    }
+    packed.type = CSS_PACKED_COMPLEX;
+    packed.data.index = index;
+    return packed;
+}
+
+const css_value_t* css_packed_complex(const css_value_table_t* table, css_packed_value_t value) {
+    if (value.type != CSS_PACKED_COMPLEX || !table) return NULL;
+    if (value.data.index >= table->count) return NULL;
+    return table->values[value.data.index];
+}
+
+css_value_t* css_unpack_value(const css_value_table_t* table, css_packed_value_t value) {
+    if (value.type == CSS_PACKED_UNSET) return NULL;
+    if (value.type == CSS_PACKED_COMPLEX) {
+        return css_value_clone(css_packed_complex(table, value));
+    }
+    
+    css_value_t* unpacked = calloc(1, sizeof(css_value_t));
+    if (!unpacked) return NULL;
+    
+    switch (value.type) {
+        case CSS_PACKED_LENGTH:
+            unpacked->type = VALUE_LENGTH;
+            unpacked->value.length.value = value.data.number;
+            unpacked->value.length.unit = value.unit;
+            break;
+        case CSS_PACKED_PERCENTAGE:
+            unpacked->type = VALUE_PERCENTAGE;
+            unpacked->value.percentage = value.data.number;
+            break;
+        case CSS_PACKED_NUMBER:
+            unpacked->type = VALUE_NUMBER;
+            unpacked->value.number = value.data.number;
+            break;
+        case CSS_PACKED_COLOR:
+            unpacked->type = VALUE_COLOR;
+            unpacked->value.color.r = (uint8_t)(value.data.rgba >> 24);
+            unpacked->value.color.g = (uint8_t)(value.data.rgba >> 16);
+            unpacked->value.color.b = (uint8_t)(value.data.rgba >> 8);
+            unpacked->value.color.a = (uint8_t)value.data.rgba;
+            break;
+        case CSS_PACKED_KEYWORD: {
+            const char* keyword = atom_string(value.data.keyword);
+            unpacked->type = VALUE_KEYWORD;
+            unpacked->value.keyword = keyword ? strdup(keyword) : NULL;
+            if (!unpacked->value.keyword) {
+                free(unpacked);
+                return NULL;
+            }
+            break;
+        }
+        default:
+            free(unpacked);
+            return NULL;
+    }
+    
+    return unpacked;
+}
+
+// Resolution
+
+float css_packed_resolve(css_packed_value_t value, const css_resolve_context_t* context, float fallback) {
+    if (value.type == CSS_PACKED_PERCENTAGE) {
+        return context ? value.data.number * context->percent_base / 100.0f : fallback;
+    }
+    if (value.type == CSS_PACKED_NUMBER && value.data.number == 0.0f) return 0.0f;
+    if (value.type != CSS_PACKED_LENGTH) return fallback;
+    
+    float number = value.data.number;
+    switch (value.unit) {
+        case UNIT_PX:   return number;
+        case UNIT_PT:   return number * 96.0f / 72.0f;
+        case UNIT_PC:   return number * 16.0f;
+        case UNIT_IN:   return number * 96.0f;
+        case UNIT_CM:   return number * 96.0f / 2.54f;
+        case UNIT_MM:   return number * 96.0f / 25.4f;
+        default:
+            break;
+    }
+    
+    // Relative units need the context
+    if (!context) return fallback;
+    float vmin = context->viewport_width < context->viewport_height ? context->viewport_width : context->viewport_height;
+    float vmax = context->viewport_width > context->viewport_height ? context->viewport_width : context->viewport_height;
+    switch (value.unit) {
+        case UNIT_EM:   return number * context->font_size;
+        case UNIT_REM:  return number * context->root_font_size;
+        case UNIT_EX:
+        case UNIT_CH:   return number * context->font_size * 0.5f;
+        case UNIT_VW:   return number * context->viewport_width / 100.0f;
+        case UNIT_VH:   return number * context->viewport_height / 100.0f;
+        case UNIT_VMIN: return number * vmin / 100.0f;
+        case UNIT_VMAX: return number * vmax / 100.0f;
+        default:
+            return fallback;
+    }
+}
@@ -0,0 +1,167 @@
+#ifndef CSS_VALUE_H
+#define CSS_VALUE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "parser.h"
+
+// Packed computed value. Lengths, percentages, numbers, colors and
+// keywords are stored inline in 8 bytes; anything else (strings, URLs,
+// functions, lists) is a CSS_PACKED_COMPLEX index into the owning style's
+// side table of css_value_t.
+typedef enum {
+    CSS_PACKED_UNSET = 0,
+    CSS_PACKED_LENGTH,
+    CSS_PACKED_PERCENTAGE,
+    CSS_PACKED_NUMBER,
+    CSS_PACKED_COLOR,
+    CSS_PACKED_KEYWORD,
+    CSS_PACKED_COMPLEX
+} css_packed_type_t;
+
+typedef struct {
+    uint8_t type;                   // css_packed_type_t
+    uint8_t unit;                   // UNIT_* for CSS_PACKED_LENGTH
+    uint16_t reserved;
+    union {
+        float number;               // Length, percentage or number
+        uint32_t rgba;              // 0xRRGGBBAA
+        atom_t keyword;
+        uint32_t index;             // Side table slot
+    } data;
+} css_packed_value_t;
+
+_Static_assert(sizeof(css_packed_value_t) == 8, "css_packed_value_t must stay 8 bytes");
+
+// Side table for values that do not fit inline
+typedef struct {
+    css_value_t** values;
+    uint32_t count;
+    uint32_t capacity;
+} css_value_table_t;
+
+// Properties stored in css_computed_style_t.values
+#define CSS_STYLE_PROPERTIES(X) \
+    X(MARGIN_TOP, margin_top) \
+    X(MARGIN_RIGHT, margin_right) \
+    X(MARGIN_BOTTOM, margin_bottom) \
+    X(MARGIN_LEFT, margin_left) \
+    X(PADDING_TOP, padding_top) \
+    X(PADDING_RIGHT, padding_right) \
+    X(PADDING_BOTTOM, padding_bottom) \
+    X(PADDING_LEFT, padding_left) \
+    X(BORDER_TOP_WIDTH, border_top_width) \
+    X(BORDER_RIGHT_WIDTH, border_right_width) \
+    X(BORDER_BOTTOM_WIDTH, border_bottom_width) \
+    X(BORDER_LEFT_WIDTH, border_left_width) \
+    X(BORDER_TOP_COLOR, border_top_color) \
+    X(BORDER_RIGHT_COLOR, border_right_color) \
+    X(BORDER_BOTTOM_COLOR, border_bottom_color) \
+    X(BORDER_LEFT_COLOR, border_left_color) \
+    X(BORDER_TOP_LEFT_RADIUS, border_top_left_radius) \
+    X(BORDER_TOP_RIGHT_RADIUS, border_top_right_radius) \
+    X(BORDER_BOTTOM_RIGHT_RADIUS, border_bottom_right_radius) \
+    X(BORDER_BOTTOM_LEFT_RADIUS, border_bottom_left_radius) \
+    X(WIDTH, width) \
+    X(HEIGHT, height) \
+    X(MIN_WIDTH, min_width) \
+    X(MIN_HEIGHT, min_height) \
+    X(MAX_WIDTH, max_width) \
+    X(MAX_HEIGHT, max_height) \
+    X(TOP, top) \
+    X(RIGHT, right) \
+    X(BOTTOM, bottom) \
+    X(LEFT, left) \
+    X(BACKGROUND_COLOR, background_color) \
+    X(BACKGROUND_POSITION_X, background_position_x) \
+    X(BACKGROUND_POSITION_Y, background_position_y) \
+    X(FLEX_GROW, flex_grow) \
+    X(FLEX_SHRINK, flex_shrink) \
+    X(FLEX_BASIS, flex_basis) \
+    X(ORDER, order) \
+    X(GAP, gap) \
+    X(GRID_GAP, grid_gap) \
+    X(OPACITY, opacity) \
+    X(PERSPECTIVE, perspective) \
+    X(Z_INDEX, z_index)
+
+typedef enum {
+#define CSS_STYLE_PROPERTY_ENUM(id, atom) CSS_PROP_##id,
+    CSS_STYLE_PROPERTIES(CSS_STYLE_PROPERTY_ENUM)
+#undef CSS_STYLE_PROPERTY_ENUM
+    // transform-origin has no longhand property names
+    CSS_PROP_TRANSFORM_ORIGIN_X,
+    CSS_PROP_TRANSFORM_ORIGIN_Y,
+    CSS_PROP_TRANSFORM_ORIGIN_Z,
+    CSS_PROP_COUNT
+} css_style_property_t;
+
+// Properties stored in css_inherited_style_t.values
+#define CSS_INHERITED_PROPERTIES(X) \
+    X(FONT_SIZE, font_size) \
+    X(LINE_HEIGHT, line_height) \
+    X(LETTER_SPACING, letter_spacing) \
+    X(WORD_SPACING, word_spacing) \
+    X(TEXT_INDENT, text_indent) \
+    X(COLOR, color)
+
+typedef enum {
+#define CSS_INHERITED_PROPERTY_ENUM(id, atom) CSS_INHERITED_##id,
+    CSS_INHERITED_PROPERTIES(CSS_INHERITED_PROPERTY_ENUM)
+#undef CSS_INHERITED_PROPERTY_ENUM
+    CSS_INHERITED_COUNT
+} css_inherited_property_t;
+
+// Inline constructors
+static inline css_packed_value_t css_packed_length(float value, uint8_t unit) {
+    css_packed_value_t packed = { .type = CSS_PACKED_LENGTH, .unit = unit, .data.number = value };
+    return packed;
+}
+
+static inline css_packed_value_t css_packed_percentage(float value) {
+    css_packed_value_t packed = { .type = CSS_PACKED_PERCENTAGE, .data.number = value };
+    return packed;
+}
+
+static inline css_packed_value_t css_packed_number(float value) {
+    css_packed_value_t packed = { .type = CSS_PACKED_NUMBER, .data.number = value };
+    return packed;
+}
+
+static inline css_packed_value_t css_packed_color(uint8_t r, uint8_t g, uint8_t b, uint8_t a) {
+    css_packed_value_t packed = {
+        .type = CSS_PACKED_COLOR,
+        .data.rgba = (uint32_t)r << 24 | (uint32_t)g << 16 | (uint32_t)b << 8 | a
+    };
+    return packed;
+}
+
+static inline css_packed_value_t css_packed_keyword(atom_t keyword) {
+    css_packed_value_t packed = { .type = CSS_PACKED_KEYWORD, .data.keyword = keyword };
+    return packed;
+}
+
+static inline bool css_packed_is_keyword(css_packed_value_t value, atom_t keyword) {
+    return value.type == CSS_PACKED_KEYWORD && value.data.keyword == keyword;
+}
+
+// Length resolution context for css_packed_resolve
+typedef struct {
+    float font_size;                // Element font size in px
+    float root_font_size;
+    float percent_base;             // Containing block dimension for %
+    float viewport_width;
+    float viewport_height;
+} css_resolve_context_t;
+
+// Conversion between packed and heap values
+css_packed_value_t css_pack_value(css_value_table_t* table, const css_value_t* value);
+css_value_t* css_unpack_value(const css_value_table_t* table, css_packed_value_t value);
+const css_value_t* css_packed_complex(const css_value_table_t* table, css_packed_value_t value);
+void css_value_table_clone(css_value_table_t* dest, const css_value_table_t* src);
+void css_value_table_clear(css_value_table_t* table);
+
+// Lengths and percentages in px; fallback for anything else (e.g. auto)
+float css_packed_resolve(css_packed_value_t value, const css_resolve_context_t* context, float fallback);
+
+#endif
@@ -3,16 +3,41 @@
 #include "html/dom.h"
 #include "css/parser.h"
 #include "css/style.h"
+#include "css/invalidation.h"
 #include "js/engine.h"
+#include "js/gc.h"
+#include "js/jit.h"
+#include "js/code_cache.h"
+#include "js/event_loop.h"
+#include "js/dom_binding.h"
 #include "render/engine.h"
 #include "webapi/fetch.h"
 #include "webapi/websocket.h"
+#include "webapi/worker.h"
 #include "security/csp.h"
 #include "network/http.h"
+#include "network/manager.h"
+#include "loader.h"
+#include "worker_pool.h"
+#include "frame_scheduler.h"
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
 
+#define BROWSER_FRAME_INTERVAL_US 16667
+
+// Share of the frame interval each phase may use, in permille. Input stops
+// at its budget and carries the rest over; the others are only reported
+// in stats.phase_over_budget.
+static const uint32_t browser_phase_budget[BROWSER_FRAME_PHASE_COUNT] = {
+    100,    // Input
+    200,    // Animation frames
+    150,    // Style
+    250,    // Layout
+    200,    // Paint
+    100     // Commit
+};
+
 // Create browser engine
 browser_engine_t* browser_engine_create(browser_config_t* config) {
     browser_engine_t* engine = calloc(1, sizeof(browser_engine_t));
@@ -26,7 +51,9 @@ browser_engine_t* browser_engine_create(browser_config_t* config) {
         engine->config.max_tabs = 100;
         engine->config.js_heap_size = 256 * 1024 * 1024; // 256MB
         engine->config.cache_size = 100 * 1024 * 1024; // 100MB
+        engine->config.cache_directory = "cache";
         engine->config.enable_gpu = true;
+        engine->config.enable_jit = true;
         engine->config.enable_webgl = true;
         engine->config.enable_webrtc = true;
         engine->config.enable_sandbox = true;
@@ -43,6 +70,42 @@ browser_engine_t* browser_engine_create(browser_config_t* config) {
     return engine;
 }
 
+static js_code_cache_t* browser_open_code_cache(const char* cache_directory) {
+    if (!cache_directory) return NULL;
+    
+    size_t length = strlen(cache_directory) + sizeof("/code");
+    char* directory = malloc(length);
+    if (!directory) return NULL;
+    snprintf(directory, length, "%s/code", cache_directory);
+    js_code_cache_t* cache = js_code_cache_open(directory);
+    free(directory);
+    return cache;
+}
+
+// Engine-wide settings every JS engine shares
+static void browser_setup_js_engine(browser_engine_t* engine, js_engine_t* js_engine) {
+    js_jit_enable(js_engine, engine->config.enable_jit);
+    js_code_cache_use(js_engine, engine->managers.code_cache);
+    
+    // Nothing is cached until a navigation gives the engine an origin
+    js_code_cache_set_origin(js_engine, NULL);
+}
+
+// Scripts the tab loads are cached in its origin's partition; opaque
+// origins are not cached at all
+static void browser_set_code_cache_origin(browser_tab_t* tab) {
+    origin_t* origin = tab->url ? origin_parse(tab->url) : NULL;
+    char* serialized = NULL;
+    if (origin && origin->scheme && origin->host) {
+        int length = snprintf(NULL, 0, "%s://%s:%u", origin->scheme, origin->host, origin->port);
+        serialized = length > 0 ? malloc((size_t)length + 1) : NULL;
+        if (serialized) snprintf(serialized, (size_t)length + 1, "%s://%s:%u", origin->scheme, origin->host, origin->port);
+    }
+    js_code_cache_set_origin((js_engine_t*)tab->js_context, serialized);
+    free(serialized);
+    if (origin) origin_destroy(origin);
+}
+
 // Initialize browser engine
 int browser_engine_init(browser_engine_t* engine) {
     if (!engine) return -1;
@@ -55,17 +118,29 @@ int browser_engine_init(browser_engine_t* engine) {
     engine->parsers.css_parser = calloc(1, sizeof(void*));
     if (!engine->parsers.css_parser) return -1;
     
+    // Compiled scripts persist next to the HTTP cache, so a page loaded
+    // before skips parsing and compiling its scripts
+    engine->managers.code_cache = browser_open_code_cache(engine->config.cache_directory);
+    
     // Initialize JavaScript engine
     engine->parsers.js_engine = js_engine_create(engine->config.js_heap_size);
     if (!engine->parsers.js_engine) return -1;
     js_engine_init(engine->parsers.js_engine);
+    browser_setup_js_engine(engine, engine->parsers.js_engine);
     
     // Initialize rendering engine
     engine->parsers.render_engine = calloc(1, sizeof(render_pipeline_t));
     if (!engine->parsers.render_engine) return -1;
     
-    // Initialize network manager
-    engine->managers.network_manager = calloc(1, sizeof(void*));
+    // Software raster by default; a GPU backend replaces these hooks
+    raster_install_software(engine->parsers.render_engine);
+    
+    // Pointer events hit test through per-layer grids, not a tree walk
+    ((render_pipeline_t*)engine->parsers.render_engine)->layout.hit_test = hit_index_hit_test;
+    
+    // Connections are pooled per origin and shared by every tab
+    engine->managers.network_manager = network_manager_create(NULL, http_network_transport(), NULL);
+    fetch_set_network_manager(engine->managers.network_manager);
     
     // Initialize cache manager
     engine->managers.cache_manager = calloc(1, sizeof(void*));
@@ -76,6 +151,20 @@ int browser_engine_init(browser_engine_t* engine) {
     // Initialize extension manager
     engine->managers.extension_manager = calloc(1, sizeof(void*));
     
+    // Worker threads; without them layout and raster run on the calling
+    // thread
+    engine->managers.worker_pool = worker_pool_create(engine->config.max_workers);
+    layout_set_worker_pool(engine->managers.worker_pool);
+    raster_set_worker_pool(engine->managers.worker_pool);
+    
+    // Frames run only when requested, aligned to vsync
+    engine->managers.frame_scheduler = frame_scheduler_create(BROWSER_FRAME_INTERVAL_US);
+    if (!engine->managers.frame_scheduler) return -1;
+    
+    // Scrolling and compositor-only animation off the main thread. Without
+    // it, frames composite and present at the end of browser_render_frame.
+    engine->managers.compositor_thread = compositor_thread_create(engine->parsers.render_engine, BROWSER_FRAME_INTERVAL_US);
+    
     // Bind Web APIs to JavaScript engine
     js_bind_fetch_api(engine->parsers.js_engine);
     js_bind_websocket_api(engine->parsers.js_engine);
@@ -83,10 +172,42 @@ int browser_engine_init(browser_engine_t* engine) {
     js_bind_webgl_api(engine->parsers.js_engine);
     js_bind_storage_api(engine->parsers.js_engine);
     js_bind_worker_api(engine->parsers.js_engine);
+    js_bind_idle_callback_api(engine->parsers.js_engine);
     
     return 0;
 }
 
+static void browser_deliver_mutations(void* data) {
+    browser_tab_t* tab = data;
+    if (tab->document) dom_deliver_mutations(tab->document);
+}
+
+// Script observers get their records at the next microtask checkpoint
+static void browser_schedule_mutations(void* data) {
+    browser_tab_t* tab = data;
+    js_queue_microtask((js_engine_t*)tab->js_context, browser_deliver_mutations, tab);
+}
+
+// Watch the tab's document for changes that can restyle it. Records are
+// polled by browser_update_style rather than delivered to a callback.
+static void browser_observe_document(browser_tab_t* tab) {
+    if (tab->style.observer) {
+        dom_disconnect_observer(tab->style.observer);
+        tab->style.observer = NULL;
+    }
+    if (!tab->document) return;
+    
+    dom_set_mutation_scheduler(tab->document, browser_schedule_mutations, tab);
+    tab->style.observer = dom_create_mutation_observer(NULL);
+    if (tab->style.observer) {
+        dom_observe_mutations(tab->style.observer, &tab->document->base,
+                              MUTATION_ATTRIBUTES | MUTATION_CHILD_LIST | MUTATION_CHARACTER_DATA | MUTATION_SUBTREE);
+    }
+    
+    // A new document has no styles yet
+    css_mark_style_dirty(tab->document->document_element, DOM_STYLE_DIRTY_SUBTREE);
+}
+
 // Create new tab
 browser_tab_t* browser_create_tab(browser_engine_t* engine) {
     if (!engine || engine->tabs.tab_count >= engine->config.max_tabs) {
@@ -98,6 +219,7 @@ browser_tab_t* browser_create_tab(browser_engine_t* engine) {
     
     // Initialize tab
     tab->id = engine->tabs.tab_count;
+    tab->engine = engine;
     tab->url = strdup("about:blank");
     tab->title = strdup("New Tab");
     
@@ -109,6 +231,7 @@ browser_tab_t* browser_create_tab(browser_engine_t* engine) {
         free(tab);
         return NULL;
     }
+    browser_setup_js_engine(engine, (js_engine_t*)tab->js_context);
     
     // Create empty document
     tab->document = dom_document_create();
@@ -120,8 +243,11 @@ browser_tab_t* browser_create_tab(browser_engine_t* engine) {
         return NULL;
     }
     
+    browser_observe_document(tab);
+    
     // Bind DOM to JavaScript
     js_bind_dom(tab->js_context, tab->document);
+    js_bind_idle_callback_api((js_engine_t*)tab->js_context);
     
     // Initialize navigation history
     tab->navigation.history = calloc(100, sizeof(void*));
@@ -136,86 +262,142 @@ browser_tab_t* browser_create_tab(browser_engine_t* engine) {
     return tab;
 }
 
-// Navigate to URL
-int browser_navigate(browser_tab_t* tab, const char* url) {
-    if (!tab || !url) return -1;
+// Dispatch a browser event to the registered handler
+static void browser_dispatch_event(browser_tab_t* tab, browser_event_type_t event, void* data) {
+    if (!tab || !tab->engine || event >= BROWSER_EVENT_COUNT) return;
     
-    // Update tab state
-    tab->state.loading = true;
-    tab->state.progress = 0;
+    browser_event_handler_t handler = tab->engine->events.handlers[event];
+    if (handler) {
+        handler(tab, event, data);
+    }
+}
+
+// Swap in a new document for the tab
+static void browser_set_document(browser_tab_t* tab, dom_document_t* document) {
+    if (tab->document == document) return;
     
-    // Parse URL and determine protocol
-    bool is_secure = strncmp(url, "https://", 8) == 0;
-    tab->state.secure = is_secure;
+    if (tab->document) {
+        js_dom_forget_document((js_engine_t*)tab->js_context, tab->document);
+        dom_document_destroy(tab->document);
+    }
+    tab->document = document;
+    browser_observe_document(tab);
+    browser_request_frame(tab->engine);
     
-    // Free old URL and set new one
-    free(tab->url);
-    tab->url = strdup(url);
+    // Bind new DOM to JavaScript
+    js_bind_dom(tab->js_context, tab->document);
+}
+
+// Replace the stylesheets styling the tab's document
+void browser_set_stylesheets(browser_tab_t* tab, css_stylesheet_t** stylesheets, uint32_t stylesheet_count) {
+    if (!tab) return;
     
-    // Add to history
-    if (tab->navigation.history_index < tab->navigation.history_count - 1) {
-        // Clear forward history
-        for (uint32_t i = tab->navigation.history_index + 1; i < tab->navigation.history_count; i++) {
-            free(tab->navigation.history[i]);
+    free(tab->style.stylesheets);
+    tab->style.stylesheets = NULL;
+    tab->style.stylesheet_count = 0;
+    if (stylesheet_count) {
+        tab->style.stylesheets = malloc(stylesheet_count * sizeof(css_stylesheet_t*));
+        if (tab->style.stylesheets) {
+            memcpy(tab->style.stylesheets, stylesheets, stylesheet_count * sizeof(css_stylesheet_t*));
+            tab->style.stylesheet_count = stylesheet_count;
         }
-        tab->navigation.history_count = tab->navigation.history_index + 1;
     }
     
-    if (tab->navigation.history_count < 100) {
-        tab->navigation.history[tab->navigation.history_count] = strdup(url);
-        tab->navigation.history_count++;
-        tab->navigation.history_index = tab->navigation.history_count - 1;
-    }
+    css_invalidation_map_destroy(tab->style.invalidation_map);
+    tab->style.invalidation_map = css_invalidation_map_create(tab->style.stylesheets, tab->style.stylesheet_count);
     
-    // Fetch the resource
-    request_t* request = fetch_create_request(url, NULL);
-    if (!request) {
-        tab->state.loading = false;
-        return -1;
-    }
+    if (!tab->style.cache) tab->style.cache = css_style_cache_create();
+    css_style_cache_set_stylesheets(tab->style.cache, tab->style.stylesheets, tab->style.stylesheet_count);
     
-    // Start fetch operation
-    fetch_operation_t* fetch_op = fetch_start(request);
-    if (!fetch_op) {
-        free(request);
-        tab->state.loading = false;
-        return -1;
+    // Every rule may have changed
+    if (tab->document) css_mark_style_dirty(tab->document->document_element, DOM_STYLE_DIRTY_SUBTREE);
+    browser_request_frame(tab->engine);
+}
+
+// Restyle what the mutations since the last frame touched and push the
+// result into the render tree's layout and paint bits
+static void browser_update_style(browser_tab_t* tab) {
+    dom_element_t* root = tab->document ? tab->document->document_element : NULL;
+    if (!root || !tab->style.cache) return;
+    
+    css_invalidation_t* invalidation = css_invalidation_create();
+    if (!invalidation) return;
+    
+    if (tab->style.observer) {
+        uint32_t record_count = 0;
+        dom_mutation_record_t** records = dom_take_records(tab->style.observer, &record_count);
+        if (records) {
+            css_invalidation_schedule(tab->style.invalidation_map, records, record_count, invalidation);
+            dom_mutation_records_destroy(records, record_count);
+        }
     }
     
-    // Wait for response (simplified - should be async)
-    // In real implementation, this would be handled asynchronously
-    response_t* response = fetch_op->response;
-    if (response && response->ok) {
-        // Parse HTML content
-        char* html_content = (char*)response->body;
-        browser_load_html(tab, html_content);
-    }
+    css_recalc_styles(tab->style.cache, root, tab->style.stylesheets, tab->style.stylesheet_count, invalidation);
+    css_invalidation_apply(invalidation, tab->render_tree);
+    css_invalidation_destroy(invalidation);
+}
+
+// The compositor thread may still be drawing the tree's layers, so it is
+// handed an empty frame before their backing stores go
+static void browser_release_render_tree(browser_engine_t* engine, render_tree_t* tree) {
+    compositor_thread_t* compositor = engine->managers.compositor_thread;
+    compositor_thread_lock(compositor);
+    compositor_thread_commit(compositor, NULL);
+    paint_release(tree, (render_pipeline_t*)engine->parsers.render_engine);
+    compositor_thread_unlock(compositor);
+    
+    free(tree->relayout_roots);
+    free(tree->scrollers);
+    free(tree);
+}
+
+// Rebuild the render tree from the tab's current document
+static void browser_rebuild_render_tree(browser_tab_t* tab) {
+    if (!tab->engine || !tab->document || !tab->document->document_element) return;
     
-    fetch_operation_destroy(fetch_op);
-    tab->state.loading = false;
-    tab->state.progress = 100;
+    render_pipeline_t* pipeline = (render_pipeline_t*)tab->engine->parsers.render_engine;
+    if (!pipeline || !pipeline->layout.build_render_tree) return;
     
-    return 0;
+    if (tab->render_tree) browser_release_render_tree(tab->engine, tab->render_tree);
+    tab->render_tree = pipeline->layout.build_render_tree(tab->document->document_element);
 }
 
-// Load HTML content
-int browser_load_html(browser_tab_t* tab, const char* html) {
-    if (!tab || !html) return -1;
+// All parser-blocking scripts have run
+static void browser_on_scripts_done(browser_tab_t* tab) {
+    tab->document->ready_state = READY_STATE_INTERACTIVE;
+    browser_dispatch_event(tab, BROWSER_EVENT_DOM_READY, tab->document);
     
-    // Parse HTML
-    html_parser_t* parser = html_parser_create();
-    if (!parser) return -1;
+    // Build render tree
+    browser_rebuild_render_tree(tab);
+}
+
+// Scripts have run and every subresource has settled
+static void browser_on_document_load(browser_tab_t* tab) {
+    tab->document->ready_state = READY_STATE_COMPLETE;
     
-    // Free old document
-    if (tab->document) {
-        dom_document_destroy(tab->document);
+    if (tab->state.load_state == BROWSER_LOAD_PARSING) {
+        tab->state.load_state = BROWSER_LOAD_COMPLETE;
+        tab->state.loading = false;
+        tab->state.progress = 100;
     }
-    
-    // Parse new document
-    tab->document = html_parse(parser, html, strlen(html));
-    html_parser_destroy(parser);
-    
-    if (!tab->document) return -1;
+    browser_dispatch_event(tab, BROWSER_EVENT_LOAD_COMPLETE, NULL);
+}
+
+static const browser_loader_callbacks_t document_loader_callbacks = {
+    .on_scripts_done = browser_on_scripts_done,
+    .on_load = browser_on_document_load
+};
+
+// Start a fresh set of subresource fetches for a new document
+static void browser_reset_loader(browser_tab_t* tab) {
+    browser_loader_destroy(tab->loader);
+    tab->loader = browser_loader_create(tab, &document_loader_callbacks);
+}
+
+// Parsing is done: pick up the title and queue scripts in document order.
+// DOM_READY and LOAD_COMPLETE follow from the loader as fetches finish.
+static int browser_finish_document(browser_tab_t* tab) {
+    if (!tab->document || !tab->loader) return -1;
     
     // Update title from document
     dom_element_t* title_elem = dom_element_query_selector(tab->document->head, "title");
@@ -227,94 +409,493 @@ int browser_load_html(browser_tab_t* tab, const char* html) {
         }
     }
     
-    // Bind new DOM to JavaScript
-    js_bind_dom(tab->js_context, tab->document);
-    
-    // Process scripts
+    // Queue scripts; external ones are usually already in flight. The
+    // array belongs to the document's live collection.
     uint32_t script_count;
     dom_element_t** scripts = dom_element_get_by_tag_name(
         tab->document->document_element, "script", &script_count
     );
     
     for (uint32_t i = 0; i < script_count; i++) {
-        char* script_src = dom_element_get_attribute(scripts[i], "src");
+        char* script_src = dom_element_get_attribute_atom(scripts[i], ATOM_src);
         if (script_src) {
-            // Fetch external script
-            request_t* script_request = fetch_create_request(script_src, NULL);
-            fetch_operation_t* script_fetch = fetch_start(script_request);
-            if (script_fetch && script_fetch->response && script_fetch->response->ok) {
-                browser_execute_script(tab, (char*)script_fetch->response->body);
-            }
-            fetch_operation_destroy(script_fetch);
+            browser_loader_queue_script(tab->loader, script_src);
         } else {
-            // Execute inline script
             char* script_content = dom_node_get_text_content((dom_node_t*)scripts[i]);
             if (script_content) {
-                browser_execute_script(tab, script_content);
+                browser_loader_queue_inline_script(tab->loader, script_content);
                 free(script_content);
             }
         }
     }
     
-    free(scripts);
+    browser_loader_parsing_done(tab->loader);
+    return 0;
+}
+
+// In-flight navigation. Shared between the fetch callbacks, which may run
+// on a network thread, and the tasks they post to the tab's event loop.
+typedef struct {
+    browser_tab_t* tab;
+    uint32_t navigation_id;
+    fetch_operation_t* operation;
+    html_parser_t* parser;
+    uint32_t ref_count;
+    bool cancelled;                 // Atomic: read from the fetch callbacks
+    bool first_paint;
+} navigation_context_t;
+
+typedef struct {
+    navigation_context_t* context;
+    enum {
+        NAVIGATION_TASK_PROGRESS,
+        NAVIGATION_TASK_DATA,
+        NAVIGATION_TASK_COMPLETE,
+        NAVIGATION_TASK_ERROR
+    } kind;
+    uint64_t loaded;
+    uint64_t total;
+    uint32_t length;
+    char data[];
+} navigation_task_t;
+
+static void navigation_context_release(navigation_context_t* context) {
+    if (__atomic_sub_fetch(&context->ref_count, 1, __ATOMIC_ACQ_REL) != 0) return;
     
-    // Build render tree
-    if (tab->render_tree) {
-        free(tab->render_tree);
+    if (context->operation) {
+        fetch_operation_destroy(context->operation);
+    }
+    if (context->parser) {
+        // A partially parsed document already belongs to the tab
+        context->parser->document = NULL;
+        html_parser_destroy(context->parser);
+    }
+    free(context);
+}
+
+// Drop the tab's pending navigation without delivering any more events for it
+static void navigation_cancel(browser_tab_t* tab) {
+    navigation_context_t* context = tab->state.pending_navigation;
+    if (!context) return;
+    
+    tab->state.pending_navigation = NULL;
+    tab->state.navigation_id++;
+    __atomic_store_n(&context->cancelled, true, __ATOMIC_RELEASE);
+    fetch_abort(context->operation);
+    navigation_context_release(context);
+}
+
+// Runs on the tab's event loop
+static void navigation_run_task(void* data) {
+    navigation_task_t* task = data;
+    navigation_context_t* context = task->context;
+    browser_tab_t* tab = context->tab;
+    
+    if (__atomic_load_n(&context->cancelled, __ATOMIC_ACQUIRE) || context->navigation_id != tab->state.navigation_id) {
+        navigation_context_release(context);
+        free(task);
+        return;
     }
     
-    render_pipeline_t* pipeline = (render_pipeline_t*)tab->render_tree;
-    tab->render_tree = pipeline->layout.build_render_tree(tab->document->document_element);
+    switch (task->kind) {
+        case NAVIGATION_TASK_PROGRESS:
+            tab->state.load_state = BROWSER_LOAD_RECEIVING;
+            if (task->total > 0) {
+                tab->state.progress = (uint32_t)(task->loaded * 99 / task->total);
+            }
+            break;
+        
+        case NAVIGATION_TASK_DATA:
+            tab->state.load_state = BROWSER_LOAD_PARSING;
+            if (!context->parser) {
+                context->parser = html_parser_create();
+                if (!context->parser) break;
+            }
+            
+            // Start subresource fetches before the tree builder reaches them
+            browser_loader_scan(tab->loader, task->data, task->length);
+            
+            // Build the DOM incrementally and show it while the rest arrives
+            html_parser_feed(context->parser, task->data, task->length);
+            if (context->parser->document) {
+                browser_set_document(tab, context->parser->document);
+                if (!context->first_paint && tab->document->body) {
+                    browser_rebuild_render_tree(tab);
+                    context->first_paint = true;
+                }
+            }
+            break;
+        
+        case NAVIGATION_TASK_COMPLETE: {
+            response_t* response = context->operation->response;
+            tab->state.pending_navigation = NULL;
+            
+            bool loaded = false;
+            if (response && response->ok) {
+                tab->state.load_state = BROWSER_LOAD_PARSING;
+                if (context->parser) {
+                    dom_document_t* document = html_parser_finish(context->parser);
+                    if (document) {
+                        browser_set_document(tab, document);
+                        loaded = browser_finish_document(tab) == 0;
+                    }
+                } else if (response->body) {
+                    // Body was not streamed
+                    loaded = browser_load_html(tab, (char*)response->body) == 0;
+                }
+            }
+            
+            // On success, LOAD_COMPLETE follows once subresources settle
+            if (!loaded) {
+                tab->state.loading = false;
+                tab->state.load_state = BROWSER_LOAD_FAILED;
+                browser_dispatch_event(tab, BROWSER_EVENT_LOAD_ERROR, response);
+            }
+            
+            // The navigation is over; drop the tab's reference
+            navigation_context_release(context);
+            break;
+        }
+        
+        case NAVIGATION_TASK_ERROR:
+            tab->state.pending_navigation = NULL;
+            tab->state.load_state = BROWSER_LOAD_FAILED;
+            tab->state.loading = false;
+            tab->state.progress = 0;
+            browser_dispatch_event(tab, BROWSER_EVENT_LOAD_ERROR, NULL);
+            navigation_context_release(context);
+            break;
+    }
+    
+    // Drop the reference held by this task
+    navigation_context_release(context);
+    free(task);
+}
+
+// A task dropped from the event loop of a tab being closed
+static void navigation_discard_task(void* data) {
+    navigation_task_t* task = data;
+    navigation_context_release(task->context);
+    free(task);
+}
+
+// Hand a fetch notification over to the tab thread
+static void navigation_post_task(fetch_operation_t* operation, int kind, uint64_t loaded, uint64_t total,
+                                 const void* data, uint32_t length) {
+    navigation_context_t* context = operation->user_data;
+    if (!context || __atomic_load_n(&context->cancelled, __ATOMIC_ACQUIRE)) return;
+    
+    // Chunks are only valid during the callback, so they travel with the task
+    navigation_task_t* task = calloc(1, sizeof(navigation_task_t) + length);
+    if (!task) return;
+    
+    task->context = context;
+    task->kind = kind;
+    task->loaded = loaded;
+    task->total = total;
+    task->length = length;
+    if (length > 0) {
+        memcpy(task->data, data, length);
+    }
+    
+    __atomic_add_fetch(&context->ref_count, 1, __ATOMIC_ACQ_REL);
+    js_queue_task((js_engine_t*)context->tab->js_context, navigation_run_task, task);
+}
+
+static void navigation_on_progress(fetch_operation_t* operation, uint64_t loaded, uint64_t total) {
+    navigation_post_task(operation, NAVIGATION_TASK_PROGRESS, loaded, total, NULL, 0);
+}
+
+static void navigation_on_data(fetch_operation_t* operation, const void* chunk, uint32_t length) {
+    navigation_post_task(operation, NAVIGATION_TASK_DATA, 0, 0, chunk, length);
+}
+
+static void navigation_on_complete(fetch_operation_t* operation, response_t* response) {
+    (void)response;
+    navigation_post_task(operation, NAVIGATION_TASK_COMPLETE, 0, 0, NULL, 0);
+}
+
+static void navigation_on_error(fetch_operation_t* operation, const char* error) {
+    (void)error;
+    navigation_post_task(operation, NAVIGATION_TASK_ERROR, 0, 0, NULL, 0);
+}
+
+static const fetch_callbacks_t navigation_callbacks = {
+    .on_progress = navigation_on_progress,
+    .on_data = navigation_on_data,
+    .on_complete = navigation_on_complete,
+    .on_error = navigation_on_error
+};
+
+// Start loading a URL without touching history. Returns immediately;
+// the document is loaded from the tab's event loop as data arrives.
+static int navigation_start(browser_tab_t* tab, const char* url) {
+    navigation_cancel(tab);
+    
+    tab->state.loading = true;
+    tab->state.progress = 0;
+    tab->state.secure = strncmp(url, "https://", 8) == 0;
+    tab->state.load_state = BROWSER_LOAD_REQUESTING;
+    
+    if (tab->url != url) {
+        free(tab->url);
+        tab->url = strdup(url);
+    }
+    browser_set_code_cache_origin(tab);
+    
+    browser_dispatch_event(tab, BROWSER_EVENT_LOAD_START, NULL);
+    browser_reset_loader(tab);
+    
+    navigation_context_t* context = calloc(1, sizeof(navigation_context_t));
+    request_t* request = fetch_create_request(url, NULL);
+    if (request) request->destination = REQUEST_DESTINATION_DOCUMENT;
+    if (!context || !request) {
+        free(context);
+        free(request);
+        tab->state.loading = false;
+        tab->state.load_state = BROWSER_LOAD_FAILED;
+        browser_dispatch_event(tab, BROWSER_EVENT_LOAD_ERROR, NULL);
+        return -1;
+    }
+    
+    context->tab = tab;
+    context->navigation_id = ++tab->state.navigation_id;
+    context->ref_count = 1; // Held by the tab until the navigation ends
+    tab->state.pending_navigation = context;
+    
+    context->operation = fetch_start_async(request, &navigation_callbacks, context);
+    if (!context->operation) {
+        free(request);
+        tab->state.pending_navigation = NULL;
+        free(context);
+        tab->state.loading = false;
+        tab->state.load_state = BROWSER_LOAD_FAILED;
+        browser_dispatch_event(tab, BROWSER_EVENT_LOAD_ERROR, NULL);
+        return -1;
+    }
     
     return 0;
 }
 
-// Execute JavaScript
-int browser_execute_script(browser_tab_t* tab, const char* script) {
-    if (!tab || !script || !tab->js_context) return -1;
+// Navigate to URL
+int browser_navigate(browser_tab_t* tab, const char* url) {
+    if (!tab || !url) return -1;
+    
+    // Add to history
+    if (tab->navigation.history_count > 0 &&
+        tab->navigation.history_index < tab->navigation.history_count - 1) {
+        // Clear forward history
+        for (uint32_t i = tab->navigation.history_index + 1; i < tab->navigation.history_count; i++) {
+            free(tab->navigation.history[i]);
+        }
+        tab->navigation.history_count = tab->navigation.history_index + 1;
+    }
+    
+    if (tab->navigation.history_count < 100) {
+        tab->navigation.history[tab->navigation.history_count] = strdup(url);
+        tab->navigation.history_count++;
+        tab->navigation.history_index = tab->navigation.history_count - 1;
+    }
+    
+    browser_dispatch_event(tab, BROWSER_EVENT_NAVIGATION, (void*)url);
     
-    // Check CSP
+    return navigation_start(tab, url);
+}
+
+// Load HTML content
+int browser_load_html(browser_tab_t* tab, const char* html) {
+    if (!tab || !html) return -1;
+    
+    // Reuse the navigation's loader unless it already served a document
+    if (!tab->loader || browser_loader_parsing_finished(tab->loader)) {
+        browser_reset_loader(tab);
+    }
+    browser_loader_scan(tab->loader, html, strlen(html));
+    
+    // Parse HTML
+    html_parser_t* parser = html_parser_create();
+    if (!parser) return -1;
+    
+    dom_document_t* document = html_parse(parser, html, strlen(html));
+    html_parser_destroy(parser);
+    
+    if (!document) return -1;
+    
+    browser_set_document(tab, document);
+    return browser_finish_document(tab);
+}
+
+// Whether the tab's CSP lets scripts run
+static bool browser_script_allowed(browser_tab_t* tab) {
+    (void)tab;
     csp_policy_t* csp = NULL; // Would get from response headers
     if (csp && !csp_allows_eval(csp)) {
         printf("CSP: Script execution blocked\n");
-        return -1;
+        return false;
     }
+    return true;
+}
+
+// Execute JavaScript
+int browser_execute_script(browser_tab_t* tab, const char* script) {
+    if (!tab || !script || !tab->js_context) return -1;
+    if (!browser_script_allowed(tab)) return -1;
     
-    // Execute script
-    js_value_t* result = js_eval(tab->js_context, script, tab->url);
+    // Execute script. The completion value is unused; the collector
+    // reclaims it.
+    js_eval(tab->js_context, script, tab->url);
     
-    if (result) {
-        // Handle result if needed
-        js_value_release(result);
+    // The script may have touched the DOM
+    browser_request_frame(tab->engine);
+    return 0;
+}
+
+// Runs a script compiled off the tab thread (js/compile_job.h)
+int browser_execute_compiled(browser_tab_t* tab, struct js_bytecode* bytecode) {
+    if (!tab || !bytecode || !tab->js_context || !browser_script_allowed(tab)) {
+        js_bytecode_destroy(bytecode);
+        return -1;
     }
     
+    js_run_script((js_engine_t*)tab->js_context, bytecode);
+    browser_request_frame(tab->engine);
     return 0;
 }
 
-// Render frame
+// Frame scheduling
+void browser_request_frame(browser_engine_t* engine) {
+    if (engine) frame_scheduler_request(engine->managers.frame_scheduler);
+}
+
+bool browser_wait_for_frame(browser_engine_t* engine, uint32_t timeout_ms) {
+    if (!engine || !engine->managers.frame_scheduler) return false;
+    return frame_scheduler_wait(engine->managers.frame_scheduler, timeout_ms) != 0;
+}
+
+uint32_t browser_request_animation_frame(browser_engine_t* engine, browser_frame_callback_t callback, void* data) {
+    if (!engine) return 0;
+    return frame_scheduler_request_animation_frame(engine->managers.frame_scheduler, callback, data);
+}
+
+void browser_cancel_animation_frame(browser_engine_t* engine, uint32_t id) {
+    if (engine) frame_scheduler_cancel_animation_frame(engine->managers.frame_scheduler, id);
+}
+
+void browser_post_input(browser_engine_t* engine, browser_frame_callback_t callback, void* data) {
+    if (engine) frame_scheduler_post_input(engine->managers.frame_scheduler, callback, data);
+}
+
+// Closes the current phase: records its time and whether it overran its
+// share of the interval, and returns the start of the next
+static uint64_t browser_end_phase(browser_engine_t* engine, browser_frame_phase_t phase, uint64_t start) {
+    uint64_t end = frame_scheduler_now();
+    uint32_t elapsed = (uint32_t)(end - start);
+    uint32_t budget = frame_scheduler_interval(engine->managers.frame_scheduler) * browser_phase_budget[phase] / 1000;
+    
+    engine->stats.phase_time_us[phase] = elapsed;
+    engine->stats.phase_total_us[phase] += elapsed;
+    if (budget && elapsed > budget) engine->stats.phase_over_budget[phase]++;
+    return end;
+}
+
+// The idle period after a frame goes to requestIdleCallback first, the
+// active tab's callbacks before the others. Callbacks still waiting get
+// the next frame's idle period.
+static void browser_run_idle_callbacks(browser_engine_t* engine, browser_tab_t* active_tab, uint64_t deadline) {
+    bool pending = false;
+    if (active_tab && active_tab->js_context) pending |= js_run_idle_callbacks((js_engine_t*)active_tab->js_context, deadline);
+    for (uint32_t i = 0; i < engine->tabs.tab_count; i++) {
+        browser_tab_t* tab = engine->tabs.tabs[i];
+        if (tab != active_tab && tab->js_context) pending |= js_run_idle_callbacks((js_engine_t*)tab->js_context, deadline);
+    }
+    if (engine->parsers.js_engine) pending |= js_run_idle_callbacks(engine->parsers.js_engine, deadline);
+    if (pending) browser_request_frame(engine);
+}
+
+// Hands what is left of the frame to the JS collectors, the active tab's
+// heap first, so marking and nursery collection rarely land in script
+static void browser_collect_garbage(browser_engine_t* engine, browser_tab_t* active_tab, uint64_t deadline) {
+    if (active_tab && active_tab->js_context) js_gc_idle((js_engine_t*)active_tab->js_context, deadline);
+    for (uint32_t i = 0; i < engine->tabs.tab_count && frame_scheduler_now() < deadline; i++) {
+        browser_tab_t* tab = engine->tabs.tabs[i];
+        if (tab != active_tab && tab->js_context) js_gc_idle((js_engine_t*)tab->js_context, deadline);
+    }
+    if (engine->parsers.js_engine && frame_scheduler_now() < deadline) js_gc_idle(engine->parsers.js_engine, deadline);
+}
+
+// Render frame. Every phase is incremental, so a frame with nothing dirty
+// costs little; the scheduler keeps frames from running at all when
+// nothing was requested.
 void browser_render_frame(browser_engine_t* engine) {
-    if (!engine || engine->tabs.tab_count == 0) return;
-    
-    browser_tab_t* active_tab = browser_get_active_tab(engine);
-    if (!active_tab || !active_tab->render_tree) return;
+    if (!engine) return;
     
+    frame_scheduler_t* scheduler = engine->managers.frame_scheduler;
     render_pipeline_t* pipeline = (render_pipeline_t*)engine->parsers.render_engine;
-    render_tree_t* tree = active_tab->render_tree;
-    
-    // Compute layout
-    pipeline->layout.compute_layout(tree, 1920.0f, 1080.0f); // Viewport size
-    
-    // Paint
-    browser_paint(active_tab);
+    uint64_t frame_time = frame_scheduler_begin_frame(scheduler);
+    uint64_t frame_start = frame_scheduler_now();
+    memset(engine->stats.phase_time_us, 0, sizeof(engine->stats.phase_time_us));
     
-    // Composite layers
-    browser_composite(engine);
-    
-    // Present to screen
-    browser_present(engine);
+    browser_tab_t* active_tab = browser_get_active_tab(engine);
+    render_tree_t* tree = active_tab ? active_tab->render_tree : NULL;
+    
+    // Input, until its budget runs out. Scroll offsets as of the
+    // compositor thread's last vsync come first, so handlers see them.
+    uint64_t phase_start = frame_start;
+    if (tree) compositor_thread_sync_scroll(engine->managers.compositor_thread, tree);
+    uint64_t input_budget = frame_scheduler_interval(scheduler) * browser_phase_budget[BROWSER_FRAME_PHASE_INPUT] / 1000;
+    frame_scheduler_run_input(scheduler, frame_time, phase_start + input_budget);
+    phase_start = browser_end_phase(engine, BROWSER_FRAME_PHASE_INPUT, phase_start);
+    
+    // Animation frame callbacks registered before this frame
+    frame_scheduler_run_animation_frames(scheduler, frame_time);
+    phase_start = browser_end_phase(engine, BROWSER_FRAME_PHASE_ANIMATION, phase_start);
+    
+    // Callbacks may have navigated or closed the tab
+    active_tab = browser_get_active_tab(engine);
+    tree = active_tab ? active_tab->render_tree : NULL;
+    if (tree && pipeline) {
+        // Restyle elements dirtied since the last frame
+        browser_update_style(active_tab);
+        phase_start = browser_end_phase(engine, BROWSER_FRAME_PHASE_STYLE, phase_start);
+        
+        // Lay out only the boxes dirtied since the last frame
+        layout_set_viewport(tree, 1920.0f, 1080.0f); // Viewport size
+        if (tree->needs_layout && pipeline->layout.reflow) {
+            pipeline->layout.reflow(tree, NULL);
+        }
+        phase_start = browser_end_phase(engine, BROWSER_FRAME_PHASE_LAYOUT, phase_start);
+        
+        // Paint
+        browser_paint(active_tab);
+        phase_start = browser_end_phase(engine, BROWSER_FRAME_PHASE_PAINT, phase_start);
+        
+        // Composite layers and present to screen
+        browser_composite(engine);
+        browser_present(engine);
+        browser_end_phase(engine, BROWSER_FRAME_PHASE_COMMIT, phase_start);
+    }
     
     // Update stats
-    engine->stats.frame_rate = 60; // Target 60 FPS
+    engine->stats.frame_time_us = (uint32_t)(frame_scheduler_now() - frame_start);
+    engine->stats.frame_count++;
+    engine->stats.dropped_frames += frame_scheduler_end_frame(scheduler);
+    engine->stats.frame_rate = frame_scheduler_frame_rate(scheduler);
+    
+    // Idle until the next vsync
+    uint64_t idle_deadline = frame_time + frame_scheduler_interval(scheduler);
+    browser_run_idle_callbacks(engine, active_tab, idle_deadline);
+    browser_collect_garbage(engine, active_tab, idle_deadline);
+    
+    network_manager_close_idle(engine->managers.network_manager);
+    engine->stats.active_connections = network_manager_connection_count(engine->managers.network_manager);
+}
+
+// Software compositing draws into a retained frame target
+static bool browser_ensure_frame_target(render_pipeline_t* pipeline) {
+    if (!pipeline->raster.context && pipeline->raster.create_context) {
+        pipeline->raster.context = pipeline->raster.create_context(1920, 1080);
+    }
+    return pipeline->raster.context != NULL;
 }
 
 // Paint tab content
@@ -322,20 +903,34 @@ void browser_paint(browser_tab_t* tab) {
     if (!tab || !tab->render_tree) return;
     
     render_tree_t* tree = tab->render_tree;
-    render_pipeline_t* pipeline = (render_pipeline_t*)tree;
-    
-    // Build layer tree
-    paint_layer_t* root_layer = pipeline->paint.build_layer_tree(tree);
-    
-    // Paint each layer
-    display_list_t* display_list = pipeline->paint.paint(root_layer);
-    
-    // Execute display list
-    void* raster_context = pipeline->raster.create_context(1920, 1080);
-    pipeline->raster.execute_display_list(raster_context, display_list);
-    pipeline->raster.flush(raster_context);
+    render_pipeline_t* pipeline = (render_pipeline_t*)tab->engine->parsers.render_engine;
+    if (!pipeline) return;
+    
+    // Layers and their backing stores are retained between frames, so a
+    // frame with nothing invalidated paints nothing and a blinking caret
+    // re-records one layer and rasterizes only its damaged rect
+    bool clean = tree->layer_tree && !tree->needs_paint && !tree->needs_layer_update &&
+                 tree->painted_layout_version == tree->layout_version;
+    
+    compositor_thread_t* compositor = tab->engine->managers.compositor_thread;
+    if (!compositor || tab != browser_get_active_tab(tab->engine)) {
+        if (!clean) paint_update(tree, pipeline);
+        return;
+    }
     
-    destroy_display_list(display_list);
+    // Paint and commit in one critical section, so the compositor thread
+    // never draws a committed frame whose backing stores were repainted or
+    // replaced under it
+    if (clean && !tree->needs_composite) return;
+    compositor_thread_lock(compositor);
+    if (!clean) paint_update(tree, pipeline);
+    if (tree->needs_composite || tree->composited_paint_version != tree->paint_version) {
+        browser_ensure_frame_target(pipeline);
+        compositor_thread_commit(compositor, tree);
+        tree->needs_composite = false;
+        tree->composited_paint_version = tree->paint_version;
+    }
+    compositor_thread_unlock(compositor);
 }
 
 // Get active tab
@@ -362,12 +957,28 @@ void browser_close_tab(browser_engine_t* engine, uint32_t tab_id) {
     
     if (!tab) return;
     
-    // Free tab resources
+    // Free tab resources. Once the fetch is cancelled no more navigation
+    // tasks are queued, but those already waiting hold the context.
+    navigation_cancel(tab);
+    js_discard_tasks((js_engine_t*)tab->js_context, navigation_run_task, navigation_discard_task);
+    browser_loader_destroy(tab->loader);
     free(tab->url);
     free(tab->title);
-    if (tab->document) dom_document_destroy(tab->document);
-    if (tab->js_context) js_engine_destroy(tab->js_context);
-    if (tab->render_tree) free(tab->render_tree);
+    if (tab->document) {
+        js_dom_forget_document((js_engine_t*)tab->js_context, tab->document);
+        dom_document_destroy(tab->document);
+    }
+    if (tab->js_context) {
+        worker_terminate_all((js_engine_t*)tab->js_context);
+        js_engine_destroy(tab->js_context);
+    }
+    if (tab->render_tree) browser_release_render_tree(engine, tab->render_tree);
+    
+    // Free style state
+    if (tab->style.observer) dom_disconnect_observer(tab->style.observer);
+    css_invalidation_map_destroy(tab->style.invalidation_map);
+    css_style_cache_destroy(tab->style.cache);
+    free(tab->style.stylesheets);
     
     // Free navigation history
     for (uint32_t i = 0; i < tab->navigation.history_count; i++) {
@@ -394,47 +1005,19 @@ int browser_go_back(browser_tab_t* tab) {
     if (!tab || tab->navigation.history_index == 0) return -1;
     
     tab->navigation.history_index--;
-    const char* url = tab->navigation.history[tab->navigation.history_index];
     
     // Navigate without adding to history
-    tab->state.loading = true;
-    free(tab->url);
-    tab->url = strdup(url);
-    
-    // Load the page
-    request_t* request = fetch_create_request(url, NULL);
-    fetch_operation_t* fetch_op = fetch_start(request);
-    if (fetch_op && fetch_op->response && fetch_op->response->ok) {
-        browser_load_html(tab, (char*)fetch_op->response->body);
-    }
-    fetch_operation_destroy(fetch_op);
-    
-    tab->state.loading = false;
-    return 0;
+    return navigation_start(tab, tab->navigation.history[tab->navigation.history_index]);
 }
 
 // Browser forward navigation
 int browser_go_forward(browser_tab_t* tab) {
-    if (!tab || tab->navigation.history_index >= tab->navigation.history_count - 1) return -1;
+    if (!tab || tab->navigation.history_index + 1 >= tab->navigation.history_count) return -1;
     
     tab->navigation.history_index++;
-    const char* url = tab->navigation.history[tab->navigation.history_index];
     
     // Navigate without adding to history
-    tab->state.loading = true;
-    free(tab->url);
-    tab->url = strdup(url);
-    
-    // Load the page
-    request_t* request = fetch_create_request(url, NULL);
-    fetch_operation_t* fetch_op = fetch_start(request);
-    if (fetch_op && fetch_op->response && fetch_op->response->ok) {
-        browser_load_html(tab, (char*)fetch_op->response->body);
-    }
-    fetch_operation_destroy(fetch_op);
-    
-    tab->state.loading = false;
-    return 0;
+    return navigation_start(tab, tab->navigation.history[tab->navigation.history_index]);
 }
 
 // Reload current page
@@ -444,35 +1027,59 @@ int browser_reload(browser_tab_t* tab) {
     // Clear cache for this URL
     // cache_delete(tab->url);
     
-    // Reload
-    return browser_navigate(tab, tab->url);
+    // Reload without adding a history entry
+    return navigation_start(tab, tab->url);
 }
 
 // Stop loading
 void browser_stop(browser_tab_t* tab) {
     if (!tab) return;
+    
+    // Cancel any pending network requests
+    navigation_cancel(tab);
+    browser_loader_destroy(tab->loader);
+    tab->loader = NULL;
+    
     tab->state.loading = false;
     tab->state.progress = 0;
-    // Cancel any pending network requests
+    tab->state.load_state = BROWSER_LOAD_IDLE;
 }
 
 // Composite layers
 void browser_composite(browser_engine_t* engine) {
     if (!engine) return;
     
+    // The compositor thread draws committed frames itself
+    if (engine->managers.compositor_thread) return;
+    
     render_pipeline_t* pipeline = (render_pipeline_t*)engine->parsers.render_engine;
     
     // Collect all layers from active tab
     browser_tab_t* active_tab = browser_get_active_tab(engine);
     if (!active_tab || !active_tab->render_tree) return;
     
+    // Nothing repainted and no compositor property changed since the last
+    // composite
+    render_tree_t* tree = active_tab->render_tree;
+    if (!tree->layer_tree) return;
+    if (!tree->needs_composite && tree->composited_paint_version == tree->paint_version) return;
+    
     // Composite layers using GPU if available
-    if (engine->config.enable_gpu && pipeline->acceleration.enabled) {
-        // GPU compositing
-        // pipeline->compositor.composite(layers, layer_count);
+    bool gpu = engine->config.enable_gpu && pipeline->acceleration.enabled && pipeline->compositor.composite;
+    if (!gpu && !browser_ensure_frame_target(pipeline)) return;
+    
+    uint32_t layer_count = 0;
+    paint_layer_t** layers = collect_layers_in_paint_order(tree->layer_tree, &layer_count);
+    if (!layers) return;
+    if (gpu) {
+        pipeline->compositor.composite(layers, layer_count);
     } else {
-        // Software compositing
+        raster_composite_layers(pipeline->raster.context, layers, layer_count);
     }
+    free(layers);
+    
+    tree->needs_composite = false;
+    tree->composited_paint_version = tree->paint_version;
 }
 
 // Present frame to screen
@@ -481,18 +1088,21 @@ void browser_present(browser_engine_t* engine) {
     
     render_pipeline_t* pipeline = (render_pipeline_t*)engine->parsers.render_engine;
     
-    // Present the composited frame
-    // pipeline->raster.present(raster_context);
-    
-    // Update frame counter
-    static uint64_t frame_count = 0;
-    frame_count++;
+    // Present the composited frame; the compositor thread presents its own
+    if (engine->managers.compositor_thread) pipeline = NULL;
+    if (pipeline && pipeline->raster.context && pipeline->raster.present) {
+        pipeline->raster.present(pipeline->raster.context);
+    }
 }
 
 // Shutdown browser engine
 void browser_engine_shutdown(browser_engine_t* engine) {
     if (!engine) return;
     
+    // Stop drawing before the layers go
+    compositor_thread_destroy(engine->managers.compositor_thread);
+    engine->managers.compositor_thread = NULL;
+    
     // Close all tabs
     while (engine->tabs.tab_count > 0) {
         browser_close_tab(engine, engine->tabs.tabs[0]->id);
@@ -500,6 +1110,7 @@ void browser_engine_shutdown(browser_engine_t* engine) {
     
     // Shutdown JavaScript engine
     if (engine->parsers.js_engine) {
+        worker_terminate_all(engine->parsers.js_engine);
         js_engine_shutdown(engine->parsers.js_engine);
         js_engine_destroy(engine->parsers.js_engine);
     }
@@ -510,13 +1121,33 @@ void browser_engine_shutdown(browser_engine_t* engine) {
     }
     
     free(engine->parsers.css_parser);
+    render_pipeline_t* pipeline = (render_pipeline_t*)engine->parsers.render_engine;
+    if (pipeline && pipeline->raster.context && pipeline->raster.destroy_context) {
+        pipeline->raster.destroy_context(pipeline->raster.context);
+    }
     free(engine->parsers.render_engine);
     
     // Free managers
-    free(engine->managers.network_manager);
+    fetch_set_network_manager(NULL);
+    network_manager_destroy(engine->managers.network_manager);
+    engine->managers.network_manager = NULL;
     free(engine->managers.cache_manager);
     free(engine->managers.security_manager);
     free(engine->managers.extension_manager);
+    
+    compositor_shutdown();
+    frame_scheduler_destroy(engine->managers.frame_scheduler);
+    engine->managers.frame_scheduler = NULL;
+    layout_set_worker_pool(NULL);
+    raster_set_worker_pool(NULL);
+    worker_pool_destroy(engine->managers.worker_pool);
+    engine->managers.worker_pool = NULL;
+    
+    // Compile jobs the pool ran to drain write to the cache
+    js_code_cache_close(engine->managers.code_cache);
+    engine->managers.code_cache = NULL;
+    
+    text_cache_clear();
 }
 
 // Destroy browser engine
@@ -528,6 +1159,12 @@ void browser_engine_destroy(browser_engine_t* engine) {
     free(engine);
 }
 
+// Register handler for browser events
+void browser_register_event_handler(browser_engine_t* engine, browser_event_type_t event, browser_event_handler_t handler) {
+    if (!engine || event >= BROWSER_EVENT_COUNT) return;
+    engine->events.handlers[event] = handler;
+}
+
 // Developer tools
 void browser_enable_devtools(browser_engine_t* engine, bool enable) {
     if (!engine) return;
@@ -537,7 +1174,8 @@ void browser_enable_devtools(browser_engine_t* engine, bool enable) {
 void browser_inspect_element(browser_tab_t* tab, uint32_t x, uint32_t y) {
     if (!tab || !tab->render_tree) return;
     
-    render_pipeline_t* pipeline = (render_pipeline_t*)tab->render_tree;
+    render_pipeline_t* pipeline = (render_pipeline_t*)tab->engine->parsers.render_engine;
+    if (!pipeline || !pipeline->layout.hit_test) return;
     layout_box_t* box = NULL;
     
     // Hit test to find element at coordinates
@@ -554,12 +1192,31 @@ void browser_show_console(browser_tab_t* tab) {
     // Show JavaScript console
 }
 
+// Profiling restarts the frame counters and phase totals
 void browser_profile_start(browser_engine_t* engine) {
     if (!engine) return;
-    // Start performance profiling
+    engine->stats.frame_count = 0;
+    engine->stats.dropped_frames = 0;
+    memset(engine->stats.phase_total_us, 0, sizeof(engine->stats.phase_total_us));
+    memset(engine->stats.phase_over_budget, 0, sizeof(engine->stats.phase_over_budget));
 }
 
 void browser_profile_stop(browser_engine_t* engine) {
     if (!engine) return;
-    // Stop profiling and show results
+    
+    static const char* phase_names[BROWSER_FRAME_PHASE_COUNT] = {
+        "input", "animation", "style", "layout", "paint", "commit"
+    };
+    uint64_t frames = engine->stats.frame_count ? engine->stats.frame_count : 1;
+    uint64_t total = 0;
+    for (uint32_t i = 0; i < BROWSER_FRAME_PHASE_COUNT; i++) total += engine->stats.phase_total_us[i];
+    
+    printf("Frames: %llu, dropped: %llu, %u fps\n", (unsigned long long)engine->stats.frame_count,
+           (unsigned long long)engine->stats.dropped_frames, engine->stats.frame_rate);
+    for (uint32_t i = 0; i < BROWSER_FRAME_PHASE_COUNT; i++) {
+        printf("  %-10s %8.1f us/frame %5.1f%%  over budget %u\n", phase_names[i],
+               (double)engine->stats.phase_total_us[i] / (double)frames,
+               total ? 100.0 * (double)engine->stats.phase_total_us[i] / (double)total : 0.0,
+               engine->stats.phase_over_budget[i]);
+    }
 }
\ No newline at end of file
@@ -10,13 +10,55 @@ typedef struct css_stylesheet css_stylesheet_t;
 typedef struct js_context js_context_t;
 typedef struct render_tree render_tree_t;
 typedef struct browser_tab browser_tab_t;
+struct js_bytecode;
+
+// Events
+typedef enum {
+    BROWSER_EVENT_LOAD_START,
+    BROWSER_EVENT_LOAD_COMPLETE,
+    BROWSER_EVENT_LOAD_ERROR,
+    BROWSER_EVENT_DOM_READY,
+    BROWSER_EVENT_NAVIGATION,
+    BROWSER_EVENT_SECURITY_WARNING,
+    BROWSER_EVENT_DOWNLOAD_START,
+    BROWSER_EVENT_DOWNLOAD_COMPLETE,
+    BROWSER_EVENT_COUNT
+} browser_event_type_t;
+
+typedef void (*browser_event_handler_t)(browser_tab_t* tab, browser_event_type_t event, void* data);
+
+// Navigation load states
+typedef enum {
+    BROWSER_LOAD_IDLE,
+    BROWSER_LOAD_REQUESTING,
+    BROWSER_LOAD_RECEIVING,
+    BROWSER_LOAD_PARSING,
+    BROWSER_LOAD_COMPLETE,
+    BROWSER_LOAD_FAILED
+} browser_load_state_t;
+
+// Frame phases, in the order browser_render_frame runs them. Commit is
+// compositing and presenting, or the handoff to the compositor thread.
+typedef enum {
+    BROWSER_FRAME_PHASE_INPUT,
+    BROWSER_FRAME_PHASE_ANIMATION,
+    BROWSER_FRAME_PHASE_STYLE,
+    BROWSER_FRAME_PHASE_LAYOUT,
+    BROWSER_FRAME_PHASE_PAINT,
+    BROWSER_FRAME_PHASE_COMMIT,
+    BROWSER_FRAME_PHASE_COUNT
+} browser_frame_phase_t;
+
+typedef void (*browser_frame_callback_t)(void* data, uint64_t frame_time_us);
 
 // Browser engine configuration
 typedef struct {
     uint32_t max_tabs;
     uint32_t js_heap_size;
     uint32_t cache_size;
+    const char* cache_directory;    // HTTP and code caches; NULL keeps nothing on disk
     bool enable_gpu;
+    bool enable_jit;                // Baseline JIT for hot scripts
     bool enable_webgl;
     bool enable_webrtc;
     bool enable_sandbox;
@@ -42,30 +84,63 @@ typedef struct browser_engine {
     struct {
         void* network_manager;
         void* cache_manager;
+        void* code_cache;           // Compiled scripts, next to the HTTP cache (js/code_cache.h)
         void* security_manager;
         void* extension_manager;
+        void* worker_pool;          // max_workers threads for layout and raster
+        void* compositor_thread;    // Scrolls and composites at vsync
+        void* frame_scheduler;      // Paces browser_render_frame
     } managers;
     
+    struct {
+        browser_event_handler_t handlers[BROWSER_EVENT_COUNT];
+    } events;
+    
     struct {
         uint64_t memory_usage;
-        uint32_t frame_rate;
+        uint32_t frame_rate;        // Frames rendered over the last second
         uint32_t active_connections;
+        
+        // Frame timing. The phase totals and counts since the last
+        // browser_profile_start show where the frame budget goes.
+        uint64_t frame_count;
+        uint64_t dropped_frames;
+        uint32_t frame_time_us;
+        uint32_t phase_time_us[BROWSER_FRAME_PHASE_COUNT];
+        uint64_t phase_total_us[BROWSER_FRAME_PHASE_COUNT];
+        uint32_t phase_over_budget[BROWSER_FRAME_PHASE_COUNT];
     } stats;
 } browser_engine_t;
 
 // Browser tab structure
 struct browser_tab {
     uint32_t id;
+    struct browser_engine* engine;
     char* url;
     char* title;
     dom_document_t* document;
     js_context_t* js_context;
     render_tree_t* render_tree;
+    void* loader;
+    
+    // Style state: the tab's stylesheets in cascade order, the invalidation
+    // sets and sharing cache built from them, and the mutation observer
+    // polled once per frame
+    struct {
+        css_stylesheet_t** stylesheets;
+        uint32_t stylesheet_count;
+        void* invalidation_map;
+        void* cache;
+        void* observer;
+    } style;
     
     struct {
         bool loading;
         bool secure;
         uint32_t progress;
+        browser_load_state_t load_state;
+        uint32_t navigation_id;
+        void* pending_navigation;
     } state;
     
     struct {
@@ -97,27 +172,26 @@ void browser_stop(browser_tab_t* tab);
 // Content loading
 int browser_load_html(browser_tab_t* tab, const char* html);
 int browser_execute_script(browser_tab_t* tab, const char* script);
+int browser_execute_compiled(browser_tab_t* tab, struct js_bytecode* bytecode); // Takes bytecode
 int browser_inject_css(browser_tab_t* tab, const char* css);
+void browser_set_stylesheets(browser_tab_t* tab, css_stylesheet_t** stylesheets, uint32_t stylesheet_count);
 
-// Rendering
+// Rendering. The host loop waits for a frame and renders it:
+//     while (browser_wait_for_frame(engine, UINT32_MAX)) browser_render_frame(engine);
+// Anything that changes the page requests a frame; with none requested
+// the wait sleeps without using CPU. Animation frame callbacks and input
+// run in the frame's first two phases.
+void browser_request_frame(browser_engine_t* engine);
+bool browser_wait_for_frame(browser_engine_t* engine, uint32_t timeout_ms);
+uint32_t browser_request_animation_frame(browser_engine_t* engine, browser_frame_callback_t callback, void* data);
+void browser_cancel_animation_frame(browser_engine_t* engine, uint32_t id);
+void browser_post_input(browser_engine_t* engine, browser_frame_callback_t callback, void* data);
 void browser_render_frame(browser_engine_t* engine);
 void browser_paint(browser_tab_t* tab);
 void browser_composite(browser_engine_t* engine);
 void browser_present(browser_engine_t* engine);
 
 // Events
-typedef enum {
-    BROWSER_EVENT_LOAD_START,
-    BROWSER_EVENT_LOAD_COMPLETE,
-    BROWSER_EVENT_LOAD_ERROR,
-    BROWSER_EVENT_DOM_READY,
-    BROWSER_EVENT_NAVIGATION,
-    BROWSER_EVENT_SECURITY_WARNING,
-    BROWSER_EVENT_DOWNLOAD_START,
-    BROWSER_EVENT_DOWNLOAD_COMPLETE
-} browser_event_type_t;
-
-typedef void (*browser_event_handler_t)(browser_tab_t* tab, browser_event_type_t event, void* data);
 void browser_register_event_handler(browser_engine_t* engine, browser_event_type_t event, browser_event_handler_t handler);
 
 // Developer tools
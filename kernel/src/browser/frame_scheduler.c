@@ -0,0 +1,312 @@
+#include "frame_scheduler.h"
+#include "capacity.h"
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+typedef struct {
+    frame_callback_t callback;      // NULL once cancelled
+    void* data;
+    uint32_t id;
+} frame_entry_t;
+
+typedef struct {
+    frame_entry_t* entries;
+    uint32_t head;
+    uint32_t count;
+    uint32_t capacity;
+} frame_queue_t;
+
+struct frame_scheduler {
+    uint32_t interval_us;
+    
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    bool requested;
+    uint64_t vsync_base;            // Any vsync; the rest are interval_us apart
+    uint64_t frame_time;            // Vsync of the frame in progress
+    
+    // Frame rate over windows of about a second
+    uint64_t window_start;
+    uint32_t window_frames;
+    uint32_t frame_rate;
+    
+    // Guarded by lock. Animation frames run from a snapshot, so callbacks
+    // registered meanwhile land in the next frame's queue.
+    frame_queue_t animation_frames;
+    frame_queue_t running;
+    frame_queue_t inputs;
+    uint32_t next_id;
+};
+
+uint64_t frame_scheduler_now(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000 + (uint64_t)now.tv_nsec / 1000;
+}
+
+static void sleep_until(uint64_t time_us) {
+    struct timespec deadline;
+    deadline.tv_sec = (time_t)(time_us / 1000000);
+    deadline.tv_nsec = (long)(time_us % 1000000) * 1000;
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL) == EINTR) {}
+}
+
+// Latest vsync at or before now
+static uint64_t last_vsync(const frame_scheduler_t* scheduler, uint64_t now) {
+    if (now < scheduler->vsync_base) return now;
+    return now - (now - scheduler->vsync_base) % scheduler->interval_us;
+}
+
+// Queues
+
+static bool queue_push(frame_queue_t* queue, frame_callback_t callback, void* data, uint32_t id) {
+    if (queue->head + queue->count >= queue->capacity) {
+        if (queue->head) {
+            memmove(queue->entries, queue->entries + queue->head, queue->count * sizeof(frame_entry_t));
+            queue->head = 0;
+        }
+        if (queue->count >= queue->capacity) {
+            uint32_t capacity = capacity_grow(queue->capacity, 16, sizeof(frame_entry_t));
+            frame_entry_t* entries = capacity ? realloc(queue->entries, capacity * sizeof(frame_entry_t)) : NULL;
+            if (!entries) return false;
+            queue->entries = entries;
+            queue->capacity = capacity;
+        }
+    }
+    
+    frame_entry_t* entry = &queue->entries[queue->head + queue->count++];
+    entry->callback = callback;
+    entry->data = data;
+    entry->id = id;
+    return true;
+}
+
+static bool queue_pop(frame_queue_t* queue, frame_entry_t* entry) {
+    if (!queue->count) return false;
+    *entry = queue->entries[queue->head++];
+    if (--queue->count == 0) queue->head = 0;
+    return true;
+}
+
+static bool queue_cancel(frame_queue_t* queue, uint32_t id) {
+    for (uint32_t i = 0; i < queue->count; i++) {
+        frame_entry_t* entry = &queue->entries[queue->head + i];
+        if (entry->id == id) {
+            entry->callback = NULL;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Lifecycle
+
+frame_scheduler_t* frame_scheduler_create(uint32_t interval_us) {
+    if (!interval_us) return NULL;
+    
+    frame_scheduler_t* scheduler = calloc(1, sizeof(frame_scheduler_t));
+    if (!scheduler) return NULL;
+    
+    scheduler->interval_us = interval_us;
+    scheduler->vsync_base = frame_scheduler_now();
+    scheduler->window_start = scheduler->vsync_base;
+    scheduler->next_id = 1;
+    
+    pthread_condattr_t attributes;
+    pthread_condattr_init(&attributes);
+    pthread_condattr_setclock(&attributes, CLOCK_MONOTONIC);
+    pthread_cond_init(&scheduler->wake, &attributes);
+    pthread_condattr_destroy(&attributes);
+    pthread_mutex_init(&scheduler->lock, NULL);
+    return scheduler;
+}
+
+void frame_scheduler_destroy(frame_scheduler_t* scheduler) {
+    if (!scheduler) return;
+    free(scheduler->animation_frames.entries);
+    free(scheduler->running.entries);
+    free(scheduler->inputs.entries);
+    pthread_cond_destroy(&scheduler->wake);
+    pthread_mutex_destroy(&scheduler->lock);
+    free(scheduler);
+}
+
+uint32_t frame_scheduler_interval(const frame_scheduler_t* scheduler) {
+    return scheduler ? scheduler->interval_us : 0;
+}
+
+// Requests and pacing
+
+static void request_locked(frame_scheduler_t* scheduler) {
+    if (!scheduler->requested) {
+        scheduler->requested = true;
+        pthread_cond_broadcast(&scheduler->wake);
+    }
+}
+
+void frame_scheduler_request(frame_scheduler_t* scheduler) {
+    if (!scheduler) return;
+    pthread_mutex_lock(&scheduler->lock);
+    request_locked(scheduler);
+    pthread_mutex_unlock(&scheduler->lock);
+}
+
+void frame_scheduler_vsync(frame_scheduler_t* scheduler, uint64_t timestamp_us) {
+    if (!scheduler) return;
+    pthread_mutex_lock(&scheduler->lock);
+    scheduler->vsync_base = timestamp_us;
+    pthread_mutex_unlock(&scheduler->lock);
+}
+
+uint64_t frame_scheduler_wait(frame_scheduler_t* scheduler, uint32_t timeout_ms) {
+    if (!scheduler) return 0;
+    
+    pthread_mutex_lock(&scheduler->lock);
+    if (timeout_ms == UINT32_MAX) {
+        while (!scheduler->requested) pthread_cond_wait(&scheduler->wake, &scheduler->lock);
+    } else if (!scheduler->requested) {
+        uint64_t until = frame_scheduler_now() + (uint64_t)timeout_ms * 1000;
+        struct timespec deadline;
+        deadline.tv_sec = (time_t)(until / 1000000);
+        deadline.tv_nsec = (long)(until % 1000000) * 1000;
+        while (!scheduler->requested) {
+            if (pthread_cond_timedwait(&scheduler->wake, &scheduler->lock, &deadline) == ETIMEDOUT) break;
+        }
+    }
+    
+    if (!scheduler->requested) {
+        pthread_mutex_unlock(&scheduler->lock);
+        return 0;
+    }
+    uint64_t vsync = last_vsync(scheduler, frame_scheduler_now()) + scheduler->interval_us;
+    pthread_mutex_unlock(&scheduler->lock);
+    
+    sleep_until(vsync);
+    return vsync;
+}
+
+uint64_t frame_scheduler_begin_frame(frame_scheduler_t* scheduler) {
+    if (!scheduler) return frame_scheduler_now();
+    
+    pthread_mutex_lock(&scheduler->lock);
+    scheduler->requested = false;
+    scheduler->frame_time = last_vsync(scheduler, frame_scheduler_now());
+    uint64_t frame_time = scheduler->frame_time;
+    pthread_mutex_unlock(&scheduler->lock);
+    return frame_time;
+}
+
+uint32_t frame_scheduler_end_frame(frame_scheduler_t* scheduler) {
+    if (!scheduler) return 0;
+    
+    uint64_t now = frame_scheduler_now();
+    pthread_mutex_lock(&scheduler->lock);
+    
+    // Finishing past the next vsync misses one frame per interval overrun
+    uint32_t dropped = 0;
+    if (now > scheduler->frame_time + scheduler->interval_us) {
+        dropped = (uint32_t)((now - scheduler->frame_time) / scheduler->interval_us);
+    }
+    
+    // After an idle stretch the window restarts instead of averaging in
+    // the time nothing was requested
+    uint64_t elapsed = now - scheduler->window_start;
+    if (elapsed > 2000000) {
+        scheduler->window_start = now;
+        scheduler->window_frames = 0;
+        elapsed = 0;
+    }
+    scheduler->window_frames++;
+    if (elapsed >= 1000000) {
+        scheduler->frame_rate = (uint32_t)((uint64_t)scheduler->window_frames * 1000000 / elapsed);
+        scheduler->window_start = now;
+        scheduler->window_frames = 0;
+    }
+    
+    pthread_mutex_unlock(&scheduler->lock);
+    return dropped;
+}
+
+uint32_t frame_scheduler_frame_rate(const frame_scheduler_t* scheduler) {
+    return scheduler ? scheduler->frame_rate : 0;
+}
+
+// Animation frames
+
+uint32_t frame_scheduler_request_animation_frame(frame_scheduler_t* scheduler, frame_callback_t callback, void* data) {
+    if (!scheduler || !callback) return 0;
+    
+    pthread_mutex_lock(&scheduler->lock);
+    uint32_t id = scheduler->next_id++;
+    if (!scheduler->next_id) scheduler->next_id = 1;
+    if (!queue_push(&scheduler->animation_frames, callback, data, id)) id = 0;
+    if (id) request_locked(scheduler);
+    pthread_mutex_unlock(&scheduler->lock);
+    return id;
+}
+
+void frame_scheduler_cancel_animation_frame(frame_scheduler_t* scheduler, uint32_t id) {
+    if (!scheduler || !id) return;
+    
+    pthread_mutex_lock(&scheduler->lock);
+    if (!queue_cancel(&scheduler->animation_frames, id)) queue_cancel(&scheduler->running, id);
+    pthread_mutex_unlock(&scheduler->lock);
+}
+
+uint32_t frame_scheduler_run_animation_frames(frame_scheduler_t* scheduler, uint64_t frame_time_us) {
+    if (!scheduler) return 0;
+    
+    pthread_mutex_lock(&scheduler->lock);
+    frame_queue_t snapshot = scheduler->animation_frames;
+    scheduler->animation_frames = scheduler->running;
+    scheduler->running = snapshot;
+    
+    uint32_t ran = 0;
+    frame_entry_t entry;
+    while (queue_pop(&scheduler->running, &entry)) {
+        if (!entry.callback) continue;
+        
+        // Unlocked, so callbacks can request and cancel frames
+        pthread_mutex_unlock(&scheduler->lock);
+        entry.callback(entry.data, frame_time_us);
+        ran++;
+        pthread_mutex_lock(&scheduler->lock);
+    }
+    pthread_mutex_unlock(&scheduler->lock);
+    return ran;
+}
+
+// Input
+
+void frame_scheduler_post_input(frame_scheduler_t* scheduler, frame_callback_t callback, void* data) {
+    if (!scheduler || !callback) return;
+    
+    pthread_mutex_lock(&scheduler->lock);
+    if (queue_push(&scheduler->inputs, callback, data, 0)) request_locked(scheduler);
+    pthread_mutex_unlock(&scheduler->lock);
+}
+
+// Always handles at least one event, so input cannot starve
+uint32_t frame_scheduler_run_input(frame_scheduler_t* scheduler, uint64_t frame_time_us, uint64_t deadline_us) {
+    if (!scheduler) return 0;
+    
+    uint32_t ran = 0;
+    frame_entry_t entry;
+    pthread_mutex_lock(&scheduler->lock);
+    while (queue_pop(&scheduler->inputs, &entry)) {
+        pthread_mutex_unlock(&scheduler->lock);
+        entry.callback(entry.data, frame_time_us);
+        ran++;
+        pthread_mutex_lock(&scheduler->lock);
+        
+        if (scheduler->inputs.count && frame_scheduler_now() >= deadline_us) {
+            request_locked(scheduler);
+            break;
+        }
+    }
+    pthread_mutex_unlock(&scheduler->lock);
+    return ran;
+}
@@ -0,0 +1,50 @@
+#ifndef FRAME_SCHEDULER_H
+#define FRAME_SCHEDULER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Vsync-paced frame scheduler. Frames run only when something asked for
+// one: anything that dirties the page calls frame_scheduler_request (from
+// any thread), and frame_scheduler_wait sleeps on a condition variable
+// until a request is pending, then until the next vsync. An idle tab
+// therefore uses no CPU. Vsync is the interval grid from creation time
+// until the platform reports real timestamps through
+// frame_scheduler_vsync.
+//
+// Animation frame callbacks registered before a frame begins run in that
+// frame; ones registered while they run wait for the next. Input is
+// queued the same way and drained up to a deadline, with the rest carried
+// over to the next frame.
+typedef struct frame_scheduler frame_scheduler_t;
+typedef void (*frame_callback_t)(void* data, uint64_t frame_time_us);
+
+frame_scheduler_t* frame_scheduler_create(uint32_t interval_us);
+void frame_scheduler_destroy(frame_scheduler_t* scheduler);
+uint32_t frame_scheduler_interval(const frame_scheduler_t* scheduler);
+uint64_t frame_scheduler_now(void);
+
+void frame_scheduler_request(frame_scheduler_t* scheduler);
+void frame_scheduler_vsync(frame_scheduler_t* scheduler, uint64_t timestamp_us);
+
+// Returns the vsync time of the frame to run, or 0 when timeout_ms passed
+// with nothing requested. UINT32_MAX waits indefinitely.
+uint64_t frame_scheduler_wait(frame_scheduler_t* scheduler, uint32_t timeout_ms);
+
+// begin_frame takes the pending request and returns the frame's vsync
+// time. end_frame returns how many vsyncs the frame overran, which are
+// counted as dropped frames.
+uint64_t frame_scheduler_begin_frame(frame_scheduler_t* scheduler);
+uint32_t frame_scheduler_end_frame(frame_scheduler_t* scheduler);
+uint32_t frame_scheduler_frame_rate(const frame_scheduler_t* scheduler);
+
+// Animation frames. Ids are never 0.
+uint32_t frame_scheduler_request_animation_frame(frame_scheduler_t* scheduler, frame_callback_t callback, void* data);
+void frame_scheduler_cancel_animation_frame(frame_scheduler_t* scheduler, uint32_t id);
+uint32_t frame_scheduler_run_animation_frames(frame_scheduler_t* scheduler, uint64_t frame_time_us);
+
+// Input
+void frame_scheduler_post_input(frame_scheduler_t* scheduler, frame_callback_t callback, void* data);
+uint32_t frame_scheduler_run_input(frame_scheduler_t* scheduler, uint64_t frame_time_us, uint64_t deadline_us);
+
+#endif
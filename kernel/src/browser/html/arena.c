@@ -0,0 +1,129 @@
+#include "arena.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define ARENA_ALIGN(size) (((size) + DOM_ARENA_ALIGNMENT - 1) & ~(size_t)(DOM_ARENA_ALIGNMENT - 1))
+#define ARENA_CHUNK_HEADER ARENA_ALIGN(sizeof(dom_arena_chunk_t))
+
+static dom_arena_chunk_t* arena_new_chunk(dom_arena_t* arena, size_t min_size) {
+    size_t size = DOM_ARENA_CHUNK_SIZE;
+    if (min_size + ARENA_CHUNK_HEADER > size) {
+        size = min_size + ARENA_CHUNK_HEADER;
+    }
+    
+    dom_arena_chunk_t* chunk = malloc(size);
+    if (!chunk) return NULL;
+    
+    chunk->next = NULL;
+    chunk->size = size;
+    chunk->used = ARENA_CHUNK_HEADER;
+    arena->bytes_reserved += size;
+    
+    return chunk;
+}
+
+dom_arena_t* dom_arena_create(void) {
+    dom_arena_t* arena = calloc(1, sizeof(dom_arena_t));
+    if (!arena) return NULL;
+    
+    arena->chunks = arena_new_chunk(arena, 0);
+    if (!arena->chunks) {
+        free(arena);
+        return NULL;
+    }
+    arena->current = arena->chunks;
+    
+    return arena;
+}
+
+// Release every allocation in one step
+void dom_arena_destroy(dom_arena_t* arena) {
+    if (!arena) return;
+    
+    dom_arena_chunk_t* chunk = arena->chunks;
+    while (chunk) {
+        dom_arena_chunk_t* next = chunk->next;
+        free(chunk);
+        chunk = next;
+    }
+    free(arena);
+}
+
+// Forget all allocations but keep the chunks for reuse
+void dom_arena_reset(dom_arena_t* arena) {
+    if (!arena) return;
+    
+    for (dom_arena_chunk_t* chunk = arena->chunks; chunk; chunk = chunk->next) {
+        chunk->used = ARENA_CHUNK_HEADER;
+    }
+    memset(arena->free_lists, 0, sizeof(arena->free_lists));
+    arena->current = arena->chunks;
+    arena->bytes_allocated = 0;
+}
+
+void* dom_arena_alloc(dom_arena_t* arena, size_t size) {
+    if (!arena) return NULL;
+    
+    size = ARENA_ALIGN(size ? size : 1);
+    
+    // Reuse a freed block of the same size class
+    if (size <= DOM_ARENA_MAX_SMALL) {
+        uint32_t size_class = (uint32_t)(size / DOM_ARENA_ALIGNMENT) - 1;
+        void* block = arena->free_lists[size_class];
+        if (block) {
+            arena->free_lists[size_class] = *(void**)block;
+            memset(block, 0, size);
+            arena->bytes_allocated += size;
+            return block;
+        }
+    }
+    
+    // Bump allocate, moving on to (or adding) the next chunk when full
+    dom_arena_chunk_t* chunk = arena->current;
+    while (chunk->used + size > chunk->size) {
+        if (!chunk->next) {
+            chunk->next = arena_new_chunk(arena, size);
+            if (!chunk->next) return NULL;
+        }
+        chunk = chunk->next;
+    }
+    arena->current = chunk;
+    
+    void* block = (char*)chunk + chunk->used;
+    chunk->used += size;
+    arena->bytes_allocated += size;
+    memset(block, 0, size);
+    
+    return block;
+}
+
+// Return a block to its size class. Large blocks are only reclaimed when
+// the arena is destroyed or reset.
+void dom_arena_free(dom_arena_t* arena, void* ptr, size_t size) {
+    if (!arena || !ptr) return;
+    
+    size = ARENA_ALIGN(size ? size : 1);
+    arena->bytes_allocated -= size;
+    
+    if (size <= DOM_ARENA_MAX_SMALL) {
+        uint32_t size_class = (uint32_t)(size / DOM_ARENA_ALIGNMENT) - 1;
+        *(void**)ptr = arena->free_lists[size_class];
+        arena->free_lists[size_class] = ptr;
+    }
+}
+
+char* dom_arena_strndup(dom_arena_t* arena, const char* str, size_t length) {
+    if (!str) return NULL;
+    
+    char* copy = dom_arena_alloc(arena, length + 1);
+    if (!copy) return NULL;
+    
+    memcpy(copy, str, length);
+    copy[length] = '\0';
+    return copy;
+}
+
+char* dom_arena_strdup(dom_arena_t* arena, const char* str) {
+    if (!str) return NULL;
+    return dom_arena_strndup(arena, str, strlen(str));
+}
\ No newline at end of file
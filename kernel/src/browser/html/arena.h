@@ -0,0 +1,44 @@
+#ifndef HTML_ARENA_H
+#define HTML_ARENA_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#define DOM_ARENA_ALIGNMENT 16
+#define DOM_ARENA_CHUNK_SIZE (64 * 1024)
+#define DOM_ARENA_MAX_SMALL 256
+#define DOM_ARENA_SIZE_CLASSES (DOM_ARENA_MAX_SMALL / DOM_ARENA_ALIGNMENT)
+
+// Arena chunk
+typedef struct dom_arena_chunk {
+    struct dom_arena_chunk* next;
+    size_t size;
+    size_t used;
+} dom_arena_chunk_t;
+
+// Bump allocator backing one document's nodes, attributes and strings.
+// Blocks freed while the document is alive go onto a free list for their
+// size class and are reused by later allocations of the same class;
+// everything is released at once by dom_arena_destroy.
+typedef struct dom_arena {
+    dom_arena_chunk_t* chunks;
+    dom_arena_chunk_t* current;
+    void* free_lists[DOM_ARENA_SIZE_CLASSES];
+    
+    uint64_t bytes_allocated;
+    uint64_t bytes_reserved;
+} dom_arena_t;
+
+// Arena lifecycle
+dom_arena_t* dom_arena_create(void);
+void dom_arena_destroy(dom_arena_t* arena);
+void dom_arena_reset(dom_arena_t* arena);
+
+// Allocation. Memory is zeroed; size must be passed back on free.
+void* dom_arena_alloc(dom_arena_t* arena, size_t size);
+void dom_arena_free(dom_arena_t* arena, void* ptr, size_t size);
+char* dom_arena_strdup(dom_arena_t* arena, const char* str);
+char* dom_arena_strndup(dom_arena_t* arena, const char* str, size_t length);
+
+#endif
\ No newline at end of file
@@ -3,6 +3,7 @@
 
 #include <stdint.h>
 #include <stdbool.h>
+#include "../atom.h"
 
 // DOM node types
 typedef enum {
@@ -25,6 +26,7 @@ typedef struct dom_attribute dom_attribute_t;
 typedef struct dom_text dom_text_t;
 typedef struct dom_comment dom_comment_t;
 typedef struct dom_event dom_event_t;
+typedef struct dom_collection dom_collection_t;
 
 // Base DOM node
 struct dom_node {
@@ -39,6 +41,10 @@ struct dom_node {
     dom_node_t* next_sibling;
     uint32_t child_count;
     void* user_data;
+    
+    // The node's one JS wrapper, or NULL (js/dom_binding.h). A node is not
+    // recycled while it has one; the wrapper's collector clears this.
+    struct js_object* wrapper;
 };
 
 // DOM element
@@ -53,9 +59,17 @@ struct dom_element {
     char* namespace_uri;
     char* prefix;
     
+    // Interned names. tag_atom is the lowercased tag name; class_atoms
+    // parallels class_list. Matching and lookups compare these rather than
+    // the strings above.
+    atom_t tag_atom;
+    atom_t id_atom;
+    atom_t* class_atoms;
+    
     // Style and layout
     void* computed_style;
     void* layout_box;
+    uint8_t style_dirty;            // DOM_STYLE_DIRTY_* bits
     
     // Shadow DOM
     dom_node_t* shadow_root;
@@ -69,6 +83,15 @@ struct dom_element {
     uint32_t listener_count;
 };
 
+// Style recalc bits on dom_element.style_dirty, set by the invalidation
+// sets in css/invalidation.h. DESCENDANTS is propagated up to the root so
+// the recalc walk can skip clean subtrees.
+enum {
+    DOM_STYLE_DIRTY_SELF = 1,           // Restyle this element
+    DOM_STYLE_DIRTY_SUBTREE = 2,        // Restyle this element and all descendants
+    DOM_STYLE_DIRTY_DESCENDANTS = 4     // Some descendant has SELF or SUBTREE
+};
+
 // DOM document
 struct dom_document {
     dom_node_t base;
@@ -98,20 +121,27 @@ struct dom_document {
         uint32_t script_count;
     } collections;
     
-    // ID and name maps
-    void* id_map;
-    void* name_map;
+    // ID, name and class maps plus cached live collections. Covers the
+    // elements connected to this document; see dom_index_* below.
+    struct dom_index* index;
     
     // Custom elements registry
     void* custom_elements;
     
-    // Mutation observers
+    // Mutation observers and their record pool (html/mutation.c)
     void* mutation_observers;
+    
+    // Backing store for the document's nodes, attributes, class lists and
+    // their strings. Removed nodes are recycled through the arena's size
+    // class free lists; dom_document_destroy releases it all at once
+    // instead of walking the tree.
+    struct dom_arena* arena;
 };
 
 // DOM attribute
 struct dom_attribute {
     char* name;
+    atom_t name_atom;
     char* value;
     char* namespace_uri;
     char* prefix;
@@ -160,13 +190,85 @@ char* dom_element_get_attribute(dom_element_t* element, const char* name);
 void dom_element_set_attribute(dom_element_t* element, const char* name, const char* value);
 void dom_element_remove_attribute(dom_element_t* element, const char* name);
 bool dom_element_has_attribute(dom_element_t* element, const char* name);
+
+// Atom-keyed variants of the lookups above. dom_element_sync_atoms refreshes
+// id_atom and class_atoms after id or class_list change.
+dom_attribute_t* dom_element_get_attribute_node_atom(dom_element_t* element, atom_t name);
+char* dom_element_get_attribute_atom(dom_element_t* element, atom_t name);
+bool dom_element_has_attribute_atom(dom_element_t* element, atom_t name);
+bool dom_element_has_class_atom(dom_element_t* element, atom_t class_name);
+void dom_element_sync_atoms(dom_element_t* element);
 dom_element_t* dom_element_get_by_id(dom_document_t* document, const char* id);
+dom_element_t* dom_element_get_by_id_atom(dom_document_t* document, atom_t id);
+
+// The arrays returned here belong to the element's cached live collection;
+// they must not be freed and stay valid until the next DOM mutation, and
+// through at least DOM_COLLECTION_CACHE_LIMIT / 2 further lookups.
+// class_name may list several classes; elements must have all of them.
 dom_element_t** dom_element_get_by_tag_name(dom_element_t* element, const char* tag_name, uint32_t* count);
 dom_element_t** dom_element_get_by_class_name(dom_element_t* element, const char* class_name, uint32_t* count);
+dom_element_t** dom_document_get_by_name(dom_document_t* document, const char* name, uint32_t* count);
 bool dom_element_matches(dom_element_t* element, const char* selector);
 dom_element_t* dom_element_query_selector(dom_element_t* element, const char* selector);
 dom_element_t** dom_element_query_selector_all(dom_element_t* element, const char* selector, uint32_t* count);
 
+// Live collections (HTMLCollection). A collection is cached per root, kind
+// and key, and is rebuilt on access only when an index change could have
+// altered its contents. Collections are owned by the document.
+//
+// dom_node_get_collection takes a reference, which keeps the collection
+// cached until dom_collection_release. Unreferenced ones are evicted, least
+// recently used first, once more than DOM_COLLECTION_CACHE_LIMIT are cached.
+#define DOM_COLLECTION_CACHE_LIMIT 64
+
+typedef enum {
+    DOM_COLLECTION_TAG,
+    DOM_COLLECTION_CLASS,
+    DOM_COLLECTION_NAME
+} dom_collection_kind_t;
+
+struct dom_collection {
+    dom_node_t* root;
+    dom_collection_kind_t kind;
+    atom_t key;                     // ATOM_NULL with DOM_COLLECTION_TAG is "*"
+    atom_t* classes;                // DOM_COLLECTION_CLASS: each class listed in key
+    uint32_t class_count;
+    dom_element_t** elements;
+    uint32_t count;
+    uint32_t capacity;
+    uint64_t version;
+    bool valid;
+    uint32_t references;
+    uint64_t used;                  // Lookup that last returned it
+    dom_collection_t* next;
+};
+
+dom_collection_t* dom_node_get_collection(dom_node_t* root, dom_collection_kind_t kind, atom_t key);
+void dom_collection_release(dom_collection_t* collection);
+uint32_t dom_collection_length(dom_collection_t* collection);
+dom_element_t* dom_collection_item(dom_collection_t* collection, uint32_t index);
+
+// Index maintenance, which the DOM's mutation paths owe the index (none are
+// in this tree yet). dom_node_append_child, insert_before, remove_child
+// and replace_child report subtrees entering or leaving a connected tree;
+// dom_element_set_attribute and remove_attribute report id, name and class
+// changes with the old and new values (NULL when absent). Insertions are
+// reported once attached, removals before detaching. The first subtree
+// report indexes the whole document; until then lookups walk the tree, so
+// a document built without reporting still answers correctly, only
+// slower. Once reporting starts every mutation must be reported.
+//
+// A node is reported to dom_index_node_destroyed before its memory goes
+// back to the arena, which empties the collections rooted at it.
+// dom_document_destroy calls dom_index_destroy, which does the same for
+// all of the document's. An emptied collection holds nothing and is freed
+// by its last dom_collection_release.
+void dom_index_insert_subtree(dom_document_t* document, dom_node_t* node);
+void dom_index_remove_subtree(dom_document_t* document, dom_node_t* node);
+void dom_index_attribute_changed(dom_element_t* element, atom_t name, const char* old_value, const char* new_value);
+void dom_index_node_destroyed(dom_node_t* node);
+void dom_index_destroy(dom_document_t* document);
+
 // Shadow DOM
 dom_node_t* dom_element_attach_shadow(dom_element_t* element, bool open);
 dom_node_t* dom_element_get_shadow_root(dom_element_t* element);
@@ -195,12 +297,43 @@ typedef struct {
     dom_node_t* next_sibling;
 } dom_mutation_record_t;
 
+// Records are batched (html/mutation.c). A mutation nobody observes, e.g.
+// anywhere in a detached tree, is dropped before any record exists.
+// Otherwise it is coalesced into the observer's pending record for the
+// same target: consecutive child list changes merge their added and
+// removed nodes, and repeated attribute or text changes keep the oldest
+// old_value. Records come from a per-document pool and wait in a ring
+// buffer for each observer, so a steady stream of mutations does not
+// allocate.
+//
+// Observers with a callback get their records once per microtask
+// checkpoint: the first record queued after a delivery calls the
+// document's scheduler, which should queue a microtask that runs
+// dom_deliver_mutations. Records passed to a callback are released when
+// it returns. Observers without one are polled with dom_take_records.
+// An observer watches nodes of one document at a time.
 typedef void (*dom_mutation_callback_t)(dom_mutation_record_t** records, uint32_t count);
 
 void* dom_create_mutation_observer(dom_mutation_callback_t callback);
 void dom_observe_mutations(void* observer, dom_node_t* target, uint32_t options);
 void dom_disconnect_observer(void* observer);
 dom_mutation_record_t** dom_take_records(void* observer, uint32_t* count);
+void dom_mutation_records_destroy(dom_mutation_record_t** records, uint32_t count);
+
+void dom_set_mutation_scheduler(dom_document_t* document, void (*schedule)(void* data), void* data);
+void dom_deliver_mutations(dom_document_t* document);
+
+// Mutation reporting. dom_node_append_child, insert_before, remove_child,
+// replace_child and set_text_content report child list changes once the
+// tree reflects them; dom_element_set_attribute and remove_attribute, and
+// character data changes, report the old value (NULL when absent) before
+// it is released. A replacement is one call with both lists.
+// dom_document_destroy calls dom_mutation_queue_destroy, which detaches
+// the document's observers.
+void dom_mutation_child_list(dom_node_t* target, dom_node_t* const* added, uint32_t added_count, dom_node_t* const* removed, uint32_t removed_count, dom_node_t* previous_sibling, dom_node_t* next_sibling);
+void dom_mutation_attribute(dom_element_t* element, atom_t name, const char* old_value);
+void dom_mutation_character_data(dom_node_t* node, const char* old_value);
+void dom_mutation_queue_destroy(dom_document_t* document);
 
 // Events
 typedef enum {
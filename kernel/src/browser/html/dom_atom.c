@@ -0,0 +1,54 @@
+#include "dom.h"
+#include "arena.h"
+#include <string.h>
+
+dom_attribute_t* dom_element_get_attribute_node_atom(dom_element_t* element, atom_t name) {
+    if (!element || name == ATOM_NULL) return NULL;
+    
+    for (uint32_t i = 0; i < element->attribute_count; i++) {
+        if (element->attributes[i]->name_atom == name) {
+            return element->attributes[i];
+        }
+    }
+    return NULL;
+}
+
+char* dom_element_get_attribute_atom(dom_element_t* element, atom_t name) {
+    dom_attribute_t* attribute = dom_element_get_attribute_node_atom(element, name);
+    return attribute ? attribute->value : NULL;
+}
+
+bool dom_element_has_attribute_atom(dom_element_t* element, atom_t name) {
+    return dom_element_get_attribute_node_atom(element, name) != NULL;
+}
+
+bool dom_element_has_class_atom(dom_element_t* element, atom_t class_name) {
+    if (!element || !element->class_atoms || class_name == ATOM_NULL) return false;
+    
+    for (uint32_t i = 0; i < element->class_count; i++) {
+        if (element->class_atoms[i] == class_name) return true;
+    }
+    return false;
+}
+
+// Re-intern id and class names. A replaced class_atoms array stays in the
+// document arena until the document is destroyed.
+void dom_element_sync_atoms(dom_element_t* element) {
+    if (!element) return;
+    
+    element->id_atom = element->id ? atom_intern(element->id) : ATOM_NULL;
+    
+    element->class_atoms = NULL;
+    if (element->class_count == 0) return;
+    
+    dom_document_t* document = element->base.owner_document;
+    if (!document || !document->arena) return;
+    
+    atom_t* class_atoms = dom_arena_alloc(document->arena, element->class_count * sizeof(atom_t));
+    if (!class_atoms) return;
+    
+    for (uint32_t i = 0; i < element->class_count; i++) {
+        class_atoms[i] = atom_intern(element->class_list[i]);
+    }
+    element->class_atoms = class_atoms;
+}
@@ -0,0 +1,698 @@
+#include "dom.h"
+#include "../capacity.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define DOM_INDEX_INITIAL_SIZE 64
+#define DOM_COLLECTION_BUCKETS 128
+
+// Connected elements sharing one key
+typedef struct {
+    atom_t key;
+    dom_element_t** elements;
+    uint32_t count;
+    uint32_t capacity;
+    uint64_t version;
+} dom_index_entry_t;
+
+// Open-addressed key -> entry table. Entries are never deleted, so a
+// collection can compare the version it saw against the current one.
+typedef struct {
+    dom_index_entry_t* entries;
+    uint32_t mask;
+    uint32_t used;
+} dom_index_table_t;
+
+struct dom_index {
+    dom_index_table_t ids;
+    dom_index_table_t names;
+    dom_index_table_t classes;
+    
+    // Bumped whenever elements are connected or disconnected
+    uint64_t tree_version;
+    
+    // Set by the first subtree report. Until then the tables are empty and
+    // lookups walk the tree.
+    bool maintained;
+    
+    dom_collection_t* collections[DOM_COLLECTION_BUCKETS];
+    uint32_t collection_count;
+    uint32_t unreferenced;          // Cached collections nobody holds
+    uint64_t lookups;
+};
+
+static bool table_init(dom_index_table_t* table) {
+    table->entries = calloc(DOM_INDEX_INITIAL_SIZE, sizeof(dom_index_entry_t));
+    table->mask = DOM_INDEX_INITIAL_SIZE - 1;
+    table->used = 0;
+    return table->entries != NULL;
+}
+
+static void table_free(dom_index_table_t* table) {
+    if (!table->entries) return;
+    for (uint32_t i = 0; i <= table->mask; i++) {
+        free(table->entries[i].elements);
+    }
+    free(table->entries);
+    table->entries = NULL;
+}
+
+static dom_index_entry_t* table_find(dom_index_table_t* table, atom_t key) {
+    if (key == ATOM_NULL || !table->entries) return NULL;
+    
+    uint32_t index = key & table->mask;
+    while (table->entries[index].key != ATOM_NULL) {
+        if (table->entries[index].key == key) return &table->entries[index];
+        index = (index + 1) & table->mask;
+    }
+    return NULL;
+}
+
+static bool table_grow(dom_index_table_t* table) {
+    uint32_t new_size = (table->mask + 1) * 2;
+    dom_index_entry_t* new_entries = calloc(new_size, sizeof(dom_index_entry_t));
+    if (!new_entries) return false;
+    
+    for (uint32_t i = 0; i <= table->mask; i++) {
+        dom_index_entry_t* entry = &table->entries[i];
+        if (entry->key == ATOM_NULL) continue;
+        
+        uint32_t index = entry->key & (new_size - 1);
+        while (new_entries[index].key != ATOM_NULL) {
+            index = (index + 1) & (new_size - 1);
+        }
+        new_entries[index] = *entry;
+    }
+    
+    free(table->entries);
+    table->entries = new_entries;
+    table->mask = new_size - 1;
+    return true;
+}
+
+// Entry pointers are invalidated by the next table_get
+static dom_index_entry_t* table_get(dom_index_table_t* table, atom_t key) {
+    dom_index_entry_t* entry = table_find(table, key);
+    if (entry || key == ATOM_NULL) return entry;
+    
+    if ((table->used + 1) * 2 > table->mask + 1 && !table_grow(table)) return NULL;
+    
+    uint32_t index = key & table->mask;
+    while (table->entries[index].key != ATOM_NULL) {
+        index = (index + 1) & table->mask;
+    }
+    table->entries[index].key = key;
+    table->used++;
+    return &table->entries[index];
+}
+
+static void entry_add(dom_index_entry_t* entry, dom_element_t* element) {
+    if (entry->count >= entry->capacity) {
+        uint32_t new_capacity = capacity_grow(entry->capacity, 4, sizeof(dom_element_t*));
+        dom_element_t** new_elements = new_capacity ? realloc(entry->elements, new_capacity * sizeof(dom_element_t*)) : NULL;
+        if (!new_elements) return;
+        entry->elements = new_elements;
+        entry->capacity = new_capacity;
+    }
+    
+    entry->elements[entry->count++] = element;
+    entry->version++;
+}
+
+// Order is not kept; collections sort into tree order when rebuilt
+static void entry_remove(dom_index_entry_t* entry, dom_element_t* element) {
+    for (uint32_t i = entry->count; i > 0; i--) {
+        if (entry->elements[i - 1] == element) {
+            entry->elements[i - 1] = entry->elements[--entry->count];
+            entry->version++;
+            return;
+        }
+    }
+}
+
+static void table_update(dom_index_table_t* table, atom_t key, dom_element_t* element, bool add) {
+    if (key == ATOM_NULL) return;
+    
+    if (add) {
+        dom_index_entry_t* entry = table_get(table, key);
+        if (entry) entry_add(entry, element);
+    } else {
+        dom_index_entry_t* entry = table_find(table, key);
+        if (entry) entry_remove(entry, element);
+    }
+}
+
+static bool is_class_space(char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\f' || c == '\r';
+}
+
+// Apply each class in a class attribute value
+static void table_update_classes(dom_index_table_t* table, const char* value, dom_element_t* element, bool add) {
+    if (!value) return;
+    
+    const char* p = value;
+    while (*p) {
+        while (*p && is_class_space(*p)) p++;
+        const char* start = p;
+        while (*p && !is_class_space(*p)) p++;
+        if (p == start) break;
+        
+        // Only interned names can already be in the table
+        uint32_t length = (uint32_t)(p - start);
+        atom_t atom = add ? atom_intern_len(start, length) : atom_lookup_len(start, length);
+        table_update(table, atom, element, add);
+    }
+}
+
+static atom_t value_atom(const char* value, bool add) {
+    if (!value) return ATOM_NULL;
+    return add ? atom_intern(value) : atom_lookup(value);
+}
+
+static struct dom_index* index_get(dom_document_t* document) {
+    if (!document) return NULL;
+    if (document->index) return document->index;
+    
+    struct dom_index* index = calloc(1, sizeof(struct dom_index));
+    if (!index) return NULL;
+    
+    if (!table_init(&index->ids) || !table_init(&index->names) || !table_init(&index->classes)) {
+        table_free(&index->ids);
+        table_free(&index->names);
+        table_free(&index->classes);
+        free(index);
+        return NULL;
+    }
+    
+    document->index = index;
+    return index;
+}
+
+static void index_element(struct dom_index* index, dom_element_t* element, bool add) {
+    table_update(&index->ids, value_atom(element->id, add), element, add);
+    table_update(&index->names, value_atom(dom_element_get_attribute_atom(element, ATOM_name), add), element, add);
+    table_update_classes(&index->classes, dom_element_get_attribute_atom(element, ATOM_class), element, add);
+}
+
+static bool node_is_connected(dom_node_t* node) {
+    while (node->parent_node) {
+        node = node->parent_node;
+    }
+    return node->type == NODE_DOCUMENT;
+}
+
+// Preorder successor of node within the subtree at root
+static dom_node_t* next_in_subtree(dom_node_t* node, dom_node_t* root) {
+    if (node->first_child) return node->first_child;
+    
+    while (node && node != root) {
+        if (node->next_sibling) return node->next_sibling;
+        node = node->parent_node;
+    }
+    return NULL;
+}
+
+// Indexes the whole document, so that the tables are complete however the
+// tree was built before reporting began
+static void index_populate(dom_document_t* document, struct dom_index* index) {
+    dom_node_t* root = (dom_node_t*)document;
+    for (dom_node_t* current = root; current; current = next_in_subtree(current, root)) {
+        if (current->type == NODE_ELEMENT) {
+            index_element(index, (dom_element_t*)current, true);
+        }
+    }
+    index->tree_version++;
+    index->maintained = true;
+}
+
+static void index_subtree(dom_document_t* document, dom_node_t* node, bool add) {
+    if (!document || !node || !node_is_connected(node)) return;
+    
+    struct dom_index* index = index_get(document);
+    if (!index) return;
+    
+    // An inserted subtree is already attached, so populating covers it
+    if (!index->maintained) {
+        index_populate(document, index);
+        if (add) return;
+    }
+    
+    for (dom_node_t* current = node; current; current = next_in_subtree(current, node)) {
+        if (current->type == NODE_ELEMENT) {
+            index_element(index, (dom_element_t*)current, add);
+        }
+    }
+    index->tree_version++;
+}
+
+// Call after the subtree is attached
+void dom_index_insert_subtree(dom_document_t* document, dom_node_t* node) {
+    index_subtree(document, node, true);
+}
+
+// Call before the subtree is detached
+void dom_index_remove_subtree(dom_document_t* document, dom_node_t* node) {
+    index_subtree(document, node, false);
+}
+
+void dom_index_attribute_changed(dom_element_t* element, atom_t name, const char* old_value, const char* new_value) {
+    if (!element || (name != ATOM_id && name != ATOM_name && name != ATOM_class)) return;
+    if (!node_is_connected((dom_node_t*)element)) return;
+    
+    // Before the first subtree report there is nothing to update
+    dom_document_t* document = element->base.owner_document;
+    struct dom_index* index = document ? document->index : NULL;
+    if (!index || !index->maintained) return;
+    
+    if (name == ATOM_class) {
+        table_update_classes(&index->classes, old_value, element, false);
+        table_update_classes(&index->classes, new_value, element, true);
+    } else {
+        dom_index_table_t* table = name == ATOM_id ? &index->ids : &index->names;
+        table_update(table, value_atom(old_value, false), element, false);
+        table_update(table, value_atom(new_value, true), element, true);
+    }
+}
+
+static void collection_free(dom_collection_t* collection) {
+    free(collection->classes);
+    free(collection->elements);
+    free(collection);
+}
+
+// Frees an uncached collection, or leaves a referenced one empty and
+// rootless for its last dom_collection_release to free
+static void collection_orphan(dom_collection_t* collection) {
+    if (collection->references == 0) {
+        collection_free(collection);
+        return;
+    }
+    collection->root = NULL;
+    collection->count = 0;
+    collection->next = NULL;
+}
+
+void dom_index_destroy(dom_document_t* document) {
+    if (!document || !document->index) return;
+    
+    struct dom_index* index = document->index;
+    table_free(&index->ids);
+    table_free(&index->names);
+    table_free(&index->classes);
+    
+    for (uint32_t i = 0; i < DOM_COLLECTION_BUCKETS; i++) {
+        dom_collection_t* collection = index->collections[i];
+        while (collection) {
+            dom_collection_t* next = collection->next;
+            collection_orphan(collection);
+            collection = next;
+        }
+    }
+    
+    free(index);
+    document->index = NULL;
+}
+
+// Tree order comparison for qsort over dom_element_t* arrays
+static int tree_order_compare(const void* a, const void* b) {
+    dom_node_t* x = *(dom_node_t* const*)a;
+    dom_node_t* y = *(dom_node_t* const*)b;
+    if (x == y) return 0;
+    
+    uint32_t depth_x = 0, depth_y = 0;
+    for (dom_node_t* n = x->parent_node; n; n = n->parent_node) depth_x++;
+    for (dom_node_t* n = y->parent_node; n; n = n->parent_node) depth_y++;
+    
+    // An ancestor precedes its descendants
+    while (depth_x > depth_y) {
+        x = x->parent_node;
+        depth_x--;
+        if (x == y) return 1;
+    }
+    while (depth_y > depth_x) {
+        y = y->parent_node;
+        depth_y--;
+        if (y == x) return -1;
+    }
+    
+    while (x->parent_node != y->parent_node) {
+        x = x->parent_node;
+        y = y->parent_node;
+    }
+    
+    for (dom_node_t* sibling = x->next_sibling; sibling; sibling = sibling->next_sibling) {
+        if (sibling == y) return -1;
+    }
+    return 1;
+}
+
+static bool node_is_descendant(dom_node_t* node, dom_node_t* root) {
+    for (dom_node_t* n = node->parent_node; n; n = n->parent_node) {
+        if (n == root) return true;
+    }
+    return false;
+}
+
+static bool collection_matches(dom_collection_t* collection, dom_element_t* element) {
+    switch (collection->kind) {
+        case DOM_COLLECTION_TAG:
+            return collection->key == ATOM_NULL || element->tag_atom == collection->key;
+        case DOM_COLLECTION_CLASS:
+            for (uint32_t i = 0; i < collection->class_count; i++) {
+                if (!dom_element_has_class_atom(element, collection->classes[i])) return false;
+            }
+            return collection->class_count > 0;
+        case DOM_COLLECTION_NAME:
+            return collection->key != ATOM_NULL &&
+                   atom_lookup(dom_element_get_attribute_atom(element, ATOM_name)) == collection->key;
+    }
+    return false;
+}
+
+static void collection_push(dom_collection_t* collection, dom_element_t* element) {
+    if (collection->count >= collection->capacity) {
+        uint32_t new_capacity = capacity_grow(collection->capacity, 16, sizeof(dom_element_t*));
+        dom_element_t** new_elements = new_capacity ? realloc(collection->elements, new_capacity * sizeof(dom_element_t*)) : NULL;
+        if (!new_elements) return;
+        collection->elements = new_elements;
+        collection->capacity = new_capacity;
+    }
+    collection->elements[collection->count++] = element;
+}
+
+// The index entry to gather from. version is set to what the contents
+// depend on; entry versions only grow, so a sum of them changes whenever
+// any one does.
+static dom_index_entry_t* collection_entry(struct dom_index* index, dom_collection_t* collection, uint64_t* version) {
+    *version = 0;
+    if (collection->kind == DOM_COLLECTION_TAG) {
+        *version = index->tree_version;
+        return NULL;
+    }
+    if (collection->kind == DOM_COLLECTION_NAME) {
+        dom_index_entry_t* entry = table_find(&index->names, collection->key);
+        if (entry) *version = entry->version;
+        return entry;
+    }
+    
+    // Gather from the rarest class; one that no element has leaves nothing
+    dom_index_entry_t* rarest = NULL;
+    bool missing = collection->class_count == 0;
+    for (uint32_t i = 0; i < collection->class_count; i++) {
+        dom_index_entry_t* entry = table_find(&index->classes, collection->classes[i]);
+        if (!entry) {
+            missing = true;
+            continue;
+        }
+        *version += entry->version;
+        if (!rarest || entry->count < rarest->count) rarest = entry;
+    }
+    return missing ? NULL : rarest;
+}
+
+// Rebuild the collection if anything it depends on has changed
+static void collection_refresh(dom_collection_t* collection) {
+    dom_node_t* root = collection->root;
+    if (!root) return;
+    
+    dom_document_t* document = root->type == NODE_DOCUMENT ? (dom_document_t*)root : root->owner_document;
+    struct dom_index* index = document ? document->index : NULL;
+    bool connected = index && index->maintained && node_is_connected(root);
+    
+    dom_index_entry_t* entry = NULL;
+    uint64_t version = 0;
+    if (connected) {
+        entry = collection_entry(index, collection, &version);
+        if (collection->valid && collection->version == version) return;
+    }
+    
+    collection->count = 0;
+    
+    if (connected && collection->kind != DOM_COLLECTION_TAG) {
+        // Gather from the index and put into tree order
+        if (entry) {
+            for (uint32_t i = 0; i < entry->count; i++) {
+                dom_element_t* element = entry->elements[i];
+                if (root->type != NODE_DOCUMENT && !node_is_descendant((dom_node_t*)element, root)) continue;
+                if (collection->class_count > 1 && !collection_matches(collection, element)) continue;
+                collection_push(collection, element);
+            }
+        }
+        if (collection->count > 1) qsort(collection->elements, collection->count, sizeof(dom_element_t*), tree_order_compare);
+        
+        // A class listed twice in one attribute is indexed twice
+        uint32_t unique = 0;
+        for (uint32_t i = 0; i < collection->count; i++) {
+            if (unique == 0 || collection->elements[unique - 1] != collection->elements[i]) {
+                collection->elements[unique++] = collection->elements[i];
+            }
+        }
+        collection->count = unique;
+    } else {
+        // Tag lists, detached subtrees and documents not yet reported are
+        // gathered by walking
+        for (dom_node_t* node = root->first_child; node; node = next_in_subtree(node, root)) {
+            if (node->type == NODE_ELEMENT && collection_matches(collection, (dom_element_t*)node)) {
+                collection_push(collection, (dom_element_t*)node);
+            }
+        }
+    }
+    
+    // Without an index there is nothing to validate against
+    collection->version = version;
+    collection->valid = connected;
+}
+
+static struct dom_index* collection_index(dom_node_t* root) {
+    if (!root) return NULL;
+    dom_document_t* document = root->type == NODE_DOCUMENT ? (dom_document_t*)root : root->owner_document;
+    return document ? document->index : NULL;
+}
+
+// The classes in a class key, each of which must be interned to match
+static bool collection_parse_classes(dom_collection_t* collection) {
+    const char* value = atom_string(collection->key);
+    if (!value) return true;
+    
+    uint32_t capacity = 0;
+    for (const char* p = value; *p; p++) {
+        if (!is_class_space(*p) && (p == value || is_class_space(p[-1]))) capacity++;
+    }
+    if (capacity == 0) return true;
+    
+    collection->classes = malloc(capacity * sizeof(atom_t));
+    if (!collection->classes) return false;
+    
+    const char* p = value;
+    while (*p) {
+        while (*p && is_class_space(*p)) p++;
+        const char* start = p;
+        while (*p && !is_class_space(*p)) p++;
+        if (p == start) break;
+        collection->classes[collection->class_count++] = atom_lookup_len(start, (uint32_t)(p - start));
+    }
+    return true;
+}
+
+// Evict the unreferenced collections the last DOM_COLLECTION_CACHE_LIMIT / 2
+// lookups did not return
+static void index_trim_collections(struct dom_index* index) {
+    if (index->unreferenced <= DOM_COLLECTION_CACHE_LIMIT) return;
+    
+    for (uint32_t i = 0; i < DOM_COLLECTION_BUCKETS; i++) {
+        dom_collection_t** link = &index->collections[i];
+        while (*link) {
+            dom_collection_t* collection = *link;
+            if (collection->references == 0 && collection->used + DOM_COLLECTION_CACHE_LIMIT / 2 <= index->lookups) {
+                *link = collection->next;
+                collection_free(collection);
+                index->collection_count--;
+                index->unreferenced--;
+            } else {
+                link = &collection->next;
+            }
+        }
+    }
+}
+
+// Finds or creates the cached collection, without taking a reference
+static dom_collection_t* collection_lookup(dom_node_t* root, dom_collection_kind_t kind, atom_t key) {
+    if (!root) return NULL;
+    
+    dom_document_t* document = root->type == NODE_DOCUMENT ? (dom_document_t*)root : root->owner_document;
+    struct dom_index* index = index_get(document);
+    if (!index) return NULL;
+    
+    uintptr_t hash = ((uintptr_t)root >> 4) ^ ((uintptr_t)key * 2654435761u) ^ (uintptr_t)kind;
+    dom_collection_t** bucket = &index->collections[hash % DOM_COLLECTION_BUCKETS];
+    
+    for (dom_collection_t* collection = *bucket; collection; collection = collection->next) {
+        if (collection->root == root && collection->kind == kind && collection->key == key) {
+            collection->used = ++index->lookups;
+            collection_refresh(collection);
+            return collection;
+        }
+    }
+    
+    index_trim_collections(index);
+    
+    dom_collection_t* collection = calloc(1, sizeof(dom_collection_t));
+    if (!collection) return NULL;
+    
+    collection->root = root;
+    collection->kind = kind;
+    collection->key = key;
+    if (kind == DOM_COLLECTION_CLASS && !collection_parse_classes(collection)) {
+        free(collection);
+        return NULL;
+    }
+    collection->used = ++index->lookups;
+    collection->next = *bucket;
+    *bucket = collection;
+    index->collection_count++;
+    index->unreferenced++;
+    
+    collection_refresh(collection);
+    return collection;
+}
+
+dom_collection_t* dom_node_get_collection(dom_node_t* root, dom_collection_kind_t kind, atom_t key) {
+    dom_collection_t* collection = collection_lookup(root, kind, key);
+    if (!collection) return NULL;
+    
+    if (collection->references++ == 0) collection_index(root)->unreferenced--;
+    return collection;
+}
+
+// The collection stays cached, now subject to eviction, unless its root is
+// gone
+void dom_collection_release(dom_collection_t* collection) {
+    if (!collection || collection->references == 0) return;
+    
+    if (!collection->root) {
+        if (--collection->references == 0) collection_free(collection);
+        return;
+    }
+    struct dom_index* index = collection_index(collection->root);
+    if (--collection->references == 0 && index) index->unreferenced++;
+}
+
+// Cached collections are found by root address, which the arena hands out
+// again, so none may outlive its root
+void dom_index_node_destroyed(dom_node_t* node) {
+    if (!node || node->type == NODE_DOCUMENT) return;
+    
+    struct dom_index* index = collection_index(node);
+    if (!index || index->collection_count == 0) return;
+    
+    for (uint32_t i = 0; i < DOM_COLLECTION_BUCKETS; i++) {
+        dom_collection_t** link = &index->collections[i];
+        while (*link) {
+            dom_collection_t* collection = *link;
+            if (collection->root != node) {
+                link = &collection->next;
+                continue;
+            }
+            *link = collection->next;
+            index->collection_count--;
+            if (collection->references == 0) index->unreferenced--;
+            collection_orphan(collection);
+        }
+    }
+}
+
+uint32_t dom_collection_length(dom_collection_t* collection) {
+    if (!collection) return 0;
+    collection_refresh(collection);
+    return collection->count;
+}
+
+dom_element_t* dom_collection_item(dom_collection_t* collection, uint32_t index) {
+    if (!collection) return NULL;
+    collection_refresh(collection);
+    return index < collection->count ? collection->elements[index] : NULL;
+}
+
+dom_element_t* dom_element_get_by_id_atom(dom_document_t* document, atom_t id) {
+    if (!document || id == ATOM_NULL) return NULL;
+    
+    // Unreported documents are searched in tree order
+    if (!document->index || !document->index->maintained) {
+        const char* value = atom_string(id);
+        dom_node_t* root = (dom_node_t*)document;
+        for (dom_node_t* node = root->first_child; value && node; node = next_in_subtree(node, root)) {
+            if (node->type != NODE_ELEMENT) continue;
+            dom_element_t* element = (dom_element_t*)node;
+            if (element->id && strcmp(element->id, value) == 0) return element;
+        }
+        return NULL;
+    }
+    
+    dom_index_entry_t* entry = table_find(&document->index->ids, id);
+    if (!entry || entry->count == 0) return NULL;
+    
+    // Duplicate ids resolve to the first in tree order
+    dom_element_t* first = entry->elements[0];
+    for (uint32_t i = 1; i < entry->count; i++) {
+        if (tree_order_compare(&entry->elements[i], &first) < 0) {
+            first = entry->elements[i];
+        }
+    }
+    return first;
+}
+
+dom_element_t* dom_element_get_by_id(dom_document_t* document, const char* id) {
+    if (!id) return NULL;
+    return dom_element_get_by_id_atom(document, atom_lookup(id));
+}
+
+static dom_element_t** collection_array(dom_node_t* root, dom_collection_kind_t kind, atom_t key, uint32_t* count) {
+    dom_collection_t* collection = collection_lookup(root, kind, key);
+    if (count) *count = collection ? collection->count : 0;
+    return collection ? collection->elements : NULL;
+}
+
+dom_element_t** dom_element_get_by_tag_name(dom_element_t* element, const char* tag_name, uint32_t* count) {
+    if (count) *count = 0;
+    if (!element || !tag_name) return NULL;
+    
+    atom_t key = ATOM_NULL;
+    if (strcmp(tag_name, "*") != 0) {
+        key = atom_lookup_lower(tag_name, (uint32_t)strlen(tag_name));
+        if (key == ATOM_NULL) return NULL;
+    }
+    return collection_array((dom_node_t*)element, DOM_COLLECTION_TAG, key, count);
+}
+
+dom_element_t** dom_element_get_by_class_name(dom_element_t* element, const char* class_name, uint32_t* count) {
+    if (count) *count = 0;
+    if (!element || !class_name) return NULL;
+    
+    // A single class is its own key; a list is keyed by its text once every
+    // class in it is known
+    atom_t key = ATOM_NULL;
+    uint32_t classes = 0;
+    const char* p = class_name;
+    while (*p) {
+        while (*p && is_class_space(*p)) p++;
+        const char* start = p;
+        while (*p && !is_class_space(*p)) p++;
+        if (p == start) break;
+        
+        key = atom_lookup_len(start, (uint32_t)(p - start));
+        if (key == ATOM_NULL) return NULL;
+        classes++;
+    }
+    if (classes == 0) return NULL;
+    if (classes > 1) key = atom_intern(class_name);
+    return collection_array((dom_node_t*)element, DOM_COLLECTION_CLASS, key, count);
+}
+
+dom_element_t** dom_document_get_by_name(dom_document_t* document, const char* name, uint32_t* count) {
+    if (count) *count = 0;
+    if (!document || !name) return NULL;
+    
+    atom_t key = atom_lookup(name);
+    if (key == ATOM_NULL) return NULL;
+    return collection_array((dom_node_t*)document, DOM_COLLECTION_NAME, key, count);
+}
@@ -0,0 +1,478 @@
+#include "dom.h"
+#include "../capacity.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define MUTATION_RING_INITIAL 16
+#define MUTATION_POOL_MAX 1024          // Free records kept per document
+#define MUTATION_COALESCE_WINDOW 8      // Pending records searched for a match
+
+struct mutation_queue;
+
+// Pooled record. The arrays and old value buffer keep their capacity
+// across reuse.
+typedef struct mutation_record {
+    dom_mutation_record_t record;   // First, so records convert back
+    struct mutation_queue* queue;
+    uint32_t added_capacity;
+    uint32_t removed_capacity;
+    char* old_value_buffer;         // record.old_value points here, if set
+    uint32_t old_value_capacity;
+    struct mutation_record* next_free;
+} mutation_record_t;
+
+typedef struct {
+    dom_node_t* node;
+    uint32_t options;
+} mutation_registration_t;
+
+typedef struct mutation_observer {
+    dom_mutation_callback_t callback;
+    struct mutation_queue* queue;   // NULL until it observes a node
+    
+    mutation_registration_t* registrations;
+    uint32_t registration_count;
+    uint32_t registration_capacity;
+    
+    // Pending records, oldest first
+    mutation_record_t** ring;
+    uint32_t ring_capacity;         // Zero or a power of two
+    uint32_t head;
+    uint32_t count;
+    
+    bool disconnected;              // Freed once delivery returns
+    struct mutation_observer* next;
+} mutation_observer_t;
+
+typedef struct mutation_queue {
+    dom_document_t* document;       // NULL once the document is gone
+    mutation_observer_t* observers;
+    uint32_t registration_count;
+    
+    mutation_record_t* free_records;
+    uint32_t free_count;
+    uint32_t outstanding;           // Records not in the pool
+    
+    void (*schedule)(void* data);
+    void* schedule_data;
+    bool scheduled;
+    bool delivering;
+} mutation_queue_t;
+
+// Queue and pool
+
+static mutation_queue_t* queue_for_document(dom_document_t* document) {
+    if (!document) return NULL;
+    if (document->mutation_observers) return document->mutation_observers;
+    
+    mutation_queue_t* queue = calloc(1, sizeof(mutation_queue_t));
+    if (!queue) return NULL;
+    queue->document = document;
+    document->mutation_observers = queue;
+    return queue;
+}
+
+static dom_document_t* document_of(dom_node_t* node) {
+    return node->type == NODE_DOCUMENT ? (dom_document_t*)node : node->owner_document;
+}
+
+static void record_free(mutation_record_t* record) {
+    free(record->record.added_nodes);
+    free(record->record.removed_nodes);
+    free(record->old_value_buffer);
+    free(record);
+}
+
+static void queue_free(mutation_queue_t* queue) {
+    while (queue->free_records) {
+        mutation_record_t* record = queue->free_records;
+        queue->free_records = record->next_free;
+        record_free(record);
+    }
+    free(queue);
+}
+
+static mutation_record_t* record_alloc(mutation_queue_t* queue) {
+    mutation_record_t* record = queue->free_records;
+    if (record) {
+        queue->free_records = record->next_free;
+        queue->free_count--;
+    } else {
+        record = calloc(1, sizeof(mutation_record_t));
+        if (!record) return NULL;
+        record->queue = queue;
+    }
+    queue->outstanding++;
+    return record;
+}
+
+static void record_release(mutation_record_t* record) {
+    mutation_queue_t* queue = record->queue;
+    queue->outstanding--;
+    if (!queue->document) {
+        // A delivery in progress frees the queue once it returns
+        record_free(record);
+        if (queue->outstanding == 0 && !queue->delivering) queue_free(queue);
+        return;
+    }
+    if (queue->free_count >= MUTATION_POOL_MAX) {
+        record_free(record);
+        return;
+    }
+    
+    dom_mutation_record_t* fields = &record->record;
+    fields->target = NULL;
+    fields->attribute_name = NULL;
+    fields->attribute_namespace = NULL;
+    fields->added_count = 0;
+    fields->removed_count = 0;
+    fields->previous_sibling = NULL;
+    fields->next_sibling = NULL;
+    fields->old_value = NULL;
+    record->next_free = queue->free_records;
+    queue->free_records = record;
+    queue->free_count++;
+}
+
+// Record contents
+
+static bool append_nodes(dom_node_t*** nodes, uint32_t* count, uint32_t* capacity, dom_node_t* const* added, uint32_t added_count) {
+    if (!added_count) return true;
+    if ((uint64_t)*count + added_count > *capacity) {
+        uint32_t grown = capacity_reserve(*capacity, (uint64_t)*count + added_count, 4, sizeof(dom_node_t*));
+        dom_node_t** array = grown ? realloc(*nodes, grown * sizeof(dom_node_t*)) : NULL;
+        if (!array) return false;
+        *nodes = array;
+        *capacity = grown;
+    }
+    memcpy(*nodes + *count, added, added_count * sizeof(dom_node_t*));
+    *count += added_count;
+    return true;
+}
+
+// attribute_name and attribute_namespace point at atoms; old_value is
+// copied into the record's own buffer, since the DOM releases it
+static bool set_old_value(mutation_record_t* record, const char* old_value) {
+    record->record.old_value = NULL;
+    if (!old_value) return true;
+    
+    size_t length = strlen(old_value);
+    if (length >= record->old_value_capacity) {
+        uint32_t capacity = capacity_reserve(record->old_value_capacity, (uint64_t)length + 1, 32, 1);
+        char* buffer = capacity ? realloc(record->old_value_buffer, capacity) : NULL;
+        if (!buffer) return false;
+        record->old_value_buffer = buffer;
+        record->old_value_capacity = capacity;
+    }
+    memcpy(record->old_value_buffer, old_value, length + 1);
+    record->record.old_value = record->old_value_buffer;
+    return true;
+}
+
+// Observers
+
+static bool observer_push(mutation_observer_t* observer, mutation_record_t* record) {
+    if (observer->count == observer->ring_capacity) {
+        uint32_t capacity = capacity_grow(observer->ring_capacity, MUTATION_RING_INITIAL, sizeof(mutation_record_t*));
+        mutation_record_t** ring = capacity ? malloc(capacity * sizeof(mutation_record_t*)) : NULL;
+        if (!ring) return false;
+        for (uint32_t i = 0; i < observer->count; i++) {
+            ring[i] = observer->ring[(observer->head + i) & (observer->ring_capacity - 1)];
+        }
+        free(observer->ring);
+        observer->ring = ring;
+        observer->ring_capacity = capacity;
+        observer->head = 0;
+    }
+    observer->ring[(observer->head + observer->count) & (observer->ring_capacity - 1)] = record;
+    observer->count++;
+    return true;
+}
+
+static mutation_record_t* observer_pending(const mutation_observer_t* observer, uint32_t age) {
+    return observer->ring[(observer->head + observer->count - 1 - age) & (observer->ring_capacity - 1)];
+}
+
+static void observer_clear(mutation_observer_t* observer) {
+    while (observer->count > 0) {
+        mutation_record_t* record = observer->ring[observer->head];
+        observer->head = (observer->head + 1) & (observer->ring_capacity - 1);
+        observer->count--;
+        record_release(record);
+    }
+}
+
+// Whether a registration on target or, with MUTATION_SUBTREE, on one of
+// its ancestors asks for type
+static bool observer_covers(const mutation_observer_t* observer, const dom_node_t* target, uint32_t type) {
+    for (const dom_node_t* node = target; node; node = node->parent_node) {
+        for (uint32_t i = 0; i < observer->registration_count; i++) {
+            const mutation_registration_t* registration = &observer->registrations[i];
+            if (registration->node != node || !(registration->options & type)) continue;
+            if (node == target || (registration->options & MUTATION_SUBTREE)) return true;
+        }
+    }
+    return false;
+}
+
+// The observer's pending record this mutation can merge into. Child
+// list changes only merge with the newest, as their order matters;
+// attribute and text changes keep the oldest old value either way.
+static mutation_record_t* find_coalescable(const mutation_observer_t* observer, const dom_node_t* target, uint32_t type, const char* attribute_name) {
+    uint32_t window = type == MUTATION_CHILD_LIST ? 1 : MUTATION_COALESCE_WINDOW;
+    for (uint32_t age = 0; age < observer->count && age < window; age++) {
+        mutation_record_t* record = observer_pending(observer, age);
+        if (record->record.target != target || record->record.type != type) continue;
+        if (type == MUTATION_ATTRIBUTES && record->record.attribute_name != attribute_name) continue;
+        return record;
+    }
+    return NULL;
+}
+
+static void schedule_delivery(mutation_queue_t* queue, const mutation_observer_t* observer) {
+    if (!observer->callback || queue->scheduled || !queue->schedule) return;
+    queue->scheduled = true;
+    queue->schedule(queue->schedule_data);
+}
+
+// Mutation reporting
+
+// The queue of target's document, or NULL when nothing could observe it
+static mutation_queue_t* observed_queue(dom_node_t* target) {
+    if (!target) return NULL;
+    dom_document_t* document = document_of(target);
+    mutation_queue_t* queue = document ? document->mutation_observers : NULL;
+    return queue && queue->registration_count ? queue : NULL;
+}
+
+void dom_mutation_child_list(dom_node_t* target, dom_node_t* const* added, uint32_t added_count, dom_node_t* const* removed, uint32_t removed_count, dom_node_t* previous_sibling, dom_node_t* next_sibling) {
+    mutation_queue_t* queue = observed_queue(target);
+    if (!queue || (!added_count && !removed_count)) return;
+    
+    for (mutation_observer_t* observer = queue->observers; observer; observer = observer->next) {
+        if (observer->disconnected || !observer_covers(observer, target, MUTATION_CHILD_LIST)) continue;
+        
+        mutation_record_t* record = find_coalescable(observer, target, MUTATION_CHILD_LIST, NULL);
+        bool merged = record != NULL;
+        if (!merged) {
+            record = record_alloc(queue);
+            if (!record) continue;
+            record->record.target = target;
+            record->record.type = MUTATION_CHILD_LIST;
+            record->record.previous_sibling = previous_sibling;
+        }
+        record->record.next_sibling = next_sibling;
+        
+        bool stored = append_nodes(&record->record.added_nodes, &record->record.added_count, &record->added_capacity, added, added_count) &&
+                      append_nodes(&record->record.removed_nodes, &record->record.removed_count, &record->removed_capacity, removed, removed_count);
+        if (!merged && (!stored || !observer_push(observer, record))) {
+            record_release(record);
+            continue;
+        }
+        schedule_delivery(queue, observer);
+    }
+}
+
+// New records for the observers that want type, or an old value kept
+// in a pending one
+static void report_value_change(dom_node_t* target, uint32_t type, const char* attribute_name, const char* old_value) {
+    mutation_queue_t* queue = observed_queue(target);
+    if (!queue) return;
+    
+    for (mutation_observer_t* observer = queue->observers; observer; observer = observer->next) {
+        if (observer->disconnected || !observer_covers(observer, target, type)) continue;
+        if (find_coalescable(observer, target, type, attribute_name)) continue;
+        
+        mutation_record_t* record = record_alloc(queue);
+        if (!record) continue;
+        record->record.target = target;
+        record->record.type = type;
+        record->record.attribute_name = (char*)attribute_name;
+        if (!set_old_value(record, old_value) || !observer_push(observer, record)) {
+            record_release(record);
+            continue;
+        }
+        schedule_delivery(queue, observer);
+    }
+}
+
+void dom_mutation_attribute(dom_element_t* element, atom_t name, const char* old_value) {
+    if (!element || name == ATOM_NULL) return;
+    report_value_change(&element->base, MUTATION_ATTRIBUTES, atom_string(name), old_value);
+}
+
+void dom_mutation_character_data(dom_node_t* node, const char* old_value) {
+    report_value_change(node, MUTATION_CHARACTER_DATA, NULL, old_value);
+}
+
+// Observer API
+
+void* dom_create_mutation_observer(dom_mutation_callback_t callback) {
+    mutation_observer_t* observer = calloc(1, sizeof(mutation_observer_t));
+    if (!observer) return NULL;
+    observer->callback = callback;
+    return observer;
+}
+
+static void observer_detach(mutation_observer_t* observer) {
+    mutation_queue_t* queue = observer->queue;
+    if (!queue) return;
+    
+    observer_clear(observer);
+    queue->registration_count -= observer->registration_count;
+    observer->registration_count = 0;
+    for (mutation_observer_t** link = &queue->observers; *link; link = &(*link)->next) {
+        if (*link == observer) {
+            *link = observer->next;
+            break;
+        }
+    }
+    observer->queue = NULL;
+    observer->next = NULL;
+}
+
+// Observing a node again replaces its options. Nodes of another document
+// move the observer over, dropping what it watched before.
+void dom_observe_mutations(void* handle, dom_node_t* target, uint32_t options) {
+    mutation_observer_t* observer = handle;
+    if (!observer || !target || observer->disconnected) return;
+    
+    mutation_queue_t* queue = queue_for_document(document_of(target));
+    if (!queue) return;
+    if (observer->queue != queue) {
+        observer_detach(observer);
+        observer->queue = queue;
+        observer->next = queue->observers;
+        queue->observers = observer;
+    }
+    
+    for (uint32_t i = 0; i < observer->registration_count; i++) {
+        if (observer->registrations[i].node == target) {
+            observer->registrations[i].options = options;
+            return;
+        }
+    }
+    if (observer->registration_count == observer->registration_capacity) {
+        uint32_t capacity = capacity_grow(observer->registration_capacity, 4, sizeof(mutation_registration_t));
+        mutation_registration_t* registrations = capacity ? realloc(observer->registrations, capacity * sizeof(mutation_registration_t)) : NULL;
+        if (!registrations) return;
+        observer->registrations = registrations;
+        observer->registration_capacity = capacity;
+    }
+    observer->registrations[observer->registration_count++] = (mutation_registration_t){ target, options };
+    queue->registration_count++;
+}
+
+static void observer_free(mutation_observer_t* observer) {
+    free(observer->registrations);
+    free(observer->ring);
+    free(observer);
+}
+
+void dom_disconnect_observer(void* handle) {
+    mutation_observer_t* observer = handle;
+    if (!observer || observer->disconnected) return;
+    
+    mutation_queue_t* queue = observer->queue;
+    if (queue && queue->delivering) {
+        // Its callback may be running; delivery frees it afterwards
+        observer_clear(observer);
+        queue->registration_count -= observer->registration_count;
+        observer->registration_count = 0;
+        observer->disconnected = true;
+        return;
+    }
+    observer_detach(observer);
+    observer_free(observer);
+}
+
+// One array for the batch; the records go back to the pool with
+// dom_mutation_records_destroy
+dom_mutation_record_t** dom_take_records(void* handle, uint32_t* count) {
+    mutation_observer_t* observer = handle;
+    if (count) *count = 0;
+    if (!observer || observer->count == 0) return NULL;
+    
+    dom_mutation_record_t** records = malloc(observer->count * sizeof(dom_mutation_record_t*));
+    if (!records) return NULL;
+    uint32_t taken = 0;
+    while (observer->count > 0) {
+        records[taken++] = &observer->ring[observer->head]->record;
+        observer->head = (observer->head + 1) & (observer->ring_capacity - 1);
+        observer->count--;
+    }
+    if (count) *count = taken;
+    return records;
+}
+
+void dom_mutation_records_destroy(dom_mutation_record_t** records, uint32_t count) {
+    if (!records) return;
+    for (uint32_t i = 0; i < count; i++) {
+        if (records[i]) record_release((mutation_record_t*)records[i]);
+    }
+    free(records);
+}
+
+// Delivery
+
+void dom_set_mutation_scheduler(dom_document_t* document, void (*schedule)(void* data), void* data) {
+    mutation_queue_t* queue = queue_for_document(document);
+    if (!queue) return;
+    queue->schedule = schedule;
+    queue->schedule_data = data;
+    queue->scheduled = false;
+}
+
+// Hands each callback observer its pending records as one batch.
+// Mutations made by a callback queue records for the next checkpoint.
+void dom_deliver_mutations(dom_document_t* document) {
+    mutation_queue_t* queue = document ? document->mutation_observers : NULL;
+    if (!queue || queue->delivering) return;
+    
+    queue->scheduled = false;
+    queue->delivering = true;
+    for (mutation_observer_t* observer = queue->observers; observer; observer = observer->next) {
+        if (!observer->callback || observer->disconnected || observer->count == 0) continue;
+        
+        uint32_t count = 0;
+        dom_mutation_record_t** records = dom_take_records(observer, &count);
+        if (!records) continue;
+        observer->callback(records, count);
+        dom_mutation_records_destroy(records, count);
+        if (!queue->document) break;   // The callback destroyed the document
+    }
+    queue->delivering = false;
+    
+    // The last access to a queue its document left behind
+    if (!queue->document) {
+        if (queue->outstanding == 0) queue_free(queue);
+        return;
+    }
+    
+    mutation_observer_t** link = &queue->observers;
+    while (*link) {
+        mutation_observer_t* observer = *link;
+        if (observer->disconnected) {
+            *link = observer->next;
+            observer_free(observer);
+        } else {
+            link = &observer->next;
+        }
+    }
+}
+
+// Records still out are freed as they come back
+void dom_mutation_queue_destroy(dom_document_t* document) {
+    mutation_queue_t* queue = document ? document->mutation_observers : NULL;
+    if (!queue) return;
+    document->mutation_observers = NULL;
+    
+    while (queue->observers) {
+        mutation_observer_t* observer = queue->observers;
+        observer_detach(observer);
+        if (observer->disconnected) observer_free(observer);
+    }
+    queue->document = NULL;
+    queue->schedule = NULL;
+    if (queue->outstanding == 0 && !queue->delivering) queue_free(queue);
+}
@@ -3,6 +3,7 @@
 
 #include <stdint.h>
 #include <stdbool.h>
+#include "../atom.h"
 
 // HTML5 tokenizer states
 typedef enum {
@@ -43,13 +44,17 @@ typedef enum {
 typedef struct {
     html_token_type_t type;
     char* tag_name;
+    atom_t tag_atom;
     struct {
         char* name;
         char* value;
+        atom_t name_atom;
     }* attributes;
     uint32_t attribute_count;
+    uint32_t attribute_capacity;
     char* data;
     bool self_closing;
+    void* pool_next;
 } html_token_t;
 
 // HTML tokenizer
@@ -61,6 +66,25 @@ typedef struct {
     html_token_t* current_token;
     char* buffer;
     uint32_t buffer_size;
+    
+    // Streaming input. When streaming, the tokenizer returns NULL instead of
+    // TOKEN_EOF once it runs out of input before end_of_input is set, keeping
+    // state and the partial current_token so the next chunk resumes mid-token.
+    // Token text is accumulated in buffer, never referenced from input, so
+    // consumed input can be discarded between chunks. owned_input is
+    // released by html_tokenizer_destroy.
+    bool streaming;
+    bool end_of_input;
+    char* owned_input;
+    uint32_t input_capacity;
+    uint64_t consumed;
+    
+    // Token recycling. Tokens come from a free list and their strings from
+    // token_arena, which is rewound whenever no token is outstanding. The
+    // tree builder copies anything it keeps into the document's arena.
+    html_token_t* token_pool;
+    uint32_t tokens_outstanding;
+    struct dom_arena* token_arena;
 } html_tokenizer_t;
 
 // Tree construction modes
@@ -104,12 +128,43 @@ void html_parser_destroy(html_parser_t* parser);
 struct dom_document* html_parse(html_parser_t* parser, const char* input, uint32_t length);
 struct dom_document* html_parse_fragment(html_parser_t* parser, const char* input, uint32_t length, struct dom_element* context);
 
+// Streaming parser API. The document is created by the first feed and
+// grows as chunks arrive; it belongs to the caller from then on and is
+// never freed by html_parser_destroy.
+int html_parser_feed(html_parser_t* parser, const char* chunk, uint32_t length);
+struct dom_document* html_parser_finish(html_parser_t* parser);
+
 // Tokenizer API
 html_tokenizer_t* html_tokenizer_create(const char* input, uint32_t length);
+html_tokenizer_t* html_tokenizer_create_streaming(void);
+int html_tokenizer_feed(html_tokenizer_t* tokenizer, const char* chunk, uint32_t length);
+void html_tokenizer_end_input(html_tokenizer_t* tokenizer);
 void html_tokenizer_destroy(html_tokenizer_t* tokenizer);
 html_token_t* html_tokenizer_next_token(html_tokenizer_t* tokenizer);
 void html_token_destroy(html_token_t* token);
 
+// Token pool. html_tokenizer_next_token hands out pooled tokens, which are
+// given back with html_tokenizer_release_token; html_tokenizer_destroy
+// calls html_token_pool_destroy.
+html_token_t* html_tokenizer_acquire_token(html_tokenizer_t* tokenizer, html_token_type_t type);
+void html_tokenizer_release_token(html_tokenizer_t* tokenizer, html_token_t* token);
+char* html_tokenizer_token_string(html_tokenizer_t* tokenizer, const char* str, uint32_t length);
+bool html_token_set_tag_name(html_tokenizer_t* tokenizer, html_token_t* token, const char* name, uint32_t length);
+bool html_token_add_attribute(html_tokenizer_t* tokenizer, html_token_t* token, const char* name, uint32_t name_length, const char* value, uint32_t value_length);
+void html_token_pool_destroy(html_tokenizer_t* tokenizer);
+
+// Character references (char_ref.c). html_decode_char_ref decodes the
+// reference at text, just past its '&', into up to HTML_CHAR_REF_MAX_UTF8
+// bytes of UTF-8 at out, and returns how much of text it used; 0 means the
+// '&' is literal. in_attribute applies the attribute value rule that keeps
+// a legacy name without its ';' as written when '=' or an alphanumeric
+// follows. html_decode_char_refs decodes every reference in a string into
+// a NUL-terminated out of capacity bytes and returns its length; a name can
+// expand to 6/5 of its text, so twice length is always enough.
+#define HTML_CHAR_REF_MAX_UTF8 8
+uint32_t html_decode_char_ref(const char* text, uint32_t length, bool in_attribute, char* out, uint32_t* out_length);
+uint32_t html_decode_char_refs(const char* text, uint32_t length, bool in_attribute, char* out, uint32_t capacity);
+
 // Tree construction
 void html_process_token(html_parser_t* parser, html_token_t* token);
 void html_insert_element(html_parser_t* parser, html_token_t* token);
@@ -124,6 +179,9 @@ void html_clear_stack_to_table_context(html_parser_t* parser);
 bool html_is_special_element(const char* tag_name);
 bool html_is_formatting_element(const char* tag_name);
 bool html_is_void_element(const char* tag_name);
+bool html_is_special_atom(atom_t tag);
+bool html_is_formatting_atom(atom_t tag);
+bool html_is_void_atom(atom_t tag);
 
 // Error recovery
 typedef enum {
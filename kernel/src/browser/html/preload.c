@@ -0,0 +1,218 @@
+#include "preload.h"
+#include "parser.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+
+html_preload_scanner_t* html_preload_scanner_create(html_preload_callback_t callback, void* data) {
+    html_preload_scanner_t* scanner = calloc(1, sizeof(html_preload_scanner_t));
+    if (!scanner) return NULL;
+    
+    scanner->state = PRELOAD_SCAN_DATA;
+    scanner->callback = callback;
+    scanner->callback_data = data;
+    
+    return scanner;
+}
+
+void html_preload_scanner_destroy(html_preload_scanner_t* scanner) {
+    free(scanner);
+}
+
+// Reports an attribute value's URL with its character references decoded
+// as the tokenizer would
+static void preload_report(html_preload_scanner_t* scanner, html_preload_type_t type, const char* value) {
+    char url[HTML_PRELOAD_MAX_TAG * 2];
+    html_decode_char_refs(value, (uint32_t)strlen(value), true, url, sizeof(url));
+    scanner->callback(scanner->callback_data, type, url);
+}
+
+// Check whether a space separated attribute value contains a token
+static bool preload_has_token(const char* value, const char* token) {
+    size_t token_length = strlen(token);
+    const char* p = value;
+    
+    while (*p) {
+        while (*p && isspace((unsigned char)*p)) p++;
+        const char* start = p;
+        while (*p && !isspace((unsigned char)*p)) p++;
+        if ((size_t)(p - start) == token_length && strncasecmp(start, token, token_length) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void preload_enter_rawtext(html_preload_scanner_t* scanner, const char* name) {
+    scanner->rawtext_length = (uint32_t)snprintf(scanner->rawtext_end, sizeof(scanner->rawtext_end), "</%s", name);
+    scanner->match = 0;
+    scanner->state = PRELOAD_SCAN_RAWTEXT;
+}
+
+// A complete start tag is in scanner->tag (without the angle brackets)
+static void preload_process_tag(html_preload_scanner_t* scanner) {
+    char* p = scanner->tag;
+    scanner->tag[scanner->tag_length] = '\0';
+    
+    // End tags, doctype and processing instructions carry no URLs
+    if (!isalpha((unsigned char)*p)) return;
+    
+    // Tag name
+    char* name = p;
+    while (*p && !isspace((unsigned char)*p) && *p != '/') {
+        *p = (char)tolower((unsigned char)*p);
+        p++;
+    }
+    if (*p) *p++ = '\0';
+    
+    bool is_script = strcmp(name, "script") == 0;
+    bool is_link = strcmp(name, "link") == 0;
+    bool is_img = strcmp(name, "img") == 0;
+    
+    // Attributes
+    char* src = NULL;
+    char* href = NULL;
+    char* rel = NULL;
+    char* as = NULL;
+    
+    while (*p) {
+        while (*p && (isspace((unsigned char)*p) || *p == '/')) p++;
+        if (!*p) break;
+        
+        char* attr_name = p;
+        while (*p && !isspace((unsigned char)*p) && *p != '=' && *p != '/') {
+            *p = (char)tolower((unsigned char)*p);
+            p++;
+        }
+        char* attr_name_end = p;
+        
+        while (*p && isspace((unsigned char)*p)) p++;
+        
+        char* value = NULL;
+        if (*p == '=') {
+            p++;
+            while (*p && isspace((unsigned char)*p)) p++;
+            if (*p == '"' || *p == '\'') {
+                char quote = *p++;
+                value = p;
+                while (*p && *p != quote) p++;
+            } else {
+                value = p;
+                while (*p && !isspace((unsigned char)*p)) p++;
+            }
+            if (*p) *p++ = '\0';
+        }
+        *attr_name_end = '\0';
+        
+        if (!value) continue;
+        
+        if (strcmp(attr_name, "src") == 0) src = value;
+        else if (strcmp(attr_name, "href") == 0) href = value;
+        else if (strcmp(attr_name, "rel") == 0) rel = value;
+        else if (strcmp(attr_name, "as") == 0) as = value;
+    }
+    
+    if (is_script && src && *src) {
+        preload_report(scanner, PRELOAD_SCRIPT, src);
+    } else if (is_img && src && *src) {
+        preload_report(scanner, PRELOAD_IMAGE, src);
+    } else if (is_link && rel && href && *href) {
+        if (preload_has_token(rel, "stylesheet")) {
+            preload_report(scanner, PRELOAD_STYLESHEET, href);
+        } else if (preload_has_token(rel, "preload")) {
+            html_preload_type_t type = PRELOAD_OTHER;
+            if (as && strcasecmp(as, "script") == 0) type = PRELOAD_SCRIPT;
+            else if (as && strcasecmp(as, "style") == 0) type = PRELOAD_STYLESHEET;
+            else if (as && strcasecmp(as, "image") == 0) type = PRELOAD_IMAGE;
+            else if (as && strcasecmp(as, "font") == 0) type = PRELOAD_FONT;
+            preload_report(scanner, type, href);
+        }
+    }
+    
+    // Markup inside these elements is text, not tags
+    if (is_script || strcmp(name, "style") == 0 || strcmp(name, "textarea") == 0 ||
+        strcmp(name, "title") == 0) {
+        preload_enter_rawtext(scanner, name);
+    }
+}
+
+// Scan the next chunk of the byte stream. State carries over between
+// calls, so tags may be split across chunks.
+void html_preload_scanner_scan(html_preload_scanner_t* scanner, const char* chunk, uint32_t length) {
+    if (!scanner || !chunk) return;
+    
+    for (uint32_t i = 0; i < length; i++) {
+        char c = chunk[i];
+        
+        switch (scanner->state) {
+            case PRELOAD_SCAN_DATA:
+                if (c == '<') {
+                    scanner->state = PRELOAD_SCAN_TAG;
+                    scanner->tag_length = 0;
+                    scanner->quote = 0;
+                    scanner->overflow = false;
+                }
+                break;
+            
+            case PRELOAD_SCAN_TAG:
+                if (scanner->tag_length == 0 && !isalpha((unsigned char)c) && c != '/' && c != '!') {
+                    // Stray '<' in text
+                    scanner->state = PRELOAD_SCAN_DATA;
+                    break;
+                }
+                
+                if (scanner->quote) {
+                    if (c == scanner->quote) scanner->quote = 0;
+                } else if (c == '"' || c == '\'') {
+                    scanner->quote = c;
+                } else if (c == '>') {
+                    scanner->state = PRELOAD_SCAN_DATA;
+                    if (!scanner->overflow) {
+                        preload_process_tag(scanner);
+                    }
+                    break;
+                }
+                
+                if (scanner->tag_length + 1 < HTML_PRELOAD_MAX_TAG) {
+                    scanner->tag[scanner->tag_length++] = c;
+                } else {
+                    scanner->overflow = true;
+                }
+                
+                if (scanner->tag_length == 3 && memcmp(scanner->tag, "!--", 3) == 0) {
+                    scanner->state = PRELOAD_SCAN_COMMENT;
+                    scanner->match = 0;
+                }
+                break;
+            
+            case PRELOAD_SCAN_COMMENT:
+                // Count consecutive dashes looking for "-->"
+                if (c == '-') {
+                    scanner->match++;
+                } else if (c == '>' && scanner->match >= 2) {
+                    scanner->state = PRELOAD_SCAN_DATA;
+                } else {
+                    scanner->match = 0;
+                }
+                break;
+            
+            case PRELOAD_SCAN_RAWTEXT:
+                if (tolower((unsigned char)c) == scanner->rawtext_end[scanner->match]) {
+                    scanner->match++;
+                    if (scanner->match == scanner->rawtext_length) {
+                        // Found the end tag; let the tag state consume up to '>'
+                        scanner->state = PRELOAD_SCAN_TAG;
+                        scanner->tag_length = 0;
+                        scanner->tag[scanner->tag_length++] = '/';
+                        scanner->quote = 0;
+                        scanner->overflow = false;
+                    }
+                } else {
+                    scanner->match = c == '<' ? 1 : 0;
+                }
+                break;
+        }
+    }
+}
\ No newline at end of file
@@ -0,0 +1,49 @@
+#ifndef HTML_PRELOAD_H
+#define HTML_PRELOAD_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define HTML_PRELOAD_MAX_TAG 4096
+
+// Subresource kinds found by the preload scanner
+typedef enum {
+    PRELOAD_SCRIPT,
+    PRELOAD_STYLESHEET,
+    PRELOAD_IMAGE,
+    PRELOAD_FONT,
+    PRELOAD_OTHER
+} html_preload_type_t;
+
+typedef void (*html_preload_callback_t)(void* data, html_preload_type_t type, const char* url);
+
+// Speculative preload scanner. Runs over the raw byte stream ahead of the
+// tree builder and reports subresource URLs as soon as their start tag has
+// been seen. It only understands enough markup to skip comments, quoted
+// attribute values and script/style raw text; it never builds DOM.
+typedef struct {
+    enum {
+        PRELOAD_SCAN_DATA,
+        PRELOAD_SCAN_TAG,
+        PRELOAD_SCAN_COMMENT,
+        PRELOAD_SCAN_RAWTEXT
+    } state;
+    char quote;
+    char tag[HTML_PRELOAD_MAX_TAG];
+    uint32_t tag_length;
+    bool overflow;
+    
+    // Raw text terminator, e.g. "</script"
+    char rawtext_end[16];
+    uint32_t rawtext_length;
+    uint32_t match;
+    
+    html_preload_callback_t callback;
+    void* callback_data;
+} html_preload_scanner_t;
+
+html_preload_scanner_t* html_preload_scanner_create(html_preload_callback_t callback, void* data);
+void html_preload_scanner_destroy(html_preload_scanner_t* scanner);
+void html_preload_scanner_scan(html_preload_scanner_t* scanner, const char* chunk, uint32_t length);
+
+#endif
\ No newline at end of file
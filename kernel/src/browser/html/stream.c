@@ -0,0 +1,132 @@
+#include "parser.h"
+#include "dom.h"
+#include "../capacity.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define STREAM_INITIAL_CAPACITY 16384
+
+// Create a tokenizer that is fed input chunk by chunk
+html_tokenizer_t* html_tokenizer_create_streaming(void) {
+    html_tokenizer_t* tokenizer = html_tokenizer_create("", 0);
+    if (!tokenizer) return NULL;
+    
+    tokenizer->owned_input = malloc(STREAM_INITIAL_CAPACITY);
+    if (!tokenizer->owned_input) {
+        html_tokenizer_destroy(tokenizer);
+        return NULL;
+    }
+    
+    tokenizer->input = tokenizer->owned_input;
+    tokenizer->input_capacity = STREAM_INITIAL_CAPACITY;
+    tokenizer->streaming = true;
+    tokenizer->end_of_input = false;
+    tokenizer->consumed = 0;
+    
+    return tokenizer;
+}
+
+// Append a chunk of input, discarding what has already been tokenized
+int html_tokenizer_feed(html_tokenizer_t* tokenizer, const char* chunk, uint32_t length) {
+    if (!tokenizer || !tokenizer->streaming || tokenizer->end_of_input) return -1;
+    if (!chunk || length == 0) return 0;
+    
+    // Compact: the tokenizer keeps no pointers into consumed input
+    if (tokenizer->position > 0) {
+        uint32_t remaining = tokenizer->length - tokenizer->position;
+        memmove(tokenizer->owned_input, tokenizer->owned_input + tokenizer->position, remaining);
+        tokenizer->consumed += tokenizer->position;
+        tokenizer->length = remaining;
+        tokenizer->position = 0;
+    }
+    
+    // Grow buffer
+    if ((uint64_t)tokenizer->length + length > tokenizer->input_capacity) {
+        uint32_t new_capacity = capacity_reserve(tokenizer->input_capacity, (uint64_t)tokenizer->length + length, STREAM_INITIAL_CAPACITY, 1);
+        if (!new_capacity) return -1;
+        
+        char* new_input = realloc(tokenizer->owned_input, new_capacity);
+        if (!new_input) return -1;
+        
+        tokenizer->owned_input = new_input;
+        tokenizer->input_capacity = new_capacity;
+    }
+    
+    memcpy(tokenizer->owned_input + tokenizer->length, chunk, length);
+    tokenizer->length += length;
+    tokenizer->input = tokenizer->owned_input;
+    
+    return 0;
+}
+
+// No more input will arrive; the next starved read yields TOKEN_EOF
+void html_tokenizer_end_input(html_tokenizer_t* tokenizer) {
+    if (!tokenizer) return;
+    tokenizer->end_of_input = true;
+}
+
+// Run tree construction over every token currently available
+static bool html_parser_pump(html_parser_t* parser) {
+    html_token_t* token;
+    while ((token = html_tokenizer_next_token(parser->tokenizer)) != NULL) {
+        bool eof = token->type == TOKEN_EOF;
+        html_process_token(parser, token);
+        html_tokenizer_release_token(parser->tokenizer, token);
+        if (eof) return true;
+    }
+    return false;
+}
+
+// Feed a chunk of the document. Tokens completed by this chunk are
+// inserted into the DOM immediately; a token split across chunks is
+// finished by the next call.
+int html_parser_feed(html_parser_t* parser, const char* chunk, uint32_t length) {
+    if (!parser) return -1;
+    
+    // First chunk starts a new document
+    if (!parser->tokenizer || !parser->tokenizer->streaming) {
+        if (parser->tokenizer) {
+            html_tokenizer_destroy(parser->tokenizer);
+        }
+        
+        parser->tokenizer = html_tokenizer_create_streaming();
+        if (!parser->tokenizer) return -1;
+        
+        parser->document = dom_document_create();
+        if (!parser->document) {
+            html_tokenizer_destroy(parser->tokenizer);
+            parser->tokenizer = NULL;
+            return -1;
+        }
+        
+        parser->document->ready_state = READY_STATE_LOADING;
+        parser->mode = MODE_INITIAL;
+        parser->open_elements_count = 0;
+        parser->active_formatting_count = 0;
+        parser->head_element = NULL;
+        parser->form_element = NULL;
+    }
+    
+    if (html_tokenizer_feed(parser->tokenizer, chunk, length) != 0) return -1;
+    
+    html_parser_pump(parser);
+    return 0;
+}
+
+// Signal end of input, flush the tokenizer and hand back the document
+struct dom_document* html_parser_finish(html_parser_t* parser) {
+    if (!parser || !parser->tokenizer || !parser->tokenizer->streaming) return NULL;
+    
+    html_tokenizer_end_input(parser->tokenizer);
+    html_parser_pump(parser);
+    
+    struct dom_document* document = parser->document;
+    
+    html_tokenizer_destroy(parser->tokenizer);
+    parser->tokenizer = NULL;
+    parser->document = NULL;
+    parser->open_elements_count = 0;
+    parser->active_formatting_count = 0;
+    
+    return document;
+}
@@ -0,0 +1,33 @@
+#include "parser.h"
+#include <string.h>
+
+// Element categories come from the static atom flags, so each check is a
+// table read rather than a strcmp chain over the category's tag names.
+
+bool html_is_special_atom(atom_t tag) {
+    return atom_has_flag(tag, ATOM_FLAG_SPECIAL);
+}
+
+bool html_is_formatting_atom(atom_t tag) {
+    return atom_has_flag(tag, ATOM_FLAG_FORMATTING);
+}
+
+bool html_is_void_atom(atom_t tag) {
+    return atom_has_flag(tag, ATOM_FLAG_VOID);
+}
+
+// String forms. Names that were never interned cannot be in any category.
+bool html_is_special_element(const char* tag_name) {
+    if (!tag_name) return false;
+    return html_is_special_atom(atom_lookup_lower(tag_name, (uint32_t)strlen(tag_name)));
+}
+
+bool html_is_formatting_element(const char* tag_name) {
+    if (!tag_name) return false;
+    return html_is_formatting_atom(atom_lookup_lower(tag_name, (uint32_t)strlen(tag_name)));
+}
+
+bool html_is_void_element(const char* tag_name) {
+    if (!tag_name) return false;
+    return html_is_void_atom(atom_lookup_lower(tag_name, (uint32_t)strlen(tag_name)));
+}
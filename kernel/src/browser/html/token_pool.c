@@ -0,0 +1,106 @@
+#include "parser.h"
+#include "arena.h"
+#include "../capacity.h"
+#include <stdlib.h>
+#include <string.h>
+
+// Take a token from the pool, resetting it for reuse
+html_token_t* html_tokenizer_acquire_token(html_tokenizer_t* tokenizer, html_token_type_t type) {
+    if (!tokenizer) return NULL;
+    
+    if (!tokenizer->token_arena) {
+        tokenizer->token_arena = dom_arena_create();
+        if (!tokenizer->token_arena) return NULL;
+    }
+    
+    html_token_t* token = tokenizer->token_pool;
+    if (token) {
+        tokenizer->token_pool = token->pool_next;
+    } else {
+        token = calloc(1, sizeof(html_token_t));
+        if (!token) return NULL;
+    }
+    
+    // Keep the attribute array; its strings live in the token arena
+    token->type = type;
+    token->tag_name = NULL;
+    token->tag_atom = ATOM_NULL;
+    token->attribute_count = 0;
+    token->data = NULL;
+    token->self_closing = false;
+    token->pool_next = NULL;
+    
+    tokenizer->tokens_outstanding++;
+    return token;
+}
+
+// Hand a token back. Once every token is back, all token strings go at once.
+void html_tokenizer_release_token(html_tokenizer_t* tokenizer, html_token_t* token) {
+    if (!tokenizer || !token) return;
+    
+    token->pool_next = tokenizer->token_pool;
+    tokenizer->token_pool = token;
+    
+    if (tokenizer->tokens_outstanding > 0) {
+        tokenizer->tokens_outstanding--;
+    }
+    if (tokenizer->tokens_outstanding == 0) {
+        dom_arena_reset(tokenizer->token_arena);
+    }
+}
+
+// Copy token text into the token arena
+char* html_tokenizer_token_string(html_tokenizer_t* tokenizer, const char* str, uint32_t length) {
+    if (!tokenizer || !tokenizer->token_arena) return NULL;
+    return dom_arena_strndup(tokenizer->token_arena, str, length);
+}
+
+// Tag names are case-insensitive; the atom is interned in lowercase
+bool html_token_set_tag_name(html_tokenizer_t* tokenizer, html_token_t* token, const char* name, uint32_t length) {
+    if (!tokenizer || !token || !name) return false;
+    
+    token->tag_name = html_tokenizer_token_string(tokenizer, name, length);
+    token->tag_atom = atom_intern_lower(name, length);
+    return token->tag_name != NULL;
+}
+
+bool html_token_add_attribute(html_tokenizer_t* tokenizer, html_token_t* token, const char* name, uint32_t name_length, const char* value, uint32_t value_length) {
+    if (!tokenizer || !token || !name) return false;
+    
+    if (token->attribute_count >= token->attribute_capacity) {
+        uint32_t new_capacity = capacity_grow(token->attribute_capacity, 8, sizeof(*token->attributes));
+        void* new_attributes = new_capacity ? realloc(token->attributes, new_capacity * sizeof(*token->attributes)) : NULL;
+        if (!new_attributes) return false;
+        token->attributes = new_attributes;
+        token->attribute_capacity = new_capacity;
+    }
+    
+    char* name_copy = html_tokenizer_token_string(tokenizer, name, name_length);
+    char* value_copy = html_tokenizer_token_string(tokenizer, value ? value : "", value ? value_length : 0);
+    if (!name_copy || !value_copy) return false;
+    
+    token->attributes[token->attribute_count].name = name_copy;
+    token->attributes[token->attribute_count].value = value_copy;
+    token->attributes[token->attribute_count].name_atom = atom_intern_lower(name, name_length);
+    token->attribute_count++;
+    
+    return true;
+}
+
+// Free pooled tokens and the token arena
+void html_token_pool_destroy(html_tokenizer_t* tokenizer) {
+    if (!tokenizer) return;
+    
+    html_token_t* token = tokenizer->token_pool;
+    while (token) {
+        html_token_t* next = token->pool_next;
+        free(token->attributes);
+        free(token);
+        token = next;
+    }
+    tokenizer->token_pool = NULL;
+    
+    dom_arena_destroy(tokenizer->token_arena);
+    tokenizer->token_arena = NULL;
+    tokenizer->tokens_outstanding = 0;
+}
\ No newline at end of file
@@ -0,0 +1,199 @@
+#include "bytecode.h"
+#include "code_cache.h"
+#include "../capacity.h"
+#include <stdlib.h>
+#include <string.h>
+
+static const struct {
+    const char* name;
+    int8_t pops;
+    int8_t pushes;
+} opcode_info[JS_OP_COUNT] = {
+#define JS_OPCODE_INFO(name, pops, pushes) { #name, pops, pushes },
+    JS_OPCODES(JS_OPCODE_INFO)
+#undef JS_OPCODE_INFO
+};
+
+const char* js_opcode_name(js_opcode_t op) {
+    return op < JS_OP_COUNT ? opcode_info[op].name : "UNKNOWN";
+}
+
+static int32_t insn_pops(uint32_t insn) {
+    uint32_t op = JS_INSN_OP(insn);
+    if (op == JS_OP_CALL) return (int32_t)JS_INSN_OPERAND(insn) + 1;
+    if (op == JS_OP_CALL_METHOD) return (int32_t)JS_INSN_OPERAND(insn) + 2;
+    return opcode_info[op].pops;
+}
+
+int32_t js_insn_stack_effect(uint32_t insn) {
+    uint32_t op = JS_INSN_OP(insn);
+    if (op >= JS_OP_COUNT) return 0;
+    return opcode_info[op].pushes - insn_pops(insn);
+}
+
+static bool grow(void** array, uint32_t* capacity, uint32_t needed, size_t element_size) {
+    if (needed <= *capacity) return true;
+    
+    uint32_t new_capacity = capacity_reserve(*capacity, needed, 16, element_size);
+    void* grown = new_capacity ? realloc(*array, new_capacity * element_size) : NULL;
+    if (!grown) return false;
+    *array = grown;
+    *capacity = new_capacity;
+    return true;
+}
+
+js_bytecode_t* js_bytecode_create(const char* name, uint16_t parameter_count) {
+    js_bytecode_t* bytecode = calloc(1, sizeof(js_bytecode_t));
+    if (!bytecode) return NULL;
+    
+    if (name) {
+        bytecode->name = strdup(name);
+        if (!bytecode->name) {
+            free(bytecode);
+            return NULL;
+        }
+    }
+    bytecode->parameter_count = parameter_count;
+    bytecode->local_count = parameter_count;
+    return bytecode;
+}
+
+void js_bytecode_destroy(js_bytecode_t* bytecode) {
+    if (!bytecode) return;
+    for (uint32_t i = 0; i < bytecode->constant_count; i++) {
+        js_gc_unprotect(bytecode->constants[i]);
+    }
+    free(bytecode->constants);
+    free(bytecode->ics);
+    if (bytecode->mapping) {
+        js_code_cache_release(bytecode->mapping);
+    } else {
+        free(bytecode->code);
+    }
+    free(bytecode->name);
+    free(bytecode);
+}
+
+int32_t js_bytecode_emit(js_bytecode_t* bytecode, js_opcode_t op, int32_t operand) {
+    if (!bytecode || bytecode->mapping || op >= JS_OP_COUNT) return -1;
+    
+    bool is_signed = op == JS_OP_LOAD_INT || op == JS_OP_JUMP || op == JS_OP_JUMP_IF_FALSE || op == JS_OP_JUMP_IF_TRUE;
+    if (is_signed ? (operand < JS_SIGNED_OPERAND_MIN || operand > JS_SIGNED_OPERAND_MAX) : (operand < 0 || operand > JS_OPERAND_MAX)) {
+        return -1;
+    }
+    if (!grow((void**)&bytecode->code, &bytecode->code_capacity, bytecode->length + 1, sizeof(uint32_t))) return -1;
+    
+    bytecode->depth += js_insn_stack_effect(JS_INSN(op, (uint32_t)operand & JS_OPERAND_MAX));
+    if (bytecode->depth > bytecode->stack_size) bytecode->stack_size = (uint16_t)bytecode->depth;
+    
+    bytecode->code[bytecode->length] = JS_INSN(op, (uint32_t)operand & JS_OPERAND_MAX);
+    return (int32_t)bytecode->length++;
+}
+
+int32_t js_bytecode_add_constant(js_bytecode_t* bytecode, js_value_t value) {
+    if (!bytecode || bytecode->constant_count > JS_OPERAND_MAX) return -1;
+    if (!grow((void**)&bytecode->constants, &bytecode->constant_capacity, bytecode->constant_count + 1, sizeof(js_value_t))) return -1;
+    
+    // Bytecode lives outside the heap, so its constants are roots
+    if (!js_gc_protect(value)) return -1;
+    bytecode->constants[bytecode->constant_count] = value;
+    return (int32_t)bytecode->constant_count++;
+}
+
+int32_t js_bytecode_add_ic(js_bytecode_t* bytecode, const char* name) {
+    if (!bytecode || !name || bytecode->ic_count > JS_OPERAND_MAX) return -1;
+    if (!grow((void**)&bytecode->ics, &bytecode->ic_capacity, bytecode->ic_count + 1, sizeof(js_property_ic_t))) return -1;
+    
+    js_ic_init(&bytecode->ics[bytecode->ic_count], atom_intern(name));
+    return (int32_t)bytecode->ic_count++;
+}
+
+int32_t js_bytecode_add_local(js_bytecode_t* bytecode) {
+    if (!bytecode || bytecode->local_count == UINT16_MAX) return -1;
+    return bytecode->local_count++;
+}
+
+uint32_t js_bytecode_label(const js_bytecode_t* bytecode) {
+    return bytecode ? bytecode->length : 0;
+}
+
+bool js_bytecode_patch_jump(js_bytecode_t* bytecode, uint32_t at, uint32_t target) {
+    if (!bytecode || bytecode->mapping || at >= bytecode->length || target > bytecode->length) return false;
+    
+    uint32_t op = JS_INSN_OP(bytecode->code[at]);
+    if (op != JS_OP_JUMP && op != JS_OP_JUMP_IF_FALSE && op != JS_OP_JUMP_IF_TRUE) return false;
+    
+    int64_t offset = (int64_t)target - (int64_t)(at + 1);
+    if (offset < JS_SIGNED_OPERAND_MIN || offset > JS_SIGNED_OPERAND_MAX) return false;
+    bytecode->code[at] = JS_INSN(op, (uint32_t)offset & JS_OPERAND_MAX);
+    return true;
+}
+
+// Verification
+
+static bool verify(const js_bytecode_t* bytecode, int32_t* depth, bool* loop_header) {
+    int32_t current = 0;
+    for (uint32_t pc = 0; pc < bytecode->length; pc++) {
+        uint32_t insn = bytecode->code[pc];
+        uint32_t op = JS_INSN_OP(insn);
+        uint32_t operand = JS_INSN_OPERAND(insn);
+        if (op >= JS_OP_COUNT) return false;
+        
+        depth[pc] = current;
+        if (current < insn_pops(insn)) return false;
+        current += js_insn_stack_effect(insn);
+        if (current > bytecode->stack_size) return false;
+        
+        switch (op) {
+            case JS_OP_LOAD_CONST:
+                if (operand >= bytecode->constant_count) return false;
+                break;
+            case JS_OP_GET_LOCAL:
+            case JS_OP_SET_LOCAL:
+                if (operand >= bytecode->local_count) return false;
+                break;
+            case JS_OP_GET_GLOBAL:
+            case JS_OP_SET_GLOBAL:
+            case JS_OP_GET_PROP:
+            case JS_OP_SET_PROP:
+                if (operand >= bytecode->ic_count) return false;
+                break;
+            case JS_OP_JUMP:
+            case JS_OP_JUMP_IF_FALSE:
+            case JS_OP_JUMP_IF_TRUE: {
+                int64_t target = (int64_t)pc + 1 + JS_INSN_SIGNED(insn);
+                if (target < 0 || target > bytecode->length) return false;
+                if (target <= pc && loop_header) loop_header[target] = true;
+                break;
+            }
+            default:
+                break;
+        }
+    }
+    depth[bytecode->length] = current;
+    
+    // Every jump must arrive with the depth its target expects
+    for (uint32_t pc = 0; pc < bytecode->length; pc++) {
+        uint32_t insn = bytecode->code[pc];
+        uint32_t op = JS_INSN_OP(insn);
+        if (op != JS_OP_JUMP && op != JS_OP_JUMP_IF_FALSE && op != JS_OP_JUMP_IF_TRUE) continue;
+        
+        uint32_t target = (uint32_t)((int64_t)pc + 1 + JS_INSN_SIGNED(insn));
+        if (depth[target] != depth[pc] + js_insn_stack_effect(insn)) return false;
+    }
+    return true;
+}
+
+bool js_bytecode_verify(const js_bytecode_t* bytecode, int32_t* depth, bool* loop_header) {
+    if (!bytecode || (bytecode->length && !bytecode->code)) return false;
+    
+    int32_t* scratch = NULL;
+    if (!depth) {
+        scratch = malloc((bytecode->length + 1) * sizeof(int32_t));
+        if (!scratch) return false;
+        depth = scratch;
+    }
+    bool valid = verify(bytecode, depth, loop_header);
+    free(scratch);
+    return valid;
+}
@@ -0,0 +1,168 @@
+#ifndef JS_BYTECODE_H
+#define JS_BYTECODE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "engine.h"
+#include "shape.h"
+
+// Stack bytecode executed by interpreter.c. Every instruction is one
+// 32-bit word: the opcode in the low byte and a 24-bit operand above it.
+// Jump operands are signed offsets from the following instruction.
+// Property accesses by name (GET_PROP, SET_PROP, GET_GLOBAL, SET_GLOBAL)
+// carry the index of their own inline cache, which holds the name.
+//
+// X(name, pops, pushes); -1 pops means it depends on the operand
+#define JS_OPCODES(X) \
+    X(NOP, 0, 0) \
+    X(LOAD_CONST, 0, 1)             /* constants[A] */ \
+    X(LOAD_INT, 0, 1)               /* signed A */ \
+    X(LOAD_UNDEFINED, 0, 1) \
+    X(LOAD_NULL, 0, 1) \
+    X(LOAD_TRUE, 0, 1) \
+    X(LOAD_FALSE, 0, 1) \
+    X(LOAD_THIS, 0, 1) \
+    X(GET_LOCAL, 0, 1)              /* locals[A]; parameters come first */ \
+    X(SET_LOCAL, 1, 0) \
+    X(GET_GLOBAL, 0, 1)             /* ics[A] on the global object */ \
+    X(SET_GLOBAL, 1, 0) \
+    X(GET_PROP, 1, 1)               /* object -> object.ics[A] */ \
+    X(SET_PROP, 2, 0)               /* object value -> */ \
+    X(GET_ELEM, 2, 1)               /* object key -> object[key] */ \
+    X(SET_ELEM, 3, 0)               /* object key value -> */ \
+    X(NEW_OBJECT, 0, 1) \
+    X(NEW_ARRAY, 0, 1) \
+    X(ADD, 2, 1) \
+    X(SUB, 2, 1) \
+    X(MUL, 2, 1) \
+    X(DIV, 2, 1) \
+    X(MOD, 2, 1) \
+    X(BIT_AND, 2, 1) \
+    X(BIT_OR, 2, 1) \
+    X(BIT_XOR, 2, 1) \
+    X(SHL, 2, 1) \
+    X(SHR, 2, 1) \
+    X(USHR, 2, 1) \
+    X(NEG, 1, 1) \
+    X(BIT_NOT, 1, 1) \
+    X(NOT, 1, 1) \
+    X(TYPEOF, 1, 1) \
+    X(INC, 1, 1) \
+    X(DEC, 1, 1) \
+    X(EQ, 2, 1) \
+    X(NE, 2, 1) \
+    X(STRICT_EQ, 2, 1) \
+    X(STRICT_NE, 2, 1) \
+    X(LT, 2, 1) \
+    X(LE, 2, 1) \
+    X(GT, 2, 1) \
+    X(GE, 2, 1) \
+    X(JUMP, 0, 0) \
+    X(JUMP_IF_FALSE, 1, 0) \
+    X(JUMP_IF_TRUE, 1, 0) \
+    X(POP, 1, 0) \
+    X(DUP, 1, 2) \
+    X(SWAP, 2, 2) \
+    X(CALL, -1, 1)                  /* callee arg0..argA-1 -> result */ \
+    X(CALL_METHOD, -1, 1)           /* this callee arg0..argA-1 -> result */ \
+    X(RETURN, 1, 0)
+
+typedef enum {
+#define JS_OPCODE_ENUM(name, pops, pushes) JS_OP_##name,
+    JS_OPCODES(JS_OPCODE_ENUM)
+#undef JS_OPCODE_ENUM
+    JS_OP_COUNT
+} js_opcode_t;
+
+#define JS_INSN(op, operand) (((uint32_t)(operand) << 8) | (uint32_t)(op))
+#define JS_INSN_OP(insn) ((insn) & 0xff)
+#define JS_INSN_OPERAND(insn) ((insn) >> 8)
+#define JS_INSN_SIGNED(insn) ((int32_t)(insn) >> 8)
+
+// Bumped with any change to the instruction set or its encoding, so
+// bytecode persisted by an older build is never run (see code_cache.h)
+#define JS_BYTECODE_VERSION 1
+
+#define JS_OPERAND_MAX 0xffffff
+#define JS_SIGNED_OPERAND_MIN (-0x800000)
+#define JS_SIGNED_OPERAND_MAX 0x7fffff
+
+// Compiled function body, referenced from js_function_t.bytecode
+typedef struct js_bytecode {
+    char* name;
+    uint32_t* code;
+    uint32_t length;
+    js_value_t* constants;          // Protected (js_gc_protect)
+    uint32_t constant_count;
+    js_property_ic_t* ics;
+    uint32_t ic_count;
+    uint16_t parameter_count;
+    uint16_t local_count;           // Including parameters
+    uint16_t stack_size;            // Deepest operand stack
+    void* mapping;                  // Code cache file code points into, or NULL
+    
+    // Tiering (see jit.h)
+    uint32_t hotness;               // Weighted calls and loop iterations
+    void* jit;                      // Compiled entry point, or NULL
+    bool jit_failed;                // Stays in the interpreter
+    
+    // Builder state
+    uint32_t code_capacity;
+    uint32_t constant_capacity;
+    uint32_t ic_capacity;
+    int32_t depth;
+} js_bytecode_t;
+
+const char* js_opcode_name(js_opcode_t op);
+
+// Operand stack depth change of one instruction
+int32_t js_insn_stack_effect(uint32_t insn);
+
+// Emitting. The builder tracks operand stack depth in emission order, so
+// code reaching a jump target must arrive with the same depth it has on
+// the fall-through path. Bytecode holding constants must be destroyed
+// before its engine's heap. Bytecode loaded from the code cache is
+// finished and cannot be emitted to.
+js_bytecode_t* js_bytecode_create(const char* name, uint16_t parameter_count);
+void js_bytecode_destroy(js_bytecode_t* bytecode);
+int32_t js_bytecode_emit(js_bytecode_t* bytecode, js_opcode_t op, int32_t operand);
+int32_t js_bytecode_add_constant(js_bytecode_t* bytecode, js_value_t value);
+int32_t js_bytecode_add_ic(js_bytecode_t* bytecode, const char* name);
+int32_t js_bytecode_add_local(js_bytecode_t* bytecode);
+uint32_t js_bytecode_label(const js_bytecode_t* bytecode);
+bool js_bytecode_patch_jump(js_bytecode_t* bytecode, uint32_t at, uint32_t target);
+
+// Checks bytecode from outside the builder before it runs: opcodes,
+// operand ranges, jump targets, and that every path reaches an
+// instruction with the same operand stack depth, within stack_size.
+// depth, if given, gets the depth before each of the length + 1
+// instructions; loop_header, if given, length + 1 flags set at backward
+// jump targets.
+bool js_bytecode_verify(const js_bytecode_t* bytecode, int32_t* depth, bool* loop_header);
+
+// Compiler (parser.c). js_compile turns source into top-level bytecode
+// without running it; js_eval is js_compile then js_run_script. NULL on
+// a syntax error, which is left in error.last_exception.
+typedef enum {
+    JS_CODE_SCRIPT,
+    JS_CODE_MODULE
+} js_code_kind_t;
+
+js_bytecode_t* js_compile(js_engine_t* engine, const char* code, const char* filename, js_code_kind_t kind);
+
+// Runs top-level bytecode with the global object as this, then destroys it
+js_value_t js_run_script(js_engine_t* engine, js_bytecode_t* bytecode);
+
+// Interpreter. Returns the result, or JS_EXCEPTION with the exception
+// in engine->error.last_exception. js_call_function uses
+// js_interpreter_call for functions with bytecode.
+js_value_t js_interpret(js_engine_t* engine, js_bytecode_t* bytecode, js_value_t this_arg, js_value_t* args, uint32_t argc);
+
+// Continues a frame js_interpret set up at pc, with sp values on its
+// operand stack, until it returns; with step, after one instruction,
+// returning JS_UNDEFINED unless it threw. Compiled code runs its slow
+// paths this way. Step mode never counts towards compilation.
+js_value_t js_interpret_frame(js_engine_t* engine, js_bytecode_t* bytecode, js_value_t* frame, uint32_t pc, uint32_t sp, bool step);
+js_value_t js_interpreter_call(js_engine_t* engine, js_function_t* function, js_value_t this_arg, js_value_t* args, uint32_t argc);
+
+#endif
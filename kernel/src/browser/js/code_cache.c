@@ -0,0 +1,605 @@
+#include "code_cache.h"
+#include "gc.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <openssl/sha.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+_Static_assert(sizeof(((js_engine_t*)0)->compilation.code_cache_partition) == JS_CODE_CACHE_DIGEST_SIZE, "code_cache_partition must hold a digest");
+
+// File layout. Offsets are from the start of the file, which is mapped
+// whole; a string offset of 0 means none.
+typedef struct {
+    uint32_t magic;                 // JS_CODE_CACHE_MAGIC
+    uint32_t version;               // JS_BYTECODE_VERSION
+    uint32_t abi;                   // abi_tag() of the writer
+    uint32_t kind;                  // js_code_kind_t
+    uint8_t source_digest[JS_CODE_CACHE_DIGEST_SIZE];
+    uint64_t source_length;
+    uint64_t size;                  // Whole file
+    uint32_t functions;             // function_count cache_function_t
+    uint32_t function_count;        // The first is the top level
+} cache_header_t;
+
+typedef struct {
+    uint32_t name;
+    uint32_t code;                  // length instructions
+    uint32_t length;
+    uint32_t constants;             // constant_count cache_constant_t
+    uint32_t constant_count;
+    uint32_t ics;                   // ic_count name offsets
+    uint32_t ic_count;
+    uint32_t parameters;            // parameter_name_count name offsets
+    uint32_t parameter_name_count;
+    uint32_t bytecode_size;         // js_function_t fields from here on
+    uint16_t parameter_count;
+    uint16_t local_count;
+    uint16_t stack_size;
+    uint8_t kind;
+    uint8_t global_context;         // bound_context was the global context
+} cache_function_t;
+
+enum {
+    CONSTANT_VALUE,                 // A number or special, as bits
+    CONSTANT_STRING,                // index is a string offset
+    CONSTANT_FUNCTION               // index is a function after the first
+};
+
+typedef struct {
+    uint32_t type;
+    uint32_t index;
+    uint64_t bits;
+} cache_constant_t;
+
+typedef struct {
+    uint32_t length;
+    char data[];                    // NUL-terminated
+} cache_string_t;
+
+// A mapped file, shared by every bytecode pointing into it
+typedef struct {
+    uint8_t* base;
+    size_t size;
+    uint32_t references;
+    bool mapped;                    // mmap'd, else malloc'd (js_code_cache_decode)
+} cache_mapping_t;
+
+// Files are only read back by the build that wrote them
+static uint32_t abi_tag(void) {
+    const uint16_t probe = 1;
+    return (uint32_t)JS_OP_COUNT | (uint32_t)sizeof(js_value_t) << 8 | (uint32_t)sizeof(void*) << 16 | (uint32_t)*(const uint8_t*)&probe << 24;
+}
+
+// A file is only trusted to be for a source whose digest it carries, so
+// the digest must be one nobody can collide on purpose
+static void digest_source(const char* source, size_t length, uint8_t digest[JS_CODE_CACHE_DIGEST_SIZE]) {
+    SHA256((const unsigned char*)source, length, digest);
+}
+
+static void format_digest(const uint8_t digest[JS_CODE_CACHE_DIGEST_SIZE], char hex[JS_CODE_CACHE_DIGEST_SIZE * 2 + 1]) {
+    static const char digits[] = "0123456789abcdef";
+    for (uint32_t i = 0; i < JS_CODE_CACHE_DIGEST_SIZE; i++) {
+        hex[i * 2] = digits[digest[i] >> 4];
+        hex[i * 2 + 1] = digits[digest[i] & 0xf];
+    }
+    hex[JS_CODE_CACHE_DIGEST_SIZE * 2] = '\0';
+}
+
+// The partition's directory, or with digest the file in it
+static char* cache_path(const js_code_cache_t* cache, const uint8_t* partition, const uint8_t* digest, js_code_kind_t kind) {
+    char partition_hex[JS_CODE_CACHE_DIGEST_SIZE * 2 + 1];
+    char name[JS_CODE_CACHE_DIGEST_SIZE * 2 + sizeof("/.mjsc")] = "";
+    format_digest(partition, partition_hex);
+    if (digest) {
+        char digest_hex[JS_CODE_CACHE_DIGEST_SIZE * 2 + 1];
+        format_digest(digest, digest_hex);
+        snprintf(name, sizeof(name), "/%s.%s", digest_hex, kind == JS_CODE_MODULE ? "mjsc" : "jsc");
+    }
+    
+    int length = snprintf(NULL, 0, "%s/%s%s", cache->directory, partition_hex, name);
+    char* path = length > 0 ? malloc((size_t)length + 1) : NULL;
+    if (path) snprintf(path, (size_t)length + 1, "%s/%s%s", cache->directory, partition_hex, name);
+    return path;
+}
+
+// mkdir -p
+static bool make_directory(const char* path) {
+    char* copy = strdup(path);
+    if (!copy) return false;
+    
+    for (char* c = copy + 1; *c; c++) {
+        if (*c != '/') continue;
+        *c = '\0';
+        if (mkdir(copy, 0700) != 0 && errno != EEXIST) {
+            free(copy);
+            return false;
+        }
+        *c = '/';
+    }
+    bool made = mkdir(copy, 0700) == 0 || errno == EEXIST;
+    free(copy);
+    return made;
+}
+
+js_code_cache_t* js_code_cache_open(const char* directory) {
+    if (!directory || !*directory || !make_directory(directory)) return NULL;
+    
+    js_code_cache_t* cache = calloc(1, sizeof(js_code_cache_t));
+    if (!cache) return NULL;
+    cache->directory = strdup(directory);
+    if (!cache->directory) {
+        free(cache);
+        return NULL;
+    }
+    return cache;
+}
+
+void js_code_cache_close(js_code_cache_t* cache) {
+    if (!cache) return;
+    free(cache->directory);
+    free(cache);
+}
+
+void js_code_cache_use(js_engine_t* engine, js_code_cache_t* cache) {
+    if (engine) engine->compilation.code_cache = cache;
+}
+
+void js_code_cache_set_origin(js_engine_t* engine, const char* origin) {
+    if (!engine) return;
+    engine->compilation.code_cache_partitioned = origin != NULL;
+    if (origin) digest_source(origin, strlen(origin), engine->compilation.code_cache_partition);
+}
+
+static const uint8_t* engine_partition(const js_engine_t* engine) {
+    return engine->compilation.code_cache_partitioned ? engine->compilation.code_cache_partition : NULL;
+}
+
+void js_code_cache_release(void* mapping) {
+    cache_mapping_t* file = mapping;
+    if (!file || --file->references > 0) return;
+    if (file->mapped) {
+        munmap(file->base, file->size);
+    } else {
+        free(file->base);
+    }
+    free(file);
+}
+
+// Writing
+
+typedef struct {
+    js_engine_t* engine;
+    uint8_t* data;
+    size_t length;
+    size_t capacity;
+    bool failed;
+    
+    // Functions found so far, in file order; the first has no object
+    const js_bytecode_t** bytecodes;
+    js_function_t** objects;
+    cache_function_t* records;
+    uint32_t count;
+    uint32_t capacity_functions;
+} cache_writer_t;
+
+// Zeroed space for size bytes at an aligned offset
+static uint32_t reserve(cache_writer_t* writer, size_t size, size_t align) {
+    if (writer->failed) return 0;
+    
+    size_t offset = (writer->length + align - 1) & ~(align - 1);
+    if (offset + size > UINT32_MAX) {
+        writer->failed = true;
+        return 0;
+    }
+    if (offset + size > writer->capacity) {
+        size_t capacity = writer->capacity ? writer->capacity * 2 : 64 * 1024;
+        while (capacity < offset + size) capacity *= 2;
+        uint8_t* data = realloc(writer->data, capacity);
+        if (!data) {
+            writer->failed = true;
+            return 0;
+        }
+        writer->data = data;
+        writer->capacity = capacity;
+    }
+    memset(writer->data + writer->length, 0, offset + size - writer->length);
+    writer->length = offset + size;
+    return (uint32_t)offset;
+}
+
+static uint32_t write_bytes(cache_writer_t* writer, const void* bytes, size_t size, size_t align) {
+    uint32_t offset = reserve(writer, size, align);
+    if (!writer->failed && size) memcpy(writer->data + offset, bytes, size);
+    return offset;
+}
+
+static uint32_t write_string(cache_writer_t* writer, const char* string, size_t length) {
+    if (!string) return 0;
+    
+    uint32_t offset = reserve(writer, sizeof(cache_string_t) + length + 1, 4);
+    if (writer->failed) return 0;
+    cache_string_t header = { (uint32_t)length };
+    memcpy(writer->data + offset, &header, sizeof(header));
+    memcpy(writer->data + offset + sizeof(cache_string_t), string, length);
+    return offset;
+}
+
+static uint32_t write_name(cache_writer_t* writer, const char* name) {
+    return name ? write_string(writer, name, strlen(name)) : 0;
+}
+
+// Index of a function in the file, adding it the first time it is seen
+static uint32_t add_function(cache_writer_t* writer, js_function_t* object, const js_bytecode_t* bytecode) {
+    for (uint32_t i = 1; i < writer->count; i++) {
+        if (writer->objects[i] == object) return i;
+    }
+    
+    if (writer->count == writer->capacity_functions) {
+        uint32_t capacity = writer->capacity_functions ? writer->capacity_functions * 2 : 16;
+        const js_bytecode_t** bytecodes = realloc(writer->bytecodes, capacity * sizeof(js_bytecode_t*));
+        if (bytecodes) writer->bytecodes = bytecodes;
+        js_function_t** objects = realloc(writer->objects, capacity * sizeof(js_function_t*));
+        if (objects) writer->objects = objects;
+        cache_function_t* records = realloc(writer->records, capacity * sizeof(cache_function_t));
+        if (records) writer->records = records;
+        if (!bytecodes || !objects || !records) {
+            writer->failed = true;
+            return 0;
+        }
+        writer->capacity_functions = capacity;
+    }
+    writer->bytecodes[writer->count] = bytecode;
+    writer->objects[writer->count] = object;
+    return writer->count++;
+}
+
+// Constants must be primitives, strings without NULs, or functions whose
+// behaviour is all in their bytecode
+static bool write_constant(cache_writer_t* writer, js_value_t value, cache_constant_t* constant) {
+    memset(constant, 0, sizeof(cache_constant_t));
+    if (js_value_is_string(value)) {
+        const js_string_t* string = js_value_as_string(value);
+        if (strlen(string->data) != string->length) return false;
+        constant->type = CONSTANT_STRING;
+        constant->index = write_string(writer, string->data, string->length);
+        return true;
+    }
+    if (js_value_type(value) == JS_TYPE_FUNCTION) {
+        js_function_t* function = (js_function_t*)js_value_as_object(value);
+        if (function->kind == FUNCTION_NATIVE || !function->bytecode || function->bound_arg_count || !js_value_is_undefined(function->bound_this)) return false;
+        if (function->bound_context && function->bound_context != writer->engine->global_context) return false;
+        constant->type = CONSTANT_FUNCTION;
+        constant->index = add_function(writer, function, function->bytecode);
+        return true;
+    }
+    if (js_value_is_cell(value)) return false;
+    
+    constant->type = CONSTANT_VALUE;
+    constant->bits = value.bits;
+    return true;
+}
+
+static bool write_function(cache_writer_t* writer, uint32_t index) {
+    const js_bytecode_t* bytecode = writer->bytecodes[index];
+    js_function_t* object = writer->objects[index];
+    cache_function_t record = { 0 };
+    
+    record.name = write_name(writer, bytecode->name);
+    record.code = write_bytes(writer, bytecode->code, bytecode->length * sizeof(uint32_t), sizeof(uint32_t));
+    record.length = bytecode->length;
+    record.parameter_count = bytecode->parameter_count;
+    record.local_count = bytecode->local_count;
+    record.stack_size = bytecode->stack_size;
+    
+    record.constants = reserve(writer, bytecode->constant_count * sizeof(cache_constant_t), 8);
+    record.constant_count = bytecode->constant_count;
+    for (uint32_t i = 0; i < bytecode->constant_count; i++) {
+        cache_constant_t constant;
+        if (!write_constant(writer, bytecode->constants[i], &constant)) return false;
+        if (!writer->failed) memcpy(writer->data + record.constants + i * sizeof(cache_constant_t), &constant, sizeof(constant));
+    }
+    
+    record.ics = reserve(writer, bytecode->ic_count * sizeof(uint32_t), 4);
+    record.ic_count = bytecode->ic_count;
+    for (uint32_t i = 0; i < bytecode->ic_count; i++) {
+        uint32_t name = write_name(writer, atom_string(bytecode->ics[i].key));
+        if (!writer->failed) memcpy(writer->data + record.ics + i * sizeof(uint32_t), &name, sizeof(name));
+    }
+    
+    if (object) {
+        record.kind = (uint8_t)object->kind;
+        record.bytecode_size = object->bytecode_size;
+        record.global_context = object->bound_context != NULL;
+        record.parameters = reserve(writer, object->parameter_count * sizeof(uint32_t), 4);
+        record.parameter_name_count = object->parameter_count;
+        for (uint32_t i = 0; i < object->parameter_count; i++) {
+            uint32_t name = write_name(writer, object->parameters ? object->parameters[i] : NULL);
+            if (!writer->failed) memcpy(writer->data + record.parameters + i * sizeof(uint32_t), &name, sizeof(name));
+        }
+    }
+    
+    if (!writer->failed) writer->records[index] = record;
+    return !writer->failed;
+}
+
+// Writes next to path and renames over it
+static bool write_file(const char* directory, const char* path, const uint8_t* data, size_t length) {
+    size_t template_length = strlen(directory) + sizeof("/.tmp-XXXXXX");
+    char* temporary = malloc(template_length);
+    if (!temporary) return false;
+    snprintf(temporary, template_length, "%s/.tmp-XXXXXX", directory);
+    
+    int fd = mkstemp(temporary);
+    if (fd < 0) {
+        free(temporary);
+        return false;
+    }
+    
+    size_t written = 0;
+    while (written < length) {
+        ssize_t result = write(fd, data + written, length - written);
+        if (result < 0 && errno == EINTR) continue;
+        if (result <= 0) break;
+        written += (size_t)result;
+    }
+    bool stored = close(fd) == 0 && written == length && rename(temporary, path) == 0;
+    if (!stored) unlink(temporary);
+    free(temporary);
+    return stored;
+}
+
+void* js_code_cache_encode(js_engine_t* engine, const char* source, size_t length, js_code_kind_t kind, const js_bytecode_t* bytecode, size_t* size) {
+    if (!engine || !source || !bytecode || !size) return NULL;
+    
+    cache_writer_t writer = { 0 };
+    writer.engine = engine;
+    uint32_t header_offset = reserve(&writer, sizeof(cache_header_t), 8);
+    add_function(&writer, NULL, bytecode);
+    
+    // Functions are appended as their constants are written
+    bool cacheable = !writer.failed;
+    for (uint32_t i = 0; cacheable && i < writer.count; i++) {
+        cacheable = write_function(&writer, i);
+    }
+    
+    cache_header_t header = { 0 };
+    header.magic = JS_CODE_CACHE_MAGIC;
+    header.version = JS_BYTECODE_VERSION;
+    header.abi = abi_tag();
+    header.kind = kind;
+    digest_source(source, length, header.source_digest);
+    header.source_length = length;
+    header.functions = cacheable ? write_bytes(&writer, writer.records, writer.count * sizeof(cache_function_t), 8) : 0;
+    header.function_count = writer.count;
+    header.size = writer.length;
+    
+    free(writer.bytecodes);
+    free(writer.objects);
+    free(writer.records);
+    if (!cacheable || writer.failed) {
+        free(writer.data);
+        return NULL;
+    }
+    memcpy(writer.data + header_offset, &header, sizeof(header));
+    *size = writer.length;
+    return writer.data;
+}
+
+bool js_code_cache_write(js_code_cache_t* cache, const uint8_t* partition, const char* source, size_t length, js_code_kind_t kind, const void* data, size_t size) {
+    if (!cache || !partition || !source || !data || length < JS_CODE_CACHE_MIN_SOURCE) return false;
+    
+    uint8_t digest[JS_CODE_CACHE_DIGEST_SIZE];
+    digest_source(source, length, digest);
+    char* directory = cache_path(cache, partition, NULL, kind);
+    char* path = cache_path(cache, partition, digest, kind);
+    bool stored = directory && path && make_directory(directory) && write_file(directory, path, data, size);
+    free(directory);
+    free(path);
+    if (stored) __atomic_add_fetch(&cache->stats.stores, 1, __ATOMIC_RELAXED);
+    return stored;
+}
+
+bool js_code_cache_store(js_engine_t* engine, const char* source, size_t length, js_code_kind_t kind, const js_bytecode_t* bytecode) {
+    js_code_cache_t* cache = engine ? engine->compilation.code_cache : NULL;
+    if (!cache || !engine_partition(engine) || !source || length < JS_CODE_CACHE_MIN_SOURCE) return false;
+    
+    size_t size;
+    void* data = js_code_cache_encode(engine, source, length, kind, bytecode, &size);
+    bool stored = data && js_code_cache_write(cache, engine_partition(engine), source, length, kind, data, size);
+    free(data);
+    return stored;
+}
+
+// Loading. Nothing in the file is trusted: every offset is bounds
+// checked and every bytecode verified before any of it can run.
+
+static bool in_file(const cache_mapping_t* file, uint64_t offset, uint64_t size, uint64_t align) {
+    return offset % align == 0 && offset <= file->size && size <= file->size - offset;
+}
+
+// False for a bad offset; a zero offset gives NULL
+static bool read_string(const cache_mapping_t* file, uint32_t offset, const char** string) {
+    *string = NULL;
+    if (!offset) return true;
+    if (!in_file(file, offset, sizeof(cache_string_t), 4)) return false;
+    
+    const cache_string_t* header = (const cache_string_t*)(file->base + offset);
+    if (!in_file(file, offset + sizeof(cache_string_t), (uint64_t)header->length + 1, 1)) return false;
+    if (header->data[header->length] != '\0' || strlen(header->data) != header->length) return false;
+    *string = header->data;
+    return true;
+}
+
+// Bytecode, ICs and the function object for one record, constants aside
+static js_bytecode_t* load_function(js_engine_t* engine, cache_mapping_t* file, const cache_function_t* record, js_value_t* object) {
+    const char* name;
+    if (!read_string(file, record->name, &name)) return NULL;
+    if (!in_file(file, record->code, (uint64_t)record->length * sizeof(uint32_t), sizeof(uint32_t))) return NULL;
+    if (!in_file(file, record->constants, (uint64_t)record->constant_count * sizeof(cache_constant_t), 8)) return NULL;
+    if (!in_file(file, record->ics, (uint64_t)record->ic_count * sizeof(uint32_t), 4)) return NULL;
+    if (!in_file(file, record->parameters, (uint64_t)record->parameter_name_count * sizeof(uint32_t), 4)) return NULL;
+    if (record->local_count < record->parameter_count) return NULL;
+    
+    js_bytecode_t* bytecode = js_bytecode_create(name, record->parameter_count);
+    if (!bytecode) return NULL;
+    bytecode->code = (uint32_t*)(file->base + record->code);
+    bytecode->length = record->length;
+    bytecode->local_count = record->local_count;
+    bytecode->stack_size = record->stack_size;
+    bytecode->mapping = file;
+    file->references++;
+    
+    const uint32_t* ics = (const uint32_t*)(file->base + record->ics);
+    for (uint32_t i = 0; i < record->ic_count; i++) {
+        const char* key;
+        if (!read_string(file, ics[i], &key) || js_bytecode_add_ic(bytecode, key ? key : "") < 0) {
+            js_bytecode_destroy(bytecode);
+            return NULL;
+        }
+    }
+    if (!object) return bytecode;
+    
+    // Nested functions get a fresh object around their bytecode
+    *object = js_create_function(engine, name, NULL);
+    if (!js_value_is_object(*object)) {
+        js_bytecode_destroy(bytecode);
+        return NULL;
+    }
+    js_function_t* function = (js_function_t*)js_value_as_object(*object);
+    function->parameters = record->parameter_name_count ? calloc(record->parameter_name_count, sizeof(char*)) : NULL;
+    function->parameter_count = function->parameters ? record->parameter_name_count : 0;
+    const uint32_t* parameters = (const uint32_t*)(file->base + record->parameters);
+    for (uint32_t i = 0; i < function->parameter_count; i++) {
+        const char* parameter;
+        if (read_string(file, parameters[i], &parameter) && parameter) function->parameters[i] = strdup(parameter);
+    }
+    function->kind = record->kind;
+    function->bytecode = bytecode;
+    function->bytecode_size = record->bytecode_size;
+    function->bound_context = record->global_context ? engine->global_context : NULL;
+    return bytecode;
+}
+
+static bool load_constants(js_engine_t* engine, cache_mapping_t* file, const cache_function_t* record, js_bytecode_t* bytecode, const js_value_t* objects, uint32_t count) {
+    const cache_constant_t* constants = (const cache_constant_t*)(file->base + record->constants);
+    for (uint32_t i = 0; i < record->constant_count; i++) {
+        js_value_t value = { constants[i].bits };
+        switch (constants[i].type) {
+            case CONSTANT_VALUE:
+                if (js_value_is_cell(value)) return false;
+                break;
+            case CONSTANT_STRING: {
+                const char* string;
+                if (!read_string(file, constants[i].index, &string) || !string) return false;
+                value = js_create_string(engine, string);
+                break;
+            }
+            case CONSTANT_FUNCTION:
+                if (constants[i].index == 0 || constants[i].index >= count) return false;
+                value = objects[constants[i].index];
+                break;
+            default:
+                return false;
+        }
+        if (js_value_is_exception(value) || js_bytecode_add_constant(bytecode, value) < 0) return false;
+    }
+    return true;
+}
+
+// The whole file, or NULL. Functions other than the first belong to
+// their objects from here on, garbage if the load fails.
+static js_bytecode_t* load_file(js_engine_t* engine, cache_mapping_t* file, const uint8_t* digest, size_t length, js_code_kind_t kind) {
+    const cache_header_t* header = (const cache_header_t*)file->base;
+    if (header->magic != JS_CODE_CACHE_MAGIC || header->version != JS_BYTECODE_VERSION || header->abi != abi_tag()) return NULL;
+    if (header->kind != kind || header->source_length != length || header->size != file->size) return NULL;
+    if (memcmp(header->source_digest, digest, JS_CODE_CACHE_DIGEST_SIZE) != 0) return NULL;
+    if (!header->function_count || !in_file(file, header->functions, (uint64_t)header->function_count * sizeof(cache_function_t), 8)) return NULL;
+    
+    uint32_t count = header->function_count;
+    const cache_function_t* records = (const cache_function_t*)(file->base + header->functions);
+    js_bytecode_t** bytecodes = calloc(count, sizeof(js_bytecode_t*));
+    js_value_t* objects = calloc(count, sizeof(js_value_t));
+    bool loaded = bytecodes && objects;
+    
+    // Every function exists before any constant refers to it
+    for (uint32_t i = 0; loaded && i < count; i++) {
+        bytecodes[i] = load_function(engine, file, &records[i], i ? &objects[i] : NULL);
+        loaded = bytecodes[i] != NULL;
+    }
+    for (uint32_t i = 0; loaded && i < count; i++) {
+        loaded = load_constants(engine, file, &records[i], bytecodes[i], objects, count) && js_bytecode_verify(bytecodes[i], NULL, NULL);
+    }
+    
+    js_bytecode_t* result = loaded ? bytecodes[0] : NULL;
+    if (!loaded && bytecodes) {
+        for (uint32_t i = 0; i < count; i++) {
+            if (i && js_value_is_object(objects[i])) ((js_function_t*)js_value_as_object(objects[i]))->bytecode = NULL;
+            js_bytecode_destroy(bytecodes[i]);
+        }
+    }
+    free(bytecodes);
+    free(objects);
+    return result;
+}
+
+// Takes a reference on file for the load itself, then drops it
+static js_bytecode_t* load_mapping(js_engine_t* engine, cache_mapping_t* file, const uint8_t* digest, size_t length, js_code_kind_t kind) {
+    file->references = 1;
+    js_bytecode_t* bytecode = file->size >= sizeof(cache_header_t) ? load_file(engine, file, digest, length, kind) : NULL;
+    js_code_cache_release(file);
+    return bytecode;
+}
+
+js_bytecode_t* js_code_cache_load(js_engine_t* engine, const char* source, size_t length, js_code_kind_t kind) {
+    js_code_cache_t* cache = engine ? engine->compilation.code_cache : NULL;
+    if (!cache || !engine_partition(engine) || !source || length < JS_CODE_CACHE_MIN_SOURCE) return NULL;
+    
+    uint8_t digest[JS_CODE_CACHE_DIGEST_SIZE];
+    digest_source(source, length, digest);
+    char* path = cache_path(cache, engine_partition(engine), digest, kind);
+    int fd = path ? open(path, O_RDONLY | O_CLOEXEC) : -1;
+    free(path);
+    if (fd < 0) {
+        __atomic_add_fetch(&cache->stats.misses, 1, __ATOMIC_RELAXED);
+        return NULL;
+    }
+    
+    struct stat info;
+    void* base = MAP_FAILED;
+    if (fstat(fd, &info) == 0 && info.st_size >= (off_t)sizeof(cache_header_t) && (uint64_t)info.st_size <= UINT32_MAX) {
+        base = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    close(fd);
+    
+    cache_mapping_t* file = base != MAP_FAILED ? calloc(1, sizeof(cache_mapping_t)) : NULL;
+    js_bytecode_t* bytecode = NULL;
+    if (file) {
+        file->base = base;
+        file->size = (size_t)info.st_size;
+        file->mapped = true;
+        bytecode = load_mapping(engine, file, digest, length, kind);
+    } else if (base != MAP_FAILED) {
+        munmap(base, (size_t)info.st_size);
+    }
+    
+    __atomic_add_fetch(bytecode ? &cache->stats.hits : &cache->stats.rejected, 1, __ATOMIC_RELAXED);
+    return bytecode;
+}
+
+js_bytecode_t* js_code_cache_decode(js_engine_t* engine, const char* source, size_t length, js_code_kind_t kind, void* data, size_t size) {
+    cache_mapping_t* file = engine && source && data ? calloc(1, sizeof(cache_mapping_t)) : NULL;
+    if (!file) {
+        free(data);
+        return NULL;
+    }
+    file->base = data;
+    file->size = size;
+    uint8_t digest[JS_CODE_CACHE_DIGEST_SIZE];
+    digest_source(source, length, digest);
+    return load_mapping(engine, file, digest, length, kind);
+}
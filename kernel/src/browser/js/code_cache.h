@@ -0,0 +1,79 @@
+#ifndef JS_CODE_CACHE_H
+#define JS_CODE_CACHE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "bytecode.h"
+
+// Persistent code cache: compiled scripts and modules saved as files next
+// to the HTTP cache, keyed by the SHA-256 of their source, so that a later
+// load of the same source skips parsing and compiling.
+//
+// The cache is partitioned by origin: each engine reads and writes only
+// the subdirectory named by the SHA-256 of the origin it was last given
+// (js_code_cache_set_origin), so one origin cannot plant code for another
+// or learn what another has loaded. An engine with no origin is not
+// cached. A file's header repeats the source digest, and a load compares
+// it with the source's before using anything else in the file.
+//
+// A file holds one top-level bytecode and every function it creates,
+// reachable through constants. js_code_cache_load maps the file and points
+// each bytecode's instructions straight into the mapping; only names,
+// constants and fresh inline caches are built. Files are written to a
+// temporary name and renamed into place, so readers never see a partial
+// one. Files from another JS_BYTECODE_VERSION, or that fail
+// js_bytecode_verify, are treated as misses.
+//
+// js_eval and js_eval_module use engine->compilation.code_cache: they try
+// js_code_cache_load before parsing and js_code_cache_store after
+// compiling a miss.
+#define JS_CODE_CACHE_MAGIC 0x4343534a      // "JSCC"
+#define JS_CODE_CACHE_MIN_SOURCE 1024       // Smaller sources compile faster than a file opens
+#define JS_CODE_CACHE_DIGEST_SIZE 32        // SHA-256
+
+typedef struct js_code_cache {
+    char* directory;
+    struct {
+        uint64_t hits;
+        uint64_t misses;
+        uint64_t stores;
+        uint64_t rejected;          // Unreadable, stale or failed to verify
+    } stats;                        // Updated atomically
+} js_code_cache_t;
+
+// Opens directory, creating it if needed; NULL if it cannot be created
+js_code_cache_t* js_code_cache_open(const char* directory);
+void js_code_cache_close(js_code_cache_t* cache);
+
+// Sets compilation.code_cache; engines may share one cache
+void js_code_cache_use(js_engine_t* engine, js_code_cache_t* cache);
+
+// Sets the partition engine's code is cached in, as on navigation. origin
+// is serialized ("https://example.com:443"); NULL, for an opaque origin,
+// stops caching.
+void js_code_cache_set_origin(js_engine_t* engine, const char* origin);
+
+// Compiled code for source, or NULL on a miss. The bytecode and its
+// functions share the file mapping until the last is destroyed.
+js_bytecode_t* js_code_cache_load(js_engine_t* engine, const char* source, size_t length, js_code_kind_t kind);
+
+// Saves freshly compiled code for source. False when there is no cache,
+// the source is too small, or the code holds constants other than
+// primitives, strings and functions with bytecode.
+bool js_code_cache_store(js_engine_t* engine, const char* source, size_t length, js_code_kind_t kind, const js_bytecode_t* bytecode);
+
+// The same format in memory, for code compiled by another engine:
+// encode where it was compiled, decode into the engine that runs it.
+// encode returns a malloc'd buffer, or NULL as store would fail; decode
+// takes the buffer whether or not it succeeds. write saves an encoded
+// buffer as store would, in partition (the code_cache_partition of the
+// engine it was compiled for; NULL when that engine is not cached).
+void* js_code_cache_encode(js_engine_t* engine, const char* source, size_t length, js_code_kind_t kind, const js_bytecode_t* bytecode, size_t* size);
+js_bytecode_t* js_code_cache_decode(js_engine_t* engine, const char* source, size_t length, js_code_kind_t kind, void* data, size_t size);
+bool js_code_cache_write(js_code_cache_t* cache, const uint8_t* partition, const char* source, size_t length, js_code_kind_t kind, const void* data, size_t size);
+
+// Drops a reference to a file mapping (js_bytecode_t.mapping)
+void js_code_cache_release(void* mapping);
+
+#endif
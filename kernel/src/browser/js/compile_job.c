@@ -0,0 +1,163 @@
+#include "compile_job.h"
+#include "code_cache.h"
+#include "engine.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+enum {
+    JOB_QUEUED,
+    JOB_RUNNING,
+    JOB_DONE,
+    JOB_CLAIMED                     // finish compiled in place before the pool got to it
+};
+
+struct js_compile_job {
+    js_engine_t* engine;
+    js_code_cache_t* cache;
+    uint8_t partition[JS_CODE_CACHE_DIGEST_SIZE];
+    bool partitioned;               // The engine's origin when the job started
+    char* source;
+    size_t length;
+    char* filename;
+    js_code_kind_t kind;
+    js_compile_done_t done;
+    void* data;
+    
+    // Result, owned by the pool thread until state is JOB_DONE
+    void* encoded;
+    size_t encoded_size;
+    char* error;                    // Syntax error message
+    
+    pthread_mutex_t lock;
+    pthread_cond_t finished;
+    uint32_t state;                 // Guarded by lock
+    uint32_t references;            // The owner and the pool task
+};
+
+static void job_release(js_compile_job_t* job) {
+    if (__atomic_sub_fetch(&job->references, 1, __ATOMIC_ACQ_REL) != 0) return;
+    pthread_cond_destroy(&job->finished);
+    pthread_mutex_destroy(&job->lock);
+    free(job->encoded);
+    free(job->error);
+    free(job->filename);
+    free(job->source);
+    free(job);
+}
+
+// Compiles in a scratch engine; only the encoded form outlives it
+static void job_compile(js_compile_job_t* job) {
+    js_engine_t* scratch = js_engine_create(JS_COMPILE_HEAP_SIZE);
+    if (!scratch) return;
+    if (js_engine_init(scratch) == 0) {
+        js_bytecode_t* bytecode = js_compile(scratch, job->source, job->filename, job->kind);
+        if (bytecode) {
+            job->encoded = js_code_cache_encode(scratch, job->source, job->length, job->kind, bytecode, &job->encoded_size);
+            js_bytecode_destroy(bytecode);
+        } else if (!js_value_is_undefined(scratch->error.last_exception)) {
+            job->error = js_to_string(scratch->error.last_exception);
+            if (!job->error) job->error = strdup("SyntaxError");
+        }
+    }
+    js_engine_destroy(scratch);
+    
+    // Saved here so that the engine's thread never writes the file
+    if (job->encoded && job->cache) {
+        js_code_cache_write(job->cache, job->partitioned ? job->partition : NULL, job->source, job->length, job->kind, job->encoded, job->encoded_size);
+    }
+}
+
+static void job_task(void* data) {
+    js_compile_job_t* job = data;
+    
+    pthread_mutex_lock(&job->lock);
+    bool claimed = job->state == JOB_CLAIMED;
+    if (!claimed) job->state = JOB_RUNNING;
+    pthread_mutex_unlock(&job->lock);
+    
+    if (!claimed) {
+        job_compile(job);
+        pthread_mutex_lock(&job->lock);
+        job->state = JOB_DONE;
+        pthread_cond_broadcast(&job->finished);
+        pthread_mutex_unlock(&job->lock);
+    }
+    if (job->done) job->done(job->data);
+    job_release(job);
+}
+
+js_compile_job_t* js_compile_job_start(js_engine_t* engine, worker_pool_t* pool, worker_group_t* group, const char* source, size_t length, const char* filename, js_code_kind_t kind, js_compile_done_t done, void* data) {
+    if (!engine || !pool || !source) return NULL;
+    
+    js_compile_job_t* job = calloc(1, sizeof(js_compile_job_t));
+    if (!job) return NULL;
+    job->source = malloc(length + 1);
+    job->filename = strdup(filename ? filename : "<script>");
+    if (!job->source || !job->filename) {
+        free(job->filename);
+        free(job->source);
+        free(job);
+        return NULL;
+    }
+    memcpy(job->source, source, length);
+    job->source[length] = '\0';
+    job->length = length;
+    job->engine = engine;
+    job->cache = engine->compilation.code_cache;
+    job->partitioned = engine->compilation.code_cache_partitioned;
+    memcpy(job->partition, engine->compilation.code_cache_partition, JS_CODE_CACHE_DIGEST_SIZE);
+    job->kind = kind;
+    job->done = done;
+    job->data = data;
+    job->state = JOB_QUEUED;
+    job->references = 2;
+    pthread_mutex_init(&job->lock, NULL);
+    pthread_cond_init(&job->finished, NULL);
+    
+    worker_pool_submit(pool, group, job_task, job);
+    return job;
+}
+
+bool js_compile_job_ready(js_compile_job_t* job) {
+    if (!job) return true;
+    pthread_mutex_lock(&job->lock);
+    bool ready = job->state == JOB_DONE;
+    pthread_mutex_unlock(&job->lock);
+    return ready;
+}
+
+js_bytecode_t* js_compile_job_finish(js_compile_job_t* job) {
+    if (!job) return NULL;
+    js_engine_t* engine = job->engine;
+    
+    // A job still queued is claimed rather than waited for
+    pthread_mutex_lock(&job->lock);
+    if (job->state == JOB_QUEUED) job->state = JOB_CLAIMED;
+    while (job->state == JOB_RUNNING) pthread_cond_wait(&job->finished, &job->lock);
+    pthread_mutex_unlock(&job->lock);
+    
+    js_bytecode_t* bytecode = NULL;
+    if (job->encoded) {
+        bytecode = js_code_cache_decode(engine, job->source, job->length, job->kind, job->encoded, job->encoded_size);
+        job->encoded = NULL;
+    }
+    if (!bytecode) {
+        if (job->error) {
+            js_throw(engine, js_create_syntax_error(engine, job->error));
+        } else {
+            bytecode = js_compile(engine, job->source, job->filename, job->kind);
+            if (bytecode) js_code_cache_store(engine, job->source, job->length, job->kind, bytecode);
+        }
+    }
+    job_release(job);
+    return bytecode;
+}
+
+void js_compile_job_discard(js_compile_job_t* job) {
+    if (!job) return;
+    pthread_mutex_lock(&job->lock);
+    if (job->state == JOB_QUEUED) job->state = JOB_CLAIMED;
+    pthread_mutex_unlock(&job->lock);
+    job_release(job);
+}
@@ -0,0 +1,40 @@
+#ifndef JS_COMPILE_JOB_H
+#define JS_COMPILE_JOB_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "bytecode.h"
+#include "../worker_pool.h"
+
+// Off-thread compilation. Bytecode constants live in a heap, and a heap
+// belongs to the thread running its engine, so a job compiles on a pool
+// thread into an engine of its own and hands the result over in the code
+// cache's heap-independent form (code_cache.h). js_compile_job_finish
+// decodes it into the engine that will run it, which costs a small
+// fraction of the parse. The job also saves it to the engine's code cache.
+#define JS_COMPILE_OFF_THREAD_MIN (32 * 1024) // Smaller sources compile in place
+#define JS_COMPILE_HEAP_SIZE (64 * 1024 * 1024)
+
+typedef struct js_compile_job js_compile_job_t;
+
+// Runs on the pool thread once the result is ready. It must only hand
+// off to the engine's own thread, e.g. with js_queue_task.
+typedef void (*js_compile_done_t)(void* data);
+
+// Copies source and starts compiling it for engine. NULL when the job
+// cannot be created; compile in place then. A group, when not NULL, counts
+// the job until done has returned, so an owner can worker_pool_wait on it
+// before tearing down what done refers to.
+js_compile_job_t* js_compile_job_start(js_engine_t* engine, worker_pool_t* pool, worker_group_t* group, const char* source, size_t length, const char* filename, js_code_kind_t kind, js_compile_done_t done, void* data);
+bool js_compile_job_ready(js_compile_job_t* job);
+
+// Bytecode for the engine's thread, waiting for the job if it is still
+// running, and freeing it. NULL on a syntax error, thrown in the engine.
+// Code the job could not hand over is compiled here instead.
+js_bytecode_t* js_compile_job_finish(js_compile_job_t* job);
+
+// Drops a job whose result is no longer wanted; done still runs
+void js_compile_job_discard(js_compile_job_t* job);
+
+#endif
@@ -0,0 +1,169 @@
+#include "dom_binding.h"
+#include "gc.h"
+#include <string.h>
+
+// Wrappers
+
+static void* wrapper_group(js_cell_t* cell) {
+    dom_node_t* node = ((js_object_t*)cell)->internal_slots;
+    if (!node) return NULL;
+    while (node->parent_node) node = node->parent_node;
+    return node;
+}
+
+static void wrapper_release(js_cell_t* cell) {
+    js_object_t* wrapper = (js_object_t*)cell;
+    dom_node_t* node = wrapper->internal_slots;
+    if (node && node->wrapper == wrapper) node->wrapper = NULL;
+    wrapper->internal_slots = NULL;
+}
+
+static const js_gc_wrapper_ops_t wrapper_ops = {
+    .group = wrapper_group,
+    .release = wrapper_release
+};
+
+// NULL for a node another engine has wrapped
+js_object_t* js_wrap_dom_node(js_engine_t* engine, struct dom_node* node) {
+    if (!engine || !node) return NULL;
+    if (node->wrapper) {
+        return js_gc_heap_of(&node->wrapper->base) == engine->memory.heap ? node->wrapper : NULL;
+    }
+    
+    js_value_t value = js_create_object(engine);
+    if (js_value_is_exception(value)) return NULL;
+    js_object_t* wrapper = js_value_as_object(value);
+    if (!js_gc_register_wrapper(&wrapper->base, &wrapper_ops)) return NULL;
+    wrapper->internal_slots = node;
+    node->wrapper = wrapper;
+    return wrapper;
+}
+
+struct dom_node* js_unwrap_dom_node(js_value_t value) {
+    js_object_t* object = js_value_as_object(value);
+    if (!object || !(object->base.gc_flags & JS_GC_WRAPPER)) return NULL;
+    return object->internal_slots;
+}
+
+void js_dom_forget_document(js_engine_t* engine, dom_document_t* document) {
+    js_gc_heap_t* heap = engine ? engine->memory.heap : NULL;
+    if (!heap || !document) return;
+    
+    for (uint32_t i = 0; i < heap->wrappers.count; i++) {
+        js_object_t* wrapper = (js_object_t*)heap->wrappers.items[i];
+        dom_node_t* node = wrapper->internal_slots;
+        if (node && (node == &document->base || node->owner_document == document)) wrapper_release(&wrapper->base);
+    }
+}
+
+// Strings
+
+js_value_t js_dom_atom_string(js_engine_t* engine, atom_t atom) {
+    if (atom == ATOM_NULL) return js_create_string_view(engine, "", 0);
+    return js_create_string_view(engine, atom_string(atom), atom_length(atom));
+}
+
+js_value_t js_dom_string(js_engine_t* engine, const char* value, uint32_t length) {
+    if (!value || !length) return js_create_string_view(engine, "", 0);
+    
+    atom_t atom = length <= JS_DOM_ATOM_LOOKUP_MAX ? atom_lookup_len(value, length) : ATOM_NULL;
+    if (atom != ATOM_NULL) return js_create_string_view(engine, atom_string(atom), length);
+    return js_create_string_length(engine, value, length);
+}
+
+static js_value_t literal_string(js_engine_t* engine, const char* literal) {
+    return js_create_string_view(engine, literal, (uint32_t)strlen(literal));
+}
+
+js_value_t js_dom_node_name(js_engine_t* engine, dom_node_t* node) {
+    switch (node->type) {
+        case NODE_TEXT: return literal_string(engine, "#text");
+        case NODE_CDATA_SECTION: return literal_string(engine, "#cdata-section");
+        case NODE_COMMENT: return literal_string(engine, "#comment");
+        case NODE_DOCUMENT: return literal_string(engine, "#document");
+        case NODE_DOCUMENT_FRAGMENT: return literal_string(engine, "#document-fragment");
+        default: break;
+    }
+    
+    // Element names come from a small set, so interning them keeps the
+    // table small and turns every later read into a view
+    if (!node->node_name) return literal_string(engine, "");
+    return js_dom_atom_string(engine, atom_intern(node->node_name));
+}
+
+// Text and comment nodes keep their data in the same place
+static bool character_data(const dom_node_t* node, const char** data, uint32_t* length) {
+    switch (node->type) {
+        case NODE_TEXT:
+        case NODE_CDATA_SECTION:
+            *data = ((const dom_text_t*)node)->data;
+            *length = ((const dom_text_t*)node)->length;
+            return true;
+        case NODE_COMMENT:
+            *data = ((const dom_comment_t*)node)->data;
+            *length = ((const dom_comment_t*)node)->length;
+            return true;
+        case NODE_PROCESSING_INSTRUCTION:
+            *data = node->node_value;
+            *length = node->node_value ? (uint32_t)strlen(node->node_value) : 0;
+            return true;
+        default:
+            return false;
+    }
+}
+
+// Preorder successor of node within root
+static dom_node_t* next_in_tree(dom_node_t* node, const dom_node_t* root) {
+    if (node->first_child) return node->first_child;
+    while (node != root) {
+        if (node->next_sibling) return node->next_sibling;
+        node = node->parent_node;
+    }
+    return NULL;
+}
+
+// Concatenates the descendant text nodes: one pass to size the string,
+// one to fill it in
+js_value_t js_dom_text_content(js_engine_t* engine, dom_node_t* node) {
+    const char* data;
+    uint32_t length;
+    if (character_data(node, &data, &length)) return js_dom_string(engine, data, length);
+    if (node->type == NODE_DOCUMENT || node->type == NODE_DOCUMENT_TYPE) return JS_NULL;
+    
+    uint64_t total = 0;
+    uint32_t texts = 0;
+    dom_node_t* only = NULL;
+    for (dom_node_t* child = next_in_tree(node, node); child; child = next_in_tree(child, node)) {
+        if (child->type != NODE_TEXT && child->type != NODE_CDATA_SECTION) continue;
+        total += ((dom_text_t*)child)->length;
+        texts++;
+        only = child;
+    }
+    if (texts == 1) return js_dom_string(engine, ((dom_text_t*)only)->data, ((dom_text_t*)only)->length);
+    if (total > UINT32_MAX) return JS_EXCEPTION;
+    
+    js_string_t* string = js_alloc_string(engine, (uint32_t)total);
+    if (!string) return JS_EXCEPTION;
+    char* cursor = string->chars;
+    for (dom_node_t* child = next_in_tree(node, node); child; child = next_in_tree(child, node)) {
+        if (child->type != NODE_TEXT && child->type != NODE_CDATA_SECTION) continue;
+        dom_text_t* text = (dom_text_t*)child;
+        if (text->length) memcpy(cursor, text->data, text->length);
+        cursor += text->length;
+    }
+    return js_value_from_cell(&string->base);
+}
+
+js_value_t js_dom_get_attribute(js_engine_t* engine, dom_element_t* element, const char* name) {
+    dom_attribute_t* attribute = dom_element_get_attribute_node(element, name);
+    if (!attribute) return JS_NULL;
+    if (attribute->name_atom == ATOM_id && element->id_atom != ATOM_NULL) return js_dom_atom_string(engine, element->id_atom);
+    
+    const char* value = attribute->value ? attribute->value : "";
+    return js_dom_string(engine, value, (uint32_t)strlen(value));
+}
+
+js_value_t js_dom_element_id(js_engine_t* engine, dom_element_t* element) {
+    if (element->id_atom != ATOM_NULL) return js_dom_atom_string(engine, element->id_atom);
+    return js_dom_string(engine, element->id, element->id ? (uint32_t)strlen(element->id) : 0);
+}
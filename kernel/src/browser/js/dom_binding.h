@@ -0,0 +1,39 @@
+#ifndef JS_DOM_BINDING_H
+#define JS_DOM_BINDING_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "engine.h"
+#include "../html/dom.h"
+
+// Wrappers and strings behind the DOM bindings.
+//
+// js_wrap_dom_node hands out one wrapper per node, cached on
+// dom_node.wrapper, and js_unwrap_dom_node takes it back. The collector
+// groups wrappers by the root of their node's tree (gc.h): a wrapper
+// lives while script can reach any node of its tree, so expandos
+// survive a trip through the DOM. Before a document is destroyed,
+// js_dom_forget_document cuts its wrappers loose; they unwrap to NULL
+// from then on.
+//
+// Strings handed to script skip malloc. Interned names and values (tag
+// and attribute names, ids, and any value already in the atom table)
+// become views over atom storage, which never changes and lives as long
+// as the process. Anything else lives in the document arena, which is
+// recycled as the DOM changes, so it is copied once, straight into the
+// heap.
+#define JS_DOM_ATOM_LOOKUP_MAX 64       // Longer values are never looked up
+
+js_value_t js_dom_string(js_engine_t* engine, const char* value, uint32_t length);
+js_value_t js_dom_atom_string(js_engine_t* engine, atom_t atom);
+
+// Getters. JS_EXCEPTION when allocation fails; a missing attribute, and
+// the text content of documents and doctypes, is JS_NULL.
+js_value_t js_dom_node_name(js_engine_t* engine, dom_node_t* node);
+js_value_t js_dom_text_content(js_engine_t* engine, dom_node_t* node);
+js_value_t js_dom_get_attribute(js_engine_t* engine, dom_element_t* element, const char* name);
+js_value_t js_dom_element_id(js_engine_t* engine, dom_element_t* element);
+
+void js_dom_forget_document(js_engine_t* engine, dom_document_t* document);
+
+#endif
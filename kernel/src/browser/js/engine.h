@@ -3,8 +3,10 @@
 
 #include <stdint.h>
 #include <stdbool.h>
+#include <stddef.h>
 
 // Forward declarations
+struct js_shape;
 struct dom_node;
 struct dom_document;
 struct dom_element;
@@ -33,39 +35,168 @@ typedef enum {
     JS_TYPE_TYPEDARRAY
 } js_value_type_t;
 
-// JavaScript value
+// JavaScript value: a NaN-boxed 64-bit word passed by value. Doubles
+// are stored as themselves, with every NaN canonicalised to one bit
+// pattern. Everything else lives in the negative quiet-NaN space, tagged
+// in bits 48-63: int32s, booleans, null and undefined are immediates that
+// never allocate, while strings, symbols, bigints and objects point at a
+// heap cell. Cells are garbage collected (see gc.h).
 typedef struct js_value {
-    js_value_type_t type;
-    union {
-        bool boolean;
-        double number;
-        char* string;
-        void* object;
-        int64_t bigint;
-        struct {
-            char* description;
-            uint64_t id;
-        } symbol;
-    } value;
-    uint32_t ref_count;
+    uint64_t bits;
 } js_value_t;
 
-// JavaScript object
+#define JS_TAG_SHIFT 48
+#define JS_TAG_INT 0xfff9ull
+#define JS_TAG_SPECIAL 0xfffaull
+#define JS_TAG_STRING 0xfffbull
+#define JS_TAG_OBJECT 0xfffcull        // Every js_object_t kind
+#define JS_TAG_CELL 0xfffdull          // Symbols and bigints
+#define JS_PAYLOAD_MASK 0x0000ffffffffffffull
+#define JS_CANONICAL_NAN 0x7ff8000000000000ull
+
+// JS_TAG_SPECIAL payloads. JS_SPECIAL_EXCEPTION is never visible to
+// scripts: functions return it when an exception is pending.
+#define JS_SPECIAL_UNDEFINED 0
+#define JS_SPECIAL_NULL 1
+#define JS_SPECIAL_FALSE 2
+#define JS_SPECIAL_TRUE 3
+#define JS_SPECIAL_EXCEPTION 4
+
+#define JS_VALUE_MAKE(tag, payload) ((js_value_t){ ((uint64_t)(tag) << JS_TAG_SHIFT) | ((uint64_t)(payload) & JS_PAYLOAD_MASK) })
+#define JS_UNDEFINED JS_VALUE_MAKE(JS_TAG_SPECIAL, JS_SPECIAL_UNDEFINED)
+#define JS_NULL JS_VALUE_MAKE(JS_TAG_SPECIAL, JS_SPECIAL_NULL)
+#define JS_FALSE JS_VALUE_MAKE(JS_TAG_SPECIAL, JS_SPECIAL_FALSE)
+#define JS_TRUE JS_VALUE_MAKE(JS_TAG_SPECIAL, JS_SPECIAL_TRUE)
+#define JS_EXCEPTION JS_VALUE_MAKE(JS_TAG_SPECIAL, JS_SPECIAL_EXCEPTION)
+
+// Header of every heap cell
+typedef struct js_cell {
+    uint32_t size;                  // Bytes, including the header
+    uint8_t type;                   // js_value_type_t
+    uint8_t gc_flags;
+    uint8_t gc_mark;                // Epoch of the last marking that reached it
+    uint32_t protect_count;         // js_gc_protect references
+} js_cell_t;
+
+// Strings own their bytes in chars[], except views (js_create_string_view),
+// whose data points at storage outside the heap
+typedef struct {
+    js_cell_t base;
+    uint32_t length;                // Bytes, excluding the terminator
+    const char* data;               // UTF-8, NUL-terminated
+    char chars[];
+} js_string_t;
+
+typedef struct {
+    js_cell_t base;
+    char* description;              // Stored after the symbol, or NULL
+    uint64_t id;
+} js_symbol_t;
+
+typedef struct {
+    js_cell_t base;
+    int64_t value;
+} js_bigint_t;
+
+static inline uint64_t js_value_tag(js_value_t value) {
+    return value.bits >> JS_TAG_SHIFT;
+}
+
+static inline bool js_value_is_double(js_value_t value) {
+    return value.bits < (JS_TAG_INT << JS_TAG_SHIFT);
+}
+
+static inline bool js_value_is_int(js_value_t value) {
+    return js_value_tag(value) == JS_TAG_INT;
+}
+
+static inline bool js_value_is_number(js_value_t value) {
+    return value.bits <= ((JS_TAG_INT << JS_TAG_SHIFT) | 0xffffffffull);
+}
+
+static inline bool js_value_is_cell(js_value_t value) {
+    return js_value_tag(value) >= JS_TAG_STRING;
+}
+
+static inline bool js_value_is_string(js_value_t value) {
+    return js_value_tag(value) == JS_TAG_STRING;
+}
+
+static inline bool js_value_is_object(js_value_t value) {
+    return js_value_tag(value) == JS_TAG_OBJECT;
+}
+
+static inline bool js_value_is_undefined(js_value_t value) {
+    return value.bits == JS_UNDEFINED.bits;
+}
+
+static inline bool js_value_is_nullish(js_value_t value) {
+    return value.bits == JS_UNDEFINED.bits || value.bits == JS_NULL.bits;
+}
+
+static inline bool js_value_is_exception(js_value_t value) {
+    return value.bits == JS_EXCEPTION.bits;
+}
+
+static inline bool js_value_same(js_value_t a, js_value_t b) {
+    return a.bits == b.bits;
+}
+
+static inline int32_t js_value_as_int(js_value_t value) {
+    return (int32_t)(uint32_t)value.bits;
+}
+
+static inline double js_value_as_double(js_value_t value) {
+    union { uint64_t bits; double number; } u = { value.bits };
+    return u.number;
+}
+
+// Either number representation
+static inline double js_value_as_number(js_value_t value) {
+    return js_value_is_int(value) ? (double)js_value_as_int(value) : js_value_as_double(value);
+}
+
+static inline js_cell_t* js_value_as_cell(js_value_t value) {
+    return (js_cell_t*)(uintptr_t)(value.bits & JS_PAYLOAD_MASK);
+}
+
+static inline js_string_t* js_value_as_string(js_value_t value) {
+    return (js_string_t*)js_value_as_cell(value);
+}
+
+static inline struct js_object* js_value_as_object(js_value_t value) {
+    return js_value_is_object(value) ? (struct js_object*)js_value_as_cell(value) : NULL;
+}
+
+static inline js_value_t js_value_from_cell(const js_cell_t* cell) {
+    uint64_t tag = cell->type == JS_TYPE_STRING ? JS_TAG_STRING : (cell->type >= JS_TYPE_OBJECT ? JS_TAG_OBJECT : JS_TAG_CELL);
+    return JS_VALUE_MAKE(tag, (uintptr_t)cell);
+}
+
+static inline js_value_t js_value_from_object(const struct js_object* object) {
+    return JS_VALUE_MAKE(JS_TAG_OBJECT, (uintptr_t)object);
+}
+
+static inline js_value_type_t js_value_type(js_value_t value) {
+    if (js_value_is_number(value)) return JS_TYPE_NUMBER;
+    if (js_value_is_cell(value)) return (js_value_type_t)js_value_as_cell(value)->type;
+    switch (value.bits & JS_PAYLOAD_MASK) {
+        case JS_SPECIAL_NULL: return JS_TYPE_NULL;
+        case JS_SPECIAL_FALSE:
+        case JS_SPECIAL_TRUE: return JS_TYPE_BOOLEAN;
+        default: return JS_TYPE_UNDEFINED;
+    }
+}
+
+// JavaScript object. Property names and attributes live in the shape,
+// which objects built the same way share; values live in slots[] at the
+// index the shape assigns (see shape.h).
 typedef struct js_object {
-    js_value_t base;
+    js_cell_t base;
     struct js_object* prototype;
-    struct {
-        char* key;
-        js_value_t* value;
-        struct {
-            bool writable;
-            bool enumerable;
-            bool configurable;
-            js_value_t* (*getter)(struct js_object*);
-            void (*setter)(struct js_object*, js_value_t*);
-        } descriptor;
-    }* properties;
-    uint32_t property_count;
+    struct js_shape* shape;
+    js_value_t* slots;
+    uint32_t slot_capacity;
     void* internal_slots;
     bool extensible;
 } js_object_t;
@@ -87,13 +218,23 @@ typedef struct {
     uint32_t parameter_count;
     void* bytecode;
     uint32_t bytecode_size;
-    js_value_t* (*native_impl)(js_value_t** args, uint32_t argc);
+    js_value_t (*native_impl)(js_value_t* args, uint32_t argc);
     struct js_context* bound_context;
-    js_value_t* bound_this;
-    js_value_t** bound_args;
+    js_value_t bound_this;          // JS_UNDEFINED unless bound
+    js_value_t* bound_args;
     uint32_t bound_arg_count;
 } js_function_t;
 
+// ArrayBuffer. The bytes live outside the heap and are freed with the
+// buffer. A buffer transferred to another engine (postMessage) hands its
+// bytes over and is left detached, empty and zero length.
+typedef struct {
+    js_object_t base;
+    uint8_t* data;
+    uint32_t byte_length;
+    bool detached;
+} js_array_buffer_t;
+
 // JavaScript execution context
 typedef struct js_context {
     struct js_context* parent;
@@ -101,11 +242,11 @@ typedef struct js_context {
     js_object_t* this_binding;
     struct {
         char* name;
-        js_value_t* value;
+        js_value_t value;
     }* variables;
     uint32_t variable_count;
     struct {
-        js_value_t** stack;
+        js_value_t* stack;
         uint32_t stack_size;
         uint32_t stack_pointer;
     } execution_stack;
@@ -116,15 +257,16 @@ typedef struct js_context {
     } execution_state;
 } js_context_t;
 
-// JavaScript engine
-typedef struct {
+// JavaScript engine. Named so that headers outside js/ can forward
+// declare it.
+typedef struct js_engine {
     // Memory management
     struct {
-        void* heap;
-        uint64_t heap_size;
-        uint64_t heap_used;
-        uint32_t gc_threshold;
-        bool gc_running;
+        void* heap;                 // js_gc_heap_t, see gc.h
+        uint64_t heap_size;         // Caps old-generation growth between cycles
+        uint64_t heap_used;         // Old generation plus nursery
+        uint32_t gc_threshold;      // Nursery size; 0 uses JS_GC_NURSERY_SIZE
+        bool gc_running;            // An incremental cycle is in progress
     } memory;
     
     // Execution
@@ -142,8 +284,14 @@ typedef struct {
         void* optimizer;
         bool jit_enabled;
         uint32_t optimization_level;
+        void* code_cache;           // js_code_cache_t, see code_cache.h; may be shared
+        uint8_t code_cache_partition[32]; // SHA-256 of the origin, see js_code_cache_set_origin
+        bool code_cache_partitioned;      // Else nothing is cached
     } compilation;
     
+    // Empty shape every object starts from (js_shape_t, see shape.h)
+    void* shapes;
+    
     // Built-in objects
     struct {
         js_object_t* Object;
@@ -182,25 +330,16 @@ typedef struct {
     
     // Event loop
     struct {
-        struct {
-            void (*callback)(void*);
-            void* data;
-            uint64_t timestamp;
-        }* tasks;
-        uint32_t task_count;
-        struct {
-            void (*callback)(void*);
-            void* data;
-        }* microtasks;
-        uint32_t microtask_count;
+        void* scheduler;                  // js_event_loop_t, see event_loop.h
         bool running;
     } event_loop;
     
     // Error handling
     struct {
-        js_value_t* last_exception;
+        js_value_t last_exception;        // JS_UNDEFINED when none is pending
         char* stack_trace;
-        void (*uncaught_handler)(js_value_t*);
+        void (*uncaught_handler)(js_value_t);
+        bool interrupted;                 // Set by js_interrupt, from any thread
     } error;
 } js_engine_t;
 
@@ -210,47 +349,102 @@ void js_engine_destroy(js_engine_t* engine);
 int js_engine_init(js_engine_t* engine);
 void js_engine_shutdown(js_engine_t* engine);
 
-// Script execution
-js_value_t* js_eval(js_engine_t* engine, const char* code, const char* filename);
-js_value_t* js_eval_module(js_engine_t* engine, const char* code, const char* specifier);
-js_value_t* js_call_function(js_engine_t* engine, js_function_t* func, js_value_t* this_arg, js_value_t** args, uint32_t argc);
+// Script execution. These return JS_EXCEPTION with the exception in
+// error.last_exception when one is thrown. Sources compiled before come
+// from compilation.code_cache when one is set.
+js_value_t js_eval(js_engine_t* engine, const char* code, const char* filename);
+js_value_t js_eval_module(js_engine_t* engine, const char* code, const char* specifier);
+js_value_t js_call_function(js_engine_t* engine, js_function_t* func, js_value_t this_arg, js_value_t* args, uint32_t argc);
+
+// Stops script on engine from another thread, for tearing down an engine
+// whose own thread may be stuck in it. Whatever is running throws at its
+// next loop back-edge or call, and so does every script after it.
+void js_interrupt(js_engine_t* engine);
+
+static inline bool js_interrupted(const js_engine_t* engine) {
+    return __atomic_load_n(&engine->error.interrupted, __ATOMIC_ACQUIRE);
+}
 
 // Value operations
-js_value_t* js_create_undefined(void);
-js_value_t* js_create_null(void);
-js_value_t* js_create_boolean(bool value);
-js_value_t* js_create_number(double value);
-js_value_t* js_create_string(const char* value);
-js_value_t* js_create_symbol(const char* description);
-js_value_t* js_create_bigint(int64_t value);
-js_value_t* js_create_object(js_engine_t* engine);
-js_value_t* js_create_array(js_engine_t* engine, uint32_t length);
-js_value_t* js_create_function(js_engine_t* engine, const char* name, js_value_t* (*impl)(js_value_t**, uint32_t));
+static inline js_value_t js_create_undefined(void) {
+    return JS_UNDEFINED;
+}
+
+static inline js_value_t js_create_null(void) {
+    return JS_NULL;
+}
+
+static inline js_value_t js_create_boolean(bool value) {
+    return value ? JS_TRUE : JS_FALSE;
+}
+
+static inline js_value_t js_create_int(int32_t value) {
+    return JS_VALUE_MAKE(JS_TAG_INT, (uint32_t)value);
+}
+
+static inline js_value_t js_create_number(double value) {
+    union { double number; uint64_t bits; } u = { value };
+    if (value != value) u.bits = JS_CANONICAL_NAN;
+    return (js_value_t){ u.bits };
+}
+
+// Cell constructors return JS_EXCEPTION when allocation fails
+js_value_t js_create_string(js_engine_t* engine, const char* value);
+js_value_t js_create_string_length(js_engine_t* engine, const char* value, uint32_t length);
+
+// A string whose length bytes the caller fills in before it is used
+js_string_t* js_alloc_string(js_engine_t* engine, uint32_t length);
+
+// A string over data[0..length), which must be NUL-terminated there,
+// never change, and outlive the engine; atom_string() storage qualifies.
+// Only the cell header is allocated.
+js_value_t js_create_string_view(js_engine_t* engine, const char* data, uint32_t length);
+js_value_t js_create_symbol(js_engine_t* engine, const char* description);
+js_value_t js_create_bigint(js_engine_t* engine, int64_t value);
+js_value_t js_create_object(js_engine_t* engine);
+js_value_t js_create_array(js_engine_t* engine, uint32_t length);
+js_value_t js_create_function(js_engine_t* engine, const char* name, js_value_t (*impl)(js_value_t*, uint32_t));
+js_value_t js_create_array_buffer(js_engine_t* engine, uint32_t byte_length);
+
+// Wraps malloc'd bytes, which the buffer then owns
+js_value_t js_adopt_array_buffer(js_engine_t* engine, void* data, uint32_t byte_length);
+
+// Takes the bytes out of a buffer, leaving it detached
+void* js_array_buffer_detach(js_array_buffer_t* buffer, uint32_t* byte_length);
+
+// Native functions are passed only their arguments. While one runs, these
+// give its engine and receiver; every engine runs on one thread at a
+// time, so they are per thread.
+js_engine_t* js_native_engine(void);
+js_value_t js_native_this(void);
 
 // Type conversions
-bool js_to_boolean(js_value_t* value);
-double js_to_number(js_value_t* value);
-char* js_to_string(js_value_t* value);
-js_object_t* js_to_object(js_engine_t* engine, js_value_t* value);
-
-// Property operations
-js_value_t* js_get_property(js_object_t* object, const char* key);
-void js_set_property(js_object_t* object, const char* key, js_value_t* value);
+bool js_to_boolean(js_value_t value);
+double js_to_number(js_value_t value);
+char* js_to_string(js_value_t value);
+js_object_t* js_to_object(js_engine_t* engine, js_value_t value);
+
+// Property operations. js_get_property returns JS_UNDEFINED when the
+// property is missing.
+js_value_t js_get_property(js_object_t* object, const char* key);
+void js_set_property(js_object_t* object, const char* key, js_value_t value);
 bool js_has_property(js_object_t* object, const char* key);
 bool js_delete_property(js_object_t* object, const char* key);
+// Own enumerable names in insertion order. The strings belong to the atom
+// table; free() only the array.
 char** js_get_property_names(js_object_t* object, uint32_t* count);
 
 // Array operations
-uint32_t js_array_length(js_value_t* array);
-js_value_t* js_array_get(js_value_t* array, uint32_t index);
-void js_array_set(js_value_t* array, uint32_t index, js_value_t* value);
-void js_array_push(js_value_t* array, js_value_t* value);
-js_value_t* js_array_pop(js_value_t* array);
+uint32_t js_array_length(js_value_t array);
+js_value_t js_array_get(js_value_t array, uint32_t index);
+void js_array_set(js_value_t array, uint32_t index, js_value_t value);
+void js_array_push(js_value_t array, js_value_t value);
+js_value_t js_array_pop(js_value_t array);
 
 // DOM bindings
 void js_bind_dom(js_engine_t* engine, struct dom_document* document);
 js_object_t* js_wrap_dom_node(js_engine_t* engine, struct dom_node* node);
-struct dom_node* js_unwrap_dom_node(js_value_t* value);
+struct dom_node* js_unwrap_dom_node(js_value_t value);
 
 // Web API bindings
 void js_bind_fetch_api(js_engine_t* engine);
@@ -270,36 +464,44 @@ uint32_t js_set_interval(js_engine_t* engine, js_function_t* callback, uint32_t
 void js_clear_timeout(js_engine_t* engine, uint32_t id);
 
 // Promises
-js_value_t* js_create_promise(js_engine_t* engine);
-void js_promise_resolve(js_value_t* promise, js_value_t* value);
-void js_promise_reject(js_value_t* promise, js_value_t* reason);
-js_value_t* js_promise_then(js_value_t* promise, js_function_t* on_fulfilled, js_function_t* on_rejected);
-js_value_t* js_promise_catch(js_value_t* promise, js_function_t* on_rejected);
-js_value_t* js_promise_finally(js_value_t* promise, js_function_t* on_finally);
+js_value_t js_create_promise(js_engine_t* engine);
+void js_promise_resolve(js_value_t promise, js_value_t value);
+void js_promise_reject(js_value_t promise, js_value_t reason);
+js_value_t js_promise_then(js_value_t promise, js_function_t* on_fulfilled, js_function_t* on_rejected);
+js_value_t js_promise_catch(js_value_t promise, js_function_t* on_rejected);
+js_value_t js_promise_finally(js_value_t promise, js_function_t* on_finally);
 
 // Async/await
-js_value_t* js_await(js_engine_t* engine, js_value_t* promise);
-js_function_t* js_create_async_function(js_engine_t* engine, const char* name, js_value_t* (*impl)(js_value_t**, uint32_t));
+js_value_t js_await(js_engine_t* engine, js_value_t promise);
+js_function_t* js_create_async_function(js_engine_t* engine, const char* name, js_value_t (*impl)(js_value_t*, uint32_t));
 
 // Modules
-js_value_t* js_import_module(js_engine_t* engine, const char* specifier);
-void js_export_value(js_engine_t* engine, const char* name, js_value_t* value);
-js_value_t* js_import_value(js_engine_t* engine, const char* module, const char* name);
+js_value_t js_import_module(js_engine_t* engine, const char* specifier);
+void js_export_value(js_engine_t* engine, const char* name, js_value_t value);
+js_value_t js_import_value(js_engine_t* engine, const char* module, const char* name);
 
-// Garbage collection
+// Garbage collection (see gc.h). js_gc_run collects everything
+// unreachable now; js_gc_sweep finishes an incremental cycle early.
+// js_gc_mark keeps a value alive from inside a collection.
 void js_gc_run(js_engine_t* engine);
-void js_gc_mark(js_value_t* value);
+void js_gc_mark(js_value_t value);
 void js_gc_sweep(js_engine_t* engine);
-void js_value_retain(js_value_t* value);
-void js_value_release(js_value_t* value);
+
+// Values kept outside the heap, interpreter frames and contexts across a
+// call into script must be protected; protections nest
+bool js_gc_protect(js_value_t value);
+void js_gc_unprotect(js_value_t value);
+
+// Releases what a cell owns outside the heap, just before it is reclaimed
+void js_cell_finalize(js_cell_t* cell);
 
 // Error handling
-js_value_t* js_create_error(js_engine_t* engine, const char* message);
-js_value_t* js_create_type_error(js_engine_t* engine, const char* message);
-js_value_t* js_create_reference_error(js_engine_t* engine, const char* message);
-js_value_t* js_create_syntax_error(js_engine_t* engine, const char* message);
-void js_throw(js_engine_t* engine, js_value_t* error);
-js_value_t* js_try_catch(js_engine_t* engine, js_function_t* try_block, js_function_t* catch_block);
+js_value_t js_create_error(js_engine_t* engine, const char* message);
+js_value_t js_create_type_error(js_engine_t* engine, const char* message);
+js_value_t js_create_reference_error(js_engine_t* engine, const char* message);
+js_value_t js_create_syntax_error(js_engine_t* engine, const char* message);
+void js_throw(js_engine_t* engine, js_value_t error);
+js_value_t js_try_catch(js_engine_t* engine, js_function_t* try_block, js_function_t* catch_block);
 
 // Debugging
 void js_debugger_attach(js_engine_t* engine);
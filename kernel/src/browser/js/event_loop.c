@@ -0,0 +1,671 @@
+#include "event_loop.h"
+#include "../frame_scheduler.h"
+#include "../capacity.h"
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define RING_INITIAL_CAPACITY 64
+#define TIMER_INDEX_BITS 20
+#define TIMER_INDEX_MASK ((1u << TIMER_INDEX_BITS) - 1)
+#define TIMER_GENERATION_MASK 0xfffu
+#define TIMER_NONE UINT32_MAX
+#define TURN_TIMERS -1              // turn_order entry for due timers
+
+typedef struct {
+    void (*callback)(void*);
+    void* data;
+} loop_task_t;
+
+// FIFO ring buffers; they only grow, so a steady stream of tasks does not
+// allocate
+typedef struct {
+    loop_task_t* tasks;
+    uint32_t capacity;              // Zero or a power of two
+    uint32_t head;
+    uint32_t count;
+} task_ring_t;
+
+typedef struct {
+    uint32_t* ids;
+    uint32_t capacity;
+    uint32_t head;
+    uint32_t count;
+} id_ring_t;
+
+enum {
+    TIMER_FREE,
+    TIMER_TIMEOUT,
+    TIMER_INTERVAL,
+    TIMER_IDLE                      // In the heap only with a timeout
+};
+
+typedef struct {
+    uint64_t due;                   // frame_scheduler_now's clock
+    uint64_t sequence;              // Equal due times fire in order
+    js_function_t* callback;        // Protected while the timer exists
+    uint32_t interval_us;
+    uint32_t heap_index;            // TIMER_NONE when not in the heap
+    uint32_t next_free;
+    uint16_t generation;
+    uint8_t kind;
+} loop_timer_t;
+
+typedef struct {
+    pthread_mutex_t lock;           // Guards sources and wake_pending
+    pthread_cond_t wake;
+    task_ring_t sources[JS_TASK_SOURCE_COUNT];
+    bool wake_pending;
+    uint32_t starved;               // Turns in a row a less urgent source waited
+    
+    // The engine's thread only
+    task_ring_t microtasks;
+    bool in_checkpoint;
+    
+    loop_timer_t* timers;           // Slots; ids index them
+    uint32_t timer_count;
+    uint32_t timer_capacity;
+    uint32_t free_timer;
+    uint32_t* heap;                 // Slot indices, ordered by due time
+    uint32_t heap_count;
+    uint32_t heap_capacity;
+    uint64_t sequence;
+    
+    id_ring_t idle;                 // Idle callback ids in request order
+    uint32_t idle_pending;          // Live entries in idle
+    js_value_t time_remaining;      // IdleDeadline.timeRemaining, protected
+} js_event_loop_t;
+
+// Turn order, most urgent first
+static const int8_t turn_order[] = {
+    JS_TASK_INPUT,
+    JS_TASK_RENDER,
+    TURN_TIMERS,
+    JS_TASK_DEFAULT,
+    JS_TASK_NETWORK
+};
+
+// Deadline of the idle callback running on this thread, or 0
+static __thread uint64_t idle_deadline_us;
+
+// Rings
+
+static bool ring_push(task_ring_t* ring, loop_task_t task) {
+    if (ring->count == ring->capacity) {
+        uint32_t capacity = capacity_grow(ring->capacity, RING_INITIAL_CAPACITY, sizeof(loop_task_t));
+        loop_task_t* tasks = capacity ? malloc(capacity * sizeof(loop_task_t)) : NULL;
+        if (!tasks) return false;
+        for (uint32_t i = 0; i < ring->count; i++) {
+            tasks[i] = ring->tasks[(ring->head + i) & (ring->capacity - 1)];
+        }
+        free(ring->tasks);
+        ring->tasks = tasks;
+        ring->capacity = capacity;
+        ring->head = 0;
+    }
+    ring->tasks[(ring->head + ring->count) & (ring->capacity - 1)] = task;
+    ring->count++;
+    return true;
+}
+
+static loop_task_t ring_pop(task_ring_t* ring) {
+    loop_task_t task = ring->tasks[ring->head];
+    ring->head = (ring->head + 1) & (ring->capacity - 1);
+    ring->count--;
+    return task;
+}
+
+static bool id_ring_push(id_ring_t* ring, uint32_t id) {
+    if (ring->count == ring->capacity) {
+        uint32_t capacity = capacity_grow(ring->capacity, RING_INITIAL_CAPACITY, sizeof(uint32_t));
+        uint32_t* ids = capacity ? malloc(capacity * sizeof(uint32_t)) : NULL;
+        if (!ids) return false;
+        for (uint32_t i = 0; i < ring->count; i++) {
+            ids[i] = ring->ids[(ring->head + i) & (ring->capacity - 1)];
+        }
+        free(ring->ids);
+        ring->ids = ids;
+        ring->capacity = capacity;
+        ring->head = 0;
+    }
+    ring->ids[(ring->head + ring->count) & (ring->capacity - 1)] = id;
+    ring->count++;
+    return true;
+}
+
+static uint32_t id_ring_pop(id_ring_t* ring) {
+    uint32_t id = ring->ids[ring->head];
+    ring->head = (ring->head + 1) & (ring->capacity - 1);
+    ring->count--;
+    return id;
+}
+
+// The loop
+
+static js_event_loop_t* loop_create(void) {
+    js_event_loop_t* loop = calloc(1, sizeof(js_event_loop_t));
+    if (!loop) return NULL;
+    
+    pthread_mutex_init(&loop->lock, NULL);
+    pthread_condattr_t attributes;
+    pthread_condattr_init(&attributes);
+    pthread_condattr_setclock(&attributes, CLOCK_MONOTONIC);
+    pthread_cond_init(&loop->wake, &attributes);
+    pthread_condattr_destroy(&attributes);
+    loop->free_timer = TIMER_NONE;
+    loop->time_remaining = JS_UNDEFINED;
+    return loop;
+}
+
+// Created on first use, possibly by a thread queuing a task
+static js_event_loop_t* event_loop(js_engine_t* engine) {
+    void* loop = __atomic_load_n(&engine->event_loop.scheduler, __ATOMIC_ACQUIRE);
+    if (loop) return loop;
+    
+    js_event_loop_t* created = loop_create();
+    if (!created) return NULL;
+    if (!__atomic_compare_exchange_n(&engine->event_loop.scheduler, &loop, created, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+        pthread_cond_destroy(&created->wake);
+        pthread_mutex_destroy(&created->lock);
+        free(created);
+        return loop;
+    }
+    return created;
+}
+
+static js_event_loop_t* existing_loop(js_engine_t* engine) {
+    return engine ? __atomic_load_n(&engine->event_loop.scheduler, __ATOMIC_ACQUIRE) : NULL;
+}
+
+// Timer slots
+
+static uint32_t timer_id(const js_event_loop_t* loop, uint32_t slot) {
+    return (uint32_t)(loop->timers[slot].generation & TIMER_GENERATION_MASK) << TIMER_INDEX_BITS | (slot + 1);
+}
+
+static uint32_t timer_alloc(js_event_loop_t* loop) {
+    if (loop->free_timer != TIMER_NONE) {
+        uint32_t slot = loop->free_timer;
+        loop->free_timer = loop->timers[slot].next_free;
+        return slot;
+    }
+    if (loop->timer_count == loop->timer_capacity) {
+        if (loop->timer_capacity >= TIMER_INDEX_MASK) return TIMER_NONE;
+        uint32_t capacity = loop->timer_capacity ? loop->timer_capacity * 2 : RING_INITIAL_CAPACITY;
+        if (capacity > TIMER_INDEX_MASK) capacity = TIMER_INDEX_MASK;
+        loop_timer_t* timers = realloc(loop->timers, capacity * sizeof(loop_timer_t));
+        if (!timers) return TIMER_NONE;
+        loop->timers = timers;
+        loop->timer_capacity = capacity;
+    }
+    uint32_t slot = loop->timer_count++;
+    memset(&loop->timers[slot], 0, sizeof(loop_timer_t));
+    return slot;
+}
+
+// Frees the slot; its callback's protection is the caller's to drop
+static void timer_release(js_event_loop_t* loop, uint32_t slot) {
+    loop_timer_t* timer = &loop->timers[slot];
+    timer->kind = TIMER_FREE;
+    timer->callback = NULL;
+    timer->generation++;
+    timer->next_free = loop->free_timer;
+    loop->free_timer = slot;
+}
+
+static uint32_t timer_lookup(const js_event_loop_t* loop, uint32_t id, uint8_t kind) {
+    uint32_t slot = (id & TIMER_INDEX_MASK) - 1;
+    if (!loop || !id || slot >= loop->timer_count) return TIMER_NONE;
+    const loop_timer_t* timer = &loop->timers[slot];
+    if (timer->kind == TIMER_FREE || (timer->generation & TIMER_GENERATION_MASK) != id >> TIMER_INDEX_BITS) return TIMER_NONE;
+    if (kind != TIMER_FREE && timer->kind != kind) return TIMER_NONE;
+    return slot;
+}
+
+// Timer heap
+
+static bool timer_before(const js_event_loop_t* loop, uint32_t a, uint32_t b) {
+    const loop_timer_t* x = &loop->timers[a];
+    const loop_timer_t* y = &loop->timers[b];
+    return x->due < y->due || (x->due == y->due && x->sequence < y->sequence);
+}
+
+static void heap_place(js_event_loop_t* loop, uint32_t position, uint32_t slot) {
+    loop->heap[position] = slot;
+    loop->timers[slot].heap_index = position;
+}
+
+static void heap_up(js_event_loop_t* loop, uint32_t position) {
+    uint32_t slot = loop->heap[position];
+    while (position > 0) {
+        uint32_t parent = (position - 1) / 2;
+        if (!timer_before(loop, slot, loop->heap[parent])) break;
+        heap_place(loop, position, loop->heap[parent]);
+        position = parent;
+    }
+    heap_place(loop, position, slot);
+}
+
+static void heap_down(js_event_loop_t* loop, uint32_t position) {
+    uint32_t slot = loop->heap[position];
+    for (;;) {
+        uint32_t child = position * 2 + 1;
+        if (child >= loop->heap_count) break;
+        if (child + 1 < loop->heap_count && timer_before(loop, loop->heap[child + 1], loop->heap[child])) child++;
+        if (!timer_before(loop, loop->heap[child], slot)) break;
+        heap_place(loop, position, loop->heap[child]);
+        position = child;
+    }
+    heap_place(loop, position, slot);
+}
+
+static bool heap_insert(js_event_loop_t* loop, uint32_t slot) {
+    if (loop->heap_count == loop->heap_capacity) {
+        uint32_t capacity = capacity_grow(loop->heap_capacity, RING_INITIAL_CAPACITY, sizeof(uint32_t));
+        uint32_t* heap = capacity ? realloc(loop->heap, capacity * sizeof(uint32_t)) : NULL;
+        if (!heap) return false;
+        loop->heap = heap;
+        loop->heap_capacity = capacity;
+    }
+    heap_place(loop, loop->heap_count++, slot);
+    heap_up(loop, loop->heap_count - 1);
+    return true;
+}
+
+static void heap_remove(js_event_loop_t* loop, uint32_t slot) {
+    uint32_t position = loop->timers[slot].heap_index;
+    if (position == TIMER_NONE) return;
+    loop->timers[slot].heap_index = TIMER_NONE;
+    
+    uint32_t last = loop->heap[--loop->heap_count];
+    if (position < loop->heap_count) {
+        heap_place(loop, position, last);
+        heap_up(loop, position);
+        heap_down(loop, loop->timers[last].heap_index);
+    }
+}
+
+// Tasks
+
+void js_queue_task_from(js_engine_t* engine, js_task_source_t source, void (*callback)(void*), void* data) {
+    if (!engine || !callback || source >= JS_TASK_SOURCE_COUNT) return;
+    js_event_loop_t* loop = event_loop(engine);
+    if (!loop) return;
+    
+    pthread_mutex_lock(&loop->lock);
+    if (ring_push(&loop->sources[source], (loop_task_t){ callback, data })) {
+        pthread_cond_signal(&loop->wake);
+    }
+    pthread_mutex_unlock(&loop->lock);
+}
+
+void js_queue_task(js_engine_t* engine, void (*callback)(void*), void* data) {
+    js_queue_task_from(engine, JS_TASK_DEFAULT, callback, data);
+}
+
+void js_discard_tasks(js_engine_t* engine, void (*callback)(void*), void (*discard)(void*)) {
+    js_event_loop_t* loop = existing_loop(engine);
+    if (!loop || !callback) return;
+    
+    pthread_mutex_lock(&loop->lock);
+    for (int i = 0; i < JS_TASK_SOURCE_COUNT; i++) {
+        // Close the gaps in place; the tasks kept stay in order
+        task_ring_t* ring = &loop->sources[i];
+        uint32_t kept = 0;
+        for (uint32_t j = 0; j < ring->count; j++) {
+            loop_task_t task = ring->tasks[(ring->head + j) & (ring->capacity - 1)];
+            if (task.callback == callback) {
+                if (discard) discard(task.data);
+            } else {
+                ring->tasks[(ring->head + kept++) & (ring->capacity - 1)] = task;
+            }
+        }
+        ring->count = kept;
+    }
+    pthread_mutex_unlock(&loop->lock);
+}
+
+void js_queue_microtask(js_engine_t* engine, void (*callback)(void*), void* data) {
+    if (!engine || !callback) return;
+    js_event_loop_t* loop = event_loop(engine);
+    if (loop) ring_push(&loop->microtasks, (loop_task_t){ callback, data });
+}
+
+// Microtasks queued while the checkpoint runs join it
+void js_run_microtasks(js_engine_t* engine) {
+    js_event_loop_t* loop = existing_loop(engine);
+    if (!loop || loop->in_checkpoint) return;
+    
+    loop->in_checkpoint = true;
+    while (loop->microtasks.count > 0) {
+        loop_task_t task = ring_pop(&loop->microtasks);
+        task.callback(task.data);
+    }
+    loop->in_checkpoint = false;
+}
+
+// Timers
+
+static uint32_t timer_start(js_engine_t* engine, uint8_t kind, js_function_t* callback, uint64_t delay_us, uint32_t interval_us) {
+    if (!engine || !callback) return 0;
+    js_event_loop_t* loop = event_loop(engine);
+    if (!loop) return 0;
+    
+    uint32_t slot = timer_alloc(loop);
+    if (slot == TIMER_NONE) return 0;
+    loop_timer_t* timer = &loop->timers[slot];
+    timer->kind = kind;
+    timer->callback = callback;
+    timer->due = frame_scheduler_now() + delay_us;
+    timer->sequence = loop->sequence++;
+    timer->interval_us = interval_us;
+    timer->heap_index = TIMER_NONE;
+    if (!heap_insert(loop, slot)) {
+        timer_release(loop, slot);
+        return 0;
+    }
+    
+    js_gc_protect(js_value_from_object(&callback->base));
+    return timer_id(loop, slot);
+}
+
+uint32_t js_set_timeout(js_engine_t* engine, js_function_t* callback, uint32_t delay) {
+    return timer_start(engine, TIMER_TIMEOUT, callback, (uint64_t)delay * 1000, 0);
+}
+
+uint32_t js_set_interval(js_engine_t* engine, js_function_t* callback, uint32_t interval) {
+    // A zero interval would never let the loop go idle
+    uint32_t interval_us = (interval ? interval : 1) * 1000;
+    return timer_start(engine, TIMER_INTERVAL, callback, interval_us, interval_us);
+}
+
+// Clears timeouts and intervals alike, as in HTML
+void js_clear_timeout(js_engine_t* engine, uint32_t id) {
+    js_event_loop_t* loop = existing_loop(engine);
+    uint32_t slot = timer_lookup(loop, id, TIMER_FREE);
+    if (slot == TIMER_NONE || loop->timers[slot].kind == TIMER_IDLE) return;
+    
+    js_function_t* callback = loop->timers[slot].callback;
+    heap_remove(loop, slot);
+    timer_release(loop, slot);
+    js_gc_unprotect(js_value_from_object(&callback->base));
+}
+
+uint64_t js_event_loop_next_timer(js_engine_t* engine) {
+    js_event_loop_t* loop = existing_loop(engine);
+    if (!loop || loop->heap_count == 0) return UINT64_MAX;
+    return loop->timers[loop->heap[0]].due;
+}
+
+// Idle callbacks
+
+static js_value_t idle_time_remaining(js_value_t* args, uint32_t argc) {
+    (void)args;
+    (void)argc;
+    uint64_t now = frame_scheduler_now();
+    return js_create_number(idle_deadline_us > now ? (double)(idle_deadline_us - now) / 1000.0 : 0.0);
+}
+
+// IdleDeadline for one callback
+static js_value_t idle_deadline(js_engine_t* engine, js_event_loop_t* loop, bool did_timeout) {
+    if (js_value_is_undefined(loop->time_remaining)) {
+        js_value_t function = js_create_function(engine, "timeRemaining", idle_time_remaining);
+        if (js_value_is_exception(function)) return JS_UNDEFINED;
+        loop->time_remaining = function;
+        js_gc_protect(function);
+    }
+    
+    js_value_t deadline = js_create_object(engine);
+    if (js_value_is_exception(deadline)) return JS_UNDEFINED;
+    js_set_property(js_value_as_object(deadline), "timeRemaining", loop->time_remaining);
+    js_set_property(js_value_as_object(deadline), "didTimeout", js_create_boolean(did_timeout));
+    return deadline;
+}
+
+uint32_t js_request_idle_callback(js_engine_t* engine, js_function_t* callback, uint32_t timeout_ms) {
+    if (!engine || !callback) return 0;
+    js_event_loop_t* loop = event_loop(engine);
+    if (!loop) return 0;
+    
+    uint32_t slot = timer_alloc(loop);
+    if (slot == TIMER_NONE) return 0;
+    loop_timer_t* timer = &loop->timers[slot];
+    timer->kind = TIMER_IDLE;
+    timer->callback = callback;
+    timer->heap_index = TIMER_NONE;
+    timer->due = frame_scheduler_now() + (uint64_t)timeout_ms * 1000;
+    timer->sequence = loop->sequence++;
+    
+    uint32_t id = timer_id(loop, slot);
+    if (!id_ring_push(&loop->idle, id) || (timeout_ms && !heap_insert(loop, slot))) {
+        // An id already in the ring goes stale with the slot
+        timer_release(loop, slot);
+        return 0;
+    }
+    
+    loop->idle_pending++;
+    js_gc_protect(js_value_from_object(&callback->base));
+    return id;
+}
+
+void js_cancel_idle_callback(js_engine_t* engine, uint32_t id) {
+    js_event_loop_t* loop = existing_loop(engine);
+    uint32_t slot = timer_lookup(loop, id, TIMER_IDLE);
+    if (slot == TIMER_NONE) return;
+    
+    js_function_t* callback = loop->timers[slot].callback;
+    heap_remove(loop, slot);
+    timer_release(loop, slot);
+    loop->idle_pending--;
+    js_gc_unprotect(js_value_from_object(&callback->base));
+}
+
+static js_value_t request_idle_callback(js_value_t* args, uint32_t argc) {
+    js_engine_t* engine = js_native_engine();
+    if (argc < 1 || js_value_type(args[0]) != JS_TYPE_FUNCTION) {
+        js_throw(engine, js_create_type_error(engine, "requestIdleCallback requires a function"));
+        return JS_EXCEPTION;
+    }
+    
+    uint32_t timeout = 0;
+    if (argc > 1 && js_value_is_object(args[1])) {
+        double value = js_to_number(js_get_property(js_value_as_object(args[1]), "timeout"));
+        if (value > 0 && value < UINT32_MAX / 1000) timeout = (uint32_t)value;
+    }
+    uint32_t id = js_request_idle_callback(engine, (js_function_t*)js_value_as_object(args[0]), timeout);
+    return js_create_number(id);
+}
+
+static js_value_t cancel_idle_callback(js_value_t* args, uint32_t argc) {
+    if (argc > 0) js_cancel_idle_callback(js_native_engine(), (uint32_t)js_to_number(args[0]));
+    return JS_UNDEFINED;
+}
+
+void js_bind_idle_callback_api(js_engine_t* engine) {
+    if (!engine || !engine->global_context) return;
+    js_object_t* global = engine->global_context->global_object;
+    js_set_property(global, "requestIdleCallback", js_create_function(engine, "requestIdleCallback", request_idle_callback));
+    js_set_property(global, "cancelIdleCallback", js_create_function(engine, "cancelIdleCallback", cancel_idle_callback));
+}
+
+// Its id stays in the idle ring and is skipped as stale
+static void run_idle_callback(js_engine_t* engine, js_event_loop_t* loop, uint32_t slot, uint64_t deadline_us, bool did_timeout) {
+    js_function_t* callback = loop->timers[slot].callback;
+    heap_remove(loop, slot);
+    timer_release(loop, slot);
+    loop->idle_pending--;
+    
+    js_value_t deadline = idle_deadline(engine, loop, did_timeout);
+    uint64_t saved = idle_deadline_us;
+    idle_deadline_us = deadline_us;
+    js_call_function(engine, callback, JS_UNDEFINED, &deadline, 1);
+    idle_deadline_us = saved;
+    js_gc_unprotect(js_value_from_object(&callback->base));
+}
+
+bool js_run_idle_callbacks(js_engine_t* engine, uint64_t deadline_us) {
+    js_event_loop_t* loop = existing_loop(engine);
+    if (!loop || engine->event_loop.running) return loop && loop->idle_pending > 0;
+    
+    uint64_t now = frame_scheduler_now();
+    if (deadline_us > now + JS_IDLE_MAX_PERIOD_US) deadline_us = now + JS_IDLE_MAX_PERIOD_US;
+    
+    // Callbacks requested from inside wait for the next period
+    engine->event_loop.running = true;
+    uint32_t count = loop->idle.count;
+    while (count-- > 0 && frame_scheduler_now() < deadline_us) {
+        uint32_t slot = timer_lookup(loop, id_ring_pop(&loop->idle), TIMER_IDLE);
+        if (slot == TIMER_NONE) continue;
+        run_idle_callback(engine, loop, slot, deadline_us, false);
+        js_run_microtasks(engine);
+    }
+    engine->event_loop.running = false;
+    return loop->idle_pending > 0;
+}
+
+// Turns
+
+static void run_timer(js_engine_t* engine, js_event_loop_t* loop, uint64_t now) {
+    uint32_t slot = loop->heap[0];
+    loop_timer_t* timer = &loop->timers[slot];
+    if (timer->kind == TIMER_IDLE) {
+        run_idle_callback(engine, loop, slot, now, true);
+        return;
+    }
+    
+    // The callback stays protected through the call even if it clears
+    // its own timer
+    js_function_t* callback = timer->callback;
+    heap_remove(loop, slot);
+    if (timer->kind == TIMER_INTERVAL) {
+        timer->due = now + timer->interval_us;
+        timer->sequence = loop->sequence++;
+        heap_insert(loop, slot);    // Cannot grow: the heap just shrank
+        js_gc_protect(js_value_from_object(&callback->base));
+    } else {
+        timer_release(loop, slot);
+    }
+    
+    js_call_function(engine, callback, JS_UNDEFINED, NULL, 0);
+    js_gc_unprotect(js_value_from_object(&callback->base));
+}
+
+bool js_run_task(js_engine_t* engine) {
+    js_event_loop_t* loop = existing_loop(engine);
+    if (!loop) return false;
+    
+    uint64_t now = frame_scheduler_now();
+    bool timer_due = loop->heap_count > 0 && loop->timers[loop->heap[0]].due <= now;
+    
+    pthread_mutex_lock(&loop->lock);
+    int chosen = -1;
+    int lowest = -1;
+    for (int i = 0; i < (int)(sizeof(turn_order) / sizeof(turn_order[0])); i++) {
+        bool ready = turn_order[i] == TURN_TIMERS ? timer_due : loop->sources[turn_order[i]].count > 0;
+        if (!ready) continue;
+        if (chosen < 0) chosen = i;
+        lowest = i;
+    }
+    if (chosen < 0) {
+        pthread_mutex_unlock(&loop->lock);
+        return false;
+    }
+    
+    if (lowest == chosen) {
+        loop->starved = 0;
+    } else if (++loop->starved > JS_EVENT_LOOP_STARVATION_LIMIT) {
+        chosen = lowest;
+        loop->starved = 0;
+    }
+    
+    loop_task_t task = { NULL, NULL };
+    if (turn_order[chosen] != TURN_TIMERS) task = ring_pop(&loop->sources[turn_order[chosen]]);
+    pthread_mutex_unlock(&loop->lock);
+    
+    if (task.callback) {
+        task.callback(task.data);
+    } else {
+        run_timer(engine, loop, now);
+    }
+    js_run_microtasks(engine);
+    return true;
+}
+
+// Nested calls, e.g. from a native a task runs, return at once
+void js_run_event_loop(js_engine_t* engine) {
+    if (!engine || engine->event_loop.running) return;
+    
+    engine->event_loop.running = true;
+    js_run_microtasks(engine);
+    while (js_run_task(engine)) {}
+    engine->event_loop.running = false;
+}
+
+// Waiting
+
+static bool tasks_queued(const js_event_loop_t* loop) {
+    for (int i = 0; i < JS_TASK_SOURCE_COUNT; i++) {
+        if (loop->sources[i].count > 0) return true;
+    }
+    return false;
+}
+
+void js_event_loop_wait(js_engine_t* engine, uint64_t until_us) {
+    if (!engine) return;
+    js_event_loop_t* loop = event_loop(engine);
+    if (!loop) return;
+    
+    uint64_t next_timer = js_event_loop_next_timer(engine);
+    if (next_timer < until_us) until_us = next_timer;
+    
+    pthread_mutex_lock(&loop->lock);
+    if (until_us == UINT64_MAX) {
+        while (!loop->wake_pending && !tasks_queued(loop)) pthread_cond_wait(&loop->wake, &loop->lock);
+    } else {
+        struct timespec deadline;
+        deadline.tv_sec = (time_t)(until_us / 1000000);
+        deadline.tv_nsec = (long)(until_us % 1000000) * 1000;
+        while (!loop->wake_pending && !tasks_queued(loop)) {
+            if (pthread_cond_timedwait(&loop->wake, &loop->lock, &deadline) == ETIMEDOUT) break;
+        }
+    }
+    loop->wake_pending = false;
+    pthread_mutex_unlock(&loop->lock);
+}
+
+void js_event_loop_wake(js_engine_t* engine) {
+    js_event_loop_t* loop = engine ? event_loop(engine) : NULL;
+    if (!loop) return;
+    
+    pthread_mutex_lock(&loop->lock);
+    loop->wake_pending = true;
+    pthread_cond_broadcast(&loop->wake);
+    pthread_mutex_unlock(&loop->lock);
+}
+
+// Tasks still queued are dropped without running
+void js_event_loop_destroy(js_engine_t* engine) {
+    js_event_loop_t* loop = existing_loop(engine);
+    if (!loop) return;
+    
+    for (uint32_t i = 0; i < loop->timer_count; i++) {
+        if (loop->timers[i].kind != TIMER_FREE) {
+            js_gc_unprotect(js_value_from_object(&loop->timers[i].callback->base));
+        }
+    }
+    if (!js_value_is_undefined(loop->time_remaining)) js_gc_unprotect(loop->time_remaining);
+    
+    for (int i = 0; i < JS_TASK_SOURCE_COUNT; i++) {
+        free(loop->sources[i].tasks);
+    }
+    free(loop->microtasks.tasks);
+    free(loop->idle.ids);
+    free(loop->timers);
+    free(loop->heap);
+    pthread_cond_destroy(&loop->wake);
+    pthread_mutex_destroy(&loop->lock);
+    free(loop);
+    engine->event_loop.scheduler = NULL;
+}
@@ -0,0 +1,79 @@
+#ifndef JS_EVENT_LOOP_H
+#define JS_EVENT_LOOP_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "engine.h"
+
+// Event loop behind js_engine_t.event_loop.
+//
+// Tasks are queued by source, each source a ring buffer. A turn of the
+// loop runs one task from the most urgent source that has one, then the
+// microtask checkpoint. Due timers count as a source between rendering
+// and default tasks. So that a flood of urgent tasks cannot starve the
+// rest, a task waiting in a less urgent source is run after
+// JS_EVENT_LOOP_STARVATION_LIMIT turns passed it over.
+//
+// Timers live in a binary min-heap on their due time, so scheduling,
+// firing and clearing cost O(log n) however many are active. Ids name a
+// timer slot and that slot's generation: freed slots are reused at once,
+// and the generation catches a stale id cleared after its timer fired.
+//
+// Idle callbacks (requestIdleCallback) run only in idle periods handed
+// over by the frame scheduler, through js_run_idle_callbacks, or as a
+// timer task once their timeout passes.
+//
+// Tasks may be queued from any thread; the engine's thread runs them.
+// Microtasks, timers and idle callbacks belong to the engine's thread.
+// The loop is created on first use; js_engine_destroy releases it with
+// js_event_loop_destroy.
+#define JS_EVENT_LOOP_STARVATION_LIMIT 16
+#define JS_IDLE_MAX_PERIOD_US 50000     // Longest deadline an idle callback is given
+
+// Most urgent first
+typedef enum {
+    JS_TASK_INPUT,                  // Input event dispatch
+    JS_TASK_RENDER,                 // Rendering updates
+    JS_TASK_DEFAULT,                // js_queue_task; posted messages
+    JS_TASK_NETWORK,                // Fetch completions and script loading
+    JS_TASK_SOURCE_COUNT
+} js_task_source_t;
+
+void js_queue_task_from(js_engine_t* engine, js_task_source_t source, void (*callback)(void*), void* data);
+
+// Drops every queued task that would call callback, handing its data to
+// discard instead, for owners tearing down what those tasks refer to.
+// discard runs with the loop locked and must not queue tasks.
+void js_discard_tasks(js_engine_t* engine, void (*callback)(void*), void (*discard)(void*));
+
+// One turn: a task or due timer, then the microtask checkpoint. False
+// when nothing was ready. js_run_event_loop runs turns until none is.
+bool js_run_task(js_engine_t* engine);
+void js_run_microtasks(js_engine_t* engine);
+
+// Idle callbacks. The callback is passed an IdleDeadline. With a timeout,
+// a callback still waiting after timeout_ms runs as a timer with
+// didTimeout set. Ids are never 0.
+uint32_t js_request_idle_callback(js_engine_t* engine, js_function_t* callback, uint32_t timeout_ms);
+void js_cancel_idle_callback(js_engine_t* engine, uint32_t id);
+
+// Installs requestIdleCallback(callback, { timeout }) and
+// cancelIdleCallback on the global object
+void js_bind_idle_callback_api(js_engine_t* engine);
+
+// Runs idle callbacks requested before the call until deadline_us
+// (frame_scheduler_now's clock). Returns whether any are left.
+bool js_run_idle_callbacks(js_engine_t* engine, uint64_t deadline_us);
+
+// When the next timer is due, or UINT64_MAX with none pending
+uint64_t js_event_loop_next_timer(js_engine_t* engine);
+
+// Sleeps until a task is queued, js_event_loop_wake is called, the next
+// timer is due or until_us passes, whichever is first. A wake that came
+// since the last wait returns at once.
+void js_event_loop_wait(js_engine_t* engine, uint64_t until_us);
+void js_event_loop_wake(js_engine_t* engine);
+
+void js_event_loop_destroy(js_engine_t* engine);
+
+#endif
@@ -0,0 +1,696 @@
+#include "gc.h"
+#include "shape.h"
+#include "../frame_scheduler.h"
+#include "../capacity.h"
+#include <stdlib.h>
+#include <string.h>
+
+// Offset of a large cell from the start of its block
+#define JS_GC_LARGE_OFFSET ((sizeof(js_gc_block_t) + JS_GC_ALIGN - 1) & ~(size_t)(JS_GC_ALIGN - 1))
+
+static bool list_push(js_gc_list_t* list, js_cell_t* cell) {
+    if (list->count == list->capacity) {
+        uint32_t capacity = capacity_grow(list->capacity, 64, sizeof(js_cell_t*));
+        js_cell_t** items = capacity ? realloc(list->items, capacity * sizeof(js_cell_t*)) : NULL;
+        if (!items) return false;
+        list->items = items;
+        list->capacity = capacity;
+    }
+    list->items[list->count++] = cell;
+    return true;
+}
+
+static void list_free(js_gc_list_t* list) {
+    free(list->items);
+    memset(list, 0, sizeof(*list));
+}
+
+js_gc_heap_t* js_gc_heap(js_engine_t* engine) {
+    if (!engine) return NULL;
+    if (engine->memory.heap) return engine->memory.heap;
+    
+    js_gc_heap_t* heap = calloc(1, sizeof(js_gc_heap_t));
+    if (!heap) return NULL;
+    heap->engine = engine;
+    heap->epoch = 1;
+    heap->nursery_limit = engine->memory.gc_threshold ? engine->memory.gc_threshold : JS_GC_NURSERY_SIZE;
+    heap->major_threshold = JS_GC_MIN_MAJOR_THRESHOLD;
+    heap->alloc_line = JS_GC_FIRST_LINE;
+    engine->memory.heap = heap;
+    return heap;
+}
+
+void js_gc_heap_destroy(js_engine_t* engine) {
+    js_gc_heap_t* heap = engine ? engine->memory.heap : NULL;
+    if (!heap) return;
+    
+    for (uint32_t i = 0; i < heap->young_finalizable.count; i++) js_cell_finalize(heap->young_finalizable.items[i]);
+    for (uint32_t i = 0; i < heap->old_finalizable.count; i++) js_cell_finalize(heap->old_finalizable.items[i]);
+    for (uint32_t i = 0; i < heap->young_large.count; i++) free(js_gc_block_of(heap->young_large.items[i]));
+    for (uint32_t i = 0; i < heap->old_large.count; i++) free(js_gc_block_of(heap->old_large.items[i]));
+    for (uint32_t i = 0; i < heap->wrappers.count; i++) heap->wrapper_ops->release(heap->wrappers.items[i]);
+    for (uint32_t i = 0; i < heap->block_count; i++) free(heap->blocks[i]);
+    free(heap->blocks);
+    free(heap->live_groups);
+    
+    list_free(&heap->young_large);
+    list_free(&heap->old_large);
+    list_free(&heap->young_finalizable);
+    list_free(&heap->old_finalizable);
+    list_free(&heap->remembered);
+    list_free(&heap->protected_cells);
+    list_free(&heap->minor_stack);
+    list_free(&heap->mark_stack);
+    list_free(&heap->wrappers);
+    free(heap);
+    engine->memory.heap = NULL;
+}
+
+static void update_stats(js_gc_heap_t* heap) {
+    heap->engine->memory.heap_used = heap->old_bytes + heap->nursery_bytes;
+    heap->engine->memory.gc_running = heap->marking;
+}
+
+// Allocation
+
+static js_gc_block_t* block_create(js_gc_heap_t* heap) {
+    if (heap->block_count == heap->block_capacity) {
+        uint32_t capacity = capacity_grow(heap->block_capacity, 16, sizeof(js_gc_block_t*));
+        js_gc_block_t** blocks = capacity ? realloc(heap->blocks, capacity * sizeof(js_gc_block_t*)) : NULL;
+        if (!blocks) return NULL;
+        heap->blocks = blocks;
+        heap->block_capacity = capacity;
+    }
+    
+    void* memory = NULL;
+    if (posix_memalign(&memory, JS_GC_BLOCK_SIZE, JS_GC_BLOCK_SIZE) != 0) return NULL;
+    js_gc_block_t* block = memory;
+    memset(block, 0, sizeof(js_gc_block_t));
+    block->heap = heap;
+    heap->blocks[heap->block_count++] = block;
+    heap->system_bytes += JS_GC_BLOCK_SIZE;
+    return block;
+}
+
+// Moves the bump pointer to the next run of free lines, in a new block
+// when every block is full. Blocks are visited in order, and the order
+// restarts only after a collection: lines allocated into this cycle are
+// still unmarked, and must not be handed out twice.
+static bool next_run(js_gc_heap_t* heap) {
+    while (heap->alloc_block < heap->block_count) {
+        js_gc_block_t* block = heap->blocks[heap->alloc_block];
+        uint32_t line = heap->alloc_line;
+        while (line < JS_GC_LINE_COUNT && block->lines[line]) line++;
+        uint32_t end = line;
+        while (end < JS_GC_LINE_COUNT && !block->lines[end]) end++;
+        
+        if (line < end) {
+            heap->cursor = (char*)block + line * JS_GC_LINE_SIZE;
+            heap->limit = (char*)block + end * JS_GC_LINE_SIZE;
+            heap->alloc_line = end;
+            return true;
+        }
+        heap->alloc_block++;
+        heap->alloc_line = JS_GC_FIRST_LINE;
+    }
+    
+    js_gc_block_t* block = block_create(heap);
+    if (!block) return false;
+    heap->alloc_block = heap->block_count - 1;
+    heap->alloc_line = JS_GC_LINE_COUNT;
+    heap->cursor = (char*)block + JS_GC_FIRST_LINE * JS_GC_LINE_SIZE;
+    heap->limit = (char*)block + JS_GC_BLOCK_SIZE;
+    return true;
+}
+
+static void reset_allocator(js_gc_heap_t* heap) {
+    heap->alloc_block = 0;
+    heap->alloc_line = JS_GC_FIRST_LINE;
+    heap->cursor = NULL;
+    heap->limit = NULL;
+}
+
+static js_cell_t* large_alloc(js_gc_heap_t* heap, size_t size) {
+    size_t block_size = JS_GC_LARGE_OFFSET + size;
+    void* memory = NULL;
+    if (posix_memalign(&memory, JS_GC_BLOCK_SIZE, block_size) != 0) return NULL;
+    
+    js_gc_block_t* block = memory;
+    memset(block, 0, sizeof(js_gc_block_t));
+    block->heap = heap;
+    block->large_size = (uint32_t)block_size;
+    js_cell_t* cell = (js_cell_t*)((char*)block + JS_GC_LARGE_OFFSET);
+    if (!list_push(&heap->young_large, cell)) {
+        free(block);
+        return NULL;
+    }
+    heap->system_bytes += block_size;
+    return cell;
+}
+
+js_cell_t* js_gc_alloc(js_gc_heap_t* heap, uint8_t type, size_t size) {
+    if (!heap || size < sizeof(js_cell_t)) return NULL;
+    size = (size + JS_GC_ALIGN - 1) & ~(size_t)(JS_GC_ALIGN - 1);
+    if (size > UINT32_MAX - JS_GC_LARGE_OFFSET) return NULL;
+    
+    js_cell_t* cell;
+    if (size > JS_GC_LARGE_SIZE) {
+        cell = large_alloc(heap, size);
+        if (!cell) return NULL;
+    } else {
+        while ((size_t)(heap->limit - heap->cursor) < size) {
+            if (!next_run(heap)) return NULL;
+        }
+        cell = (js_cell_t*)heap->cursor;
+        heap->cursor += size;
+    }
+    
+    memset(cell, 0, size);
+    cell->size = (uint32_t)size;
+    cell->type = type;
+    
+    heap->nursery_bytes += size;
+    if (heap->marking) heap->slice_bytes += size;
+    if (heap->nursery_bytes >= heap->nursery_limit || heap->slice_bytes >= JS_GC_SLICE_BYTES) heap->pending = true;
+    return cell;
+}
+
+void js_gc_register_finalizer(js_cell_t* cell) {
+    if (!cell || (cell->gc_flags & JS_GC_FINALIZE)) return;
+    
+    js_gc_heap_t* heap = js_gc_heap_of(cell);
+    js_gc_list_t* list = (cell->gc_flags & JS_GC_OLD) ? &heap->old_finalizable : &heap->young_finalizable;
+    if (list_push(list, cell)) cell->gc_flags |= JS_GC_FINALIZE;
+}
+
+bool js_gc_register_wrapper(js_cell_t* cell, const js_gc_wrapper_ops_t* ops) {
+    if (!cell || !ops) return false;
+    if (cell->gc_flags & JS_GC_WRAPPER) return true;
+    
+    js_gc_heap_t* heap = js_gc_heap_of(cell);
+    if (!list_push(&heap->wrappers, cell)) return false;
+    heap->wrapper_ops = ops;
+    cell->gc_flags |= JS_GC_WRAPPER;
+    return true;
+}
+
+js_gc_slots_t* js_gc_slots_of(const js_value_t* slots) {
+    return slots ? (js_gc_slots_t*)((char*)slots - offsetof(js_gc_slots_t, values)) : NULL;
+}
+
+// Barrier and protection
+
+void js_gc_remember(js_gc_heap_t* heap, js_cell_t* owner) {
+    if (list_push(&heap->remembered, owner)) {
+        owner->gc_flags |= JS_GC_REMEMBERED;
+    } else {
+        // Without the record, only tracing everything again is safe
+        heap->full = true;
+        heap->pending = true;
+    }
+}
+
+bool js_gc_protect(js_value_t value) {
+    if (!js_value_is_cell(value)) return true;
+    
+    js_cell_t* cell = js_value_as_cell(value);
+    if (!(cell->gc_flags & JS_GC_PROTECTED)) {
+        if (!list_push(&js_gc_heap_of(cell)->protected_cells, cell)) return false;
+        cell->gc_flags |= JS_GC_PROTECTED;
+    }
+    cell->protect_count++;
+    return true;
+}
+
+void js_gc_unprotect(js_value_t value) {
+    if (!js_value_is_cell(value)) return;
+    
+    // The list entry goes at the next collection
+    js_cell_t* cell = js_value_as_cell(value);
+    if (cell->protect_count) cell->protect_count--;
+}
+
+static void compact_protected(js_gc_heap_t* heap) {
+    uint32_t kept = 0;
+    for (uint32_t i = 0; i < heap->protected_cells.count; i++) {
+        js_cell_t* cell = heap->protected_cells.items[i];
+        if (cell->protect_count) {
+            heap->protected_cells.items[kept++] = cell;
+        } else {
+            cell->gc_flags &= ~JS_GC_PROTECTED;
+        }
+    }
+    heap->protected_cells.count = kept;
+}
+
+// Tracing
+
+static void mark_lines(js_gc_heap_t* heap, js_cell_t* cell) {
+    js_gc_block_t* block = js_gc_block_of(cell);
+    if (block->large_size) return;
+    
+    uintptr_t offset = (uintptr_t)cell - (uintptr_t)block;
+    uint32_t first = (uint32_t)(offset / JS_GC_LINE_SIZE);
+    uint32_t last = (uint32_t)((offset + cell->size - 1) / JS_GC_LINE_SIZE);
+    memset(&block->lines[first], heap->epoch, last - first + 1);
+}
+
+static void trace_children(js_gc_heap_t* heap, js_cell_t* cell);
+
+static void push_grey(js_gc_heap_t* heap, js_gc_list_t* stack, js_cell_t* cell) {
+    // Out of memory for the stack: trace right away instead
+    if (!list_push(stack, cell)) trace_children(heap, cell);
+}
+
+// A young cell reached by any trace survives and becomes old in place.
+// Old cells are traced by the incremental cycle only; outside one, minor
+// collections stop at them.
+static void visit(js_gc_heap_t* heap, js_cell_t* cell) {
+    if (!(cell->gc_flags & JS_GC_OLD)) {
+        cell->gc_flags |= JS_GC_OLD;
+        cell->gc_mark = heap->epoch;
+        mark_lines(heap, cell);
+        if (heap->marking) {
+            heap->live_bytes += cell->size;
+        } else {
+            heap->old_bytes += cell->size;
+        }
+        push_grey(heap, heap->minor_tracing ? &heap->minor_stack : &heap->mark_stack, cell);
+        return;
+    }
+    
+    if (!heap->marking || cell->gc_mark == heap->epoch) return;
+    cell->gc_mark = heap->epoch;
+    mark_lines(heap, cell);
+    heap->live_bytes += cell->size;
+    push_grey(heap, &heap->mark_stack, cell);
+}
+
+static void visit_value(js_gc_heap_t* heap, js_value_t value) {
+    if (js_value_is_cell(value)) visit(heap, js_value_as_cell(value));
+}
+
+static void visit_object(js_gc_heap_t* heap, js_object_t* object) {
+    if (object) visit(heap, &object->base);
+}
+
+static void trace_children(js_gc_heap_t* heap, js_cell_t* cell) {
+    if (cell->type < JS_TYPE_OBJECT || cell->type == JS_CELL_SLOTS) return;
+    
+    js_object_t* object = (js_object_t*)cell;
+    visit_object(heap, object->prototype);
+    if (object->slots) {
+        visit(heap, &js_gc_slots_of(object->slots)->base);
+        uint32_t count = object->shape ? object->shape->property_count : 0;
+        if (count > object->slot_capacity) count = object->slot_capacity;
+        for (uint32_t i = 0; i < count; i++) visit_value(heap, object->slots[i]);
+    }
+    
+    if (cell->type == JS_TYPE_FUNCTION) {
+        js_function_t* function = (js_function_t*)cell;
+        visit_value(heap, function->bound_this);
+        for (uint32_t i = 0; i < function->bound_arg_count; i++) visit_value(heap, function->bound_args[i]);
+    }
+}
+
+static void visit_context(js_gc_heap_t* heap, js_context_t* context) {
+    for (; context; context = context->parent) {
+        visit_object(heap, context->global_object);
+        visit_object(heap, context->this_binding);
+        for (uint32_t i = 0; i < context->variable_count; i++) visit_value(heap, context->variables[i].value);
+        
+        // Interpreter frames clear their whole reservation on entry, so
+        // every cell up to the stack pointer holds a value this trace
+        // has kept alive ever since it was stored
+        if (context->execution_stack.stack) {
+            for (uint32_t i = 0; i < context->execution_stack.stack_pointer; i++) {
+                visit_value(heap, context->execution_stack.stack[i]);
+            }
+        }
+    }
+}
+
+static void visit_roots(js_gc_heap_t* heap) {
+    js_engine_t* engine = heap->engine;
+    
+    compact_protected(heap);
+    for (uint32_t i = 0; i < heap->protected_cells.count; i++) visit(heap, heap->protected_cells.items[i]);
+    
+    visit_context(heap, engine->global_context);
+    visit_context(heap, engine->current_context);
+    for (uint32_t i = 0; i < engine->context_stack.context_count; i++) {
+        visit_context(heap, engine->context_stack.contexts[i]);
+    }
+    
+    js_object_t** builtins = (js_object_t**)&engine->builtins;
+    for (size_t i = 0; i < sizeof(engine->builtins) / sizeof(js_object_t*); i++) visit_object(heap, builtins[i]);
+    for (uint32_t i = 0; i < engine->modules.module_count; i++) visit_object(heap, engine->modules.modules[i].namespace);
+    visit_value(heap, engine->error.last_exception);
+}
+
+// Remembered cells are old, and all that has to be traced of them is what
+// was written since the last collection; tracing every child is simpler
+// and also shades the old ones an incremental cycle has not reached yet
+static void trace_remembered(js_gc_heap_t* heap, bool trace) {
+    for (uint32_t i = 0; i < heap->remembered.count; i++) {
+        js_cell_t* cell = heap->remembered.items[i];
+        cell->gc_flags &= ~JS_GC_REMEMBERED;
+        if (trace) trace_children(heap, cell);
+    }
+    heap->remembered.count = 0;
+}
+
+static void drain(js_gc_heap_t* heap, js_gc_list_t* stack) {
+    while (stack->count) trace_children(heap, stack->items[--stack->count]);
+}
+
+// Wrapper groups
+
+// A minor collection keeps every old cell; a major one only those this
+// cycle reached
+static bool wrapper_live(const js_gc_heap_t* heap, const js_cell_t* cell, bool major) {
+    if (!(cell->gc_flags & JS_GC_OLD)) return false;
+    return !major || cell->gc_mark == heap->epoch;
+}
+
+static void* wrapper_group(const js_gc_heap_t* heap, js_cell_t* cell) {
+    void* group = heap->wrapper_ops->group(cell);
+    return group ? group : cell;
+}
+
+static uint32_t group_slot(const void* group, uint32_t capacity) {
+    uint64_t hash = ((uintptr_t)group >> 3) * 0x9e3779b97f4a7c15ull;
+    return (uint32_t)(hash >> 32) & (capacity - 1);
+}
+
+// Empties the set, sized to at least twice the wrapper count so probes
+// stay short
+static bool groups_reset(js_gc_heap_t* heap) {
+    uint32_t capacity = capacity_reserve(0, (uint64_t)heap->wrappers.count * 2, 64, sizeof(void*));
+    if (!capacity) return false;
+    if (heap->live_group_capacity < capacity) {
+        void** groups = realloc(heap->live_groups, capacity * sizeof(void*));
+        if (!groups) return false;
+        heap->live_groups = groups;
+        heap->live_group_capacity = capacity;
+    }
+    memset(heap->live_groups, 0, heap->live_group_capacity * sizeof(void*));
+    return true;
+}
+
+static void groups_add(js_gc_heap_t* heap, void* group) {
+    uint32_t mask = heap->live_group_capacity - 1;
+    uint32_t slot = group_slot(group, heap->live_group_capacity);
+    while (heap->live_groups[slot] && heap->live_groups[slot] != group) slot = (slot + 1) & mask;
+    heap->live_groups[slot] = group;
+}
+
+static bool groups_contain(const js_gc_heap_t* heap, const void* group) {
+    uint32_t mask = heap->live_group_capacity - 1;
+    uint32_t slot = group_slot(group, heap->live_group_capacity);
+    while (heap->live_groups[slot]) {
+        if (heap->live_groups[slot] == group) return true;
+        slot = (slot + 1) & mask;
+    }
+    return false;
+}
+
+// Revives the wrappers of every group with a live member, until tracing
+// from them makes no further group live. Runs with stack otherwise
+// drained.
+static void trace_wrappers(js_gc_heap_t* heap, js_gc_list_t* stack, bool major) {
+    js_gc_list_t* wrappers = &heap->wrappers;
+    if (!wrappers->count) return;
+    for (;;) {
+        bool revived = false;
+        if (groups_reset(heap)) {
+            for (uint32_t i = 0; i < wrappers->count; i++) {
+                js_cell_t* cell = wrappers->items[i];
+                if (wrapper_live(heap, cell, major)) groups_add(heap, wrapper_group(heap, cell));
+            }
+            for (uint32_t i = 0; i < wrappers->count; i++) {
+                js_cell_t* cell = wrappers->items[i];
+                if (wrapper_live(heap, cell, major) || !groups_contain(heap, wrapper_group(heap, cell))) continue;
+                visit(heap, cell);
+                revived = true;
+            }
+        } else {
+            // Without the set, keeping every wrapper is the safe choice
+            for (uint32_t i = 0; i < wrappers->count; i++) {
+                js_cell_t* cell = wrappers->items[i];
+                if (wrapper_live(heap, cell, major)) continue;
+                visit(heap, cell);
+                revived = true;
+            }
+        }
+        if (!revived) return;
+        drain(heap, stack);
+    }
+}
+
+// After trace_wrappers, the wrappers still unreached are dead
+static void release_wrappers(js_gc_heap_t* heap, bool major) {
+    uint32_t kept = 0;
+    for (uint32_t i = 0; i < heap->wrappers.count; i++) {
+        js_cell_t* cell = heap->wrappers.items[i];
+        if (wrapper_live(heap, cell, major)) {
+            heap->wrappers.items[kept++] = cell;
+        } else {
+            cell->gc_flags &= ~JS_GC_WRAPPER;
+            heap->wrapper_ops->release(cell);
+        }
+    }
+    heap->wrappers.count = kept;
+}
+
+// Young cells still unmarked are dead. Their lines were never marked, so
+// they are free already; only large cells and finalizers need a pass.
+static void release_young(js_gc_heap_t* heap) {
+    for (uint32_t i = 0; i < heap->young_finalizable.count; i++) {
+        js_cell_t* cell = heap->young_finalizable.items[i];
+        if (!(cell->gc_flags & JS_GC_OLD)) {
+            js_cell_finalize(cell);
+        } else if (!list_push(&heap->old_finalizable, cell)) {
+            cell->gc_flags &= ~JS_GC_FINALIZE;
+        }
+    }
+    heap->young_finalizable.count = 0;
+    
+    // A promoted large cell old_large has no room for stays here, still
+    // allocated, until a later pass records it
+    uint32_t kept = 0;
+    for (uint32_t i = 0; i < heap->young_large.count; i++) {
+        js_cell_t* cell = heap->young_large.items[i];
+        if (cell->gc_flags & JS_GC_OLD) {
+            if (!list_push(&heap->old_large, cell)) heap->young_large.items[kept++] = cell;
+            continue;
+        }
+        js_gc_block_t* block = js_gc_block_of(cell);
+        heap->system_bytes -= block->large_size;
+        free(block);
+    }
+    heap->young_large.count = kept;
+    
+    heap->nursery_bytes = 0;
+    reset_allocator(heap);
+}
+
+static void minor_collect(js_gc_heap_t* heap) {
+    heap->minor_tracing = true;
+    visit_roots(heap);
+    trace_remembered(heap, true);
+    drain(heap, &heap->minor_stack);
+    trace_wrappers(heap, &heap->minor_stack, false);
+    release_wrappers(heap, false);
+    heap->minor_tracing = false;
+    
+    release_young(heap);
+    heap->stats.minor_collections++;
+}
+
+// Incremental cycles
+
+static void start_marking(js_gc_heap_t* heap) {
+    if (heap->nursery_bytes) minor_collect(heap);
+    
+    heap->epoch = heap->epoch == UINT8_MAX ? 1 : heap->epoch + 1;
+    heap->marking = true;
+    heap->live_bytes = 0;
+    heap->slice_bytes = 0;
+    visit_roots(heap);
+}
+
+// Marks until the grey stack is empty or the deadline passes
+static bool mark_slice(js_gc_heap_t* heap, uint64_t deadline_us) {
+    uint32_t traced = 0;
+    while (heap->mark_stack.count) {
+        trace_children(heap, heap->mark_stack.items[--heap->mark_stack.count]);
+        if (++traced % 256 == 0 && frame_scheduler_now() >= deadline_us) break;
+    }
+    heap->stats.slices++;
+    heap->slice_bytes = 0;
+    return heap->mark_stack.count == 0;
+}
+
+static void sweep(js_gc_heap_t* heap) {
+    uint8_t epoch = heap->epoch;
+    
+    uint32_t kept = 0;
+    for (uint32_t i = 0; i < heap->old_finalizable.count; i++) {
+        js_cell_t* cell = heap->old_finalizable.items[i];
+        if (cell->gc_mark == epoch) {
+            heap->old_finalizable.items[kept++] = cell;
+        } else {
+            js_cell_finalize(cell);
+        }
+    }
+    heap->old_finalizable.count = kept;
+    
+    kept = 0;
+    for (uint32_t i = 0; i < heap->old_large.count; i++) {
+        js_cell_t* cell = heap->old_large.items[i];
+        if (cell->gc_mark == epoch) {
+            heap->old_large.items[kept++] = cell;
+        } else {
+            js_gc_block_t* block = js_gc_block_of(cell);
+            heap->system_bytes -= block->large_size;
+            free(block);
+        }
+    }
+    heap->old_large.count = kept;
+    
+    // Lines not reached this cycle are free. Empty blocks beyond one
+    // nursery's worth go back to the system.
+    uint64_t reserve = heap->nursery_limit / JS_GC_BLOCK_SIZE;
+    uint64_t empty = 0;
+    kept = 0;
+    for (uint32_t i = 0; i < heap->block_count; i++) {
+        js_gc_block_t* block = heap->blocks[i];
+        bool used = false;
+        for (uint32_t line = JS_GC_FIRST_LINE; line < JS_GC_LINE_COUNT; line++) {
+            if (block->lines[line] != epoch) {
+                block->lines[line] = 0;
+            } else {
+                used = true;
+            }
+        }
+        if (!used && ++empty > reserve) {
+            heap->system_bytes -= JS_GC_BLOCK_SIZE;
+            free(block);
+            continue;
+        }
+        heap->blocks[kept++] = block;
+    }
+    heap->block_count = kept;
+    reset_allocator(heap);
+    
+    heap->old_bytes = heap->live_bytes;
+    heap->major_threshold = heap->old_bytes * 2;
+    if (heap->major_threshold < JS_GC_MIN_MAJOR_THRESHOLD) heap->major_threshold = JS_GC_MIN_MAJOR_THRESHOLD;
+    uint64_t limit = heap->engine->memory.heap_size;
+    if (limit && heap->major_threshold > limit && limit > heap->old_bytes) heap->major_threshold = limit;
+    heap->marking = false;
+    heap->stats.major_collections++;
+}
+
+// The final pause. Roots are not behind the barrier and are traced again;
+// everything written meanwhile was remembered. Young survivors are traced
+// along the way, so this doubles as a minor collection.
+static void finish_marking(js_gc_heap_t* heap, bool trace_remembered_cells) {
+    visit_roots(heap);
+    trace_remembered(heap, trace_remembered_cells);
+    drain(heap, &heap->mark_stack);
+    trace_wrappers(heap, &heap->mark_stack, true);
+    release_wrappers(heap, true);
+    release_young(heap);
+    sweep(heap);
+}
+
+static void collect_full(js_gc_heap_t* heap) {
+    // A fresh epoch forgets partial marking, which may have missed writes
+    heap->epoch = heap->epoch == UINT8_MAX ? 1 : heap->epoch + 1;
+    heap->marking = true;
+    heap->live_bytes = 0;
+    heap->mark_stack.count = 0;
+    heap->full = false;
+    finish_marking(heap, false);
+}
+
+static void record_pause(js_gc_heap_t* heap, uint64_t start) {
+    uint64_t pause = frame_scheduler_now() - start;
+    heap->stats.last_pause_us = pause;
+    heap->stats.total_pause_us += pause;
+    if (pause > heap->stats.max_pause_us) heap->stats.max_pause_us = pause;
+    update_stats(heap);
+}
+
+// Entry points
+
+void js_gc_safepoint(js_engine_t* engine) {
+    js_gc_heap_t* heap = engine ? engine->memory.heap : NULL;
+    if (!heap || !heap->pending || heap->native_depth) return;
+    
+    uint64_t start = frame_scheduler_now();
+    heap->pending = false;
+    if (heap->full) {
+        collect_full(heap);
+    } else {
+        if (heap->nursery_bytes >= heap->nursery_limit) minor_collect(heap);
+        if (heap->marking) {
+            if (mark_slice(heap, start + JS_GC_SLICE_US)) finish_marking(heap, true);
+        } else if (heap->old_bytes >= heap->major_threshold) {
+            start_marking(heap);
+        }
+    }
+    record_pause(heap, start);
+}
+
+bool js_gc_idle(js_engine_t* engine, uint64_t deadline_us) {
+    js_gc_heap_t* heap = engine ? engine->memory.heap : NULL;
+    if (!heap) return false;
+    if (heap->native_depth) return heap->marking;
+    
+    uint64_t start = frame_scheduler_now();
+    if (start >= deadline_us) return heap->marking;
+    
+    // Idle time empties the nursery early and starts cycles before the
+    // threshold, so script rarely has to pay for either
+    if (heap->full) {
+        collect_full(heap);
+    } else {
+        if (heap->nursery_bytes >= heap->nursery_limit / 4) minor_collect(heap);
+        if (!heap->marking && heap->old_bytes >= heap->major_threshold / 4 * 3) start_marking(heap);
+        if (heap->marking && mark_slice(heap, deadline_us)) finish_marking(heap, true);
+    }
+    heap->pending = heap->nursery_bytes >= heap->nursery_limit;
+    record_pause(heap, start);
+    return heap->marking;
+}
+
+void js_gc_run(js_engine_t* engine) {
+    js_gc_heap_t* heap = engine ? engine->memory.heap : NULL;
+    if (!heap) return;
+    
+    // Native frames may hold unprotected values: collect once they return
+    heap->full = true;
+    heap->pending = true;
+    if (heap->native_depth) return;
+    
+    uint64_t start = frame_scheduler_now();
+    heap->pending = false;
+    collect_full(heap);
+    record_pause(heap, start);
+}
+
+void js_gc_sweep(js_engine_t* engine) {
+    js_gc_heap_t* heap = engine ? engine->memory.heap : NULL;
+    if (!heap || !heap->marking || heap->native_depth) return;
+    
+    uint64_t start = frame_scheduler_now();
+    finish_marking(heap, true);
+    record_pause(heap, start);
+}
+
+void js_gc_mark(js_value_t value) {
+    if (js_value_is_cell(value)) visit(js_gc_heap_of(js_value_as_cell(value)), js_value_as_cell(value));
+}
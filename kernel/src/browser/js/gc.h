@@ -0,0 +1,208 @@
+#ifndef JS_GC_H
+#define JS_GC_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "engine.h"
+
+// Generational, incremental, non-moving collector behind
+// js_engine_t.memory.heap.
+//
+// Cells are bump-allocated into 32KB blocks divided into 128-byte lines.
+// The nursery is every cell allocated since the last minor collection.
+// A minor collection traces only young cells, from the roots and the
+// remembered set. Survivors become old where they stand, and they mark
+// the lines they cover. Lines left unmarked are free, and they are
+// bump-allocated into again, so nursery garbage costs nothing to
+// reclaim. Cells never move, so js_object_t pointers held by native code
+// stay valid.
+//
+// The old generation is marked incrementally. Slices run at interpreter
+// safepoints, paced by allocation, and in idle time handed over by the
+// frame scheduler through js_gc_idle. A short final pause re-scans the
+// roots, drains what the barrier recorded, and sweeps.
+//
+// Collection only happens at safepoints: loop back-edges and function
+// entry in the interpreter, js_gc_idle, and js_gc_run. It never happens
+// while a native function, getter or setter is running, and never inside
+// allocation. Native code therefore only has to protect values it keeps
+// outside the heap beyond its own call (js_gc_protect).
+//
+// Roots:
+// - every context's globals, variables and execution stack
+// - the builtins and module namespaces
+// - the pending exception
+// - protected values
+//
+// Wrappers (js_gc_register_wrapper) are objects standing for something
+// outside the heap, such as DOM nodes. Each belongs to a group, and a
+// wrapper stays alive while any wrapper in its group is reachable: a
+// script holding one node of a tree can walk to every other, and finds
+// the same wrappers, expandos included, there. Groups are resolved once
+// tracing is otherwise done, so they cost nothing until a collection
+// ends.
+#define JS_GC_BLOCK_SIZE (32 * 1024)
+#define JS_GC_LINE_SIZE 128
+#define JS_GC_LINE_COUNT (JS_GC_BLOCK_SIZE / JS_GC_LINE_SIZE)
+#define JS_GC_LARGE_SIZE (8 * 1024)     // Bigger cells get their own allocation
+#define JS_GC_ALIGN 8
+
+#define JS_GC_NURSERY_SIZE (2 * 1024 * 1024)    // When memory.gc_threshold is 0
+#define JS_GC_MIN_MAJOR_THRESHOLD (8 * 1024 * 1024)
+#define JS_GC_SLICE_BYTES (256 * 1024)  // Allocation between marking slices
+#define JS_GC_SLICE_US 500              // Marking slice at a safepoint
+
+// js_cell_t.gc_flags
+#define JS_GC_OLD           0x01        // Survived a minor collection
+#define JS_GC_REMEMBERED    0x02        // In the remembered set
+#define JS_GC_PROTECTED     0x04        // In the protected list
+#define JS_GC_FINALIZE      0x08        // js_cell_finalize runs when it dies
+#define JS_GC_WRAPPER       0x10        // In the wrapper list
+
+// Cell types that never appear in a value; they follow js_value_type_t
+#define JS_CELL_SLOTS 0x80              // js_object_t.slots storage
+
+typedef struct js_gc_heap js_gc_heap_t;
+
+// How an embedder groups its wrappers. group returns the key of the
+// wrapper's group, e.g. the root of a DOM tree, and must not allocate.
+// release runs as a wrapper dies, or when the heap is destroyed, to drop
+// the embedder's pointer to it.
+typedef struct {
+    void* (*group)(js_cell_t* wrapper);
+    void (*release)(js_cell_t* wrapper);
+} js_gc_wrapper_ops_t;
+
+// Header at the start of every block. Large cells get a block of their
+// own, so any cell finds its heap by masking its address.
+typedef struct {
+    js_gc_heap_t* heap;
+    uint32_t large_size;            // Bytes of a large cell's block, else 0
+    uint8_t lines[JS_GC_LINE_COUNT]; // Epoch that found the line live, 0 when free
+} js_gc_block_t;
+
+#define JS_GC_FIRST_LINE ((sizeof(js_gc_block_t) + JS_GC_LINE_SIZE - 1) / JS_GC_LINE_SIZE)
+
+typedef struct {
+    js_cell_t** items;
+    uint32_t count;
+    uint32_t capacity;
+} js_gc_list_t;
+
+// Storage behind js_object_t.slots, slot_capacity values long
+typedef struct {
+    js_cell_t base;
+    js_value_t values[];
+} js_gc_slots_t;
+
+struct js_gc_heap {
+    js_engine_t* engine;
+    
+    // Line blocks, and the run of free lines being bump-allocated
+    js_gc_block_t** blocks;
+    uint32_t block_count;
+    uint32_t block_capacity;
+    uint32_t alloc_block;
+    uint32_t alloc_line;
+    char* cursor;
+    char* limit;
+    
+    js_gc_list_t young_large;
+    js_gc_list_t old_large;
+    js_gc_list_t young_finalizable;
+    js_gc_list_t old_finalizable;
+    js_gc_list_t remembered;        // Old cells written since the last minor collection
+    js_gc_list_t protected_cells;
+    js_gc_list_t minor_stack;
+    js_gc_list_t mark_stack;        // Grey old cells
+    
+    js_gc_list_t wrappers;
+    const js_gc_wrapper_ops_t* wrapper_ops;
+    void** live_groups;             // Open-addressed set, rebuilt per collection
+    uint32_t live_group_capacity;
+    
+    uint64_t system_bytes;          // Blocks and large cells
+    uint64_t nursery_bytes;
+    uint64_t nursery_limit;
+    uint64_t old_bytes;
+    uint64_t live_bytes;            // Marked so far this cycle
+    uint64_t major_threshold;
+    uint64_t slice_bytes;           // Allocated since the last marking slice
+    uint32_t native_depth;
+    uint8_t epoch;                  // Mark of cells live as of the current cycle
+    bool marking;
+    bool pending;                   // The next safepoint has work
+    bool full;                      // Collect everything from a fresh epoch
+    bool minor_tracing;
+    
+    struct {
+        uint32_t minor_collections;
+        uint32_t major_collections;
+        uint32_t slices;
+        uint64_t last_pause_us;
+        uint64_t max_pause_us;
+        uint64_t total_pause_us;
+    } stats;
+};
+
+static inline js_gc_block_t* js_gc_block_of(const js_cell_t* cell) {
+    return (js_gc_block_t*)((uintptr_t)cell & ~(uintptr_t)(JS_GC_BLOCK_SIZE - 1));
+}
+
+static inline js_gc_heap_t* js_gc_heap_of(const js_cell_t* cell) {
+    return js_gc_block_of(cell)->heap;
+}
+
+// The engine's heap, created on first use. js_engine_destroy releases it
+// with js_gc_heap_destroy before the shape tree.
+js_gc_heap_t* js_gc_heap(js_engine_t* engine);
+void js_gc_heap_destroy(js_engine_t* engine);
+
+// Zeroed cell with its header filled in, or NULL. Never collects.
+js_cell_t* js_gc_alloc(js_gc_heap_t* heap, uint8_t type, size_t size);
+void js_gc_register_finalizer(js_cell_t* cell);
+
+// Makes cell a wrapper grouped by ops, which every wrapper in a heap
+// shares. False when out of memory.
+bool js_gc_register_wrapper(js_cell_t* cell, const js_gc_wrapper_ops_t* ops);
+js_gc_slots_t* js_gc_slots_of(const js_value_t* slots);
+
+// Write barrier, for every store of a value into a cell. It records old
+// cells that gain a young reference, and while marking, old cells written
+// at all.
+void js_gc_remember(js_gc_heap_t* heap, js_cell_t* owner);
+
+static inline void js_gc_write_barrier_cell(js_cell_t* owner, const js_cell_t* target) {
+    if ((owner->gc_flags & (JS_GC_OLD | JS_GC_REMEMBERED)) != JS_GC_OLD) return;
+    
+    js_gc_heap_t* heap = js_gc_heap_of(owner);
+    if (!(target->gc_flags & JS_GC_OLD) || heap->marking) js_gc_remember(heap, owner);
+}
+
+static inline void js_gc_write_barrier(js_cell_t* owner, js_value_t value) {
+    if (js_value_is_cell(value)) js_gc_write_barrier_cell(owner, js_value_as_cell(value));
+}
+
+// Native frames defer collection until they return
+static inline void js_gc_enter_native(js_gc_heap_t* heap) {
+    if (heap) heap->native_depth++;
+}
+
+static inline void js_gc_leave_native(js_gc_heap_t* heap) {
+    if (heap) heap->native_depth--;
+}
+
+// Safepoints
+static inline bool js_gc_pending(const js_engine_t* engine) {
+    const js_gc_heap_t* heap = engine->memory.heap;
+    return heap && heap->pending;
+}
+
+void js_gc_safepoint(js_engine_t* engine);
+
+// Idle-time work until deadline_us (frame_scheduler_now's clock). Returns
+// whether an incremental cycle is still in progress.
+bool js_gc_idle(js_engine_t* engine, uint64_t deadline_us);
+
+#endif
@@ -0,0 +1,215 @@
+#include "shape.h"
+#include "gc.h"
+#include <string.h>
+
+void js_ic_init(js_property_ic_t* ic, atom_t key) {
+    if (!ic) return;
+    memset(ic, 0, sizeof(js_property_ic_t));
+    ic->key = key;
+}
+
+void js_ic_reset(js_property_ic_t* ic) {
+    if (!ic) return;
+    ic->state = JS_IC_UNINITIALIZED;
+    ic->entry_count = 0;
+    ic->misses = 0;
+}
+
+// Walks entry->depth prototypes checking each shape. Returns the last
+// object checked, or NULL when the chain no longer matches.
+static js_object_t* check_chain(const js_ic_entry_t* entry, js_object_t* object) {
+    js_object_t* holder = object;
+    for (uint32_t i = 0; i < entry->depth; i++) {
+        holder = holder->prototype;
+        if (!holder || holder->shape != entry->chain[i]) return NULL;
+    }
+    return holder;
+}
+
+static void add_entry(js_property_ic_t* ic, const js_ic_entry_t* entry) {
+    ic->misses++;
+    if (ic->state == JS_IC_MEGAMORPHIC) return;
+    
+    // An entry for this receiver shape whose chain went stale is replaced
+    for (uint32_t i = 0; i < ic->entry_count; i++) {
+        if (ic->entries[i].shape == entry->shape) {
+            ic->entries[i] = *entry;
+            return;
+        }
+    }
+    
+    if (ic->entry_count >= JS_IC_MAX_ENTRIES) {
+        ic->state = JS_IC_MEGAMORPHIC;
+        ic->entry_count = 0;
+        return;
+    }
+    ic->entries[ic->entry_count++] = *entry;
+    ic->state = ic->entry_count == 1 ? JS_IC_MONOMORPHIC : JS_IC_POLYMORPHIC;
+}
+
+// Finds where key lives for a cache entry. Returns false when some object
+// on the way is a dictionary or the chain is too deep to guard.
+static bool describe_lookup(js_object_t* object, atom_t key, js_ic_entry_t* entry, js_object_t** holder, int32_t* index) {
+    memset(entry, 0, sizeof(js_ic_entry_t));
+    entry->shape = object->shape;
+    *holder = NULL;
+    *index = -1;
+    
+    for (js_object_t* current = object; current; current = current->prototype) {
+        if (!current->shape || current->shape->dictionary) return false;
+        if (current != object) {
+            if (entry->depth >= JS_IC_MAX_DEPTH) return false;
+            entry->chain[entry->depth++] = current->shape;
+        }
+        
+        *index = js_shape_lookup(current->shape, key);
+        if (*index >= 0) {
+            *holder = current;
+            return true;
+        }
+    }
+    return true;
+}
+
+// Loads
+
+static bool load_miss(js_property_ic_t* ic, js_object_t* object, js_value_t* value) {
+    js_ic_entry_t entry;
+    js_object_t* holder;
+    int32_t index;
+    if (ic->state == JS_IC_MEGAMORPHIC) {
+        ic->misses++;
+    } else if (describe_lookup(object, ic->key, &entry, &holder, &index)) {
+        if (!holder) {
+            entry.kind = JS_IC_LOAD_MISSING;
+        } else {
+            const js_shape_property_t* property = js_shape_property(holder->shape, (uint32_t)index);
+            entry.kind = (property->attributes & JS_PROP_ACCESSOR) ? JS_IC_LOAD_GETTER : JS_IC_LOAD_SLOT;
+            entry.getter = property->getter;
+            entry.slot = (uint32_t)index;
+        }
+        add_entry(ic, &entry);
+    } else {
+        ic->misses++;
+    }
+    return js_object_get(object, ic->key, value);
+}
+
+bool js_ic_get(js_property_ic_t* ic, js_object_t* object, js_value_t* value) {
+    *value = JS_UNDEFINED;
+    if (!ic || !object || !object->shape) return false;
+    
+    js_shape_t* shape = object->shape;
+    for (uint32_t i = 0; i < ic->entry_count; i++) {
+        const js_ic_entry_t* entry = &ic->entries[i];
+        if (entry->shape != shape) continue;
+        
+        js_object_t* holder = check_chain(entry, object);
+        if (!holder) break;
+        
+        switch (entry->kind) {
+            case JS_IC_LOAD_SLOT:
+                *value = holder->slots[entry->slot];
+                return true;
+            case JS_IC_LOAD_GETTER:
+                if (entry->getter) {
+                    js_gc_enter_native(js_gc_heap_of(&object->base));
+                    *value = entry->getter(object);
+                    js_gc_leave_native(js_gc_heap_of(&object->base));
+                }
+                return true;
+            case JS_IC_LOAD_MISSING:
+                if (!holder->prototype) return false;
+                break;
+        }
+        break;
+    }
+    return load_miss(ic, object, value);
+}
+
+// Stores
+
+static bool store_miss(js_property_ic_t* ic, js_object_t* object, js_value_t value) {
+    js_ic_entry_t entry;
+    js_object_t* holder;
+    int32_t index;
+    bool cacheable = ic->state != JS_IC_MEGAMORPHIC && describe_lookup(object, ic->key, &entry, &holder, &index);
+    js_shape_t* before = object->shape;
+    
+    if (!js_object_set(object, ic->key, value)) {
+        ic->misses++;
+        return false;
+    }
+    if (!cacheable) {
+        ic->misses++;
+        return true;
+    }
+    
+    const js_shape_property_t* property = holder ? js_shape_property(holder->shape, (uint32_t)index) : NULL;
+    if (property && (property->attributes & JS_PROP_ACCESSOR)) {
+        entry.kind = JS_IC_STORE_SETTER;
+        entry.setter = property->setter;
+    } else if (holder == object) {
+        entry.kind = JS_IC_STORE_SLOT;
+        entry.slot = (uint32_t)index;
+    } else {
+        // Added: cacheable only as a plain transition, guarding the whole
+        // chain so a setter or read-only property appearing on a prototype
+        // is noticed
+        js_shape_t* after = object->shape;
+        if (after->dictionary || after->parent != before) {
+            ic->misses++;
+            return true;
+        }
+        entry.kind = JS_IC_STORE_ADD;
+        entry.transition = after;
+        entry.slot = after->property_count - 1;
+        if (holder) {
+            // Shadowing an inherited writable property: guard to the end
+            for (js_object_t* current = holder->prototype; current; current = current->prototype) {
+                if (current->shape->dictionary || entry.depth >= JS_IC_MAX_DEPTH) {
+                    ic->misses++;
+                    return true;
+                }
+                entry.chain[entry.depth++] = current->shape;
+            }
+        }
+    }
+    add_entry(ic, &entry);
+    return true;
+}
+
+bool js_ic_set(js_property_ic_t* ic, js_object_t* object, js_value_t value) {
+    if (!ic || !object || !object->shape) return false;
+    
+    js_shape_t* shape = object->shape;
+    for (uint32_t i = 0; i < ic->entry_count; i++) {
+        js_ic_entry_t* entry = &ic->entries[i];
+        if (entry->shape != shape) continue;
+        
+        js_object_t* holder = check_chain(entry, object);
+        if (!holder) break;
+        
+        switch (entry->kind) {
+            case JS_IC_STORE_SLOT:
+                object->slots[entry->slot] = value;
+                js_gc_write_barrier(&object->base, value);
+                return true;
+            case JS_IC_STORE_ADD:
+                if (holder->prototype || !object->extensible) break;
+                if (!js_object_reserve_slots(object, entry->slot + 1)) return false;
+                object->slots[entry->slot] = value;
+                object->shape = entry->transition;
+                js_gc_write_barrier(&object->base, value);
+                return true;
+            case JS_IC_STORE_SETTER:
+                if (!entry->setter) return false;
+                js_gc_enter_native(js_gc_heap_of(&object->base));
+                entry->setter(object, value);
+                js_gc_leave_native(js_gc_heap_of(&object->base));
+                return true;
+        }
+        break;
+    }
+    return store_miss(ic, object, value);
+}
@@ -0,0 +1,616 @@
+#include "bytecode.h"
+#include "gc.h"
+#include "jit.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Value stack shared by all frames of a context, in values
+#define JS_INTERPRETER_STACK_SIZE (256 * 1024)
+
+static js_value_t throw_type_error(js_engine_t* engine, const char* message) {
+    js_throw(engine, js_create_type_error(engine, message));
+    return JS_EXCEPTION;
+}
+
+// Checked where a loop could otherwise run forever: back-edges and calls
+static bool throw_if_interrupted(js_engine_t* engine) {
+    if (!js_interrupted(engine)) return false;
+    js_throw(engine, js_create_error(engine, "Script terminated"));
+    return true;
+}
+
+static js_object_t* global_object(js_engine_t* engine) {
+    js_context_t* context = engine->current_context ? engine->current_context : engine->global_context;
+    return context ? context->global_object : NULL;
+}
+
+static int32_t to_int32(js_value_t value) {
+    if (js_value_is_int(value)) return js_value_as_int(value);
+    double number = js_to_number(value);
+    if (!isfinite(number)) return 0;
+    return (int32_t)(uint32_t)(int64_t)fmod(trunc(number), 4294967296.0);
+}
+
+// Integral results that fit stay int32; -0 must stay a double
+static js_value_t number_from_int64(int64_t value) {
+    if (value >= INT32_MIN && value <= INT32_MAX) return js_create_int((int32_t)value);
+    return js_create_number((double)value);
+}
+
+static bool strict_equals(js_value_t a, js_value_t b) {
+    // Either number representation; NaN is unequal to itself
+    if (js_value_is_number(a) && js_value_is_number(b)) {
+        if (js_value_is_int(a) && js_value_is_int(b)) return js_value_as_int(a) == js_value_as_int(b);
+        return js_value_as_number(a) == js_value_as_number(b);
+    }
+    if (js_value_same(a, b)) return true;
+    
+    js_value_type_t type = js_value_type(a);
+    if (type != js_value_type(b)) return false;
+    switch (type) {
+        case JS_TYPE_STRING: {
+            js_string_t* x = js_value_as_string(a);
+            js_string_t* y = js_value_as_string(b);
+            return x->length == y->length && memcmp(x->data, y->data, x->length) == 0;
+        }
+        case JS_TYPE_BIGINT:
+            return ((js_bigint_t*)js_value_as_cell(a))->value == ((js_bigint_t*)js_value_as_cell(b))->value;
+        default:
+            return false;
+    }
+}
+
+static bool loose_equals(js_value_t a, js_value_t b) {
+    if (js_value_type(a) == js_value_type(b)) return strict_equals(a, b);
+    
+    bool a_nullish = js_value_is_nullish(a);
+    bool b_nullish = js_value_is_nullish(b);
+    if (a_nullish || b_nullish) return a_nullish && b_nullish;
+    if (js_value_is_object(a) || js_value_is_object(b)) return false;
+    return js_to_number(a) == js_to_number(b);
+}
+
+// <, <=, >, >= on strings compare code units, everything else as numbers
+static js_value_t compare(js_opcode_t op, js_value_t a, js_value_t b) {
+    int order;
+    if (js_value_is_int(a) && js_value_is_int(b)) {
+        int32_t x = js_value_as_int(a);
+        int32_t y = js_value_as_int(b);
+        order = x < y ? -1 : (x > y ? 1 : 0);
+    } else if (js_value_is_string(a) && js_value_is_string(b)) {
+        order = strcmp(js_value_as_string(a)->data, js_value_as_string(b)->data);
+    } else {
+        double x = js_to_number(a);
+        double y = js_to_number(b);
+        if (isnan(x) || isnan(y)) return JS_FALSE;
+        order = x < y ? -1 : (x > y ? 1 : 0);
+    }
+    
+    switch (op) {
+        case JS_OP_LT: return js_create_boolean(order < 0);
+        case JS_OP_LE: return js_create_boolean(order <= 0);
+        case JS_OP_GT: return js_create_boolean(order > 0);
+        default: return js_create_boolean(order >= 0);
+    }
+}
+
+static js_value_t concat(js_engine_t* engine, js_value_t a, js_value_t b) {
+    char* left = js_to_string(a);
+    char* right = js_to_string(b);
+    js_value_t result = JS_EXCEPTION;
+    if (left && right) {
+        size_t left_length = strlen(left);
+        size_t right_length = strlen(right);
+        char* joined = malloc(left_length + right_length + 1);
+        if (joined) {
+            memcpy(joined, left, left_length);
+            memcpy(joined + left_length, right, right_length + 1);
+            result = js_create_string(engine, joined);
+            free(joined);
+        }
+    }
+    free(left);
+    free(right);
+    return result;
+}
+
+// Both operands int32: no conversions, and the result stays an int32
+// unless it overflows or is -0
+static js_value_t int_arithmetic(js_opcode_t op, int32_t x, int32_t y) {
+    switch (op) {
+        case JS_OP_ADD: return number_from_int64((int64_t)x + y);
+        case JS_OP_SUB: return number_from_int64((int64_t)x - y);
+        case JS_OP_MUL:
+            if ((x == 0 && y < 0) || (y == 0 && x < 0)) return js_create_number(-0.0);
+            return number_from_int64((int64_t)x * y);
+        case JS_OP_DIV:
+            if (y != 0 && !(x == INT32_MIN && y == -1) && x % y == 0 && !(x == 0 && y < 0)) return js_create_int(x / y);
+            return js_create_number((double)x / y);
+        case JS_OP_MOD:
+            if (x >= 0 && y > 0) return js_create_int(x % y);
+            return js_create_number(fmod(x, y));
+        case JS_OP_BIT_AND: return js_create_int(x & y);
+        case JS_OP_BIT_OR: return js_create_int(x | y);
+        case JS_OP_BIT_XOR: return js_create_int(x ^ y);
+        case JS_OP_SHL: return js_create_int((int32_t)((uint32_t)x << (y & 31)));
+        case JS_OP_SHR: return js_create_int(x >> (y & 31));
+        case JS_OP_USHR: return number_from_int64((uint32_t)x >> (y & 31));
+        default: return JS_EXCEPTION;
+    }
+}
+
+static js_value_t arithmetic(js_engine_t* engine, js_opcode_t op, js_value_t a, js_value_t b) {
+    switch (op) {
+        case JS_OP_ADD:
+            if (js_value_is_string(a) || js_value_is_string(b)) return concat(engine, a, b);
+            return js_create_number(js_to_number(a) + js_to_number(b));
+        case JS_OP_SUB: return js_create_number(js_to_number(a) - js_to_number(b));
+        case JS_OP_MUL: return js_create_number(js_to_number(a) * js_to_number(b));
+        case JS_OP_DIV: return js_create_number(js_to_number(a) / js_to_number(b));
+        case JS_OP_MOD: return js_create_number(fmod(js_to_number(a), js_to_number(b)));
+        default: return int_arithmetic(op, to_int32(a), to_int32(b));
+    }
+}
+
+static js_value_t unary(js_opcode_t op, js_value_t a) {
+    if (js_value_is_int(a)) {
+        int32_t x = js_value_as_int(a);
+        switch (op) {
+            case JS_OP_NEG: return x == 0 ? js_create_number(-0.0) : number_from_int64(-(int64_t)x);
+            case JS_OP_BIT_NOT: return js_create_int(~x);
+            case JS_OP_INC: return number_from_int64((int64_t)x + 1);
+            case JS_OP_DEC: return number_from_int64((int64_t)x - 1);
+            default: break;
+        }
+    }
+    
+    switch (op) {
+        case JS_OP_NEG: return js_create_number(-js_to_number(a));
+        case JS_OP_BIT_NOT: return js_create_int(~to_int32(a));
+        case JS_OP_NOT: return js_create_boolean(!js_to_boolean(a));
+        case JS_OP_INC: return js_create_number(js_to_number(a) + 1);
+        default: return js_create_number(js_to_number(a) - 1);
+    }
+}
+
+static const char* type_name(js_value_t value) {
+    switch (js_value_type(value)) {
+        case JS_TYPE_UNDEFINED: return "undefined";
+        case JS_TYPE_BOOLEAN: return "boolean";
+        case JS_TYPE_NUMBER: return "number";
+        case JS_TYPE_STRING: return "string";
+        case JS_TYPE_SYMBOL: return "symbol";
+        case JS_TYPE_BIGINT: return "bigint";
+        case JS_TYPE_FUNCTION: return "function";
+        default: return "object";
+    }
+}
+
+// Property access on any value. Primitives other than a string's length
+// are looked up through their wrapper object.
+static js_value_t get_named(js_engine_t* engine, js_value_t value, js_property_ic_t* ic) {
+    js_value_t result;
+    js_object_t* object = js_value_as_object(value);
+    if (object) {
+        js_ic_get(ic, object, &result);
+        return result;
+    }
+    
+    if (js_value_is_nullish(value)) {
+        return throw_type_error(engine, "Cannot read properties of null or undefined");
+    }
+    if (js_value_is_string(value) && ic->key == ATOM_length) {
+        return number_from_int64(js_value_as_string(value)->length);
+    }
+    
+    js_object_t* wrapper = js_to_object(engine, value);
+    if (!wrapper) return JS_UNDEFINED;
+    js_ic_get(ic, wrapper, &result);
+    return result;
+}
+
+static bool element_index(js_value_t key, uint32_t* index) {
+    if (js_value_is_int(key)) {
+        if (js_value_as_int(key) < 0) return false;
+        *index = (uint32_t)js_value_as_int(key);
+        return true;
+    }
+    if (!js_value_is_double(key)) return false;
+    double number = js_value_as_double(key);
+    if (number < 0 || number >= 4294967295.0 || number != floor(number)) return false;
+    *index = (uint32_t)number;
+    return true;
+}
+
+static atom_t element_atom(js_value_t key) {
+    if (js_value_is_string(key)) return atom_intern(js_value_as_string(key)->data);
+    
+    char* name = js_to_string(key);
+    if (!name) return ATOM_NULL;
+    atom_t atom = atom_intern(name);
+    free(name);
+    return atom;
+}
+
+static js_value_t get_element(js_engine_t* engine, js_value_t value, js_value_t key) {
+    js_object_t* object = js_value_as_object(value);
+    uint32_t index;
+    if (object && js_value_type(value) == JS_TYPE_ARRAY && element_index(key, &index)) {
+        if (index >= js_array_length(value)) return JS_UNDEFINED;
+        return js_array_get(value, index);
+    }
+    if (!object && js_value_is_nullish(value)) {
+        return throw_type_error(engine, "Cannot read properties of null or undefined");
+    }
+    
+    // Computed names get a throwaway cache, which falls through to the
+    // generic lookup
+    js_property_ic_t ic;
+    js_ic_init(&ic, element_atom(key));
+    if (ic.key == ATOM_NULL) return JS_UNDEFINED;
+    ic.state = JS_IC_MEGAMORPHIC;
+    return get_named(engine, value, &ic);
+}
+
+static bool set_element(js_engine_t* engine, js_value_t value, js_value_t key, js_value_t element) {
+    js_object_t* object = js_value_as_object(value);
+    if (!object) {
+        if (js_value_is_nullish(value)) {
+            throw_type_error(engine, "Cannot set properties of null or undefined");
+            return false;
+        }
+        return true;
+    }
+    
+    uint32_t index;
+    if (js_value_type(value) == JS_TYPE_ARRAY && element_index(key, &index)) {
+        js_array_set(value, index, element);
+        return true;
+    }
+    atom_t atom = element_atom(key);
+    if (atom != ATOM_NULL) js_object_set(object, atom, element);
+    return true;
+}
+
+static js_context_t* frame_context(js_engine_t* engine) {
+    js_context_t* context = engine->current_context ? engine->current_context : engine->global_context;
+    if (!context) return NULL;
+    
+    if (!context->execution_stack.stack) {
+        context->execution_stack.stack = calloc(JS_INTERPRETER_STACK_SIZE, sizeof(js_value_t));
+        if (!context->execution_stack.stack) return NULL;
+        context->execution_stack.stack_size = JS_INTERPRETER_STACK_SIZE;
+        context->execution_stack.stack_pointer = 0;
+    }
+    return context;
+}
+
+js_value_t js_interpret(js_engine_t* engine, js_bytecode_t* bytecode, js_value_t this_arg, js_value_t* args, uint32_t argc) {
+    if (!engine || !bytecode) return JS_EXCEPTION;
+    
+    js_context_t* context = frame_context(engine);
+    if (!context) return JS_EXCEPTION;
+    
+    // Frame: this, the locals, then the operand stack. The collector scans
+    // every context's stack up to its stack pointer, so the whole frame is
+    // initialised: slots above sp hold stale values, and stale values must
+    // still be values.
+    uint32_t base = context->execution_stack.stack_pointer;
+    uint32_t frame_size = 1 + (uint32_t)bytecode->local_count + bytecode->stack_size;
+    if (frame_size > context->execution_stack.stack_size - base) {
+        js_throw(engine, js_create_error(engine, "Maximum call stack size exceeded"));
+        return JS_EXCEPTION;
+    }
+    context->execution_stack.stack_pointer = base + frame_size;
+    
+    js_value_t* frame = context->execution_stack.stack + base;
+    js_value_t* locals = frame + 1;
+    js_value_t* stack = locals + bytecode->local_count;
+    frame[0] = this_arg;
+    for (uint32_t i = 0; i < bytecode->local_count; i++) {
+        locals[i] = i < bytecode->parameter_count && i < argc ? args[i] : JS_UNDEFINED;
+    }
+    for (uint32_t i = 0; i < bytecode->stack_size; i++) stack[i] = JS_UNDEFINED;
+    if (js_gc_pending(engine)) js_gc_safepoint(engine);
+    if (throw_if_interrupted(engine)) {
+        context->execution_stack.stack_pointer = base;
+        return JS_EXCEPTION;
+    }
+    
+    js_value_t result;
+    if (js_jit_count_call(engine, bytecode)) {
+        result = js_jit_run(engine, bytecode, frame, 0);
+    } else {
+        result = js_interpret_frame(engine, bytecode, frame, 0, 0, false);
+    }
+    context->execution_stack.stack_pointer = base;
+    return result;
+}
+
+// Loop back-edges are safepoints, and count towards compiling the
+// function. True when the loop should continue in compiled code.
+static bool back_edge(js_engine_t* engine, js_bytecode_t* bytecode, bool step) {
+    if (js_gc_pending(engine)) js_gc_safepoint(engine);
+    return !step && js_jit_count_loop(engine, bytecode);
+}
+
+js_value_t js_interpret_frame(js_engine_t* engine, js_bytecode_t* bytecode, js_value_t* frame, uint32_t pc, uint32_t sp, bool step) {
+    js_value_t* locals = frame + 1;
+    js_value_t* stack = locals + bytecode->local_count;
+    const uint32_t* code = bytecode->code;
+    js_value_t result = JS_EXCEPTION;
+    js_value_t a;
+    js_value_t b;
+    js_value_t c;
+    
+    while (pc < bytecode->length) {
+        uint32_t insn = code[pc++];
+        uint32_t operand = JS_INSN_OPERAND(insn);
+        js_opcode_t op = (js_opcode_t)JS_INSN_OP(insn);
+        
+        switch (op) {
+            case JS_OP_NOP:
+                break;
+            
+            // Loads
+            case JS_OP_LOAD_CONST:
+                a = bytecode->constants[operand];
+                stack[sp++] = a;
+                break;
+            case JS_OP_LOAD_INT:
+                stack[sp++] = js_create_int(JS_INSN_SIGNED(insn));
+                break;
+            case JS_OP_LOAD_UNDEFINED:
+                stack[sp++] = JS_UNDEFINED;
+                break;
+            case JS_OP_LOAD_NULL:
+                stack[sp++] = JS_NULL;
+                break;
+            case JS_OP_LOAD_TRUE:
+            case JS_OP_LOAD_FALSE:
+                stack[sp++] = js_create_boolean(op == JS_OP_LOAD_TRUE);
+                break;
+            case JS_OP_LOAD_THIS:
+                stack[sp++] = frame[0];
+                break;
+            case JS_OP_GET_LOCAL:
+                stack[sp++] = locals[operand];
+                break;
+            case JS_OP_SET_LOCAL:
+                locals[operand] = stack[--sp];
+                break;
+            
+            // Properties
+            case JS_OP_GET_GLOBAL: {
+                js_object_t* global = global_object(engine);
+                if (!global || !js_ic_get(&bytecode->ics[operand], global, &a)) {
+                    js_throw(engine, js_create_reference_error(engine, atom_string(bytecode->ics[operand].key)));
+                    goto unwind;
+                }
+                if (js_value_is_exception(a)) goto unwind;
+                stack[sp++] = a;
+                break;
+            }
+            case JS_OP_SET_GLOBAL: {
+                js_object_t* global = global_object(engine);
+                a = stack[--sp];
+                if (global) js_ic_set(&bytecode->ics[operand], global, a);
+                break;
+            }
+            case JS_OP_GET_PROP:
+                a = stack[sp - 1];
+                b = get_named(engine, a, &bytecode->ics[operand]);
+                if (js_value_is_exception(b)) goto unwind;
+                stack[sp - 1] = b;
+                break;
+            case JS_OP_SET_PROP: {
+                b = stack[--sp];
+                a = stack[--sp];
+                js_object_t* object = js_value_as_object(a);
+                bool thrown = js_value_is_nullish(a);
+                if (object) js_ic_set(&bytecode->ics[operand], object, b);
+                if (thrown) {
+                    throw_type_error(engine, "Cannot set properties of null or undefined");
+                    goto unwind;
+                }
+                break;
+            }
+            case JS_OP_GET_ELEM:
+                b = stack[--sp];
+                a = stack[sp - 1];
+                c = get_element(engine, a, b);
+                if (js_value_is_exception(c)) goto unwind;
+                stack[sp - 1] = c;
+                break;
+            case JS_OP_SET_ELEM: {
+                c = stack[--sp];
+                b = stack[--sp];
+                a = stack[--sp];
+                bool ok = set_element(engine, a, b, c);
+                if (!ok) goto unwind;
+                break;
+            }
+            case JS_OP_NEW_OBJECT:
+            case JS_OP_NEW_ARRAY:
+                a = op == JS_OP_NEW_OBJECT ? js_create_object(engine) : js_create_array(engine, 0);
+                if (js_value_is_exception(a)) goto unwind;
+                stack[sp++] = a;
+                break;
+            
+            // Operators. The int32 paths never touch memory beyond the
+            // stack.
+            case JS_OP_ADD:
+            case JS_OP_SUB:
+            case JS_OP_MUL:
+            case JS_OP_DIV:
+            case JS_OP_MOD:
+            case JS_OP_BIT_AND:
+            case JS_OP_BIT_OR:
+            case JS_OP_BIT_XOR:
+            case JS_OP_SHL:
+            case JS_OP_SHR:
+            case JS_OP_USHR:
+                b = stack[--sp];
+                a = stack[sp - 1];
+                if (js_value_is_int(a) && js_value_is_int(b)) {
+                    stack[sp - 1] = int_arithmetic(op, js_value_as_int(a), js_value_as_int(b));
+                    break;
+                }
+                c = arithmetic(engine, op, a, b);
+                if (js_value_is_exception(c)) goto unwind;
+                stack[sp - 1] = c;
+                break;
+            case JS_OP_EQ:
+            case JS_OP_NE:
+            case JS_OP_STRICT_EQ:
+            case JS_OP_STRICT_NE: {
+                b = stack[--sp];
+                a = stack[sp - 1];
+                bool equal = (op == JS_OP_EQ || op == JS_OP_NE) ? loose_equals(a, b) : strict_equals(a, b);
+                stack[sp - 1] = js_create_boolean((op == JS_OP_EQ || op == JS_OP_STRICT_EQ) == equal);
+                break;
+            }
+            case JS_OP_LT:
+            case JS_OP_LE:
+            case JS_OP_GT:
+            case JS_OP_GE:
+                b = stack[--sp];
+                a = stack[sp - 1];
+                stack[sp - 1] = compare(op, a, b);
+                break;
+            case JS_OP_NEG:
+            case JS_OP_BIT_NOT:
+            case JS_OP_NOT:
+            case JS_OP_INC:
+            case JS_OP_DEC:
+                a = stack[sp - 1];
+                stack[sp - 1] = unary(op, a);
+                break;
+            case JS_OP_TYPEOF:
+                a = stack[sp - 1];
+                b = js_create_string(engine, type_name(a));
+                if (js_value_is_exception(b)) goto unwind;
+                stack[sp - 1] = b;
+                break;
+            
+            // Control flow
+            case JS_OP_JUMP:
+                pc += JS_INSN_SIGNED(insn);
+                if (JS_INSN_SIGNED(insn) < 0) {
+                    if (throw_if_interrupted(engine)) goto unwind;
+                    if (back_edge(engine, bytecode, step)) {
+                        result = js_jit_run(engine, bytecode, frame, pc);
+                        goto unwind;
+                    }
+                }
+                break;
+            case JS_OP_JUMP_IF_FALSE:
+            case JS_OP_JUMP_IF_TRUE: {
+                a = stack[--sp];
+                bool truthy = js_to_boolean(a);
+                if (truthy == (op == JS_OP_JUMP_IF_TRUE)) {
+                    pc += JS_INSN_SIGNED(insn);
+                    if (JS_INSN_SIGNED(insn) < 0) {
+                        if (throw_if_interrupted(engine)) goto unwind;
+                        if (back_edge(engine, bytecode, step)) {
+                            result = js_jit_run(engine, bytecode, frame, pc);
+                            goto unwind;
+                        }
+                    }
+                }
+                break;
+            }
+            case JS_OP_POP:
+                sp--;
+                break;
+            case JS_OP_DUP:
+                stack[sp] = stack[sp - 1];
+                sp++;
+                break;
+            case JS_OP_SWAP:
+                a = stack[sp - 1];
+                stack[sp - 1] = stack[sp - 2];
+                stack[sp - 2] = a;
+                break;
+            case JS_OP_CALL:
+            case JS_OP_CALL_METHOD: {
+                uint32_t callee_index = sp - operand - 1;
+                js_value_t receiver = op == JS_OP_CALL_METHOD ? stack[callee_index - 1] : JS_UNDEFINED;
+                js_value_t callee = stack[callee_index];
+                if (js_value_type(callee) != JS_TYPE_FUNCTION) {
+                    throw_type_error(engine, "Value is not a function");
+                    goto unwind;
+                }
+                
+                c = js_interpreter_call(engine, (js_function_t*)js_value_as_object(callee), receiver, stack + callee_index + 1, operand);
+                uint32_t first = op == JS_OP_CALL_METHOD ? callee_index - 1 : callee_index;
+                sp = first;
+                if (js_value_is_exception(c)) goto unwind;
+                stack[sp++] = c;
+                break;
+            }
+            case JS_OP_RETURN:
+                result = stack[--sp];
+                goto unwind;
+            
+            default:
+                throw_type_error(engine, "Invalid bytecode");
+                goto unwind;
+        }
+        if (step) return JS_UNDEFINED;
+    }
+    result = JS_UNDEFINED;
+
+unwind:
+    return result;
+}
+
+void js_interrupt(js_engine_t* engine) {
+    if (engine) __atomic_store_n(&engine->error.interrupted, true, __ATOMIC_RELEASE);
+}
+
+js_value_t js_run_script(js_engine_t* engine, js_bytecode_t* bytecode) {
+    if (!engine || !bytecode) {
+        js_bytecode_destroy(bytecode);
+        return JS_EXCEPTION;
+    }
+    
+    js_context_t* context = engine->global_context;
+    js_value_t global = context && context->global_object ? js_value_from_object(context->global_object) : JS_UNDEFINED;
+    js_value_t result = js_interpret(engine, bytecode, global, NULL, 0);
+    js_bytecode_destroy(bytecode);
+    return result;
+}
+
+// The innermost native call on this thread
+static __thread js_engine_t* native_engine;
+static __thread js_value_t native_this;
+
+js_engine_t* js_native_engine(void) {
+    return native_engine;
+}
+
+js_value_t js_native_this(void) {
+    return native_engine ? native_this : JS_UNDEFINED;
+}
+
+js_value_t js_interpreter_call(js_engine_t* engine, js_function_t* function, js_value_t this_arg, js_value_t* args, uint32_t argc) {
+    if (!engine || !function) return JS_EXCEPTION;
+    
+    // Native functions return JS_EXCEPTION themselves when they throw
+    if (function->kind == FUNCTION_NATIVE || !function->bytecode) {
+        if (!function->native_impl) return JS_UNDEFINED;
+        js_engine_t* outer_engine = native_engine;
+        js_value_t outer_this = native_this;
+        native_engine = engine;
+        native_this = js_value_is_undefined(this_arg) ? function->bound_this : this_arg;
+        js_gc_enter_native(engine->memory.heap);
+        js_value_t result = function->native_impl(args, argc);
+        js_gc_leave_native(engine->memory.heap);
+        native_engine = outer_engine;
+        native_this = outer_this;
+        return result;
+    }
+    return js_interpret(engine, function->bytecode, js_value_is_undefined(this_arg) ? function->bound_this : this_arg, args, argc);
+}
@@ -0,0 +1,861 @@
+#include "jit.h"
+#include "gc.h"
+#include "../capacity.h"
+#include <stdlib.h>
+#include <string.h>
+#if defined(__x86_64__)
+#include <sys/mman.h>
+#endif
+
+// State compiled code reaches through r13
+typedef struct {
+    js_engine_t* engine;
+    js_bytecode_t* bytecode;
+    js_value_t* frame;
+} js_jit_frame_t;
+
+typedef uint64_t (*js_jit_entry_t)(js_jit_frame_t* frame, uint32_t pc);
+
+typedef struct js_jit_chunk {
+    struct js_jit_chunk* next;
+    uint8_t* memory;
+    size_t size;
+    size_t used;
+} js_jit_chunk_t;
+
+struct js_jit {
+    js_jit_chunk_t* chunks;
+    uint32_t compiled;
+    uint32_t failed;
+    uint64_t code_bytes;
+};
+
+void js_jit_enable(js_engine_t* engine, bool enabled) {
+    if (!engine) return;
+    engine->compilation.jit_enabled = enabled;
+    if (enabled && engine->compilation.optimization_level < JS_JIT_LEVEL_BASELINE) {
+        engine->compilation.optimization_level = JS_JIT_LEVEL_BASELINE;
+    }
+}
+
+js_value_t js_jit_run(js_engine_t* engine, js_bytecode_t* bytecode, js_value_t* frame, uint32_t pc) {
+    js_jit_frame_t state = { engine, bytecode, frame };
+    js_jit_entry_t entry = (js_jit_entry_t)bytecode->jit;
+    return (js_value_t){ entry(&state, pc) };
+}
+
+#if defined(__x86_64__)
+
+static js_jit_t* jit_state(js_engine_t* engine) {
+    if (!engine->compilation.optimizer) engine->compilation.optimizer = calloc(1, sizeof(js_jit_t));
+    return engine->compilation.optimizer;
+}
+
+// Runtime entry points called from compiled code
+
+static uint64_t jit_step(js_jit_frame_t* state, uint32_t pc, uint32_t sp) {
+    return js_interpret_frame(state->engine, state->bytecode, state->frame, pc, sp, true).bits;
+}
+
+static uint64_t jit_truthy(uint64_t bits) {
+    return js_to_boolean((js_value_t){ bits });
+}
+
+static void jit_safepoint(js_jit_frame_t* state) {
+    js_gc_safepoint(state->engine);
+}
+
+static void jit_interrupt(js_jit_frame_t* state) {
+    js_throw(state->engine, js_create_error(state->engine, "Script terminated"));
+}
+
+static void jit_write_barrier(js_object_t* object, uint64_t bits) {
+    js_gc_write_barrier(&object->base, (js_value_t){ bits });
+}
+
+// Executable memory. Chunks are writable only while code is copied in.
+
+static void* jit_install(js_jit_t* jit, const uint8_t* code, size_t length) {
+    js_jit_chunk_t* chunk = jit->chunks;
+    if (!chunk || chunk->size - chunk->used < length) {
+        size_t size = length > JS_JIT_CHUNK_SIZE ? (length + 4095) & ~(size_t)4095 : JS_JIT_CHUNK_SIZE;
+        void* memory = mmap(NULL, size, PROT_READ | PROT_EXEC, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (memory == MAP_FAILED) return NULL;
+        
+        chunk = calloc(1, sizeof(js_jit_chunk_t));
+        if (!chunk) {
+            munmap(memory, size);
+            return NULL;
+        }
+        chunk->memory = memory;
+        chunk->size = size;
+        chunk->next = jit->chunks;
+        jit->chunks = chunk;
+    }
+    
+    if (mprotect(chunk->memory, chunk->size, PROT_READ | PROT_WRITE) != 0) return NULL;
+    uint8_t* entry = chunk->memory + chunk->used;
+    memcpy(entry, code, length);
+    if (mprotect(chunk->memory, chunk->size, PROT_READ | PROT_EXEC) != 0) return NULL;
+    
+    chunk->used += (length + 15) & ~(size_t)15;
+    if (chunk->used > chunk->size) chunk->used = chunk->size;
+    jit->code_bytes += length;
+    return entry;
+}
+
+void js_jit_destroy(js_engine_t* engine) {
+    js_jit_t* jit = engine ? engine->compilation.optimizer : NULL;
+    if (!jit) return;
+    
+    while (jit->chunks) {
+        js_jit_chunk_t* chunk = jit->chunks;
+        jit->chunks = chunk->next;
+        munmap(chunk->memory, chunk->size);
+        free(chunk);
+    }
+    free(jit);
+    engine->compilation.optimizer = NULL;
+}
+
+// Assembler
+
+enum { RAX, RCX, RDX, RBX, RSP, RBP, RSI, RDI, R8, R9, R10, R11, R12, R13, R14, R15 };
+enum { CC_O = 0x0, CC_AE = 0x3, CC_E = 0x4, CC_NE = 0x5, CC_A = 0x7, CC_S = 0x8, CC_NP = 0xb, CC_L = 0xc, CC_GE = 0xd, CC_LE = 0xe, CC_G = 0xf };
+
+#define FRAME_REG R12                   // js_value_t* frame
+#define STATE_REG R13                   // js_jit_frame_t*
+#define EXCEPTION_REG R14               // JS_EXCEPTION
+#define INT_TAG_REG R15                 // JS_TAG_INT << JS_TAG_SHIFT
+
+typedef struct {
+    uint32_t at;                        // rel32 to patch
+    uint32_t label;
+} jit_fixup_t;
+
+typedef struct {
+    uint8_t* code;
+    size_t length;
+    size_t capacity;
+    bool failed;
+    
+    js_bytecode_t* bytecode;
+    uint32_t* labels;                   // Code offset of each pc, then the exits
+    jit_fixup_t* fixups;
+    uint32_t fixup_count;
+    uint32_t fixup_capacity;
+} jit_assembler_t;
+
+static void emit_bytes(jit_assembler_t* as, const void* bytes, size_t count) {
+    if (as->failed) return;
+    if (as->length + count > as->capacity) {
+        size_t capacity = as->capacity ? as->capacity * 2 : 4096;
+        while (capacity < as->length + count) capacity *= 2;
+        uint8_t* code = capacity <= JS_JIT_MAX_CODE ? realloc(as->code, capacity) : NULL;
+        if (!code) {
+            as->failed = true;
+            return;
+        }
+        as->code = code;
+        as->capacity = capacity;
+    }
+    memcpy(as->code + as->length, bytes, count);
+    as->length += count;
+}
+
+static void emit8(jit_assembler_t* as, uint8_t byte) {
+    emit_bytes(as, &byte, 1);
+}
+
+static void emit32(jit_assembler_t* as, uint32_t value) {
+    emit_bytes(as, &value, 4);
+}
+
+static void emit64(jit_assembler_t* as, uint64_t value) {
+    emit_bytes(as, &value, 8);
+}
+
+// Opcodes above 0xff are two-byte 0x0f escapes
+static void emit_opcode(jit_assembler_t* as, uint32_t op) {
+    if (op > 0xff) emit8(as, 0x0f);
+    emit8(as, (uint8_t)op);
+}
+
+static void emit_rex(jit_assembler_t* as, bool wide, int reg, int rm) {
+    uint8_t rex = 0x40 | (wide ? 0x08 : 0) | ((reg & 8) ? 0x04 : 0) | ((rm & 8) ? 0x01 : 0);
+    if (rex != 0x40) emit8(as, rex);
+}
+
+// op reg, rm
+static void emit_rr(jit_assembler_t* as, bool wide, uint32_t op, int reg, int rm) {
+    emit_rex(as, wide, reg, rm);
+    emit_opcode(as, op);
+    emit8(as, (uint8_t)(0xc0 | ((reg & 7) << 3) | (rm & 7)));
+}
+
+// op reg, [base + disp32]
+static void emit_mem(jit_assembler_t* as, bool wide, uint32_t op, int reg, int base, int32_t disp) {
+    emit_rex(as, wide, reg, base);
+    emit_opcode(as, op);
+    emit8(as, (uint8_t)(0x80 | ((reg & 7) << 3) | (base & 7)));
+    if ((base & 7) == RSP) emit8(as, 0x24);
+    emit32(as, (uint32_t)disp);
+}
+
+static void emit_mov_imm(jit_assembler_t* as, int reg, uint64_t value) {
+    emit_rex(as, true, 0, reg);
+    emit8(as, (uint8_t)(0xb8 | (reg & 7)));
+    emit64(as, value);
+}
+
+static void emit_load(jit_assembler_t* as, int reg, int32_t disp) {
+    emit_mem(as, true, 0x8b, reg, FRAME_REG, disp);
+}
+
+static void emit_store(jit_assembler_t* as, int reg, int32_t disp) {
+    emit_mem(as, true, 0x89, reg, FRAME_REG, disp);
+}
+
+static void emit_call(jit_assembler_t* as, const void* function) {
+    emit_mov_imm(as, RAX, (uint64_t)(uintptr_t)function);
+    emit_rr(as, false, 0xff, 2, RAX);   // call rax
+}
+
+// Forward branches within one instruction's template
+static uint32_t emit_jcc_forward(jit_assembler_t* as, int cc) {
+    emit_opcode(as, 0x180 | cc);
+    emit32(as, 0);
+    return (uint32_t)as->length - 4;
+}
+
+static uint32_t emit_jmp_forward(jit_assembler_t* as) {
+    emit8(as, 0xe9);
+    emit32(as, 0);
+    return (uint32_t)as->length - 4;
+}
+
+// Branch back to an offset already emitted
+static void emit_jmp_back(jit_assembler_t* as, uint32_t offset) {
+    emit8(as, 0xe9);
+    emit32(as, (uint32_t)(int32_t)(offset - (as->length + 4)));
+}
+
+static void patch_here(jit_assembler_t* as, uint32_t at) {
+    if (as->failed) return;
+    int32_t offset = (int32_t)(as->length - (at + 4));
+    memcpy(as->code + at, &offset, 4);
+}
+
+// Branches to a label, resolved once every pc has its offset
+static void add_fixup(jit_assembler_t* as, uint32_t label) {
+    if (as->failed) return;
+    if (as->fixup_count == as->fixup_capacity) {
+        uint32_t capacity = capacity_grow(as->fixup_capacity, 64, sizeof(jit_fixup_t));
+        jit_fixup_t* fixups = capacity ? realloc(as->fixups, capacity * sizeof(jit_fixup_t)) : NULL;
+        if (!fixups) {
+            as->failed = true;
+            return;
+        }
+        as->fixups = fixups;
+        as->fixup_capacity = capacity;
+    }
+    as->fixups[as->fixup_count++] = (jit_fixup_t){ (uint32_t)as->length - 4, label };
+}
+
+static void emit_jcc_label(jit_assembler_t* as, int cc, uint32_t label) {
+    emit_opcode(as, 0x180 | cc);
+    emit32(as, 0);
+    add_fixup(as, label);
+}
+
+static void emit_jmp_label(jit_assembler_t* as, uint32_t label) {
+    emit8(as, 0xe9);
+    emit32(as, 0);
+    add_fixup(as, label);
+}
+
+// Frame layout, as js_interpret builds it
+
+static int32_t local_disp(const js_bytecode_t* bytecode, uint32_t index) {
+    (void)bytecode;
+    return (int32_t)((1 + index) * sizeof(js_value_t));
+}
+
+static int32_t stack_disp(const js_bytecode_t* bytecode, int32_t depth) {
+    return (int32_t)((1 + bytecode->local_count + depth) * sizeof(js_value_t));
+}
+
+// Templates
+
+#define LABEL_EXCEPTION(as) ((as)->bytecode->length + 1)
+#define LABEL_RETURN(as) ((as)->bytecode->length + 2)
+
+// The instruction at pc through the interpreter
+static void emit_step(jit_assembler_t* as, uint32_t pc, int32_t sp) {
+    emit_rr(as, true, 0x89, STATE_REG, RDI);
+    emit8(as, 0xbe);                    // mov esi, pc
+    emit32(as, pc);
+    emit8(as, 0xba);                    // mov edx, sp
+    emit32(as, (uint32_t)sp);
+    emit_call(as, (const void*)jit_step);
+    emit_rr(as, true, 0x39, EXCEPTION_REG, RAX);
+    emit_jcc_label(as, CC_E, LABEL_EXCEPTION(as));
+}
+
+// Jumps to the returned patch site unless reg holds an int32
+static uint32_t emit_guard_int(jit_assembler_t* as, int reg) {
+    emit_rr(as, true, 0x89, reg, RDX);
+    emit_rr(as, true, 0xc1, 5, RDX);    // shr rdx, 32
+    emit8(as, 32);
+    emit_rr(as, false, 0x81, 7, RDX);   // cmp edx, imm32
+    emit32(as, (uint32_t)(JS_TAG_INT << (JS_TAG_SHIFT - 32)));
+    return emit_jcc_forward(as, CC_NE);
+}
+
+// Jumps to the returned patch site unless rax holds an object, which is
+// left untagged in rax
+static uint32_t emit_guard_object(jit_assembler_t* as) {
+    emit_rr(as, true, 0x89, RAX, RDX);
+    emit_rr(as, true, 0xc1, 5, RDX);    // shr rdx, 48
+    emit8(as, JS_TAG_SHIFT);
+    emit_rr(as, false, 0x81, 7, RDX);
+    emit32(as, (uint32_t)JS_TAG_OBJECT);
+    uint32_t at = emit_jcc_forward(as, CC_NE);
+    emit_mov_imm(as, RDX, JS_PAYLOAD_MASK);
+    emit_rr(as, true, 0x21, RDX, RAX);  // and rax, rdx
+    return at;
+}
+
+// SSE2, for the double paths
+static void emit_sse(jit_assembler_t* as, uint8_t prefix, bool wide, uint8_t op, int reg, int rm) {
+    emit8(as, prefix);
+    emit_rr(as, wide, 0x100 | op, reg, rm);
+}
+
+enum { XMM0, XMM1 };
+
+// reg as a double in xmm, or a jump to the returned patch site when it
+// holds no number
+static uint32_t emit_to_double(jit_assembler_t* as, int reg, int xmm) {
+    uint32_t not_int = emit_guard_int(as, reg);
+    emit_sse(as, 0xf2, false, 0x2a, xmm, reg);      // cvtsi2sd xmm, reg32
+    uint32_t done = emit_jmp_forward(as);
+    patch_here(as, not_int);
+    emit_rr(as, true, 0x39, INT_TAG_REG, reg);       // cmp reg, r15
+    uint32_t not_number = emit_jcc_forward(as, CC_AE);
+    emit_sse(as, 0x66, true, 0x6e, xmm, reg);       // movq xmm, reg
+    patch_here(as, done);
+    return not_number;
+}
+
+// xmm0 as a value in rax, NaN canonical as js_create_number makes it
+static void emit_box_double(jit_assembler_t* as) {
+    emit_sse(as, 0x66, true, 0x7e, XMM0, RAX);      // movq rax, xmm0
+    emit_sse(as, 0x66, false, 0x2e, XMM0, XMM0);    // ucomisd xmm0, xmm0
+    uint32_t ordered = emit_jcc_forward(as, CC_NP);
+    emit_mov_imm(as, RAX, JS_CANONICAL_NAN);
+    patch_here(as, ordered);
+}
+
+// a = S(sp - 2), b = S(sp - 1) -> S(sp - 2). Both int32 run inline, and
+// for + - * / so do doubles. Results that leave int32 take the double
+// path; anything else steps.
+static void emit_binary(jit_assembler_t* as, js_opcode_t op, uint32_t pc, int32_t sp) {
+    int32_t a = stack_disp(as->bytecode, sp - 2);
+    int32_t b = stack_disp(as->bytecode, sp - 1);
+    bool floating = op == JS_OP_ADD || op == JS_OP_SUB || op == JS_OP_MUL || op == JS_OP_DIV;
+    uint32_t number[8];
+    uint32_t number_count = 0;
+    uint32_t slow[4];
+    uint32_t slow_count = 0;
+    uint32_t* fallback = floating ? number : slow;
+    uint32_t* fallback_count = floating ? &number_count : &slow_count;
+    
+    emit_load(as, RAX, a);
+    emit_load(as, RCX, b);
+    fallback[(*fallback_count)++] = emit_guard_int(as, RAX);
+    fallback[(*fallback_count)++] = emit_guard_int(as, RCX);
+    
+    switch (op) {
+        case JS_OP_ADD:
+            emit_rr(as, false, 0x01, RCX, RAX);
+            number[number_count++] = emit_jcc_forward(as, CC_O);
+            break;
+        case JS_OP_SUB:
+            emit_rr(as, false, 0x29, RCX, RAX);
+            number[number_count++] = emit_jcc_forward(as, CC_O);
+            break;
+        case JS_OP_MUL: {
+            // A zero product with a negative operand is -0, a double
+            emit_rr(as, false, 0x89, RAX, RDX);
+            emit_rr(as, false, 0x09, RCX, RDX);
+            emit_rr(as, false, 0x1af, RAX, RCX);
+            number[number_count++] = emit_jcc_forward(as, CC_O);
+            emit_rr(as, false, 0x85, RAX, RAX);
+            uint32_t nonzero = emit_jcc_forward(as, CC_NE);
+            emit_rr(as, false, 0x85, RDX, RDX);
+            number[number_count++] = emit_jcc_forward(as, CC_S);
+            patch_here(as, nonzero);
+            break;
+        }
+        case JS_OP_DIV: {
+            // Exact quotients stay int32, as in the interpreter: not by
+            // zero, not INT32_MIN / -1 (which idiv faults on), and not 0 by
+            // a negative
+            emit_rr(as, false, 0x85, RCX, RCX);
+            number[number_count++] = emit_jcc_forward(as, CC_E);
+            emit_rr(as, false, 0x85, RAX, RAX);
+            uint32_t nonzero = emit_jcc_forward(as, CC_NE);
+            emit_rr(as, false, 0x85, RCX, RCX);
+            number[number_count++] = emit_jcc_forward(as, CC_S);
+            patch_here(as, nonzero);
+            emit_rr(as, false, 0x81, 7, RAX);           // cmp eax, INT32_MIN
+            emit32(as, 0x80000000u);
+            uint32_t divide = emit_jcc_forward(as, CC_NE);
+            emit_rr(as, false, 0x83, 7, RCX);           // cmp ecx, -1
+            emit8(as, 0xff);
+            number[number_count++] = emit_jcc_forward(as, CC_E);
+            patch_here(as, divide);
+            emit8(as, 0x99);                            // cdq
+            emit_rr(as, false, 0xf7, 7, RCX);           // idiv ecx
+            emit_rr(as, false, 0x85, RDX, RDX);
+            number[number_count++] = emit_jcc_forward(as, CC_NE);
+            break;
+        }
+        case JS_OP_MOD:
+            // Only the non-negative remainder is an int32 the same way fmod
+            // would have it
+            emit_rr(as, false, 0x85, RAX, RAX);
+            slow[slow_count++] = emit_jcc_forward(as, CC_S);
+            emit_rr(as, false, 0x85, RCX, RCX);
+            slow[slow_count++] = emit_jcc_forward(as, CC_LE);
+            emit8(as, 0x99);
+            emit_rr(as, false, 0xf7, 7, RCX);
+            emit_rr(as, false, 0x89, RDX, RAX);
+            break;
+        case JS_OP_BIT_AND: emit_rr(as, false, 0x21, RCX, RAX); break;
+        case JS_OP_BIT_OR: emit_rr(as, false, 0x09, RCX, RAX); break;
+        case JS_OP_BIT_XOR: emit_rr(as, false, 0x31, RCX, RAX); break;
+        case JS_OP_SHL: emit_rr(as, false, 0xd3, 4, RAX); break;
+        case JS_OP_SHR: emit_rr(as, false, 0xd3, 7, RAX); break;
+        default:
+            // USHR: results past INT32_MAX are doubles
+            emit_rr(as, false, 0xd3, 5, RAX);
+            emit_rr(as, false, 0x85, RAX, RAX);
+            slow[slow_count++] = emit_jcc_forward(as, CC_S);
+            break;
+    }
+    
+    // 32-bit operations clear the upper half; put the tag back
+    emit_rr(as, true, 0x09, INT_TAG_REG, RAX);
+    emit_store(as, RAX, a);
+    uint32_t done = emit_jmp_forward(as);
+    uint32_t number_done = 0;
+    
+    if (floating) {
+        for (uint32_t i = 0; i < number_count; i++) patch_here(as, number[i]);
+        emit_load(as, RAX, a);
+        emit_load(as, RCX, b);
+        slow[slow_count++] = emit_to_double(as, RAX, XMM0);
+        slow[slow_count++] = emit_to_double(as, RCX, XMM1);
+        static const uint8_t sse_op[] = { 0x58, 0x5c, 0x59, 0x5e };     // add, sub, mul, div
+        emit_sse(as, 0xf2, false, sse_op[op - JS_OP_ADD], XMM0, XMM1);
+        emit_box_double(as);
+        emit_store(as, RAX, a);
+        number_done = emit_jmp_forward(as);
+    }
+    
+    for (uint32_t i = 0; i < slow_count; i++) patch_here(as, slow[i]);
+    emit_step(as, pc, sp);
+    patch_here(as, done);
+    if (floating) patch_here(as, number_done);
+}
+
+static void emit_compare(jit_assembler_t* as, js_opcode_t op, uint32_t pc, int32_t sp) {
+    int32_t a = stack_disp(as->bytecode, sp - 2);
+    int32_t b = stack_disp(as->bytecode, sp - 1);
+    bool relational = op == JS_OP_LT || op == JS_OP_LE || op == JS_OP_GT || op == JS_OP_GE;
+    
+    emit_load(as, RAX, a);
+    emit_load(as, RCX, b);
+    uint32_t not_int_a = emit_guard_int(as, RAX);
+    uint32_t not_int_b = emit_guard_int(as, RCX);
+    
+    int cc;
+    switch (op) {
+        case JS_OP_LT: cc = CC_L; break;
+        case JS_OP_LE: cc = CC_LE; break;
+        case JS_OP_GT: cc = CC_G; break;
+        case JS_OP_GE: cc = CC_GE; break;
+        case JS_OP_EQ:
+        case JS_OP_STRICT_EQ: cc = CC_E; break;
+        default: cc = CC_NE; break;
+    }
+    emit_rr(as, false, 0x39, RCX, RAX);
+    emit_rr(as, false, 0x190 | cc, 0, RAX);     // setcc al
+    uint32_t boolean = (uint32_t)as->length;
+    emit_rr(as, false, 0x1b6, RAX, RAX);        // movzx eax, al
+    emit_mov_imm(as, RDX, JS_FALSE.bits);
+    emit_rr(as, true, 0x01, RDX, RAX);          // JS_TRUE is JS_FALSE + 1
+    emit_store(as, RAX, a);
+    uint32_t done = emit_jmp_forward(as);
+    
+    uint32_t slow[2];
+    uint32_t slow_count = 0;
+    patch_here(as, not_int_a);
+    patch_here(as, not_int_b);
+    if (relational) {
+        // Unordered sets CF and ZF, so NaN compares false through "above"
+        emit_load(as, RAX, a);
+        emit_load(as, RCX, b);
+        slow[slow_count++] = emit_to_double(as, RAX, XMM0);
+        slow[slow_count++] = emit_to_double(as, RCX, XMM1);
+        bool swap = op == JS_OP_LT || op == JS_OP_LE;
+        emit_sse(as, 0x66, false, 0x2e, swap ? XMM1 : XMM0, swap ? XMM0 : XMM1);
+        emit_rr(as, false, 0x190 | ((op == JS_OP_LT || op == JS_OP_GT) ? CC_A : CC_AE), 0, RAX);
+        emit_jmp_back(as, boolean);
+    }
+    for (uint32_t i = 0; i < slow_count; i++) patch_here(as, slow[i]);
+    emit_step(as, pc, sp);
+    patch_here(as, done);
+}
+
+static void emit_increment(jit_assembler_t* as, js_opcode_t op, uint32_t pc, int32_t sp) {
+    int32_t a = stack_disp(as->bytecode, sp - 1);
+    
+    emit_load(as, RAX, a);
+    uint32_t slow = emit_guard_int(as, RAX);
+    emit_rr(as, false, 0x83, op == JS_OP_INC ? 0 : 5, RAX);    // add/sub eax, 1
+    emit8(as, 1);
+    uint32_t overflow = emit_jcc_forward(as, CC_O);
+    emit_rr(as, true, 0x09, INT_TAG_REG, RAX);
+    emit_store(as, RAX, a);
+    uint32_t done = emit_jmp_forward(as);
+    
+    patch_here(as, slow);
+    patch_here(as, overflow);
+    emit_step(as, pc, sp);
+    patch_here(as, done);
+}
+
+static void emit_branch(jit_assembler_t* as, bool if_true, int32_t sp, uint32_t target, uint32_t next) {
+    uint32_t truthy = if_true ? target : next;
+    uint32_t falsy = if_true ? next : target;
+    
+    // Booleans, then int32s, inline
+    emit_load(as, RAX, stack_disp(as->bytecode, sp - 1));
+    emit_mov_imm(as, RDX, JS_TRUE.bits);
+    emit_rr(as, true, 0x39, RDX, RAX);
+    emit_jcc_label(as, CC_E, truthy);
+    emit_mov_imm(as, RDX, JS_FALSE.bits);
+    emit_rr(as, true, 0x39, RDX, RAX);
+    emit_jcc_label(as, CC_E, falsy);
+    
+    uint32_t slow = emit_guard_int(as, RAX);
+    emit_rr(as, false, 0x85, RAX, RAX);
+    emit_jcc_label(as, CC_NE, truthy);
+    emit_jmp_label(as, falsy);
+    
+    patch_here(as, slow);
+    emit_rr(as, true, 0x89, RAX, RDI);
+    emit_call(as, (const void*)jit_truthy);
+    emit_rr(as, false, 0x85, RAX, RAX);
+    emit_jcc_label(as, CC_NE, truthy);
+    emit_jmp_label(as, falsy);
+}
+
+// Own data slots the cache has seen get a shape test each; the rest,
+// prototype hits, getters and setters included, step through the cache
+static bool cached_slot(const js_ic_entry_t* entry, bool store) {
+    return entry->depth == 0 && entry->kind == (store ? JS_IC_STORE_SLOT : JS_IC_LOAD_SLOT);
+}
+
+static void emit_get_prop(jit_assembler_t* as, uint32_t pc, int32_t sp, const js_property_ic_t* ic) {
+    uint32_t exits[JS_IC_MAX_ENTRIES];
+    uint32_t exit_count = 0;
+    int32_t object = stack_disp(as->bytecode, sp - 1);
+    
+    if (ic->state == JS_IC_MONOMORPHIC || ic->state == JS_IC_POLYMORPHIC) {
+        emit_load(as, RAX, object);
+        uint32_t slow = emit_guard_object(as);
+        emit_mem(as, true, 0x8b, RCX, RAX, (int32_t)offsetof(js_object_t, shape));
+        for (uint32_t i = 0; i < ic->entry_count; i++) {
+            const js_ic_entry_t* entry = &ic->entries[i];
+            if (!cached_slot(entry, false)) continue;
+            
+            emit_mov_imm(as, RDX, (uint64_t)(uintptr_t)entry->shape);
+            emit_rr(as, true, 0x39, RDX, RCX);
+            uint32_t miss = emit_jcc_forward(as, CC_NE);
+            emit_mem(as, true, 0x8b, RAX, RAX, (int32_t)offsetof(js_object_t, slots));
+            emit_mem(as, true, 0x8b, RAX, RAX, (int32_t)(entry->slot * sizeof(js_value_t)));
+            emit_store(as, RAX, object);
+            exits[exit_count++] = emit_jmp_forward(as);
+            patch_here(as, miss);
+        }
+        patch_here(as, slow);
+    }
+    emit_step(as, pc, sp);
+    for (uint32_t i = 0; i < exit_count; i++) patch_here(as, exits[i]);
+}
+
+static void emit_set_prop(jit_assembler_t* as, uint32_t pc, int32_t sp, const js_property_ic_t* ic) {
+    uint32_t exits[JS_IC_MAX_ENTRIES * 2];
+    uint32_t exit_count = 0;
+    
+    if (ic->state == JS_IC_MONOMORPHIC || ic->state == JS_IC_POLYMORPHIC) {
+        emit_load(as, RAX, stack_disp(as->bytecode, sp - 2));
+        uint32_t slow = emit_guard_object(as);
+        emit_mem(as, true, 0x8b, RCX, RAX, (int32_t)offsetof(js_object_t, shape));
+        for (uint32_t i = 0; i < ic->entry_count; i++) {
+            const js_ic_entry_t* entry = &ic->entries[i];
+            if (!cached_slot(entry, true)) continue;
+            
+            emit_mov_imm(as, RDX, (uint64_t)(uintptr_t)entry->shape);
+            emit_rr(as, true, 0x39, RDX, RCX);
+            uint32_t miss = emit_jcc_forward(as, CC_NE);
+            emit_load(as, RCX, stack_disp(as->bytecode, sp - 1));
+            emit_mem(as, true, 0x8b, RDX, RAX, (int32_t)offsetof(js_object_t, slots));
+            emit_mem(as, true, 0x89, RCX, RDX, (int32_t)(entry->slot * sizeof(js_value_t)));
+            
+            // Write barrier, taken only by old objects not yet remembered
+            emit_mem(as, false, 0x1b6, RDX, RAX, (int32_t)offsetof(js_cell_t, gc_flags));
+            emit_rr(as, false, 0x83, 4, RDX);   // and edx, OLD | REMEMBERED
+            emit8(as, JS_GC_OLD | JS_GC_REMEMBERED);
+            emit_rr(as, false, 0x83, 7, RDX);   // cmp edx, OLD
+            emit8(as, JS_GC_OLD);
+            exits[exit_count++] = emit_jcc_forward(as, CC_NE);
+            emit_rr(as, true, 0x89, RAX, RDI);
+            emit_rr(as, true, 0x89, RCX, RSI);
+            emit_call(as, (const void*)jit_write_barrier);
+            exits[exit_count++] = emit_jmp_forward(as);
+            patch_here(as, miss);
+        }
+        patch_here(as, slow);
+    }
+    emit_step(as, pc, sp);
+    for (uint32_t i = 0; i < exit_count; i++) patch_here(as, exits[i]);
+}
+
+// Loop headers poll the collector, and js_interrupt, which throws
+static void emit_safepoint_poll(jit_assembler_t* as, js_engine_t* engine) {
+    const js_gc_heap_t* heap = js_gc_heap(engine);
+    if (heap) {
+        emit_mov_imm(as, RAX, (uint64_t)(uintptr_t)&heap->pending);
+        emit8(as, 0x80);                // cmp byte [rax], 0
+        emit8(as, 0x38);
+        emit8(as, 0);
+        uint32_t idle = emit_jcc_forward(as, CC_E);
+        emit_rr(as, true, 0x89, STATE_REG, RDI);
+        emit_call(as, (const void*)jit_safepoint);
+        patch_here(as, idle);
+    }
+    
+    emit_mov_imm(as, RAX, (uint64_t)(uintptr_t)&engine->error.interrupted);
+    emit8(as, 0x80);                    // cmp byte [rax], 0
+    emit8(as, 0x38);
+    emit8(as, 0);
+    uint32_t running = emit_jcc_forward(as, CC_E);
+    emit_rr(as, true, 0x89, STATE_REG, RDI);
+    emit_call(as, (const void*)jit_interrupt);
+    emit_jmp_label(as, LABEL_EXCEPTION(as));
+    patch_here(as, running);
+}
+
+static void emit_instruction(jit_assembler_t* as, uint32_t pc, int32_t sp) {
+    js_bytecode_t* bytecode = as->bytecode;
+    uint32_t insn = bytecode->code[pc];
+    uint32_t operand = JS_INSN_OPERAND(insn);
+    js_opcode_t op = (js_opcode_t)JS_INSN_OP(insn);
+    
+    switch (op) {
+        case JS_OP_NOP:
+        case JS_OP_POP:
+            break;
+        case JS_OP_LOAD_CONST:
+            emit_mov_imm(as, RAX, bytecode->constants[operand].bits);
+            emit_store(as, RAX, stack_disp(bytecode, sp));
+            break;
+        case JS_OP_LOAD_INT:
+            emit_mov_imm(as, RAX, js_create_int(JS_INSN_SIGNED(insn)).bits);
+            emit_store(as, RAX, stack_disp(bytecode, sp));
+            break;
+        case JS_OP_LOAD_UNDEFINED:
+        case JS_OP_LOAD_NULL:
+        case JS_OP_LOAD_TRUE:
+        case JS_OP_LOAD_FALSE: {
+            js_value_t value = op == JS_OP_LOAD_UNDEFINED ? JS_UNDEFINED : op == JS_OP_LOAD_NULL ? JS_NULL : js_create_boolean(op == JS_OP_LOAD_TRUE);
+            emit_mov_imm(as, RAX, value.bits);
+            emit_store(as, RAX, stack_disp(bytecode, sp));
+            break;
+        }
+        case JS_OP_LOAD_THIS:
+            emit_load(as, RAX, 0);
+            emit_store(as, RAX, stack_disp(bytecode, sp));
+            break;
+        case JS_OP_GET_LOCAL:
+            emit_load(as, RAX, local_disp(bytecode, operand));
+            emit_store(as, RAX, stack_disp(bytecode, sp));
+            break;
+        case JS_OP_SET_LOCAL:
+            emit_load(as, RAX, stack_disp(bytecode, sp - 1));
+            emit_store(as, RAX, local_disp(bytecode, operand));
+            break;
+        case JS_OP_DUP:
+            emit_load(as, RAX, stack_disp(bytecode, sp - 1));
+            emit_store(as, RAX, stack_disp(bytecode, sp));
+            break;
+        case JS_OP_SWAP:
+            emit_load(as, RAX, stack_disp(bytecode, sp - 1));
+            emit_load(as, RCX, stack_disp(bytecode, sp - 2));
+            emit_store(as, RAX, stack_disp(bytecode, sp - 2));
+            emit_store(as, RCX, stack_disp(bytecode, sp - 1));
+            break;
+        case JS_OP_GET_PROP:
+            emit_get_prop(as, pc, sp, &bytecode->ics[operand]);
+            break;
+        case JS_OP_SET_PROP:
+            emit_set_prop(as, pc, sp, &bytecode->ics[operand]);
+            break;
+        case JS_OP_ADD:
+        case JS_OP_SUB:
+        case JS_OP_MUL:
+        case JS_OP_DIV:
+        case JS_OP_MOD:
+        case JS_OP_BIT_AND:
+        case JS_OP_BIT_OR:
+        case JS_OP_BIT_XOR:
+        case JS_OP_SHL:
+        case JS_OP_SHR:
+        case JS_OP_USHR:
+            emit_binary(as, op, pc, sp);
+            break;
+        case JS_OP_EQ:
+        case JS_OP_NE:
+        case JS_OP_STRICT_EQ:
+        case JS_OP_STRICT_NE:
+        case JS_OP_LT:
+        case JS_OP_LE:
+        case JS_OP_GT:
+        case JS_OP_GE:
+            emit_compare(as, op, pc, sp);
+            break;
+        case JS_OP_INC:
+        case JS_OP_DEC:
+            emit_increment(as, op, pc, sp);
+            break;
+        case JS_OP_JUMP:
+            emit_jmp_label(as, (uint32_t)((int64_t)pc + 1 + JS_INSN_SIGNED(insn)));
+            break;
+        case JS_OP_JUMP_IF_FALSE:
+        case JS_OP_JUMP_IF_TRUE:
+            emit_branch(as, op == JS_OP_JUMP_IF_TRUE, sp, (uint32_t)((int64_t)pc + 1 + JS_INSN_SIGNED(insn)), pc + 1);
+            break;
+        case JS_OP_RETURN:
+            emit_load(as, RAX, stack_disp(bytecode, sp - 1));
+            emit_jmp_label(as, LABEL_RETURN(as));
+            break;
+        default:
+            emit_step(as, pc, sp);
+            break;
+    }
+}
+
+static bool assemble(jit_assembler_t* as, js_engine_t* engine, const int32_t* depth, const bool* loop_header) {
+    js_bytecode_t* bytecode = as->bytecode;
+    static const uint8_t prologue[] = {
+        0x53,                           // push rbx
+        0x41, 0x54,                     // push r12
+        0x41, 0x55,                     // push r13
+        0x41, 0x56,                     // push r14
+        0x41, 0x57,                     // push r15
+        0x49, 0x89, 0xfd,               // mov r13, rdi
+    };
+    static const uint8_t epilogue[] = {
+        0x41, 0x5f, 0x41, 0x5e, 0x41, 0x5d, 0x41, 0x5c, 0x5b, 0xc3
+    };
+    
+    emit_bytes(as, prologue, sizeof(prologue));
+    emit_mem(as, true, 0x8b, FRAME_REG, STATE_REG, (int32_t)offsetof(js_jit_frame_t, frame));
+    emit_mov_imm(as, EXCEPTION_REG, JS_EXCEPTION.bits);
+    emit_mov_imm(as, INT_TAG_REG, JS_TAG_INT << JS_TAG_SHIFT);
+    
+    // Entry at a loop header continues the interpreter's frame
+    for (uint32_t pc = 1; pc < bytecode->length; pc++) {
+        if (!loop_header[pc]) continue;
+        emit_rr(as, false, 0x81, 7, RSI);   // cmp esi, pc
+        emit32(as, pc);
+        emit_jcc_label(as, CC_E, pc);
+    }
+    
+    for (uint32_t pc = 0; pc < bytecode->length; pc++) {
+        as->labels[pc] = (uint32_t)as->length;
+        if (loop_header[pc]) emit_safepoint_poll(as, engine);
+        emit_instruction(as, pc, depth[pc]);
+    }
+    
+    // Falling off the end returns undefined
+    as->labels[bytecode->length] = (uint32_t)as->length;
+    emit_mov_imm(as, RAX, JS_UNDEFINED.bits);
+    emit_jmp_label(as, LABEL_RETURN(as));
+    as->labels[LABEL_EXCEPTION(as)] = (uint32_t)as->length;
+    emit_rr(as, true, 0x89, EXCEPTION_REG, RAX);
+    as->labels[LABEL_RETURN(as)] = (uint32_t)as->length;
+    emit_bytes(as, epilogue, sizeof(epilogue));
+    if (as->failed) return false;
+    
+    for (uint32_t i = 0; i < as->fixup_count; i++) {
+        const jit_fixup_t* fixup = &as->fixups[i];
+        int32_t offset = (int32_t)(as->labels[fixup->label] - (fixup->at + 4));
+        memcpy(as->code + fixup->at, &offset, 4);
+    }
+    return true;
+}
+
+bool js_jit_compile(js_engine_t* engine, js_bytecode_t* bytecode) {
+    if (!engine || !bytecode) return false;
+    if (bytecode->jit) return true;
+    
+    js_jit_t* jit = jit_state(engine);
+    int32_t* depth = malloc((bytecode->length + 1) * sizeof(int32_t));
+    bool* loop_header = calloc(bytecode->length + 1, sizeof(bool));
+    jit_assembler_t as = { 0 };
+    as.bytecode = bytecode;
+    as.labels = calloc(bytecode->length + 3, sizeof(uint32_t));
+    
+    bool ok = jit && depth && loop_header && as.labels && js_bytecode_verify(bytecode, depth, loop_header) &&
+              assemble(&as, engine, depth, loop_header);
+    if (ok) {
+        bytecode->jit = jit_install(jit, as.code, as.length);
+        ok = bytecode->jit != NULL;
+    }
+    
+    free(as.code);
+    free(as.labels);
+    free(as.fixups);
+    free(depth);
+    free(loop_header);
+    
+    if (!ok) {
+        bytecode->jit_failed = true;
+        if (jit) jit->failed++;
+        return false;
+    }
+    jit->compiled++;
+    return true;
+}
+
+#else
+
+bool js_jit_compile(js_engine_t* engine, js_bytecode_t* bytecode) {
+    (void)engine;
+    if (bytecode) bytecode->jit_failed = true;
+    return false;
+}
+
+void js_jit_destroy(js_engine_t* engine) {
+    if (!engine) return;
+    free(engine->compilation.optimizer);
+    engine->compilation.optimizer = NULL;
+}
+
+#endif
@@ -0,0 +1,69 @@
+#ifndef JS_JIT_H
+#define JS_JIT_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "bytecode.h"
+
+// Baseline JIT: a template compiler from bytecode to x86_64 machine code,
+// run once a function is hot. Compiled code works on the interpreter's
+// own frame, so either tier can continue the other's work at any
+// instruction:
+// - Operand stack depth is static at every instruction, so stack slots
+//   become fixed frame offsets and the stack pointer disappears.
+// - int32 arithmetic, comparisons, branches and locals run inline.
+// - Named property loads and stores test the shapes their inline cache
+//   has seen when the function is compiled, and read or write the slot
+//   directly.
+// - Everything else, and every fast path whose guard fails, runs that one
+//   instruction through js_interpret_frame.
+// - Loop headers are entry points too, so a long loop already running in
+//   the interpreter moves over at its next back-edge.
+//
+// Enabled by compilation.jit_enabled with compilation.optimization_level
+// at least JS_JIT_LEVEL_BASELINE. Compiled code lives in executable
+// chunks behind compilation.optimizer until js_jit_destroy.
+#define JS_JIT_LEVEL_BASELINE 1
+
+#define JS_JIT_THRESHOLD 2000           // Hotness that triggers compilation
+#define JS_JIT_CALL_WEIGHT 20           // Hotness per call; 1 per back-edge
+#define JS_JIT_CHUNK_SIZE (256 * 1024)
+#define JS_JIT_MAX_CODE (1024 * 1024)   // Bigger functions stay interpreted
+
+typedef struct js_jit js_jit_t;
+
+// Sets compilation.jit_enabled and optimization_level together
+void js_jit_enable(js_engine_t* engine, bool enabled);
+void js_jit_destroy(js_engine_t* engine);
+
+static inline bool js_jit_enabled(const js_engine_t* engine) {
+    return engine->compilation.jit_enabled && engine->compilation.optimization_level >= JS_JIT_LEVEL_BASELINE;
+}
+
+// Compiles bytecode, or marks it jit_failed. False on failure, including
+// on hosts other than x86_64.
+bool js_jit_compile(js_engine_t* engine, js_bytecode_t* bytecode);
+
+// Runs compiled code on a frame js_interpret set up, from pc: 0 or the
+// target of a backward jump, with the operand stack as the interpreter
+// left it there
+js_value_t js_jit_run(js_engine_t* engine, js_bytecode_t* bytecode, js_value_t* frame, uint32_t pc);
+
+// Tiering counters. Each returns whether compiled code is ready to run.
+static inline bool js_jit_count(js_engine_t* engine, js_bytecode_t* bytecode, uint32_t weight) {
+    if (bytecode->jit) return true;
+    if (bytecode->jit_failed || !js_jit_enabled(engine)) return false;
+    
+    bytecode->hotness += weight;
+    return bytecode->hotness >= JS_JIT_THRESHOLD && js_jit_compile(engine, bytecode);
+}
+
+static inline bool js_jit_count_call(js_engine_t* engine, js_bytecode_t* bytecode) {
+    return js_jit_count(engine, bytecode, JS_JIT_CALL_WEIGHT);
+}
+
+static inline bool js_jit_count_loop(js_engine_t* engine, js_bytecode_t* bytecode) {
+    return js_jit_count(engine, bytecode, 1);
+}
+
+#endif
@@ -0,0 +1,442 @@
+#include "shape.h"
+#include "gc.h"
+#include "../capacity.h"
+#include <stdlib.h>
+#include <string.h>
+
+// Tables up to this size are scanned; larger ones get a hash index
+#define JS_SHAPE_LINEAR_LOOKUP 8
+
+static uint32_t key_hash(atom_t key) {
+    return key * 2654435761u;
+}
+
+// Property tables
+
+static js_property_table_t* table_create(uint32_t capacity) {
+    js_property_table_t* table = calloc(1, sizeof(js_property_table_t));
+    if (!table) return NULL;
+    
+    table->ref_count = 1;
+    if (capacity) {
+        table->entries = malloc(capacity * sizeof(js_shape_property_t));
+        if (!table->entries) {
+            free(table);
+            return NULL;
+        }
+        table->capacity = capacity;
+    }
+    return table;
+}
+
+static void table_release(js_property_table_t* table) {
+    if (!table || --table->ref_count > 0) return;
+    free(table->entries);
+    free(table->buckets);
+    free(table);
+}
+
+static bool table_rehash(js_property_table_t* table) {
+    uint32_t bucket_count = capacity_reserve(0, (uint64_t)table->count * 2, 16, sizeof(uint32_t));
+    
+    uint32_t* buckets = bucket_count ? calloc(bucket_count, sizeof(uint32_t)) : NULL;
+    if (!buckets) return false;
+    
+    for (uint32_t i = 0; i < table->count; i++) {
+        uint32_t mask = bucket_count - 1;
+        uint32_t bucket = key_hash(table->entries[i].key) & mask;
+        while (buckets[bucket]) bucket = (bucket + 1) & mask;
+        buckets[bucket] = i + 1;
+    }
+    free(table->buckets);
+    table->buckets = buckets;
+    table->bucket_count = bucket_count;
+    return true;
+}
+
+static bool table_append(js_property_table_t* table, const js_shape_property_t* property) {
+    if (table->count >= table->capacity) {
+        uint32_t capacity = capacity_grow(table->capacity, 4, sizeof(js_shape_property_t));
+        js_shape_property_t* entries = capacity ? realloc(table->entries, capacity * sizeof(js_shape_property_t)) : NULL;
+        if (!entries) return false;
+        table->entries = entries;
+        table->capacity = capacity;
+    }
+    table->entries[table->count++] = *property;
+    
+    if (table->count <= JS_SHAPE_LINEAR_LOOKUP) return true;
+    if (table->count * 2 > table->bucket_count) {
+        if (!table_rehash(table)) {
+            table->count--;
+            return false;
+        }
+        return true;
+    }
+    uint32_t mask = table->bucket_count - 1;
+    uint32_t bucket = key_hash(property->key) & mask;
+    while (table->buckets[bucket]) bucket = (bucket + 1) & mask;
+    table->buckets[bucket] = table->count;
+    return true;
+}
+
+// Only the first limit entries belong to the asking shape. Keys within a
+// table are unique, so a match past limit means absent.
+static int32_t table_find(const js_property_table_t* table, atom_t key, uint32_t limit) {
+    if (!table->buckets) {
+        for (uint32_t i = 0; i < limit; i++) {
+            if (table->entries[i].key == key) return (int32_t)i;
+        }
+        return -1;
+    }
+    
+    uint32_t mask = table->bucket_count - 1;
+    for (uint32_t bucket = key_hash(key) & mask; table->buckets[bucket]; bucket = (bucket + 1) & mask) {
+        uint32_t index = table->buckets[bucket] - 1;
+        if (table->entries[index].key == key) return index < limit ? (int32_t)index : -1;
+    }
+    return -1;
+}
+
+static js_property_table_t* table_copy(const js_property_table_t* table, uint32_t count, uint32_t extra) {
+    js_property_table_t* copy = table_create(count + extra);
+    if (!copy) return NULL;
+    
+    if (count) memcpy(copy->entries, table->entries, count * sizeof(js_shape_property_t));
+    copy->count = count;
+    if (count > JS_SHAPE_LINEAR_LOOKUP && !table_rehash(copy)) {
+        table_release(copy);
+        return NULL;
+    }
+    return copy;
+}
+
+// Shapes
+
+js_shape_t* js_shape_create_empty(void) {
+    js_shape_t* shape = calloc(1, sizeof(js_shape_t));
+    if (!shape) return NULL;
+    
+    shape->table = table_create(0);
+    if (!shape->table) {
+        free(shape);
+        return NULL;
+    }
+    return shape;
+}
+
+static void shape_free(js_shape_t* shape) {
+    table_release(shape->table);
+    free(shape->transitions);
+    free(shape);
+}
+
+void js_shape_destroy_tree(js_shape_t* shape) {
+    if (!shape) return;
+    for (uint32_t i = 0; i < shape->transition_count; i++) {
+        js_shape_destroy_tree(shape->transitions[i]);
+    }
+    shape_free(shape);
+}
+
+int32_t js_shape_lookup(const js_shape_t* shape, atom_t key) {
+    if (!shape || key == ATOM_NULL) return -1;
+    return table_find(shape->table, key, shape->property_count);
+}
+
+const js_shape_property_t* js_shape_property(const js_shape_t* shape, uint32_t index) {
+    if (!shape || index >= shape->property_count) return NULL;
+    return &shape->table->entries[index];
+}
+
+static bool same_property(const js_shape_property_t* a, const js_shape_property_t* b) {
+    return a->key == b->key && a->attributes == b->attributes && a->getter == b->getter && a->setter == b->setter;
+}
+
+// The shared shape for shape plus property, reusing an earlier transition
+static js_shape_t* shape_transition(js_shape_t* shape, const js_shape_property_t* property) {
+    for (uint32_t i = 0; i < shape->transition_count; i++) {
+        js_shape_t* child = shape->transitions[i];
+        if (same_property(&child->table->entries[shape->property_count], property)) return child;
+    }
+    
+    if (shape->transition_count >= shape->transition_capacity) {
+        uint32_t capacity = capacity_grow(shape->transition_capacity, 2, sizeof(js_shape_t*));
+        js_shape_t** transitions = capacity ? realloc(shape->transitions, capacity * sizeof(js_shape_t*)) : NULL;
+        if (!transitions) return NULL;
+        shape->transitions = transitions;
+        shape->transition_capacity = capacity;
+    }
+    
+    js_shape_t* child = calloc(1, sizeof(js_shape_t));
+    if (!child) return NULL;
+    
+    // The first child extends the parent's table in place; later siblings
+    // would overwrite its entries and get a copy instead
+    js_property_table_t* table = shape->table;
+    if (table->count == shape->property_count) {
+        if (!table_append(table, property)) {
+            free(child);
+            return NULL;
+        }
+        table->ref_count++;
+    } else {
+        table = table_copy(table, shape->property_count, 4);
+        if (!table || !table_append(table, property)) {
+            table_release(table);
+            free(child);
+            return NULL;
+        }
+    }
+    
+    child->parent = shape;
+    child->table = table;
+    child->property_count = shape->property_count + 1;
+    shape->transitions[shape->transition_count++] = child;
+    return child;
+}
+
+// Objects
+
+void js_object_init(js_engine_t* engine, js_object_t* object, js_object_t* prototype) {
+    if (!object) return;
+    
+    if (engine && !engine->shapes) engine->shapes = js_shape_create_empty();
+    object->prototype = prototype;
+    if (prototype) js_gc_write_barrier_cell(&object->base, &prototype->base);
+    object->shape = engine ? engine->shapes : NULL;
+    object->slots = NULL;
+    object->slot_capacity = 0;
+    object->extensible = true;
+}
+
+// Slot storage is a cell of its own; only a dictionary shape needs freeing
+void js_object_finalize(js_object_t* object) {
+    if (!object) return;
+    
+    if (object->shape && object->shape->dictionary) shape_free(object->shape);
+    object->slots = NULL;
+    object->slot_capacity = 0;
+    object->shape = NULL;
+}
+
+bool js_object_reserve_slots(js_object_t* object, uint32_t count) {
+    if (count <= object->slot_capacity) return true;
+    
+    uint32_t capacity = capacity_reserve(object->slot_capacity, count, 4, sizeof(js_value_t));
+    if (!capacity) return false;
+    js_gc_slots_t* storage = (js_gc_slots_t*)js_gc_alloc(js_gc_heap_of(&object->base), JS_CELL_SLOTS, sizeof(js_gc_slots_t) + capacity * sizeof(js_value_t));
+    if (!storage) return false;
+    
+    // The old storage is left to the collector
+    if (object->slot_capacity) memcpy(storage->values, object->slots, object->slot_capacity * sizeof(js_value_t));
+    for (uint32_t i = object->slot_capacity; i < capacity; i++) storage->values[i] = JS_UNDEFINED;
+    object->slots = storage->values;
+    object->slot_capacity = capacity;
+    js_gc_write_barrier_cell(&object->base, &storage->base);
+    return true;
+}
+
+// Gives the object its own mutable copy of its shape
+static bool object_normalize(js_object_t* object) {
+    js_shape_t* shape = object->shape;
+    if (shape->dictionary) return true;
+    
+    js_shape_t* dictionary = calloc(1, sizeof(js_shape_t));
+    if (!dictionary) return false;
+    
+    dictionary->table = table_copy(shape->table, shape->property_count, 4);
+    if (!dictionary->table) {
+        free(dictionary);
+        return false;
+    }
+    dictionary->property_count = shape->property_count;
+    dictionary->dictionary = true;
+    object->shape = dictionary;
+    js_gc_register_finalizer(&object->base);
+    return true;
+}
+
+static bool object_add(js_object_t* object, const js_shape_property_t* property, js_value_t value) {
+    if (!object->shape || !object->extensible) return false;
+    if (!js_object_reserve_slots(object, object->shape->property_count + 1)) return false;
+    
+    if (!object->shape->dictionary && object->shape->property_count >= JS_SHAPE_MAX_PROPERTIES) {
+        if (!object_normalize(object)) return false;
+    }
+    
+    js_shape_t* shape = object->shape;
+    if (shape->dictionary) {
+        if (!table_append(shape->table, property)) return false;
+        shape->property_count++;
+    } else {
+        js_shape_t* next = shape_transition(shape, property);
+        if (!next) return false;
+        object->shape = next;
+    }
+    
+    object->slots[object->shape->property_count - 1] = value;
+    js_gc_write_barrier(&object->base, value);
+    return true;
+}
+
+static void store_slot(js_object_t* object, uint32_t slot, js_value_t value) {
+    object->slots[slot] = value;
+    js_gc_write_barrier(&object->base, value);
+}
+
+bool js_object_get(js_object_t* object, atom_t key, js_value_t* value) {
+    for (js_object_t* holder = object; holder; holder = holder->prototype) {
+        int32_t index = js_shape_lookup(holder->shape, key);
+        if (index < 0) continue;
+        
+        const js_shape_property_t* property = &holder->shape->table->entries[index];
+        if (property->attributes & JS_PROP_ACCESSOR) {
+            *value = JS_UNDEFINED;
+            if (property->getter) {
+                js_gc_enter_native(js_gc_heap_of(&object->base));
+                *value = property->getter(object);
+                js_gc_leave_native(js_gc_heap_of(&object->base));
+            }
+        } else {
+            *value = holder->slots[index];
+        }
+        return true;
+    }
+    *value = JS_UNDEFINED;
+    return false;
+}
+
+bool js_object_set(js_object_t* object, atom_t key, js_value_t value) {
+    if (!object || key == ATOM_NULL) return false;
+    
+    for (js_object_t* holder = object; holder; holder = holder->prototype) {
+        int32_t index = js_shape_lookup(holder->shape, key);
+        if (index < 0) continue;
+        
+        const js_shape_property_t* property = &holder->shape->table->entries[index];
+        if (property->attributes & JS_PROP_ACCESSOR) {
+            if (!property->setter) return false;
+            js_gc_enter_native(js_gc_heap_of(&object->base));
+            property->setter(object, value);
+            js_gc_leave_native(js_gc_heap_of(&object->base));
+            return true;
+        }
+        if (!(property->attributes & JS_PROP_WRITABLE)) return false;
+        if (holder == object) {
+            store_slot(object, (uint32_t)index, value);
+            return true;
+        }
+        // A writable inherited data property is shadowed by a new own one
+        break;
+    }
+    
+    js_shape_property_t property = { key, JS_PROP_DEFAULT, NULL, NULL };
+    return object_add(object, &property, value);
+}
+
+bool js_object_define(js_object_t* object, atom_t key, js_value_t value, uint8_t attributes, js_getter_t getter, js_setter_t setter) {
+    if (!object || !object->shape || key == ATOM_NULL) return false;
+    
+    js_shape_property_t property = { key, attributes, getter, setter };
+    if (!(attributes & JS_PROP_ACCESSOR)) {
+        property.getter = NULL;
+        property.setter = NULL;
+    }
+    
+    int32_t index = js_shape_lookup(object->shape, key);
+    if (attributes & JS_PROP_ACCESSOR) value = JS_UNDEFINED;
+    if (index < 0) return object_add(object, &property, value);
+    
+    const js_shape_property_t* existing = &object->shape->table->entries[index];
+    if (!same_property(existing, &property)) {
+        if (!(existing->attributes & JS_PROP_CONFIGURABLE)) return false;
+        if (!object_normalize(object)) return false;
+        object->shape->table->entries[index] = property;
+    }
+    store_slot(object, (uint32_t)index, value);
+    return true;
+}
+
+bool js_object_delete(js_object_t* object, atom_t key) {
+    if (!object || !object->shape) return false;
+    
+    int32_t index = js_shape_lookup(object->shape, key);
+    if (index < 0) return true;
+    if (!(object->shape->table->entries[index].attributes & JS_PROP_CONFIGURABLE)) return false;
+    
+    store_slot(object, (uint32_t)index, JS_UNDEFINED);
+    js_shape_t* shape = object->shape;
+    
+    // Undoing the last transition keeps the object on a shared shape
+    if (!shape->dictionary && shape->parent && (uint32_t)index == shape->property_count - 1) {
+        object->shape = shape->parent;
+        return true;
+    }
+    
+    if (!object_normalize(object)) return false;
+    shape = object->shape;
+    js_property_table_t* table = shape->table;
+    // Shift the rest down so enumeration keeps insertion order
+    uint32_t after = shape->property_count - (uint32_t)index - 1;
+    memmove(&table->entries[index], &table->entries[index + 1], after * sizeof(js_shape_property_t));
+    memmove(&object->slots[index], &object->slots[index + 1], after * sizeof(js_value_t));
+    table->count--;
+    shape->property_count--;
+    object->slots[shape->property_count] = JS_UNDEFINED;
+    if (table->buckets && !table_rehash(table)) {
+        free(table->buckets);
+        table->buckets = NULL;
+        table->bucket_count = 0;
+    }
+    return true;
+}
+
+// String-keyed API
+
+js_value_t js_get_property(js_object_t* object, const char* key) {
+    js_value_t value = JS_UNDEFINED;
+    if (!object || !key) return value;
+    
+    // A name never interned cannot be a property of anything
+    atom_t atom = atom_lookup(key);
+    if (atom != ATOM_NULL) js_object_get(object, atom, &value);
+    return value;
+}
+
+void js_set_property(js_object_t* object, const char* key, js_value_t value) {
+    if (!object || !key) return;
+    js_object_set(object, atom_intern(key), value);
+}
+
+bool js_has_property(js_object_t* object, const char* key) {
+    if (!object || !key) return false;
+    
+    atom_t atom = atom_lookup(key);
+    if (atom == ATOM_NULL) return false;
+    for (js_object_t* holder = object; holder; holder = holder->prototype) {
+        if (js_shape_lookup(holder->shape, atom) >= 0) return true;
+    }
+    return false;
+}
+
+bool js_delete_property(js_object_t* object, const char* key) {
+    if (!object || !key) return false;
+    
+    atom_t atom = atom_lookup(key);
+    return atom == ATOM_NULL ? true : js_object_delete(object, atom);
+}
+
+char** js_get_property_names(js_object_t* object, uint32_t* count) {
+    if (count) *count = 0;
+    if (!object || !object->shape || !count) return NULL;
+    
+    const js_shape_t* shape = object->shape;
+    char** names = malloc((shape->property_count ? shape->property_count : 1) * sizeof(char*));
+    if (!names) return NULL;
+    
+    for (uint32_t i = 0; i < shape->property_count; i++) {
+        const js_shape_property_t* property = &shape->table->entries[i];
+        if (property->attributes & JS_PROP_ENUMERABLE) names[(*count)++] = (char*)atom_string(property->key);
+    }
+    return names;
+}
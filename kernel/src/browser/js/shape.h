@@ -0,0 +1,134 @@
+#ifndef JS_SHAPE_H
+#define JS_SHAPE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "../atom.h"
+#include "engine.h"
+
+// Hidden classes. An object's shape maps property names to indexes in
+// its slots[] array. Objects that gained the same properties in the same
+// order share one shape: each shape records the transitions taken from
+// it, so the second object built like the first walks the existing chain
+// instead of creating new shapes. Shapes along one chain share a single
+// property table, of which each shape sees only its first property_count
+// entries.
+//
+// Deleting anything but the most recent property, changing attributes of
+// an existing property, or growing past JS_SHAPE_MAX_PROPERTIES moves the
+// object to a dictionary shape. Dictionary shapes belong to one object,
+// are mutated in place, and are never cached by inline caches.
+#define JS_SHAPE_MAX_PROPERTIES 128
+
+// Property attributes
+#define JS_PROP_WRITABLE        0x01
+#define JS_PROP_ENUMERABLE      0x02
+#define JS_PROP_CONFIGURABLE    0x04
+#define JS_PROP_ACCESSOR        0x08    // getter/setter instead of a slot value
+#define JS_PROP_DEFAULT         (JS_PROP_WRITABLE | JS_PROP_ENUMERABLE | JS_PROP_CONFIGURABLE)
+
+typedef js_value_t (*js_getter_t)(js_object_t* object);
+typedef void (*js_setter_t)(js_object_t* object, js_value_t value);
+
+typedef struct {
+    atom_t key;
+    uint8_t attributes;
+    js_getter_t getter;
+    js_setter_t setter;
+} js_shape_property_t;
+
+typedef struct {
+    uint32_t ref_count;             // Shapes sharing the table
+    js_shape_property_t* entries;   // Slot i holds the value of entries[i]
+    uint32_t count;
+    uint32_t capacity;
+    uint32_t* buckets;              // Entry index + 1, 0 when empty
+    uint32_t bucket_count;
+} js_property_table_t;
+
+typedef struct js_shape {
+    struct js_shape* parent;
+    js_property_table_t* table;
+    uint32_t property_count;
+    bool dictionary;
+    
+    // A shape owns the shapes it transitions to, so freeing an engine's
+    // empty shape frees every shared shape reachable from it
+    struct js_shape** transitions;
+    uint32_t transition_count;
+    uint32_t transition_capacity;
+} js_shape_t;
+
+js_shape_t* js_shape_create_empty(void);
+void js_shape_destroy_tree(js_shape_t* shape);
+
+// Objects must be initialised before any property is set, and must be
+// heap cells (js_gc_alloc): slot storage is allocated next to them. The engine's
+// empty shape (engine->shapes) is created on first use; js_engine_destroy
+// releases it with js_shape_destroy_tree.
+void js_object_init(js_engine_t* engine, js_object_t* object, js_object_t* prototype);
+void js_object_finalize(js_object_t* object);
+bool js_object_reserve_slots(js_object_t* object, uint32_t count);
+
+// Index of key in shape, or -1
+int32_t js_shape_lookup(const js_shape_t* shape, atom_t key);
+const js_shape_property_t* js_shape_property(const js_shape_t* shape, uint32_t index);
+
+// Atom-keyed property access, the slow paths behind the inline caches.
+// js_object_get stores the value in *value, and returns false when the
+// property is missing from the whole prototype chain.
+bool js_object_get(js_object_t* object, atom_t key, js_value_t* value);
+bool js_object_set(js_object_t* object, atom_t key, js_value_t value);
+bool js_object_define(js_object_t* object, atom_t key, js_value_t value, uint8_t attributes, js_getter_t getter, js_setter_t setter);
+bool js_object_delete(js_object_t* object, atom_t key);
+
+// Property inline caches, one per bytecode property access site. Each
+// entry guards on the receiver's shape and, for properties found on a
+// prototype, on the shape of every object down to the holder. A site
+// starts uninitialised, goes monomorphic on its first miss, polymorphic
+// up to JS_IC_MAX_ENTRIES shapes and megamorphic beyond that, when it
+// stops caching and always takes the slow path.
+#define JS_IC_MAX_ENTRIES 4
+#define JS_IC_MAX_DEPTH 8
+
+typedef enum {
+    JS_IC_UNINITIALIZED,
+    JS_IC_MONOMORPHIC,
+    JS_IC_POLYMORPHIC,
+    JS_IC_MEGAMORPHIC
+} js_ic_state_t;
+
+typedef enum {
+    JS_IC_LOAD_SLOT,                // Data property on the holder
+    JS_IC_LOAD_GETTER,
+    JS_IC_LOAD_MISSING,             // Absent from the whole chain
+    JS_IC_STORE_SLOT,               // Existing writable own data property
+    JS_IC_STORE_ADD,                // New property: shape -> transition
+    JS_IC_STORE_SETTER
+} js_ic_kind_t;
+
+typedef struct {
+    js_shape_t* shape;              // Receiver
+    js_shape_t* chain[JS_IC_MAX_DEPTH]; // Prototypes down to the holder
+    js_shape_t* transition;         // JS_IC_STORE_ADD: receiver's new shape
+    js_getter_t getter;
+    js_setter_t setter;
+    uint32_t slot;
+    uint8_t depth;                  // Prototypes checked; 0 for own properties
+    uint8_t kind;
+} js_ic_entry_t;
+
+typedef struct {
+    atom_t key;
+    uint8_t state;
+    uint8_t entry_count;
+    uint32_t misses;
+    js_ic_entry_t entries[JS_IC_MAX_ENTRIES];
+} js_property_ic_t;
+
+void js_ic_init(js_property_ic_t* ic, atom_t key);
+void js_ic_reset(js_property_ic_t* ic);
+bool js_ic_get(js_property_ic_t* ic, js_object_t* object, js_value_t* value);
+bool js_ic_set(js_property_ic_t* ic, js_object_t* object, js_value_t value);
+
+#endif
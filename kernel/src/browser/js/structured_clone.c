@@ -0,0 +1,497 @@
+#include "structured_clone.h"
+#include <stdlib.h>
+#include <string.h>
+
+// Record tags. Every object gets the next reference index as it is
+// written or read, so REFERENCE can point back at it.
+enum {
+    CLONE_UNDEFINED,
+    CLONE_NULL,
+    CLONE_FALSE,
+    CLONE_TRUE,
+    CLONE_INT,                      // int32
+    CLONE_NUMBER,                   // double bits
+    CLONE_STRING,                   // uint32 length, bytes
+    CLONE_BIGINT,                   // int64
+    CLONE_OBJECT,                   // uint32 count, count (string, value) pairs
+    CLONE_ARRAY,                    // uint32 length, length values
+    CLONE_ARRAY_BUFFER,             // uint32 length, bytes
+    CLONE_TRANSFERRED,              // uint32 transfer index
+    CLONE_REFERENCE                 // uint32 reference index
+};
+
+typedef struct {
+    void* data;
+    uint32_t byte_length;
+} clone_transfer_t;
+
+struct js_clone {
+    uint8_t* data;
+    size_t size;
+    uint32_t reference_count;       // Objects written
+    clone_transfer_t* transfers;
+    uint32_t transfer_count;
+};
+
+// Objects seen so far, by address; keys are object pointers
+typedef struct {
+    const void** keys;
+    uint32_t* values;
+    uint32_t mask;
+    uint32_t count;
+} clone_map_t;
+
+typedef struct {
+    js_engine_t* engine;
+    uint8_t* data;
+    size_t size;
+    size_t capacity;
+    clone_map_t references;
+    js_array_buffer_t** transfers;
+    uint32_t transfer_count;
+    uint32_t reference_count;
+    const char* error;              // DataCloneError message
+} clone_writer_t;
+
+typedef struct {
+    js_engine_t* engine;
+    const uint8_t* data;
+    size_t size;
+    size_t position;
+    js_value_t* references;
+    uint32_t reference_count;
+    uint32_t reference_capacity;
+    js_value_t* transfers;
+    uint32_t transfer_count;
+} clone_reader_t;
+
+// Reference map
+
+static uint32_t map_hash(const void* key) {
+    uintptr_t bits = (uintptr_t)key >> 3;
+    return (uint32_t)(bits ^ (bits >> 17)) * 0x9e3779b1u;
+}
+
+static bool map_grow(clone_map_t* map) {
+    uint32_t capacity = map->mask ? (map->mask + 1) * 2 : 64;
+    const void** keys = calloc(capacity, sizeof(void*));
+    uint32_t* values = malloc(capacity * sizeof(uint32_t));
+    if (!keys || !values) {
+        free(keys);
+        free(values);
+        return false;
+    }
+    
+    for (uint32_t i = 0; map->mask && i <= map->mask; i++) {
+        if (!map->keys[i]) continue;
+        uint32_t bucket = map_hash(map->keys[i]) & (capacity - 1);
+        while (keys[bucket]) bucket = (bucket + 1) & (capacity - 1);
+        keys[bucket] = map->keys[i];
+        values[bucket] = map->values[i];
+    }
+    free(map->keys);
+    free(map->values);
+    map->keys = keys;
+    map->values = values;
+    map->mask = capacity - 1;
+    return true;
+}
+
+static bool map_find(const clone_map_t* map, const void* key, uint32_t* value) {
+    if (!map->mask) return false;
+    for (uint32_t bucket = map_hash(key) & map->mask; map->keys[bucket]; bucket = (bucket + 1) & map->mask) {
+        if (map->keys[bucket] == key) {
+            *value = map->values[bucket];
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool map_insert(clone_map_t* map, const void* key, uint32_t value) {
+    if ((map->count + 1) * 2 > map->mask + 1 && !map_grow(map)) return false;
+    uint32_t bucket = map_hash(key) & map->mask;
+    while (map->keys[bucket]) bucket = (bucket + 1) & map->mask;
+    map->keys[bucket] = key;
+    map->values[bucket] = value;
+    map->count++;
+    return true;
+}
+
+static void map_destroy(clone_map_t* map) {
+    free(map->keys);
+    free(map->values);
+}
+
+// Writing
+
+static bool write_bytes(clone_writer_t* writer, const void* bytes, size_t length) {
+    if (writer->size + length > writer->capacity) {
+        size_t capacity = writer->capacity ? writer->capacity * 2 : 256;
+        while (capacity < writer->size + length) capacity *= 2;
+        uint8_t* data = realloc(writer->data, capacity);
+        if (!data) {
+            writer->error = "out of memory";
+            return false;
+        }
+        writer->data = data;
+        writer->capacity = capacity;
+    }
+    if (length) memcpy(writer->data + writer->size, bytes, length);
+    writer->size += length;
+    return true;
+}
+
+static bool write_tag(clone_writer_t* writer, uint8_t tag) {
+    return write_bytes(writer, &tag, 1);
+}
+
+static bool write_u32(clone_writer_t* writer, uint32_t value) {
+    return write_bytes(writer, &value, sizeof(value));
+}
+
+static bool write_string(clone_writer_t* writer, const char* string, uint32_t length) {
+    return write_u32(writer, length) && write_bytes(writer, string, length);
+}
+
+// Gives object the next reference index, or writes a REFERENCE to it and
+// returns false with *written set when it was seen before
+static bool write_reference(clone_writer_t* writer, const void* object, bool* written) {
+    uint32_t index;
+    if (map_find(&writer->references, object, &index)) {
+        *written = write_tag(writer, CLONE_REFERENCE) && write_u32(writer, index);
+        return false;
+    }
+    if (!map_insert(&writer->references, object, writer->reference_count++)) {
+        writer->error = "out of memory";
+        *written = false;
+        return false;
+    }
+    return true;
+}
+
+static bool write_value(clone_writer_t* writer, js_value_t value, uint32_t depth) {
+    if (depth > JS_CLONE_MAX_DEPTH) {
+        writer->error = "object graph is too deep";
+        return false;
+    }
+    
+    if (js_value_is_int(value)) {
+        int32_t number = js_value_as_int(value);
+        return write_tag(writer, CLONE_INT) && write_bytes(writer, &number, sizeof(number));
+    }
+    if (js_value_is_double(value)) {
+        return write_tag(writer, CLONE_NUMBER) && write_bytes(writer, &value.bits, sizeof(value.bits));
+    }
+    
+    switch (js_value_type(value)) {
+        case JS_TYPE_UNDEFINED:
+            return write_tag(writer, CLONE_UNDEFINED);
+        case JS_TYPE_NULL:
+            return write_tag(writer, CLONE_NULL);
+        case JS_TYPE_BOOLEAN:
+            return write_tag(writer, js_to_boolean(value) ? CLONE_TRUE : CLONE_FALSE);
+        case JS_TYPE_STRING: {
+            js_string_t* string = js_value_as_string(value);
+            return write_tag(writer, CLONE_STRING) && write_string(writer, string->data, string->length);
+        }
+        case JS_TYPE_BIGINT: {
+            int64_t number = ((js_bigint_t*)js_value_as_cell(value))->value;
+            return write_tag(writer, CLONE_BIGINT) && write_bytes(writer, &number, sizeof(number));
+        }
+        case JS_TYPE_ARRAYBUFFER: {
+            js_array_buffer_t* buffer = (js_array_buffer_t*)js_value_as_object(value);
+            for (uint32_t i = 0; i < writer->transfer_count; i++) {
+                if (writer->transfers[i] == buffer) {
+                    return write_tag(writer, CLONE_TRANSFERRED) && write_u32(writer, i);
+                }
+            }
+            if (buffer->detached) {
+                writer->error = "ArrayBuffer is detached";
+                return false;
+            }
+            
+            bool written;
+            if (!write_reference(writer, buffer, &written)) return written;
+            return write_tag(writer, CLONE_ARRAY_BUFFER) && write_string(writer, (const char*)buffer->data, buffer->byte_length);
+        }
+        case JS_TYPE_ARRAY: {
+            bool written;
+            if (!write_reference(writer, js_value_as_cell(value), &written)) return written;
+            
+            uint32_t length = js_array_length(value);
+            if (!write_tag(writer, CLONE_ARRAY) || !write_u32(writer, length)) return false;
+            for (uint32_t i = 0; i < length; i++) {
+                if (!write_value(writer, js_array_get(value, i), depth + 1)) return false;
+            }
+            return true;
+        }
+        case JS_TYPE_OBJECT: {
+            js_object_t* object = js_value_as_object(value);
+            bool written;
+            if (!write_reference(writer, object, &written)) return written;
+            
+            uint32_t count = 0;
+            char** names = js_get_property_names(object, &count);
+            if (count && !names) {
+                writer->error = "out of memory";
+                return false;
+            }
+            
+            bool ok = write_tag(writer, CLONE_OBJECT) && write_u32(writer, count);
+            for (uint32_t i = 0; ok && i < count; i++) {
+                ok = write_string(writer, names[i], (uint32_t)strlen(names[i])) && write_value(writer, js_get_property(object, names[i]), depth + 1);
+            }
+            free(names);
+            return ok;
+        }
+        case JS_TYPE_SYMBOL:
+            writer->error = "symbols cannot be cloned";
+            return false;
+        case JS_TYPE_FUNCTION:
+            writer->error = "functions cannot be cloned";
+            return false;
+        default:
+            writer->error = "value cannot be cloned";
+            return false;
+    }
+}
+
+// Transfer list entries must be distinct, attached ArrayBuffers
+static bool check_transfers(clone_writer_t* writer, const js_value_t* transfer, uint32_t transfer_count) {
+    if (!transfer_count) return true;
+    writer->transfers = calloc(transfer_count, sizeof(js_array_buffer_t*));
+    if (!writer->transfers) {
+        writer->error = "out of memory";
+        return false;
+    }
+    
+    for (uint32_t i = 0; i < transfer_count; i++) {
+        if (js_value_type(transfer[i]) != JS_TYPE_ARRAYBUFFER) {
+            writer->error = "only ArrayBuffers can be transferred";
+            return false;
+        }
+        js_array_buffer_t* buffer = (js_array_buffer_t*)js_value_as_object(transfer[i]);
+        if (buffer->detached) {
+            writer->error = "ArrayBuffer is detached";
+            return false;
+        }
+        for (uint32_t j = 0; j < writer->transfer_count; j++) {
+            if (writer->transfers[j] == buffer) {
+                writer->error = "ArrayBuffer is transferred twice";
+                return false;
+            }
+        }
+        writer->transfers[writer->transfer_count++] = buffer;
+    }
+    return true;
+}
+
+// A DOMException named DataCloneError, with its legacy DATA_CLONE_ERR code
+static js_value_t create_data_clone_error(js_engine_t* engine, const char* message) {
+    js_value_t error = js_create_error(engine, message);
+    if (js_value_is_exception(error)) return error;
+    js_object_t* object = js_value_as_object(error);
+    js_set_property(object, "name", js_create_string(engine, "DataCloneError"));
+    js_set_property(object, "code", js_create_int(25));
+    return error;
+}
+
+js_clone_t* js_clone_serialize(js_engine_t* engine, js_value_t value, const js_value_t* transfer, uint32_t transfer_count) {
+    if (!engine) return NULL;
+    
+    clone_writer_t writer = { .engine = engine };
+    js_clone_t* clone = NULL;
+    
+    if (check_transfers(&writer, transfer, transfer_count) && write_value(&writer, value, 0)) {
+        clone = calloc(1, sizeof(js_clone_t));
+        if (clone && writer.transfer_count) {
+            clone->transfers = calloc(writer.transfer_count, sizeof(clone_transfer_t));
+            if (!clone->transfers) {
+                free(clone);
+                clone = NULL;
+            }
+        }
+        if (!clone) writer.error = "out of memory";
+    }
+    
+    if (clone) {
+        // Only a successful clone detaches
+        clone->data = writer.data;
+        clone->size = writer.size;
+        clone->reference_count = writer.reference_count;
+        clone->transfer_count = writer.transfer_count;
+        for (uint32_t i = 0; i < writer.transfer_count; i++) {
+            clone->transfers[i].data = js_array_buffer_detach(writer.transfers[i], &clone->transfers[i].byte_length);
+        }
+    } else {
+        free(writer.data);
+        js_throw(engine, create_data_clone_error(engine, writer.error ? writer.error : "value cannot be cloned"));
+    }
+    
+    map_destroy(&writer.references);
+    free(writer.transfers);
+    return clone;
+}
+
+// Reading. The data was written by js_clone_serialize, so it is trusted;
+// the bounds checks only stop a truncated clone running off the end.
+
+static bool read_bytes(clone_reader_t* reader, void* bytes, size_t length) {
+    if (reader->size - reader->position < length) return false;
+    memcpy(bytes, reader->data + reader->position, length);
+    reader->position += length;
+    return true;
+}
+
+static bool read_u32(clone_reader_t* reader, uint32_t* value) {
+    return read_bytes(reader, value, sizeof(*value));
+}
+
+// A property key's bytes, NUL-terminated in a malloc'd copy
+static char* read_string(clone_reader_t* reader, uint32_t* length) {
+    if (!read_u32(reader, length) || reader->size - reader->position < *length) return NULL;
+    char* string = malloc(*length + 1);
+    if (!string) return NULL;
+    memcpy(string, reader->data + reader->position, *length);
+    string[*length] = '\0';
+    reader->position += *length;
+    return string;
+}
+
+static bool add_reference(clone_reader_t* reader, js_value_t value) {
+    if (reader->reference_count >= reader->reference_capacity) return false;
+    reader->references[reader->reference_count++] = value;
+    return true;
+}
+
+static js_value_t read_value(clone_reader_t* reader) {
+    js_engine_t* engine = reader->engine;
+    uint8_t tag;
+    if (!read_bytes(reader, &tag, 1)) return JS_EXCEPTION;
+    
+    switch (tag) {
+        case CLONE_UNDEFINED:
+            return JS_UNDEFINED;
+        case CLONE_NULL:
+            return JS_NULL;
+        case CLONE_FALSE:
+            return JS_FALSE;
+        case CLONE_TRUE:
+            return JS_TRUE;
+        case CLONE_INT: {
+            int32_t number;
+            return read_bytes(reader, &number, sizeof(number)) ? js_create_int(number) : JS_EXCEPTION;
+        }
+        case CLONE_NUMBER: {
+            js_value_t value;
+            return read_bytes(reader, &value.bits, sizeof(value.bits)) ? value : JS_EXCEPTION;
+        }
+        case CLONE_STRING: {
+            uint32_t length;
+            if (!read_u32(reader, &length) || reader->size - reader->position < length) return JS_EXCEPTION;
+            js_value_t value = js_create_string_length(engine, (const char*)reader->data + reader->position, length);
+            reader->position += length;
+            return value;
+        }
+        case CLONE_BIGINT: {
+            int64_t number;
+            return read_bytes(reader, &number, sizeof(number)) ? js_create_bigint(engine, number) : JS_EXCEPTION;
+        }
+        case CLONE_ARRAY_BUFFER: {
+            uint32_t length;
+            if (!read_u32(reader, &length) || reader->size - reader->position < length) return JS_EXCEPTION;
+            js_value_t value = js_create_array_buffer(engine, length);
+            if (js_value_is_exception(value) || !add_reference(reader, value)) return JS_EXCEPTION;
+            js_array_buffer_t* buffer = (js_array_buffer_t*)js_value_as_object(value);
+            if (length) memcpy(buffer->data, reader->data + reader->position, length);
+            reader->position += length;
+            return value;
+        }
+        case CLONE_TRANSFERRED: {
+            uint32_t index;
+            if (!read_u32(reader, &index) || index >= reader->transfer_count) return JS_EXCEPTION;
+            return reader->transfers[index];
+        }
+        case CLONE_REFERENCE: {
+            uint32_t index;
+            if (!read_u32(reader, &index) || index >= reader->reference_count) return JS_EXCEPTION;
+            return reader->references[index];
+        }
+        case CLONE_ARRAY: {
+            uint32_t length;
+            if (!read_u32(reader, &length)) return JS_EXCEPTION;
+            js_value_t array = js_create_array(engine, 0);
+            if (js_value_is_exception(array) || !add_reference(reader, array)) return JS_EXCEPTION;
+            for (uint32_t i = 0; i < length; i++) {
+                js_value_t element = read_value(reader);
+                if (js_value_is_exception(element)) return JS_EXCEPTION;
+                js_array_set(array, i, element);
+            }
+            return array;
+        }
+        case CLONE_OBJECT: {
+            uint32_t count;
+            if (!read_u32(reader, &count)) return JS_EXCEPTION;
+            js_value_t value = js_create_object(engine);
+            if (js_value_is_exception(value) || !add_reference(reader, value)) return JS_EXCEPTION;
+            js_object_t* object = js_value_as_object(value);
+            for (uint32_t i = 0; i < count; i++) {
+                uint32_t length;
+                char* key = read_string(reader, &length);
+                if (!key) return JS_EXCEPTION;
+                js_value_t property = read_value(reader);
+                if (!js_value_is_exception(property)) js_set_property(object, key, property);
+                free(key);
+                if (js_value_is_exception(property)) return JS_EXCEPTION;
+            }
+            return value;
+        }
+        default:
+            return JS_EXCEPTION;
+    }
+}
+
+// The heap collects only at safepoints, none of which is reached here, so
+// the values built so far need no protection until the result is returned
+js_value_t js_clone_deserialize(js_engine_t* engine, js_clone_t* clone) {
+    if (!engine || !clone) return JS_EXCEPTION;
+    
+    clone_reader_t reader = {
+        .engine = engine,
+        .data = clone->data,
+        .size = clone->size,
+        .reference_capacity = clone->reference_count
+    };
+    js_value_t result = JS_EXCEPTION;
+    
+    reader.references = clone->reference_count ? calloc(clone->reference_count, sizeof(js_value_t)) : NULL;
+    reader.transfers = clone->transfer_count ? calloc(clone->transfer_count, sizeof(js_value_t)) : NULL;
+    if ((clone->reference_count && !reader.references) || (clone->transfer_count && !reader.transfers)) goto done;
+    
+    // Every transferred buffer arrives, referenced or not
+    for (uint32_t i = 0; i < clone->transfer_count; i++) {
+        js_value_t buffer = js_adopt_array_buffer(engine, clone->transfers[i].data, clone->transfers[i].byte_length);
+        if (js_value_is_exception(buffer)) goto done;
+        clone->transfers[i].data = NULL;
+        reader.transfers[reader.transfer_count++] = buffer;
+    }
+    
+    result = read_value(&reader);
+
+done:
+    free(reader.references);
+    free(reader.transfers);
+    js_clone_free(clone);
+    return result;
+}
+
+void js_clone_free(js_clone_t* clone) {
+    if (!clone) return;
+    for (uint32_t i = 0; i < clone->transfer_count; i++) {
+        free(clone->transfers[i].data);
+    }
+    free(clone->transfers);
+    free(clone->data);
+    free(clone);
+}
@@ -0,0 +1,34 @@
+#ifndef JS_STRUCTURED_CLONE_H
+#define JS_STRUCTURED_CLONE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "engine.h"
+
+// Structured clone, for postMessage between engines. A clone is a flat
+// byte encoding of a value that holds nothing from the heap it came from,
+// so it may be serialized on one thread and deserialized on another.
+// Primitives, strings, bigints, plain objects, arrays and ArrayBuffers are
+// supported, with shared and cyclic references preserved; anything else
+// (functions, symbols, DOM wrappers) fails with a DataCloneError.
+//
+// ArrayBuffers in the transfer list are not copied: their bytes move into
+// the clone and the originals are detached, and deserialize hands the same
+// bytes to buffers in the receiving engine.
+#define JS_CLONE_MAX_DEPTH 512
+
+typedef struct js_clone js_clone_t;
+
+// NULL with a DataCloneError thrown in engine when value cannot be
+// cloned or the transfer list is invalid; nothing is detached then
+js_clone_t* js_clone_serialize(js_engine_t* engine, js_value_t value, const js_value_t* transfer, uint32_t transfer_count);
+
+// Rebuilds the value in engine and frees the clone. JS_EXCEPTION when
+// allocation fails.
+js_value_t js_clone_deserialize(js_engine_t* engine, js_clone_t* clone);
+
+// Frees a clone that will not be deserialized, with any bytes transferred
+// into it
+void js_clone_free(js_clone_t* clone);
+
+#endif
@@ -0,0 +1,283 @@
+#include "engine.h"
+#include "shape.h"
+#include "gc.h"
+#include <ctype.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static uint64_t next_symbol_id = 1;
+
+// Cells
+
+js_string_t* js_alloc_string(js_engine_t* engine, uint32_t length) {
+    if (length > UINT32_MAX - sizeof(js_string_t) - 1) return NULL;
+    js_string_t* string = (js_string_t*)js_gc_alloc(js_gc_heap(engine), JS_TYPE_STRING, sizeof(js_string_t) + length + 1);
+    if (!string) return NULL;
+    
+    string->length = length;
+    string->data = string->chars;
+    return string;
+}
+
+js_value_t js_create_string_length(js_engine_t* engine, const char* value, uint32_t length) {
+    js_string_t* string = js_alloc_string(engine, length);
+    if (!string) return JS_EXCEPTION;
+    
+    if (length) memcpy(string->chars, value, length);
+    return js_value_from_cell(&string->base);
+}
+
+js_value_t js_create_string(js_engine_t* engine, const char* value) {
+    if (!value) value = "";
+    
+    size_t length = strlen(value);
+    if (length > UINT32_MAX) return JS_EXCEPTION;
+    return js_create_string_length(engine, value, (uint32_t)length);
+}
+
+js_value_t js_create_string_view(js_engine_t* engine, const char* data, uint32_t length) {
+    js_string_t* string = (js_string_t*)js_gc_alloc(js_gc_heap(engine), JS_TYPE_STRING, sizeof(js_string_t));
+    if (!string) return JS_EXCEPTION;
+    
+    string->length = length;
+    string->data = data;
+    return js_value_from_cell(&string->base);
+}
+
+js_value_t js_create_symbol(js_engine_t* engine, const char* description) {
+    size_t length = description ? strlen(description) + 1 : 0;
+    if (length > UINT32_MAX - sizeof(js_symbol_t)) return JS_EXCEPTION;
+    js_symbol_t* symbol = (js_symbol_t*)js_gc_alloc(js_gc_heap(engine), JS_TYPE_SYMBOL, sizeof(js_symbol_t) + length);
+    if (!symbol) return JS_EXCEPTION;
+    
+    if (description) {
+        symbol->description = (char*)(symbol + 1);
+        memcpy(symbol->description, description, length);
+    }
+    symbol->id = __atomic_fetch_add(&next_symbol_id, 1, __ATOMIC_RELAXED);
+    return js_value_from_cell(&symbol->base);
+}
+
+js_value_t js_create_bigint(js_engine_t* engine, int64_t value) {
+    js_bigint_t* bigint = (js_bigint_t*)js_gc_alloc(js_gc_heap(engine), JS_TYPE_BIGINT, sizeof(js_bigint_t));
+    if (!bigint) return JS_EXCEPTION;
+    
+    bigint->value = value;
+    return js_value_from_cell(&bigint->base);
+}
+
+// Plain objects inherit from Object.prototype once the builtins exist
+static js_object_t* object_prototype(js_engine_t* engine) {
+    js_value_t value;
+    if (!engine->builtins.Object || !js_object_get(engine->builtins.Object, ATOM_prototype, &value)) return NULL;
+    return js_value_as_object(value);
+}
+
+js_value_t js_create_object(js_engine_t* engine) {
+    js_object_t* object = (js_object_t*)js_gc_alloc(js_gc_heap(engine), JS_TYPE_OBJECT, sizeof(js_object_t));
+    if (!object) return JS_EXCEPTION;
+    
+    js_object_init(engine, object, object_prototype(engine));
+    return js_value_from_object(object);
+}
+
+js_value_t js_adopt_array_buffer(js_engine_t* engine, void* data, uint32_t byte_length) {
+    js_array_buffer_t* buffer = (js_array_buffer_t*)js_gc_alloc(js_gc_heap(engine), JS_TYPE_ARRAYBUFFER, sizeof(js_array_buffer_t));
+    if (!buffer) return JS_EXCEPTION;
+    
+    js_object_init(engine, &buffer->base, object_prototype(engine));
+    buffer->data = data;
+    buffer->byte_length = byte_length;
+    js_gc_register_finalizer(&buffer->base.base);
+    return js_value_from_object(&buffer->base);
+}
+
+js_value_t js_create_array_buffer(js_engine_t* engine, uint32_t byte_length) {
+    void* data = byte_length ? calloc(byte_length, 1) : NULL;
+    if (byte_length && !data) return JS_EXCEPTION;
+    
+    js_value_t buffer = js_adopt_array_buffer(engine, data, byte_length);
+    if (js_value_is_exception(buffer)) free(data);
+    return buffer;
+}
+
+void* js_array_buffer_detach(js_array_buffer_t* buffer, uint32_t* byte_length) {
+    void* data = buffer->data;
+    *byte_length = buffer->byte_length;
+    buffer->data = NULL;
+    buffer->byte_length = 0;
+    buffer->detached = true;
+    return data;
+}
+
+// Runs for cells registered with js_gc_register_finalizer as they die
+void js_cell_finalize(js_cell_t* cell) {
+    if (!cell || cell->type < JS_TYPE_OBJECT || cell->type == JS_CELL_SLOTS) return;
+    js_object_finalize((js_object_t*)cell);
+    if (cell->type == JS_TYPE_ARRAYBUFFER) free(((js_array_buffer_t*)cell)->data);
+}
+
+// Conversions
+
+bool js_to_boolean(js_value_t value) {
+    if (js_value_is_int(value)) return js_value_as_int(value) != 0;
+    if (js_value_is_double(value)) {
+        double number = js_value_as_double(value);
+        return number != 0 && !isnan(number);
+    }
+    
+    switch (js_value_type(value)) {
+        case JS_TYPE_UNDEFINED:
+        case JS_TYPE_NULL:
+            return false;
+        case JS_TYPE_BOOLEAN:
+            return js_value_same(value, JS_TRUE);
+        case JS_TYPE_STRING:
+            return js_value_as_string(value)->length > 0;
+        case JS_TYPE_BIGINT:
+            return ((js_bigint_t*)js_value_as_cell(value))->value != 0;
+        default:
+            return true;
+    }
+}
+
+// StringToNumber: surrounding whitespace ignored, empty means 0
+static double string_to_number(const js_string_t* string) {
+    const char* start = string->data;
+    const char* end = string->data + string->length;
+    while (start < end && isspace((unsigned char)*start)) start++;
+    while (end > start && isspace((unsigned char)end[-1])) end--;
+    if (start == end) return 0;
+    
+    size_t length = (size_t)(end - start);
+    char buffer[64];
+    char* text = length < sizeof(buffer) ? buffer : malloc(length + 1);
+    if (!text) return NAN;
+    memcpy(text, start, length);
+    text[length] = '\0';
+    
+    double number = NAN;
+    const char* digits = text[0] == '+' || text[0] == '-' ? text + 1 : text;
+    if (strcmp(digits, "Infinity") == 0) {
+        number = text[0] == '-' ? -INFINITY : INFINITY;
+    } else if (isdigit((unsigned char)digits[0]) || digits[0] == '.') {
+        // strtod alone would also accept "inf" and "nan"
+        char* parsed;
+        number = strtod(text, &parsed);
+        if (*parsed != '\0') number = NAN;
+    }
+    if (text != buffer) free(text);
+    return number;
+}
+
+double js_to_number(js_value_t value) {
+    if (js_value_is_number(value)) return js_value_as_number(value);
+    
+    switch (js_value_type(value)) {
+        case JS_TYPE_NULL:
+            return 0;
+        case JS_TYPE_BOOLEAN:
+            return js_value_same(value, JS_TRUE) ? 1 : 0;
+        case JS_TYPE_STRING:
+            return string_to_number(js_value_as_string(value));
+        case JS_TYPE_BIGINT:
+            return (double)((js_bigint_t*)js_value_as_cell(value))->value;
+        default:
+            return NAN;
+    }
+}
+
+// Number::toString: the shortest digits that read back as the same
+// double, positional between 1e-7 and 1e21 and exponential outside
+static void format_number(double number, char* buffer, size_t size) {
+    if (isnan(number)) {
+        snprintf(buffer, size, "NaN");
+        return;
+    }
+    if (isinf(number)) {
+        snprintf(buffer, size, number < 0 ? "-Infinity" : "Infinity");
+        return;
+    }
+    if (number == 0) {
+        snprintf(buffer, size, "0");
+        return;
+    }
+    
+    char scientific[32];
+    for (int precision = 1; precision <= 17; precision++) {
+        snprintf(scientific, sizeof(scientific), "%.*e", precision - 1, number);
+        if (strtod(scientific, NULL) == number) break;
+    }
+    
+    // "-d.ddde+XX" -> digits "dddd" and n, with value 0.dddd * 10^n
+    char digits[20];
+    int k = 0;
+    const char* c = scientific + (number < 0);
+    for (; *c && *c != 'e'; c++) {
+        if (*c != '.') digits[k++] = *c;
+    }
+    while (k > 1 && digits[k - 1] == '0') k--;
+    digits[k] = '\0';
+    int n = atoi(c + 1) + 1;
+    
+    char* out = buffer;
+    char* end = buffer + size - 1;
+    if (number < 0 && out < end) *out++ = '-';
+    if (k <= n && n <= 21) {
+        for (int i = 0; i < k && out < end; i++) *out++ = digits[i];
+        for (int i = k; i < n && out < end; i++) *out++ = '0';
+    } else if (0 < n && n <= 21) {
+        for (int i = 0; i < k && out < end; i++) {
+            if (i == n && out < end) *out++ = '.';
+            if (out < end) *out++ = digits[i];
+        }
+    } else if (-6 < n && n <= 0) {
+        if (out < end) *out++ = '0';
+        if (out < end) *out++ = '.';
+        for (int i = n; i < 0 && out < end; i++) *out++ = '0';
+        for (int i = 0; i < k && out < end; i++) *out++ = digits[i];
+    } else {
+        snprintf(out, (size_t)(end - out) + 1, "%c%s%se%+d", digits[0], k > 1 ? "." : "", digits + 1, n - 1);
+        return;
+    }
+    *out = '\0';
+}
+
+char* js_to_string(js_value_t value) {
+    char buffer[64];
+    if (js_value_is_int(value)) {
+        snprintf(buffer, sizeof(buffer), "%d", js_value_as_int(value));
+        return strdup(buffer);
+    }
+    if (js_value_is_double(value)) {
+        format_number(js_value_as_double(value), buffer, sizeof(buffer));
+        return strdup(buffer);
+    }
+    
+    switch (js_value_type(value)) {
+        case JS_TYPE_UNDEFINED:
+            return strdup("undefined");
+        case JS_TYPE_NULL:
+            return strdup("null");
+        case JS_TYPE_BOOLEAN:
+            return strdup(js_value_same(value, JS_TRUE) ? "true" : "false");
+        case JS_TYPE_STRING:
+            return strdup(js_value_as_string(value)->data);
+        case JS_TYPE_SYMBOL: {
+            const char* description = ((js_symbol_t*)js_value_as_cell(value))->description;
+            size_t length = description ? strlen(description) : 0;
+            char* text = malloc(length + 9);
+            if (text) snprintf(text, length + 9, "Symbol(%s)", description ? description : "");
+            return text;
+        }
+        case JS_TYPE_BIGINT:
+            snprintf(buffer, sizeof(buffer), "%lld", (long long)((js_bigint_t*)js_value_as_cell(value))->value);
+            return strdup(buffer);
+        case JS_TYPE_FUNCTION:
+            return strdup("function () { [native code] }");
+        default:
+            return strdup("[object Object]");
+    }
+}
@@ -0,0 +1,422 @@
+#include "loader.h"
+#include "js/engine.h"
+#include "js/compile_job.h"
+#include "js/event_loop.h"
+#include "webapi/fetch.h"
+#include "capacity.h"
+#include <stdlib.h>
+#include <string.h>
+
+// Script queued for execution in document order
+typedef struct {
+    char* text;                     // Inline source, or NULL
+    js_compile_job_t* compile_job;  // Inline source compiling off-thread, or NULL
+    browser_resource_t* resource;   // External source, or NULL
+} loader_script_t;
+
+struct browser_loader {
+    browser_tab_t* tab;
+    browser_loader_callbacks_t callbacks;
+    html_preload_scanner_t* scanner;
+    
+    browser_resource_t** resources;
+    uint32_t resource_count;
+    uint32_t resource_capacity;
+    uint32_t pending_count;
+    
+    loader_script_t* scripts;
+    uint32_t script_count;
+    uint32_t script_capacity;
+    uint32_t next_script;
+    
+    bool parsing_done;
+    bool scripts_done;
+    bool load_fired;
+    bool cancelled;                 // Set on the main thread, read from fetch callbacks and pool threads
+    uint32_t ref_count;
+    
+    worker_group_t compile_group;   // Compile jobs whose done has not returned
+};
+
+typedef struct {
+    browser_resource_t* resource;
+    bool success;
+} loader_task_t;
+
+static bool loader_cancelled(browser_loader_t* loader) {
+    return __atomic_load_n(&loader->cancelled, __ATOMIC_ACQUIRE);
+}
+
+static void loader_retain(browser_loader_t* loader) {
+    __atomic_add_fetch(&loader->ref_count, 1, __ATOMIC_ACQ_REL);
+}
+
+static void loader_release(browser_loader_t* loader) {
+    if (__atomic_sub_fetch(&loader->ref_count, 1, __ATOMIC_ACQ_REL) != 0) return;
+    
+    for (uint32_t i = 0; i < loader->resource_count; i++) {
+        browser_resource_t* resource = loader->resources[i];
+        if (resource->operation) {
+            fetch_operation_destroy(resource->operation);
+        }
+        js_compile_job_discard(resource->compile_job);
+        free(resource->url);
+        free(resource);
+    }
+    free(loader->resources);
+    
+    for (uint32_t i = 0; i < loader->script_count; i++) {
+        js_compile_job_discard(loader->scripts[i].compile_job);
+        free(loader->scripts[i].text);
+    }
+    free(loader->scripts);
+    
+    html_preload_scanner_destroy(loader->scanner);
+    free(loader);
+}
+
+// Fire on_load once scripts have run and no fetch is outstanding
+static void loader_check_load(browser_loader_t* loader) {
+    if (loader_cancelled(loader) || loader->load_fired) return;
+    if (!loader->scripts_done || loader->pending_count > 0) return;
+    
+    loader->load_fired = true;
+    if (loader->callbacks.on_load) {
+        loader->callbacks.on_load(loader->tab);
+    }
+}
+
+static void loader_run_scripts(browser_loader_t* loader);
+
+// Runs on the tab's event loop once a compile job is ready
+static void loader_compiled_task(void* data) {
+    browser_loader_t* loader = data;
+    if (!loader_cancelled(loader)) {
+        loader_run_scripts(loader);
+    }
+    loader_release(loader);
+}
+
+// Runs on a pool thread. browser_loader_destroy waits for it, so the tab
+// and its engine outlive it.
+static void loader_on_compiled(void* data) {
+    browser_loader_t* loader = data;
+    if (loader_cancelled(loader)) {
+        loader_release(loader);
+        return;
+    }
+    js_queue_task_from((js_engine_t*)loader->tab->js_context, JS_TASK_NETWORK, loader_compiled_task, loader);
+}
+
+// Starts compiling a large script on the worker pool; NULL when it is
+// small or there is no pool, and it compiles as it runs
+static js_compile_job_t* loader_start_compile(browser_loader_t* loader, const char* source, size_t length, const char* filename) {
+    worker_pool_t* pool = loader->tab->engine ? loader->tab->engine->managers.worker_pool : NULL;
+    if (!pool || !loader->tab->js_context || length < JS_COMPILE_OFF_THREAD_MIN) return NULL;
+    
+    loader_retain(loader);
+    js_compile_job_t* job = js_compile_job_start((js_engine_t*)loader->tab->js_context, pool, &loader->compile_group, source, length, filename, JS_CODE_SCRIPT, loader_on_compiled, loader);
+    if (!job) loader_release(loader);
+    return job;
+}
+
+// Takes the job
+static void loader_execute_compiled(browser_loader_t* loader, js_compile_job_t* job) {
+    js_bytecode_t* bytecode = js_compile_job_finish(job);
+    if (bytecode) {
+        browser_execute_compiled(loader->tab, bytecode);
+    }
+}
+
+// Execute queued scripts in order until one is still downloading or
+// compiling
+static void loader_run_scripts(browser_loader_t* loader) {
+    if (!loader->parsing_done || loader->scripts_done) return;
+    
+    // Scripts may tear the loader down (e.g. by navigating)
+    loader_retain(loader);
+    
+    while (!loader_cancelled(loader) && loader->next_script < loader->script_count) {
+        loader_script_t* script = &loader->scripts[loader->next_script];
+        
+        if (script->resource) {
+            browser_resource_t* resource = script->resource;
+            if (resource->state == RESOURCE_PENDING) break;
+            if (resource->compile_job && !js_compile_job_ready(resource->compile_job)) break;
+            
+            loader->next_script++;
+            response_t* response = resource->operation ? resource->operation->response : NULL;
+            if (resource->compile_job) {
+                js_compile_job_t* job = resource->compile_job;
+                resource->compile_job = NULL;
+                loader_execute_compiled(loader, job);
+            } else if (resource->state == RESOURCE_LOADED && response && response->ok && response->body) {
+                browser_execute_script(loader->tab, (char*)response->body);
+            }
+        } else {
+            if (script->compile_job && !js_compile_job_ready(script->compile_job)) break;
+            
+            loader->next_script++;
+            if (script->compile_job) {
+                js_compile_job_t* job = script->compile_job;
+                script->compile_job = NULL;
+                loader_execute_compiled(loader, job);
+            } else {
+                browser_execute_script(loader->tab, script->text);
+            }
+        }
+    }
+    
+    if (!loader_cancelled(loader) && loader->next_script == loader->script_count) {
+        loader->scripts_done = true;
+        if (loader->callbacks.on_scripts_done) {
+            loader->callbacks.on_scripts_done(loader->tab);
+        }
+        loader_check_load(loader);
+    }
+    
+    loader_release(loader);
+}
+
+// Runs on the tab's event loop
+static void loader_run_task(void* data) {
+    loader_task_t* task = data;
+    browser_resource_t* resource = task->resource;
+    browser_loader_t* loader = resource->loader;
+    
+    if (!loader_cancelled(loader) && resource->state == RESOURCE_PENDING) {
+        resource->state = task->success ? RESOURCE_LOADED : RESOURCE_FAILED;
+        loader->pending_count--;
+        
+        response_t* response = resource->operation ? resource->operation->response : NULL;
+        if (resource->type == PRELOAD_SCRIPT && resource->state == RESOURCE_LOADED && response && response->ok && response->body) {
+            resource->compile_job = loader_start_compile(loader, response->body, response->body_size, resource->url);
+        }
+        loader_run_scripts(loader);
+        loader_check_load(loader);
+    }
+    
+    loader_release(loader);
+    free(task);
+}
+
+// Tasks dropped unrun from the event loop still hold their loader
+static void loader_discard_task(void* data) {
+    loader_task_t* task = data;
+    loader_release(task->resource->loader);
+    free(task);
+}
+
+static void loader_discard_compiled_task(void* data) {
+    loader_release(data);
+}
+
+static void loader_post_task(fetch_operation_t* operation, bool success) {
+    browser_resource_t* resource = operation->user_data;
+    browser_loader_t* loader = resource->loader;
+    if (loader_cancelled(loader)) return;
+    
+    loader_task_t* task = calloc(1, sizeof(loader_task_t));
+    if (!task) return;
+    
+    task->resource = resource;
+    task->success = success;
+    
+    loader_retain(loader);
+    js_queue_task_from((js_engine_t*)loader->tab->js_context, JS_TASK_NETWORK, loader_run_task, task);
+}
+
+static void loader_on_complete(fetch_operation_t* operation, response_t* response) {
+    loader_post_task(operation, response && response->ok);
+}
+
+static void loader_on_error(fetch_operation_t* operation, const char* error) {
+    (void)error;
+    loader_post_task(operation, false);
+}
+
+static const fetch_callbacks_t loader_callbacks = {
+    .on_complete = loader_on_complete,
+    .on_error = loader_on_error
+};
+
+// What a subresource is for, which sets its fetch's network priority
+static request_destination_t loader_destination(html_preload_type_t type) {
+    switch (type) {
+        case PRELOAD_SCRIPT: return REQUEST_DESTINATION_SCRIPT;
+        case PRELOAD_STYLESHEET: return REQUEST_DESTINATION_STYLE;
+        case PRELOAD_IMAGE: return REQUEST_DESTINATION_IMAGE;
+        case PRELOAD_FONT: return REQUEST_DESTINATION_FONT;
+        default: return REQUEST_DESTINATION_EMPTY;
+    }
+}
+
+static void loader_on_preload(void* data, html_preload_type_t type, const char* url) {
+    browser_loader_request((browser_loader_t*)data, type, url);
+}
+
+browser_loader_t* browser_loader_create(browser_tab_t* tab, const browser_loader_callbacks_t* callbacks) {
+    if (!tab) return NULL;
+    
+    browser_loader_t* loader = calloc(1, sizeof(browser_loader_t));
+    if (!loader) return NULL;
+    
+    loader->tab = tab;
+    loader->ref_count = 1;
+    if (callbacks) {
+        loader->callbacks = *callbacks;
+    }
+    
+    loader->scanner = html_preload_scanner_create(loader_on_preload, loader);
+    if (!loader->scanner) {
+        free(loader);
+        return NULL;
+    }
+    
+    return loader;
+}
+
+// Abort outstanding fetches; no callbacks are delivered afterwards
+void browser_loader_destroy(browser_loader_t* loader) {
+    if (!loader) return;
+    
+    __atomic_store_n(&loader->cancelled, true, __ATOMIC_RELEASE);
+    for (uint32_t i = 0; i < loader->resource_count; i++) {
+        browser_resource_t* resource = loader->resources[i];
+        if (resource->state == RESOURCE_PENDING && resource->operation) {
+            fetch_abort(resource->operation);
+        }
+        js_compile_job_discard(resource->compile_job);
+        resource->compile_job = NULL;
+    }
+    for (uint32_t i = loader->next_script; i < loader->script_count; i++) {
+        js_compile_job_discard(loader->scripts[i].compile_job);
+        loader->scripts[i].compile_job = NULL;
+    }
+    
+    // Discarded jobs still queued only report back; one compiling finishes
+    // first. Either way the tab may be closed once none is left.
+    worker_pool_t* pool = loader->tab->engine ? loader->tab->engine->managers.worker_pool : NULL;
+    worker_pool_wait(pool, &loader->compile_group);
+    
+    // The tab has a single live loader, so every loader task still queued
+    // is this one's or a cancelled predecessor's
+    js_engine_t* js_engine = (js_engine_t*)loader->tab->js_context;
+    js_discard_tasks(js_engine, loader_run_task, loader_discard_task);
+    js_discard_tasks(js_engine, loader_compiled_task, loader_discard_compiled_task);
+    
+    loader_release(loader);
+}
+
+void browser_loader_scan(browser_loader_t* loader, const char* chunk, uint32_t length) {
+    if (!loader || loader_cancelled(loader)) return;
+    html_preload_scanner_scan(loader->scanner, chunk, length);
+}
+
+browser_resource_t* browser_loader_find(browser_loader_t* loader, const char* url) {
+    if (!loader || !url) return NULL;
+    
+    for (uint32_t i = 0; i < loader->resource_count; i++) {
+        if (strcmp(loader->resources[i]->url, url) == 0) {
+            return loader->resources[i];
+        }
+    }
+    return NULL;
+}
+
+browser_resource_t* browser_loader_request(browser_loader_t* loader, html_preload_type_t type, const char* url) {
+    if (!loader || !url || loader_cancelled(loader)) return NULL;
+    
+    browser_resource_t* resource = browser_loader_find(loader, url);
+    if (resource) return resource;
+    
+    if (loader->resource_count >= loader->resource_capacity) {
+        uint32_t new_capacity = capacity_grow(loader->resource_capacity, 32, sizeof(browser_resource_t*));
+        browser_resource_t** new_resources = new_capacity ? realloc(loader->resources, new_capacity * sizeof(browser_resource_t*)) : NULL;
+        if (!new_resources) return NULL;
+        loader->resources = new_resources;
+        loader->resource_capacity = new_capacity;
+    }
+    
+    resource = calloc(1, sizeof(browser_resource_t));
+    if (!resource) return NULL;
+    
+    resource->loader = loader;
+    resource->type = type;
+    resource->url = strdup(url);
+    resource->state = RESOURCE_PENDING;
+    loader->resources[loader->resource_count++] = resource;
+    loader->pending_count++;
+    
+    request_t* request = fetch_create_request(url, NULL);
+    if (request) {
+        request->destination = loader_destination(type);
+        resource->operation = fetch_start_async(request, &loader_callbacks, resource);
+        if (!resource->operation) {
+            free(request);
+        }
+    }
+    
+    if (!resource->operation) {
+        resource->state = RESOURCE_FAILED;
+        loader->pending_count--;
+    }
+    
+    return resource;
+}
+
+static loader_script_t* loader_push_script(browser_loader_t* loader) {
+    if (loader->script_count >= loader->script_capacity) {
+        uint32_t new_capacity = capacity_grow(loader->script_capacity, 16, sizeof(loader_script_t));
+        loader_script_t* new_scripts = new_capacity ? realloc(loader->scripts, new_capacity * sizeof(loader_script_t)) : NULL;
+        if (!new_scripts) return NULL;
+        loader->scripts = new_scripts;
+        loader->script_capacity = new_capacity;
+    }
+    
+    loader_script_t* script = &loader->scripts[loader->script_count++];
+    script->text = NULL;
+    script->compile_job = NULL;
+    script->resource = NULL;
+    return script;
+}
+
+void browser_loader_queue_script(browser_loader_t* loader, const char* src) {
+    if (!loader || !src || loader->parsing_done) return;
+    
+    // Usually already in flight thanks to the preload scanner
+    browser_resource_t* resource = browser_loader_request(loader, PRELOAD_SCRIPT, src);
+    if (!resource) return;
+    
+    loader_script_t* script = loader_push_script(loader);
+    if (script) {
+        script->resource = resource;
+    }
+}
+
+void browser_loader_queue_inline_script(browser_loader_t* loader, const char* text) {
+    if (!loader || !text || loader->parsing_done) return;
+    
+    char* copy = strdup(text);
+    if (!copy) return;
+    
+    loader_script_t* script = loader_push_script(loader);
+    if (script) {
+        script->text = copy;
+        script->compile_job = loader_start_compile(loader, copy, strlen(copy), loader->tab->url);
+    } else {
+        free(copy);
+    }
+}
+
+// The script queue is complete; start executing it
+void browser_loader_parsing_done(browser_loader_t* loader) {
+    if (!loader || loader->parsing_done) return;
+    
+    loader->parsing_done = true;
+    loader_run_scripts(loader);
+}
+
+bool browser_loader_parsing_finished(browser_loader_t* loader) {
+    return loader && loader->parsing_done;
+}
\ No newline at end of file
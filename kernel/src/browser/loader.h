@@ -0,0 +1,57 @@
+#ifndef BROWSER_LOADER_H
+#define BROWSER_LOADER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "engine.h"
+#include "html/preload.h"
+
+// Forward declarations
+struct fetch_operation;
+struct js_compile_job;
+
+typedef struct browser_loader browser_loader_t;
+
+// Subresource fetched on behalf of a document
+typedef struct {
+    browser_loader_t* loader;
+    char* url;
+    html_preload_type_t type;
+    struct fetch_operation* operation;
+    struct js_compile_job* compile_job; // Large scripts compile off-thread once loaded
+    enum {
+        RESOURCE_PENDING,
+        RESOURCE_LOADED,
+        RESOURCE_FAILED
+    } state;
+} browser_resource_t;
+
+// Document lifecycle notifications, delivered on the tab's event loop
+typedef struct {
+    void (*on_scripts_done)(browser_tab_t* tab);
+    void (*on_load)(browser_tab_t* tab);
+} browser_loader_callbacks_t;
+
+// Resource loader. Owns every subresource fetch of one document load:
+// URLs found by the preload scanner are fetched in parallel as soon as they
+// appear in the byte stream, while scripts still execute in document order
+// once the parser has finished. Large scripts are compiled on the worker
+// pool as soon as their source is known, and the queue waits for them
+// without blocking the tab's event loop.
+browser_loader_t* browser_loader_create(browser_tab_t* tab, const browser_loader_callbacks_t* callbacks);
+void browser_loader_destroy(browser_loader_t* loader);
+
+// Speculative scanning of raw document bytes
+void browser_loader_scan(browser_loader_t* loader, const char* chunk, uint32_t length);
+
+// Fetch a subresource unless it is already known
+browser_resource_t* browser_loader_request(browser_loader_t* loader, html_preload_type_t type, const char* url);
+browser_resource_t* browser_loader_find(browser_loader_t* loader, const char* url);
+
+// Scripts, queued in document order after parsing
+void browser_loader_queue_script(browser_loader_t* loader, const char* src);
+void browser_loader_queue_inline_script(browser_loader_t* loader, const char* text);
+void browser_loader_parsing_done(browser_loader_t* loader);
+bool browser_loader_parsing_finished(browser_loader_t* loader);
+
+#endif
\ No newline at end of file
@@ -0,0 +1,878 @@
+#include "manager.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+
+#define NETWORK_POOL_BUCKETS_INITIAL 16
+#define NETWORK_ACTION_BATCH 16         // Transport calls made per unlock
+
+typedef struct network_pool network_pool_t;
+
+typedef enum {
+    CONNECTION_CONNECTING,
+    CONNECTION_READY,
+    CONNECTION_CLOSING,             // Takes no requests; waits for those sent
+    CONNECTION_CLOSED               // Out of its pool; freed with its last reference
+} connection_state_t;
+
+struct network_connection {
+    network_pool_t* pool;
+    network_connection_t* next;
+    connection_state_t state;
+    network_protocol_t protocol;
+    uint32_t max_streams;
+    uint32_t active;                // Requests assigned to it
+    uint64_t idle_since;
+    uint32_t refs;                  // The pool's, one per active request and per action
+    void* transport_data;
+};
+
+typedef enum {
+    REQUEST_QUEUED,
+    REQUEST_SENDING,                // Assigned; the send is about to be made
+    REQUEST_SENT,
+    REQUEST_DONE
+} request_state_t;
+
+struct network_request {
+    network_pool_t* pool;
+    network_connection_t* connection;   // Once assigned
+    network_request_t* prev;
+    network_request_t* next;
+    network_priority_t priority;
+    request_state_t state;
+    bool cancelled;
+    uint32_t refs;                  // The caller's, and the manager's until done
+    void* user_data;
+};
+
+struct network_pool {
+    network_manager_t* manager;
+    network_pool_t* next;
+    char* key;                      // "scheme://host:port"
+    network_origin_t origin;
+    
+    network_connection_t* connections;
+    uint32_t open_count;            // Connecting, ready or closing
+    uint32_t connecting_count;
+    uint32_t closing_count;
+    uint32_t live_count;            // Not yet freed, so still pointing here
+    uint32_t resuming;              // Dispatches to pick up after their batch
+network_protocol_t protocol;    // As last negotiated
+    
+    struct {
+        network_request_t* head;
+        network_request_t* tail;
+    } pending[NETWORK_PRIORITY_COUNT];
+    uint32_t pending_count;
+    bool waiting_for_slot;          // Wants a connection the global cap denies
+    
+    void* session;
+    uint32_t session_length;
+    uint64_t session_saved;
+};
+
+struct network_manager {
+    network_config_t config;
+    network_transport_t transport;
+    void* transport_data;
+    
+    pthread_mutex_t lock;
+    network_pool_t** buckets;
+    uint32_t bucket_count;          // Power of two
+    uint32_t pool_count;
+    uint32_t connection_count;      // Open connections, all origins
+    uint32_t slot_waiters;          // Pools waiting_for_slot
+};
+
+// Transport calls collected under the lock and made after it is dropped.
+// Each holds a reference on its connection.
+typedef struct {
+    enum {
+        ACTION_CONNECT,
+        ACTION_SEND,
+        ACTION_CLOSE,
+        ACTION_FAIL
+    } kind;
+    network_connection_t* connection;
+    network_request_t* request;     // SEND; for FAIL a chain through next
+    void* session;                  // CONNECT; a copy
+    uint32_t session_length;
+    const char* error;
+} network_action_t;
+
+typedef struct {
+    network_action_t items[NETWORK_ACTION_BATCH];
+    uint32_t count;
+} network_actions_t;
+
+static uint64_t network_now(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000 + (uint64_t)now.tv_nsec / 1000;
+}
+
+network_priority_t network_priority_for_destination(request_destination_t destination) {
+    switch (destination) {
+        case REQUEST_DESTINATION_DOCUMENT: return NETWORK_PRIORITY_DOCUMENT;
+        case REQUEST_DESTINATION_STYLE: return NETWORK_PRIORITY_STYLE;
+        case REQUEST_DESTINATION_SCRIPT: return NETWORK_PRIORITY_SCRIPT;
+        case REQUEST_DESTINATION_IMAGE: return NETWORK_PRIORITY_IMAGE;
+        default: return NETWORK_PRIORITY_DEFAULT;
+    }
+}
+
+// Origins
+
+static uint32_t hash_key(const char* key) {
+    uint32_t hash = 2166136261u;
+    for (; *key; key++) {
+        hash = (hash ^ (uint8_t)*key) * 16777619u;
+    }
+    return hash;
+}
+
+// Parses url's origin into key as "scheme://host:port". False unless it
+// is http(s) with a host.
+static bool parse_origin(const char* url, char* key, size_t key_size, network_origin_t* origin) {
+    size_t scheme_length;
+    if (strncasecmp(url, "https://", 8) == 0) {
+        origin->scheme = "https";
+        origin->secure = true;
+        origin->port = 443;
+        scheme_length = 8;
+    } else if (strncasecmp(url, "http://", 7) == 0) {
+        origin->scheme = "http";
+        origin->secure = false;
+        origin->port = 80;
+        scheme_length = 7;
+    } else {
+        return false;
+    }
+    
+    const char* authority = url + scheme_length;
+    size_t authority_length = strcspn(authority, "/?#");
+    for (size_t i = authority_length; i > 0; i--) {
+        if (authority[i - 1] == '@') {
+            authority += i;
+            authority_length -= i;
+            break;
+        }
+    }
+    
+    // The host runs to the port, past any IPv6 literal's colons
+    size_t host_length = 0;
+    if (authority_length && authority[0] == '[') {
+        const char* close = memchr(authority, ']', authority_length);
+        if (!close) return false;
+        host_length = (size_t)(close - authority) + 1;
+    } else {
+        while (host_length < authority_length && authority[host_length] != ':') host_length++;
+    }
+    if (host_length == 0) return false;
+    
+    if (host_length < authority_length) {
+        if (authority[host_length] != ':') return false;
+        uint32_t port = 0;
+        for (size_t i = host_length + 1; i < authority_length; i++) {
+            if (authority[i] < '0' || authority[i] > '9') return false;
+            port = port * 10 + (uint32_t)(authority[i] - '0');
+            if (port > 65535) return false;
+        }
+        if (host_length + 1 < authority_length) origin->port = (uint16_t)port;
+    }
+    
+    int length = snprintf(key, key_size, "%s://%.*s:%u", origin->scheme, (int)host_length, authority, origin->port);
+    if (length < 0 || (size_t)length >= key_size) return false;
+    
+    // Hosts compare case-insensitively
+    char* host = key + strlen(origin->scheme) + 3;
+    for (size_t i = 0; i < host_length; i++) {
+        if (host[i] >= 'A' && host[i] <= 'Z') host[i] += 'a' - 'A';
+    }
+    return true;
+}
+
+static bool manager_grow_buckets(network_manager_t* manager) {
+    uint32_t bucket_count = manager->bucket_count * 2;
+    network_pool_t** buckets = calloc(bucket_count, sizeof(network_pool_t*));
+    if (!buckets) return false;
+    
+    for (uint32_t i = 0; i < manager->bucket_count; i++) {
+        network_pool_t* pool = manager->buckets[i];
+        while (pool) {
+            network_pool_t* next = pool->next;
+            uint32_t bucket = hash_key(pool->key) & (bucket_count - 1);
+            pool->next = buckets[bucket];
+            buckets[bucket] = pool;
+            pool = next;
+        }
+    }
+    free(manager->buckets);
+    manager->buckets = buckets;
+    manager->bucket_count = bucket_count;
+    return true;
+}
+
+static network_pool_t* manager_pool(network_manager_t* manager, const char* url) {
+    char key[512];
+    network_origin_t origin;
+    if (!parse_origin(url, key, sizeof(key), &origin)) return NULL;
+    
+    uint32_t hash = hash_key(key);
+    for (network_pool_t* pool = manager->buckets[hash & (manager->bucket_count - 1)]; pool; pool = pool->next) {
+        if (strcmp(pool->key, key) == 0) return pool;
+    }
+    
+    if (manager->pool_count >= manager->bucket_count && !manager_grow_buckets(manager)) return NULL;
+    
+    network_pool_t* pool = calloc(1, sizeof(network_pool_t));
+    if (!pool) return NULL;
+    pool->key = strdup(key);
+    if (!pool->key) {
+        free(pool);
+        return NULL;
+    }
+    
+    // The host is the key between "scheme://" and the port
+    pool->origin = origin;
+    char* host = pool->key + strlen(origin.scheme) + 3;
+    char* port = strrchr(host, ':');
+    char* host_copy = malloc((size_t)(port - host) + 1);
+    if (!host_copy) {
+        free(pool->key);
+        free(pool);
+        return NULL;
+    }
+    memcpy(host_copy, host, (size_t)(port - host));
+    host_copy[port - host] = '\0';
+    pool->origin.host = host_copy;
+    pool->manager = manager;
+    
+    uint32_t bucket = hash & (manager->bucket_count - 1);
+    pool->next = manager->buckets[bucket];
+    manager->buckets[bucket] = pool;
+    manager->pool_count++;
+    return pool;
+}
+
+static void pool_free(network_pool_t* pool) {
+    free((char*)pool->origin.host);
+    free(pool->key);
+    free(pool->session);
+    free(pool);
+}
+
+// Waiting requests
+
+static void pool_push(network_pool_t* pool, network_request_t* request) {
+    network_request_t** tail = &pool->pending[request->priority].tail;
+    request->prev = *tail;
+    request->next = NULL;
+    if (*tail) {
+        (*tail)->next = request;
+    } else {
+        pool->pending[request->priority].head = request;
+    }
+    *tail = request;
+    pool->pending_count++;
+}
+
+static void pool_unlink(network_pool_t* pool, network_request_t* request) {
+    if (request->prev) {
+        request->prev->next = request->next;
+    } else {
+        pool->pending[request->priority].head = request->next;
+    }
+    if (request->next) {
+        request->next->prev = request->prev;
+    } else {
+        pool->pending[request->priority].tail = request->prev;
+    }
+    request->prev = request->next = NULL;
+    pool->pending_count--;
+}
+
+static network_request_t* pool_first(const network_pool_t* pool) {
+    for (uint32_t priority = 0; priority < NETWORK_PRIORITY_COUNT; priority++) {
+        if (pool->pending[priority].head) return pool->pending[priority].head;
+    }
+    return NULL;
+}
+
+static void request_unref(network_request_t* request) {
+    if (__atomic_sub_fetch(&request->refs, 1, __ATOMIC_ACQ_REL) == 0) {
+        free(request);
+    }
+}
+
+// Connections. Everything below runs with the manager's lock held.
+
+static void pool_set_waiting(network_pool_t* pool, bool waiting) {
+    if (pool->waiting_for_slot == waiting) return;
+    pool->waiting_for_slot = waiting;
+    if (waiting) {
+        pool->manager->slot_waiters++;
+    } else {
+        pool->manager->slot_waiters--;
+    }
+}
+
+static void connection_unref(network_connection_t* connection) {
+    if (--connection->refs > 0) return;
+    connection->pool->live_count--;
+    free(connection);
+}
+
+static void connection_remove(network_connection_t* connection) {
+    network_pool_t* pool = connection->pool;
+    for (network_connection_t** link = &pool->connections; *link; link = &(*link)->next) {
+        if (*link == connection) {
+            *link = connection->next;
+            break;
+        }
+    }
+    if (connection->state == CONNECTION_CONNECTING) pool->connecting_count--;
+    if (connection->state == CONNECTION_CLOSING) pool->closing_count--;
+    connection->state = CONNECTION_CLOSED;
+    connection->next = NULL;
+    pool->open_count--;
+    pool->manager->connection_count--;
+    connection_unref(connection);
+}
+
+static uint32_t connection_capacity(const network_connection_t* connection) {
+    return connection->protocol == NETWORK_PROTOCOL_HTTP2 ? connection->max_streams : 1;
+}
+
+// The ready connection with the most room, so h2 streams spread out
+static network_connection_t* pool_available(const network_pool_t* pool) {
+    network_connection_t* best = NULL;
+    uint32_t best_room = 0;
+    for (network_connection_t* connection = pool->connections; connection; connection = connection->next) {
+        if (connection->state != CONNECTION_READY) continue;
+        uint32_t capacity = connection_capacity(connection);
+        uint32_t room = capacity > connection->active ? capacity - connection->active : 0;
+        if (room > best_room) {
+            best = connection;
+            best_room = room;
+        }
+    }
+    return best;
+}
+
+static bool pool_wants_connection(const network_pool_t* pool) {
+    const network_manager_t* manager = pool->manager;
+    uint32_t usable = pool->open_count - pool->closing_count;
+    if (pool->pending_count == 0) return false;
+    
+    // One h2 connection carries the origin; one TLS handshake tells
+    if (pool->protocol == NETWORK_PROTOCOL_HTTP2) return usable == 0;
+    if (pool->protocol == NETWORK_PROTOCOL_UNKNOWN && pool->origin.secure && pool->connecting_count > 0) return false;
+    
+    return pool->connecting_count < pool->pending_count && usable < manager->config.max_connections_per_origin;
+}
+
+static bool actions_push(network_actions_t* actions, int kind, network_connection_t* connection, network_request_t* request) {
+    if (actions->count == NETWORK_ACTION_BATCH) return false;
+    network_action_t* action = &actions->items[actions->count++];
+    memset(action, 0, sizeof(*action));
+    action->kind = kind;
+    action->connection = connection;
+    action->request = request;
+    if (connection) connection->refs++;
+    return true;
+}
+
+// Frees a connection slot under the global cap by closing the connection
+// idle longest, whatever its origin
+static bool manager_reserve_slot(network_manager_t* manager, network_actions_t* actions) {
+    if (manager->connection_count < manager->config.max_connections) return true;
+    
+    network_connection_t* oldest = NULL;
+    for (uint32_t i = 0; i < manager->bucket_count; i++) {
+        for (network_pool_t* pool = manager->buckets[i]; pool; pool = pool->next) {
+            for (network_connection_t* connection = pool->connections; connection; connection = connection->next) {
+                if (connection->state != CONNECTION_READY || connection->active > 0) continue;
+                if (!oldest || connection->idle_since < oldest->idle_since) oldest = connection;
+            }
+        }
+    }
+    if (!oldest || !actions_push(actions, ACTION_CLOSE, oldest, NULL)) return false;
+    connection_remove(oldest);
+    return true;
+}
+
+// Assigns the pool's waiting requests to connections with room and opens
+// connections for the rest. False once actions is full.
+static bool pool_dispatch(network_pool_t* pool, network_actions_t* actions) {
+    network_manager_t* manager = pool->manager;
+    bool blocked = false;
+    
+    while (pool->pending_count > 0) {
+        // Room for an eviction and a connect
+        if (actions->count + 2 > NETWORK_ACTION_BATCH) return false;
+        
+        network_connection_t* connection = pool_available(pool);
+        if (connection) {
+            network_request_t* request = pool_first(pool);
+            pool_unlink(pool, request);
+            request->state = REQUEST_SENDING;
+            request->connection = connection;
+            connection->active++;
+            connection->refs++;
+            actions_push(actions, ACTION_SEND, connection, request);
+            continue;
+        }
+        
+        if (!pool_wants_connection(pool)) break;
+        if (!manager_reserve_slot(manager, actions)) {
+            blocked = true;
+            break;
+        }
+        
+        connection = calloc(1, sizeof(network_connection_t));
+        if (!connection) break;
+        connection->pool = pool;
+        connection->state = CONNECTION_CONNECTING;
+        connection->refs = 1;
+        connection->next = pool->connections;
+        pool->connections = connection;
+        pool->open_count++;
+        pool->connecting_count++;
+        pool->live_count++;
+        manager->connection_count++;
+        
+        network_action_t* action = &actions->items[actions->count];
+        actions_push(actions, ACTION_CONNECT, connection, NULL);
+        if (pool->session) {
+            action->session = malloc(pool->session_length);
+            if (action->session) {
+                memcpy(action->session, pool->session, pool->session_length);
+                action->session_length = pool->session_length;
+            }
+        }
+    }
+    
+    pool_set_waiting(pool, blocked);
+    return true;
+}
+
+static network_pool_t* manager_most_urgent_waiter(network_manager_t* manager) {
+    network_pool_t* best = NULL;
+    network_priority_t best_priority = NETWORK_PRIORITY_COUNT;
+    for (uint32_t i = 0; i < manager->bucket_count; i++) {
+        for (network_pool_t* pool = manager->buckets[i]; pool; pool = pool->next) {
+            if (!pool->waiting_for_slot) continue;
+            network_request_t* first = pool_first(pool);
+            if (first && first->priority < best_priority) {
+                best = pool;
+                best_priority = first->priority;
+            }
+        }
+    }
+    return best;
+}
+
+// Dispatches pool, when given, and then the origins waiting on the
+// global cap, most urgent first. False when actions filled up first.
+static bool manager_dispatch(network_manager_t* manager, network_pool_t* pool, network_actions_t* actions) {
+    if (pool && !pool_dispatch(pool, actions)) return false;
+    
+    while (manager->slot_waiters > 0) {
+        network_pool_t* waiter = manager_most_urgent_waiter(manager);
+        if (!waiter) break;
+        if (!pool_dispatch(waiter, actions)) return false;
+        if (waiter->waiting_for_slot) break;
+    }
+    return true;
+}
+
+static void manager_run_actions(network_manager_t* manager, network_actions_t* actions) {
+    const network_transport_t* transport = &manager->transport;
+    
+    for (uint32_t i = 0; i < actions->count; i++) {
+        network_action_t* action = &actions->items[i];
+        switch (action->kind) {
+            case ACTION_CONNECT:
+                transport->connect(manager->transport_data, action->connection, &action->connection->pool->origin, action->session, action->session_length);
+                free(action->session);
+                break;
+            
+            case ACTION_SEND: {
+                // Cancelled before it went out: free the connection for
+                // the next request instead
+                pthread_mutex_lock(&manager->lock);
+                network_request_t* request = action->request;
+                bool cancelled = request->cancelled;
+                request->state = cancelled ? REQUEST_SENDING : REQUEST_SENT;
+                pthread_mutex_unlock(&manager->lock);
+                if (cancelled) {
+                    network_request_finished(request, true);
+                } else {
+                    transport->send(manager->transport_data, action->connection, request);
+                }
+                break;
+            }
+            
+            case ACTION_CLOSE:
+                transport->close(manager->transport_data, action->connection);
+                break;
+            
+            case ACTION_FAIL:
+                for (network_request_t* request = action->request; request;) {
+                    network_request_t* next = request->next;
+                    request->next = NULL;
+                    transport->fail(manager->transport_data, request, action->error);
+                    request_unref(request);
+                    request = next;
+                }
+                break;
+        }
+    }
+    
+    pthread_mutex_lock(&manager->lock);
+    for (uint32_t i = 0; i < actions->count; i++) {
+        if (actions->items[i].connection) connection_unref(actions->items[i].connection);
+    }
+    pthread_mutex_unlock(&manager->lock);
+    actions->count = 0;
+}
+
+// Dispatches with the lock held, then drops it to make the transport
+// calls, repeating while they did not all fit in one batch. The same pool
+// is dispatched again, so a connection that became ready for many waiting
+// requests is filled up to its stream limit; resuming keeps the pool from
+// being freed in between.
+static void manager_dispatch_unlock(network_manager_t* manager, network_pool_t* pool) {
+    network_actions_t actions;
+    actions.count = 0;
+    bool done = manager_dispatch(manager, pool, &actions);
+    if (!done && pool) pool->resuming++;
+    pthread_mutex_unlock(&manager->lock);
+    
+    while (actions.count > 0) {
+        manager_run_actions(manager, &actions);
+        if (done) break;
+        
+        pthread_mutex_lock(&manager->lock);
+        done = manager_dispatch(manager, pool, &actions);
+        if (done && pool) pool->resuming--;
+        pthread_mutex_unlock(&manager->lock);
+    }
+}
+
+// Manager
+
+network_manager_t* network_manager_create(const network_config_t* config, const network_transport_t* transport, void* transport_data) {
+    if (!transport) return NULL;
+    
+    network_manager_t* manager = calloc(1, sizeof(network_manager_t));
+    if (!manager) return NULL;
+    
+    if (config) manager->config = *config;
+    if (!manager->config.max_connections) manager->config.max_connections = NETWORK_MAX_CONNECTIONS;
+    if (!manager->config.max_connections_per_origin) manager->config.max_connections_per_origin = NETWORK_MAX_CONNECTIONS_PER_ORIGIN;
+    if (!manager->config.keep_alive_us) manager->config.keep_alive_us = NETWORK_KEEP_ALIVE_US;
+    if (!manager->config.session_lifetime_us) manager->config.session_lifetime_us = NETWORK_SESSION_LIFETIME_US;
+    manager->transport = *transport;
+    manager->transport_data = transport_data;
+    
+    manager->bucket_count = NETWORK_POOL_BUCKETS_INITIAL;
+    manager->buckets = calloc(manager->bucket_count, sizeof(network_pool_t*));
+    if (!manager->buckets) {
+        free(manager);
+        return NULL;
+    }
+    pthread_mutex_init(&manager->lock, NULL);
+    return manager;
+}
+
+void network_manager_destroy(network_manager_t* manager) {
+    if (!manager) return;
+    
+    for (uint32_t i = 0; i < manager->bucket_count; i++) {
+        network_pool_t* pool = manager->buckets[i];
+        while (pool) {
+            network_pool_t* next = pool->next;
+            while (pool->connections) {
+                network_connection_t* connection = pool->connections;
+                pool->connections = connection->next;
+                manager->transport.close(manager->transport_data, connection);
+                free(connection);
+            }
+            for (uint32_t priority = 0; priority < NETWORK_PRIORITY_COUNT; priority++) {
+                while (pool->pending[priority].head) {
+                    network_request_t* request = pool->pending[priority].head;
+                    pool->pending[priority].head = request->next;
+                    request_unref(request);
+                }
+            }
+            pool_free(pool);
+            pool = next;
+        }
+    }
+    free(manager->buckets);
+    pthread_mutex_destroy(&manager->lock);
+    free(manager);
+}
+
+network_request_t* network_manager_submit(network_manager_t* manager, const char* url, network_priority_t priority, void* user_data) {
+    if (!manager || !url || priority >= NETWORK_PRIORITY_COUNT) return NULL;
+    
+    network_request_t* request = calloc(1, sizeof(network_request_t));
+    if (!request) return NULL;
+    request->priority = priority;
+    request->user_data = user_data;
+    request->state = REQUEST_QUEUED;
+    request->refs = 2;
+    
+    pthread_mutex_lock(&manager->lock);
+    network_pool_t* pool = manager_pool(manager, url);
+    if (!pool) {
+        pthread_mutex_unlock(&manager->lock);
+        free(request);
+        return NULL;
+    }
+    request->pool = pool;
+    pool_push(pool, request);
+    manager_dispatch_unlock(manager, pool);
+    return request;
+}
+
+void network_manager_cancel(network_manager_t* manager, network_request_t* request) {
+    if (!manager || !request) return;
+    
+    pthread_mutex_lock(&manager->lock);
+    if (request->cancelled || request->state == REQUEST_DONE) {
+        pthread_mutex_unlock(&manager->lock);
+        return;
+    }
+    request->cancelled = true;
+    
+    if (request->state == REQUEST_QUEUED) {
+        network_pool_t* pool = request->pool;
+        pool_unlink(pool, request);
+        request->state = REQUEST_DONE;
+        if (pool->pending_count == 0) pool_set_waiting(pool, false);
+        pthread_mutex_unlock(&manager->lock);
+        request_unref(request);
+        return;
+    }
+    
+    // A request still being sent is dropped by its send action
+    network_connection_t* connection = request->state == REQUEST_SENT ? request->connection : NULL;
+    if (connection) connection->refs++;
+    pthread_mutex_unlock(&manager->lock);
+    if (!connection) return;
+    
+    manager->transport.cancel(manager->transport_data, connection, request);
+    pthread_mutex_lock(&manager->lock);
+    connection_unref(connection);
+    pthread_mutex_unlock(&manager->lock);
+}
+
+void network_request_release(network_request_t* request) {
+    if (request) request_unref(request);
+}
+
+void* network_request_data(const network_request_t* request) {
+    return request ? request->user_data : NULL;
+}
+
+network_priority_t network_request_priority(const network_request_t* request) {
+    return request ? request->priority : NETWORK_PRIORITY_DEFAULT;
+}
+
+uint64_t network_manager_close_idle(network_manager_t* manager) {
+    if (!manager) return UINT64_MAX;
+    
+    uint64_t now = network_now();
+    uint64_t next = UINT64_MAX;
+    network_actions_t actions;
+    actions.count = 0;
+    
+    pthread_mutex_lock(&manager->lock);
+    for (uint32_t i = 0; i < manager->bucket_count; i++) {
+        network_pool_t** link = &manager->buckets[i];
+        while (*link) {
+            network_pool_t* pool = *link;
+            
+            network_connection_t* connection = pool->connections;
+            while (connection) {
+                network_connection_t* following = connection->next;
+                if (connection->state == CONNECTION_READY && connection->active == 0) {
+                    uint64_t expiry = connection->idle_since + manager->config.keep_alive_us;
+                    if (expiry > now) {
+                        if (expiry < next) next = expiry;
+                    } else if (actions_push(&actions, ACTION_CLOSE, connection, NULL)) {
+                        connection_remove(connection);
+                    } else {
+                        next = now;     // The rest on the next call
+                    }
+                }
+                connection = following;
+            }
+            
+            if (pool->session) {
+                uint64_t expiry = pool->session_saved + manager->config.session_lifetime_us;
+                if (expiry > now) {
+                    if (expiry < next) next = expiry;
+                } else {
+                    free(pool->session);
+                    pool->session = NULL;
+                    pool->session_length = 0;
+                }
+            }
+            
+            if (!pool->session && pool->live_count == 0 && pool->pending_count == 0 && pool->resuming == 0) {
+                *link = pool->next;
+                manager->pool_count--;
+                pool_free(pool);
+            } else {
+                link = &pool->next;
+            }
+        }
+    }
+    
+    // Closing freed slots under the cap
+    manager_dispatch_unlock(manager, NULL);
+    if (actions.count > 0) manager_run_actions(manager, &actions);
+    return next;
+}
+
+uint32_t network_manager_connection_count(network_manager_t* manager) {
+    if (!manager) return 0;
+    pthread_mutex_lock(&manager->lock);
+    uint32_t count = manager->connection_count;
+    pthread_mutex_unlock(&manager->lock);
+    return count;
+}
+
+// Transport reports
+
+void network_connection_ready(network_connection_t* connection, network_protocol_t protocol, uint32_t max_streams) {
+    network_pool_t* pool = connection->pool;
+    network_manager_t* manager = pool->manager;
+    
+    pthread_mutex_lock(&manager->lock);
+    if (connection->state == CONNECTION_CONNECTING) {
+        pool->connecting_count--;
+        connection->state = CONNECTION_READY;
+        connection->protocol = protocol == NETWORK_PROTOCOL_HTTP2 ? NETWORK_PROTOCOL_HTTP2 : NETWORK_PROTOCOL_HTTP1;
+        connection->max_streams = max_streams ? max_streams : NETWORK_DEFAULT_MAX_STREAMS;
+        connection->idle_since = network_now();
+        pool->protocol = connection->protocol;
+    }
+    manager_dispatch_unlock(manager, pool);
+}
+
+void network_connection_set_max_streams(network_connection_t* connection, uint32_t max_streams) {
+    network_manager_t* manager = connection->pool->manager;
+    
+    pthread_mutex_lock(&manager->lock);
+    connection->max_streams = max_streams ? max_streams : NETWORK_DEFAULT_MAX_STREAMS;
+    manager_dispatch_unlock(manager, connection->pool);
+}
+
+void network_connection_save_session(network_connection_t* connection, const void* session, uint32_t session_length) {
+    network_pool_t* pool = connection->pool;
+    network_manager_t* manager = pool->manager;
+    void* copy = session_length ? malloc(session_length) : NULL;
+    if (copy) memcpy(copy, session, session_length);
+    
+    pthread_mutex_lock(&manager->lock);
+    free(pool->session);
+    pool->session = copy;
+    pool->session_length = copy ? session_length : 0;
+    pool->session_saved = network_now();
+    pthread_mutex_unlock(&manager->lock);
+}
+
+void network_connection_failed(network_connection_t* connection, const char* error) {
+    network_pool_t* pool = connection->pool;
+    network_manager_t* manager = pool->manager;
+    network_actions_t actions;
+    actions.count = 0;
+    
+    pthread_mutex_lock(&manager->lock);
+    if (connection->state != CONNECTION_CLOSED) connection_remove(connection);
+    
+    // The saved session may be why; the next attempt does a full handshake
+    free(pool->session);
+    pool->session = NULL;
+    pool->session_length = 0;
+    
+    // With nothing else open to the origin, what waits for it fails rather
+    // than retrying in a loop
+    if (pool->open_count == 0 && pool->pending_count > 0) {
+        network_request_t* failed = NULL;
+        network_request_t** tail = &failed;
+        for (uint32_t priority = 0; priority < NETWORK_PRIORITY_COUNT; priority++) {
+            while (pool->pending[priority].head) {
+                network_request_t* request = pool->pending[priority].head;
+                pool_unlink(pool, request);
+                request->state = REQUEST_DONE;
+                *tail = request;
+                tail = &request->next;
+            }
+        }
+        pool_set_waiting(pool, false);
+        actions_push(&actions, ACTION_FAIL, NULL, failed);
+        actions.items[0].error = error ? error : "connection failed";
+    }
+    
+    manager_dispatch_unlock(manager, pool);
+    if (actions.count > 0) manager_run_actions(manager, &actions);
+}
+
+void network_connection_closed(network_connection_t* connection) {
+    network_pool_t* pool = connection->pool;
+    network_manager_t* manager = pool->manager;
+    
+    pthread_mutex_lock(&manager->lock);
+    if (connection->state == CONNECTION_CONNECTING || (connection->state == CONNECTION_READY && connection->active == 0)) {
+        connection_remove(connection);
+    } else if (connection->state == CONNECTION_READY) {
+        connection->state = CONNECTION_CLOSING;
+        pool->closing_count++;
+    }
+    manager_dispatch_unlock(manager, pool);
+}
+
+void network_request_finished(network_request_t* request, bool keep_alive) {
+    network_pool_t* pool = request->pool;
+    network_manager_t* manager = pool->manager;
+    
+    pthread_mutex_lock(&manager->lock);
+    if (request->state == REQUEST_DONE) {
+        pthread_mutex_unlock(&manager->lock);
+        return;
+    }
+    network_connection_t* connection = request->connection;
+    request->state = REQUEST_DONE;
+    request->connection = NULL;
+    
+    connection->active--;
+    if (connection->active == 0) connection->idle_since = network_now();
+    if (!keep_alive && connection->protocol != NETWORK_PROTOCOL_HTTP2 && connection->state == CONNECTION_READY) {
+        connection_remove(connection);
+    } else if (connection->state == CONNECTION_CLOSING && connection->active == 0) {
+        connection_remove(connection);
+    }
+    connection_unref(connection);
+    
+    manager_dispatch_unlock(manager, pool);
+    request_unref(request);
+}
+
+void network_connection_set_data(network_connection_t* connection, void* data) {
+    connection->transport_data = data;
+}
+
+void* network_connection_data(const network_connection_t* connection) {
+    return connection->transport_data;
+}
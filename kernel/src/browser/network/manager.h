@@ -0,0 +1,140 @@
+#ifndef NETWORK_MANAGER_H
+#define NETWORK_MANAGER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "../webapi/fetch.h"
+
+// Connection manager behind browser_engine_t.managers.network_manager.
+//
+// Requests are pooled by origin (scheme, host and port) and share that
+// origin's connections rather than each opening its own. An HTTP/1.1
+// connection carries one request at a time and is kept alive between
+// them until it has idled for keep_alive_us. An HTTP/2 connection
+// multiplexes requests up to the server's stream limit, so an origin
+// that negotiated h2 gets a single connection. Until a secure origin's
+// protocol is known only one connection is opened: it may turn out to
+// be h2, and either way it leaves a TLS session for the next ones to
+// resume instead of paying a full handshake.
+//
+// Waiting requests go out by priority, then in submission order.
+// max_connections caps connections across all origins; at the cap an
+// idle connection is closed to make room, and failing that the origin
+// with the most urgent waiting request gets the next slot freed.
+//
+// Wire protocols and TLS belong to the transport (network/http.c). The
+// manager tells it what to open, send and close, and it reports back
+// through the network_connection_* and network_request_finished calls,
+// from any thread. The transport is never called with the manager's lock
+// held, so it may report from within one of its hooks.
+#define NETWORK_MAX_CONNECTIONS 64
+#define NETWORK_MAX_CONNECTIONS_PER_ORIGIN 6
+#define NETWORK_KEEP_ALIVE_US 60000000ull           // Idle connections close after a minute
+#define NETWORK_SESSION_LIFETIME_US 600000000ull    // TLS sessions resume for ten minutes
+#define NETWORK_DEFAULT_MAX_STREAMS 100             // Until the server's SETTINGS say otherwise
+
+typedef struct network_manager network_manager_t;
+typedef struct network_connection network_connection_t;
+typedef struct network_request network_request_t;
+
+// Most urgent first
+typedef enum {
+    NETWORK_PRIORITY_DOCUMENT,      // Navigations
+    NETWORK_PRIORITY_STYLE,         // Stylesheets block rendering
+    NETWORK_PRIORITY_SCRIPT,        // Scripts block the parser
+    NETWORK_PRIORITY_DEFAULT,       // fetch(), fonts and the rest
+    NETWORK_PRIORITY_IMAGE,
+    NETWORK_PRIORITY_COUNT
+} network_priority_t;
+
+typedef enum {
+    NETWORK_PROTOCOL_UNKNOWN,       // Not negotiated yet
+    NETWORK_PROTOCOL_HTTP1,
+    NETWORK_PROTOCOL_HTTP2
+} network_protocol_t;
+
+typedef struct {
+    const char* scheme;             // "http" or "https"
+    const char* host;               // Lowercased; IPv6 literals keep their brackets
+    uint16_t port;
+    bool secure;
+} network_origin_t;
+
+typedef struct {
+    // Opens a connection to origin, resuming session (saved from an earlier
+    // connection) when it is not NULL. Reported with network_connection_ready
+    // or network_connection_failed.
+    void (*connect)(void* data, network_connection_t* connection, const network_origin_t* origin, const void* session, uint32_t session_length);
+    
+    // Sends request on a ready connection, on HTTP/2 as a new stream
+    // weighted by its priority. Reported with network_request_finished.
+    void (*send)(void* data, network_connection_t* connection, network_request_t* request);
+    
+    // Aborts a sent request, which is still reported finished. May arrive
+    // from another thread while send is running.
+    void (*cancel)(void* data, network_connection_t* connection, network_request_t* request);
+    
+    // Closes a connection that has nothing in flight. Nothing is reported.
+    void (*close)(void* data, network_connection_t* connection);
+    
+    // A request that will not be sent, as its origin could not be reached
+    void (*fail)(void* data, network_request_t* request, const char* error);
+} network_transport_t;
+
+// Zero fields take the defaults above
+typedef struct {
+    uint32_t max_connections;       // Across all origins, connecting or open
+    uint32_t max_connections_per_origin;
+    uint64_t keep_alive_us;
+    uint64_t session_lifetime_us;
+} network_config_t;
+
+network_manager_t* network_manager_create(const network_config_t* config, const network_transport_t* transport, void* transport_data);
+
+// Closes every connection. Call once all request handles are released.
+void network_manager_destroy(network_manager_t* manager);
+
+// Queues a request to url's origin and returns its handle, or NULL when
+// url is not http(s). user_data is for the transport. The handle stays
+// valid until network_request_release, whatever becomes of the request.
+network_request_t* network_manager_submit(network_manager_t* manager, const char* url, network_priority_t priority, void* user_data);
+
+// A waiting request is dropped without a report; a sent one is
+// cancelled through the transport
+void network_manager_cancel(network_manager_t* manager, network_request_t* request);
+void network_request_release(network_request_t* request);
+
+void* network_request_data(const network_request_t* request);
+network_priority_t network_request_priority(const network_request_t* request);
+network_priority_t network_priority_for_destination(request_destination_t destination);
+
+// Closes connections idle for keep_alive_us and forgets expired TLS
+// sessions. Returns when it next has something to do (frame_scheduler_now's
+// clock), or UINT64_MAX.
+uint64_t network_manager_close_idle(network_manager_t* manager);
+uint32_t network_manager_connection_count(network_manager_t* manager);
+
+// Transport reports. max_streams is the server's concurrent stream limit
+// on HTTP/2, zero for the default, and ignored on HTTP/1.1.
+void network_connection_ready(network_connection_t* connection, network_protocol_t protocol, uint32_t max_streams);
+void network_connection_set_max_streams(network_connection_t* connection, uint32_t max_streams);
+void network_connection_save_session(network_connection_t* connection, const void* session, uint32_t session_length);
+void network_connection_failed(network_connection_t* connection, const char* error);
+
+// The peer closed the connection or, on HTTP/2, sent GOAWAY. Requests
+// already sent on it are still reported.
+void network_connection_closed(network_connection_t* connection);
+
+// keep_alive is false when an HTTP/1.1 connection cannot carry another
+// request (Connection: close, a broken response) and the transport has
+// closed it
+void network_request_finished(network_request_t* request, bool keep_alive);
+
+// The transport's own state for a connection
+void network_connection_set_data(network_connection_t* connection, void* data);
+void* network_connection_data(const network_connection_t* connection);
+
+// The HTTP/1.1, HTTP/2 and TLS transport (network/http.c)
+const network_transport_t* http_network_transport(void);
+
+#endif
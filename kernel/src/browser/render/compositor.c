@@ -0,0 +1,382 @@
+#include "engine.h"
+#include "../capacity.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Gap between atlas slots so filtering never samples a neighbour
+#define COMPOSITOR_ATLAS_PADDING 1
+#define COMPOSITOR_BATCH_SIZE 256
+
+typedef struct {
+    uint32_t y;
+    uint32_t height;
+    uint32_t x;                     // Next free column
+} atlas_shelf_t;
+
+// Shelf-packed texture shared by small backing stores. Slots are not
+// reused individually; the atlas is repacked from empty once its last
+// slot is released.
+typedef struct {
+    uint32_t texture;
+    atlas_shelf_t* shelves;
+    uint32_t shelf_count;
+    uint32_t shelf_capacity;
+    uint32_t next_y;
+    uint32_t live;
+} compositor_atlas_t;
+
+typedef struct {
+    bool used;
+    uint32_t surface;               // Tiled raster surface holding the pixels
+    uint32_t texture;
+    uint32_t atlas;                 // Atlas index + 1, 0 for a dedicated texture
+    uint32_t x, y;                  // Slot position in the texture
+    uint32_t width, height;
+    uint32_t texture_width, texture_height;
+} compositor_backing_t;
+
+// Compositor state. Like the hooks it serves, it is only used from the
+// thread driving the frame.
+static const render_pipeline_t* gpu_pipeline;
+static uint32_t program;
+static compositor_atlas_t* atlases;
+static uint32_t atlas_count;
+static compositor_backing_t* backings;
+static uint32_t backing_capacity;
+
+// Quad corners are transformed on the CPU when the backend builds the
+// batch's vertex buffer, so the shaders only project and sample
+static const char* vertex_shader =
+    "uniform mat4 u_projection;\n"
+    "attribute vec2 a_position;\n"
+    "attribute vec2 a_uv;\n"
+    "attribute float a_opacity;\n"
+    "varying vec2 v_uv;\n"
+    "varying float v_opacity;\n"
+    "void main() {\n"
+    "    v_uv = a_uv;\n"
+    "    v_opacity = a_opacity;\n"
+    "    gl_Position = u_projection * vec4(a_position, 0.0, 1.0);\n"
+    "}\n";
+
+// Premultiplied source, so opacity scales all four channels
+static const char* fragment_shader =
+    "precision mediump float;\n"
+    "uniform sampler2D u_texture;\n"
+    "varying vec2 v_uv;\n"
+    "varying float v_opacity;\n"
+    "void main() {\n"
+    "    gl_FragColor = texture2D(u_texture, v_uv) * v_opacity;\n"
+    "}\n";
+
+// Atlases
+
+static bool atlas_alloc(compositor_atlas_t* atlas, uint32_t width, uint32_t height, uint32_t* x, uint32_t* y) {
+    width += COMPOSITOR_ATLAS_PADDING;
+    height += COMPOSITOR_ATLAS_PADDING;
+    
+    // Shortest shelf the slot fits on
+    int32_t best = -1;
+    for (uint32_t i = 0; i < atlas->shelf_count; i++) {
+        atlas_shelf_t* shelf = &atlas->shelves[i];
+        if (shelf->height < height || shelf->x + width > COMPOSITOR_ATLAS_SIZE) continue;
+        if (best < 0 || shelf->height < atlas->shelves[best].height) best = (int32_t)i;
+    }
+    
+    // A shelf more than twice the slot's height wastes most of its row;
+    // open a new one while there is room
+    if ((best < 0 || atlas->shelves[best].height > height * 2) && atlas->next_y + height <= COMPOSITOR_ATLAS_SIZE) {
+        if (atlas->shelf_count >= atlas->shelf_capacity) {
+            uint32_t capacity = capacity_grow(atlas->shelf_capacity, 8, sizeof(atlas_shelf_t));
+            atlas_shelf_t* shelves = capacity ? realloc(atlas->shelves, capacity * sizeof(atlas_shelf_t)) : NULL;
+            if (!shelves) return false;
+            atlas->shelves = shelves;
+            atlas->shelf_capacity = capacity;
+        }
+        atlas_shelf_t* shelf = &atlas->shelves[atlas->shelf_count];
+        shelf->y = atlas->next_y;
+        shelf->height = height;
+        shelf->x = 0;
+        atlas->next_y += height;
+        best = (int32_t)atlas->shelf_count++;
+    }
+    if (best < 0) return false;
+    
+    atlas_shelf_t* shelf = &atlas->shelves[best];
+    *x = shelf->x;
+    *y = shelf->y;
+    shelf->x += width;
+    atlas->live++;
+    return true;
+}
+
+static void atlas_release(compositor_atlas_t* atlas) {
+    if (atlas->live && --atlas->live == 0) {
+        atlas->shelf_count = 0;
+        atlas->next_y = 0;
+    }
+}
+
+// Finds or creates an atlas with room; returns its index + 1, or 0
+static uint32_t atlas_place(uint32_t width, uint32_t height, uint32_t* x, uint32_t* y) {
+    for (uint32_t i = 0; i < atlas_count; i++) {
+        if (atlas_alloc(&atlases[i], width, height, x, y)) return i + 1;
+    }
+    
+    uint32_t texture = gpu_pipeline->acceleration.gpu.create_texture(COMPOSITOR_ATLAS_SIZE, COMPOSITOR_ATLAS_SIZE);
+    if (!texture) return 0;
+    
+    compositor_atlas_t* grown = realloc(atlases, (atlas_count + 1) * sizeof(compositor_atlas_t));
+    if (!grown) {
+        if (gpu_pipeline->acceleration.gpu.delete_texture) gpu_pipeline->acceleration.gpu.delete_texture(texture);
+        return 0;
+    }
+    atlases = grown;
+    compositor_atlas_t* atlas = &atlases[atlas_count++];
+    memset(atlas, 0, sizeof(*atlas));
+    atlas->texture = texture;
+    return atlas_alloc(atlas, width, height, x, y) ? atlas_count : 0;
+}
+
+// Backing stores
+
+static compositor_backing_t* backing_lookup(uint32_t id) {
+    if (!id || id > backing_capacity || !backings[id - 1].used) return NULL;
+    return &backings[id - 1];
+}
+
+static uint32_t gpu_create_backing_store(uint32_t width, uint32_t height) {
+    if (!width || !height) return 0;
+    
+    uint32_t slot = 0;
+    while (slot < backing_capacity && backings[slot].used) slot++;
+    if (slot == backing_capacity) {
+        uint32_t capacity = capacity_grow(backing_capacity, 16, sizeof(compositor_backing_t));
+        compositor_backing_t* grown = capacity ? realloc(backings, capacity * sizeof(compositor_backing_t)) : NULL;
+        if (!grown) return 0;
+        memset(grown + backing_capacity, 0, (capacity - backing_capacity) * sizeof(compositor_backing_t));
+        backings = grown;
+        backing_capacity = capacity;
+    }
+    
+    compositor_backing_t* backing = &backings[slot];
+    backing->surface = raster_surface_create(width, height);
+    if (!backing->surface) return 0;
+    backing->width = width;
+    backing->height = height;
+    
+    if (width <= COMPOSITOR_ATLAS_MAX_SLOT && height <= COMPOSITOR_ATLAS_MAX_SLOT) {
+        backing->atlas = atlas_place(width, height, &backing->x, &backing->y);
+        if (backing->atlas) {
+            backing->texture = atlases[backing->atlas - 1].texture;
+            backing->texture_width = COMPOSITOR_ATLAS_SIZE;
+            backing->texture_height = COMPOSITOR_ATLAS_SIZE;
+        }
+    }
+    if (!backing->atlas) {
+        backing->x = 0;
+        backing->y = 0;
+        backing->texture = gpu_pipeline->acceleration.gpu.create_texture(width, height);
+        backing->texture_width = width;
+        backing->texture_height = height;
+    }
+    if (!backing->texture) {
+        raster_surface_destroy(backing->surface);
+        memset(backing, 0, sizeof(*backing));
+        return 0;
+    }
+    
+    backing->used = true;
+    return slot + 1;
+}
+
+static void gpu_destroy_backing_store(uint32_t id) {
+    compositor_backing_t* backing = backing_lookup(id);
+    if (!backing) return;
+    
+    raster_surface_destroy(backing->surface);
+    if (backing->atlas) {
+        atlas_release(&atlases[backing->atlas - 1]);
+    } else if (gpu_pipeline->acceleration.gpu.delete_texture) {
+        gpu_pipeline->acceleration.gpu.delete_texture(backing->texture);
+    }
+    memset(backing, 0, sizeof(*backing));
+}
+
+// Rasterizes the damage on the CPU, then uploads just the damaged part of
+// each touched tile into the layer's area of its texture
+static void gpu_repaint(paint_layer_t* layer, rect_t* dirty_rect) {
+    compositor_backing_t* backing = backing_lookup(layer->compositing.texture_id);
+    if (!backing || !layer->display_list) return;
+    
+    float origin_x = floorf(layer->bounds.x);
+    float origin_y = floorf(layer->bounds.y);
+    raster_surface_repaint(backing->surface, layer->display_list, origin_x, origin_y, dirty_rect);
+    
+    int32_t x0 = 0, y0 = 0;
+    int32_t x1 = (int32_t)backing->width, y1 = (int32_t)backing->height;
+    if (dirty_rect) {
+        int32_t dx0 = (int32_t)floorf(dirty_rect->x - origin_x);
+        int32_t dy0 = (int32_t)floorf(dirty_rect->y - origin_y);
+        int32_t dx1 = (int32_t)ceilf(dirty_rect->x + dirty_rect->width - origin_x);
+        int32_t dy1 = (int32_t)ceilf(dirty_rect->y + dirty_rect->height - origin_y);
+        if (dx0 > x0) x0 = dx0;
+        if (dy0 > y0) y0 = dy0;
+        if (dx1 < x1) x1 = dx1;
+        if (dy1 < y1) y1 = dy1;
+    }
+    if (x1 <= x0 || y1 <= y0) return;
+    
+    for (uint32_t ty = (uint32_t)y0 / RASTER_TILE_SIZE; ty <= (uint32_t)(y1 - 1) / RASTER_TILE_SIZE; ty++) {
+        for (uint32_t tx = (uint32_t)x0 / RASTER_TILE_SIZE; tx <= (uint32_t)(x1 - 1) / RASTER_TILE_SIZE; tx++) {
+            const uint32_t* pixels = raster_surface_tile(backing->surface, tx, ty);
+            if (!pixels) continue;
+            
+            int32_t tile_x = (int32_t)(tx * RASTER_TILE_SIZE);
+            int32_t tile_y = (int32_t)(ty * RASTER_TILE_SIZE);
+            int32_t ux0 = x0 > tile_x ? x0 : tile_x;
+            int32_t uy0 = y0 > tile_y ? y0 : tile_y;
+            int32_t ux1 = x1 < tile_x + RASTER_TILE_SIZE ? x1 : tile_x + RASTER_TILE_SIZE;
+            int32_t uy1 = y1 < tile_y + RASTER_TILE_SIZE ? y1 : tile_y + RASTER_TILE_SIZE;
+            
+            gpu_pipeline->acceleration.gpu.update_texture(
+                backing->texture,
+                backing->x + (uint32_t)ux0, backing->y + (uint32_t)uy0,
+                (uint32_t)(ux1 - ux0), (uint32_t)(uy1 - uy0),
+                pixels + (uy0 - tile_y) * RASTER_TILE_SIZE + (ux0 - tile_x),
+                RASTER_TILE_SIZE);
+        }
+    }
+}
+
+// Compositing
+
+static void flush_batch(const compositor_quad_t* quads, uint32_t* count, uint32_t texture, uint32_t blend_mode) {
+    if (!*count) return;
+    gpu_pipeline->acceleration.gpu.draw_quads(program, texture, blend_mode, quads, *count);
+    *count = 0;
+}
+
+// Draws layers in the given (paint) order. Layers packed into the same
+// atlas are usually adjacent in paint order, so most pages draw in a few
+// calls.
+static void gpu_composite(paint_layer_t** layers, uint32_t layer_count) {
+    compositor_quad_t batch[COMPOSITOR_BATCH_SIZE];
+    uint32_t batch_count = 0;
+    uint32_t batch_texture = 0;
+    uint32_t batch_blend = 0;
+    
+    for (uint32_t i = 0; i < layer_count; i++) {
+        const paint_layer_t* layer = layers[i];
+        const compositor_backing_t* backing = backing_lookup(layer->compositing.texture_id);
+        if (!backing || layer->compositing.opacity <= 0.0f) continue;
+        
+        uint32_t blend_mode = (uint32_t)layer->compositing.blend_mode;
+        if (batch_count && (backing->texture != batch_texture || blend_mode != batch_blend || batch_count == COMPOSITOR_BATCH_SIZE)) {
+            flush_batch(batch, &batch_count, batch_texture, batch_blend);
+        }
+        batch_texture = backing->texture;
+        batch_blend = blend_mode;
+        
+        compositor_quad_t* quad = &batch[batch_count++];
+        quad->rect.x = floorf(layer->bounds.x);
+        quad->rect.y = floorf(layer->bounds.y);
+        quad->rect.width = (float)backing->width;
+        quad->rect.height = (float)backing->height;
+        quad->uv.x = (float)backing->x / (float)backing->texture_width;
+        quad->uv.y = (float)backing->y / (float)backing->texture_height;
+        quad->uv.width = (float)backing->width / (float)backing->texture_width;
+        quad->uv.height = (float)backing->height / (float)backing->texture_height;
+        if (layer->has_clip) {
+            quad->clip = layer->clip_rect;
+        } else {
+            memset(&quad->clip, 0, sizeof(quad->clip));
+        }
+        memcpy(quad->transform, layer->compositing.transform, sizeof(quad->transform));
+        quad->opacity = layer->compositing.opacity > 1.0f ? 1.0f : layer->compositing.opacity;
+    }
+    flush_batch(batch, &batch_count, batch_texture, batch_blend);
+}
+
+bool compositor_install_gpu(render_pipeline_t* pipeline) {
+    if (!pipeline || !pipeline->acceleration.enabled) return false;
+    if (!pipeline->acceleration.gpu.create_texture || !pipeline->acceleration.gpu.update_texture ||
+        !pipeline->acceleration.gpu.draw_quads) {
+        return false;
+    }
+    
+    gpu_pipeline = pipeline;
+    if (pipeline->acceleration.gpu.compile_shader) {
+        program = pipeline->acceleration.gpu.compile_shader(vertex_shader, fragment_shader);
+    }
+    
+    pipeline->compositor.create_backing_store = gpu_create_backing_store;
+    pipeline->compositor.destroy_backing_store = gpu_destroy_backing_store;
+    pipeline->compositor.composite = gpu_composite;
+    pipeline->paint.repaint = gpu_repaint;
+    return true;
+}
+
+// Releases what the layers did not: atlases and any leaked backings
+void compositor_shutdown(void) {
+    for (uint32_t i = 0; i < backing_capacity; i++) {
+        if (backings[i].used) gpu_destroy_backing_store(i + 1);
+    }
+    free(backings);
+    backings = NULL;
+    backing_capacity = 0;
+    
+    for (uint32_t i = 0; i < atlas_count; i++) {
+        if (gpu_pipeline && gpu_pipeline->acceleration.gpu.delete_texture) {
+            gpu_pipeline->acceleration.gpu.delete_texture(atlases[i].texture);
+        }
+        free(atlases[i].shelves);
+    }
+    free(atlases);
+    atlases = NULL;
+    atlas_count = 0;
+    
+    gpu_pipeline = NULL;
+    program = 0;
+}
+
+// Animations
+
+static paint_layer_t* owned_layer(layout_box_t* box) {
+    return box->paint_layer && box->paint_layer->box == box ? box->paint_layer : NULL;
+}
+
+void compositor_set_transform(render_tree_t* tree, layout_box_t* box, const float transform[16]) {
+    if (!box || !transform) return;
+    
+    memcpy(box->paint_properties.transform_matrix, transform, sizeof(box->paint_properties.transform_matrix));
+    box->paint_properties.has_transform = true;
+    
+    paint_layer_t* layer = owned_layer(box);
+    if (layer) {
+        memcpy(layer->compositing.transform, transform, sizeof(layer->compositing.transform));
+        if (tree) tree->needs_composite = true;
+        return;
+    }
+    
+    // Painted into an ancestor's layer: repaint there this frame and give
+    // the box a layer of its own for the rest of the animation
+    invalidate_paint(tree, box, NULL);
+    if (tree) tree->needs_layer_update = true;
+}
+
+void compositor_set_opacity(render_tree_t* tree, layout_box_t* box, float opacity) {
+    if (!box) return;
+    box->paint_properties.opacity = opacity;
+    
+    paint_layer_t* layer = owned_layer(box);
+    if (layer) {
+        layer->compositing.opacity = opacity;
+        if (tree) tree->needs_composite = true;
+        return;
+    }
+    
+    invalidate_paint(tree, box, NULL);
+    if (tree) tree->needs_layer_update = true;
+}
@@ -0,0 +1,683 @@
+#include "engine.h"
+#include "../css/style.h"
+#include "../capacity.h"
+#include <math.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+typedef enum {
+    ANIMATE_OPACITY,
+    ANIMATE_TRANSLATE_X,
+    ANIMATE_TRANSLATE_Y,
+    ANIMATE_SCALE,
+    ANIMATE_ROTATE,
+    ANIMATE_PROPERTY_COUNT
+} animate_property_t;
+
+static const char* animate_property_names[ANIMATE_PROPERTY_COUNT] = {
+    "opacity", "translate-x", "translate-y", "scale", "rotate"
+};
+
+typedef struct {
+    uint32_t scroll_id;
+    int32_t parent;                 // Enclosing scroll node, -1 for none
+    rect_t clip;                    // Scroll viewport, unscrolled
+    float max_x, max_y;
+    float x, y;
+    
+    // Smooth scroll in progress
+    bool animating;
+    float from_x, from_y;
+    float to_x, to_y;
+    uint32_t duration;
+    uint32_t elapsed;
+} scroll_node_t;
+
+typedef struct {
+    const void* key;                // Owning box; compared, never dereferenced
+    int32_t scroller;               // -1 when fixed or outside any scroller
+    paint_layer_t layer;            // Bounds, clip and compositing; no tree links
+} frame_layer_t;
+
+// A committed frame. The draw arrays are scratch space allocated with it so
+// the thread does not allocate per vsync.
+typedef struct {
+    frame_layer_t* layers;
+    uint32_t layer_count;
+    scroll_node_t* scrollers;
+    uint32_t scroller_count;
+    paint_layer_t* draw_layers;
+    paint_layer_t** draw_list;
+} compositor_frame_t;
+
+typedef struct {
+    animation_t animation;          // property is not retained
+    animate_property_t property;
+    const void* key;
+    int32_t layer;                  // Index in the active frame, -1 if absent
+    float value;
+    bool finished;
+} compositor_animation_t;
+
+typedef struct {
+    enum { INPUT_SCROLL, INPUT_ANIMATE } type;
+    uint32_t scroll_id;
+    float x, y;
+    bool relative;
+    uint32_t duration;
+    compositor_animation_t animation;
+} compositor_input_t;
+
+typedef struct {
+    uint32_t scroll_id;
+    float x, y;
+} scroll_offset_t;
+
+struct compositor_thread {
+    render_pipeline_t* pipeline;
+    uint32_t interval_us;
+    pthread_t thread;
+    bool stop;
+    
+    // Held while drawing, and by the main thread while it paints and
+    // commits. pending is the handoff slot, exchanged atomically.
+    pthread_mutex_t draw_lock;
+    compositor_frame_t* pending;
+    
+    // Thread only
+    compositor_frame_t* active;
+    compositor_animation_t* animations;
+    uint32_t animation_count;
+    uint32_t animation_capacity;
+    
+    // Queued input and the offsets published back to the main thread.
+    // Inputs are applied and offsets published under the same lock, so a
+    // sync never sees an input as consumed but not yet reflected.
+    pthread_mutex_t input_lock;
+    compositor_input_t* inputs;
+    uint32_t input_count;
+    uint32_t input_capacity;
+    scroll_offset_t* offsets;
+    uint32_t offset_count;
+    uint32_t offset_capacity;
+};
+
+static float clamp_range(float value, float max) {
+    if (value < 0.0f) return 0.0f;
+    return value > max ? max : value;
+}
+
+// Frames
+
+static void free_frame(compositor_frame_t* frame) {
+    if (!frame) return;
+    free(frame->layers);
+    free(frame->scrollers);
+    free(frame->draw_layers);
+    free(frame->draw_list);
+    free(frame);
+}
+
+// Nearest scroller whose box is box or one of its ancestors
+static int32_t find_scroller(const render_tree_t* tree, const layout_box_t* box, int32_t viewport) {
+    for (; box; box = box->parent) {
+        for (uint32_t i = 0; i < tree->scroller_count; i++) {
+            if (tree->scrollers[i]->scrollable_box == box) return (int32_t)i;
+        }
+    }
+    return viewport;
+}
+
+static compositor_frame_t* build_frame(compositor_thread_t* thread, render_tree_t* tree) {
+    compositor_frame_t* frame = calloc(1, sizeof(compositor_frame_t));
+    if (!frame || !tree) return frame;
+    
+    uint32_t layer_count = 0;
+    paint_layer_t** layers = tree->layer_tree ? collect_layers_in_paint_order(tree->layer_tree, &layer_count) : NULL;
+    if (tree->layer_tree && !layers) layer_count = 0;
+    
+    frame->layers = layer_count ? calloc(layer_count, sizeof(frame_layer_t)) : NULL;
+    frame->draw_layers = layer_count ? calloc(layer_count, sizeof(paint_layer_t)) : NULL;
+    frame->draw_list = layer_count ? calloc(layer_count, sizeof(paint_layer_t*)) : NULL;
+    frame->scrollers = tree->scroller_count ? calloc(tree->scroller_count, sizeof(scroll_node_t)) : NULL;
+    if ((layer_count && (!frame->layers || !frame->draw_layers || !frame->draw_list)) ||
+        (tree->scroller_count && !frame->scrollers)) {
+        free(layers);
+        free_frame(frame);
+        return NULL;
+    }
+    
+    // Scroll nodes, indexed like tree->scrollers
+    int32_t viewport = -1;
+    for (uint32_t i = 0; i < tree->scroller_count; i++) {
+        if (!tree->scrollers[i]->scrollable_box) {
+            viewport = (int32_t)i;
+            break;
+        }
+    }
+    for (uint32_t i = 0; i < tree->scroller_count; i++) {
+        scroll_state_t* state = tree->scrollers[i];
+        scroll_node_t* node = &frame->scrollers[i];
+        
+        node->scroll_id = state->scroll_id;
+        if (state->scrollable_box) {
+            node->parent = find_scroller(tree, state->scrollable_box->parent, viewport);
+            node->clip = state->scrollable_box->padding_rect;
+        } else {
+            node->parent = -1;
+            node->clip.width = tree->viewport_width;
+            node->clip.height = tree->viewport_height;
+        }
+        node->max_x = state->scroll_width - state->viewport_width;
+        node->max_y = state->scroll_height - state->viewport_height;
+        if (node->max_x < 0.0f) node->max_x = 0.0f;
+        if (node->max_y < 0.0f) node->max_y = 0.0f;
+        node->x = clamp_range(state->scroll_x, node->max_x);
+        node->y = clamp_range(state->scroll_y, node->max_y);
+        state->compositor = thread;
+    }
+    frame->scroller_count = tree->scroller_count;
+    
+    for (uint32_t i = 0; i < layer_count; i++) {
+        const paint_layer_t* layer = layers[i];
+        frame_layer_t* copy = &frame->layers[i];
+        
+        copy->key = layer->box;
+        copy->layer = *layer;
+        copy->layer.box = NULL;
+        copy->layer.parent = NULL;
+        copy->layer.children = NULL;
+        copy->layer.child_count = 0;
+        copy->layer.display_list = NULL;
+        
+        const layout_box_t* box = layer->box;
+        bool fixed = box && box->style && box->style->position == POSITION_FIXED;
+        copy->scroller = fixed ? -1 : find_scroller(tree, box, viewport);
+    }
+    frame->layer_count = layer_count;
+    free(layers);
+    return frame;
+}
+
+static scroll_node_t* find_node(compositor_frame_t* frame, uint32_t scroll_id) {
+    if (!frame) return NULL;
+    for (uint32_t i = 0; i < frame->scroller_count; i++) {
+        if (frame->scrollers[i].scroll_id == scroll_id) return &frame->scrollers[i];
+    }
+    return NULL;
+}
+
+static int32_t find_layer(const compositor_frame_t* frame, const void* key) {
+    if (!frame || !key) return -1;
+    for (uint32_t i = 0; i < frame->layer_count; i++) {
+        if (frame->layers[i].key == key) return (int32_t)i;
+    }
+    return -1;
+}
+
+// Once committed, offsets belong to the thread: carry them (and smooth
+// scrolls in flight) over from the previous frame
+static void adopt_frame(compositor_thread_t* thread, compositor_frame_t* frame) {
+    compositor_frame_t* old = thread->active;
+    
+    for (uint32_t i = 0; i < frame->scroller_count; i++) {
+        scroll_node_t* node = &frame->scrollers[i];
+        const scroll_node_t* previous = find_node(old, node->scroll_id);
+        if (!previous) continue;
+        
+        node->x = clamp_range(previous->x, node->max_x);
+        node->y = clamp_range(previous->y, node->max_y);
+        node->animating = previous->animating;
+        node->from_x = previous->from_x;
+        node->from_y = previous->from_y;
+        node->to_x = clamp_range(previous->to_x, node->max_x);
+        node->to_y = clamp_range(previous->to_y, node->max_y);
+        node->duration = previous->duration;
+        node->elapsed = previous->elapsed;
+    }
+    free_frame(old);
+    thread->active = frame;
+    
+    // The main thread has seen finished animations by now
+    uint32_t kept = 0;
+    for (uint32_t i = 0; i < thread->animation_count; i++) {
+        compositor_animation_t* animation = &thread->animations[i];
+        if (animation->finished) continue;
+        animation->layer = find_layer(frame, animation->key);
+        thread->animations[kept++] = *animation;
+    }
+    thread->animation_count = kept;
+}
+
+// Input and animation
+
+static void add_animation(compositor_thread_t* thread, const compositor_animation_t* animation) {
+    for (uint32_t i = 0; i < thread->animation_count; i++) {
+        compositor_animation_t* existing = &thread->animations[i];
+        if (existing->key == animation->key && existing->property == animation->property) {
+            *existing = *animation;
+            existing->layer = find_layer(thread->active, animation->key);
+            return;
+        }
+    }
+    
+    if (thread->animation_count >= thread->animation_capacity) {
+        uint32_t capacity = capacity_grow(thread->animation_capacity, 16, sizeof(compositor_animation_t));
+        compositor_animation_t* grown = capacity ? realloc(thread->animations, capacity * sizeof(compositor_animation_t)) : NULL;
+        if (!grown) return;
+        thread->animations = grown;
+        thread->animation_capacity = capacity;
+    }
+    compositor_animation_t* added = &thread->animations[thread->animation_count++];
+    *added = *animation;
+    added->layer = find_layer(thread->active, animation->key);
+}
+
+static bool apply_inputs(compositor_thread_t* thread) {
+    bool dirty = thread->input_count > 0;
+    
+    for (uint32_t i = 0; i < thread->input_count; i++) {
+        const compositor_input_t* input = &thread->inputs[i];
+        if (input->type == INPUT_ANIMATE) {
+            add_animation(thread, &input->animation);
+            continue;
+        }
+        
+        // Scrollers not committed yet start from the offset they commit with
+        scroll_node_t* node = find_node(thread->active, input->scroll_id);
+        if (!node) continue;
+        
+        float x = input->relative ? (node->animating ? node->to_x : node->x) + input->x : input->x;
+        float y = input->relative ? (node->animating ? node->to_y : node->y) + input->y : input->y;
+        x = clamp_range(x, node->max_x);
+        y = clamp_range(y, node->max_y);
+        
+        if (input->duration) {
+            node->animating = true;
+            node->from_x = node->x;
+            node->from_y = node->y;
+            node->to_x = x;
+            node->to_y = y;
+            node->duration = input->duration;
+            node->elapsed = 0;
+        } else if (node->animating && input->relative) {
+            // A wheel delta during a smooth scroll retargets it
+            node->to_x = x;
+            node->to_y = y;
+        } else {
+            node->animating = false;
+            node->x = x;
+            node->y = y;
+        }
+    }
+    thread->input_count = 0;
+    return dirty;
+}
+
+static float ease_in_out(float t) {
+    if (t < 0.5f) return 4.0f * t * t * t;
+    float u = -2.0f * t + 2.0f;
+    return 1.0f - u * u * u / 2.0f;
+}
+
+static bool advance(compositor_thread_t* thread, uint32_t delta_ms) {
+    bool dirty = false;
+    
+    compositor_frame_t* frame = thread->active;
+    for (uint32_t i = 0; frame && i < frame->scroller_count; i++) {
+        scroll_node_t* node = &frame->scrollers[i];
+        if (!node->animating) continue;
+        
+        node->elapsed += delta_ms;
+        float t = node->elapsed >= node->duration ? 1.0f : (float)node->elapsed / (float)node->duration;
+        float p = ease_in_out(t);
+        node->x = node->from_x + (node->to_x - node->from_x) * p;
+        node->y = node->from_y + (node->to_y - node->from_y) * p;
+        if (t >= 1.0f) node->animating = false;
+        dirty = true;
+    }
+    
+    for (uint32_t i = 0; i < thread->animation_count; i++) {
+        compositor_animation_t* animation = &thread->animations[i];
+        if (animation->finished) continue;
+        
+        animation_t* timing = &animation->animation;
+        timing->elapsed += delta_ms;
+        float t = timing->elapsed >= timing->duration ? 1.0f : (float)timing->elapsed / (float)timing->duration;
+        animation->value = timing->from + (timing->to - timing->from) * evaluate_easing(timing, t);
+        if (t >= 1.0f) {
+            animation->finished = true;
+            animation->value = timing->to;
+        }
+        dirty = true;
+    }
+    return dirty;
+}
+
+static void publish_offsets(compositor_thread_t* thread) {
+    compositor_frame_t* frame = thread->active;
+    uint32_t count = frame ? frame->scroller_count : 0;
+    
+    if (count > thread->offset_capacity) {
+        scroll_offset_t* grown = realloc(thread->offsets, count * sizeof(scroll_offset_t));
+        if (!grown) return;
+        thread->offsets = grown;
+        thread->offset_capacity = count;
+    }
+    for (uint32_t i = 0; i < count; i++) {
+        thread->offsets[i].scroll_id = frame->scrollers[i].scroll_id;
+        thread->offsets[i].x = frame->scrollers[i].x;
+        thread->offsets[i].y = frame->scrollers[i].y;
+    }
+    thread->offset_count = count;
+}
+
+// Drawing
+
+static void matrix_multiply(float out[16], const float a[16], const float b[16]) {
+    float result[16];
+    for (int column = 0; column < 4; column++) {
+        for (int row = 0; row < 4; row++) {
+            float sum = 0.0f;
+            for (int k = 0; k < 4; k++) sum += a[k * 4 + row] * b[column * 4 + k];
+            result[column * 4 + row] = sum;
+        }
+    }
+    memcpy(out, result, sizeof(result));
+}
+
+// Scale and rotate about the layer's centre, after its own transform
+static void apply_animation(paint_layer_t* layer, const compositor_animation_t* animation) {
+    float cx = layer->bounds.x + layer->bounds.width * 0.5f;
+    float cy = layer->bounds.y + layer->bounds.height * 0.5f;
+    float m[16] = { 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1 };
+    
+    switch (animation->property) {
+        case ANIMATE_OPACITY:
+            layer->compositing.opacity = animation->value;
+            return;
+        case ANIMATE_TRANSLATE_X:
+            layer->bounds.x += animation->value;
+            if (layer->has_clip) layer->clip_rect.x += animation->value;
+            return;
+        case ANIMATE_TRANSLATE_Y:
+            layer->bounds.y += animation->value;
+            if (layer->has_clip) layer->clip_rect.y += animation->value;
+            return;
+        case ANIMATE_SCALE:
+            m[0] = animation->value;
+            m[5] = animation->value;
+            m[12] = cx - cx * animation->value;
+            m[13] = cy - cy * animation->value;
+            break;
+        case ANIMATE_ROTATE: {
+            float c = cosf(animation->value);
+            float s = sinf(animation->value);
+            m[0] = c;
+            m[1] = s;
+            m[4] = -s;
+            m[5] = c;
+            m[12] = cx - c * cx + s * cy;
+            m[13] = cy - s * cx - c * cy;
+            break;
+        }
+        default:
+            return;
+    }
+    matrix_multiply(layer->compositing.transform, m, layer->compositing.transform);
+}
+
+static void scroll_offset(const compositor_frame_t* frame, int32_t node, float* x, float* y) {
+    *x = 0.0f;
+    *y = 0.0f;
+    for (; node >= 0; node = frame->scrollers[node].parent) {
+        *x += frame->scrollers[node].x;
+        *y += frame->scrollers[node].y;
+    }
+}
+
+static rect_t intersect(const rect_t* a, const rect_t* b) {
+    rect_t result = { 0, 0, 0, 0 };
+    float x1 = a->x > b->x ? a->x : b->x;
+    float y1 = a->y > b->y ? a->y : b->y;
+    float x2 = a->x + a->width < b->x + b->width ? a->x + a->width : b->x + b->width;
+    float y2 = a->y + a->height < b->y + b->height ? a->y + a->height : b->y + b->height;
+    if (x2 > x1 && y2 > y1) {
+        result.x = x1;
+        result.y = y1;
+        result.width = x2 - x1;
+        result.height = y2 - y1;
+    }
+    return result;
+}
+
+static void draw_frame(compositor_thread_t* thread) {
+    compositor_frame_t* frame = thread->active;
+    
+    for (uint32_t i = 0; i < frame->layer_count; i++) {
+        paint_layer_t* layer = &frame->draw_layers[i];
+        int32_t node = frame->layers[i].scroller;
+        *layer = frame->layers[i].layer;
+        frame->draw_list[i] = layer;
+        if (node < 0) continue;
+        
+        float sx, sy;
+        scroll_offset(frame, node, &sx, &sy);
+        layer->bounds.x -= sx;
+        layer->bounds.y -= sy;
+        if (layer->has_clip) {
+            layer->clip_rect.x -= sx;
+            layer->clip_rect.y -= sy;
+        }
+        
+        // Clip to the scroll viewport, itself moved by enclosing scrollers
+        float px, py;
+        scroll_offset(frame, frame->scrollers[node].parent, &px, &py);
+        rect_t viewport = frame->scrollers[node].clip;
+        viewport.x -= px;
+        viewport.y -= py;
+        layer->clip_rect = layer->has_clip ? intersect(&layer->clip_rect, &viewport) : viewport;
+        layer->has_clip = true;
+    }
+    
+    for (uint32_t i = 0; i < thread->animation_count; i++) {
+        const compositor_animation_t* animation = &thread->animations[i];
+        if (animation->layer >= 0) apply_animation(&frame->draw_layers[animation->layer], animation);
+    }
+    
+    render_pipeline_t* pipeline = thread->pipeline;
+    if (pipeline->compositor.composite) {
+        pipeline->compositor.composite(frame->draw_list, frame->layer_count);
+    } else if (pipeline->raster.context) {
+        raster_composite_layers(pipeline->raster.context, frame->draw_list, frame->layer_count);
+    }
+    if (pipeline->raster.context && pipeline->raster.present) {
+        pipeline->raster.present(pipeline->raster.context);
+    }
+}
+
+// Thread
+
+static void compositor_tick(compositor_thread_t* thread, uint32_t delta_ms) {
+    pthread_mutex_lock(&thread->draw_lock);
+    pthread_mutex_lock(&thread->input_lock);
+    
+    bool dirty = false;
+    compositor_frame_t* frame = __atomic_exchange_n(&thread->pending, NULL, __ATOMIC_ACQ_REL);
+    if (frame) {
+        adopt_frame(thread, frame);
+        dirty = true;
+    }
+    dirty |= apply_inputs(thread);
+    dirty |= advance(thread, delta_ms);
+    publish_offsets(thread);
+    
+    pthread_mutex_unlock(&thread->input_lock);
+    
+    if (dirty && thread->active) draw_frame(thread);
+    pthread_mutex_unlock(&thread->draw_lock);
+}
+
+static uint64_t timespec_us(const struct timespec* time) {
+    return (uint64_t)time->tv_sec * 1000000 + (uint64_t)time->tv_nsec / 1000;
+}
+
+// Ticks on absolute deadlines so the interval does not drift; missed
+// vsyncs are skipped rather than drawn back to back
+static void* compositor_main(void* data) {
+    compositor_thread_t* thread = data;
+    
+    struct timespec deadline;
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    uint64_t last = timespec_us(&deadline);
+    
+    while (!__atomic_load_n(&thread->stop, __ATOMIC_ACQUIRE)) {
+        deadline.tv_nsec += (long)thread->interval_us * 1000;
+        while (deadline.tv_nsec >= 1000000000L) {
+            deadline.tv_nsec -= 1000000000L;
+            deadline.tv_sec++;
+        }
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL);
+        
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        uint64_t now_us = timespec_us(&now);
+        if (now_us > timespec_us(&deadline) + thread->interval_us) deadline = now;
+        
+        uint32_t delta_ms = (uint32_t)((now_us - last) / 1000);
+        last += (uint64_t)delta_ms * 1000;
+        compositor_tick(thread, delta_ms);
+    }
+    return NULL;
+}
+
+compositor_thread_t* compositor_thread_create(render_pipeline_t* pipeline, uint32_t interval_us) {
+    if (!pipeline || !interval_us) return NULL;
+    
+    compositor_thread_t* thread = calloc(1, sizeof(compositor_thread_t));
+    if (!thread) return NULL;
+    thread->pipeline = pipeline;
+    thread->interval_us = interval_us;
+    pthread_mutex_init(&thread->draw_lock, NULL);
+    pthread_mutex_init(&thread->input_lock, NULL);
+    
+    if (pthread_create(&thread->thread, NULL, compositor_main, thread) != 0) {
+        pthread_mutex_destroy(&thread->draw_lock);
+        pthread_mutex_destroy(&thread->input_lock);
+        free(thread);
+        return NULL;
+    }
+    return thread;
+}
+
+void compositor_thread_destroy(compositor_thread_t* thread) {
+    if (!thread) return;
+    
+    __atomic_store_n(&thread->stop, true, __ATOMIC_RELEASE);
+    pthread_join(thread->thread, NULL);
+    
+    free_frame(thread->pending);
+    free_frame(thread->active);
+    free(thread->animations);
+    free(thread->inputs);
+    free(thread->offsets);
+    pthread_mutex_destroy(&thread->draw_lock);
+    pthread_mutex_destroy(&thread->input_lock);
+    free(thread);
+}
+
+void compositor_thread_lock(compositor_thread_t* thread) {
+    if (thread) pthread_mutex_lock(&thread->draw_lock);
+}
+
+void compositor_thread_unlock(compositor_thread_t* thread) {
+    if (thread) pthread_mutex_unlock(&thread->draw_lock);
+}
+
+void compositor_thread_commit(compositor_thread_t* thread, render_tree_t* tree) {
+    if (!thread) return;
+    
+    compositor_frame_t* frame = build_frame(thread, tree);
+    if (!frame) return;
+    free_frame(__atomic_exchange_n(&thread->pending, frame, __ATOMIC_ACQ_REL));
+}
+
+static void post_input(compositor_thread_t* thread, const compositor_input_t* input) {
+    pthread_mutex_lock(&thread->input_lock);
+    if (thread->input_count >= thread->input_capacity) {
+        uint32_t capacity = capacity_grow(thread->input_capacity, 32, sizeof(compositor_input_t));
+        compositor_input_t* grown = capacity ? realloc(thread->inputs, capacity * sizeof(compositor_input_t)) : NULL;
+        if (!grown) {
+            pthread_mutex_unlock(&thread->input_lock);
+            return;
+        }
+        thread->inputs = grown;
+        thread->input_capacity = capacity;
+    }
+    thread->inputs[thread->input_count++] = *input;
+    pthread_mutex_unlock(&thread->input_lock);
+}
+
+void compositor_thread_scroll(compositor_thread_t* thread, uint32_t scroll_id, float x, float y, bool relative, uint32_t duration) {
+    if (!thread || !scroll_id) return;
+    
+    compositor_input_t input;
+    memset(&input, 0, sizeof(input));
+    input.type = INPUT_SCROLL;
+    input.scroll_id = scroll_id;
+    input.x = x;
+    input.y = y;
+    input.relative = relative;
+    input.duration = duration;
+    post_input(thread, &input);
+}
+
+bool compositor_thread_animate(compositor_thread_t* thread, const animation_t* animation) {
+    if (!thread || !animation || !animation->target || !animation->property) return false;
+    
+    int property = 0;
+    while (property < ANIMATE_PROPERTY_COUNT && strcmp(animation->property, animate_property_names[property]) != 0) {
+        property++;
+    }
+    if (property == ANIMATE_PROPERTY_COUNT) return false;
+    
+    compositor_input_t input;
+    memset(&input, 0, sizeof(input));
+    input.type = INPUT_ANIMATE;
+    input.animation.animation = *animation;
+    input.animation.animation.property = NULL;
+    input.animation.animation.target = NULL;
+    input.animation.property = (animate_property_t)property;
+    input.animation.key = animation->target;
+    input.animation.layer = -1;
+    input.animation.value = animation->from;
+    post_input(thread, &input);
+    return true;
+}
+
+// Corrects the main thread's view of each scroller. Scrollers with input
+// still queued keep their estimate, which already includes it.
+void compositor_thread_sync_scroll(compositor_thread_t* thread, render_tree_t* tree) {
+    if (!thread || !tree) return;
+    
+    pthread_mutex_lock(&thread->input_lock);
+    for (uint32_t i = 0; i < tree->scroller_count; i++) {
+        scroll_state_t* state = tree->scrollers[i];
+        
+        bool queued = false;
+        for (uint32_t j = 0; j < thread->input_count && !queued; j++) {
+            queued = thread->inputs[j].type == INPUT_SCROLL && thread->inputs[j].scroll_id == state->scroll_id;
+        }
+        if (queued) continue;
+        
+        for (uint32_t j = 0; j < thread->offset_count; j++) {
+            if (thread->offsets[j].scroll_id != state->scroll_id) continue;
+            state->scroll_x = thread->offsets[j].x;
+            state->scroll_y = thread->offsets[j].y;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&thread->input_lock);
+}
@@ -0,0 +1,264 @@
+#include "engine.h"
+#include "../capacity.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define DISPLAY_LIST_INITIAL_SIZE 4096
+#define DISPLAY_LIST_INITIAL_STRINGS 1024
+
+// Buffers
+
+static bool grow_buffer(void** buffer, uint32_t* capacity, uint32_t needed, uint32_t initial, size_t element_size) {
+    if (needed <= *capacity) return true;
+    
+    uint32_t new_capacity = capacity_reserve(*capacity, needed, initial, element_size);
+    if (!new_capacity) return false;
+    
+    void* grown = realloc(*buffer, (size_t)new_capacity * element_size);
+    if (!grown) return false;
+    *buffer = grown;
+    *capacity = new_capacity;
+    return true;
+}
+
+// Appends a command of size bytes and returns it for the caller to fill in
+// immediately; the next append may move the buffer. Returns NULL when out
+// of memory, dropping the command.
+static void* emit(display_list_t* list, display_command_type_t type, uint32_t size) {
+    if (!list) return NULL;
+    
+    // Every payload field is 4 bytes wide
+    size = (size + 3) & ~3u;
+    if (!grow_buffer((void**)&list->commands, &list->capacity, list->size + size, DISPLAY_LIST_INITIAL_SIZE, 1)) {
+        return NULL;
+    }
+    
+    display_command_t* command = (display_command_t*)(list->commands + list->size);
+    memset(command, 0, size);
+    command->type = (uint16_t)type;
+    command->size = (uint16_t)size;
+    list->size += size;
+    list->command_count++;
+    return command;
+}
+
+// Returns the string's offset in the side buffer, or UINT32_MAX
+static uint32_t add_string(display_list_t* list, const char* text, uint32_t length) {
+    if (!grow_buffer((void**)&list->strings, &list->string_capacity, list->string_size + length + 1, DISPLAY_LIST_INITIAL_STRINGS, 1)) {
+        return UINT32_MAX;
+    }
+    
+    uint32_t offset = list->string_size;
+    memcpy(list->strings + offset, text, length);
+    list->strings[offset + length] = '\0';
+    list->string_size += length + 1;
+    return offset;
+}
+
+static uint32_t add_resource(display_list_t* list, void* resource) {
+    if (!grow_buffer((void**)&list->resources, &list->resource_capacity, list->resource_count + 1, 16, sizeof(void*))) {
+        return UINT32_MAX;
+    }
+    list->resources[list->resource_count] = resource;
+    return list->resource_count++;
+}
+
+static void extend_bounds(display_list_t* list, const rect_t* rect) {
+    if (rect->width <= 0 || rect->height <= 0) return;
+    if (list->bounds.width <= 0 || list->bounds.height <= 0) {
+        list->bounds = *rect;
+        return;
+    }
+    
+    float x1 = list->bounds.x < rect->x ? list->bounds.x : rect->x;
+    float y1 = list->bounds.y < rect->y ? list->bounds.y : rect->y;
+    float x2 = list->bounds.x + list->bounds.width;
+    float y2 = list->bounds.y + list->bounds.height;
+    if (rect->x + rect->width > x2) x2 = rect->x + rect->width;
+    if (rect->y + rect->height > y2) y2 = rect->y + rect->height;
+    
+    list->bounds.x = x1;
+    list->bounds.y = y1;
+    list->bounds.width = x2 - x1;
+    list->bounds.height = y2 - y1;
+}
+
+// Lifecycle
+
+display_list_t* create_display_list(void) {
+    return calloc(1, sizeof(display_list_t));
+}
+
+void destroy_display_list(display_list_t* list) {
+    if (!list) return;
+    free(list->commands);
+    free(list->strings);
+    free(list->resources);
+    free(list);
+}
+
+void display_list_reset(display_list_t* list) {
+    if (!list) return;
+    list->size = 0;
+    list->command_count = 0;
+    list->string_size = 0;
+    list->resource_count = 0;
+    memset(&list->bounds, 0, sizeof(list->bounds));
+}
+
+// Recording
+
+static void emit_rect(display_list_t* list, display_command_type_t type, rect_t* rect, uint32_t color, float stroke_width) {
+    if (!rect) return;
+    display_rect_t* command = emit(list, type, sizeof(display_rect_t));
+    if (!command) return;
+    command->rect = *rect;
+    command->color = color;
+    command->stroke_width = stroke_width;
+    if (type != DISPLAY_CLIP_RECT) extend_bounds(list, rect);
+}
+
+void display_list_draw_rect(display_list_t* list, rect_t* rect, uint32_t color) {
+    emit_rect(list, DISPLAY_DRAW_RECT, rect, color, 0.0f);
+}
+
+void display_list_stroke_rect(display_list_t* list, rect_t* rect, uint32_t color, float width) {
+    emit_rect(list, DISPLAY_STROKE_RECT, rect, color, width);
+}
+
+void display_list_clip_rect(display_list_t* list, rect_t* rect) {
+    emit_rect(list, DISPLAY_CLIP_RECT, rect, 0, 0.0f);
+}
+
+void display_list_draw_rounded_rect(display_list_t* list, rect_t* rect, uint32_t color, const float border_radius[4]) {
+    if (!rect) return;
+    display_rounded_rect_t* command = emit(list, DISPLAY_DRAW_ROUNDED_RECT, sizeof(display_rounded_rect_t));
+    if (!command) return;
+    command->rect = *rect;
+    command->color = color;
+    if (border_radius) memcpy(command->border_radius, border_radius, sizeof(command->border_radius));
+    extend_bounds(list, rect);
+}
+
+static void emit_text(display_list_t* list, const char* text, uint32_t length, float x, float y, atom_t font, float size, uint32_t color) {
+    if (!list || !text || !length) return;
+    
+    uint32_t offset = add_string(list, text, length);
+    if (offset == UINT32_MAX) return;
+    
+    display_text_t* command = emit(list, DISPLAY_DRAW_TEXT, sizeof(display_text_t));
+    if (!command) return;
+    command->x = x;
+    command->y = y;
+    command->font = font;
+    command->font_size = size;
+    command->color = color;
+    command->text = offset;
+    command->length = length;
+}
+
+void display_list_draw_text(display_list_t* list, const char* text, float x, float y, const char* font, float size, uint32_t color) {
+    if (!text) return;
+    atom_t font_atom = font ? atom_intern(font) : ATOM_NULL;
+    emit_text(list, text, (uint32_t)strlen(text), x, y, font_atom, size, color);
+}
+
+// Draws bytes [start, end) of a shaped run; the font is already an atom
+void display_list_draw_text_run(display_list_t* list, const text_shape_t* shape, uint32_t start, uint32_t end, float x, float y, uint32_t color) {
+    if (!shape) return;
+    if (end > shape->length) end = shape->length;
+    if (start >= end) return;
+    
+    emit_text(list, shape->text + start, end - start, x, y, shape->font, shape->font_size, color);
+    
+    rect_t bounds = {
+        x, y - shape->ascent,
+        text_shape_measure(shape, start, end), shape->ascent + shape->descent
+    };
+    extend_bounds(list, &bounds);
+}
+
+void display_list_draw_image(display_list_t* list, void* image, rect_t* src, rect_t* dst) {
+    if (!list || !image || !dst) return;
+    
+    uint32_t index = add_resource(list, image);
+    if (index == UINT32_MAX) return;
+    
+    display_image_t* command = emit(list, DISPLAY_DRAW_IMAGE, sizeof(display_image_t));
+    if (!command) return;
+    command->image = index;
+    if (src) command->src_rect = *src;
+    command->dst_rect = *dst;
+    extend_bounds(list, dst);
+}
+
+void display_list_draw_line(display_list_t* list, float x1, float y1, float x2, float y2, uint32_t color, float width) {
+    display_line_t* command = emit(list, DISPLAY_DRAW_LINE, sizeof(display_line_t));
+    if (!command) return;
+    command->x1 = x1;
+    command->y1 = y1;
+    command->x2 = x2;
+    command->y2 = y2;
+    command->color = color;
+    command->width = width;
+}
+
+void display_list_draw_path(display_list_t* list, void* path, uint32_t fill_color, uint32_t stroke_color, float stroke_width) {
+    if (!list || !path) return;
+    
+    uint32_t index = add_resource(list, path);
+    if (index == UINT32_MAX) return;
+    
+    display_path_t* command = emit(list, DISPLAY_DRAW_PATH, sizeof(display_path_t));
+    if (!command) return;
+    command->path = index;
+    command->fill_color = fill_color;
+    command->stroke_color = stroke_color;
+    command->stroke_width = stroke_width;
+}
+
+// State
+
+void display_list_save(display_list_t* list) {
+    emit(list, DISPLAY_SAVE, sizeof(display_command_t));
+}
+
+void display_list_restore(display_list_t* list) {
+    emit(list, DISPLAY_RESTORE, sizeof(display_command_t));
+}
+
+static void emit_transform_2d(display_list_t* list, display_command_type_t type, float x, float y) {
+    display_transform_2d_t* command = emit(list, type, sizeof(display_transform_2d_t));
+    if (!command) return;
+    command->x = x;
+    command->y = y;
+}
+
+void display_list_translate(display_list_t* list, float x, float y) {
+    emit_transform_2d(list, DISPLAY_TRANSLATE, x, y);
+}
+
+void display_list_scale(display_list_t* list, float x, float y) {
+    emit_transform_2d(list, DISPLAY_SCALE, x, y);
+}
+
+void display_list_rotate(display_list_t* list, float radians) {
+    emit_transform_2d(list, DISPLAY_ROTATE, radians, 0.0f);
+}
+
+void display_list_transform(display_list_t* list, float matrix[16]) {
+    if (!matrix) return;
+    display_matrix_t* command = emit(list, DISPLAY_SET_TRANSFORM, sizeof(display_matrix_t));
+    if (!command) return;
+    memcpy(command->matrix, matrix, sizeof(command->matrix));
+}
+
+void display_list_set_opacity(display_list_t* list, float opacity) {
+    display_state_t* command = emit(list, DISPLAY_SET_OPACITY, sizeof(display_state_t));
+    if (command) command->value.opacity = opacity;
+}
+
+void display_list_set_blend_mode(display_list_t* list, uint32_t blend_mode) {
+    display_state_t* command = emit(list, DISPLAY_SET_BLEND_MODE, sizeof(display_state_t));
+    if (command) command->value.blend_mode = blend_mode;
+}
@@ -3,10 +3,18 @@
 
 #include <stdint.h>
 #include <stdbool.h>
+#include <stddef.h>
+#include "../atom.h"
 
 // Forward declarations
 struct dom_element;
 struct css_computed_style;
+struct text_shape;
+struct paint_layer;
+struct display_list;
+struct scroll_state;
+struct compositor_thread;
+struct hit_grid;
 
 // Layout box types
 typedef enum {
@@ -71,6 +79,7 @@ typedef struct layout_box {
             float height;
         }* runs;
         uint32_t run_count;
+        struct text_shape* shape;   // Retained from the text cache
     } text_data;
     
     // Flex container
@@ -113,9 +122,21 @@ typedef struct layout_box {
         uint32_t item_count;
     } grid;
     
-    // Painting
+    // Incremental layout. needs_layout marks this box's own geometry stale,
+    // child_needs_layout that some descendant's is. layout_width is the
+    // container width of the last layout; a clean box laid out again at the
+    // same width is skipped.
+    bool needs_layout;
+    bool child_needs_layout;
+    float layout_width;
+    
+    // Painting. paint_layer is the layer that records this box and
+    // painted_rect its border rect when it was last painted, so a move
+    // damages both the old and the new position.
     bool needs_paint;
     uint32_t paint_order;
+    struct paint_layer* paint_layer;
+    rect_t painted_rect;
     struct {
         bool has_transform;
         float transform_matrix[16];
@@ -125,13 +146,39 @@ typedef struct layout_box {
 } layout_box_t;
 
 // Render tree
-typedef struct {
+typedef struct render_tree {
     layout_box_t* root;
     uint32_t box_count;
     bool needs_layout;
     bool needs_paint;
-    uint64_t layout_version;
+    uint64_t layout_version;        // Bumped only when a box moved or resized
     uint64_t paint_version;
+    
+    // Relayout boundaries with dirty boxes below them, laid out in place
+    // by the next reflow without touching their ancestors
+    layout_box_t** relayout_roots;
+    uint32_t relayout_root_count;
+    uint32_t relayout_root_capacity;
+    float viewport_width;
+    float viewport_height;
+    
+    // Retained layer tree, rebuilt only when needs_layer_update is set
+    struct paint_layer* layer_tree;
+    bool needs_layer_update;
+    uint64_t painted_layout_version;
+    
+    // Set when only compositor properties changed; a frame with nothing
+    // repainted and no such change skips compositing
+    bool needs_composite;
+    uint64_t composited_paint_version;
+    
+    // Scroll containers registered by layout, not owned by the tree
+    struct scroll_state** scrollers;
+    uint32_t scroller_count;
+    uint32_t scroller_capacity;
+    
+    // Layers in paint order for hit testing, dropped with the layer tree
+    void* hit_index;
 } render_tree_t;
 
 // Paint layer
@@ -166,6 +213,19 @@ typedef struct paint_layer {
     rect_t clip_rect;
     bool has_clip_path;
     void* clip_path;
+    
+    // Retained painting: the layer's own content as recorded at the last
+    // repaint, the damage accumulated since, and the size of the backing
+    // store in compositing.texture_id. Empty damage with needs_repaint set
+    // repaints the whole layer.
+    struct display_list* display_list;
+    rect_t damage;
+    uint32_t backing_width;
+    uint32_t backing_height;
+    
+    // Hit testing grid over the boxes this layer paints
+    struct hit_grid* hit_grid;
+    bool hit_grid_dirty;
 } paint_layer_t;
 
 // Display list commands
@@ -189,61 +249,137 @@ typedef enum {
     DISPLAY_SET_BLEND_MODE
 } display_command_type_t;
 
-// Display list item
+// Display list commands are packed back to back in one buffer, each a
+// display_command_t header followed by the payload for its type. Strings
+// live in a side buffer and images and paths in a resource table, both
+// referenced by index, so a list can be reset and re-recorded every frame
+// without freeing anything.
 typedef struct {
-    display_command_type_t type;
-    union {
-        struct {
-            rect_t rect;
-            uint32_t color;
-            float border_radius[4];
-        } rect;
-        
-        struct {
-            char* text;
-            float x, y;
-            char* font_family;
-            float font_size;
-            uint32_t color;
-        } text;
-        
-        struct {
-            void* image_data;
-            rect_t src_rect;
-            rect_t dst_rect;
-        } image;
-        
-        struct {
-            float x1, y1, x2, y2;
-            uint32_t color;
-            float width;
-        } line;
-        
-        struct {
-            void* path_data;
-            uint32_t fill_color;
-            uint32_t stroke_color;
-            float stroke_width;
-        } path;
-        
-        struct {
-            float matrix[16];
-        } transform;
-        
-        struct {
-            float opacity;
-        } opacity;
-    } data;
-} display_item_t;
+    uint16_t type;                  // display_command_type_t
+    uint16_t size;                  // Bytes including this header
+} display_command_t;
+
+// DISPLAY_DRAW_RECT, DISPLAY_FILL_RECT, DISPLAY_STROKE_RECT, DISPLAY_CLIP_RECT
+typedef struct {
+    display_command_t header;
+    rect_t rect;
+    uint32_t color;
+    float stroke_width;
+} display_rect_t;
+
+// DISPLAY_DRAW_ROUNDED_RECT
+typedef struct {
+    display_command_t header;
+    rect_t rect;
+    uint32_t color;
+    float border_radius[4];
+} display_rounded_rect_t;
+
+// DISPLAY_DRAW_TEXT
+typedef struct {
+    display_command_t header;
+    float x, y;
+    atom_t font;
+    float font_size;
+    uint32_t color;
+    uint32_t text;                  // Offset into the string buffer
+    uint32_t length;
+} display_text_t;
+
+// DISPLAY_DRAW_IMAGE
+typedef struct {
+    display_command_t header;
+    uint32_t image;                 // Resource index
+    rect_t src_rect;
+    rect_t dst_rect;
+} display_image_t;
+
+// DISPLAY_DRAW_LINE
+typedef struct {
+    display_command_t header;
+    float x1, y1, x2, y2;
+    uint32_t color;
+    float width;
+} display_line_t;
+
+// DISPLAY_DRAW_PATH
+typedef struct {
+    display_command_t header;
+    uint32_t path;                  // Resource index
+    uint32_t fill_color;
+    uint32_t stroke_color;
+    float stroke_width;
+} display_path_t;
+
+// DISPLAY_TRANSLATE, DISPLAY_SCALE (x, y) and DISPLAY_ROTATE (x in radians)
+typedef struct {
+    display_command_t header;
+    float x, y;
+} display_transform_2d_t;
+
+// DISPLAY_SET_TRANSFORM
+typedef struct {
+    display_command_t header;
+    float matrix[16];
+} display_matrix_t;
 
-// Display list
+// DISPLAY_SET_OPACITY, DISPLAY_SET_BLEND_MODE
 typedef struct {
-    display_item_t** items;
-    uint32_t item_count;
+    display_command_t header;
+    union {
+        float opacity;
+        uint32_t blend_mode;
+    } value;
+} display_state_t;
+
+// Display list. DISPLAY_SAVE and DISPLAY_RESTORE are a bare header.
+typedef struct display_list {
+    uint8_t* commands;
+    uint32_t size;
     uint32_t capacity;
-    rect_t bounds;
+    uint32_t command_count;
+    
+    char* strings;
+    uint32_t string_size;
+    uint32_t string_capacity;
+    
+    void** resources;
+    uint32_t resource_count;
+    uint32_t resource_capacity;
+    
+    rect_t bounds;                  // Drawn area, ignoring transforms
 } display_list_t;
 
+// Linear iteration for rasterizers:
+//   for (cmd = display_list_first(list); cmd; cmd = display_list_next(list, cmd))
+static inline const display_command_t* display_list_first(const display_list_t* list) {
+    return list && list->size ? (const display_command_t*)list->commands : NULL;
+}
+
+static inline const display_command_t* display_list_next(const display_list_t* list, const display_command_t* command) {
+    const uint8_t* next = (const uint8_t*)command + command->size;
+    return next < list->commands + list->size ? (const display_command_t*)next : NULL;
+}
+
+static inline const char* display_list_string(const display_list_t* list, uint32_t offset) {
+    return list->strings + offset;
+}
+
+static inline void* display_list_resource(const display_list_t* list, uint32_t index) {
+    return index < list->resource_count ? list->resources[index] : NULL;
+}
+
+// One textured quad for the GPU compositor: rect is the layer's untransformed
+// destination, uv its area of the texture in 0-1 coordinates, and clip the
+// device-space scissor (empty for none)
+typedef struct {
+    rect_t rect;
+    rect_t uv;
+    rect_t clip;
+    float transform[16];
+    float opacity;
+} compositor_quad_t;
+
 // Render pipeline
 typedef struct {
     // Layout engine
@@ -257,7 +393,10 @@ typedef struct {
     // Paint system
     struct {
         paint_layer_t* (*build_layer_tree)(render_tree_t* tree);
-        display_list_t* (*paint)(paint_layer_t* layer);
+        // Records the layer's own boxes, not its child layers
+        void (*paint)(paint_layer_t* layer, display_list_t* list);
+        // Rasterizes layer->display_list into its backing store, clipped
+        // to dirty_rect
         void (*repaint)(paint_layer_t* layer, rect_t* dirty_rect);
     } paint;
     
@@ -269,12 +408,14 @@ typedef struct {
         void (*destroy_backing_store)(uint32_t texture_id);
     } compositor;
     
-    // Rasterization
+    // Rasterization. context is the frame's target, kept across frames.
     struct {
+        void* context;
         void* (*create_context)(uint32_t width, uint32_t height);
         void (*execute_display_list)(void* context, display_list_t* list);
         void (*flush)(void* context);
         void (*present)(void* context);
+        void (*destroy_context)(void* context);
     } raster;
     
     // GPU acceleration
@@ -286,11 +427,18 @@ typedef struct {
             uint32_t (*create_texture)(uint32_t width, uint32_t height);
             void (*bind_texture)(uint32_t texture_id);
             void (*draw_quad)(rect_t* rect, uint32_t texture_id);
+            // Premultiplied ARGB upload into part of a texture; stride in pixels
+            void (*update_texture)(uint32_t texture_id, uint32_t x, uint32_t y, uint32_t width, uint32_t height, const uint32_t* pixels, uint32_t stride);
+            void (*delete_texture)(uint32_t texture_id);
+            // Quads from one texture drawn with program in a single call
+            void (*draw_quads)(uint32_t program, uint32_t texture_id, uint32_t blend_mode, const compositor_quad_t* quads, uint32_t count);
         } gpu;
     } acceleration;
 } render_pipeline_t;
 
-// Layout algorithms
+// Layout algorithms. Each lays out box itself and positions its children,
+// sizing every child through layout_box_if_needed so clean subtrees keep
+// their geometry.
 void layout_block(layout_box_t* box, float container_width);
 void layout_inline(layout_box_t* box, float container_width);
 void layout_flex(layout_box_t* box, float container_width);
@@ -298,6 +446,79 @@ void layout_grid(layout_box_t* box, float container_width);
 void layout_table(layout_box_t* box, float container_width);
 void layout_text(layout_box_t* box, float container_width);
 
+// Incremental reflow (reflow.c). layout_reflow is the pipeline's reflow:
+// with a NULL dirty_box it lays out every pending relayout root, skipping
+// the whole pass when nothing is dirty. layout_set_viewport relayouts the
+// root only when the viewport size changed.
+bool layout_box_if_needed(layout_box_t* box, float container_width);
+void layout_reflow(render_tree_t* tree, layout_box_t* dirty_box);
+void layout_set_viewport(render_tree_t* tree, float viewport_width, float viewport_height);
+bool layout_is_relayout_boundary(const layout_box_t* box);
+
+// Parallel layout (parallel_layout.c). Independent formatting contexts --
+// flex and grid items, table cells, fixed-width blocks -- can be laid out
+// on the worker pool once their container widths are known. Algorithms
+// call layout_children_parallel (block children at container_width) or
+// layout_boxes_parallel (items with computed widths) before their serial
+// positioning pass, which then finds those boxes clean. Code reached from
+// a layout algorithm must only write to the box it was given and its
+// subtree.
+struct worker_pool;
+void layout_set_worker_pool(struct worker_pool* pool);
+bool layout_is_independent(const layout_box_t* box);
+void layout_boxes_parallel(layout_box_t** boxes, const float* container_widths, uint32_t count);
+void layout_children_parallel(layout_box_t* box, float container_width);
+
+// Text measurement cache (text_cache.c). Shapes are shared across layout
+// workers, keyed by font, size and text, and hold per-byte advances and
+// break opportunities. layout_text keeps its shape in text_data.shape and
+// rebuilds runs from text_shape_break_lines, which reuses the previous
+// line breaks when the width is unchanged. Shapes for a font are dropped
+// by text_cache_font_loaded; a retained shape is then marked stale and
+// must be replaced on the next layout.
+enum {
+    TEXT_BREAK_NONE = 0,
+    TEXT_BREAK_ALLOWED = 1,         // A line may start at this byte
+    TEXT_BREAK_MANDATORY = 2        // A line must start at this byte
+};
+
+typedef struct {
+    uint32_t start;
+    uint32_t end;                   // Exclusive, includes trailing spaces
+    float width;                    // Without trailing spaces
+} text_line_t;
+
+typedef struct text_shape {
+    uint32_t ref_count;
+    atom_t font;
+    float font_size;
+    uint32_t hash;
+    char* text;
+    uint32_t length;
+    float* offsets;                 // Pen position before each byte; length + 1 entries
+    uint8_t* breaks;                // TEXT_BREAK_* per byte
+    float ascent;
+    float descent;
+    bool stale;
+    void* lines;                    // Last line breaking, guarded by the shape
+} text_shape_t;
+
+// Fills advances[i] for each byte of text; continuation bytes get 0.
+// Called from worker threads, so it must be thread-safe.
+typedef void (*text_measure_fn_t)(atom_t font, float font_size, const char* text, uint32_t length, float* advances, float* ascent, float* descent);
+
+void text_cache_set_measure(text_measure_fn_t measure);
+text_shape_t* text_cache_shape(atom_t font, float font_size, const char* text, uint32_t length);
+void text_cache_font_loaded(atom_t font);
+void text_cache_clear(void);
+void text_cache_get_stats(uint64_t* hits, uint64_t* misses);
+
+text_shape_t* text_shape_retain(text_shape_t* shape);
+void text_shape_release(text_shape_t* shape);
+bool text_shape_is_stale(const text_shape_t* shape);
+float text_shape_measure(const text_shape_t* shape, uint32_t start, uint32_t end);
+uint32_t text_shape_break_lines(text_shape_t* shape, float max_width, text_line_t* lines, uint32_t capacity);
+
 // Box tree operations
 layout_box_t* create_layout_box(layout_box_type_t type);
 void destroy_layout_box(layout_box_t* box);
@@ -305,17 +526,107 @@ void append_child_box(layout_box_t* parent, layout_box_t* child);
 void remove_child_box(layout_box_t* parent, layout_box_t* child);
 layout_box_t* build_layout_tree(struct dom_element* element, struct css_computed_style* style);
 
-// Painting operations
+// Painting operations (display_list.c). The paint hook records into a list
+// the caller owns; display_list_reset empties it for the next frame while
+// keeping its buffers. Images and paths are borrowed, not owned.
 display_list_t* create_display_list(void);
 void destroy_display_list(display_list_t* list);
+void display_list_reset(display_list_t* list);
 void display_list_draw_rect(display_list_t* list, rect_t* rect, uint32_t color);
+void display_list_draw_rounded_rect(display_list_t* list, rect_t* rect, uint32_t color, const float border_radius[4]);
+void display_list_stroke_rect(display_list_t* list, rect_t* rect, uint32_t color, float width);
+void display_list_clip_rect(display_list_t* list, rect_t* rect);
 void display_list_draw_text(display_list_t* list, const char* text, float x, float y, const char* font, float size, uint32_t color);
+void display_list_draw_text_run(display_list_t* list, const text_shape_t* shape, uint32_t start, uint32_t end, float x, float y, uint32_t color);
 void display_list_draw_image(display_list_t* list, void* image, rect_t* src, rect_t* dst);
+void display_list_draw_line(display_list_t* list, float x1, float y1, float x2, float y2, uint32_t color, float width);
+void display_list_draw_path(display_list_t* list, void* path, uint32_t fill_color, uint32_t stroke_color, float stroke_width);
 void display_list_save(display_list_t* list);
 void display_list_restore(display_list_t* list);
+void display_list_translate(display_list_t* list, float x, float y);
+void display_list_scale(display_list_t* list, float x, float y);
+void display_list_rotate(display_list_t* list, float radians);
 void display_list_transform(display_list_t* list, float matrix[16]);
+void display_list_set_opacity(display_list_t* list, float opacity);
+void display_list_set_blend_mode(display_list_t* list, uint32_t blend_mode);
+
+// Retained painting (paint_cache.c). paint_update rebuilds the layer tree
+// only when needs_layer_update is set, carrying each layer's display list
+// and backing store over to the new layer for the same box, then records
+// and rasterizes just the layers with damage. paint_release frees the
+// retained state before the render tree goes away.
+void paint_update(render_tree_t* tree, const render_pipeline_t* pipeline);
+void paint_release(render_tree_t* tree, const render_pipeline_t* pipeline);
+bool paint_style_changes_layers(const struct css_computed_style* old_style, const struct css_computed_style* new_style);
+
+// Software rasterizer (raster.c). Backing stores are tiled surfaces of
+// RASTER_TILE_SIZE square premultiplied ARGB tiles. A repaint bins the
+// layer's draw commands into the tiles they touch, with transform, clip
+// and opacity resolved at binning time, and rasterizes the damaged tiles
+// in parallel on the worker pool; other tiles keep their pixels. Only
+// axis-aligned transforms are honoured -- a rotation or skew paints its
+// untransformed bounds -- blend modes other than normal draw as normal,
+// and paths are not drawn. raster_install_software fills in the pipeline's backing store,
+// repaint and raster hooks; raster.context is then a raster_framebuffer_t.
+#define RASTER_TILE_SIZE 256
+
+// DISPLAY_DRAW_IMAGE resources for the software path
+typedef struct {
+    uint32_t width;
+    uint32_t height;
+    uint32_t stride;                // In pixels
+    const uint32_t* pixels;         // Premultiplied ARGB
+} raster_image_t;
+
+typedef struct {
+    uint32_t width;
+    uint32_t height;
+    uint32_t* pixels;               // Premultiplied ARGB, width pixels per row
+} raster_framebuffer_t;
 
-// Layer operations
+// Draws one text command into pixels, which hold the device-space area
+// clip, in premultiplied ARGB color; called from worker threads. Without
+// one, text is not drawn.
+typedef void (*raster_text_fn_t)(uint32_t* pixels, uint32_t stride, const rect_t* clip, const char* text, uint32_t length, atom_t font, float font_size, float x, float y, uint32_t color);
+
+void raster_install_software(render_pipeline_t* pipeline);
+
+// Tiled surfaces by id, for backends that upload the rasterized tiles
+// themselves. Ids are the software backing store texture ids; a tile is
+// NULL until first painted.
+uint32_t raster_surface_create(uint32_t width, uint32_t height);
+void raster_surface_destroy(uint32_t surface_id);
+void raster_surface_repaint(uint32_t surface_id, const display_list_t* list, float origin_x, float origin_y, const rect_t* dirty_rect);
+const uint32_t* raster_surface_tile(uint32_t surface_id, uint32_t tile_x, uint32_t tile_y);
+void raster_set_worker_pool(struct worker_pool* pool);
+void raster_set_text_renderer(raster_text_fn_t render_text);
+raster_framebuffer_t* raster_create_framebuffer(uint32_t width, uint32_t height);
+void raster_destroy_framebuffer(raster_framebuffer_t* framebuffer);
+void raster_composite_layers(raster_framebuffer_t* framebuffer, paint_layer_t** layers, uint32_t layer_count);
+
+// GPU compositor (compositor.c). compositor_install_gpu takes over the
+// backing store, repaint and composite hooks when acceleration.gpu is
+// filled in, and is a no-op otherwise; the platform calls it after
+// filling the hooks and before the first paint. Layer content is still
+// rasterized into tiled surfaces, whose damaged tiles are uploaded into
+// textures; backing stores up to COMPOSITOR_ATLAS_MAX_SLOT pixels square
+// share COMPOSITOR_ATLAS_SIZE atlases, larger ones get their own texture.
+// The composite hook draws layers in paint order, batching consecutive quads
+// that share a texture and blend mode into one draw_quads call.
+//
+// compositor_set_transform and compositor_set_opacity are for animations:
+// on a box that owns a layer they only update its compositing properties,
+// never touching layout or paint. Other boxes repaint once and are
+// given a layer of their own at the next layer tree update.
+#define COMPOSITOR_ATLAS_SIZE 2048
+#define COMPOSITOR_ATLAS_MAX_SLOT 512
+
+bool compositor_install_gpu(render_pipeline_t* pipeline);
+void compositor_shutdown(void);
+void compositor_set_transform(render_tree_t* tree, layout_box_t* box, const float transform[16]);
+void compositor_set_opacity(render_tree_t* tree, layout_box_t* box, float opacity);
+
+// Layer operations. destroy_paint_layer frees the layer and its children.
 paint_layer_t* create_paint_layer(layout_box_t* box);
 void destroy_paint_layer(paint_layer_t* layer);
 void add_child_layer(paint_layer_t* parent, paint_layer_t* child);
@@ -326,13 +637,35 @@ paint_layer_t** collect_layers_in_paint_order(paint_layer_t* root, uint32_t* cou
 layout_box_t* hit_test_box(layout_box_t* box, float x, float y);
 layout_box_t* hit_test_layer(paint_layer_t* layer, float x, float y);
 
-// Invalidation
+// Hit testing index (hit_index.c). Each paint layer keeps a uniform grid
+// over the border rects of the boxes it paints. The grid is built on first
+// use and rebuilt only after layout moves one of those boxes, which reflow
+// reports through hit_index_invalidate_box. hit_index_hit_test is the
+// pipeline's layout.hit_test. It tries layers topmost first in paint
+// order; within a layer the hit latest in paint_order, then in tree order,
+// wins. Coordinates are document coordinates. While a layer tree update is
+// pending it falls back to hit_test_box over the whole tree.
+bool hit_index_hit_test(render_tree_t* tree, float x, float y, layout_box_t** result);
+void hit_index_invalidate_box(layout_box_t* box);
+void hit_index_reset(render_tree_t* tree);
+void hit_index_release_layer(paint_layer_t* layer);
+
+// Invalidation. invalidate_layout marks the box and sets child_needs_layout
+// on its ancestors up to the nearest relayout boundary, which it queues on
+// the tree; append_child_box and remove_child_box invalidate the parent
+// and set needs_layer_update. invalidate_paint adds the dirty rect (by
+// default the box's old and new border rects) to the damage of the box's
+// layer; invalidate_layer with a NULL rect damages the whole layer.
 void invalidate_layout(render_tree_t* tree, layout_box_t* box);
 void invalidate_paint(render_tree_t* tree, layout_box_t* box, rect_t* dirty_rect);
 void invalidate_layer(paint_layer_t* layer, rect_t* dirty_rect);
 
-// Scrolling
-typedef struct {
+// Scrolling (scroll.c). A NULL scrollable_box is the viewport. Once a
+// scroller has been committed to a compositor thread, the thread owns its
+// offset: scroll_to and friends post to it and update scroll_x/scroll_y
+// only as the main thread's estimate, which compositor_thread_sync_scroll
+// corrects at the start of each frame.
+typedef struct scroll_state {
     layout_box_t* scrollable_box;
     float scroll_x;
     float scroll_y;
@@ -340,11 +673,15 @@ typedef struct {
     float scroll_height;
     float viewport_width;
     float viewport_height;
+    uint32_t scroll_id;             // Assigned by render_tree_add_scroller
+    struct compositor_thread* compositor;
 } scroll_state_t;
 
 void scroll_to(scroll_state_t* state, float x, float y);
 void scroll_by(scroll_state_t* state, float dx, float dy);
 void smooth_scroll_to(scroll_state_t* state, float x, float y, uint32_t duration);
+int render_tree_add_scroller(render_tree_t* tree, scroll_state_t* state);
+void render_tree_remove_scroller(render_tree_t* tree, scroll_state_t* state);
 
 // Animation
 typedef struct {
@@ -371,4 +708,36 @@ void stop_animation(animation_t* animation);
 void update_animation(animation_t* animation, uint32_t delta_time);
 float evaluate_easing(animation_t* animation, float progress);
 
+// Compositor thread (compositor_thread.c). The thread owns the last
+// committed frame: a flat copy of the layer tree in paint order with its
+// scroll nodes. Every interval_us it takes the newest commit, applies
+// queued scrolls, advances smooth scrolls and compositor animations on its
+// own copy, and draws through compositor.composite (or the software frame
+// target) and raster.present, all without waiting on the main thread.
+//
+// The main thread hands frames over with an atomic pointer exchange; a
+// commit the thread has not picked up yet is simply replaced. Backing
+// stores are shared, so the main thread paints and commits between
+// compositor_thread_lock and compositor_thread_unlock, which the thread
+// also holds while it draws. A NULL tree commits an empty frame, for
+// before the layers' backing stores are released.
+//
+// Layers owned by a scroller's box or its descendants move with it, and
+// position: fixed layers stay put. compositor_thread_scroll may be called
+// from any thread, so platform input keeps scrolling through long tasks.
+// compositor_thread_animate runs an animation of "opacity",
+// "translate-x", "translate-y", "scale" or "rotate" on the layer owned by
+// its target box and returns false for anything else; a finished
+// animation holds its end value until the next commit.
+typedef struct compositor_thread compositor_thread_t;
+
+compositor_thread_t* compositor_thread_create(render_pipeline_t* pipeline, uint32_t interval_us);
+void compositor_thread_destroy(compositor_thread_t* thread);
+void compositor_thread_lock(compositor_thread_t* thread);
+void compositor_thread_unlock(compositor_thread_t* thread);
+void compositor_thread_commit(compositor_thread_t* thread, render_tree_t* tree);
+void compositor_thread_scroll(compositor_thread_t* thread, uint32_t scroll_id, float x, float y, bool relative, uint32_t duration);
+bool compositor_thread_animate(compositor_thread_t* thread, const animation_t* animation);
+void compositor_thread_sync_scroll(compositor_thread_t* thread, render_tree_t* tree);
+
 #endif
\ No newline at end of file
@@ -0,0 +1,265 @@
+#include "engine.h"
+#include "../capacity.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define HIT_GRID_MAX_CELLS 65536
+// Boxes spanning more cells than this are kept on a list checked for
+// every query rather than copied into each cell
+#define HIT_GRID_OVERSIZE 64
+
+typedef struct {
+    rect_t rect;
+    layout_box_t* box;
+    uint64_t order;                 // paint_order, then tree order
+} hit_entry_t;
+
+struct hit_grid {
+    rect_t extent;
+    uint32_t columns, rows;
+    float cell_width, cell_height;
+    uint32_t* cell_start;           // columns * rows + 1 offsets into cell_entries
+    uint32_t* cell_entries;
+    uint32_t* oversize;
+    uint32_t oversize_count;
+    hit_entry_t* entries;
+    uint32_t entry_count;
+};
+
+typedef struct {
+    paint_layer_t** layers;         // Paint order
+    uint32_t layer_count;
+} hit_index_t;
+
+static bool rect_contains(const rect_t* rect, float x, float y) {
+    return x >= rect->x && x < rect->x + rect->width && y >= rect->y && y < rect->y + rect->height;
+}
+
+// Grids
+
+static void free_grid(struct hit_grid* grid) {
+    if (!grid) return;
+    free(grid->cell_start);
+    free(grid->cell_entries);
+    free(grid->oversize);
+    free(grid->entries);
+    free(grid);
+}
+
+// The boxes a layer paints: its owner's subtree minus subtrees owned by
+// other layers
+static bool collect_entries(struct hit_grid* grid, uint32_t* capacity, layout_box_t* box, const paint_layer_t* layer, uint32_t* sequence) {
+    if (box->paint_layer != layer) return true;
+    
+    const rect_t* rect = &box->border_rect;
+    if (rect->width > 0 && rect->height > 0) {
+        if (grid->entry_count >= *capacity) {
+            uint32_t new_capacity = capacity_grow(*capacity, 64, sizeof(hit_entry_t));
+            hit_entry_t* entries = new_capacity ? realloc(grid->entries, new_capacity * sizeof(hit_entry_t)) : NULL;
+            if (!entries) return false;
+            grid->entries = entries;
+            *capacity = new_capacity;
+        }
+        hit_entry_t* entry = &grid->entries[grid->entry_count++];
+        entry->rect = *rect;
+        entry->box = box;
+        entry->order = ((uint64_t)box->paint_order << 32) | *sequence;
+    }
+    (*sequence)++;
+    
+    for (layout_box_t* child = box->first_child; child; child = child->next_sibling) {
+        if (!collect_entries(grid, capacity, child, layer, sequence)) return false;
+    }
+    return true;
+}
+
+static void cell_range(const struct hit_grid* grid, const rect_t* rect, uint32_t* c0, uint32_t* r0, uint32_t* c1, uint32_t* r1) {
+    float x0 = (rect->x - grid->extent.x) / grid->cell_width;
+    float y0 = (rect->y - grid->extent.y) / grid->cell_height;
+    float x1 = (rect->x + rect->width - grid->extent.x) / grid->cell_width;
+    float y1 = (rect->y + rect->height - grid->extent.y) / grid->cell_height;
+    
+    *c0 = x0 > 0 ? (uint32_t)x0 : 0;
+    *r0 = y0 > 0 ? (uint32_t)y0 : 0;
+    *c1 = x1 > 0 ? (uint32_t)x1 : 0;
+    *r1 = y1 > 0 ? (uint32_t)y1 : 0;
+    if (*c0 >= grid->columns) *c0 = grid->columns - 1;
+    if (*r0 >= grid->rows) *r0 = grid->rows - 1;
+    if (*c1 >= grid->columns) *c1 = grid->columns - 1;
+    if (*r1 >= grid->rows) *r1 = grid->rows - 1;
+}
+
+// Bins entries into roughly one cell per box, shaped like the extent.
+// Cells are filled with a counting pass and prefix sums.
+static bool bin_entries(struct hit_grid* grid) {
+    rect_t* extent = &grid->extent;
+    float x2 = extent->x, y2 = extent->y;
+    for (uint32_t i = 0; i < grid->entry_count; i++) {
+        const rect_t* rect = &grid->entries[i].rect;
+        if (i == 0) {
+            *extent = *rect;
+            x2 = rect->x + rect->width;
+            y2 = rect->y + rect->height;
+            continue;
+        }
+        if (rect->x < extent->x) extent->x = rect->x;
+        if (rect->y < extent->y) extent->y = rect->y;
+        if (rect->x + rect->width > x2) x2 = rect->x + rect->width;
+        if (rect->y + rect->height > y2) y2 = rect->y + rect->height;
+    }
+    extent->width = x2 - extent->x;
+    extent->height = y2 - extent->y;
+    
+    uint32_t cells = grid->entry_count < HIT_GRID_MAX_CELLS ? grid->entry_count : HIT_GRID_MAX_CELLS;
+    if (!cells) cells = 1;
+    float aspect = extent->height > 0 ? extent->width / extent->height : 1.0f;
+    uint32_t columns = (uint32_t)ceilf(sqrtf((float)cells * aspect));
+    if (columns < 1) columns = 1;
+    if (columns > cells) columns = cells;
+    grid->columns = columns;
+    grid->rows = (cells + columns - 1) / columns;
+    grid->cell_width = extent->width > 0 ? extent->width / (float)grid->columns : 1.0f;
+    grid->cell_height = extent->height > 0 ? extent->height / (float)grid->rows : 1.0f;
+    
+    uint32_t cell_count = grid->columns * grid->rows;
+    grid->cell_start = calloc(cell_count + 1, sizeof(uint32_t));
+    uint32_t* cursor = calloc(cell_count, sizeof(uint32_t));
+    if (!grid->cell_start || !cursor) {
+        free(cursor);
+        return false;
+    }
+    
+    uint32_t total = 0;
+    for (uint32_t i = 0; i < grid->entry_count; i++) {
+        uint32_t c0, r0, c1, r1;
+        cell_range(grid, &grid->entries[i].rect, &c0, &r0, &c1, &r1);
+        uint32_t span = (c1 - c0 + 1) * (r1 - r0 + 1);
+        if (span > HIT_GRID_OVERSIZE) {
+            grid->oversize_count++;
+            continue;
+        }
+        for (uint32_t r = r0; r <= r1; r++) {
+            for (uint32_t c = c0; c <= c1; c++) grid->cell_start[r * grid->columns + c + 1]++;
+        }
+        total += span;
+    }
+    for (uint32_t c = 0; c < cell_count; c++) grid->cell_start[c + 1] += grid->cell_start[c];
+    
+    grid->cell_entries = malloc((total ? total : 1) * sizeof(uint32_t));
+    grid->oversize = malloc((grid->oversize_count ? grid->oversize_count : 1) * sizeof(uint32_t));
+    if (!grid->cell_entries || !grid->oversize) {
+        free(cursor);
+        return false;
+    }
+    
+    memcpy(cursor, grid->cell_start, cell_count * sizeof(uint32_t));
+    uint32_t oversize = 0;
+    for (uint32_t i = 0; i < grid->entry_count; i++) {
+        uint32_t c0, r0, c1, r1;
+        cell_range(grid, &grid->entries[i].rect, &c0, &r0, &c1, &r1);
+        if ((c1 - c0 + 1) * (r1 - r0 + 1) > HIT_GRID_OVERSIZE) {
+            grid->oversize[oversize++] = i;
+            continue;
+        }
+        for (uint32_t r = r0; r <= r1; r++) {
+            for (uint32_t c = c0; c <= c1; c++) grid->cell_entries[cursor[r * grid->columns + c]++] = i;
+        }
+    }
+    free(cursor);
+    return true;
+}
+
+static struct hit_grid* build_grid(const render_tree_t* tree, paint_layer_t* layer) {
+    struct hit_grid* grid = calloc(1, sizeof(struct hit_grid));
+    if (!grid) return NULL;
+    
+    layout_box_t* owner = layer->box ? layer->box : tree->root;
+    uint32_t capacity = 0;
+    uint32_t sequence = 0;
+    if ((owner && !collect_entries(grid, &capacity, owner, layer, &sequence)) || !bin_entries(grid)) {
+        free_grid(grid);
+        return NULL;
+    }
+    return grid;
+}
+
+static const hit_entry_t* query_grid(const struct hit_grid* grid, float x, float y) {
+    if (!grid->entry_count || !rect_contains(&grid->extent, x, y)) return NULL;
+    
+    const hit_entry_t* best = NULL;
+    uint32_t column = (uint32_t)((x - grid->extent.x) / grid->cell_width);
+    uint32_t row = (uint32_t)((y - grid->extent.y) / grid->cell_height);
+    if (column >= grid->columns) column = grid->columns - 1;
+    if (row >= grid->rows) row = grid->rows - 1;
+    
+    uint32_t cell = row * grid->columns + column;
+    for (uint32_t i = grid->cell_start[cell]; i < grid->cell_start[cell + 1]; i++) {
+        const hit_entry_t* entry = &grid->entries[grid->cell_entries[i]];
+        if (rect_contains(&entry->rect, x, y) && (!best || entry->order > best->order)) best = entry;
+    }
+    for (uint32_t i = 0; i < grid->oversize_count; i++) {
+        const hit_entry_t* entry = &grid->entries[grid->oversize[i]];
+        if (rect_contains(&entry->rect, x, y) && (!best || entry->order > best->order)) best = entry;
+    }
+    return best;
+}
+
+// Index
+
+void hit_index_invalidate_box(layout_box_t* box) {
+    if (box && box->paint_layer) __atomic_store_n(&box->paint_layer->hit_grid_dirty, true, __ATOMIC_RELAXED);
+}
+
+void hit_index_release_layer(paint_layer_t* layer) {
+    if (!layer) return;
+    free_grid(layer->hit_grid);
+    layer->hit_grid = NULL;
+    layer->hit_grid_dirty = false;
+}
+
+void hit_index_reset(render_tree_t* tree) {
+    if (!tree || !tree->hit_index) return;
+    hit_index_t* index = tree->hit_index;
+    free(index->layers);
+    free(index);
+    tree->hit_index = NULL;
+}
+
+bool hit_index_hit_test(render_tree_t* tree, float x, float y, layout_box_t** result) {
+    if (result) *result = NULL;
+    if (!tree || !tree->root || !result) return false;
+    
+    // Layer ownership is stale until paint rebuilds the layer tree
+    if (!tree->layer_tree || tree->needs_layer_update) {
+        *result = hit_test_box(tree->root, x, y);
+        return *result != NULL;
+    }
+    
+    hit_index_t* index = tree->hit_index;
+    if (!index) {
+        index = calloc(1, sizeof(hit_index_t));
+        if (!index) return false;
+        index->layers = collect_layers_in_paint_order(tree->layer_tree, &index->layer_count);
+        if (!index->layers) index->layer_count = 0;
+        tree->hit_index = index;
+    }
+    
+    for (uint32_t i = index->layer_count; i-- > 0;) {
+        paint_layer_t* layer = index->layers[i];
+        if (layer->has_clip && !rect_contains(&layer->clip_rect, x, y)) continue;
+        
+        if (!layer->hit_grid || layer->hit_grid_dirty) {
+            hit_index_release_layer(layer);
+            layer->hit_grid = build_grid(tree, layer);
+            if (!layer->hit_grid) continue;
+        }
+        
+        const hit_entry_t* entry = query_grid(layer->hit_grid, x, y);
+        if (entry) {
+            *result = entry->box;
+            return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,299 @@
+#include "engine.h"
+#include "../css/style.h"
+#include <stdlib.h>
+#include <string.h>
+
+// Rectangles
+
+static bool rect_is_empty(const rect_t* rect) {
+    return rect->width <= 0 || rect->height <= 0;
+}
+
+static bool rect_equal(const rect_t* a, const rect_t* b) {
+    return a->x == b->x && a->y == b->y && a->width == b->width && a->height == b->height;
+}
+
+static void rect_union(rect_t* dest, const rect_t* rect) {
+    if (rect_is_empty(rect)) return;
+    if (rect_is_empty(dest)) {
+        *dest = *rect;
+        return;
+    }
+    
+    float x1 = dest->x < rect->x ? dest->x : rect->x;
+    float y1 = dest->y < rect->y ? dest->y : rect->y;
+    float x2 = dest->x + dest->width > rect->x + rect->width ? dest->x + dest->width : rect->x + rect->width;
+    float y2 = dest->y + dest->height > rect->y + rect->height ? dest->y + dest->height : rect->y + rect->height;
+    dest->x = x1;
+    dest->y = y1;
+    dest->width = x2 - x1;
+    dest->height = y2 - y1;
+}
+
+static rect_t rect_intersect(const rect_t* a, const rect_t* b) {
+    rect_t result = { 0, 0, 0, 0 };
+    float x1 = a->x > b->x ? a->x : b->x;
+    float y1 = a->y > b->y ? a->y : b->y;
+    float x2 = a->x + a->width < b->x + b->width ? a->x + a->width : b->x + b->width;
+    float y2 = a->y + a->height < b->y + b->height ? a->y + a->height : b->y + b->height;
+    if (x2 > x1 && y2 > y1) {
+        result.x = x1;
+        result.y = y1;
+        result.width = x2 - x1;
+        result.height = y2 - y1;
+    }
+    return result;
+}
+
+// Invalidation
+
+static paint_layer_t* layer_for_box(layout_box_t* box) {
+    for (; box; box = box->parent) {
+        if (box->paint_layer) return box->paint_layer;
+    }
+    return NULL;
+}
+
+void invalidate_layer(paint_layer_t* layer, rect_t* dirty_rect) {
+    if (!layer) return;
+    
+    // Empty damage on a layer that needs repaint means all of it
+    bool whole_layer = layer->needs_repaint && rect_is_empty(&layer->damage);
+    layer->needs_repaint = true;
+    if (!dirty_rect || rect_is_empty(dirty_rect)) {
+        memset(&layer->damage, 0, sizeof(layer->damage));
+    } else if (!whole_layer) {
+        rect_union(&layer->damage, dirty_rect);
+    }
+}
+
+void invalidate_paint(render_tree_t* tree, layout_box_t* box, rect_t* dirty_rect) {
+    if (!box) return;
+    if (tree) tree->needs_paint = true;
+    
+    // Boxes are only assigned to layers once the layer tree is built,
+    // which paints everything anyway
+    paint_layer_t* layer = layer_for_box(box);
+    if (!layer) return;
+    
+    rect_t damage = box->painted_rect;
+    if (dirty_rect) {
+        damage = *dirty_rect;
+    } else {
+        rect_union(&damage, &box->border_rect);
+    }
+    if (rect_is_empty(&damage)) return;
+    invalidate_layer(layer, &damage);
+}
+
+bool paint_style_changes_layers(const struct css_computed_style* old_style, const struct css_computed_style* new_style) {
+    if (!old_style || !new_style) return old_style != new_style;
+    if (old_style == new_style) return false;
+    
+    return old_style->position != new_style->position ||
+           old_style->overflow_x != new_style->overflow_x ||
+           old_style->overflow_y != new_style->overflow_y ||
+           old_style->transform_count != new_style->transform_count ||
+           memcmp(&old_style->values[CSS_PROP_Z_INDEX], &new_style->values[CSS_PROP_Z_INDEX], sizeof(css_packed_value_t)) != 0 ||
+           memcmp(&old_style->values[CSS_PROP_OPACITY], &new_style->values[CSS_PROP_OPACITY], sizeof(css_packed_value_t)) != 0;
+}
+
+// Layer tree
+
+static void clear_box_layers(layout_box_t* box) {
+    box->paint_layer = NULL;
+    for (layout_box_t* child = box->first_child; child; child = child->next_sibling) {
+        clear_box_layers(child);
+    }
+}
+
+static void mark_layer_owners(paint_layer_t* layer) {
+    if (layer->box) layer->box->paint_layer = layer;
+    for (uint32_t i = 0; i < layer->child_count; i++) {
+        mark_layer_owners(layer->children[i]);
+    }
+}
+
+// Boxes not owning a layer paint into their nearest ancestor's
+static void assign_box_layers(layout_box_t* box, paint_layer_t* layer) {
+    if (box->paint_layer) {
+        layer = box->paint_layer;
+    } else {
+        box->paint_layer = layer;
+    }
+    box->painted_rect = box->border_rect;
+    box->needs_paint = false;
+    
+    for (layout_box_t* child = box->first_child; child; child = child->next_sibling) {
+        assign_box_layers(child, layer);
+    }
+}
+
+// Moves the retained state of the old layer for the same box onto layer.
+// Runs before boxes are reassigned, while box->paint_layer still points
+// into the old tree.
+static void adopt_retained_state(paint_layer_t* layer) {
+    paint_layer_t* old = layer->box ? layer->box->paint_layer : NULL;
+    
+    if (old && old->box == layer->box && old != layer) {
+        layer->display_list = old->display_list;
+        layer->compositing.texture_id = old->compositing.texture_id;
+        layer->backing_width = old->backing_width;
+        layer->backing_height = old->backing_height;
+        old->display_list = NULL;
+        old->compositing.texture_id = 0;
+        
+        if (!rect_equal(&old->bounds, &layer->bounds)) {
+            layer->needs_repaint = true;
+            memset(&layer->damage, 0, sizeof(layer->damage));
+        } else {
+            layer->needs_repaint = old->needs_repaint;
+            layer->damage = old->damage;
+        }
+    } else {
+        layer->needs_repaint = true;
+        memset(&layer->damage, 0, sizeof(layer->damage));
+    }
+    
+    for (uint32_t i = 0; i < layer->child_count; i++) {
+        adopt_retained_state(layer->children[i]);
+    }
+}
+
+static void release_layer_state(paint_layer_t* layer, const render_pipeline_t* pipeline) {
+    destroy_display_list(layer->display_list);
+    layer->display_list = NULL;
+    if (layer->compositing.texture_id && pipeline && pipeline->compositor.destroy_backing_store) {
+        pipeline->compositor.destroy_backing_store(layer->compositing.texture_id);
+    }
+    layer->compositing.texture_id = 0;
+    hit_index_release_layer(layer);
+    
+    for (uint32_t i = 0; i < layer->child_count; i++) {
+        release_layer_state(layer->children[i], pipeline);
+    }
+}
+
+static void rebuild_layer_tree(render_tree_t* tree, const render_pipeline_t* pipeline) {
+    paint_layer_t* old_tree = tree->layer_tree;
+    paint_layer_t* new_tree = pipeline->paint.build_layer_tree ? pipeline->paint.build_layer_tree(tree) : NULL;
+    
+    if (new_tree) adopt_retained_state(new_tree);
+    hit_index_reset(tree);
+    if (old_tree) {
+        release_layer_state(old_tree, pipeline);
+        destroy_paint_layer(old_tree);
+    }
+    
+    tree->layer_tree = new_tree;
+    tree->needs_layer_update = false;
+    if (!tree->root) return;
+    
+    clear_box_layers(tree->root);
+    if (new_tree) {
+        mark_layer_owners(new_tree);
+        assign_box_layers(tree->root, new_tree);
+    }
+    tree->painted_layout_version = tree->layout_version;
+}
+
+// Damage from layout: every box that moved or resized since the last
+// paint repaints its old and new rects
+static void collect_moved_boxes(render_tree_t* tree, layout_box_t* box) {
+    if (box->needs_paint) {
+        paint_layer_t* layer = layer_for_box(box);
+        rect_t damage = box->painted_rect;
+        rect_union(&damage, &box->border_rect);
+        invalidate_layer(layer, &damage);
+        
+        // Layer bounds follow their box and are recomputed by a rebuild
+        if (layer && layer->box == box) tree->needs_layer_update = true;
+        box->needs_paint = false;
+    }
+    box->painted_rect = box->border_rect;
+    
+    for (layout_box_t* child = box->first_child; child; child = child->next_sibling) {
+        collect_moved_boxes(tree, child);
+    }
+}
+
+// Repaint
+
+// Returns false when the backing store was (re)created and needs a full
+// raster
+static bool ensure_backing_store(paint_layer_t* layer, const render_pipeline_t* pipeline) {
+    uint32_t width = (uint32_t)layer->bounds.width;
+    uint32_t height = (uint32_t)layer->bounds.height;
+    if ((float)width < layer->bounds.width) width++;
+    if ((float)height < layer->bounds.height) height++;
+    
+    if (layer->compositing.texture_id && layer->backing_width == width && layer->backing_height == height) {
+        return true;
+    }
+    
+    if (layer->compositing.texture_id && pipeline->compositor.destroy_backing_store) {
+        pipeline->compositor.destroy_backing_store(layer->compositing.texture_id);
+    }
+    layer->compositing.texture_id = 0;
+    if (width && height && pipeline->compositor.create_backing_store) {
+        layer->compositing.texture_id = pipeline->compositor.create_backing_store(width, height);
+    }
+    layer->backing_width = width;
+    layer->backing_height = height;
+    return false;
+}
+
+static void repaint_layers(paint_layer_t* layer, const render_pipeline_t* pipeline) {
+    if (layer->needs_repaint) {
+        bool reused = ensure_backing_store(layer, pipeline);
+        
+        if (!layer->display_list) layer->display_list = create_display_list();
+        display_list_t* list = layer->display_list;
+        if (list) {
+            // Re-record the whole layer; only the damage is rasterized
+            display_list_reset(list);
+            if (pipeline->paint.paint) pipeline->paint.paint(layer, list);
+            
+            rect_t dirty = layer->bounds;
+            if (reused && !rect_is_empty(&layer->damage)) {
+                dirty = rect_intersect(&layer->damage, &layer->bounds);
+            }
+            if (!rect_is_empty(&dirty) && pipeline->paint.repaint) {
+                pipeline->paint.repaint(layer, &dirty);
+            }
+            
+            layer->needs_repaint = false;
+            memset(&layer->damage, 0, sizeof(layer->damage));
+        }
+    }
+    
+    for (uint32_t i = 0; i < layer->child_count; i++) {
+        repaint_layers(layer->children[i], pipeline);
+    }
+}
+
+void paint_update(render_tree_t* tree, const render_pipeline_t* pipeline) {
+    if (!tree || !pipeline) return;
+    
+    if (tree->layer_tree && tree->root && tree->painted_layout_version != tree->layout_version) {
+        collect_moved_boxes(tree, tree->root);
+        tree->painted_layout_version = tree->layout_version;
+    }
+    if (!tree->layer_tree || tree->needs_layer_update) {
+        rebuild_layer_tree(tree, pipeline);
+    }
+    
+    if (tree->layer_tree) repaint_layers(tree->layer_tree, pipeline);
+    tree->needs_paint = false;
+    tree->paint_version++;
+}
+
+void paint_release(render_tree_t* tree, const render_pipeline_t* pipeline) {
+    hit_index_reset(tree);
+    if (!tree || !tree->layer_tree) return;
+    
+    release_layer_state(tree->layer_tree, pipeline);
+    destroy_paint_layer(tree->layer_tree);
+    tree->layer_tree = NULL;
+    if (tree->root) clear_box_layers(tree->root);
+}
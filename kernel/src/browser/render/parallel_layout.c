@@ -0,0 +1,92 @@
+#include "engine.h"
+#include "../worker_pool.h"
+#include "../css/style.h"
+#include <stdlib.h>
+
+// Pool shared by every layout pass; NULL lays out on the calling thread
+static worker_pool_t* layout_pool;
+
+typedef struct {
+    layout_box_t* box;
+    float container_width;
+} layout_job_t;
+
+void layout_set_worker_pool(struct worker_pool* pool) {
+    layout_pool = pool;
+}
+
+static void layout_job_run(void* data) {
+    layout_job_t* job = data;
+    layout_box_if_needed(job->box, job->container_width);
+}
+
+static bool box_needs_work(const layout_box_t* box, float container_width) {
+    return box->needs_layout || box->child_needs_layout || box->layout_width != container_width;
+}
+
+// Roots of formatting contexts whose layout reads nothing outside their
+// own subtree once the container width is known
+bool layout_is_independent(const layout_box_t* box) {
+    if (!box->parent || box->is_floating) return false;
+    
+    layout_box_type_t parent_type = box->parent->type;
+    if (parent_type == BOX_FLEX || parent_type == BOX_GRID) return true;
+    if (box->type == BOX_TABLE_CELL) return true;
+    
+    if (box->type != BOX_BLOCK && box->type != BOX_FLEX && box->type != BOX_GRID) return false;
+    
+    // Fixed-width blocks; auto widths follow the container but margins can
+    // still collapse through them, so they stay on the serial path
+    const css_computed_style_t* style = box->style;
+    if (!style) return false;
+    css_packed_value_t width = style->values[CSS_PROP_WIDTH];
+    return width.type == CSS_PACKED_LENGTH && css_packed_resolve(width, NULL, -1.0f) >= 0.0f &&
+           style->overflow_y != OVERFLOW_VISIBLE;
+}
+
+void layout_boxes_parallel(layout_box_t** boxes, const float* container_widths, uint32_t count) {
+    // Count the boxes that have work; a single one gains nothing from a thread
+    uint32_t dirty = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        if (box_needs_work(boxes[i], container_widths[i])) dirty++;
+    }
+    
+    layout_job_t* jobs = layout_pool && dirty > 1 ? malloc(dirty * sizeof(layout_job_t)) : NULL;
+    if (!jobs) {
+        for (uint32_t i = 0; i < count; i++) layout_box_if_needed(boxes[i], container_widths[i]);
+        return;
+    }
+    
+    // Each job writes only inside its own subtree, so the result does not
+    // depend on which thread runs it or in what order
+    worker_group_t group = { 0 };
+    uint32_t job_count = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        if (!box_needs_work(boxes[i], container_widths[i])) continue;
+        jobs[job_count].box = boxes[i];
+        jobs[job_count].container_width = container_widths[i];
+        worker_pool_submit(layout_pool, &group, layout_job_run, &jobs[job_count]);
+        job_count++;
+    }
+    worker_pool_wait(layout_pool, &group);
+    free(jobs);
+}
+
+void layout_children_parallel(layout_box_t* box, float container_width) {
+    if (!box || !layout_pool || box->child_count < 2) return;
+    
+    layout_box_t** boxes = malloc(box->child_count * sizeof(layout_box_t*));
+    float* widths = malloc(box->child_count * sizeof(float));
+    if (boxes && widths) {
+        uint32_t count = 0;
+        for (layout_box_t* child = box->first_child; child && count < box->child_count; child = child->next_sibling) {
+            if (!layout_is_independent(child)) continue;
+            boxes[count] = child;
+            widths[count] = container_width;
+            count++;
+        }
+        layout_boxes_parallel(boxes, widths, count);
+    }
+    free(boxes);
+    free(widths);
+}
@@ -0,0 +1,1029 @@
+#include "engine.h"
+#include "../worker_pool.h"
+#include "../capacity.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#define RASTER_MAX_SAVE_DEPTH 32
+#define RASTER_BAND_HEIGHT 64
+#define RASTER_IMAGE_CHUNK 256
+
+// Transform, clip and opacity a draw command runs under. Transforms are
+// kept axis-aligned: device = user * s + t.
+typedef struct {
+    float sx, sy;
+    float tx, ty;
+    rect_t clip;                    // Device space
+    float alpha;
+} raster_state_t;
+
+typedef struct {
+    const display_command_t* command;
+    rect_t bounds;                  // Device space, clipped
+    uint32_t state;
+} raster_item_t;
+
+// A display list binned into a grid of cells. Reused across repaints.
+typedef struct {
+    raster_item_t* items;
+    uint32_t item_count;
+    uint32_t item_capacity;
+    raster_state_t* states;
+    uint32_t state_count;
+    uint32_t state_capacity;
+    uint32_t* bin_starts;           // bin_count + 1 offsets into bin_items
+    uint32_t bin_count;
+    uint32_t bin_start_capacity;
+    uint32_t* bin_items;
+    uint32_t bin_item_capacity;
+} raster_bins_t;
+
+typedef struct {
+    uint32_t* pixels;               // RASTER_TILE_SIZE squared, NULL until painted
+    uint64_t version;               // Surface content version last rasterized
+} raster_tile_t;
+
+typedef struct raster_job raster_job_t;
+
+// Software backing store
+typedef struct {
+    uint32_t width;
+    uint32_t height;
+    uint32_t tiles_x;
+    uint32_t tiles_y;
+    raster_tile_t* tiles;
+    uint64_t content_version;
+    raster_bins_t bins;
+    raster_job_t* jobs;             // One per tile
+} raster_surface_t;
+
+typedef struct {
+    raster_framebuffer_t framebuffer;
+    raster_bins_t bins;
+    raster_job_t* jobs;             // One per band
+} raster_target_t;
+
+// One cell of a binned list drawn into pixels, which cover device space
+// from (origin_x, origin_y) with the given row stride
+struct raster_job {
+    const raster_bins_t* bins;
+    const display_list_t* list;
+    uint32_t bin;
+    uint32_t* pixels;
+    uint32_t stride;
+    int32_t origin_x, origin_y;
+    int32_t x0, y0, x1, y1;         // Device pixels to repaint
+};
+
+typedef struct {
+    raster_framebuffer_t* framebuffer;
+    paint_layer_t** layers;
+    uint32_t layer_count;
+    int32_t y0, y1;
+} raster_composite_job_t;
+
+static worker_pool_t* raster_pool;
+static raster_text_fn_t text_renderer;
+
+// Backing stores by texture id - 1. Created and destroyed on the main
+// thread only.
+static raster_surface_t** surfaces;
+static uint32_t surface_capacity;
+
+void raster_set_worker_pool(struct worker_pool* pool) {
+    raster_pool = pool;
+}
+
+void raster_set_text_renderer(raster_text_fn_t render_text) {
+    text_renderer = render_text;
+}
+
+// Pixels
+
+// 0xRRGGBBAA to premultiplied 0xAARRGGBB, with alpha scaled by opacity
+static uint32_t premultiply(uint32_t rgba, float opacity) {
+    uint32_t a = (uint32_t)((float)(rgba & 0xFF) * opacity + 0.5f);
+    if (a > 255) a = 255;
+    uint32_t r = ((rgba >> 24) & 0xFF) * a / 255;
+    uint32_t g = ((rgba >> 16) & 0xFF) * a / 255;
+    uint32_t b = ((rgba >> 8) & 0xFF) * a / 255;
+    return a << 24 | r << 16 | g << 8 | b;
+}
+
+static inline uint32_t div255(uint32_t value) {
+    value += 128;
+    return (value + (value >> 8)) >> 8;
+}
+
+// Source-over of premultiplied pixels
+static inline uint32_t blend_pixel(uint32_t dst, uint32_t src) {
+    uint32_t inverse = 255 - (src >> 24);
+    if (inverse == 0) return src;
+    if (inverse == 255) return dst;
+    
+    uint32_t result = 0;
+    for (uint32_t shift = 0; shift < 32; shift += 8) {
+        uint32_t channel = ((src >> shift) & 0xFF) + div255(((dst >> shift) & 0xFF) * inverse);
+        result |= (channel > 255 ? 255 : channel) << shift;
+    }
+    return result;
+}
+
+static inline uint32_t scale_pixel(uint32_t pixel, uint32_t alpha) {
+    uint32_t result = 0;
+    for (uint32_t shift = 0; shift < 32; shift += 8) {
+        result |= div255(((pixel >> shift) & 0xFF) * alpha) << shift;
+    }
+    return result;
+}
+
+#ifdef __SSE2__
+static inline __m128i div255_epi16(__m128i value) {
+    value = _mm_add_epi16(value, _mm_set1_epi16(128));
+    return _mm_srli_epi16(_mm_add_epi16(value, _mm_srli_epi16(value, 8)), 8);
+}
+
+// dst * inverse + src for four pixels, inverse per 16-bit channel
+static inline __m128i blend_4(__m128i dst, __m128i src, __m128i inverse_lo, __m128i inverse_hi) {
+    __m128i zero = _mm_setzero_si128();
+    __m128i lo = div255_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(dst, zero), inverse_lo));
+    __m128i hi = div255_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(dst, zero), inverse_hi));
+    return _mm_adds_epu8(_mm_packus_epi16(lo, hi), src);
+}
+#endif
+
+// Fills count pixels with one premultiplied color
+static void fill_span(uint32_t* dst, uint32_t count, uint32_t color) {
+    uint32_t alpha = color >> 24;
+    if (alpha == 0) return;
+    
+    uint32_t i = 0;
+#ifdef __SSE2__
+    __m128i src = _mm_set1_epi32((int)color);
+    if (alpha == 255) {
+        for (; i + 4 <= count; i += 4) {
+            _mm_storeu_si128((__m128i*)(dst + i), src);
+        }
+    } else {
+        __m128i inverse = _mm_set1_epi16((short)(255 - alpha));
+        for (; i + 4 <= count; i += 4) {
+            __m128i pixels = _mm_loadu_si128((const __m128i*)(dst + i));
+            _mm_storeu_si128((__m128i*)(dst + i), blend_4(pixels, src, inverse, inverse));
+        }
+    }
+#endif
+    if (alpha == 255) {
+        for (; i < count; i++) dst[i] = color;
+    } else {
+        for (; i < count; i++) dst[i] = blend_pixel(dst[i], color);
+    }
+}
+
+// Source-over of count premultiplied pixels, scaled by alpha (0-255)
+static void blend_span(uint32_t* dst, const uint32_t* src, uint32_t count, uint32_t alpha) {
+    if (alpha == 0) return;
+    
+    uint32_t i = 0;
+#ifdef __SSE2__
+    if (alpha == 255) {
+        __m128i alpha_mask = _mm_set1_epi32((int)0xFF000000u);
+        __m128i full = _mm_set1_epi16(255);
+        for (; i + 4 <= count; i += 4) {
+            __m128i pixels = _mm_loadu_si128((const __m128i*)(src + i));
+            
+            // Opaque runs are a plain copy
+            __m128i opaque = _mm_cmpeq_epi32(_mm_and_si128(pixels, alpha_mask), alpha_mask);
+            if (_mm_movemask_epi8(opaque) == 0xFFFF) {
+                _mm_storeu_si128((__m128i*)(dst + i), pixels);
+                continue;
+            }
+            
+            __m128i zero = _mm_setzero_si128();
+            __m128i lo = _mm_unpacklo_epi8(pixels, zero);
+            __m128i hi = _mm_unpackhi_epi8(pixels, zero);
+            lo = _mm_shufflehi_epi16(_mm_shufflelo_epi16(lo, 0xFF), 0xFF);
+            hi = _mm_shufflehi_epi16(_mm_shufflelo_epi16(hi, 0xFF), 0xFF);
+            __m128i target = _mm_loadu_si128((const __m128i*)(dst + i));
+            _mm_storeu_si128((__m128i*)(dst + i),
+                             blend_4(target, pixels, _mm_sub_epi16(full, lo), _mm_sub_epi16(full, hi)));
+        }
+    }
+#endif
+    if (alpha == 255) {
+        for (; i < count; i++) dst[i] = blend_pixel(dst[i], src[i]);
+    } else {
+        for (; i < count; i++) dst[i] = blend_pixel(dst[i], scale_pixel(src[i], alpha));
+    }
+}
+
+// Geometry
+
+static bool rect_is_empty(const rect_t* rect) {
+    return rect->width <= 0 || rect->height <= 0;
+}
+
+static rect_t rect_intersect(const rect_t* a, const rect_t* b) {
+    rect_t result = { 0, 0, 0, 0 };
+    float x1 = a->x > b->x ? a->x : b->x;
+    float y1 = a->y > b->y ? a->y : b->y;
+    float x2 = a->x + a->width < b->x + b->width ? a->x + a->width : b->x + b->width;
+    float y2 = a->y + a->height < b->y + b->height ? a->y + a->height : b->y + b->height;
+    if (x2 > x1 && y2 > y1) {
+        result.x = x1;
+        result.y = y1;
+        result.width = x2 - x1;
+        result.height = y2 - y1;
+    }
+    return result;
+}
+
+static rect_t transform_rect(const raster_state_t* state, const rect_t* rect) {
+    rect_t result = {
+        rect->x * state->sx + state->tx,
+        rect->y * state->sy + state->ty,
+        rect->width * state->sx,
+        rect->height * state->sy
+    };
+    // Negative scales flip the rect
+    if (result.width < 0) {
+        result.x += result.width;
+        result.width = -result.width;
+    }
+    if (result.height < 0) {
+        result.y += result.height;
+        result.height = -result.height;
+    }
+    return result;
+}
+
+// Pixels whose centres fall inside rect, limited to the job's area
+static bool pixel_span(const raster_job_t* job, const rect_t* rect, int32_t* x0, int32_t* y0, int32_t* x1, int32_t* y1) {
+    *x0 = (int32_t)floorf(rect->x + 0.5f);
+    *y0 = (int32_t)floorf(rect->y + 0.5f);
+    *x1 = (int32_t)floorf(rect->x + rect->width + 0.5f);
+    *y1 = (int32_t)floorf(rect->y + rect->height + 0.5f);
+    if (*x0 < job->x0) *x0 = job->x0;
+    if (*y0 < job->y0) *y0 = job->y0;
+    if (*x1 > job->x1) *x1 = job->x1;
+    if (*y1 > job->y1) *y1 = job->y1;
+    return *x1 > *x0 && *y1 > *y0;
+}
+
+static inline uint32_t* pixel_at(const raster_job_t* job, int32_t x, int32_t y) {
+    return job->pixels + (size_t)(y - job->origin_y) * job->stride + (x - job->origin_x);
+}
+
+// Binning
+
+static bool reserve(void** buffer, uint32_t* capacity, uint32_t needed, size_t element_size) {
+    if (needed <= *capacity) return true;
+    uint32_t new_capacity = capacity_reserve(*capacity, needed, 64, element_size);
+    void* grown = new_capacity ? realloc(*buffer, (size_t)new_capacity * element_size) : NULL;
+    if (!grown) return false;
+    *buffer = grown;
+    *capacity = new_capacity;
+    return true;
+}
+
+static uint32_t push_state(raster_bins_t* bins, const raster_state_t* state) {
+    if (!reserve((void**)&bins->states, &bins->state_capacity, bins->state_count + 1, sizeof(raster_state_t))) {
+        return bins->state_count ? bins->state_count - 1 : 0;
+    }
+    bins->states[bins->state_count] = *state;
+    return bins->state_count++;
+}
+
+// User-space bounds of a draw command; false if it draws nothing here
+static bool command_bounds(const display_list_t* list, const display_command_t* command, rect_t* bounds) {
+    switch (command->type) {
+        case DISPLAY_DRAW_RECT:
+        case DISPLAY_FILL_RECT: {
+            *bounds = ((const display_rect_t*)command)->rect;
+            return true;
+        }
+        case DISPLAY_STROKE_RECT: {
+            const display_rect_t* rect = (const display_rect_t*)command;
+            float half = rect->stroke_width * 0.5f;
+            *bounds = rect->rect;
+            bounds->x -= half;
+            bounds->y -= half;
+            bounds->width += rect->stroke_width;
+            bounds->height += rect->stroke_width;
+            return true;
+        }
+        case DISPLAY_DRAW_ROUNDED_RECT: {
+            *bounds = ((const display_rounded_rect_t*)command)->rect;
+            return true;
+        }
+        case DISPLAY_DRAW_TEXT: {
+            if (!text_renderer) return false;
+            const display_text_t* text = (const display_text_t*)command;
+            text_shape_t* shape = text_cache_shape(text->font, text->font_size, display_list_string(list, text->text), text->length);
+            if (!shape) return false;
+            bounds->x = text->x;
+            bounds->y = text->y - shape->ascent;
+            bounds->width = text_shape_measure(shape, 0, shape->length);
+            bounds->height = shape->ascent + shape->descent;
+            text_shape_release(shape);
+            return true;
+        }
+        case DISPLAY_DRAW_IMAGE: {
+            *bounds = ((const display_image_t*)command)->dst_rect;
+            return display_list_resource(list, ((const display_image_t*)command)->image) != NULL;
+        }
+        case DISPLAY_DRAW_LINE: {
+            const display_line_t* line = (const display_line_t*)command;
+            float half = line->width * 0.5f;
+            bounds->x = (line->x1 < line->x2 ? line->x1 : line->x2) - half;
+            bounds->y = (line->y1 < line->y2 ? line->y1 : line->y2) - half;
+            bounds->width = fabsf(line->x2 - line->x1) + line->width;
+            bounds->height = fabsf(line->y2 - line->y1) + line->width;
+            return true;
+        }
+        default:
+            // Paths need a scan converter the software path does not have
+            return false;
+    }
+}
+
+
+static void cell_range(float start, float length, uint32_t cell_size, uint32_t count, uint32_t* first, uint32_t* end) {
+    int32_t lo = (int32_t)floorf(start / (float)cell_size);
+    int32_t hi = (int32_t)ceilf((start + length) / (float)cell_size);
+    if (lo < 0) lo = 0;
+    if (hi > (int32_t)count) hi = (int32_t)count;
+    *first = (uint32_t)lo;
+    *end = hi > lo ? (uint32_t)hi : (uint32_t)lo;
+}
+
+// Bins list into a cols x rows grid of cell_width x cell_height cells
+// starting at device (0, 0), with user space shifted by -origin
+static bool bin_display_list(raster_bins_t* bins, const display_list_t* list, float origin_x, float origin_y,
+                             uint32_t cell_width, uint32_t cell_height, uint32_t cols, uint32_t rows) {
+    bins->item_count = 0;
+    bins->state_count = 0;
+    bins->bin_count = 0;
+    
+    uint32_t bin_count = cols * rows;
+    if (!reserve((void**)&bins->bin_starts, &bins->bin_start_capacity, bin_count + 1, sizeof(uint32_t))) return false;
+    
+    raster_state_t state = {
+        1.0f, 1.0f, -origin_x, -origin_y,
+        { 0, 0, (float)(cols * cell_width), (float)(rows * cell_height) },
+        1.0f
+    };
+    raster_state_t stack[RASTER_MAX_SAVE_DEPTH];
+    uint32_t depth = 0;
+    uint32_t overflow = 0;
+    
+    uint32_t current = push_state(bins, &state);
+    if (!bins->state_count) return false;
+    bool state_changed = false;
+    
+    // Resolve state and device bounds for every draw command
+    for (const display_command_t* command = display_list_first(list); command; command = display_list_next(list, command)) {
+        switch (command->type) {
+            case DISPLAY_SAVE:
+                if (depth < RASTER_MAX_SAVE_DEPTH) {
+                    stack[depth++] = state;
+                } else {
+                    overflow++;
+                }
+                continue;
+            case DISPLAY_RESTORE:
+                if (overflow) {
+                    overflow--;
+                } else if (depth) {
+                    state = stack[--depth];
+                    state_changed = true;
+                }
+                continue;
+            case DISPLAY_TRANSLATE: {
+                const display_transform_2d_t* translate = (const display_transform_2d_t*)command;
+                state.tx += translate->x * state.sx;
+                state.ty += translate->y * state.sy;
+                state_changed = true;
+                continue;
+            }
+            case DISPLAY_SCALE: {
+                const display_transform_2d_t* scale = (const display_transform_2d_t*)command;
+                state.sx *= scale->x;
+                state.sy *= scale->y;
+                state_changed = true;
+                continue;
+            }
+            case DISPLAY_SET_TRANSFORM: {
+                // Column-major 4x4; only scale and translation are kept
+                const float* matrix = ((const display_matrix_t*)command)->matrix;
+                state.sx = matrix[0];
+                state.sy = matrix[5];
+                state.tx = matrix[12] - origin_x;
+                state.ty = matrix[13] - origin_y;
+                state_changed = true;
+                continue;
+            }
+            case DISPLAY_CLIP_RECT: {
+                rect_t clip = transform_rect(&state, &((const display_rect_t*)command)->rect);
+                state.clip = rect_intersect(&state.clip, &clip);
+                state_changed = true;
+                continue;
+            }
+            case DISPLAY_SET_OPACITY: {
+                float opacity = ((const display_state_t*)command)->value.opacity;
+                state.alpha = opacity < 0.0f ? 0.0f : opacity > 1.0f ? 1.0f : opacity;
+                state_changed = true;
+                continue;
+            }
+            case DISPLAY_ROTATE:
+            case DISPLAY_SET_BLEND_MODE:
+                continue;
+            default:
+                break;
+        }
+        
+        rect_t bounds;
+        if (state.alpha <= 0.0f || !command_bounds(list, command, &bounds)) continue;
+        bounds = transform_rect(&state, &bounds);
+        bounds = rect_intersect(&bounds, &state.clip);
+        if (rect_is_empty(&bounds)) continue;
+        
+        if (state_changed) {
+            current = push_state(bins, &state);
+            state_changed = false;
+        }
+        if (!reserve((void**)&bins->items, &bins->item_capacity, bins->item_count + 1, sizeof(raster_item_t))) return false;
+        raster_item_t* item = &bins->items[bins->item_count++];
+        item->command = command;
+        item->bounds = bounds;
+        item->state = current;
+    }
+    
+    // Count items per cell, then fill using the starts as cursors
+    memset(bins->bin_starts, 0, (bin_count + 1) * sizeof(uint32_t));
+    for (uint32_t i = 0; i < bins->item_count; i++) {
+        uint32_t c0, c1, r0, r1;
+        cell_range(bins->items[i].bounds.x, bins->items[i].bounds.width, cell_width, cols, &c0, &c1);
+        cell_range(bins->items[i].bounds.y, bins->items[i].bounds.height, cell_height, rows, &r0, &r1);
+        for (uint32_t r = r0; r < r1; r++) {
+            for (uint32_t c = c0; c < c1; c++) bins->bin_starts[r * cols + c]++;
+        }
+    }
+    
+    uint32_t total = 0;
+    for (uint32_t b = 0; b < bin_count; b++) {
+        uint32_t count = bins->bin_starts[b];
+        bins->bin_starts[b] = total;
+        total += count;
+    }
+    bins->bin_starts[bin_count] = total;
+    if (!reserve((void**)&bins->bin_items, &bins->bin_item_capacity, total ? total : 1, sizeof(uint32_t))) return false;
+    
+    for (uint32_t i = 0; i < bins->item_count; i++) {
+        uint32_t c0, c1, r0, r1;
+        cell_range(bins->items[i].bounds.x, bins->items[i].bounds.width, cell_width, cols, &c0, &c1);
+        cell_range(bins->items[i].bounds.y, bins->items[i].bounds.height, cell_height, rows, &r0, &r1);
+        for (uint32_t r = r0; r < r1; r++) {
+            for (uint32_t c = c0; c < c1; c++) bins->bin_items[bins->bin_starts[r * cols + c]++] = i;
+        }
+    }
+    
+    // Each cursor now sits at the next cell's start
+    for (uint32_t b = bin_count; b > 0; b--) bins->bin_starts[b] = bins->bin_starts[b - 1];
+    bins->bin_starts[0] = 0;
+    
+    bins->bin_count = bin_count;
+    return true;
+}
+
+static void free_bins(raster_bins_t* bins) {
+    free(bins->items);
+    free(bins->states);
+    free(bins->bin_starts);
+    free(bins->bin_items);
+    memset(bins, 0, sizeof(*bins));
+}
+
+// Drawing
+
+static void fill_device_rect(const raster_job_t* job, const rect_t* rect, uint32_t color) {
+    int32_t x0, y0, x1, y1;
+    if (!pixel_span(job, rect, &x0, &y0, &x1, &y1)) return;
+    for (int32_t y = y0; y < y1; y++) {
+        fill_span(pixel_at(job, x0, y), (uint32_t)(x1 - x0), color);
+    }
+}
+
+static void stroke_device_rect(const raster_job_t* job, const rect_t* rect, float width_x, float width_y, uint32_t color) {
+    rect_t outer = { rect->x - width_x * 0.5f, rect->y - width_y * 0.5f, rect->width + width_x, rect->height + width_y };
+    float inner_height = rect->height - width_y;
+    
+    rect_t top = { outer.x, outer.y, outer.width, width_y };
+    rect_t bottom = { outer.x, outer.y + outer.height - width_y, outer.width, width_y };
+    fill_device_rect(job, &top, color);
+    if (outer.height > 2 * width_y) fill_device_rect(job, &bottom, color);
+    if (inner_height <= 0) return;
+    
+    // Sides between the top and bottom edges so no pixel is blended twice
+    rect_t left = { outer.x, outer.y + width_y, width_x, inner_height };
+    rect_t right = { outer.x + outer.width - width_x, outer.y + width_y, width_x, inner_height };
+    fill_device_rect(job, &left, color);
+    if (outer.width > 2 * width_x) fill_device_rect(job, &right, color);
+}
+
+// Horizontal inset of a rounded rect's edge at row centre y
+static float corner_inset(float y, const rect_t* rect, float top_radius, float bottom_radius) {
+    float radius;
+    float distance;
+    if (top_radius > 0 && y < rect->y + top_radius) {
+        radius = top_radius;
+        distance = rect->y + top_radius - y;
+    } else if (bottom_radius > 0 && y > rect->y + rect->height - bottom_radius) {
+        radius = bottom_radius;
+        distance = y - (rect->y + rect->height - bottom_radius);
+    } else {
+        return 0.0f;
+    }
+    if (distance > radius) distance = radius;
+    return radius - sqrtf(radius * radius - distance * distance);
+}
+
+static void fill_rounded_rect(const raster_job_t* job, const rect_t* rect, const float border_radius[4], float scale, uint32_t color) {
+    // Radii in device pixels, limited to half the box
+    float limit = (rect->width < rect->height ? rect->width : rect->height) * 0.5f;
+    float radius[4];
+    for (int i = 0; i < 4; i++) {
+        radius[i] = border_radius[i] * scale;
+        if (radius[i] > limit) radius[i] = limit;
+    }
+    
+    int32_t x0, y0, x1, y1;
+    if (!pixel_span(job, rect, &x0, &y0, &x1, &y1)) return;
+    for (int32_t y = y0; y < y1; y++) {
+        float center = (float)y + 0.5f;
+        float left = rect->x + corner_inset(center, rect, radius[0], radius[3]);
+        float right = rect->x + rect->width - corner_inset(center, rect, radius[1], radius[2]);
+        int32_t start = (int32_t)floorf(left + 0.5f);
+        int32_t end = (int32_t)floorf(right + 0.5f);
+        if (start < x0) start = x0;
+        if (end > x1) end = x1;
+        if (end > start) fill_span(pixel_at(job, start, y), (uint32_t)(end - start), color);
+    }
+}
+
+static void draw_line(const raster_job_t* job, const raster_item_t* item, const raster_state_t* state, const display_line_t* line, uint32_t color) {
+    float x1 = line->x1 * state->sx + state->tx;
+    float y1 = line->y1 * state->sy + state->ty;
+    float x2 = line->x2 * state->sx + state->tx;
+    float y2 = line->y2 * state->sy + state->ty;
+    float dx = x2 - x1;
+    float dy = y2 - y1;
+    
+    // Horizontal lines are rects; anything else is scanned row by row
+    if (fabsf(dy) < 0.5f) {
+        fill_device_rect(job, &item->bounds, color);
+        return;
+    }
+    
+    float half = line->width * 0.5f * fabsf(state->sx);
+    float extent = half * sqrtf(dx * dx + dy * dy) / fabsf(dy);
+    int32_t x0, y0, xe, ye;
+    if (!pixel_span(job, &item->bounds, &x0, &y0, &xe, &ye)) return;
+    
+    for (int32_t y = y0; y < ye; y++) {
+        float center = x1 + ((float)y + 0.5f - y1) * dx / dy;
+        int32_t start = (int32_t)floorf(center - extent + 0.5f);
+        int32_t end = (int32_t)floorf(center + extent + 0.5f);
+        if (end == start) end++;
+        if (start < x0) start = x0;
+        if (end > xe) end = xe;
+        if (end > start) fill_span(pixel_at(job, start, y), (uint32_t)(end - start), color);
+    }
+}
+
+// Nearest-neighbour scaled blit
+static void draw_image(const raster_job_t* job, const raster_item_t* item, const raster_state_t* state, const display_image_t* command) {
+    const raster_image_t* image = display_list_resource(job->list, command->image);
+    if (!image || !image->pixels || !image->width || !image->height) return;
+    
+    rect_t src = command->src_rect;
+    if (rect_is_empty(&src)) {
+        src.x = 0;
+        src.y = 0;
+        src.width = (float)image->width;
+        src.height = (float)image->height;
+    }
+    rect_t dst = transform_rect(state, &command->dst_rect);
+    if (rect_is_empty(&dst)) return;
+    
+    int32_t x0, y0, x1, y1;
+    if (!pixel_span(job, &item->bounds, &x0, &y0, &x1, &y1)) return;
+    
+    uint32_t alpha = (uint32_t)(state->alpha * 255.0f + 0.5f);
+    float step_x = src.width / dst.width;
+    float step_y = src.height / dst.height;
+    uint32_t row[RASTER_IMAGE_CHUNK];
+    
+    for (int32_t y = y0; y < y1; y++) {
+        int32_t sy = (int32_t)(src.y + ((float)y + 0.5f - dst.y) * step_y);
+        if (sy < 0) sy = 0;
+        if (sy >= (int32_t)image->height) sy = (int32_t)image->height - 1;
+        const uint32_t* source = image->pixels + (size_t)sy * image->stride;
+        
+        for (int32_t x = x0; x < x1; x += RASTER_IMAGE_CHUNK) {
+            uint32_t count = (uint32_t)(x1 - x < RASTER_IMAGE_CHUNK ? x1 - x : RASTER_IMAGE_CHUNK);
+            for (uint32_t i = 0; i < count; i++) {
+                int32_t sx = (int32_t)(src.x + ((float)(x + (int32_t)i) + 0.5f - dst.x) * step_x);
+                if (sx < 0) sx = 0;
+                if (sx >= (int32_t)image->width) sx = (int32_t)image->width - 1;
+                row[i] = source[sx];
+            }
+            blend_span(pixel_at(job, x, y), row, count, alpha);
+        }
+    }
+}
+
+static void draw_text(const raster_job_t* job, const raster_item_t* item, const raster_state_t* state, const display_text_t* text) {
+    int32_t x0, y0, x1, y1;
+    if (!text_renderer || !pixel_span(job, &item->bounds, &x0, &y0, &x1, &y1)) return;
+    
+    rect_t clip = { (float)x0, (float)y0, (float)(x1 - x0), (float)(y1 - y0) };
+    text_renderer(pixel_at(job, x0, y0), job->stride, &clip,
+                  display_list_string(job->list, text->text), text->length,
+                  text->font, text->font_size * state->sy,
+                  text->x * state->sx + state->tx, text->y * state->sy + state->ty,
+                  premultiply(text->color, state->alpha));
+}
+
+static void draw_item(const raster_job_t* job, const raster_item_t* item) {
+    const raster_state_t* state = &job->bins->states[item->state];
+    const display_command_t* command = item->command;
+    
+    switch (command->type) {
+        case DISPLAY_DRAW_RECT:
+        case DISPLAY_FILL_RECT:
+            fill_device_rect(job, &item->bounds, premultiply(((const display_rect_t*)command)->color, state->alpha));
+            break;
+        case DISPLAY_STROKE_RECT: {
+            const display_rect_t* rect = (const display_rect_t*)command;
+            rect_t device = transform_rect(state, &rect->rect);
+            stroke_device_rect(job, &device, rect->stroke_width * fabsf(state->sx), rect->stroke_width * fabsf(state->sy),
+                               premultiply(rect->color, state->alpha));
+            break;
+        }
+        case DISPLAY_DRAW_ROUNDED_RECT: {
+            const display_rounded_rect_t* rect = (const display_rounded_rect_t*)command;
+            rect_t device = transform_rect(state, &rect->rect);
+            float scale = fabsf(state->sx) < fabsf(state->sy) ? fabsf(state->sx) : fabsf(state->sy);
+            fill_rounded_rect(job, &device, rect->border_radius, scale, premultiply(rect->color, state->alpha));
+            break;
+        }
+        case DISPLAY_DRAW_LINE: {
+            const display_line_t* line = (const display_line_t*)command;
+            draw_line(job, item, state, line, premultiply(line->color, state->alpha));
+            break;
+        }
+        case DISPLAY_DRAW_IMAGE:
+            draw_image(job, item, state, (const display_image_t*)command);
+            break;
+        case DISPLAY_DRAW_TEXT:
+            draw_text(job, item, state, (const display_text_t*)command);
+            break;
+        default:
+            break;
+    }
+}
+
+// Clears the job's area and draws the cell's items into it, in list order
+static void run_raster_job(void* data) {
+    raster_job_t* job = data;
+    
+    for (int32_t y = job->y0; y < job->y1; y++) {
+        memset(pixel_at(job, job->x0, y), 0, (size_t)(job->x1 - job->x0) * sizeof(uint32_t));
+    }
+    
+    const raster_bins_t* bins = job->bins;
+    for (uint32_t i = bins->bin_starts[job->bin]; i < bins->bin_starts[job->bin + 1]; i++) {
+        draw_item(job, &bins->items[bins->bin_items[i]]);
+    }
+}
+
+// Backing stores
+
+static raster_surface_t* surface_lookup(uint32_t texture_id) {
+    return texture_id && texture_id <= surface_capacity ? surfaces[texture_id - 1] : NULL;
+}
+
+static void surface_destroy(raster_surface_t* surface) {
+    if (!surface) return;
+    if (surface->tiles) {
+        for (uint32_t i = 0; i < surface->tiles_x * surface->tiles_y; i++) {
+            free(surface->tiles[i].pixels);
+        }
+    }
+    free(surface->tiles);
+    free(surface->jobs);
+    free_bins(&surface->bins);
+    free(surface);
+}
+
+static raster_surface_t* surface_create(uint32_t width, uint32_t height) {
+    raster_surface_t* surface = calloc(1, sizeof(raster_surface_t));
+    if (!surface) return NULL;
+    
+    surface->width = width;
+    surface->height = height;
+    surface->tiles_x = (width + RASTER_TILE_SIZE - 1) / RASTER_TILE_SIZE;
+    surface->tiles_y = (height + RASTER_TILE_SIZE - 1) / RASTER_TILE_SIZE;
+    
+    // Tile pixels are allocated when first painted
+    uint32_t tile_count = surface->tiles_x * surface->tiles_y;
+    surface->tiles = calloc(tile_count, sizeof(raster_tile_t));
+    surface->jobs = calloc(tile_count, sizeof(raster_job_t));
+    if (!surface->tiles || !surface->jobs) {
+        surface_destroy(surface);
+        return NULL;
+    }
+    return surface;
+}
+
+uint32_t raster_surface_create(uint32_t width, uint32_t height) {
+    if (!width || !height) return 0;
+    
+    uint32_t slot = 0;
+    while (slot < surface_capacity && surfaces[slot]) slot++;
+    if (slot == surface_capacity) {
+        uint32_t capacity = capacity_grow(surface_capacity, 16, sizeof(raster_surface_t*));
+        raster_surface_t** grown = capacity ? realloc(surfaces, capacity * sizeof(raster_surface_t*)) : NULL;
+        if (!grown) return 0;
+        memset(grown + surface_capacity, 0, (capacity - surface_capacity) * sizeof(raster_surface_t*));
+        surfaces = grown;
+        surface_capacity = capacity;
+    }
+    
+    surfaces[slot] = surface_create(width, height);
+    return surfaces[slot] ? slot + 1 : 0;
+}
+
+void raster_surface_destroy(uint32_t surface_id) {
+    raster_surface_t* surface = surface_lookup(surface_id);
+    if (!surface) return;
+    surface_destroy(surface);
+    surfaces[surface_id - 1] = NULL;
+}
+
+const uint32_t* raster_surface_tile(uint32_t surface_id, uint32_t tile_x, uint32_t tile_y) {
+    const raster_surface_t* surface = surface_lookup(surface_id);
+    if (!surface || tile_x >= surface->tiles_x || tile_y >= surface->tiles_y) return NULL;
+    return surface->tiles[tile_y * surface->tiles_x + tile_x].pixels;
+}
+
+// Rasterizes the tiles under dirty_rect (in list space); every other tile
+// keeps the pixels of the version it was last rasterized at
+void raster_surface_repaint(uint32_t surface_id, const display_list_t* list, float origin_x, float origin_y, const rect_t* dirty_rect) {
+    raster_surface_t* surface = surface_lookup(surface_id);
+    if (!surface || !list) return;
+    
+    origin_x = floorf(origin_x);
+    origin_y = floorf(origin_y);
+    if (!bin_display_list(&surface->bins, list, origin_x, origin_y,
+                          RASTER_TILE_SIZE, RASTER_TILE_SIZE, surface->tiles_x, surface->tiles_y)) {
+        return;
+    }
+    surface->content_version++;
+    
+    // Damage in surface pixels
+    int32_t x0 = 0, y0 = 0;
+    int32_t x1 = (int32_t)surface->width, y1 = (int32_t)surface->height;
+    if (dirty_rect) {
+        int32_t dx0 = (int32_t)floorf(dirty_rect->x - origin_x);
+        int32_t dy0 = (int32_t)floorf(dirty_rect->y - origin_y);
+        int32_t dx1 = (int32_t)ceilf(dirty_rect->x + dirty_rect->width - origin_x);
+        int32_t dy1 = (int32_t)ceilf(dirty_rect->y + dirty_rect->height - origin_y);
+        if (dx0 > x0) x0 = dx0;
+        if (dy0 > y0) y0 = dy0;
+        if (dx1 < x1) x1 = dx1;
+        if (dy1 < y1) y1 = dy1;
+    }
+    if (x1 <= x0 || y1 <= y0) return;
+    
+    worker_group_t group = { 0 };
+    for (uint32_t ty = (uint32_t)y0 / RASTER_TILE_SIZE; ty <= (uint32_t)(y1 - 1) / RASTER_TILE_SIZE; ty++) {
+        for (uint32_t tx = (uint32_t)x0 / RASTER_TILE_SIZE; tx <= (uint32_t)(x1 - 1) / RASTER_TILE_SIZE; tx++) {
+            uint32_t index = ty * surface->tiles_x + tx;
+            raster_tile_t* tile = &surface->tiles[index];
+            
+            // A new tile has no old pixels worth keeping
+            bool fresh = !tile->pixels;
+            if (fresh) {
+                tile->pixels = malloc(RASTER_TILE_SIZE * RASTER_TILE_SIZE * sizeof(uint32_t));
+                if (!tile->pixels) continue;
+            }
+            
+            int32_t tile_x = (int32_t)(tx * RASTER_TILE_SIZE);
+            int32_t tile_y = (int32_t)(ty * RASTER_TILE_SIZE);
+            raster_job_t* job = &surface->jobs[index];
+            job->bins = &surface->bins;
+            job->list = list;
+            job->bin = index;
+            job->pixels = tile->pixels;
+            job->stride = RASTER_TILE_SIZE;
+            job->origin_x = tile_x;
+            job->origin_y = tile_y;
+            job->x0 = fresh || x0 < tile_x ? tile_x : x0;
+            job->y0 = fresh || y0 < tile_y ? tile_y : y0;
+            job->x1 = fresh || x1 > tile_x + RASTER_TILE_SIZE ? tile_x + RASTER_TILE_SIZE : x1;
+            job->y1 = fresh || y1 > tile_y + RASTER_TILE_SIZE ? tile_y + RASTER_TILE_SIZE : y1;
+            
+            tile->version = surface->content_version;
+            worker_pool_submit(raster_pool, &group, run_raster_job, job);
+        }
+    }
+    worker_pool_wait(raster_pool, &group);
+}
+
+static void software_repaint(paint_layer_t* layer, rect_t* dirty_rect) {
+    raster_surface_repaint(layer->compositing.texture_id, layer->display_list, layer->bounds.x, layer->bounds.y, dirty_rect);
+}
+
+// Frame target
+
+static uint32_t band_count(uint32_t height) {
+    return (height + RASTER_BAND_HEIGHT - 1) / RASTER_BAND_HEIGHT;
+}
+
+raster_framebuffer_t* raster_create_framebuffer(uint32_t width, uint32_t height) {
+    if (!width || !height) return NULL;
+    
+    raster_target_t* target = calloc(1, sizeof(raster_target_t));
+    if (!target) return NULL;
+    
+    target->framebuffer.width = width;
+    target->framebuffer.height = height;
+    target->framebuffer.pixels = calloc((size_t)width * height, sizeof(uint32_t));
+    target->jobs = calloc(band_count(height), sizeof(raster_job_t));
+    if (!target->framebuffer.pixels || !target->jobs) {
+        raster_destroy_framebuffer(&target->framebuffer);
+        return NULL;
+    }
+    return &target->framebuffer;
+}
+
+void raster_destroy_framebuffer(raster_framebuffer_t* framebuffer) {
+    if (!framebuffer) return;
+    raster_target_t* target = (raster_target_t*)framebuffer;
+    free(target->framebuffer.pixels);
+    free(target->jobs);
+    free_bins(&target->bins);
+    free(target);
+}
+
+// Draws a whole list into the frame target, one band per task
+static void software_execute_display_list(void* context, display_list_t* list) {
+    raster_target_t* target = context;
+    if (!target || !list) return;
+    
+    raster_framebuffer_t* framebuffer = &target->framebuffer;
+    uint32_t bands = band_count(framebuffer->height);
+    if (!bin_display_list(&target->bins, list, 0.0f, 0.0f, framebuffer->width, RASTER_BAND_HEIGHT, 1, bands)) return;
+    
+    worker_group_t group = { 0 };
+    for (uint32_t band = 0; band < bands; band++) {
+        raster_job_t* job = &target->jobs[band];
+        job->bins = &target->bins;
+        job->list = list;
+        job->bin = band;
+        job->pixels = framebuffer->pixels;
+        job->stride = framebuffer->width;
+        job->origin_x = 0;
+        job->origin_y = 0;
+        job->x0 = 0;
+        job->y0 = (int32_t)(band * RASTER_BAND_HEIGHT);
+        job->x1 = (int32_t)framebuffer->width;
+        job->y1 = job->y0 + RASTER_BAND_HEIGHT > (int32_t)framebuffer->height ? (int32_t)framebuffer->height : job->y0 + RASTER_BAND_HEIGHT;
+        worker_pool_submit(raster_pool, &group, run_raster_job, job);
+    }
+    worker_pool_wait(raster_pool, &group);
+}
+
+// Compositing
+
+static void composite_layer_rows(raster_framebuffer_t* framebuffer, const paint_layer_t* layer, int32_t band_y0, int32_t band_y1) {
+    const raster_surface_t* surface = surface_lookup(layer->compositing.texture_id);
+    if (!surface) return;
+    
+    float opacity = layer->compositing.opacity;
+    uint32_t alpha = opacity >= 1.0f ? 255 : opacity <= 0.0f ? 0 : (uint32_t)(opacity * 255.0f + 0.5f);
+    if (!alpha) return;
+    
+    int32_t left = (int32_t)floorf(layer->bounds.x);
+    int32_t top = (int32_t)floorf(layer->bounds.y);
+    int32_t x0 = left > 0 ? left : 0;
+    int32_t y0 = top > band_y0 ? top : band_y0;
+    int32_t x1 = left + (int32_t)surface->width;
+    int32_t y1 = top + (int32_t)surface->height;
+    if (x1 > (int32_t)framebuffer->width) x1 = (int32_t)framebuffer->width;
+    if (y1 > band_y1) y1 = band_y1;
+    if (layer->has_clip) {
+        int32_t cx0 = (int32_t)floorf(layer->clip_rect.x);
+        int32_t cy0 = (int32_t)floorf(layer->clip_rect.y);
+        int32_t cx1 = (int32_t)ceilf(layer->clip_rect.x + layer->clip_rect.width);
+        int32_t cy1 = (int32_t)ceilf(layer->clip_rect.y + layer->clip_rect.height);
+        if (cx0 > x0) x0 = cx0;
+        if (cy0 > y0) y0 = cy0;
+        if (cx1 < x1) x1 = cx1;
+        if (cy1 < y1) y1 = cy1;
+    }
+    if (x1 <= x0 || y1 <= y0) return;
+    
+    for (int32_t y = y0; y < y1; y++) {
+        uint32_t surface_y = (uint32_t)(y - top);
+        const raster_tile_t* row_tiles = &surface->tiles[(surface_y / RASTER_TILE_SIZE) * surface->tiles_x];
+        uint32_t* dst = framebuffer->pixels + (size_t)y * framebuffer->width;
+        
+        for (int32_t x = x0; x < x1;) {
+            uint32_t surface_x = (uint32_t)(x - left);
+            uint32_t tile_x = surface_x / RASTER_TILE_SIZE;
+            uint32_t offset = surface_x % RASTER_TILE_SIZE;
+            uint32_t count = RASTER_TILE_SIZE - offset;
+            if ((int32_t)count > x1 - x) count = (uint32_t)(x1 - x);
+            
+            const raster_tile_t* tile = &row_tiles[tile_x];
+            if (tile->pixels) {
+                const uint32_t* src = tile->pixels + (surface_y % RASTER_TILE_SIZE) * RASTER_TILE_SIZE + offset;
+                blend_span(dst + x, src, count, alpha);
+            }
+            x += (int32_t)count;
+        }
+    }
+}
+
+static void run_composite_job(void* data) {
+    raster_composite_job_t* job = data;
+    raster_framebuffer_t* framebuffer = job->framebuffer;
+    
+    // Opaque white page background
+    for (int32_t y = job->y0; y < job->y1; y++) {
+        fill_span(framebuffer->pixels + (size_t)y * framebuffer->width, framebuffer->width, 0xFFFFFFFFu);
+    }
+    for (uint32_t i = 0; i < job->layer_count; i++) {
+        composite_layer_rows(framebuffer, job->layers[i], job->y0, job->y1);
+    }
+}
+
+// Blends the layers' backing stores into the framebuffer in paint order.
+// Bands of rows run in parallel; each band composites every layer, so
+// layer order is kept without locking.
+void raster_composite_layers(raster_framebuffer_t* framebuffer, paint_layer_t** layers, uint32_t layer_count) {
+    if (!framebuffer) return;
+    
+    uint32_t bands = band_count(framebuffer->height);
+    raster_composite_job_t* jobs = calloc(bands, sizeof(raster_composite_job_t));
+    if (!jobs) return;
+    
+    worker_group_t group = { 0 };
+    for (uint32_t band = 0; band < bands; band++) {
+        raster_composite_job_t* job = &jobs[band];
+        job->framebuffer = framebuffer;
+        job->layers = layers;
+        job->layer_count = layer_count;
+        job->y0 = (int32_t)(band * RASTER_BAND_HEIGHT);
+        job->y1 = job->y0 + RASTER_BAND_HEIGHT > (int32_t)framebuffer->height ? (int32_t)framebuffer->height : job->y0 + RASTER_BAND_HEIGHT;
+        worker_pool_submit(raster_pool, &group, run_composite_job, job);
+    }
+    worker_pool_wait(raster_pool, &group);
+    free(jobs);
+}
+
+// Pipeline hooks
+
+static void* software_create_context(uint32_t width, uint32_t height) {
+    return raster_create_framebuffer(width, height);
+}
+
+static void software_destroy_context(void* context) {
+    raster_destroy_framebuffer(context);
+}
+
+static void software_flush(void* context) {
+    (void)context;
+}
+
+static void software_present(void* context) {
+    (void)context;
+}
+
+void raster_install_software(render_pipeline_t* pipeline) {
+    if (!pipeline) return;
+    pipeline->compositor.create_backing_store = raster_surface_create;
+    pipeline->compositor.destroy_backing_store = raster_surface_destroy;
+    pipeline->paint.repaint = software_repaint;
+    pipeline->raster.create_context = software_create_context;
+    pipeline->raster.execute_display_list = software_execute_display_list;
+    pipeline->raster.flush = software_flush;
+    pipeline->raster.present = software_present;
+    pipeline->raster.destroy_context = software_destroy_context;
+}
@@ -0,0 +1,195 @@
+#include "engine.h"
+#include "../css/style.h"
+#include "../capacity.h"
+#include <stdlib.h>
+#include <string.h>
+
+// Boxes whose geometry changed during the current reflow. Updated
+// atomically since parallel layout runs boxes on worker threads.
+static uint32_t reflow_moved_count;
+
+// Relayout boundaries
+
+// Absolute lengths only; anything relative depends on the parent
+static bool is_fixed_length(css_packed_value_t value) {
+    return value.type == CSS_PACKED_LENGTH && css_packed_resolve(value, NULL, -1.0f) >= 0.0f;
+}
+
+// A box whose size cannot depend on its content or its container: fixed
+// width and height, and overflow clipped so its content cannot spill into
+// the parent's scrollable area
+bool layout_is_relayout_boundary(const layout_box_t* box) {
+    if (!box->parent) return true;
+    
+    if (box->type != BOX_BLOCK && box->type != BOX_INLINE_BLOCK &&
+        box->type != BOX_FLEX && box->type != BOX_GRID) {
+        return false;
+    }
+    
+    // Flex and grid items are sized by their container
+    if (box->parent->type == BOX_FLEX || box->parent->type == BOX_GRID) return false;
+    
+    const css_computed_style_t* style = box->style;
+    if (!style) return false;
+    if (style->overflow_x == OVERFLOW_VISIBLE || style->overflow_y == OVERFLOW_VISIBLE) return false;
+    
+    return is_fixed_length(style->values[CSS_PROP_WIDTH]) && is_fixed_length(style->values[CSS_PROP_HEIGHT]);
+}
+
+static void mark_subtree_dirty(layout_box_t* box) {
+    box->needs_layout = true;
+    for (layout_box_t* child = box->first_child; child; child = child->next_sibling) {
+        mark_subtree_dirty(child);
+    }
+}
+
+static void add_relayout_root(render_tree_t* tree, layout_box_t* box) {
+    if (tree->relayout_root_count >= tree->relayout_root_capacity) {
+        uint32_t capacity = capacity_grow(tree->relayout_root_capacity, 8, sizeof(layout_box_t*));
+        layout_box_t** roots = capacity ? realloc(tree->relayout_roots, capacity * sizeof(layout_box_t*)) : NULL;
+        if (!roots) {
+            // Out of memory: fall back to a full layout from the top
+            if (!tree->relayout_roots || !tree->root) return;
+            mark_subtree_dirty(tree->root);
+            tree->relayout_roots[0] = tree->root;
+            tree->relayout_root_count = 1;
+            return;
+        }
+        tree->relayout_roots = roots;
+        tree->relayout_root_capacity = capacity;
+    }
+    tree->relayout_roots[tree->relayout_root_count++] = box;
+}
+
+// Invalidation
+
+void invalidate_layout(render_tree_t* tree, layout_box_t* box) {
+    if (!box) return;
+    if (tree) tree->needs_layout = true;
+    
+    // A dirty box already has its ancestor chain marked
+    bool was_dirty = box->needs_layout || box->child_needs_layout;
+    box->needs_layout = true;
+    if (was_dirty) return;
+    
+    layout_box_t* current = box;
+    while (!layout_is_relayout_boundary(current)) {
+        layout_box_t* parent = current->parent;
+        bool parent_dirty = parent->needs_layout || parent->child_needs_layout;
+        parent->child_needs_layout = true;
+        if (parent_dirty) return;
+        current = parent;
+    }
+    
+    if (tree) add_relayout_root(tree, current);
+}
+
+// Layout
+
+static bool rect_equal(const rect_t* a, const rect_t* b) {
+    return a->x == b->x && a->y == b->y && a->width == b->width && a->height == b->height;
+}
+
+static void run_layout_algorithm(layout_box_t* box, float container_width) {
+    switch (box->type) {
+        case BOX_INLINE:
+        case BOX_INLINE_BLOCK:
+            layout_inline(box, container_width);
+            break;
+        case BOX_FLEX:
+            layout_flex(box, container_width);
+            break;
+        case BOX_GRID:
+            layout_grid(box, container_width);
+            break;
+        case BOX_TABLE:
+        case BOX_TABLE_ROW:
+        case BOX_TABLE_CELL:
+            layout_table(box, container_width);
+            break;
+        case BOX_TEXT:
+            layout_text(box, container_width);
+            break;
+        case BOX_BLOCK:
+        case BOX_REPLACED:
+        case BOX_ANONYMOUS:
+        default:
+            layout_block(box, container_width);
+            break;
+    }
+}
+
+// Lays out box if it, a descendant or its container width changed.
+// Returns true if the box's geometry changed.
+bool layout_box_if_needed(layout_box_t* box, float container_width) {
+    if (!box) return false;
+    
+    bool width_changed = box->layout_width != container_width;
+    if (!box->needs_layout && !box->child_needs_layout && !width_changed) return false;
+    
+    if (!box->needs_layout && !width_changed) {
+        // Only descendants are dirty: lay them out in place at their old
+        // widths and rerun this box only if one of them changed
+        bool child_changed = false;
+        for (layout_box_t* child = box->first_child; child; child = child->next_sibling) {
+            if (layout_box_if_needed(child, child->layout_width)) child_changed = true;
+        }
+        box->child_needs_layout = false;
+        if (!child_changed) return false;
+    }
+    
+    rect_t margin_rect = box->margin_rect;
+    rect_t content_rect = box->content_rect;
+    
+    run_layout_algorithm(box, container_width);
+    box->layout_width = container_width;
+    box->needs_layout = false;
+    box->child_needs_layout = false;
+    
+    if (rect_equal(&margin_rect, &box->margin_rect) && rect_equal(&content_rect, &box->content_rect)) {
+        return false;
+    }
+    
+    box->needs_paint = true;
+    hit_index_invalidate_box(box);
+    __atomic_add_fetch(&reflow_moved_count, 1, __ATOMIC_RELAXED);
+    return true;
+}
+
+void layout_set_viewport(render_tree_t* tree, float viewport_width, float viewport_height) {
+    if (!tree) return;
+    if (tree->viewport_width == viewport_width && tree->viewport_height == viewport_height) return;
+    
+    tree->viewport_width = viewport_width;
+    tree->viewport_height = viewport_height;
+    if (!tree->root) return;
+    
+    // Viewport units can appear anywhere, so a resize lays out everything
+    mark_subtree_dirty(tree->root);
+    tree->relayout_root_count = 0;
+    add_relayout_root(tree, tree->root);
+    tree->needs_layout = true;
+}
+
+void layout_reflow(render_tree_t* tree, layout_box_t* dirty_box) {
+    if (!tree) return;
+    if (dirty_box) invalidate_layout(tree, dirty_box);
+    if (!tree->needs_layout) return;
+    
+    reflow_moved_count = 0;
+    
+    // A root below another root is usually laid out by the outer one and
+    // is then clean when its own turn comes
+    for (uint32_t i = 0; i < tree->relayout_root_count; i++) {
+        layout_box_t* root = tree->relayout_roots[i];
+        float container_width = root->parent ? root->layout_width : tree->viewport_width;
+        layout_box_if_needed(root, container_width);
+    }
+    tree->relayout_root_count = 0;
+    tree->needs_layout = false;
+    
+    if (reflow_moved_count) {
+        tree->layout_version++;
+        tree->needs_paint = true;
+    }
+}
@@ -0,0 +1,84 @@
+#include "engine.h"
+#include "../capacity.h"
+#include <stdlib.h>
+
+static uint32_t next_scroll_id = 1;
+
+static float clamp_offset(float offset, float content, float viewport) {
+    float max = content - viewport;
+    if (max < 0.0f) max = 0.0f;
+    if (offset < 0.0f) return 0.0f;
+    return offset > max ? max : offset;
+}
+
+void scroll_to(scroll_state_t* state, float x, float y) {
+    if (!state) return;
+    
+    state->scroll_x = clamp_offset(x, state->scroll_width, state->viewport_width);
+    state->scroll_y = clamp_offset(y, state->scroll_height, state->viewport_height);
+    if (state->compositor) {
+        compositor_thread_scroll(state->compositor, state->scroll_id, state->scroll_x, state->scroll_y, false, 0);
+    }
+}
+
+// Relative scrolls are posted as deltas so they compose with scrolling
+// the compositor thread did since the last sync
+void scroll_by(scroll_state_t* state, float dx, float dy) {
+    if (!state) return;
+    
+    if (!state->compositor) {
+        scroll_to(state, state->scroll_x + dx, state->scroll_y + dy);
+        return;
+    }
+    state->scroll_x = clamp_offset(state->scroll_x + dx, state->scroll_width, state->viewport_width);
+    state->scroll_y = clamp_offset(state->scroll_y + dy, state->scroll_height, state->viewport_height);
+    compositor_thread_scroll(state->compositor, state->scroll_id, dx, dy, true, 0);
+}
+
+// Animates on the compositor thread; without one there is no per-frame
+// tick to animate on, so it jumps
+void smooth_scroll_to(scroll_state_t* state, float x, float y, uint32_t duration) {
+    if (!state) return;
+    
+    if (!state->compositor || !duration) {
+        scroll_to(state, x, y);
+        return;
+    }
+    x = clamp_offset(x, state->scroll_width, state->viewport_width);
+    y = clamp_offset(y, state->scroll_height, state->viewport_height);
+    compositor_thread_scroll(state->compositor, state->scroll_id, x, y, false, duration);
+}
+
+// Scroller registry
+
+int render_tree_add_scroller(render_tree_t* tree, scroll_state_t* state) {
+    if (!tree || !state) return -1;
+    
+    for (uint32_t i = 0; i < tree->scroller_count; i++) {
+        if (tree->scrollers[i] == state) return 0;
+    }
+    if (tree->scroller_count >= tree->scroller_capacity) {
+        uint32_t capacity = capacity_grow(tree->scroller_capacity, 8, sizeof(scroll_state_t*));
+        scroll_state_t** scrollers = capacity ? realloc(tree->scrollers, capacity * sizeof(scroll_state_t*)) : NULL;
+        if (!scrollers) return -1;
+        tree->scrollers = scrollers;
+        tree->scroller_capacity = capacity;
+    }
+    
+    if (!state->scroll_id) state->scroll_id = __atomic_fetch_add(&next_scroll_id, 1, __ATOMIC_RELAXED);
+    tree->scrollers[tree->scroller_count++] = state;
+    tree->needs_composite = true;
+    return 0;
+}
+
+void render_tree_remove_scroller(render_tree_t* tree, scroll_state_t* state) {
+    if (!tree || !state) return;
+    
+    for (uint32_t i = 0; i < tree->scroller_count; i++) {
+        if (tree->scrollers[i] != state) continue;
+        tree->scrollers[i] = tree->scrollers[--tree->scroller_count];
+        state->compositor = NULL;
+        tree->needs_composite = true;
+        return;
+    }
+}
@@ -0,0 +1,444 @@
+#include "engine.h"
+#include "../capacity.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define TEXT_CACHE_INITIAL_SIZE 1024
+#define TEXT_CACHE_MAX_ENTRIES 16384
+
+// Last line breaking of a shape. Shapes are shared between boxes laid out
+// on different workers, so the memo has its own lock.
+typedef struct {
+    pthread_mutex_t lock;
+    bool valid;
+    float max_width;
+    text_line_t* lines;
+    uint32_t count;
+    uint32_t capacity;
+} text_line_cache_t;
+
+typedef struct {
+    text_shape_t** entries;
+    uint32_t mask;
+    uint32_t used;
+    uint64_t hits;
+    uint64_t misses;
+} text_cache_t;
+
+static text_cache_t cache;
+static pthread_mutex_t cache_lock = PTHREAD_MUTEX_INITIALIZER;
+static text_measure_fn_t measure_fn;
+
+// Fallback measurement
+
+static uint32_t utf8_decode(const char* text, uint32_t length, uint32_t index, uint32_t* size) {
+    const unsigned char* s = (const unsigned char*)text + index;
+    uint32_t remaining = length - index;
+    
+    if (s[0] < 0x80 || remaining < 2) {
+        *size = 1;
+        return s[0];
+    }
+    if ((s[0] & 0xE0) == 0xC0) {
+        *size = 2;
+        return (uint32_t)(s[0] & 0x1F) << 6 | (s[1] & 0x3F);
+    }
+    if ((s[0] & 0xF0) == 0xE0 && remaining >= 3) {
+        *size = 3;
+        return (uint32_t)(s[0] & 0x0F) << 12 | (uint32_t)(s[1] & 0x3F) << 6 | (s[2] & 0x3F);
+    }
+    if ((s[0] & 0xF8) == 0xF0 && remaining >= 4) {
+        *size = 4;
+        return (uint32_t)(s[0] & 0x07) << 18 | (uint32_t)(s[1] & 0x3F) << 12 |
+               (uint32_t)(s[2] & 0x3F) << 6 | (s[3] & 0x3F);
+    }
+    *size = 1;
+    return s[0];
+}
+
+// Ideographs and kana, which break between any two characters
+static bool is_wide(uint32_t codepoint) {
+    return (codepoint >= 0x1100 && codepoint <= 0x115F) ||
+           (codepoint >= 0x2E80 && codepoint <= 0xA4CF) ||
+           (codepoint >= 0xAC00 && codepoint <= 0xD7A3) ||
+           (codepoint >= 0xF900 && codepoint <= 0xFAFF) ||
+           (codepoint >= 0xFF00 && codepoint <= 0xFF60) ||
+           (codepoint >= 0x20000 && codepoint <= 0x3FFFD);
+}
+
+static bool is_space(char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+// Average glyph widths, used until a font backend registers a measurer
+static void default_measure(atom_t font, float font_size, const char* text, uint32_t length, float* advances, float* ascent, float* descent) {
+    (void)font;
+    
+    uint32_t i = 0;
+    while (i < length) {
+        uint32_t size;
+        uint32_t codepoint = utf8_decode(text, length, i, &size);
+        if (codepoint == '\n' || codepoint == '\r') {
+            advances[i] = 0.0f;
+        } else if (codepoint == ' ' || codepoint == '\t') {
+            advances[i] = font_size * 0.25f;
+        } else {
+            advances[i] = font_size * (is_wide(codepoint) ? 1.0f : 0.5f);
+        }
+        for (uint32_t j = 1; j < size; j++) advances[i + j] = 0.0f;
+        i += size;
+    }
+    *ascent = font_size * 0.8f;
+    *descent = font_size * 0.2f;
+}
+
+// Break opportunities: after a run of spaces, after a hyphen, around wide
+// characters and after a newline (mandatory)
+static void find_breaks(const char* text, uint32_t length, uint8_t* breaks) {
+    memset(breaks, TEXT_BREAK_NONE, length);
+    
+    bool prev_wide = false;
+    uint32_t i = 0;
+    while (i < length) {
+        uint32_t size;
+        uint32_t codepoint = utf8_decode(text, length, i, &size);
+        bool wide = is_wide(codepoint);
+        
+        if (i > 0 && breaks[i] == TEXT_BREAK_NONE) {
+            char prev = text[i - 1];
+            if (prev == '\n') {
+                breaks[i] = TEXT_BREAK_MANDATORY;
+            } else if ((is_space(prev) && !is_space(text[i])) || prev == '-' || wide || prev_wide) {
+                breaks[i] = TEXT_BREAK_ALLOWED;
+            }
+        }
+        prev_wide = wide;
+        i += size;
+    }
+}
+
+// Hash table
+
+static uint32_t shape_hash(atom_t font, float font_size, const char* text, uint32_t length) {
+    uint32_t size_bits;
+    memcpy(&size_bits, &font_size, sizeof(size_bits));
+    
+    uint32_t hash = 2166136261u;
+    hash = (hash ^ font) * 16777619u;
+    hash = (hash ^ size_bits) * 16777619u;
+    for (uint32_t i = 0; i < length; i++) {
+        hash = (hash ^ (unsigned char)text[i]) * 16777619u;
+    }
+    return hash ? hash : 1;
+}
+
+static bool shape_matches(const text_shape_t* shape, uint32_t hash, atom_t font, float font_size, const char* text, uint32_t length) {
+    return shape->hash == hash && shape->font == font && shape->font_size == font_size &&
+           shape->length == length && memcmp(shape->text, text, length) == 0;
+}
+
+static bool table_init(void) {
+    if (cache.entries) return true;
+    cache.entries = calloc(TEXT_CACHE_INITIAL_SIZE, sizeof(text_shape_t*));
+    if (!cache.entries) return false;
+    cache.mask = TEXT_CACHE_INITIAL_SIZE - 1;
+    cache.used = 0;
+    return true;
+}
+
+static void table_insert_entry(text_shape_t** entries, uint32_t mask, text_shape_t* shape) {
+    uint32_t index = shape->hash & mask;
+    while (entries[index]) index = (index + 1) & mask;
+    entries[index] = shape;
+}
+
+static bool table_grow(void) {
+    uint32_t capacity = (cache.mask + 1) * 2;
+    text_shape_t** entries = calloc(capacity, sizeof(text_shape_t*));
+    if (!entries) return false;
+    
+    for (uint32_t i = 0; i <= cache.mask; i++) {
+        if (cache.entries[i]) table_insert_entry(entries, capacity - 1, cache.entries[i]);
+    }
+    free(cache.entries);
+    cache.entries = entries;
+    cache.mask = capacity - 1;
+    return true;
+}
+
+static text_shape_t* table_find(uint32_t hash, atom_t font, float font_size, const char* text, uint32_t length) {
+    if (!cache.entries) return NULL;
+    
+    uint32_t index = hash & cache.mask;
+    while (cache.entries[index]) {
+        text_shape_t* shape = cache.entries[index];
+        if (shape_matches(shape, hash, font, font_size, text, length)) return shape;
+        index = (index + 1) & cache.mask;
+    }
+    return NULL;
+}
+
+// Drops the table's reference to every shape remove() selects and rehashes
+// the survivors. Shapes whose metrics changed are also marked stale so
+// boxes still holding them reshape. Caller holds cache_lock.
+static void table_remove_if(bool (*remove)(const text_shape_t* shape, atom_t font), atom_t font, bool mark_stale) {
+    if (!cache.entries) return;
+    
+    uint32_t capacity = cache.mask + 1;
+    text_shape_t** old = cache.entries;
+    text_shape_t** entries = calloc(capacity, sizeof(text_shape_t*));
+    if (!entries) {
+        // Cannot rehash: drop everything rather than keep stale shapes
+        entries = old;
+        for (uint32_t i = 0; i < capacity; i++) {
+            if (!old[i]) continue;
+            if (mark_stale) __atomic_store_n(&old[i]->stale, true, __ATOMIC_RELEASE);
+            text_shape_release(old[i]);
+            old[i] = NULL;
+        }
+        cache.used = 0;
+        return;
+    }
+    
+    cache.used = 0;
+    for (uint32_t i = 0; i < capacity; i++) {
+        text_shape_t* shape = old[i];
+        if (!shape) continue;
+        if (remove(shape, font)) {
+            if (mark_stale) __atomic_store_n(&shape->stale, true, __ATOMIC_RELEASE);
+            text_shape_release(shape);
+        } else {
+            table_insert_entry(entries, cache.mask, shape);
+            cache.used++;
+        }
+    }
+    free(old);
+    cache.entries = entries;
+}
+
+static bool remove_any(const text_shape_t* shape, atom_t font) {
+    (void)shape;
+    (void)font;
+    return true;
+}
+
+static bool remove_font(const text_shape_t* shape, atom_t font) {
+    return shape->font == font;
+}
+
+// Shapes
+
+static void shape_free(text_shape_t* shape) {
+    text_line_cache_t* lines = shape->lines;
+    if (lines) {
+        pthread_mutex_destroy(&lines->lock);
+        free(lines->lines);
+        free(lines);
+    }
+    free(shape->text);
+    free(shape->offsets);
+    free(shape->breaks);
+    free(shape);
+}
+
+static text_shape_t* shape_create(uint32_t hash, atom_t font, float font_size, const char* text, uint32_t length) {
+    text_shape_t* shape = calloc(1, sizeof(text_shape_t));
+    if (!shape) return NULL;
+    
+    shape->ref_count = 1;
+    shape->font = font;
+    shape->font_size = font_size;
+    shape->hash = hash;
+    shape->length = length;
+    shape->text = malloc(length + 1);
+    shape->offsets = malloc((length + 1) * sizeof(float));
+    shape->breaks = malloc(length + 1);
+    
+    text_line_cache_t* lines = calloc(1, sizeof(text_line_cache_t));
+    if (lines) {
+        pthread_mutex_init(&lines->lock, NULL);
+        shape->lines = lines;
+    }
+    
+    if (!shape->text || !shape->offsets || !shape->breaks || !lines) {
+        shape_free(shape);
+        return NULL;
+    }
+    memcpy(shape->text, text, length);
+    shape->text[length] = '\0';
+    
+    // Measure into offsets[1..] and turn the advances into pen positions
+    text_measure_fn_t measure = __atomic_load_n(&measure_fn, __ATOMIC_ACQUIRE);
+    if (!measure) measure = default_measure;
+    shape->offsets[0] = 0.0f;
+    measure(font, font_size, shape->text, length, shape->offsets + 1, &shape->ascent, &shape->descent);
+    for (uint32_t i = 1; i <= length; i++) {
+        shape->offsets[i] += shape->offsets[i - 1];
+    }
+    
+    find_breaks(shape->text, length, shape->breaks);
+    return shape;
+}
+
+text_shape_t* text_shape_retain(text_shape_t* shape) {
+    if (shape) __atomic_add_fetch(&shape->ref_count, 1, __ATOMIC_RELAXED);
+    return shape;
+}
+
+void text_shape_release(text_shape_t* shape) {
+    if (!shape) return;
+    if (__atomic_sub_fetch(&shape->ref_count, 1, __ATOMIC_ACQ_REL) == 0) {
+        shape_free(shape);
+    }
+}
+
+bool text_shape_is_stale(const text_shape_t* shape) {
+    return !shape || __atomic_load_n(&shape->stale, __ATOMIC_ACQUIRE);
+}
+
+float text_shape_measure(const text_shape_t* shape, uint32_t start, uint32_t end) {
+    if (!shape || start >= end) return 0.0f;
+    if (end > shape->length) end = shape->length;
+    if (start >= end) return 0.0f;
+    return shape->offsets[end] - shape->offsets[start];
+}
+
+// Line breaking
+
+static float line_width(const text_shape_t* shape, uint32_t start, uint32_t end) {
+    while (end > start && is_space(shape->text[end - 1])) end--;
+    return shape->offsets[end] - shape->offsets[start];
+}
+
+static bool add_line(text_line_cache_t* cache_lines, const text_shape_t* shape, uint32_t start, uint32_t end) {
+    if (cache_lines->count >= cache_lines->capacity) {
+        uint32_t capacity = capacity_grow(cache_lines->capacity, 8, sizeof(text_line_t));
+        text_line_t* lines = capacity ? realloc(cache_lines->lines, capacity * sizeof(text_line_t)) : NULL;
+        if (!lines) return false;
+        cache_lines->lines = lines;
+        cache_lines->capacity = capacity;
+    }
+    text_line_t* line = &cache_lines->lines[cache_lines->count++];
+    line->start = start;
+    line->end = end;
+    line->width = line_width(shape, start, end);
+    return true;
+}
+
+// Greedy breaking: each line takes as many break-separated segments as fit,
+// with trailing spaces hanging past max_width. A segment wider than the
+// line overflows on a line of its own.
+static bool break_lines(text_line_cache_t* cache_lines, const text_shape_t* shape, float max_width) {
+    cache_lines->count = 0;
+    
+    uint32_t line_start = 0;
+    uint32_t last_break = 0;
+    for (uint32_t i = 1; i <= shape->length; i++) {
+        uint8_t kind = i < shape->length ? shape->breaks[i] : TEXT_BREAK_MANDATORY;
+        if (kind == TEXT_BREAK_NONE) continue;
+        
+        if (line_width(shape, line_start, i) > max_width && last_break > line_start) {
+            if (!add_line(cache_lines, shape, line_start, last_break)) return false;
+            line_start = last_break;
+        }
+        
+        if (kind == TEXT_BREAK_MANDATORY) {
+            if (!add_line(cache_lines, shape, line_start, i)) return false;
+            line_start = i;
+        }
+        last_break = i;
+    }
+    return true;
+}
+
+uint32_t text_shape_break_lines(text_shape_t* shape, float max_width, text_line_t* lines, uint32_t capacity) {
+    if (!shape || !shape->lines) return 0;
+    text_line_cache_t* cache_lines = shape->lines;
+    
+    pthread_mutex_lock(&cache_lines->lock);
+    
+    // Relayout at the same width reuses the previous breaks
+    if (!cache_lines->valid || cache_lines->max_width != max_width) {
+        cache_lines->valid = break_lines(cache_lines, shape, max_width);
+        cache_lines->max_width = max_width;
+    }
+    
+    uint32_t count = cache_lines->valid ? cache_lines->count : 0;
+    if (lines) {
+        memcpy(lines, cache_lines->lines, (count < capacity ? count : capacity) * sizeof(text_line_t));
+    }
+    
+    pthread_mutex_unlock(&cache_lines->lock);
+    return count;
+}
+
+// Cache
+
+void text_cache_set_measure(text_measure_fn_t measure) {
+    __atomic_store_n(&measure_fn, measure, __ATOMIC_RELEASE);
+    text_cache_clear();
+}
+
+// Returns a new reference; the caller releases it with text_shape_release
+text_shape_t* text_cache_shape(atom_t font, float font_size, const char* text, uint32_t length) {
+    if (!text) return NULL;
+    uint32_t hash = shape_hash(font, font_size, text, length);
+    
+    pthread_mutex_lock(&cache_lock);
+    text_shape_t* shape = table_find(hash, font, font_size, text, length);
+    if (shape) {
+        cache.hits++;
+        text_shape_retain(shape);
+        pthread_mutex_unlock(&cache_lock);
+        return shape;
+    }
+    cache.misses++;
+    pthread_mutex_unlock(&cache_lock);
+    
+    // Shape outside the lock so other workers are not serialized behind
+    // the measurer
+    shape = shape_create(hash, font, font_size, text, length);
+    if (!shape) return NULL;
+    
+    pthread_mutex_lock(&cache_lock);
+    text_shape_t* existing = table_find(hash, font, font_size, text, length);
+    if (existing) {
+        // Another worker shaped the same text first
+        text_shape_retain(existing);
+        pthread_mutex_unlock(&cache_lock);
+        text_shape_release(shape);
+        return existing;
+    }
+    
+    // Bound memory held by the cache; evicted shapes stay valid
+    if (cache.used >= TEXT_CACHE_MAX_ENTRIES) {
+        table_remove_if(remove_any, ATOM_NULL, false);
+    }
+    if (table_init() && ((cache.used + 1) * 2 <= cache.mask + 1 || table_grow())) {
+        table_insert_entry(cache.entries, cache.mask, text_shape_retain(shape));
+        cache.used++;
+    }
+    pthread_mutex_unlock(&cache_lock);
+    
+    return shape;
+}
+
+// Drops the shapes measured with font. ATOM_NULL drops every shape, for
+// loads that can change fallback metrics.
+void text_cache_font_loaded(atom_t font) {
+    pthread_mutex_lock(&cache_lock);
+    table_remove_if(font == ATOM_NULL ? remove_any : remove_font, font, true);
+    pthread_mutex_unlock(&cache_lock);
+}
+
+void text_cache_clear(void) {
+    text_cache_font_loaded(ATOM_NULL);
+}
+
+void text_cache_get_stats(uint64_t* hits, uint64_t* misses) {
+    pthread_mutex_lock(&cache_lock);
+    if (hits) *hits = cache.hits;
+    if (misses) *misses = cache.misses;
+    pthread_mutex_unlock(&cache_lock);
+}
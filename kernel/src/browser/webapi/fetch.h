@@ -53,6 +53,17 @@ typedef enum {
     REQUEST_REDIRECT_MANUAL
 } request_redirect_t;
 
+// Request destination: what the response is for. Sets its network
+// priority (network/manager.h).
+typedef enum {
+    REQUEST_DESTINATION_EMPTY,      // fetch()
+    REQUEST_DESTINATION_DOCUMENT,
+    REQUEST_DESTINATION_STYLE,
+    REQUEST_DESTINATION_SCRIPT,
+    REQUEST_DESTINATION_FONT,
+    REQUEST_DESTINATION_IMAGE
+} request_destination_t;
+
 // HTTP headers
 typedef struct {
     char* name;
@@ -77,6 +88,7 @@ typedef struct {
     request_credentials_t credentials;
     request_cache_t cache;
     request_redirect_t redirect;
+    request_destination_t destination;
     char* referrer;
     char* referrer_policy;
     char* integrity;
@@ -119,10 +131,10 @@ typedef struct {
 } body_mixin_t;
 
 // Fetch API functions
-js_value_t* fetch_api_fetch(js_engine_t* engine, const char* url, js_value_t* init);
-request_t* fetch_create_request(const char* url, js_value_t* init);
-response_t* fetch_create_response(void* body, js_value_t* init);
-headers_t* fetch_create_headers(js_value_t* init);
+js_value_t fetch_api_fetch(js_engine_t* engine, const char* url, const js_value_t* init);
+request_t* fetch_create_request(const char* url, const js_value_t* init);
+response_t* fetch_create_response(void* body, const js_value_t* init);
+headers_t* fetch_create_headers(const js_value_t* init);
 
 // Headers operations
 void headers_append(headers_t* headers, const char* name, const char* value);
@@ -134,33 +146,53 @@ http_header_t** headers_entries(headers_t* headers, uint32_t* count);
 
 // Request operations
 request_t* request_clone(request_t* request);
-js_value_t* request_array_buffer(js_engine_t* engine, request_t* request);
-js_value_t* request_blob(js_engine_t* engine, request_t* request);
-js_value_t* request_form_data(js_engine_t* engine, request_t* request);
-js_value_t* request_json(js_engine_t* engine, request_t* request);
-js_value_t* request_text(js_engine_t* engine, request_t* request);
+js_value_t request_array_buffer(js_engine_t* engine, request_t* request);
+js_value_t request_blob(js_engine_t* engine, request_t* request);
+js_value_t request_form_data(js_engine_t* engine, request_t* request);
+js_value_t request_json(js_engine_t* engine, request_t* request);
+js_value_t request_text(js_engine_t* engine, request_t* request);
 
 // Response operations
 response_t* response_clone(response_t* response);
 response_t* response_error(void);
 response_t* response_redirect(const char* url, uint16_t status);
-js_value_t* response_array_buffer(js_engine_t* engine, response_t* response);
-js_value_t* response_blob(js_engine_t* engine, response_t* response);
-js_value_t* response_form_data(js_engine_t* engine, response_t* response);
-js_value_t* response_json(js_engine_t* engine, response_t* response);
-js_value_t* response_text(js_engine_t* engine, response_t* response);
+js_value_t response_array_buffer(js_engine_t* engine, response_t* response);
+js_value_t response_blob(js_engine_t* engine, response_t* response);
+js_value_t response_form_data(js_engine_t* engine, response_t* response);
+js_value_t response_json(js_engine_t* engine, response_t* response);
+js_value_t response_text(js_engine_t* engine, response_t* response);
 
 // Network operations
-typedef struct {
+typedef struct fetch_operation {
     request_t* request;
     response_t* response;
-    void (*on_progress)(uint64_t loaded, uint64_t total);
-    void (*on_complete)(response_t* response);
-    void (*on_error)(const char* error);
+    void (*on_progress)(struct fetch_operation* operation, uint64_t loaded, uint64_t total);
+    void (*on_data)(struct fetch_operation* operation, const void* chunk, uint32_t length);
+    void (*on_complete)(struct fetch_operation* operation, response_t* response);
+    void (*on_error)(struct fetch_operation* operation, const char* error);
+    void* user_data;
     bool aborted;
 } fetch_operation_t;
 
+// Callbacks for asynchronous fetches. They may be invoked on a network
+// thread; exactly one of on_complete/on_error is delivered, and none
+// are delivered once fetch_abort() has returned. on_data receives body
+// chunks in order as they are read from the response stream; the chunk
+// is only valid for the duration of the call.
+typedef struct {
+    void (*on_progress)(fetch_operation_t* operation, uint64_t loaded, uint64_t total);
+    void (*on_data)(fetch_operation_t* operation, const void* chunk, uint32_t length);
+    void (*on_complete)(fetch_operation_t* operation, response_t* response);
+    void (*on_error)(fetch_operation_t* operation, const char* error);
+} fetch_callbacks_t;
+
+// Fetches share the connection pools of the network manager set here
+// (network/manager.h); without one each opens its own connection.
+struct network_manager;
+void fetch_set_network_manager(struct network_manager* manager);
+
 fetch_operation_t* fetch_start(request_t* request);
+fetch_operation_t* fetch_start_async(request_t* request, const fetch_callbacks_t* callbacks, void* user_data);
 void fetch_abort(fetch_operation_t* operation);
 void fetch_operation_destroy(fetch_operation_t* operation);
 
@@ -195,8 +227,8 @@ typedef struct {
 
 cache_storage_t* cache_storage_open(const char* name);
 void cache_storage_close(cache_storage_t* cache);
-js_value_t* cache_match(js_engine_t* engine, cache_storage_t* cache, request_t* request);
-js_value_t* cache_match_all(js_engine_t* engine, cache_storage_t* cache, request_t* request);
+js_value_t cache_match(js_engine_t* engine, cache_storage_t* cache, request_t* request);
+js_value_t cache_match_all(js_engine_t* engine, cache_storage_t* cache, request_t* request);
 void cache_put(cache_storage_t* cache, request_t* request, response_t* response);
 bool cache_delete(cache_storage_t* cache, request_t* request);
 char** cache_keys(cache_storage_t* cache, uint32_t* count);
@@ -218,7 +250,7 @@ typedef struct {
 service_worker_t* service_worker_register(const char* script_url, const char* scope);
 void service_worker_unregister(service_worker_t* worker);
 response_t* service_worker_fetch(service_worker_t* worker, request_t* request);
-void service_worker_post_message(service_worker_t* worker, js_value_t* message);
+void service_worker_post_message(service_worker_t* worker, js_value_t message);
 
 // Abort controller
 typedef struct {
@@ -250,8 +282,8 @@ typedef struct {
 
 readable_stream_t* readable_stream_create(void* source);
 readable_stream_reader_t* readable_stream_get_reader(readable_stream_t* stream);
-js_value_t* readable_stream_read(js_engine_t* engine, readable_stream_reader_t* reader);
-void readable_stream_cancel(readable_stream_t* stream, js_value_t* reason);
+js_value_t readable_stream_read(js_engine_t* engine, readable_stream_reader_t* reader);
+void readable_stream_cancel(readable_stream_t* stream, js_value_t reason);
 void readable_stream_close(readable_stream_t* stream);
 
 // FormData
@@ -276,12 +308,12 @@ typedef struct {
 } form_data_t;
 
 form_data_t* form_data_create(void);
-void form_data_append(form_data_t* data, const char* name, js_value_t* value);
+void form_data_append(form_data_t* data, const char* name, js_value_t value);
 void form_data_delete(form_data_t* data, const char* name);
-js_value_t* form_data_get(js_engine_t* engine, form_data_t* data, const char* name);
-js_value_t** form_data_get_all(js_engine_t* engine, form_data_t* data, const char* name, uint32_t* count);
+js_value_t form_data_get(js_engine_t* engine, form_data_t* data, const char* name);
+js_value_t* form_data_get_all(js_engine_t* engine, form_data_t* data, const char* name, uint32_t* count);
 bool form_data_has(form_data_t* data, const char* name);
-void form_data_set(form_data_t* data, const char* name, js_value_t* value);
+void form_data_set(form_data_t* data, const char* name, js_value_t value);
 void form_data_destroy(form_data_t* data);
 
 #endif
\ No newline at end of file
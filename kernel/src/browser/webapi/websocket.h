@@ -215,10 +215,10 @@ void websocket_compression_decompress(websocket_compression_t* comp, uint8_t* da
 void websocket_compression_destroy(websocket_compression_t* comp);
 
 // JavaScript bindings
-js_value_t* websocket_create_js(js_engine_t* engine, const char* url, js_value_t* protocols);
-void websocket_bind_events(js_engine_t* engine, websocket_t* ws, js_value_t* js_ws);
-js_value_t* websocket_send_js(js_engine_t* engine, websocket_t* ws, js_value_t* data);
-js_value_t* websocket_close_js(js_engine_t* engine, websocket_t* ws, js_value_t* code, js_value_t* reason);
+js_value_t websocket_create_js(js_engine_t* engine, const char* url, js_value_t protocols);
+void websocket_bind_events(js_engine_t* engine, websocket_t* ws, js_value_t js_ws);
+js_value_t websocket_send_js(js_engine_t* engine, websocket_t* ws, js_value_t data);
+js_value_t websocket_close_js(js_engine_t* engine, websocket_t* ws, js_value_t code, js_value_t reason);
 
 // Event handling
 typedef void (*websocket_event_handler_t)(websocket_t* ws, websocket_event_t* event);
@@ -0,0 +1,569 @@
+#include "worker.h"
+#include "fetch.h"
+#include "../js/engine.h"
+#include "../js/structured_clone.h"
+#include "../js/event_loop.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Message in a mailbox. A NULL clone reports an error to the page.
+typedef struct worker_message {
+    js_clone_t* clone;
+    char* error;
+    struct worker_message* next;
+} worker_message_t;
+
+typedef struct {
+    worker_message_t* head;
+    worker_message_t* tail;
+} worker_mailbox_t;
+
+struct web_worker {
+    js_engine_t* parent;
+    js_value_t object;              // The Worker object in parent, protected
+    char* script_url;
+    pthread_t thread;
+    
+    pthread_mutex_t lock;
+    js_engine_t* engine;            // The worker's, while it may be woken or interrupted
+    worker_mailbox_t inbox;         // Page to worker
+    worker_mailbox_t outbox;        // Worker to page
+    bool delivery_queued;           // A parent task will drain outbox
+    bool terminated;
+    bool closed;                    // The worker called close()
+    pthread_cond_t fetched;         // The script fetch ended, or terminate
+    bool fetch_finished;
+    bool fetch_loaded;
+    uint32_t references;            // Registry, thread and a queued delivery
+    
+    struct web_worker* next;        // Registry
+};
+
+// Workers not yet terminated, so natives can check the worker behind a
+// Worker object is still alive
+static pthread_mutex_t registry_lock = PTHREAD_MUTEX_INITIALIZER;
+static web_worker_t* registry;
+
+// The worker whose engine runs on this thread
+static __thread web_worker_t* current_worker;
+
+static void worker_retain(web_worker_t* worker) {
+    __atomic_add_fetch(&worker->references, 1, __ATOMIC_ACQ_REL);
+}
+
+static void mailbox_clear(worker_mailbox_t* mailbox) {
+    worker_message_t* message = mailbox->head;
+    while (message) {
+        worker_message_t* next = message->next;
+        js_clone_free(message->clone);
+        free(message->error);
+        free(message);
+        message = next;
+    }
+    mailbox->head = mailbox->tail = NULL;
+}
+
+static void worker_release(web_worker_t* worker) {
+    if (__atomic_sub_fetch(&worker->references, 1, __ATOMIC_ACQ_REL) != 0) return;
+    mailbox_clear(&worker->inbox);
+    mailbox_clear(&worker->outbox);
+    pthread_cond_destroy(&worker->fetched);
+    pthread_mutex_destroy(&worker->lock);
+    free(worker->script_url);
+    free(worker);
+}
+
+static void mailbox_push(worker_mailbox_t* mailbox, worker_message_t* message) {
+    message->next = NULL;
+    if (mailbox->tail) {
+        mailbox->tail->next = message;
+    } else {
+        mailbox->head = message;
+    }
+    mailbox->tail = message;
+}
+
+// Takes every message at once
+static worker_message_t* mailbox_take(worker_mailbox_t* mailbox) {
+    worker_message_t* messages = mailbox->head;
+    mailbox->head = mailbox->tail = NULL;
+    return messages;
+}
+
+static bool registry_contains(web_worker_t* worker) {
+    pthread_mutex_lock(&registry_lock);
+    web_worker_t* entry = registry;
+    while (entry && entry != worker) entry = entry->next;
+    pthread_mutex_unlock(&registry_lock);
+    return entry != NULL;
+}
+
+static bool registry_remove(web_worker_t* worker) {
+    bool removed = false;
+    pthread_mutex_lock(&registry_lock);
+    for (web_worker_t** link = &registry; *link; link = &(*link)->next) {
+        if (*link == worker) {
+            *link = worker->next;
+            removed = true;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&registry_lock);
+    return removed;
+}
+
+// Calls target.name({ key: value }) if it is a function
+static void dispatch_event(js_engine_t* engine, js_object_t* target, const char* name, const char* key, js_value_t value) {
+    js_value_t handler = js_get_property(target, name);
+    if (js_value_type(handler) != JS_TYPE_FUNCTION) return;
+    
+    js_value_t event = js_create_object(engine);
+    if (js_value_is_exception(event)) return;
+    js_set_property(js_value_as_object(event), key, value);
+    js_call_function(engine, (js_function_t*)js_value_as_object(handler), js_value_from_object(target), &event, 1);
+}
+
+// Array of ArrayBuffers, as postMessage's second argument
+static js_value_t* transfer_list(js_value_t list, uint32_t* count) {
+    *count = 0;
+    if (js_value_type(list) != JS_TYPE_ARRAY) return NULL;
+    uint32_t length = js_array_length(list);
+    js_value_t* transfer = length ? calloc(length, sizeof(js_value_t)) : NULL;
+    if (!transfer) return NULL;
+    for (uint32_t i = 0; i < length; i++) {
+        transfer[i] = js_array_get(list, i);
+    }
+    *count = length;
+    return transfer;
+}
+
+// Page side
+
+// Runs on the parent's event loop
+static void worker_deliver_to_parent(void* data) {
+    web_worker_t* worker = data;
+    
+    pthread_mutex_lock(&worker->lock);
+    worker->delivery_queued = false;
+    worker_message_t* messages = worker->terminated ? NULL : mailbox_take(&worker->outbox);
+    pthread_mutex_unlock(&worker->lock);
+    
+    js_engine_t* engine = worker->parent;
+    while (messages) {
+        worker_message_t* message = messages;
+        messages = message->next;
+        
+        // A handler may terminate the worker mid-batch
+        bool terminated = __atomic_load_n(&worker->terminated, __ATOMIC_ACQUIRE);
+        if (!terminated && message->clone) {
+            js_value_t value = js_clone_deserialize(engine, message->clone);
+            message->clone = NULL;
+            if (!js_value_is_exception(value)) {
+                dispatch_event(engine, js_value_as_object(worker->object), "onmessage", "data", value);
+            }
+        } else if (!terminated && message->error) {
+            js_value_t text = js_create_string(engine, message->error);
+            if (!js_value_is_exception(text)) {
+                dispatch_event(engine, js_value_as_object(worker->object), "onerror", "message", text);
+            }
+        }
+        js_clone_free(message->clone);
+        free(message->error);
+        free(message);
+    }
+    
+    worker_release(worker);
+}
+
+// A delivery dropped unrun from the parent's event loop
+static void worker_discard_delivery(void* data) {
+    worker_release(data);
+}
+
+// Worker thread side. Queues a delivery unless one is already pending.
+static void worker_send_to_parent(web_worker_t* worker, worker_message_t* message) {
+    pthread_mutex_lock(&worker->lock);
+    if (worker->terminated) {
+        pthread_mutex_unlock(&worker->lock);
+        js_clone_free(message->clone);
+        free(message->error);
+        free(message);
+        return;
+    }
+    mailbox_push(&worker->outbox, message);
+    bool queue = !worker->delivery_queued;
+    worker->delivery_queued = true;
+    if (queue) {
+        worker_retain(worker);
+        js_queue_task(worker->parent, worker_deliver_to_parent, worker);
+    }
+    pthread_mutex_unlock(&worker->lock);
+}
+
+static void worker_report_error(web_worker_t* worker, const char* error) {
+    worker_message_t* message = calloc(1, sizeof(worker_message_t));
+    if (!message) return;
+    message->error = strdup(error);
+    worker_send_to_parent(worker, message);
+}
+
+// Worker side
+
+static js_value_t worker_global_post_message(js_value_t* args, uint32_t argc) {
+    web_worker_t* worker = current_worker;
+    js_engine_t* engine = js_native_engine();
+    if (!worker || !engine || argc < 1) return JS_UNDEFINED;
+    
+    uint32_t transfer_count;
+    js_value_t* transfer = transfer_list(argc > 1 ? args[1] : JS_UNDEFINED, &transfer_count);
+    js_clone_t* clone = js_clone_serialize(engine, args[0], transfer, transfer_count);
+    free(transfer);
+    if (!clone) return JS_EXCEPTION;
+    
+    worker_message_t* message = calloc(1, sizeof(worker_message_t));
+    if (!message) {
+        js_clone_free(clone);
+        return JS_UNDEFINED;
+    }
+    message->clone = clone;
+    worker_send_to_parent(worker, message);
+    return JS_UNDEFINED;
+}
+
+static js_value_t worker_global_close(js_value_t* args, uint32_t argc) {
+    (void)args;
+    (void)argc;
+    web_worker_t* worker = current_worker;
+    if (!worker) return JS_UNDEFINED;
+    
+    pthread_mutex_lock(&worker->lock);
+    worker->closed = true;
+    pthread_mutex_unlock(&worker->lock);
+    return JS_UNDEFINED;
+}
+
+static void worker_bind_global(js_engine_t* engine) {
+    js_object_t* global = engine->global_context ? engine->global_context->global_object : NULL;
+    if (!global) return;
+    
+    js_set_property(global, "self", js_value_from_object(global));
+    js_set_property(global, "postMessage", js_create_function(engine, "postMessage", worker_global_post_message));
+    js_set_property(global, "close", js_create_function(engine, "close", worker_global_close));
+    js_set_property(global, "onmessage", JS_NULL);
+}
+
+static void worker_fetch_finished(fetch_operation_t* operation, bool loaded) {
+    web_worker_t* worker = operation->user_data;
+    pthread_mutex_lock(&worker->lock);
+    worker->fetch_finished = true;
+    worker->fetch_loaded = loaded;
+    pthread_cond_broadcast(&worker->fetched);
+    pthread_mutex_unlock(&worker->lock);
+}
+
+static void worker_fetch_complete(fetch_operation_t* operation, response_t* response) {
+    worker_fetch_finished(operation, response && response->ok);
+}
+
+static void worker_fetch_error(fetch_operation_t* operation, const char* error) {
+    (void)error;
+    worker_fetch_finished(operation, false);
+}
+
+static const fetch_callbacks_t worker_fetch_callbacks = {
+    .on_complete = worker_fetch_complete,
+    .on_error = worker_fetch_error
+};
+
+// NUL-terminated script body, or NULL. Terminating the worker abandons
+// the fetch.
+static char* worker_fetch_script(web_worker_t* worker) {
+    request_t* request = fetch_create_request(worker->script_url, NULL);
+    if (!request) return NULL;
+    request->destination = REQUEST_DESTINATION_SCRIPT;
+    
+    fetch_operation_t* operation = fetch_start_async(request, &worker_fetch_callbacks, worker);
+    if (!operation) {
+        free(request);
+        return NULL;
+    }
+    
+    pthread_mutex_lock(&worker->lock);
+    while (!worker->fetch_finished && !worker->terminated) {
+        pthread_cond_wait(&worker->fetched, &worker->lock);
+    }
+    bool finished = worker->fetch_finished;
+    bool loaded = worker->fetch_loaded;
+    pthread_mutex_unlock(&worker->lock);
+    if (!finished) fetch_abort(operation);
+    
+    char* source = NULL;
+    response_t* response = operation->response;
+    if (loaded && response && response->body) {
+        source = malloc(response->body_size + 1);
+        if (source) {
+            memcpy(source, response->body, response->body_size);
+            source[response->body_size] = '\0';
+        }
+    }
+    fetch_operation_destroy(operation);
+    return source;
+}
+
+// Takes the messages waiting in the inbox; false once the worker is
+// stopping
+static bool worker_take_messages(web_worker_t* worker, worker_message_t** messages) {
+    pthread_mutex_lock(&worker->lock);
+    bool stopping = worker->terminated || worker->closed;
+    *messages = stopping ? NULL : mailbox_take(&worker->inbox);
+    pthread_mutex_unlock(&worker->lock);
+    return !stopping;
+}
+
+static void worker_set_engine(web_worker_t* worker, js_engine_t* engine) {
+    pthread_mutex_lock(&worker->lock);
+    worker->engine = engine;
+    pthread_mutex_unlock(&worker->lock);
+}
+
+// Parent side, with worker->lock held: a message or terminate is waiting
+static void worker_wake(web_worker_t* worker) {
+    if (worker->engine) js_event_loop_wake(worker->engine);
+}
+
+static bool worker_stopping(web_worker_t* worker) {
+    pthread_mutex_lock(&worker->lock);
+    bool stopping = worker->terminated || worker->closed;
+    pthread_mutex_unlock(&worker->lock);
+    return stopping;
+}
+
+static void* worker_main(void* data) {
+    web_worker_t* worker = data;
+    current_worker = worker;
+    
+    // The engine is created here so that its heap belongs to this thread
+    js_engine_t* engine = js_engine_create(WORKER_HEAP_SIZE);
+    if (!engine || js_engine_init(engine) != 0) {
+        worker_report_error(worker, "Worker could not be started");
+    } else {
+        worker_bind_global(engine);
+        
+        // From here terminate interrupts the script
+        worker_set_engine(worker, engine);
+        if (worker_stopping(worker)) js_interrupt(engine);
+        
+        char* source = worker_fetch_script(worker);
+        if (!source) {
+            worker_report_error(worker, "Worker script could not be loaded");
+        } else {
+            js_value_t result = js_eval(engine, source, worker->script_url);
+            free(source);
+            if (js_value_is_exception(result)) {
+                char* error = js_to_string(engine->error.last_exception);
+                worker_report_error(worker, error ? error : "Error");
+                free(error);
+                engine->error.last_exception = JS_UNDEFINED;
+            }
+            
+            // Timers and tasks run between messages; with neither the
+            // thread sleeps until a message, a timer or terminate
+            worker_message_t* messages;
+            for (;;) {
+                js_run_event_loop(engine);
+                if (!worker_take_messages(worker, &messages)) break;
+                if (!messages) {
+                    js_event_loop_wait(engine, UINT64_MAX);
+                    continue;
+                }
+                
+                js_object_t* global = engine->global_context->global_object;
+                while (messages) {
+                    worker_message_t* message = messages;
+                    messages = message->next;
+                    if (!worker_stopping(worker)) {
+                        js_value_t value = js_clone_deserialize(engine, message->clone);
+                        message->clone = NULL;
+                        if (!js_value_is_exception(value)) {
+                            dispatch_event(engine, global, "onmessage", "data", value);
+                        }
+                    }
+                    js_clone_free(message->clone);
+                    free(message);
+                }
+            }
+        }
+        worker_set_engine(worker, NULL);
+    }
+    
+    current_worker = NULL;
+    if (engine) js_engine_destroy(engine);
+    worker_release(worker);
+    return NULL;
+}
+
+web_worker_t* worker_create(js_engine_t* parent, const char* script_url, js_value_t object) {
+    if (!parent || !script_url || !js_value_is_object(object)) return NULL;
+    
+    web_worker_t* worker = calloc(1, sizeof(web_worker_t));
+    if (!worker) return NULL;
+    worker->script_url = strdup(script_url);
+    if (!worker->script_url) {
+        free(worker);
+        return NULL;
+    }
+    worker->parent = parent;
+    worker->object = object;
+    worker->references = 2;
+    pthread_mutex_init(&worker->lock, NULL);
+    pthread_cond_init(&worker->fetched, NULL);
+    
+    if (pthread_create(&worker->thread, NULL, worker_main, worker) != 0) {
+        worker->references = 1;
+        worker_release(worker);
+        return NULL;
+    }
+    
+    js_gc_protect(object);
+    pthread_mutex_lock(&registry_lock);
+    worker->next = registry;
+    registry = worker;
+    pthread_mutex_unlock(&registry_lock);
+    return worker;
+}
+
+bool worker_post_message(web_worker_t* worker, js_value_t message, const js_value_t* transfer, uint32_t transfer_count) {
+    if (!worker || __atomic_load_n(&worker->terminated, __ATOMIC_ACQUIRE)) return false;
+    
+    js_clone_t* clone = js_clone_serialize(worker->parent, message, transfer, transfer_count);
+    if (!clone) return false;
+    
+    worker_message_t* entry = calloc(1, sizeof(worker_message_t));
+    if (!entry) {
+        js_clone_free(clone);
+        return false;
+    }
+    entry->clone = clone;
+    
+    pthread_mutex_lock(&worker->lock);
+    mailbox_push(&worker->inbox, entry);
+    worker_wake(worker);
+    pthread_mutex_unlock(&worker->lock);
+    return true;
+}
+
+// Runs on the parent's thread. join waits for the worker thread to exit,
+// which is prompt: script is interrupted and the script fetch abandoned.
+static void worker_stop(web_worker_t* worker, bool join) {
+    if (!registry_remove(worker)) return;
+    
+    pthread_mutex_lock(&worker->lock);
+    __atomic_store_n(&worker->terminated, true, __ATOMIC_RELEASE);
+    mailbox_clear(&worker->inbox);
+    mailbox_clear(&worker->outbox);
+    if (worker->engine) js_interrupt(worker->engine);
+    pthread_cond_broadcast(&worker->fetched);
+    worker_wake(worker);
+    pthread_mutex_unlock(&worker->lock);
+    
+    js_gc_unprotect(worker->object);
+    if (join) {
+        pthread_join(worker->thread, NULL);
+    } else {
+        pthread_detach(worker->thread);
+    }
+    worker_release(worker);
+}
+
+void worker_terminate(web_worker_t* worker) {
+    if (worker) worker_stop(worker, false);
+}
+
+void worker_terminate_all(js_engine_t* parent) {
+    for (;;) {
+        pthread_mutex_lock(&registry_lock);
+        web_worker_t* worker = registry;
+        while (worker && worker->parent != parent) worker = worker->next;
+        pthread_mutex_unlock(&registry_lock);
+        if (!worker) break;
+        worker_stop(worker, true);
+    }
+    
+    // Deliveries still queued hold their worker, and parent's loop drops
+    // them unrun
+    js_discard_tasks(parent, worker_deliver_to_parent, worker_discard_delivery);
+}
+
+// Worker objects. internal_slots holds the worker; the registry check
+// rejects objects whose worker is gone.
+
+static web_worker_t* worker_from_this(void) {
+    js_object_t* object = js_value_as_object(js_native_this());
+    web_worker_t* worker = object ? object->internal_slots : NULL;
+    return worker && registry_contains(worker) ? worker : NULL;
+}
+
+static js_value_t worker_object_post_message(js_value_t* args, uint32_t argc) {
+    web_worker_t* worker = worker_from_this();
+    if (!worker || argc < 1) return JS_UNDEFINED;
+    
+    js_engine_t* engine = worker->parent;
+    js_value_t pending = engine->error.last_exception;
+    
+    uint32_t transfer_count;
+    js_value_t* transfer = transfer_list(argc > 1 ? args[1] : JS_UNDEFINED, &transfer_count);
+    bool posted = worker_post_message(worker, args[0], transfer, transfer_count);
+    free(transfer);
+    
+    // A clone failure throws a DataCloneError
+    if (!posted && !js_value_same(pending, engine->error.last_exception)) return JS_EXCEPTION;
+    return JS_UNDEFINED;
+}
+
+static js_value_t worker_object_terminate(js_value_t* args, uint32_t argc) {
+    (void)args;
+    (void)argc;
+    web_worker_t* worker = worker_from_this();
+    if (worker) {
+        js_value_as_object(worker->object)->internal_slots = NULL;
+        worker_terminate(worker);
+    }
+    return JS_UNDEFINED;
+}
+
+// new Worker(url)
+static js_value_t worker_constructor(js_value_t* args, uint32_t argc) {
+    js_engine_t* engine = js_native_engine();
+    if (!engine) return JS_UNDEFINED;
+    if (argc < 1) {
+        js_throw(engine, js_create_type_error(engine, "Worker requires a script URL"));
+        return JS_EXCEPTION;
+    }
+    
+    char* url = js_to_string(args[0]);
+    js_value_t object = url ? js_create_object(engine) : JS_EXCEPTION;
+    if (js_value_is_exception(object)) {
+        free(url);
+        return JS_EXCEPTION;
+    }
+    
+    js_object_t* target = js_value_as_object(object);
+    js_set_property(target, "postMessage", js_create_function(engine, "postMessage", worker_object_post_message));
+    js_set_property(target, "terminate", js_create_function(engine, "terminate", worker_object_terminate));
+    js_set_property(target, "onmessage", JS_NULL);
+    js_set_property(target, "onerror", JS_NULL);
+    
+    target->internal_slots = worker_create(engine, url, object);
+    free(url);
+    if (!target->internal_slots) {
+        js_throw(engine, js_create_error(engine, "Worker could not be started"));
+        return JS_EXCEPTION;
+    }
+    return object;
+}
+
+void js_bind_worker_api(js_engine_t* engine) {
+    if (!engine || !engine->global_context || !engine->global_context->global_object) return;
+    js_set_property(engine->global_context->global_object, "Worker", js_create_function(engine, "Worker", worker_constructor));
+}
@@ -0,0 +1,45 @@
+#ifndef WEBAPI_WORKER_H
+#define WEBAPI_WORKER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Forward declarations
+typedef struct js_value js_value_t;
+typedef struct js_engine js_engine_t;
+
+// Dedicated workers. Each worker runs its script on a thread of its own,
+// in a js_engine_t with its own heap, so the two sides share no values.
+// postMessage sends a structured clone (js/structured_clone.h) through a
+// mailbox; ArrayBuffers in the transfer list move their bytes across
+// without copying.
+//
+// Scripts see the usual API: `new Worker(url)` with postMessage(),
+// terminate() and onmessage/onerror in the page, and postMessage(),
+// close(), self and onmessage in the worker. js_bind_worker_api installs
+// the constructor. Messages arrive as tasks on the receiving engine's
+// event loop; the worker thread sleeps in its own loop while it has no
+// message, task or due timer.
+#define WORKER_HEAP_SIZE (32 * 1024 * 1024)
+
+typedef struct web_worker web_worker_t;
+
+// Starts a worker running script_url. Events are delivered to object, a
+// value in parent's heap with onmessage/onerror, which stays protected
+// until the worker is terminated.
+web_worker_t* worker_create(js_engine_t* parent, const char* script_url, js_value_t object);
+
+// False with a DataCloneError thrown in parent when message cannot be
+// cloned, or when the worker has been terminated
+bool worker_post_message(web_worker_t* worker, js_value_t message, const js_value_t* transfer, uint32_t transfer_count);
+
+// Stops the worker, interrupting any script it is running (js_interrupt)
+// and abandoning its script fetch; pending messages in both directions are
+// dropped. The worker must not be used afterwards.
+void worker_terminate(web_worker_t* worker);
+
+// Terminates every worker created with parent and waits for their
+// threads, before parent is destroyed
+void worker_terminate_all(js_engine_t* parent);
+
+#endif
@@ -0,0 +1,277 @@
+#include "worker_pool.h"
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sched.h>
+
+#define WORKER_DEQUE_INITIAL_SIZE 64
+
+typedef struct {
+    worker_task_fn_t fn;
+    void* data;
+    worker_group_t* group;
+} worker_task_t;
+
+// Ring buffer; top is the steal end, bottom the owner's end
+typedef struct {
+    pthread_mutex_t lock;
+    worker_task_t* tasks;
+    uint32_t mask;
+    uint32_t top;
+    uint32_t bottom;
+} worker_deque_t;
+
+typedef struct {
+    worker_pool_t* pool;
+    uint32_t index;
+} worker_thread_t;
+
+struct worker_pool {
+    pthread_t* threads;
+    worker_thread_t* workers;
+    uint32_t thread_count;
+    
+    // thread_count worker deques plus one for external submitters
+    worker_deque_t* deques;
+    uint32_t deque_count;
+    
+    // Idle workers sleep until queued becomes non-zero
+    pthread_mutex_t sleep_lock;
+    pthread_cond_t wake;
+    uint32_t queued;
+    uint32_t sleepers;              // Guarded by sleep_lock
+    bool stopping;
+    
+    pthread_key_t worker_key;
+};
+
+// Deques
+
+static bool deque_init(worker_deque_t* deque) {
+    deque->tasks = calloc(WORKER_DEQUE_INITIAL_SIZE, sizeof(worker_task_t));
+    if (!deque->tasks) return false;
+    deque->mask = WORKER_DEQUE_INITIAL_SIZE - 1;
+    deque->top = deque->bottom = 0;
+    pthread_mutex_init(&deque->lock, NULL);
+    return true;
+}
+
+static void deque_destroy(worker_deque_t* deque) {
+    pthread_mutex_destroy(&deque->lock);
+    free(deque->tasks);
+}
+
+static bool deque_push(worker_deque_t* deque, const worker_task_t* task) {
+    pthread_mutex_lock(&deque->lock);
+    
+    uint32_t size = deque->mask + 1;
+    if (deque->bottom - deque->top >= size) {
+        worker_task_t* tasks = calloc(size * 2, sizeof(worker_task_t));
+        if (!tasks) {
+            pthread_mutex_unlock(&deque->lock);
+            return false;
+        }
+        for (uint32_t i = deque->top; i != deque->bottom; i++) {
+            tasks[i & (size * 2 - 1)] = deque->tasks[i & deque->mask];
+        }
+        free(deque->tasks);
+        deque->tasks = tasks;
+        deque->mask = size * 2 - 1;
+    }
+    
+    // Indices are also read without the lock by deque_steal's empty check
+    deque->tasks[deque->bottom & deque->mask] = *task;
+    __atomic_store_n(&deque->bottom, deque->bottom + 1, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&deque->lock);
+    return true;
+}
+
+static bool deque_pop(worker_deque_t* deque, worker_task_t* task) {
+    pthread_mutex_lock(&deque->lock);
+    bool found = deque->bottom != deque->top;
+    if (found) {
+        __atomic_store_n(&deque->bottom, deque->bottom - 1, __ATOMIC_RELEASE);
+        *task = deque->tasks[deque->bottom & deque->mask];
+    }
+    pthread_mutex_unlock(&deque->lock);
+    return found;
+}
+
+static bool deque_steal(worker_deque_t* deque, worker_task_t* task) {
+    // Skip empty deques without taking the lock
+    if (__atomic_load_n(&deque->bottom, __ATOMIC_RELAXED) == __atomic_load_n(&deque->top, __ATOMIC_RELAXED)) {
+        return false;
+    }
+    
+    pthread_mutex_lock(&deque->lock);
+    bool found = deque->bottom != deque->top;
+    if (found) {
+        *task = deque->tasks[deque->top & deque->mask];
+        __atomic_store_n(&deque->top, deque->top + 1, __ATOMIC_RELEASE);
+    }
+    pthread_mutex_unlock(&deque->lock);
+    return found;
+}
+
+// Scheduling
+
+// Index of the calling thread's deque; external threads share the last one
+static uint32_t current_deque(worker_pool_t* pool) {
+    worker_thread_t* worker = pthread_getspecific(pool->worker_key);
+    return worker && worker->pool == pool ? worker->index : pool->thread_count;
+}
+
+static bool take_task(worker_pool_t* pool, uint32_t self, worker_task_t* task) {
+    bool found = deque_pop(&pool->deques[self], task);
+    for (uint32_t i = 1; !found && i < pool->deque_count; i++) {
+        found = deque_steal(&pool->deques[(self + i) % pool->deque_count], task);
+    }
+    if (found) __atomic_sub_fetch(&pool->queued, 1, __ATOMIC_ACQ_REL);
+    return found;
+}
+
+static void run_task(worker_task_t* task) {
+    task->fn(task->data);
+    if (task->group) __atomic_sub_fetch(&task->group->pending, 1, __ATOMIC_ACQ_REL);
+}
+
+static void* worker_main(void* arg) {
+    worker_thread_t* worker = arg;
+    worker_pool_t* pool = worker->pool;
+    pthread_setspecific(pool->worker_key, worker);
+    
+    for (;;) {
+        worker_task_t task;
+        if (take_task(pool, worker->index, &task)) {
+            run_task(&task);
+            continue;
+        }
+        
+        pthread_mutex_lock(&pool->sleep_lock);
+        while (!pool->stopping && __atomic_load_n(&pool->queued, __ATOMIC_ACQUIRE) == 0) {
+            pool->sleepers++;
+            pthread_cond_wait(&pool->wake, &pool->sleep_lock);
+            pool->sleepers--;
+        }
+        bool stopping = pool->stopping;
+        pthread_mutex_unlock(&pool->sleep_lock);
+        if (stopping) break;
+    }
+    
+    return NULL;
+}
+
+// Pool lifecycle
+
+worker_pool_t* worker_pool_create(uint32_t thread_count) {
+    if (thread_count == 0) return NULL;
+    
+    worker_pool_t* pool = calloc(1, sizeof(worker_pool_t));
+    if (!pool) return NULL;
+    
+    pool->deque_count = thread_count + 1;
+    pool->deques = calloc(pool->deque_count, sizeof(worker_deque_t));
+    pool->threads = calloc(thread_count, sizeof(pthread_t));
+    pool->workers = calloc(thread_count, sizeof(worker_thread_t));
+    if (!pool->deques || !pool->threads || !pool->workers || pthread_key_create(&pool->worker_key, NULL) != 0) {
+        free(pool->deques);
+        free(pool->threads);
+        free(pool->workers);
+        free(pool);
+        return NULL;
+    }
+    
+    uint32_t initialised = 0;
+    while (initialised < pool->deque_count && deque_init(&pool->deques[initialised])) initialised++;
+    if (initialised < pool->deque_count) {
+        for (uint32_t i = 0; i < initialised; i++) deque_destroy(&pool->deques[i]);
+        pthread_key_delete(pool->worker_key);
+        free(pool->deques);
+        free(pool->threads);
+        free(pool->workers);
+        free(pool);
+        return NULL;
+    }
+    
+    pthread_mutex_init(&pool->sleep_lock, NULL);
+    pthread_cond_init(&pool->wake, NULL);
+    
+    // The external deque index is thread_count, so all threads must start
+    for (uint32_t i = 0; i < thread_count; i++) {
+        pool->workers[i].pool = pool;
+        pool->workers[i].index = i;
+        if (pthread_create(&pool->threads[i], NULL, worker_main, &pool->workers[i]) != 0) {
+            worker_pool_destroy(pool);
+            return NULL;
+        }
+        pool->thread_count++;
+    }
+    
+    return pool;
+}
+
+void worker_pool_destroy(worker_pool_t* pool) {
+    if (!pool) return;
+    
+    pthread_mutex_lock(&pool->sleep_lock);
+    pool->stopping = true;
+    pthread_cond_broadcast(&pool->wake);
+    pthread_mutex_unlock(&pool->sleep_lock);
+    
+    for (uint32_t i = 0; i < pool->thread_count; i++) {
+        pthread_join(pool->threads[i], NULL);
+    }
+    
+    // Tasks still queued were never waited on; run them so groups drain
+    worker_task_t task;
+    for (uint32_t i = 0; i < pool->deque_count; i++) {
+        while (deque_pop(&pool->deques[i], &task)) run_task(&task);
+        deque_destroy(&pool->deques[i]);
+    }
+    
+    pthread_mutex_destroy(&pool->sleep_lock);
+    pthread_cond_destroy(&pool->wake);
+    pthread_key_delete(pool->worker_key);
+    free(pool->deques);
+    free(pool->threads);
+    free(pool->workers);
+    free(pool);
+}
+
+uint32_t worker_pool_thread_count(const worker_pool_t* pool) {
+    return pool ? pool->thread_count : 0;
+}
+
+// Tasks
+
+void worker_pool_submit(worker_pool_t* pool, worker_group_t* group, worker_task_fn_t fn, void* data) {
+    if (!fn) return;
+    
+    worker_task_t task = { .fn = fn, .data = data, .group = group };
+    if (group) __atomic_add_fetch(&group->pending, 1, __ATOMIC_ACQ_REL);
+    
+    if (!pool || !deque_push(&pool->deques[current_deque(pool)], &task)) {
+        run_task(&task);
+        return;
+    }
+    
+    // Taking the lock orders this against a worker about to sleep
+    pthread_mutex_lock(&pool->sleep_lock);
+    __atomic_add_fetch(&pool->queued, 1, __ATOMIC_ACQ_REL);
+    if (pool->sleepers) pthread_cond_signal(&pool->wake);
+    pthread_mutex_unlock(&pool->sleep_lock);
+}
+
+void worker_pool_wait(worker_pool_t* pool, worker_group_t* group) {
+    if (!group) return;
+    
+    uint32_t self = pool ? current_deque(pool) : 0;
+    while (__atomic_load_n(&group->pending, __ATOMIC_ACQUIRE) != 0) {
+        worker_task_t task;
+        if (pool && take_task(pool, self, &task)) {
+            run_task(&task);
+        } else {
+            sched_yield();
+        }
+    }
+}
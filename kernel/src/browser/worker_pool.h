@@ -0,0 +1,30 @@
+#ifndef WORKER_POOL_H
+#define WORKER_POOL_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Work-stealing thread pool. Every worker owns a deque: it pushes and pops
+// its own tasks at the bottom (newest first) and steals from the top of
+// the others' (oldest first) when it runs dry. Tasks submitted from
+// outside the pool go to a shared deque that workers steal from.
+//
+// Tasks are tracked by groups. worker_pool_wait runs queued tasks on the
+// calling thread until the group drains, so a task may submit and wait on
+// a nested group without tying up a worker.
+typedef struct worker_pool worker_pool_t;
+typedef void (*worker_task_fn_t)(void* data);
+
+typedef struct {
+    uint32_t pending;               // Zero-initialise before first use
+} worker_group_t;
+
+worker_pool_t* worker_pool_create(uint32_t thread_count);
+void worker_pool_destroy(worker_pool_t* pool);
+uint32_t worker_pool_thread_count(const worker_pool_t* pool);
+
+// With a NULL pool or on allocation failure the task runs inline
+void worker_pool_submit(worker_pool_t* pool, worker_group_t* group, worker_task_fn_t fn, void* data);
+void worker_pool_wait(worker_pool_t* pool, worker_group_t* group);
+
+#endif